@@ -13,6 +13,7 @@
 
 #include "iothub_message.h"
 #include "internal/iothub_transport_ll_private.h"
+#include "internal/timeout_heap.h"
 #include "iothub_client_core_common.h"
 #include "iothub_client_core_ll.h"
 
@@ -49,6 +50,12 @@ typedef struct IOTHUB_MESSAGE_LIST_TAG
     DLIST_ENTRY entry;
     tickcounter_ms_t ms_timesOutAfter; /* a value of "0" means "no timeout", if the IOTHUBCLIENT_LL's handle tickcounter > msTimesOutAfer then the message shall timeout*/
     tickcounter_ms_t message_timeout_value;
+    size_t message_size; /* payload bytes accounted against OPTION_MAX_QUEUED_BYTES, 0 when no byte limit was set at the time the message was queued*/
+    IOTHUB_MESSAGE_PRIORITY priority; /* position of the message in waitingToSend, starts as the message priority and is raised if the message is overtaken too many times*/
+    size_t times_overtaken; /* number of higher priority messages queued ahead of this one*/
+    size_t store_position; /* position of the message in the message store, 0 when it is not stored*/
+    uint64_t queue_sequence; /* increases with the position of the message among the messages of its priority in waitingToSend*/
+    TIMEOUT_HEAP_ENTRY timeout_entry; /* deadline of the message, only in the client's timeout heap while the message has a timeout*/
 }IOTHUB_MESSAGE_LIST;
 
 typedef struct IOTHUB_DEVICE_TWIN_TAG
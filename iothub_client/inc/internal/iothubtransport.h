@@ -42,6 +42,13 @@ extern "C"
     MOCKABLE_FUNCTION(, bool, IoTHubTransport_SignalEndWorkerThread, TRANSPORT_HANDLE, transportHandle, IOTHUB_CLIENT_CORE_HANDLE, clientHandle);
     MOCKABLE_FUNCTION(, void, IoTHubTransport_JoinWorkerThread, TRANSPORT_HANDLE, transportHandle, IOTHUB_CLIENT_CORE_HANDLE, clientHandle);
 
+    /* Both functions below take the lock returned by IoTHubTransport_GetLock, so they shall not be called with it held. */
+    MOCKABLE_FUNCTION(, IOTHUB_CLIENT_RESULT, IoTHubTransport_SetWorkerIdleTime, TRANSPORT_HANDLE, transportHandle, unsigned int, idleTimeInMs);
+    MOCKABLE_FUNCTION(, void, IoTHubTransport_SignalWork, TRANSPORT_HANDLE, transportHandle);
+
+    /* Shall be called before the worker thread is started, with the lock returned by IoTHubTransport_GetLock held. */
+    MOCKABLE_FUNCTION(, IOTHUB_CLIENT_RESULT, IoTHubTransport_SetWorkerThreadCount, TRANSPORT_HANDLE, transportHandle, size_t, threadCount);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,92 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+/** @file    message_store.h
+*    @brief    A persistent store for the telemetry messages waiting to be sent, kept in a memory-mapped log on local disk.
+*
+*    @remarks  The log is split in MESSAGE_STORE_SEGMENT_COUNT files of MESSAGE_STORE_SEGMENT_SIZE bytes, used as a ring.
+*              Appending a message only copies it into the mapped memory; the log is flushed to disk by message_store_commit,
+*              once for all the messages appended since the previous commit. A segment is reused once all its messages
+*              have been released. The messages that were never released are handed back when the store is opened again.
+*              The log uses the native byte order, so it can only be read by the device that wrote it.
+*/
+
+#ifndef MESSAGE_STORE_H
+#define MESSAGE_STORE_H
+
+#ifdef __cplusplus
+#include <cstddef>
+#else
+#include <stddef.h>
+#endif
+
+#include "umock_c/umock_c_prod.h"
+#include "iothub_message.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+typedef struct MESSAGE_STORE_TAG* MESSAGE_STORE_HANDLE;
+
+/**
+* @brief    Called by message_store_open for every message of the log that was never released, oldest first.
+*
+* @param    message     The stored message. The callee owns it.
+* @param    position    The position of the message in the log, to be passed to message_store_release.
+* @param    context     The context passed to message_store_open.
+*/
+typedef void(*ON_STORED_MESSAGE)(IOTHUB_MESSAGE_HANDLE message, size_t position, void* context);
+
+/**
+* @brief    Opens, or creates, the log kept in @c directory, and replays the messages it contains.
+*
+* @param    directory            An existing directory the log files are kept in.
+* @param    on_stored_message    Called for every message of the log that was never released.
+* @param    context              Passed to @c on_stored_message.
+*
+* @returns  A handle to the store, or NULL if the log cannot be opened.
+*/
+MOCKABLE_FUNCTION(, MESSAGE_STORE_HANDLE, message_store_open, const char*, directory, ON_STORED_MESSAGE, on_stored_message, void*, context);
+
+/**
+* @brief    Flushes the log to disk and closes it. The messages that were not released are kept.
+*
+* @param    store    The store to be closed.
+*/
+MOCKABLE_FUNCTION(, void, message_store_close, MESSAGE_STORE_HANDLE, store);
+
+/**
+* @brief    Appends a message to the log. The message is only guaranteed to be on disk after the next message_store_commit.
+*
+* @param    store       The store the message is appended to.
+* @param    message     The message to be stored. Its payload, properties and system properties are saved.
+* @param    position    Receives the position of the message in the log, never 0.
+*
+* @returns  0 on success, a non-zero value if the message is too large or the log is full.
+*/
+MOCKABLE_FUNCTION(, int, message_store_append, MESSAGE_STORE_HANDLE, store, IOTHUB_MESSAGE_HANDLE, message, size_t*, position);
+
+/**
+* @brief    Marks a message as done with, so it is not replayed and its space can be reused.
+*
+* @param    store       The store the message was appended to.
+* @param    position    The position returned by message_store_append, or passed to ON_STORED_MESSAGE.
+*/
+MOCKABLE_FUNCTION(, void, message_store_release, MESSAGE_STORE_HANDLE, store, size_t, position);
+
+/**
+* @brief    Flushes to disk all the changes made to the log since the previous commit.
+*
+* @param    store    The store to be flushed.
+*
+* @returns  0 on success, a non-zero value otherwise.
+*/
+MOCKABLE_FUNCTION(, int, message_store_commit, MESSAGE_STORE_HANDLE, store);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* MESSAGE_STORE_H */
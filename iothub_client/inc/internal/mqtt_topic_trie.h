@@ -0,0 +1,83 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+/** @file    mqtt_topic_trie.h
+*    @brief    A compressed prefix trie classifying MQTT topic names by the longest known prefix they start with.
+*
+*    @remarks  The prefixes are matched without regard to ASCII case, in a single walk over the topic that
+*              stops at the first character no prefix continues with. The nodes are stored inside the trie
+*              itself, so neither adding prefixes nor matching topics allocates memory. Node labels point
+*              into the prefixes that were added, which must outlive the trie or be added again after it is
+*              initialized.
+*/
+
+#ifndef MQTT_TOPIC_TRIE_H
+#define MQTT_TOPIC_TRIE_H
+
+#ifdef __cplusplus
+#include <cstddef>
+#else
+#include <stddef.h>
+#endif
+
+#include "umock_c/umock_c_prod.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#define MQTT_TOPIC_TRIE_MAX_NODES 16
+#define MQTT_TOPIC_TRIE_NO_MATCH  -1
+
+typedef struct MQTT_TOPIC_TRIE_NODE_TAG
+{
+    const char* label;   /* Points into the prefix the node was added from. */
+    size_t label_length;
+    size_t first_child;  /* 0 for none, as the root is node 0 and never a child. */
+    size_t next_sibling; /* 0 for none. */
+    int value;           /* MQTT_TOPIC_TRIE_NO_MATCH unless a prefix ends at this node. */
+} MQTT_TOPIC_TRIE_NODE;
+
+typedef struct MQTT_TOPIC_TRIE_TAG
+{
+    size_t node_count;
+    MQTT_TOPIC_TRIE_NODE nodes[MQTT_TOPIC_TRIE_MAX_NODES];
+} MQTT_TOPIC_TRIE;
+
+/**
+* @brief    Initializes a trie without any prefix.
+*
+* @param    trie    The trie to be initialized.
+*/
+MOCKABLE_FUNCTION(, void, mqtt_topic_trie_initialize, MQTT_TOPIC_TRIE*, trie);
+
+/**
+* @brief    Adds @c prefix to the trie, so that topics starting with it match @c value.
+*
+* @param    trie             The trie the prefix is added to.
+* @param    prefix           The prefix, not copied. An empty prefix matches every topic no other prefix does.
+* @param    prefix_length    The number of characters of @c prefix to add.
+* @param    value            The value topics starting with @c prefix match. Must not be negative. Replaces
+*                            the value of a prefix added before with the same characters.
+*
+* @returns  0 on success, a non-zero value if the arguments are invalid or the trie has no room for the prefix.
+*/
+MOCKABLE_FUNCTION(, int, mqtt_topic_trie_add, MQTT_TOPIC_TRIE*, trie, const char*, prefix, size_t, prefix_length, int, value);
+
+/**
+* @brief    Finds the longest prefix added to the trie that @c topic starts with.
+*
+* @param    trie              The trie to search.
+* @param    topic             The NULL-terminated topic name.
+* @param    matched_length    Optional. Receives the length of the matched prefix, 0 if there is none.
+*
+* @returns  The value of the matched prefix, or MQTT_TOPIC_TRIE_NO_MATCH if @c topic starts with no prefix.
+*/
+MOCKABLE_FUNCTION(, int, mqtt_topic_trie_match, const MQTT_TOPIC_TRIE*, trie, const char*, topic, size_t*, matched_length);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* MQTT_TOPIC_TRIE_H */
@@ -0,0 +1,97 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+/** @file    packet_id_table.h
+*    @brief    An open-addressing hash table indexing in-flight items by their 16-bit MQTT packet id.
+*
+*    @remarks  Lookups and removals are O(1), so acknowledging one of many in-flight messages does not
+*              walk the list they are kept in. The first slots are stored inside the table itself, so
+*              a small number of in-flight items never allocates memory; the table only grows on the
+*              heap when more items are added. A table must not be moved or copied once initialized.
+*/
+
+#ifndef PACKET_ID_TABLE_H
+#define PACKET_ID_TABLE_H
+
+#ifdef __cplusplus
+#include <cstddef>
+#include <cstdint>
+#else
+#include <stddef.h>
+#include <stdint.h>
+#endif
+
+#include "umock_c/umock_c_prod.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#define PACKET_ID_TABLE_INLINE_SLOT_COUNT 16
+
+typedef struct PACKET_ID_TABLE_SLOT_TAG
+{
+    void* value; /* NULL for a free slot */
+    uint16_t packet_id;
+} PACKET_ID_TABLE_SLOT;
+
+typedef struct PACKET_ID_TABLE_TAG
+{
+    PACKET_ID_TABLE_SLOT* slots;
+    size_t slot_count_bits;
+    size_t count;
+    PACKET_ID_TABLE_SLOT inline_slots[PACKET_ID_TABLE_INLINE_SLOT_COUNT];
+} PACKET_ID_TABLE;
+
+/**
+* @brief    Initializes an empty table.
+*
+* @param    table    The table to be initialized.
+*/
+MOCKABLE_FUNCTION(, void, packet_id_table_initialize, PACKET_ID_TABLE*, table);
+
+/**
+* @brief    Frees the memory the table allocated and leaves it empty. The values are not touched.
+*
+* @param    table    The table to be deinitialized.
+*/
+MOCKABLE_FUNCTION(, void, packet_id_table_deinitialize, PACKET_ID_TABLE*, table);
+
+/**
+* @brief    Adds @c value to the table under @c packet_id.
+*
+* @param    table        The table the value is added to.
+* @param    packet_id    The packet id the value is indexed by. Must not already be in the table.
+* @param    value        The value to be added. Cannot be NULL.
+*
+* @returns  0 on success, a non-zero value if the arguments are invalid, @c packet_id is already in the table
+*           or the table could not grow.
+*/
+MOCKABLE_FUNCTION(, int, packet_id_table_insert, PACKET_ID_TABLE*, table, uint16_t, packet_id, void*, value);
+
+/**
+* @brief    Returns the value indexed by @c packet_id, leaving it in the table.
+*
+* @param    table        The table to search.
+* @param    packet_id    The packet id to search for.
+*
+* @returns  The value, or NULL if @c packet_id is not in the table.
+*/
+MOCKABLE_FUNCTION(, void*, packet_id_table_find, PACKET_ID_TABLE*, table, uint16_t, packet_id);
+
+/**
+* @brief    Removes the value indexed by @c packet_id from the table.
+*
+* @param    table        The table to remove the value from.
+* @param    packet_id    The packet id of the value.
+*
+* @returns  The removed value, or NULL if @c packet_id is not in the table.
+*/
+MOCKABLE_FUNCTION(, void*, packet_id_table_remove, PACKET_ID_TABLE*, table, uint16_t, packet_id);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PACKET_ID_TABLE_H */
@@ -0,0 +1,100 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+/** @file    timeout_heap.h
+*    @brief    An intrusive min-heap of deadlines, used to process timeouts in O(expired) per DoWork.
+*
+*    @remarks  Like DLIST_ENTRY, a TIMEOUT_HEAP_ENTRY is embedded in the structure being tracked and
+*              recovered with containingRecord. The heap never allocates memory, so inserting and
+*              removing entries cannot fail. Entries with the same deadline expire in insertion order.
+*/
+
+#ifndef TIMEOUT_HEAP_H
+#define TIMEOUT_HEAP_H
+
+#ifdef __cplusplus
+#include <cstddef>
+#else
+#include <stddef.h>
+#include <stdbool.h>
+#endif
+
+#include "azure_c_shared_utility/tickcounter.h"
+#include "umock_c/umock_c_prod.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+typedef struct TIMEOUT_HEAP_ENTRY_TAG
+{
+    tickcounter_ms_t deadline;
+    size_t sequence;
+    struct TIMEOUT_HEAP_ENTRY_TAG* child;
+    struct TIMEOUT_HEAP_ENTRY_TAG* next;
+    struct TIMEOUT_HEAP_ENTRY_TAG* prev; /* previous sibling, or the parent for the first child; NULL for the root and for entries not in a heap */
+} TIMEOUT_HEAP_ENTRY;
+
+typedef struct TIMEOUT_HEAP_TAG
+{
+    TIMEOUT_HEAP_ENTRY* root;
+    size_t next_sequence;
+    size_t count;
+} TIMEOUT_HEAP;
+
+/**
+* @brief    Initializes an empty heap.
+*
+* @param    heap    The heap to be initialized.
+*/
+MOCKABLE_FUNCTION(, void, timeout_heap_initialize, TIMEOUT_HEAP*, heap);
+
+/**
+* @brief    Adds an entry to the heap, expiring at @c deadline.
+*
+* @remarks  @c entry must not currently be in a heap. To reschedule an entry, remove it first.
+*
+* @param    heap        The heap the entry is added to.
+* @param    entry       The entry embedded in the structure being tracked.
+* @param    deadline    The tick (in milliseconds) at which the entry expires.
+*/
+MOCKABLE_FUNCTION(, void, timeout_heap_insert, TIMEOUT_HEAP*, heap, TIMEOUT_HEAP_ENTRY*, entry, tickcounter_ms_t, deadline);
+
+/**
+* @brief    Removes an entry from the heap, before it expires.
+*
+* @remarks  Removing an entry that is not in @c heap (e.g. one previously returned by timeout_heap_pop_expired) has no effect,
+*           as long as it was zero-initialized or has been in a heap before.
+*
+* @param    heap     The heap the entry was added to.
+* @param    entry    The entry to be removed.
+*/
+MOCKABLE_FUNCTION(, void, timeout_heap_remove, TIMEOUT_HEAP*, heap, TIMEOUT_HEAP_ENTRY*, entry);
+
+/**
+* @brief    Returns the entry with the earliest deadline without removing it.
+*
+* @param    heap    The heap to inspect.
+*
+* @returns  The entry with the earliest deadline, or NULL if the heap is empty.
+*/
+MOCKABLE_FUNCTION(, TIMEOUT_HEAP_ENTRY*, timeout_heap_peek, TIMEOUT_HEAP*, heap);
+
+/**
+* @brief    Removes and returns the entry with the earliest deadline, if that deadline is not after @c current_ms.
+*
+* @remarks  Callers drain all expired entries by calling this function until it returns NULL.
+*
+* @param    heap          The heap to inspect.
+* @param    current_ms    The current tick (in milliseconds).
+*
+* @returns  The expired entry with the earliest deadline, or NULL if no entry has expired.
+*/
+MOCKABLE_FUNCTION(, TIMEOUT_HEAP_ENTRY*, timeout_heap_pop_expired, TIMEOUT_HEAP*, heap, tickcounter_ms_t, current_ms);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* TIMEOUT_HEAP_H */
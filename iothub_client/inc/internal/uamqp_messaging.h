@@ -13,8 +13,17 @@ extern "C"
 {
 #endif
 
+    // Grow-only buffer an AMQP message is encoded into, reused across messages by its owner.
+    typedef struct UAMQP_ENCODING_BUFFER_TAG
+    {
+        unsigned char* bytes;
+        size_t capacity;
+        size_t max_capacity;
+    } UAMQP_ENCODING_BUFFER;
+
     MOCKABLE_FUNCTION(, int, message_create_IoTHubMessage_from_uamqp_message, MESSAGE_HANDLE, uamqp_message, IOTHUB_MESSAGE_HANDLE*, iothubclient_message);
     MOCKABLE_FUNCTION(, int, message_create_uamqp_encoding_from_iothub_message, MESSAGE_HANDLE, message_batch_container, IOTHUB_MESSAGE_HANDLE, message_handle, BINARY_DATA*, body_binary_data);
+    MOCKABLE_FUNCTION(, int, message_create_uamqp_encoding_from_iothub_message_into_buffer, MESSAGE_HANDLE, message_batch_container, IOTHUB_MESSAGE_HANDLE, message_handle, UAMQP_ENCODING_BUFFER*, encoding_buffer, BINARY_DATA*, body_binary_data);
 
 #ifdef __cplusplus
 }
@@ -29,7 +29,8 @@ extern "C"
     IOTHUB_CLIENT_INVALID_ARG,            \
     IOTHUB_CLIENT_ERROR,                  \
     IOTHUB_CLIENT_INVALID_SIZE,           \
-    IOTHUB_CLIENT_INDEFINITE_TIME
+    IOTHUB_CLIENT_INDEFINITE_TIME,        \
+    IOTHUB_CLIENT_QUEUE_FULL
 
     /** @brief Enumeration specifying the status of calls to various APIs in this module.
     */
@@ -102,7 +103,8 @@ extern "C"
     IOTHUB_CLIENT_CONFIRMATION_OK,                   \
     IOTHUB_CLIENT_CONFIRMATION_BECAUSE_DESTROY,      \
     IOTHUB_CLIENT_CONFIRMATION_MESSAGE_TIMEOUT,      \
-    IOTHUB_CLIENT_CONFIRMATION_ERROR                 \
+    IOTHUB_CLIENT_CONFIRMATION_ERROR,                \
+    IOTHUB_CLIENT_CONFIRMATION_MESSAGE_DROPPED       \
 
     /** @brief Enumeration passed in by the IoT Hub when the event confirmation
     *           callback is invoked to indicate status of the event processing in
@@ -110,6 +112,37 @@ extern "C"
     */
     MU_DEFINE_ENUM_WITHOUT_INVALID(IOTHUB_CLIENT_CONFIRMATION_RESULT, IOTHUB_CLIENT_CONFIRMATION_RESULT_VALUES);
 
+#define IOTHUB_CLIENT_BATCH_CONFIRMATION_VALUES      \
+    IOTHUB_CLIENT_BATCH_CONFIRMATION_PER_MESSAGE,    \
+    IOTHUB_CLIENT_BATCH_CONFIRMATION_PER_BATCH       \
+
+    /** @brief Enumeration passed to the SendEventBatchAsync APIs to select whether the
+    *           event confirmation callback is invoked once per message or once for the
+    *           whole batch.
+    */
+    MU_DEFINE_ENUM_WITHOUT_INVALID(IOTHUB_CLIENT_BATCH_CONFIRMATION, IOTHUB_CLIENT_BATCH_CONFIRMATION_VALUES);
+
+#define IOTHUB_CLIENT_QUEUE_FULL_POLICY_VALUES           \
+    IOTHUB_CLIENT_QUEUE_FULL_REJECT,                     \
+    IOTHUB_CLIENT_QUEUE_FULL_DROP_OLDEST,                \
+    IOTHUB_CLIENT_QUEUE_FULL_DROP_LOWEST_PRIORITY        \
+
+    /** @brief Enumeration passed to the OPTION_QUEUE_FULL_POLICY option to select what
+    *           SendEventAsync does when the outgoing queue has reached OPTION_MAX_QUEUED_MESSAGES
+    *           or OPTION_MAX_QUEUED_BYTES. Dropped messages are completed with
+    *           IOTHUB_CLIENT_CONFIRMATION_MESSAGE_DROPPED.
+    */
+    MU_DEFINE_ENUM_WITHOUT_INVALID(IOTHUB_CLIENT_QUEUE_FULL_POLICY, IOTHUB_CLIENT_QUEUE_FULL_POLICY_VALUES);
+
+#define IOTHUB_CLIENT_QUEUE_STATE_VALUES                 \
+    IOTHUB_CLIENT_QUEUE_STATE_HIGH_WATERMARK,            \
+    IOTHUB_CLIENT_QUEUE_STATE_LOW_WATERMARK              \
+
+    /** @brief Enumeration passed to the outgoing queue state callback when the queue
+    *           rises to its high watermark or drains back to its low watermark.
+    */
+    MU_DEFINE_ENUM_WITHOUT_INVALID(IOTHUB_CLIENT_QUEUE_STATE, IOTHUB_CLIENT_QUEUE_STATE_VALUES);
+
 #define IOTHUB_CLIENT_CONNECTION_STATUS_VALUES             \
     IOTHUB_CLIENT_CONNECTION_AUTHENTICATED,                \
     IOTHUB_CLIENT_CONNECTION_UNAUTHENTICATED               \
@@ -150,6 +183,7 @@ extern "C"
     MU_DEFINE_ENUM_WITHOUT_INVALID(DEVICE_TWIN_UPDATE_STATE, DEVICE_TWIN_UPDATE_STATE_VALUES);
 
     typedef void(*IOTHUB_CLIENT_EVENT_CONFIRMATION_CALLBACK)(IOTHUB_CLIENT_CONFIRMATION_RESULT result, void* userContextCallback);
+    typedef void(*IOTHUB_CLIENT_QUEUE_STATE_CALLBACK)(IOTHUB_CLIENT_QUEUE_STATE queue_state, size_t queued_messages, size_t queued_bytes, void* userContextCallback);
     typedef void(*IOTHUB_CLIENT_CONNECTION_STATUS_CALLBACK)(IOTHUB_CLIENT_CONNECTION_STATUS result, IOTHUB_CLIENT_CONNECTION_STATUS_REASON reason, void* userContextCallback);
     typedef IOTHUBMESSAGE_DISPOSITION_RESULT (*IOTHUB_CLIENT_MESSAGE_CALLBACK_ASYNC)(IOTHUB_MESSAGE_HANDLE message, void* userContextCallback);
 
@@ -181,6 +215,23 @@ extern "C"
     typedef void(*IOTHUB_CLIENT_FILE_UPLOAD_GET_DATA_CALLBACK)(IOTHUB_CLIENT_FILE_UPLOAD_RESULT result, unsigned char const ** data, size_t* size, void* context);
     typedef IOTHUB_CLIENT_FILE_UPLOAD_GET_DATA_RESULT(*IOTHUB_CLIENT_FILE_UPLOAD_GET_DATA_CALLBACK_EX)(IOTHUB_CLIENT_FILE_UPLOAD_RESULT result, unsigned char const ** data, size_t* size, void* context);
 
+    /** @brief    Identifies an upload started by IoTHubDeviceClient_QueueUploadToBlobAsync or IoTHubDeviceClient_QueueUploadMultipleBlocksToBlobAsync.
+    *             Ids are never 0 and are not reused while the client exists, unless 2^32 uploads are started.
+    */
+    typedef uint32_t IOTHUB_CLIENT_UPLOAD_JOB_ID;
+
+    /** @brief    The round trip time between sending telemetry and receiving its acknowledgement on the current connection, read with IoTHubDeviceClient_GetRttStatistics.
+    *             resend_timeout_ms is how long a message waits for its acknowledgement before being resent.
+    *             All fields but resend_timeout_ms are 0 until a round trip time is measured.
+    */
+    typedef struct IOTHUB_CLIENT_RTT_STATISTICS_TAG
+    {
+        size_t smoothed_rtt_ms;
+        size_t rtt_variance_ms;
+        size_t resend_timeout_ms;
+        size_t sample_count;
+    } IOTHUB_CLIENT_RTT_STATISTICS;
+
     /** @brief    This struct captures IoTHub client configuration. */
     typedef struct IOTHUB_CLIENT_CONFIG_TAG
     {
@@ -4,6 +4,12 @@
 #ifndef IOTHUB_CLIENT_OPTIONS_H
 #define IOTHUB_CLIENT_OPTIONS_H
 
+#ifdef __cplusplus
+#include <cstddef>
+#else
+#include <stddef.h>
+#endif
+
 #include "azure_c_shared_utility/const_defines.h"
 
 #ifdef __cplusplus
@@ -38,6 +44,19 @@ extern "C"
     static STATIC_VAR_UNUSED const char* OPTION_MIN_POLLING_TIME = "MinimumPollingTime";
     static STATIC_VAR_UNUSED const char* OPTION_BATCHING = "Batching";
 
+    /*
+    * @brief Turns on adaptive cloud-to-device polling for HTTP. The device polls again right after a message is received
+    *        and doubles the time between polls, from OPTION_MIN_POLLING_TIME up to OPTION_MAX_POLLING_TIME, while its queue is empty.
+    */
+    static STATIC_VAR_UNUSED const char* OPTION_ADAPTIVE_POLLING = "AdaptivePolling";
+    static STATIC_VAR_UNUSED const char* OPTION_MAX_POLLING_TIME = "MaximumPollingTime";
+
+    /*
+    * @brief Number of HTTP connections, from 1 (default) to 64, a shared HTTP transport spreads its devices over.
+    *        Each connection beyond the first runs its devices' requests on its own thread during DoWork.
+    */
+    static STATIC_VAR_UNUSED const char* OPTION_HTTP_CONNECTION_POOL_SIZE = "HttpConnectionPoolSize";
+
     /* DEPRECATED:: OPTION_MESSAGE_TIMEOUT is DEPRECATED! Use OPTION_SERVICE_SIDE_KEEP_ALIVE_FREQ_SECS for AMQP; MQTT has no option available. OPTION_MESSAGE_TIMEOUT legacy variable will be kept for back-compat.  */
     static STATIC_VAR_UNUSED const char* OPTION_MESSAGE_TIMEOUT = "messageTimeout";
     static STATIC_VAR_UNUSED const char* OPTION_BLOB_UPLOAD_TIMEOUT_SECS = "blob_upload_timeout_secs";
@@ -53,6 +72,39 @@ extern "C"
     */
     static STATIC_VAR_UNUSED const char* OPTION_AUTO_URL_ENCODE_DECODE = "auto_url_encode_decode";
 
+    /*
+    * @brief    Maximum number of telemetry messages (size_t) published and waiting for their PUBACK. Messages queued behind
+    *           are published as acknowledgements arrive. 0 (the default) means no limit. Only valid for use with MQTT Transport
+    */
+    static STATIC_VAR_UNUSED const char* OPTION_MQTT_MAX_INFLIGHT = "mqtt_max_inflight";
+
+    /*
+    * @brief    Maximum number of telemetry messages (size_t) published by each DoWork call. 0 (the default) means no limit.
+    *           Only valid for use with MQTT Transport
+    */
+    static STATIC_VAR_UNUSED const char* OPTION_MQTT_PUBLISH_BUDGET_MESSAGES = "mqtt_publish_budget_messages";
+
+    /*
+    * @brief    Maximum number of telemetry payload bytes (size_t) published by each DoWork call. A message larger than the budget
+    *           is still published, alone. 0 (the default) means no limit. Only valid for use with MQTT Transport
+    */
+    static STATIC_VAR_UNUSED const char* OPTION_MQTT_PUBLISH_BUDGET_BYTES = "mqtt_publish_budget_bytes";
+
+    /*
+    * @brief    Publishes telemetry with QoS 0 (bool). Messages are confirmed with IOTHUB_CLIENT_CONFIRMATION_OK once handed to the
+    *           connection, and are neither acknowledged by the hub nor resent, so they can be lost. Off by default.
+    *           Only valid for use with MQTT Transport
+    */
+    static STATIC_VAR_UNUSED const char* OPTION_MQTT_TELEMETRY_AT_MOST_ONCE = "mqtt_telemetry_at_most_once";
+
+    /*
+    * @brief    Relies on the session the hub keeps across connections (bool). When a CONNACK reports the session present, the
+    *           topics subscribed to in that session are not subscribed to again and the twin is only retrieved again if a
+    *           desired properties patch was missed. Desired properties patches are subscribed to with QoS 1. Off by default.
+    *           Only valid for use with MQTT Transport
+    */
+    static STATIC_VAR_UNUSED const char* OPTION_MQTT_PERSISTENT_SESSION = "mqtt_persistent_session";
+
     /*
     * @brief Informs the service of what is the maximum period the client will wait for a keep-alive message from the service.
     *        The service must send keep-alives before this timeout is reached, otherwise the client will trigger its re-connection logic.
@@ -86,6 +138,99 @@ extern "C"
 
     static STATIC_VAR_UNUSED const char* OPTION_DO_WORK_FREQUENCY_IN_MS = "do_work_freq_ms";
 
+    /*
+    * @brief Longest time (tickcounter_ms_t, up to 1000) the worker thread of the convenience layer waits between two calls to DoWork
+    *        while nothing is queued to be sent. Sending wakes the worker thread up at once. Data from IoT Hub, like cloud-to-device
+    *        messages and send confirmations, can be delayed by up to this time. Not set by default, DoWork is then called every
+    *        OPTION_DO_WORK_FREQUENCY_IN_MS. On a shared transport it applies to the worker thread of the transport.
+    */
+    static STATIC_VAR_UNUSED const char* OPTION_DO_WORK_IDLE_FREQ_IN_MS = "do_work_idle_freq_ms";
+
+    /*
+    * @brief Number of threads (size_t, 1 up to the number of callback types) the convenience layer runs the user callbacks on, instead
+    *        of its worker thread, so a slow callback does not delay the traffic with IoT Hub. All the callbacks of one type run on the
+    *        same thread, in the order they were received. Can only be set once. Not set by default.
+    */
+    static STATIC_VAR_UNUSED const char* OPTION_CALLBACK_DISPATCHER_THREADS = "callback_dispatcher_threads";
+
+    /*
+    * @brief Maximum number of callbacks (size_t) waiting to be run by each thread started with OPTION_CALLBACK_DISPATCHER_THREADS.
+    *        Callbacks that do not fit stay queued in the client until that thread catches up. The default is 64.
+    */
+    static STATIC_VAR_UNUSED const char* OPTION_CALLBACK_DISPATCHER_QUEUE_SIZE = "callback_dispatcher_queue_size";
+
+    /*
+    * @brief Maximum number of user callbacks (size_t) the worker thread runs for a client on each of its passes, so a client with a large
+    *        backlog of confirmations or messages does not delay the other clients of a shared transport. The other callbacks stay queued,
+    *        in order, for the next pass. 0 (the default) runs all of them. Does not apply once OPTION_CALLBACK_DISPATCHER_THREADS is set.
+    */
+    static STATIC_VAR_UNUSED const char* OPTION_DO_WORK_CALLBACK_BUDGET = "do_work_callback_budget";
+
+    /*
+    * @brief Number of threads (size_t, 1-64) serving the clients of a shared transport. The clients are spread over the threads, each
+    *        with its own lock; the transport itself keeps being driven by a single thread. Only valid on a client created with a shared
+    *        transport, before any client of that transport starts its worker thread. The default is 1.
+    */
+    static STATIC_VAR_UNUSED const char* OPTION_TRANSPORT_WORKER_THREADS = "transport_worker_threads";
+
+    /*
+    * @brief Maximum number of telemetry messages (size_t) SendEventAsync can queue for the worker thread of the convenience layer
+    *        without taking the lock the worker thread holds while calling DoWork. SendEventAsync fails with IOTHUB_CLIENT_QUEUE_FULL
+    *        when the worker thread has not caught up yet. Errors from the lower layer are then reported through the confirmation
+    *        callback. Can only be set once, before sending. Not set by default.
+    */
+    static STATIC_VAR_UNUSED const char* OPTION_SUBMISSION_QUEUE_SIZE = "submission_queue_size";
+
+    /*
+    * @brief Maximum number of telemetry messages (size_t) the client holds that have been accepted by SendEventAsync and not yet completed.
+    *        0 (the default) means no limit. What SendEventAsync does when the limit is reached is selected with OPTION_QUEUE_FULL_POLICY.
+    */
+    static STATIC_VAR_UNUSED const char* OPTION_MAX_QUEUED_MESSAGES = "max_queued_messages";
+
+    /*
+    * @brief Maximum number of payload bytes (size_t) of the telemetry messages accepted by SendEventAsync and not yet completed.
+    *        0 (the default) means no limit. Only the messages sent after this option is set are accounted for.
+    */
+    static STATIC_VAR_UNUSED const char* OPTION_MAX_QUEUED_BYTES = "max_queued_bytes";
+
+    /*
+    * @brief What SendEventAsync does when the outgoing queue is full (IOTHUB_CLIENT_QUEUE_FULL_POLICY).
+    *        The default IOTHUB_CLIENT_QUEUE_FULL_REJECT fails the call with IOTHUB_CLIENT_QUEUE_FULL.
+    */
+    static STATIC_VAR_UNUSED const char* OPTION_QUEUE_FULL_POLICY = "queue_full_policy";
+
+    /*
+    * @brief Percentage (unsigned int, 1-100) of OPTION_MAX_QUEUED_MESSAGES or OPTION_MAX_QUEUED_BYTES at which the queue state callback
+    *        is invoked with IOTHUB_CLIENT_QUEUE_STATE_HIGH_WATERMARK. The default is 80.
+    */
+    static STATIC_VAR_UNUSED const char* OPTION_QUEUE_HIGH_WATERMARK_PERCENT = "queue_high_watermark_percent";
+
+    /*
+    * @brief Percentage (unsigned int, 0-99, lower than the high watermark) both limits have to drain back to before the queue state callback
+    *        is invoked with IOTHUB_CLIENT_QUEUE_STATE_LOW_WATERMARK. The default is 50.
+    */
+    static STATIC_VAR_UNUSED const char* OPTION_QUEUE_LOW_WATERMARK_PERCENT = "queue_low_watermark_percent";
+
+    /*
+    * @brief Existing directory (const char*) where telemetry messages are kept until they are acknowledged, so they survive a restart.
+    *        Messages left from a previous run are queued again, without a confirmation callback, when the option is set.
+    *        Can only be set once, and only if the SDK is built with use_message_store.
+    */
+    static STATIC_VAR_UNUSED const char* OPTION_MESSAGE_STORE_DIRECTORY = "message_store_directory";
+
+    /*
+    * @brief Number of threads (size_t, 1-16) running the uploads started with UploadToBlobAsync and UploadMultipleBlocksToBlobAsync,
+    *        instead of one thread per upload. Uploads wait in a queue for a free thread and can be cancelled until one picks them up.
+    *        Can only be set once. Not set by default.
+    */
+    static STATIC_VAR_UNUSED const char* OPTION_BLOB_UPLOAD_WORKER_THREADS = "blob_upload_worker_threads";
+
+    /*
+    * @brief Maximum number of uploads (size_t) waiting for one of the threads started with OPTION_BLOB_UPLOAD_WORKER_THREADS.
+    *        Uploads that do not fit fail with IOTHUB_CLIENT_QUEUE_FULL. The default is 64.
+    */
+    static STATIC_VAR_UNUSED const char* OPTION_BLOB_UPLOAD_QUEUE_SIZE = "blob_upload_queue_size";
+
 #ifdef __cplusplus
 }
 #endif
@@ -128,6 +128,59 @@ extern "C"
     */
     MOCKABLE_FUNCTION(, IOTHUB_CLIENT_RESULT, IoTHubDeviceClient_SendEventAsync, IOTHUB_DEVICE_CLIENT_HANDLE, iotHubClientHandle, IOTHUB_MESSAGE_HANDLE, eventMessageHandle, IOTHUB_CLIENT_EVENT_CONFIRMATION_CALLBACK, eventConfirmationCallback, void*, userContextCallback);
 
+    /**
+    * @brief    Asynchronous call to send the message specified by @p eventMessageHandle, transferring
+    *           ownership of the message to the client instead of copying it.
+    *
+    * @param    iotHubClientHandle              The handle created by a call to the create function.
+    * @param    eventMessageHandle              The handle to an IoT Hub message. On success the client owns
+    *                                           this handle and the caller must not use or destroy it anymore.
+    * @param    eventConfirmationCallback       The callback specified by the caller for receiving
+    *                                           confirmation of the delivery of the IoT Hub message.
+    *                                           The user can specify a @c NULL value here to
+    *                                           indicate that no callback is required.
+    * @param    userContextCallback             User specified context that will be provided to the
+    *                                           callback. This can be @c NULL.
+    *
+    *           @b NOTE: The application behavior is undefined if the user calls
+    *           the ::IoTHubDeviceClient_Destroy function from within any callback.
+    * @remarks
+    *           Unlike ::IoTHubDeviceClient_SendEventAsync, the IOTHUB_MESSAGE_HANDLE is not cloned. The iothub client destroys
+    *           it when the message is effectively sent, if a failure sending it occurs, or if the client is destroyed.
+    *           If this function returns an error the ownership of @c eventMessageHandle stays with the caller.
+    * @return   IOTHUB_CLIENT_OK upon success or an error code upon failure.
+    */
+    MOCKABLE_FUNCTION(, IOTHUB_CLIENT_RESULT, IoTHubDeviceClient_SendEventAsync_TakeOwnership, IOTHUB_DEVICE_CLIENT_HANDLE, iotHubClientHandle, IOTHUB_MESSAGE_HANDLE, eventMessageHandle, IOTHUB_CLIENT_EVENT_CONFIRMATION_CALLBACK, eventConfirmationCallback, void*, userContextCallback);
+
+    /**
+    * @brief    Asynchronous call to send a batch of messages to IoT Hub in a single call.
+    *           The messages are queued under a single acquisition of the client lock.
+    *
+    * @param    iotHubClientHandle              The handle created by a call to the create function.
+    * @param    eventMessageHandles             Array of @p eventMessageCount IoT Hub message handles.
+    * @param    eventMessageCount               The number of messages in @p eventMessageHandles. Must be greater than 0.
+    * @param    confirmationMode                ::IOTHUB_CLIENT_BATCH_CONFIRMATION_PER_MESSAGE invokes
+    *                                           @p eventConfirmationCallback once for every message;
+    *                                           ::IOTHUB_CLIENT_BATCH_CONFIRMATION_PER_BATCH invokes it once,
+    *                                           after every message of the batch completed, with
+    *                                           IOTHUB_CLIENT_CONFIRMATION_OK or the first failure result seen.
+    * @param    eventConfirmationCallback       The callback specified by the caller for receiving
+    *                                           confirmation of the delivery of the IoT Hub messages.
+    *                                           The user can specify a @c NULL value here to
+    *                                           indicate that no callback is required.
+    * @param    userContextCallback             User specified context that will be provided to the
+    *                                           callback. This can be @c NULL.
+    *
+    *           @b NOTE: The application behavior is undefined if the user calls
+    *           the ::IoTHubDeviceClient_Destroy function from within any callback.
+    * @remarks
+    *           All messages are queued together with the same timeout start time, or none are queued
+    *           if the call fails. As with ::IoTHubDeviceClient_SendEventAsync the messages are cloned, so the
+    *           handles can be destroyed by the calling application right after this function returns.
+    * @return   IOTHUB_CLIENT_OK upon success or an error code upon failure.
+    */
+    MOCKABLE_FUNCTION(, IOTHUB_CLIENT_RESULT, IoTHubDeviceClient_SendEventBatchAsync, IOTHUB_DEVICE_CLIENT_HANDLE, iotHubClientHandle, IOTHUB_MESSAGE_HANDLE*, eventMessageHandles, size_t, eventMessageCount, IOTHUB_CLIENT_BATCH_CONFIRMATION, confirmationMode, IOTHUB_CLIENT_EVENT_CONFIRMATION_CALLBACK, eventConfirmationCallback, void*, userContextCallback);
+
     /**
     * @brief    This function returns the current sending status for IoTHubClient.
     *
@@ -176,6 +229,26 @@ extern "C"
     */
     MOCKABLE_FUNCTION(, IOTHUB_CLIENT_RESULT, IoTHubDeviceClient_SetConnectionStatusCallback, IOTHUB_DEVICE_CLIENT_HANDLE, iotHubClientHandle, IOTHUB_CLIENT_CONNECTION_STATUS_CALLBACK, connectionStatusCallback, void*, userContextCallback);
 
+    /**
+    * @brief    Sets up the callback to be invoked when the outgoing telemetry queue reaches its high
+    *           watermark, and when it drains back to its low watermark.
+    *
+    * @param    iotHubClientHandle    The handle created by a call to the create function.
+    * @param    queueStateCallback    The callback specified by the device to throttle its producers
+    *                                 before SendEventAsync starts failing with IOTHUB_CLIENT_QUEUE_FULL
+    *                                 or dropping messages. This can be @c NULL to stop the notifications.
+    * @param    userContextCallback   User specified context that will be provided to the
+    *                                 callback. This can be @c NULL.
+    *
+    *           @b NOTE: The watermarks are percentages of ::OPTION_MAX_QUEUED_MESSAGES and ::OPTION_MAX_QUEUED_BYTES
+    *           (see ::OPTION_QUEUE_HIGH_WATERMARK_PERCENT and ::OPTION_QUEUE_LOW_WATERMARK_PERCENT), so the callback
+    *           is only invoked once at least one of these limits is set. The application behavior is undefined
+    *           if the user calls the ::IoTHubDeviceClient_Destroy function from within any callback.
+    *
+    * @return   IOTHUB_CLIENT_OK upon success or an error code upon failure.
+    */
+    MOCKABLE_FUNCTION(, IOTHUB_CLIENT_RESULT, IoTHubDeviceClient_SetOutgoingQueueStateCallback, IOTHUB_DEVICE_CLIENT_HANDLE, iotHubClientHandle, IOTHUB_CLIENT_QUEUE_STATE_CALLBACK, queueStateCallback, void*, userContextCallback);
+
     /**
     * @brief    Sets up the connection status callback to be invoked representing the status of
     *           the connection to IOT Hub. This is a blocking call.
@@ -222,6 +295,18 @@ extern "C"
     */
     MOCKABLE_FUNCTION(, IOTHUB_CLIENT_RESULT, IoTHubDeviceClient_GetLastMessageReceiveTime, IOTHUB_DEVICE_CLIENT_HANDLE, iotHubClientHandle, time_t*, lastMessageReceiveTime);
 
+    /**
+    * @brief    Reads the round trip time measured between sending telemetry and receiving its acknowledgement,
+    *           and the resend timeout derived from it.
+    *
+    * @param    iotHubClientHandle    The handle created by a call to the create function.
+    * @param    rttStatistics         Out parameter filled in with the round trip time statistics.
+    *
+    * @return   IOTHUB_CLIENT_OK upon success, IOTHUB_CLIENT_ERROR if the transport does not measure it (only MQTT does),
+    *           or an error code upon failure.
+    */
+    MOCKABLE_FUNCTION(, IOTHUB_CLIENT_RESULT, IoTHubDeviceClient_GetRttStatistics, IOTHUB_DEVICE_CLIENT_HANDLE, iotHubClientHandle, IOTHUB_CLIENT_RTT_STATISTICS*, rttStatistics);
+
     /**
     * @brief    This API sets a runtime option identified by parameter @p optionName
     *           to a value pointed to by @p value. @p optionName and the data type
@@ -378,6 +463,46 @@ extern "C"
     */
     MOCKABLE_FUNCTION(, IOTHUB_CLIENT_RESULT, IoTHubDeviceClient_UploadMultipleBlocksToBlobAsync, IOTHUB_DEVICE_CLIENT_HANDLE, iotHubClientHandle, const char*, destinationFileName, IOTHUB_CLIENT_FILE_UPLOAD_GET_DATA_CALLBACK_EX, getDataCallbackEx, void*, context);
 
+    /**
+    * @brief    Same as ::IoTHubDeviceClient_UploadToBlobAsync, also returning the id of the upload for ::IoTHubDeviceClient_CancelUploadToBlobAsync.
+    *
+    * @param    iotHubClientHandle                  The handle created by a call to the IoTHubDeviceClient_Create function.
+    * @param    destinationFileName                 The name of the file to be created in Azure Blob Storage.
+    * @param    source                              The source of data.
+    * @param    size                                The size of data.
+    * @param    iotHubClientFileUploadCallback      A callback to be invoked when the file upload operation has finished.
+    * @param    context                             A user-provided context to be passed to the file upload callback.
+    * @param    uploadJobId                         Receives the id of the upload.
+    *
+    * @return   IOTHUB_CLIENT_OK upon success or an error code upon failure.
+    */
+    MOCKABLE_FUNCTION(, IOTHUB_CLIENT_RESULT, IoTHubDeviceClient_QueueUploadToBlobAsync, IOTHUB_DEVICE_CLIENT_HANDLE, iotHubClientHandle, const char*, destinationFileName, const unsigned char*, source, size_t, size, IOTHUB_CLIENT_FILE_UPLOAD_CALLBACK, iotHubClientFileUploadCallback, void*, context, IOTHUB_CLIENT_UPLOAD_JOB_ID*, uploadJobId);
+
+    /**
+    * @brief                          Same as ::IoTHubDeviceClient_UploadMultipleBlocksToBlobAsync, also returning the id of the upload for ::IoTHubDeviceClient_CancelUploadToBlobAsync.
+    * @param iotHubClientHandle       The handle created by a call to the IoTHubDeviceClient_Create function.
+    * @param destinationFileName      The name of the file to be created in Azure Blob Storage.
+    * @param getDataCallbackEx        A callback to be invoked to acquire the file chunks to be uploaded, as well as to indicate the status of the upload of the previous block.
+    * @param context                  Any data provided by the user to serve as context on getDataCallback.
+    * @param uploadJobId              Receives the id of the upload.
+    * @returns                        An IOTHUB_CLIENT_RESULT value indicating the success or failure of the API call.
+    */
+    MOCKABLE_FUNCTION(, IOTHUB_CLIENT_RESULT, IoTHubDeviceClient_QueueUploadMultipleBlocksToBlobAsync, IOTHUB_DEVICE_CLIENT_HANDLE, iotHubClientHandle, const char*, destinationFileName, IOTHUB_CLIENT_FILE_UPLOAD_GET_DATA_CALLBACK_EX, getDataCallbackEx, void*, context, IOTHUB_CLIENT_UPLOAD_JOB_ID*, uploadJobId);
+
+    /**
+    * @brief    Cancels an upload that is still waiting for an upload worker thread.
+    *
+    * @param    iotHubClientHandle      The handle created by a call to the IoTHubDeviceClient_Create function.
+    * @param    uploadJobId             The id returned by ::IoTHubDeviceClient_QueueUploadToBlobAsync or
+    *                                   ::IoTHubDeviceClient_QueueUploadMultipleBlocksToBlobAsync.
+    *
+    * @remarks  Only applies once OPTION_BLOB_UPLOAD_WORKER_THREADS is set. The callback of the cancelled upload is invoked
+    *           with FILE_UPLOAD_ERROR before this function returns. An upload already started runs to completion.
+    *
+    * @return   IOTHUB_CLIENT_OK if the upload was cancelled or an error code otherwise.
+    */
+    MOCKABLE_FUNCTION(, IOTHUB_CLIENT_RESULT, IoTHubDeviceClient_CancelUploadToBlobAsync, IOTHUB_DEVICE_CLIENT_HANDLE, iotHubClientHandle, IOTHUB_CLIENT_UPLOAD_JOB_ID, uploadJobId);
+
 #endif /* DONT_USE_UPLOADTOBLOB */
 
 #ifdef __cplusplus
@@ -132,6 +132,58 @@ typedef struct IOTHUB_CLIENT_CORE_LL_HANDLE_DATA_TAG* IOTHUB_DEVICE_CLIENT_LL_HA
     */
      MOCKABLE_FUNCTION(, IOTHUB_CLIENT_RESULT, IoTHubDeviceClient_LL_SendEventAsync, IOTHUB_DEVICE_CLIENT_LL_HANDLE, iotHubClientHandle, IOTHUB_MESSAGE_HANDLE, eventMessageHandle, IOTHUB_CLIENT_EVENT_CONFIRMATION_CALLBACK, eventConfirmationCallback, void*, userContextCallback);
 
+    /**
+    * @brief    Asynchronous call to send the message specified by @p eventMessageHandle, transferring
+    *           ownership of the message to the client instead of copying it.
+    *
+    * @param    iotHubClientHandle              The handle created by a call to the create function.
+    * @param    eventMessageHandle              The handle to an IoT Hub message. On success the client owns
+    *                                           this handle and the caller must not use or destroy it anymore.
+    * @param    eventConfirmationCallback       The callback specified by the caller for receiving
+    *                                           confirmation of the delivery of the IoT Hub message.
+    *                                           The user can specify a @c NULL value here to
+    *                                           indicate that no callback is required.
+    * @param    userContextCallback             User specified context that will be provided to the
+    *                                           callback. This can be @c NULL.
+    *
+    *           @b NOTE: The application behavior is undefined if the user calls
+    *           the ::IoTHubDeviceClient_LL_Destroy function from within any callback.
+    * @remarks
+    *           Unlike ::IoTHubDeviceClient_LL_SendEventAsync, the IOTHUB_MESSAGE_HANDLE is not cloned. The iothub client destroys
+    *           it when the message is effectively sent, if a failure sending it occurs, or if the client is destroyed.
+    *           If this function returns an error the ownership of @c eventMessageHandle stays with the caller.
+    * @return   IOTHUB_CLIENT_OK upon success or an error code upon failure.
+    */
+     MOCKABLE_FUNCTION(, IOTHUB_CLIENT_RESULT, IoTHubDeviceClient_LL_SendEventAsync_TakeOwnership, IOTHUB_DEVICE_CLIENT_LL_HANDLE, iotHubClientHandle, IOTHUB_MESSAGE_HANDLE, eventMessageHandle, IOTHUB_CLIENT_EVENT_CONFIRMATION_CALLBACK, eventConfirmationCallback, void*, userContextCallback);
+
+    /**
+    * @brief    Asynchronous call to send a batch of messages to IoT Hub in a single call.
+    *
+    * @param    iotHubClientHandle              The handle created by a call to the create function.
+    * @param    eventMessageHandles             Array of @p eventMessageCount IoT Hub message handles.
+    * @param    eventMessageCount               The number of messages in @p eventMessageHandles. Must be greater than 0.
+    * @param    confirmationMode                ::IOTHUB_CLIENT_BATCH_CONFIRMATION_PER_MESSAGE invokes
+    *                                           @p eventConfirmationCallback once for every message;
+    *                                           ::IOTHUB_CLIENT_BATCH_CONFIRMATION_PER_BATCH invokes it once,
+    *                                           after every message of the batch completed, with
+    *                                           IOTHUB_CLIENT_CONFIRMATION_OK or the first failure result seen.
+    * @param    eventConfirmationCallback       The callback specified by the caller for receiving
+    *                                           confirmation of the delivery of the IoT Hub messages.
+    *                                           The user can specify a @c NULL value here to
+    *                                           indicate that no callback is required.
+    * @param    userContextCallback             User specified context that will be provided to the
+    *                                           callback. This can be @c NULL.
+    *
+    *           @b NOTE: The application behavior is undefined if the user calls
+    *           the ::IoTHubDeviceClient_LL_Destroy function from within any callback.
+    * @remarks
+    *           All messages are queued together with the same timeout start time, or none are queued
+    *           if the call fails. As with ::IoTHubDeviceClient_LL_SendEventAsync the messages are cloned, so the
+    *           handles can be destroyed by the calling application right after this function returns.
+    * @return   IOTHUB_CLIENT_OK upon success or an error code upon failure.
+    */
+     MOCKABLE_FUNCTION(, IOTHUB_CLIENT_RESULT, IoTHubDeviceClient_LL_SendEventBatchAsync, IOTHUB_DEVICE_CLIENT_LL_HANDLE, iotHubClientHandle, IOTHUB_MESSAGE_HANDLE*, eventMessageHandles, size_t, eventMessageCount, IOTHUB_CLIENT_BATCH_CONFIRMATION, confirmationMode, IOTHUB_CLIENT_EVENT_CONFIRMATION_CALLBACK, eventConfirmationCallback, void*, userContextCallback);
+
     /**
     * @brief    This function returns the current sending status for IoTHubClient.
     *
@@ -180,6 +232,26 @@ typedef struct IOTHUB_CLIENT_CORE_LL_HANDLE_DATA_TAG* IOTHUB_DEVICE_CLIENT_LL_HA
     */
      MOCKABLE_FUNCTION(, IOTHUB_CLIENT_RESULT, IoTHubDeviceClient_LL_SetConnectionStatusCallback, IOTHUB_DEVICE_CLIENT_LL_HANDLE, iotHubClientHandle, IOTHUB_CLIENT_CONNECTION_STATUS_CALLBACK, connectionStatusCallback, void*, userContextCallback);
 
+    /**
+    * @brief    Sets up the callback to be invoked when the outgoing telemetry queue reaches its high
+    *           watermark, and when it drains back to its low watermark.
+    *
+    * @param    iotHubClientHandle    The handle created by a call to the create function.
+    * @param    queueStateCallback    The callback specified by the device to throttle its producers
+    *                                 before SendEventAsync starts failing with IOTHUB_CLIENT_QUEUE_FULL
+    *                                 or dropping messages. This can be @c NULL to stop the notifications.
+    * @param    userContextCallback   User specified context that will be provided to the
+    *                                 callback. This can be @c NULL.
+    *
+    *           @b NOTE: The watermarks are percentages of ::OPTION_MAX_QUEUED_MESSAGES and ::OPTION_MAX_QUEUED_BYTES
+    *           (see ::OPTION_QUEUE_HIGH_WATERMARK_PERCENT and ::OPTION_QUEUE_LOW_WATERMARK_PERCENT), so the callback
+    *           is only invoked once at least one of these limits is set. The application behavior is undefined
+    *           if the user calls the ::IoTHubDeviceClient_LL_Destroy function from within any callback.
+    *
+    * @return   IOTHUB_CLIENT_OK upon success or an error code upon failure.
+    */
+     MOCKABLE_FUNCTION(, IOTHUB_CLIENT_RESULT, IoTHubDeviceClient_LL_SetOutgoingQueueStateCallback, IOTHUB_DEVICE_CLIENT_LL_HANDLE, iotHubClientHandle, IOTHUB_CLIENT_QUEUE_STATE_CALLBACK, queueStateCallback, void*, userContextCallback);
+
     /**
     * @brief    Sets up the connection status callback to be invoked representing the status of
     * the connection to IOT Hub. This is a blocking call.
@@ -241,6 +313,36 @@ typedef struct IOTHUB_CLIENT_CORE_LL_HANDLE_DATA_TAG* IOTHUB_DEVICE_CLIENT_LL_HA
     */
      MOCKABLE_FUNCTION(, void, IoTHubDeviceClient_LL_DoWork, IOTHUB_DEVICE_CLIENT_LL_HANDLE, iotHubClientHandle);
 
+    /**
+    * @brief    Returns how long the application can wait before IoTHubDeviceClient_LL_DoWork has
+    *           work queued by the client to do, so that an event loop does not have to wake up
+    *           every few milliseconds while the device is idle.
+    *
+    * @param    iotHubClientHandle    The handle created by a call to the create function.
+    * @param    msUntilNextWork       Out parameter set to 0 if messages, reported properties or twin
+    *                                 requests are waiting to be sent, otherwise to the time left until the
+    *                                 earliest message confirmation timeout, or to @c UINT_MAX if there is none.
+    *
+    *           @b NOTE: Data arriving from IoT Hub, keep-alives, reconnection and token renewal are
+    *           handled by the transport inside _DoWork, and are not accounted for here. _DoWork still has
+    *           to be called periodically (at least once every few hundred milliseconds) while idle.
+    *
+    * @return   IOTHUB_CLIENT_OK upon success or an error code upon failure.
+    */
+     MOCKABLE_FUNCTION(, IOTHUB_CLIENT_RESULT, IoTHubDeviceClient_LL_GetNextWorkDeadline, IOTHUB_DEVICE_CLIENT_LL_HANDLE, iotHubClientHandle, unsigned int*, msUntilNextWork);
+
+    /**
+    * @brief    Reads the round trip time measured between sending telemetry and receiving its acknowledgement,
+    *           and the resend timeout derived from it.
+    *
+    * @param    iotHubClientHandle    The handle created by a call to the create function.
+    * @param    rttStatistics         Out parameter filled in with the round trip time statistics.
+    *
+    * @return   IOTHUB_CLIENT_OK upon success, IOTHUB_CLIENT_ERROR if the transport does not measure it (only MQTT does),
+    *           or an error code upon failure.
+    */
+     MOCKABLE_FUNCTION(, IOTHUB_CLIENT_RESULT, IoTHubDeviceClient_LL_GetRttStatistics, IOTHUB_DEVICE_CLIENT_LL_HANDLE, iotHubClientHandle, IOTHUB_CLIENT_RTT_STATISTICS*, rttStatistics);
+
     /**
     * @brief    This API sets a runtime option identified by parameter @p optionName
     *           to a value pointed to by @p value. @p optionName and the data type
@@ -42,6 +42,17 @@ IOTHUBMESSAGE_UNKNOWN \
 */
 MU_DEFINE_ENUM_WITHOUT_INVALID(IOTHUBMESSAGE_CONTENT_TYPE, IOTHUBMESSAGE_CONTENT_TYPE_VALUES);
 
+#define IOTHUB_MESSAGE_PRIORITY_VALUES \
+IOTHUB_MESSAGE_PRIORITY_LOW, \
+IOTHUB_MESSAGE_PRIORITY_NORMAL, \
+IOTHUB_MESSAGE_PRIORITY_HIGH \
+
+/** @brief Enumeration specifying the order in which the client sends the queued
+* messages. Higher priority messages are sent first; messages are created with
+* IOTHUB_MESSAGE_PRIORITY_NORMAL. The priority is not sent to the IoT Hub.
+*/
+MU_DEFINE_ENUM_WITHOUT_INVALID(IOTHUB_MESSAGE_PRIORITY, IOTHUB_MESSAGE_PRIORITY_VALUES);
+
 typedef struct IOTHUB_MESSAGE_HANDLE_DATA_TAG* IOTHUB_MESSAGE_HANDLE;
 
 /** @brief diagnostic related data*/
@@ -387,6 +398,27 @@ MOCKABLE_FUNCTION(, IOTHUB_MESSAGE_RESULT, IoTHubMessage_SetAsSecurityMessage, I
 */
 MOCKABLE_FUNCTION(, bool, IoTHubMessage_IsSecurityMessage, IOTHUB_MESSAGE_HANDLE, iotHubMessageHandle);
 
+/**
+* @brief   Sets the priority with which the client sends the message, relative to the other queued messages.
+*          Messages of the same priority are sent in the order they were queued.
+*
+* @param   iotHubMessageHandle Handle to the message.
+* @param   priority            The priority of the message.
+*
+* @return  Returns IOTHUB_MESSAGE_OK if the priority was set successfully
+*          or an error code otherwise.
+*/
+MOCKABLE_FUNCTION(, IOTHUB_MESSAGE_RESULT, IoTHubMessage_SetPriority, IOTHUB_MESSAGE_HANDLE, iotHubMessageHandle, IOTHUB_MESSAGE_PRIORITY, priority);
+
+/**
+* @brief   Gets the priority of the message.
+*
+* @param   iotHubMessageHandle Handle to the message.
+*
+* @return  Returns the priority of the message, IOTHUB_MESSAGE_PRIORITY_NORMAL if it was never set or if iotHubMessageHandle is NULL.
+*/
+MOCKABLE_FUNCTION(, IOTHUB_MESSAGE_PRIORITY, IoTHubMessage_GetPriority, IOTHUB_MESSAGE_HANDLE, iotHubMessageHandle);
+
 /**
 * @brief   Frees all resources associated with the given message handle.
 *
@@ -99,6 +99,30 @@ extern "C"
     */
      MOCKABLE_FUNCTION(, IOTHUB_CLIENT_RESULT, IoTHubModuleClient_LL_SendEventAsync, IOTHUB_MODULE_CLIENT_LL_HANDLE, iotHubModuleClientHandle, IOTHUB_MESSAGE_HANDLE, eventMessageHandle, IOTHUB_CLIENT_EVENT_CONFIRMATION_CALLBACK, eventConfirmationCallback, void*, userContextCallback);
 
+    /**
+    * @brief    Asynchronous call to send the message specified by @p eventMessageHandle, transferring
+    *           ownership of the message to the client instead of copying it.
+    *
+    * @param    iotHubModuleClientHandle        The handle created by a call to the create function.
+    * @param    eventMessageHandle              The handle to an IoT Hub message. On success the client owns
+    *                                           this handle and the caller must not use or destroy it anymore.
+    * @param    eventConfirmationCallback       The callback specified by the caller for receiving
+    *                                           confirmation of the delivery of the IoT Hub message.
+    *                                           The user can specify a @c NULL value here to
+    *                                           indicate that no callback is required.
+    * @param    userContextCallback             User specified context that will be provided to the
+    *                                           callback. This can be @c NULL.
+    *
+    *           @b NOTE: The application behavior is undefined if the user calls
+    *           the ::IoTHubModuleClient_LL_Destroy function from within any callback.
+    * @remarks
+    *           Unlike ::IoTHubModuleClient_LL_SendEventAsync, the IOTHUB_MESSAGE_HANDLE is not cloned. The iothub client destroys
+    *           it when the message is effectively sent, if a failure sending it occurs, or if the client is destroyed.
+    *           If this function returns an error the ownership of @c eventMessageHandle stays with the caller.
+    * @return   IOTHUB_CLIENT_OK upon success or an error code upon failure.
+    */
+    MOCKABLE_FUNCTION(, IOTHUB_CLIENT_RESULT, IoTHubModuleClient_LL_SendEventAsync_TakeOwnership, IOTHUB_MODULE_CLIENT_LL_HANDLE, iotHubModuleClientHandle, IOTHUB_MESSAGE_HANDLE, eventMessageHandle, IOTHUB_CLIENT_EVENT_CONFIRMATION_CALLBACK, eventConfirmationCallback, void*, userContextCallback);
+
     /**
     * @brief    This function returns the current sending status for IoTHubClient.
     *
@@ -147,6 +171,26 @@ extern "C"
     */
      MOCKABLE_FUNCTION(, IOTHUB_CLIENT_RESULT, IoTHubModuleClient_LL_SetConnectionStatusCallback, IOTHUB_MODULE_CLIENT_LL_HANDLE, iotHubModuleClientHandle, IOTHUB_CLIENT_CONNECTION_STATUS_CALLBACK, connectionStatusCallback, void*, userContextCallback);
 
+    /**
+    * @brief    Sets up the callback to be invoked when the outgoing telemetry queue reaches its high
+    *           watermark, and when it drains back to its low watermark.
+    *
+    * @param    iotHubModuleClientHandle    The handle created by a call to the create function.
+    * @param    queueStateCallback    The callback specified by the module to throttle its producers
+    *                                 before SendEventAsync starts failing with IOTHUB_CLIENT_QUEUE_FULL
+    *                                 or dropping messages. This can be @c NULL to stop the notifications.
+    * @param    userContextCallback   User specified context that will be provided to the
+    *                                 callback. This can be @c NULL.
+    *
+    *           @b NOTE: The watermarks are percentages of ::OPTION_MAX_QUEUED_MESSAGES and ::OPTION_MAX_QUEUED_BYTES
+    *           (see ::OPTION_QUEUE_HIGH_WATERMARK_PERCENT and ::OPTION_QUEUE_LOW_WATERMARK_PERCENT), so the callback
+    *           is only invoked once at least one of these limits is set. The application behavior is undefined
+    *           if the user calls the ::IoTHubModuleClient_LL_Destroy function from within any callback.
+    *
+    * @return   IOTHUB_CLIENT_OK upon success or an error code upon failure.
+    */
+     MOCKABLE_FUNCTION(, IOTHUB_CLIENT_RESULT, IoTHubModuleClient_LL_SetOutgoingQueueStateCallback, IOTHUB_MODULE_CLIENT_LL_HANDLE, iotHubModuleClientHandle, IOTHUB_CLIENT_QUEUE_STATE_CALLBACK, queueStateCallback, void*, userContextCallback);
+
     /**
     * @brief    Sets up the connection status callback to be invoked representing the status of
     * the connection to IOT Hub. This is a blocking call.
@@ -206,6 +250,34 @@ extern "C"
     */
      MOCKABLE_FUNCTION(, void, IoTHubModuleClient_LL_DoWork, IOTHUB_MODULE_CLIENT_LL_HANDLE, iotHubModuleClientHandle);
 
+    /**
+    * @brief    Returns how long the application can wait before IoTHubModuleClient_LL_DoWork has
+    *             work queued by the client to do.
+    *
+    * @param    iotHubModuleClientHandle    The handle created by a call to the create function.
+    * @param    msUntilNextWork             Out parameter set to 0 if messages, reported properties or twin
+    *                                       requests are waiting to be sent, otherwise to the time left until the
+    *                                       earliest message confirmation timeout, or to @c UINT_MAX if there is none.
+    *
+    *            @b NOTE: Data arriving from IoT Hub and the connection management are not accounted for,
+    *            so _DoWork still has to be called periodically while idle.
+    *
+    * @return    IOTHUB_CLIENT_OK upon success or an error code upon failure.
+    */
+     MOCKABLE_FUNCTION(, IOTHUB_CLIENT_RESULT, IoTHubModuleClient_LL_GetNextWorkDeadline, IOTHUB_MODULE_CLIENT_LL_HANDLE, iotHubModuleClientHandle, unsigned int*, msUntilNextWork);
+
+    /**
+    * @brief    Reads the round trip time measured between sending telemetry and receiving its acknowledgement,
+    *             and the resend timeout derived from it.
+    *
+    * @param    iotHubModuleClientHandle    The handle created by a call to the create function.
+    * @param    rttStatistics               Out parameter filled in with the round trip time statistics.
+    *
+    * @return    IOTHUB_CLIENT_OK upon success, IOTHUB_CLIENT_ERROR if the transport does not measure it (only MQTT does),
+    *            or an error code upon failure.
+    */
+     MOCKABLE_FUNCTION(, IOTHUB_CLIENT_RESULT, IoTHubModuleClient_LL_GetRttStatistics, IOTHUB_MODULE_CLIENT_LL_HANDLE, iotHubModuleClientHandle, IOTHUB_CLIENT_RTT_STATISTICS*, rttStatistics);
+
     /**
     * @brief    This API sets a runtime option identified by parameter @p optionName
     *             to a value pointed to by @p value. @p optionName and the data type
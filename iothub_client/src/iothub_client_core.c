@@ -7,6 +7,7 @@
 
 #include <signal.h>
 #include <stddef.h>
+#include <stdint.h>
 #include "azure_c_shared_utility/optimize_size.h"
 #include "azure_c_shared_utility/crt_abstractions.h"
 #include "iothub_client_core.h"
@@ -16,6 +17,7 @@
 #include "internal/iothubtransport.h"
 #include "azure_c_shared_utility/threadapi.h"
 #include "azure_c_shared_utility/lock.h"
+#include "azure_c_shared_utility/condition.h"
 #include "azure_c_shared_utility/xlogging.h"
 #include "azure_c_shared_utility/singlylinkedlist.h"
 #include "azure_c_shared_utility/vector.h"
@@ -25,8 +27,29 @@
 
 
 #define DO_WORK_FREQ_DEFAULT 1
+#define DO_WORK_IDLE_FREQ_MAX 1000
+#define CALLBACK_DISPATCHER_QUEUE_SIZE_DEFAULT 64
+#define BLOB_UPLOAD_WORKER_THREADS_MAX 16
+#define BLOB_UPLOAD_QUEUE_SIZE_DEFAULT 64
 
 struct IOTHUB_QUEUE_CONTEXT_TAG;
+struct IOTHUB_CLIENT_CORE_INSTANCE_TAG;
+
+typedef struct CALLBACK_DISPATCHER_TAG
+{
+    struct IOTHUB_CLIENT_CORE_INSTANCE_TAG* iotHubClientInstance;
+    THREAD_HANDLE threadHandle;
+    COND_HANDLE pendingCondition;
+    VECTOR_HANDLE pendingCallbacks; /*USER_CALLBACK_INFO waiting to be run by this dispatcher, guarded by dispatcherLock*/
+    int stop;
+} CALLBACK_DISPATCHER;
+
+typedef struct SUBMITTED_EVENT_TAG
+{
+    IOTHUB_MESSAGE_HANDLE message; /*owned by the client*/
+    IOTHUB_CLIENT_EVENT_CONFIRMATION_CALLBACK eventConfirmationCallback; /*as passed to IoTHubClientCore_LL_SendEventAsync_TakeOwnership*/
+    void* userContextCallback;
+} SUBMITTED_EVENT;
 
 typedef struct IOTHUB_CLIENT_CORE_INSTANCE_TAG
 {
@@ -34,21 +57,47 @@ typedef struct IOTHUB_CLIENT_CORE_INSTANCE_TAG
     TRANSPORT_HANDLE TransportHandle;
     THREAD_HANDLE ThreadHandle;
     LOCK_HANDLE LockHandle;
+    COND_HANDLE WorkCondition; /*only created once OPTION_DO_WORK_IDLE_FREQ_IN_MS is set*/
     sig_atomic_t StopThread;
+    int WorkSignaled;
     SINGLYLINKEDLIST_HANDLE httpWorkerThreadInfoList; /*list containing HTTPWORKER_THREAD_INFO*/
     int created_with_transport_handle;
     VECTOR_HANDLE saved_user_callback_list;
+    LOCK_HANDLE callbackLock; /*only created for the clients of a shared transport, guards saved_user_callback_list so their worker thread takes the callbacks without the transport lock*/
     IOTHUB_CLIENT_DEVICE_TWIN_CALLBACK desired_state_callback;
     IOTHUB_CLIENT_CONNECTION_STATUS_CALLBACK connection_status_callback;
+    IOTHUB_CLIENT_QUEUE_STATE_CALLBACK queue_state_callback;
     IOTHUB_CLIENT_DEVICE_METHOD_CALLBACK_ASYNC device_method_callback;
     IOTHUB_CLIENT_INBOUND_DEVICE_METHOD_CALLBACK inbound_device_method_callback;
     IOTHUB_CLIENT_MESSAGE_CALLBACK_ASYNC message_callback;
     struct IOTHUB_QUEUE_CONTEXT_TAG* devicetwin_user_context;
     struct IOTHUB_QUEUE_CONTEXT_TAG* connection_status_user_context;
+    struct IOTHUB_QUEUE_CONTEXT_TAG* queue_state_user_context;
     struct IOTHUB_QUEUE_CONTEXT_TAG* message_user_context;
     struct IOTHUB_QUEUE_CONTEXT_TAG* method_user_context;
     tickcounter_ms_t do_work_freq_ms;
+    tickcounter_ms_t do_work_idle_freq_ms;
     tickcounter_ms_t currentMessageTimeout;
+    LOCK_HANDLE dispatcherLock; /*only created once OPTION_CALLBACK_DISPATCHER_THREADS is set*/
+    CALLBACK_DISPATCHER* dispatchers;
+    size_t dispatcher_count;
+    size_t dispatcher_queue_size;
+    size_t callback_budget; /*0 runs all the queued callbacks on each pass of the worker thread*/
+    LOCK_HANDLE submissionLock; /*only created once OPTION_SUBMISSION_QUEUE_SIZE is set*/
+    SUBMITTED_EVENT* submitted_events; /*filled by the senders, guarded by submissionLock*/
+    SUBMITTED_EVENT* draining_events; /*handed to IoTHubClientCore_LL, guarded by LockHandle*/
+    size_t submitted_count;
+    size_t submission_queue_size;
+    int workerWaiting; /*set while the worker thread waits for work, guarded by submissionLock*/
+    LOCK_HANDLE uploadWorkerLock; /*only created once OPTION_BLOB_UPLOAD_WORKER_THREADS is set*/
+    COND_HANDLE uploadWorkerCondition;
+    THREAD_HANDLE* uploadWorkers;
+    size_t upload_worker_count;
+    SINGLYLINKEDLIST_HANDLE pendingUploads; /*HTTPWORKER_THREAD_INFO waiting for an upload worker, guarded by uploadWorkerLock*/
+    size_t pending_upload_count;
+    size_t upload_queue_size;
+    int stopUploadWorkers;
+    IOTHUB_CLIENT_UPLOAD_JOB_ID last_upload_job_id; /*guarded by LockHandle*/
 } IOTHUB_CLIENT_CORE_INSTANCE;
 
 typedef enum HTTPWORKER_THREAD_TYPE_TAG
@@ -92,6 +141,8 @@ typedef struct HTTPWORKER_THREAD_INFO_TAG
     UPLOADTOBLOB_SAVED_DATA uploadBlobSavedData;
     INVOKE_METHOD_SAVED_DATA invokeMethodSavedData;
     UPLOADTOBLOB_MULTIBLOCK_SAVED_DATA uploadBlobMultiblockSavedData;
+    THREAD_START_FUNC uploadJobFunc; /*only set when the upload is run by an upload worker instead of its own thread*/
+    IOTHUB_CLIENT_UPLOAD_JOB_ID uploadJobId;
 }HTTPWORKER_THREAD_INFO;
 
 #define USER_CALLBACK_TYPE_VALUES       \
@@ -102,11 +153,14 @@ typedef struct HTTPWORKER_THREAD_INFO_TAG
     CALLBACK_TYPE_DEVICE_METHOD,        \
     CALLBACK_TYPE_INBOUD_DEVICE_METHOD, \
     CALLBACK_TYPE_MESSAGE,              \
-    CALLBACK_TYPE_INPUTMESSAGE
+    CALLBACK_TYPE_INPUTMESSAGE,         \
+    CALLBACK_TYPE_QUEUE_STATE
 
 MU_DEFINE_ENUM_WITHOUT_INVALID(USER_CALLBACK_TYPE, USER_CALLBACK_TYPE_VALUES)
 MU_DEFINE_ENUM_STRINGS_WITHOUT_INVALID(USER_CALLBACK_TYPE, USER_CALLBACK_TYPE_VALUES)
 
+#define CALLBACK_DISPATCHER_MAX_THREADS MU_COUNT_ARG(USER_CALLBACK_TYPE_VALUES)
+
 typedef struct DEVICE_TWIN_CALLBACK_INFO_TAG
 {
     DEVICE_TWIN_UPDATE_STATE update_state;
@@ -134,6 +188,13 @@ typedef struct CONNECTION_STATUS_CALLBACK_INFO_TAG
     IOTHUB_CLIENT_CONNECTION_STATUS_REASON status_reason;
 } CONNECTION_STATUS_CALLBACK_INFO;
 
+typedef struct QUEUE_STATE_CALLBACK_INFO_TAG
+{
+    IOTHUB_CLIENT_QUEUE_STATE queue_state;
+    size_t queued_messages;
+    size_t queued_bytes;
+} QUEUE_STATE_CALLBACK_INFO;
+
 typedef struct METHOD_CALLBACK_INFO_TAG
 {
     STRING_HANDLE method_name;
@@ -157,6 +218,7 @@ typedef struct USER_CALLBACK_INFO_TAG
         EVENT_CONFIRM_CALLBACK_INFO event_confirm_cb_info;
         REPORTED_STATE_CALLBACK_INFO reported_state_cb_info;
         CONNECTION_STATUS_CALLBACK_INFO connection_status_cb_info;
+        QUEUE_STATE_CALLBACK_INFO queue_state_cb_info;
         METHOD_CALLBACK_INFO method_cb_info;
         MESSAGE_CALLBACK_INFO* message_cb_info;
         INPUTMESSAGE_CALLBACK_INFO inputmessage_cb_info;
@@ -186,6 +248,12 @@ typedef struct IOTHUB_QUEUE_CONSOLIDATED_CONTEXT_TAG
     void* userContext;
 } IOTHUB_QUEUE_CONSOLIDATED_CONTEXT;
 
+typedef struct IOTHUB_QUEUE_BATCH_CONTEXT_TAG
+{
+    IOTHUB_QUEUE_CONTEXT queue_context;
+    size_t pending_count;
+} IOTHUB_QUEUE_BATCH_CONTEXT;
+
 typedef struct IOTHUB_INPUTMESSAGE_CALLBACK_CONTEXT_TAG
 {
     IOTHUB_CLIENT_CORE_HANDLE iotHubClientHandle;
@@ -195,6 +263,8 @@ typedef struct IOTHUB_INPUTMESSAGE_CALLBACK_CONTEXT_TAG
 
 /*used by unittests only*/
 const size_t IoTHubClientCore_ThreadTerminationOffset = offsetof(IOTHUB_CLIENT_CORE_INSTANCE, StopThread);
+const size_t IoTHubClientCore_DispatcherTerminationOffset = offsetof(CALLBACK_DISPATCHER, stop);
+const size_t IoTHubClientCore_UploadWorkerTerminationOffset = offsetof(IOTHUB_CLIENT_CORE_INSTANCE, stopUploadWorkers);
 
 typedef enum CREATE_HUB_INSTANCE_TYPE_TAG
 {
@@ -268,6 +338,45 @@ static void garbageCollectorImpl(IOTHUB_CLIENT_CORE_INSTANCE* iotHubClientInstan
     }
 }
 
+/*the callbacks of a client of a shared transport are queued by the transport thread under the transport lock,
+and taken by the worker thread of the client under callbackLock only*/
+static int lock_user_callbacks(IOTHUB_CLIENT_CORE_INSTANCE* iotHubClientInstance)
+{
+    int result = 0;
+
+    if ((iotHubClientInstance->callbackLock != NULL) && (Lock(iotHubClientInstance->callbackLock) != LOCK_OK))
+    {
+        LogError("failed locking the queued callbacks");
+        result = MU_FAILURE;
+    }
+
+    return result;
+}
+
+static void unlock_user_callbacks(IOTHUB_CLIENT_CORE_INSTANCE* iotHubClientInstance)
+{
+    if (iotHubClientInstance->callbackLock != NULL)
+    {
+        (void)Unlock(iotHubClientInstance->callbackLock);
+    }
+}
+
+static int queue_user_callback(IOTHUB_CLIENT_CORE_INSTANCE* iotHubClientInstance, const USER_CALLBACK_INFO* queue_cb_info)
+{
+    int result;
+
+    if (lock_user_callbacks(iotHubClientInstance) != 0)
+    {
+        result = MU_FAILURE;
+    }
+    else
+    {
+        result = VECTOR_push_back(iotHubClientInstance->saved_user_callback_list, queue_cb_info, 1);
+        unlock_user_callbacks(iotHubClientInstance);
+    }
+
+    return result;
+}
 
 static bool iothub_ll_message_callback(MESSAGE_CALLBACK_INFO* messageData, void* userContextCallback)
 {
@@ -284,7 +393,7 @@ static bool iothub_ll_message_callback(MESSAGE_CALLBACK_INFO* messageData, void*
         queue_cb_info.type = CALLBACK_TYPE_MESSAGE;
         queue_cb_info.userContextCallback = queue_context->userContextCallback;
         queue_cb_info.iothub_callback.message_cb_info = messageData;
-        if (VECTOR_push_back(queue_context->iotHubClientHandle->saved_user_callback_list, &queue_cb_info, 1) == 0)
+        if (queue_user_callback(queue_context->iotHubClientHandle, &queue_cb_info) == 0)
         {
             result = true;
         }
@@ -314,7 +423,7 @@ static bool iothub_ll_inputmessage_callback(MESSAGE_CALLBACK_INFO* message_cb_in
         queue_cb_info.iothub_callback.inputmessage_cb_info.eventHandlerCallback = inputMessageCallbackContext->eventHandlerCallback;
         queue_cb_info.iothub_callback.inputmessage_cb_info.message_cb_info = message_cb_info;
 
-        if (VECTOR_push_back(inputMessageCallbackContext->iotHubClientHandle->saved_user_callback_list, &queue_cb_info, 1) == 0)
+        if (queue_user_callback(inputMessageCallbackContext->iotHubClientHandle, &queue_cb_info) == 0)
         {
             result = true;
         }
@@ -351,7 +460,7 @@ static int make_method_calback_queue_context(USER_CALLBACK_INFO* queue_cb_info,
         }
         else
         {
-            if (VECTOR_push_back(queue_context->iotHubClientHandle->saved_user_callback_list, queue_cb_info, 1) == 0)
+            if (queue_user_callback(queue_context->iotHubClientHandle, queue_cb_info) == 0)
             {
                 result = 0;
             }
@@ -430,13 +539,31 @@ static void iothub_ll_connection_status_callback(IOTHUB_CLIENT_CONNECTION_STATUS
         queue_cb_info.userContextCallback = queue_context->userContextCallback;
         queue_cb_info.iothub_callback.connection_status_cb_info.status_reason = reason;
         queue_cb_info.iothub_callback.connection_status_cb_info.connection_status = result;
-        if (VECTOR_push_back(queue_context->iotHubClientHandle->saved_user_callback_list, &queue_cb_info, 1) != 0)
+        if (queue_user_callback(queue_context->iotHubClientHandle, &queue_cb_info) != 0)
         {
             LogError("connection status callback vector push failed.");
         }
     }
 }
 
+static void iothub_ll_queue_state_callback(IOTHUB_CLIENT_QUEUE_STATE queue_state, size_t queued_messages, size_t queued_bytes, void* userContextCallback)
+{
+    IOTHUB_QUEUE_CONTEXT* queue_context = (IOTHUB_QUEUE_CONTEXT*)userContextCallback;
+    if (queue_context != NULL)
+    {
+        USER_CALLBACK_INFO queue_cb_info;
+        queue_cb_info.type = CALLBACK_TYPE_QUEUE_STATE;
+        queue_cb_info.userContextCallback = queue_context->userContextCallback;
+        queue_cb_info.iothub_callback.queue_state_cb_info.queue_state = queue_state;
+        queue_cb_info.iothub_callback.queue_state_cb_info.queued_messages = queued_messages;
+        queue_cb_info.iothub_callback.queue_state_cb_info.queued_bytes = queued_bytes;
+        if (queue_user_callback(queue_context->iotHubClientHandle, &queue_cb_info) != 0)
+        {
+            LogError("queue state callback vector push failed.");
+        }
+    }
+}
+
 static void iothub_ll_event_confirm_callback(IOTHUB_CLIENT_CONFIRMATION_RESULT result, void* userContextCallback)
 {
     IOTHUB_QUEUE_CONTEXT* queue_context = (IOTHUB_QUEUE_CONTEXT*)userContextCallback;
@@ -447,7 +574,7 @@ static void iothub_ll_event_confirm_callback(IOTHUB_CLIENT_CONFIRMATION_RESULT r
         queue_cb_info.userContextCallback = queue_context->userContextCallback;
         queue_cb_info.iothub_callback.event_confirm_cb_info.confirm_result = result;
         queue_cb_info.iothub_callback.event_confirm_cb_info.eventConfirmationCallback = queue_context->callbackFunction.eventConfirmationCallback;
-        if (VECTOR_push_back(queue_context->iotHubClientHandle->saved_user_callback_list, &queue_cb_info, 1) != 0)
+        if (queue_user_callback(queue_context->iotHubClientHandle, &queue_cb_info) != 0)
         {
             LogError("event confirm callback vector push failed.");
         }
@@ -455,6 +582,30 @@ static void iothub_ll_event_confirm_callback(IOTHUB_CLIENT_CONFIRMATION_RESULT r
     }
 }
 
+static void iothub_ll_event_batch_confirm_callback(IOTHUB_CLIENT_CONFIRMATION_RESULT result, void* userContextCallback)
+{
+    IOTHUB_QUEUE_BATCH_CONTEXT* batch_context = (IOTHUB_QUEUE_BATCH_CONTEXT*)userContextCallback;
+    if (batch_context != NULL)
+    {
+        USER_CALLBACK_INFO queue_cb_info;
+        queue_cb_info.type = CALLBACK_TYPE_EVENT_CONFIRM;
+        queue_cb_info.userContextCallback = batch_context->queue_context.userContextCallback;
+        queue_cb_info.iothub_callback.event_confirm_cb_info.confirm_result = result;
+        queue_cb_info.iothub_callback.event_confirm_cb_info.eventConfirmationCallback = batch_context->queue_context.callbackFunction.eventConfirmationCallback;
+        if (queue_user_callback(batch_context->queue_context.iotHubClientHandle, &queue_cb_info) != 0)
+        {
+            LogError("event confirm callback vector push failed.");
+        }
+
+        /* the same context is shared by every message of the batch */
+        batch_context->pending_count--;
+        if (batch_context->pending_count == 0)
+        {
+            free(batch_context);
+        }
+    }
+}
+
 static void iothub_ll_reported_state_callback(int status_code, void* userContextCallback)
 {
     IOTHUB_QUEUE_CONTEXT* queue_context = (IOTHUB_QUEUE_CONTEXT*)userContextCallback;
@@ -465,7 +616,7 @@ static void iothub_ll_reported_state_callback(int status_code, void* userContext
         queue_cb_info.userContextCallback = queue_context->userContextCallback;
         queue_cb_info.iothub_callback.reported_state_cb_info.status_code = status_code;
         queue_cb_info.iothub_callback.reported_state_cb_info.reportedStateCallback = queue_context->callbackFunction.reportedStateCallback;
-        if (VECTOR_push_back(queue_context->iotHubClientHandle->saved_user_callback_list, &queue_cb_info, 1) != 0)
+        if (queue_user_callback(queue_context->iotHubClientHandle, &queue_cb_info) != 0)
         {
             LogError("reported state callback vector push failed.");
         }
@@ -511,7 +662,7 @@ static void iothub_ll_device_twin_callback(DEVICE_TWIN_UPDATE_STATE update_state
         }
         if (push_to_vector == 0)
         {
-            if (VECTOR_push_back(queue_context->iotHubClientHandle->saved_user_callback_list, &queue_cb_info, 1) != 0)
+            if (queue_user_callback(queue_context->iotHubClientHandle, &queue_cb_info) != 0)
             {
                 if (queue_cb_info.iothub_callback.dev_twin_cb_info.payLoad != NULL)
                 {
@@ -561,7 +712,7 @@ static void iothub_ll_get_device_twin_async_callback(DEVICE_TWIN_UPDATE_STATE up
             }
         }
 
-        if (VECTOR_push_back(queue_context->iotHubClientHandle->saved_user_callback_list, &queue_cb_info, 1) != 0)
+        if (queue_user_callback(queue_context->iotHubClientHandle, &queue_cb_info) != 0)
         {
             LogError("device twin callback userContextCallback vector push failed.");
 
@@ -586,6 +737,7 @@ static void dispatch_user_callbacks(IOTHUB_CLIENT_CORE_INSTANCE* iotHubClientIns
 
     IOTHUB_CLIENT_DEVICE_TWIN_CALLBACK desired_state_callback = NULL;
     IOTHUB_CLIENT_CONNECTION_STATUS_CALLBACK connection_status_callback = NULL;
+    IOTHUB_CLIENT_QUEUE_STATE_CALLBACK queue_state_callback = NULL;
     IOTHUB_CLIENT_DEVICE_METHOD_CALLBACK_ASYNC device_method_callback = NULL;
     IOTHUB_CLIENT_INBOUND_DEVICE_METHOD_CALLBACK inbound_device_method_callback = NULL;
     IOTHUB_CLIENT_MESSAGE_CALLBACK_ASYNC message_callback = NULL;
@@ -601,6 +753,7 @@ static void dispatch_user_callbacks(IOTHUB_CLIENT_CORE_INSTANCE* iotHubClientIns
     {
         desired_state_callback = iotHubClientInstance->desired_state_callback;
         connection_status_callback = iotHubClientInstance->connection_status_callback;
+        queue_state_callback = iotHubClientInstance->queue_state_callback;
         device_method_callback = iotHubClientInstance->device_method_callback;
         inbound_device_method_callback = iotHubClientInstance->inbound_device_method_callback;
         message_callback = iotHubClientInstance->message_callback;
@@ -670,6 +823,12 @@ static void dispatch_user_callbacks(IOTHUB_CLIENT_CORE_INSTANCE* iotHubClientIns
                     connection_status_callback(queued_cb->iothub_callback.connection_status_cb_info.connection_status, queued_cb->iothub_callback.connection_status_cb_info.status_reason, queued_cb->userContextCallback);
                 }
                 break;
+            case CALLBACK_TYPE_QUEUE_STATE:
+                if (queue_state_callback)
+                {
+                    queue_state_callback(queued_cb->iothub_callback.queue_state_cb_info.queue_state, queued_cb->iothub_callback.queue_state_cb_info.queued_messages, queued_cb->iothub_callback.queue_state_cb_info.queued_bytes, queued_cb->userContextCallback);
+                }
+                break;
             case CALLBACK_TYPE_DEVICE_METHOD:
                 if (device_method_callback)
                 {
@@ -763,179 +922,798 @@ static void dispatch_user_callbacks(IOTHUB_CLIENT_CORE_INSTANCE* iotHubClientIns
     VECTOR_destroy(call_backs);
 }
 
-static void ScheduleWork_Thread_ForMultiplexing(void* iotHubClientHandle)
+/*called with the lock held, instead of moving saved_user_callback_list out for the calling thread to dispatch*/
+static void route_user_callbacks(IOTHUB_CLIENT_CORE_INSTANCE* iotHubClientInstance)
 {
-    IOTHUB_CLIENT_CORE_INSTANCE* iotHubClientInstance = (IOTHUB_CLIENT_CORE_INSTANCE*)iotHubClientHandle;
+    size_t callbacks_length = VECTOR_size(iotHubClientInstance->saved_user_callback_list);
 
-    garbageCollectorImpl(iotHubClientInstance);
-    if (Lock(iotHubClientInstance->LockHandle) == LOCK_OK)
+    if (callbacks_length > 0)
     {
-        VECTOR_HANDLE call_backs = VECTOR_move(iotHubClientInstance->saved_user_callback_list);
-        (void)Unlock(iotHubClientInstance->LockHandle);
-
-        if (call_backs == NULL)
+        if (Lock(iotHubClientInstance->dispatcherLock) != LOCK_OK)
         {
-            LogError("Failed moving user callbacks");
+            LogError("failed locking the callback dispatchers");
         }
         else
         {
-            dispatch_user_callbacks(iotHubClientInstance, call_backs);
+            bool dispatcher_full[CALLBACK_DISPATCHER_MAX_THREADS] = { false };
+            size_t kept_length = 0;
+            size_t index;
+
+            for (index = 0; index < callbacks_length; index++)
+            {
+                USER_CALLBACK_INFO* queued_cb = (USER_CALLBACK_INFO*)VECTOR_element(iotHubClientInstance->saved_user_callback_list, index);
+                /*Codes_SRS_IOTHUBCLIENT_44_019: [ Once the dispatcher threads are started, the worker thread shall hand the queued callbacks to them instead of running them, all the callbacks of one type going to the same dispatcher thread, in the order they were queued. ]*/
+                size_t dispatcher_index = (size_t)queued_cb->type % iotHubClientInstance->dispatcher_count;
+                CALLBACK_DISPATCHER* dispatcher = &iotHubClientInstance->dispatchers[dispatcher_index];
+
+                /*Codes_SRS_IOTHUBCLIENT_44_020: [ A callback whose dispatcher thread already has `dispatcher_queue_size` callbacks waiting shall stay queued, along with all the callbacks for that dispatcher thread queued after it, until a later call to `IoTHubClientCore_LL_DoWork`. ]*/
+                if (dispatcher_full[dispatcher_index] ||
+                    VECTOR_size(dispatcher->pendingCallbacks) >= iotHubClientInstance->dispatcher_queue_size ||
+                    VECTOR_push_back(dispatcher->pendingCallbacks, queued_cb, 1) != 0)
+                {
+                    dispatcher_full[dispatcher_index] = true;
+                    if (kept_length != index)
+                    {
+                        *(USER_CALLBACK_INFO*)VECTOR_element(iotHubClientInstance->saved_user_callback_list, kept_length) = *queued_cb;
+                    }
+                    kept_length++;
+                }
+            }
+
+            for (index = 0; index < iotHubClientInstance->dispatcher_count; index++)
+            {
+                if (VECTOR_size(iotHubClientInstance->dispatchers[index].pendingCallbacks) > 0)
+                {
+                    (void)Condition_Post(iotHubClientInstance->dispatchers[index].pendingCondition);
+                }
+            }
+            (void)Unlock(iotHubClientInstance->dispatcherLock);
+
+            if (kept_length < callbacks_length)
+            {
+                VECTOR_erase(iotHubClientInstance->saved_user_callback_list, VECTOR_element(iotHubClientInstance->saved_user_callback_list, kept_length), callbacks_length - kept_length);
+            }
         }
     }
-    else
-    {
-        LogError("failed locking for ScheduleWork_Thread_ForMultiplexing");
-    }
 }
 
-static int ScheduleWork_Thread(void* threadArgument)
+static int CallbackDispatcher_Thread(void* threadArgument)
 {
-    IOTHUB_CLIENT_CORE_INSTANCE* iotHubClientInstance = (IOTHUB_CLIENT_CORE_INSTANCE*)threadArgument;
-    unsigned int sleeptime_in_ms = DO_WORK_FREQ_DEFAULT;
-
-    srand((unsigned int)get_time(NULL));
+    CALLBACK_DISPATCHER* dispatcher = (CALLBACK_DISPATCHER*)threadArgument;
+    IOTHUB_CLIENT_CORE_INSTANCE* iotHubClientInstance = dispatcher->iotHubClientInstance;
 
     while (1)
     {
-        if (Lock(iotHubClientInstance->LockHandle) == LOCK_OK)
+        if (Lock(iotHubClientInstance->dispatcherLock) != LOCK_OK)
         {
-            /*Codes_SRS_IOTHUBCLIENT_01_038: [ The thread shall exit when IoTHubClient_Destroy is called. ]*/
-            if (iotHubClientInstance->StopThread)
+            LogError("failed locking the callback dispatchers");
+            (void)ThreadAPI_Sleep(DO_WORK_FREQ_DEFAULT);
+        }
+        else
+        {
+            VECTOR_HANDLE call_backs;
+
+            /*Codes_SRS_IOTHUBCLIENT_44_021: [ Each dispatcher thread shall wait until callbacks are handed to it, and run them without holding the lock of the client. ]*/
+            while (!dispatcher->stop && VECTOR_size(dispatcher->pendingCallbacks) == 0)
             {
-                (void)Unlock(iotHubClientInstance->LockHandle);
-                break; /*gets out of the thread*/
+                /*0 waits until the condition is posted*/
+                (void)Condition_Wait(dispatcher->pendingCondition, iotHubClientInstance->dispatcherLock, 0);
             }
-            else
-            {
-                /* Codes_SRS_IOTHUBCLIENT_01_037: [The thread created by IoTHubClient_SendEvent or IoTHubClient_SetMessageCallback shall call IoTHubClientCore_LL_DoWork every 1 ms by default.] */
-                /* Codes_SRS_IOTHUBCLIENT_01_039: [All calls to IoTHubClientCore_LL_DoWork shall be protected by the lock created in IotHubClient_Create.] */
-                IoTHubClientCore_LL_DoWork(iotHubClientInstance->IoTHubClientLLHandle);
 
-                garbageCollectorImpl(iotHubClientInstance);
-                VECTOR_HANDLE call_backs = VECTOR_move(iotHubClientInstance->saved_user_callback_list);
-                sleeptime_in_ms = (unsigned int)iotHubClientInstance->do_work_freq_ms; // Update the sleepval within the locked thread.
-                (void)Unlock(iotHubClientInstance->LockHandle);
-                if (call_backs == NULL)
-                {
-                    LogError("VECTOR_move failed");
-                }
-                else
-                {
-                    dispatch_user_callbacks(iotHubClientInstance, call_backs);
-                }
+            if (dispatcher->stop)
+            {
+                (void)Unlock(iotHubClientInstance->dispatcherLock);
+                break; /*the callbacks not run yet are released by IoTHubClientCore_Destroy*/
+            }
 
+            call_backs = VECTOR_move(dispatcher->pendingCallbacks);
+            (void)Unlock(iotHubClientInstance->dispatcherLock);
 
+            if (call_backs == NULL)
+            {
+                LogError("VECTOR_move failed");
+            }
+            else
+            {
+                dispatch_user_callbacks(iotHubClientInstance, call_backs);
             }
         }
-        else
-        {
-            /*Codes_SRS_IOTHUBCLIENT_01_040: [If acquiring the lock fails, IoTHubClientCore_LL_DoWork shall not be called.]*/
-            /*no code, shall retry*/
-        }
-        /* Codes_SRS_IOTHUBCLIENT_041_02: [The thread shall sleep for a specified time in ms as provided through IoTHubClientCore_SetOption, with a default of 1 ms ] */
-        (void)ThreadAPI_Sleep(sleeptime_in_ms);
     }
 
     ThreadAPI_Exit(0);
     return 0;
 }
 
-static IOTHUB_CLIENT_RESULT StartWorkerThreadIfNeeded(IOTHUB_CLIENT_CORE_INSTANCE* iotHubClientInstance)
+/*stops the dispatcher threads and hands back the callbacks they did not run to saved_user_callback_list*/
+static void stop_callback_dispatchers(IOTHUB_CLIENT_CORE_INSTANCE* iotHubClientInstance, LOCK_HANDLE dispatcherLock, CALLBACK_DISPATCHER* dispatchers, size_t dispatcher_count)
 {
-    IOTHUB_CLIENT_RESULT result;
-    if (iotHubClientInstance->TransportHandle == NULL)
+    size_t index;
+
+    if (Lock(dispatcherLock) != LOCK_OK)
     {
-        if (iotHubClientInstance->ThreadHandle == NULL)
+        LogError("unable to Lock - - will still proceed to try to end the dispatcher threads without locking");
+    }
+    for (index = 0; index < dispatcher_count; index++)
+    {
+        dispatchers[index].stop = 1;
+        (void)Condition_Post(dispatchers[index].pendingCondition);
+    }
+    (void)Unlock(dispatcherLock);
+
+    for (index = 0; index < dispatcher_count; index++)
+    {
+        int res;
+        size_t pending_length;
+
+        if (ThreadAPI_Join(dispatchers[index].threadHandle, &res) != THREADAPI_OK)
         {
-            iotHubClientInstance->StopThread = 0;
-            if (ThreadAPI_Create(&iotHubClientInstance->ThreadHandle, ScheduleWork_Thread, iotHubClientInstance) != THREADAPI_OK)
+            LogError("ThreadAPI_Join failed for callback dispatcher %lu", (unsigned long)index);
+        }
+
+        pending_length = VECTOR_size(dispatchers[index].pendingCallbacks);
+        if (pending_length > 0)
+        {
+            if (lock_user_callbacks(iotHubClientInstance) != 0)
             {
-                LogError("ThreadAPI_Create failed");
-                iotHubClientInstance->ThreadHandle = NULL;
-                result = IOTHUB_CLIENT_ERROR;
+                LogError("failed handing back %lu callbacks, their data is lost", (unsigned long)pending_length);
             }
             else
             {
-                result = IOTHUB_CLIENT_OK;
+                if (VECTOR_push_back(iotHubClientInstance->saved_user_callback_list, VECTOR_element(dispatchers[index].pendingCallbacks, 0), pending_length) != 0)
+                {
+                    LogError("failed handing back %lu callbacks, their data is lost", (unsigned long)pending_length);
+                }
+                unlock_user_callbacks(iotHubClientInstance);
             }
         }
-        else
-        {
-            result = IOTHUB_CLIENT_OK;
-        }
+        VECTOR_destroy(dispatchers[index].pendingCallbacks);
+        Condition_Deinit(dispatchers[index].pendingCondition);
+    }
+
+    free(dispatchers);
+    Lock_Deinit(dispatcherLock);
+}
+
+/*called with the lock held*/
+static int start_callback_dispatchers(IOTHUB_CLIENT_CORE_INSTANCE* iotHubClientInstance, size_t dispatcher_count)
+{
+    int result;
+    CALLBACK_DISPATCHER* dispatchers = (CALLBACK_DISPATCHER*)malloc(dispatcher_count * sizeof(CALLBACK_DISPATCHER));
+
+    if (dispatchers == NULL)
+    {
+        LogError("Failed allocating the callback dispatchers");
+        result = MU_FAILURE;
     }
     else
     {
-        /*Codes_SRS_IOTHUBCLIENT_17_012: [ If the transport connection is shared, the thread shall be started by calling IoTHubTransport_StartWorkerThread. ]*/
-        /*Codes_SRS_IOTHUBCLIENT_17_011: [ If the transport connection is shared, the thread shall be started by calling IoTHubTransport_StartWorkerThread*/
-        result = IoTHubTransport_StartWorkerThread(iotHubClientInstance->TransportHandle, iotHubClientInstance, ScheduleWork_Thread_ForMultiplexing);
+        LOCK_HANDLE dispatcherLock;
+
+        memset(dispatchers, 0, dispatcher_count * sizeof(CALLBACK_DISPATCHER));
+        if ((dispatcherLock = Lock_Init()) == NULL)
+        {
+            LogError("Failure creating the callback dispatcher lock");
+            free(dispatchers);
+            result = MU_FAILURE;
+        }
+        else
+        {
+            size_t index;
+
+            /*the dispatcher threads take this lock as soon as they start*/
+            iotHubClientInstance->dispatcherLock = dispatcherLock;
+            for (index = 0; index < dispatcher_count; index++)
+            {
+                dispatchers[index].iotHubClientInstance = iotHubClientInstance;
+                if ((dispatchers[index].pendingCallbacks = VECTOR_create(sizeof(USER_CALLBACK_INFO))) == NULL)
+                {
+                    LogError("Failed creating the queue of callback dispatcher %lu", (unsigned long)index);
+                    break;
+                }
+                else if ((dispatchers[index].pendingCondition = Condition_Init()) == NULL)
+                {
+                    LogError("Failed creating the condition of callback dispatcher %lu", (unsigned long)index);
+                    VECTOR_destroy(dispatchers[index].pendingCallbacks);
+                    break;
+                }
+                else if (ThreadAPI_Create(&dispatchers[index].threadHandle, CallbackDispatcher_Thread, &dispatchers[index]) != THREADAPI_OK)
+                {
+                    LogError("Failed starting callback dispatcher %lu", (unsigned long)index);
+                    Condition_Deinit(dispatchers[index].pendingCondition);
+                    VECTOR_destroy(dispatchers[index].pendingCallbacks);
+                    break;
+                }
+            }
+
+            if (index < dispatcher_count)
+            {
+                stop_callback_dispatchers(iotHubClientInstance, dispatcherLock, dispatchers, index);
+                iotHubClientInstance->dispatcherLock = NULL;
+                result = MU_FAILURE;
+            }
+            else
+            {
+                /*the worker thread of a client of a shared transport reads them under callbackLock*/
+                if (lock_user_callbacks(iotHubClientInstance) != 0)
+                {
+                    stop_callback_dispatchers(iotHubClientInstance, dispatcherLock, dispatchers, dispatcher_count);
+                    iotHubClientInstance->dispatcherLock = NULL;
+                    result = MU_FAILURE;
+                }
+                else
+                {
+                    iotHubClientInstance->dispatchers = dispatchers;
+                    iotHubClientInstance->dispatcher_count = dispatcher_count;
+                    unlock_user_callbacks(iotHubClientInstance);
+                    result = 0;
+                }
+            }
+        }
     }
+
     return result;
 }
 
-static IOTHUB_CLIENT_CORE_INSTANCE* create_iothub_instance(CREATE_HUB_INSTANCE_TYPE create_hub_instance_type, const IOTHUB_CLIENT_CONFIG* config, TRANSPORT_HANDLE transportHandle, const char* connectionString, IOTHUB_CLIENT_TRANSPORT_PROVIDER protocol, const char* iothub_uri, const char* device_id)
+#if !defined(DONT_USE_UPLOADTOBLOB)
+static int UploadWorker_Thread(void* threadArgument)
 {
-    /* Codes_SRS_IOTHUBCLIENT_12_020: [** `IoTHubClient_CreateFromDeviceAuth` shall allocate a new `IoTHubClient` instance. **] */
-    IOTHUB_CLIENT_CORE_INSTANCE* result = (IOTHUB_CLIENT_CORE_INSTANCE*)malloc(sizeof(IOTHUB_CLIENT_CORE_INSTANCE));
-    (void)create_hub_instance_type;
+    IOTHUB_CLIENT_CORE_INSTANCE* iotHubClientInstance = (IOTHUB_CLIENT_CORE_INSTANCE*)threadArgument;
 
-    /* Codes_SRS_IOTHUBCLIENT_12_021: [** If allocating memory for the new `IoTHubClient` instance fails, then `IoTHubClient_CreateFromDeviceAuth` shall return `NULL`. **] */
-    /* Codes_SRS_IOTHUBCLIENT_01_004: [If allocating memory for the new IoTHubClient instance fails, then IoTHubClient_Create shall return NULL.] */
-    if (result != NULL)
+    while (1)
     {
-        memset((void *)result, 0, sizeof(IOTHUB_CLIENT_CORE_INSTANCE));
-
-        /* Codes_SRS_IOTHUBCLIENT_41_02 [] */
-        result->do_work_freq_ms = DO_WORK_FREQ_DEFAULT;
-        /* Default currentMessageTimeout to NULL until it is set by SetOption */
-        result->currentMessageTimeout = 0;
-
-        /* Codes_SRS_IOTHUBCLIENT_01_029: [IoTHubClient_Create shall create a lock object to be used later for serializing IoTHubClient calls.] */
-        if ((result->saved_user_callback_list = VECTOR_create(sizeof(USER_CALLBACK_INFO))) == NULL)
+        if (Lock(iotHubClientInstance->uploadWorkerLock) != LOCK_OK)
         {
-            LogError("Failed creating VECTOR");
-            free(result);
-            result = NULL;
+            LogError("failed locking the upload workers");
+            (void)ThreadAPI_Sleep(DO_WORK_FREQ_DEFAULT);
         }
         else
         {
-            /*Codes_SRS_IOTHUBCLIENT_02_060: [ IoTHubClient_Create shall create a SINGLYLINKEDLIST_HANDLE containing THREAD_HANDLE (created by future calls to IoTHubClient_UploadToBlobAsync). ]*/
-            if ((result->httpWorkerThreadInfoList = singlylinkedlist_create()) == NULL)
+            LIST_ITEM_HANDLE item;
+            HTTPWORKER_THREAD_INFO* threadInfo;
+
+            /*Codes_SRS_IOTHUBCLIENT_44_034: [ Each upload worker thread shall wait until an upload is queued, and run the queued uploads one at a time in the order they were queued. ]*/
+            while (((item = singlylinkedlist_get_head_item(iotHubClientInstance->pendingUploads)) == NULL) && !iotHubClientInstance->stopUploadWorkers)
             {
-                /*Codes_SRS_IOTHUBCLIENT_02_061: [ If creating the SINGLYLINKEDLIST_HANDLE fails then IoTHubClient_Create shall fail and return NULL. ]*/
-                LogError("unable to singlylinkedlist_create");
-                VECTOR_destroy(result->saved_user_callback_list);
-                free(result);
-                result = NULL;
+                /*0 waits until the condition is posted*/
+                (void)Condition_Wait(iotHubClientInstance->uploadWorkerCondition, iotHubClientInstance->uploadWorkerLock, 0);
             }
-            else
+
+            if (item == NULL)
             {
-                result->TransportHandle = transportHandle;
-                result->created_with_transport_handle = 0;
-                if (config != NULL)
-                {
-                    if (transportHandle != NULL)
-                    {
-                        /*Codes_SRS_IOTHUBCLIENT_17_005: [ IoTHubClient_CreateWithTransport shall call IoTHubTransport_GetLock to get the transport lock to be used later for serializing IoTHubClient calls. ]*/
-                        result->LockHandle = IoTHubTransport_GetLock(transportHandle);
-                        if (result->LockHandle == NULL)
-                        {
-                            LogError("unable to IoTHubTransport_GetLock");
-                            result->IoTHubClientLLHandle = NULL;
-                        }
-                        else
-                        {
-                            IOTHUB_CLIENT_DEVICE_CONFIG deviceConfig;
-                            deviceConfig.deviceId = config->deviceId;
-                            deviceConfig.deviceKey = config->deviceKey;
-                            deviceConfig.protocol = config->protocol;
-                            deviceConfig.deviceSasToken = config->deviceSasToken;
+                (void)Unlock(iotHubClientInstance->uploadWorkerLock);
+                break; /*only stops once the queued uploads are done*/
+            }
 
-                            /*Codes_SRS_IOTHUBCLIENT_17_003: [ IoTHubClient_CreateWithTransport shall call IoTHubTransport_GetLLTransport on transportHandle to get lower layer transport. ]*/
-                            deviceConfig.transportHandle = IoTHubTransport_GetLLTransport(transportHandle);
-                            if (deviceConfig.transportHandle == NULL)
-                            {
-                                LogError("unable to IoTHubTransport_GetLLTransport");
+            threadInfo = (HTTPWORKER_THREAD_INFO*)singlylinkedlist_item_get_value(item);
+            (void)singlylinkedlist_remove(iotHubClientInstance->pendingUploads, item);
+            iotHubClientInstance->pending_upload_count--;
+            (void)Unlock(iotHubClientInstance->uploadWorkerLock);
+
+            (void)threadInfo->uploadJobFunc(threadInfo);
+            freeHttpWorkerThreadInfo(threadInfo);
+        }
+    }
+
+    ThreadAPI_Exit(0);
+    return 0;
+}
+
+/*lets the upload workers finish the queued uploads, then joins them and frees the pool*/
+static void stop_upload_workers(IOTHUB_CLIENT_CORE_INSTANCE* iotHubClientInstance, THREAD_HANDLE* uploadWorkers, size_t upload_worker_count)
+{
+    size_t index;
+
+    if (Lock(iotHubClientInstance->uploadWorkerLock) != LOCK_OK)
+    {
+        LogError("unable to Lock - - will still proceed to try to end the upload workers without locking");
+    }
+    iotHubClientInstance->stopUploadWorkers = 1;
+    for (index = 0; index < upload_worker_count; index++)
+    {
+        (void)Condition_Post(iotHubClientInstance->uploadWorkerCondition);
+    }
+    (void)Unlock(iotHubClientInstance->uploadWorkerLock);
+
+    for (index = 0; index < upload_worker_count; index++)
+    {
+        int res;
+        if (ThreadAPI_Join(uploadWorkers[index], &res) != THREADAPI_OK)
+        {
+            LogError("ThreadAPI_Join failed for upload worker %lu", (unsigned long)index);
+        }
+    }
+
+    singlylinkedlist_destroy(iotHubClientInstance->pendingUploads);
+    Condition_Deinit(iotHubClientInstance->uploadWorkerCondition);
+    Lock_Deinit(iotHubClientInstance->uploadWorkerLock);
+    free(uploadWorkers);
+    iotHubClientInstance->pendingUploads = NULL;
+    iotHubClientInstance->uploadWorkerCondition = NULL;
+    iotHubClientInstance->uploadWorkerLock = NULL;
+}
+
+/*called with the lock held*/
+static int start_upload_workers(IOTHUB_CLIENT_CORE_INSTANCE* iotHubClientInstance, size_t upload_worker_count)
+{
+    int result;
+    THREAD_HANDLE* uploadWorkers = (THREAD_HANDLE*)malloc(upload_worker_count * sizeof(THREAD_HANDLE));
+
+    if (uploadWorkers == NULL)
+    {
+        LogError("Failed allocating the upload workers");
+        result = MU_FAILURE;
+    }
+    else if ((iotHubClientInstance->pendingUploads = singlylinkedlist_create()) == NULL)
+    {
+        LogError("Failed creating the upload queue");
+        free(uploadWorkers);
+        result = MU_FAILURE;
+    }
+    else if ((iotHubClientInstance->uploadWorkerCondition = Condition_Init()) == NULL)
+    {
+        LogError("Failed creating the upload worker condition");
+        singlylinkedlist_destroy(iotHubClientInstance->pendingUploads);
+        iotHubClientInstance->pendingUploads = NULL;
+        free(uploadWorkers);
+        result = MU_FAILURE;
+    }
+    else if ((iotHubClientInstance->uploadWorkerLock = Lock_Init()) == NULL)
+    {
+        LogError("Failure creating the upload worker lock");
+        Condition_Deinit(iotHubClientInstance->uploadWorkerCondition);
+        singlylinkedlist_destroy(iotHubClientInstance->pendingUploads);
+        iotHubClientInstance->uploadWorkerCondition = NULL;
+        iotHubClientInstance->pendingUploads = NULL;
+        free(uploadWorkers);
+        result = MU_FAILURE;
+    }
+    else
+    {
+        size_t index;
+
+        iotHubClientInstance->pending_upload_count = 0;
+        iotHubClientInstance->stopUploadWorkers = 0;
+        for (index = 0; index < upload_worker_count; index++)
+        {
+            if (ThreadAPI_Create(&uploadWorkers[index], UploadWorker_Thread, iotHubClientInstance) != THREADAPI_OK)
+            {
+                LogError("Failed starting upload worker %lu", (unsigned long)index);
+                break;
+            }
+        }
+
+        if (index < upload_worker_count)
+        {
+            stop_upload_workers(iotHubClientInstance, uploadWorkers, index);
+            result = MU_FAILURE;
+        }
+        else
+        {
+            /*uploads are only queued once uploadWorkers is set*/
+            iotHubClientInstance->uploadWorkers = uploadWorkers;
+            iotHubClientInstance->upload_worker_count = upload_worker_count;
+            result = 0;
+        }
+    }
+
+    return result;
+}
+#endif /*DONT_USE_UPLOADTOBLOB*/
+
+/*called with the lock held, before IoTHubClientCore_LL_DoWork or any other call queuing telemetry in IoTHubClientCore_LL; returns how many messages were taken*/
+static size_t drain_submitted_events(IOTHUB_CLIENT_CORE_INSTANCE* iotHubClientInstance)
+{
+    size_t result = 0;
+
+    if (Lock(iotHubClientInstance->submissionLock) != LOCK_OK)
+    {
+        LogError("failed locking the submission queue");
+    }
+    else
+    {
+        /*swapping the buffers keeps the senders out of the submission lock only for as long as it takes to take a copy of a pointer*/
+        SUBMITTED_EVENT* submitted_events = iotHubClientInstance->submitted_events;
+        size_t submitted_count = iotHubClientInstance->submitted_count;
+        size_t index;
+
+        iotHubClientInstance->submitted_events = iotHubClientInstance->draining_events;
+        iotHubClientInstance->draining_events = submitted_events;
+        iotHubClientInstance->submitted_count = 0;
+        (void)Unlock(iotHubClientInstance->submissionLock);
+
+        for (index = 0; index < submitted_count; index++)
+        {
+            SUBMITTED_EVENT* submitted_event = &submitted_events[index];
+            IOTHUB_CLIENT_RESULT send_result;
+
+            /*Codes_SRS_IOTHUBCLIENT_44_026: [ Before each call to `IoTHubClientCore_LL_DoWork` the worker thread shall pass the queued messages, in the order they were queued, to `IoTHubClientCore_LL_SendEventAsync_TakeOwnership`. ]*/
+            if ((send_result = IoTHubClientCore_LL_SendEventAsync_TakeOwnership(iotHubClientInstance->IoTHubClientLLHandle, submitted_event->message, submitted_event->eventConfirmationCallback, submitted_event->userContextCallback)) != IOTHUB_CLIENT_OK)
+            {
+                /*Codes_SRS_IOTHUBCLIENT_44_027: [ If `IoTHubClientCore_LL_SendEventAsync_TakeOwnership` fails, the message shall be destroyed and its confirmation callback invoked with `IOTHUB_CLIENT_CONFIRMATION_MESSAGE_DROPPED` if the outgoing queue is full, `IOTHUB_CLIENT_CONFIRMATION_ERROR` otherwise. ]*/
+                LogError("IoTHubClientCore_LL_SendEventAsync_TakeOwnership failed for a queued message (%s)", MU_ENUM_TO_STRING(IOTHUB_CLIENT_RESULT, send_result));
+                IoTHubMessage_Destroy(submitted_event->message);
+                if (submitted_event->eventConfirmationCallback != NULL)
+                {
+                    submitted_event->eventConfirmationCallback((send_result == IOTHUB_CLIENT_QUEUE_FULL) ? IOTHUB_CLIENT_CONFIRMATION_MESSAGE_DROPPED : IOTHUB_CLIENT_CONFIRMATION_ERROR, submitted_event->userContextCallback);
+                }
+            }
+        }
+
+        result = submitted_count;
+    }
+
+    return result;
+}
+
+/*called with the lock held, right before the worker thread waits for work. Returns false if messages were submitted meanwhile,
+otherwise the senders are told the worker thread waits, so the next one takes the lock to wake it up*/
+static bool start_waiting_for_submissions(IOTHUB_CLIENT_CORE_INSTANCE* iotHubClientInstance)
+{
+    bool result = true;
+
+    if (iotHubClientInstance->submissionLock != NULL)
+    {
+        if (Lock(iotHubClientInstance->submissionLock) != LOCK_OK)
+        {
+            LogError("failed locking the submission queue");
+        }
+        else
+        {
+            result = (iotHubClientInstance->submitted_count == 0);
+            iotHubClientInstance->workerWaiting = result ? 1 : 0;
+            (void)Unlock(iotHubClientInstance->submissionLock);
+        }
+    }
+
+    return result;
+}
+
+static void stop_waiting_for_submissions(IOTHUB_CLIENT_CORE_INSTANCE* iotHubClientInstance)
+{
+    if ((iotHubClientInstance->submissionLock != NULL) && (Lock(iotHubClientInstance->submissionLock) == LOCK_OK))
+    {
+        iotHubClientInstance->workerWaiting = 0;
+        (void)Unlock(iotHubClientInstance->submissionLock);
+    }
+}
+
+/*called with the lock held; takes the callbacks the worker thread runs on this pass*/
+static VECTOR_HANDLE take_user_callbacks(IOTHUB_CLIENT_CORE_INSTANCE* iotHubClientInstance)
+{
+    VECTOR_HANDLE result;
+
+    /*Codes_SRS_IOTHUBCLIENT_44_041: [ Once `OPTION_DO_WORK_CALLBACK_BUDGET` is set, each pass of the worker thread shall run at most that many of the queued callbacks, in the order they were queued, leaving the others queued for the next pass. ]*/
+    if ((iotHubClientInstance->callback_budget == 0) || (VECTOR_size(iotHubClientInstance->saved_user_callback_list) <= iotHubClientInstance->callback_budget))
+    {
+        result = VECTOR_move(iotHubClientInstance->saved_user_callback_list);
+    }
+    else if ((result = VECTOR_create(sizeof(USER_CALLBACK_INFO))) == NULL)
+    {
+        LogError("VECTOR_create failed");
+    }
+    else
+    {
+        void* first_callback = VECTOR_front(iotHubClientInstance->saved_user_callback_list);
+
+        if (VECTOR_push_back(result, first_callback, iotHubClientInstance->callback_budget) != 0)
+        {
+            LogError("VECTOR_push_back failed");
+            VECTOR_destroy(result);
+            result = NULL;
+        }
+        else
+        {
+            VECTOR_erase(iotHubClientInstance->saved_user_callback_list, first_callback, iotHubClientInstance->callback_budget);
+        }
+    }
+
+    return result;
+}
+
+/*called with the lock held, after anything was queued for the worker thread to send.
+Returns true when the shared transport has to be signaled once the lock is released: the lock of a client of a shared transport
+is the transport lock, which IoTHubTransport_SignalWork takes*/
+static bool signal_pending_work(IOTHUB_CLIENT_CORE_INSTANCE* iotHubClientInstance)
+{
+    bool result = false;
+
+    /*Codes_SRS_IOTHUBCLIENT_44_011: [ Once `OPTION_DO_WORK_IDLE_FREQ_IN_MS` is set, queuing a message, a reported state or a twin request shall wake up the worker thread, so it is sent without waiting for the idle time to elapse. ]*/
+    if (iotHubClientInstance->do_work_idle_freq_ms != 0)
+    {
+        if (iotHubClientInstance->TransportHandle != NULL)
+        {
+            result = true;
+        }
+        else if (iotHubClientInstance->WorkCondition != NULL)
+        {
+            iotHubClientInstance->WorkSignaled = 1;
+            (void)Condition_Post(iotHubClientInstance->WorkCondition);
+        }
+    }
+
+    return result;
+}
+
+static void ScheduleWork_Thread_ForMultiplexing(void* iotHubClientHandle)
+{
+    IOTHUB_CLIENT_CORE_INSTANCE* iotHubClientInstance = (IOTHUB_CLIENT_CORE_INSTANCE*)iotHubClientHandle;
+    bool signal_transport = false;
+
+    garbageCollectorImpl(iotHubClientInstance);
+
+    /*Codes_SRS_IOTHUBCLIENT_44_044: [ Messages taken from the submission queue by the worker thread of a shared transport shall wake it up, so they are sent by its next DoWork without waiting for the idle time to elapse. ]*/
+    if (iotHubClientInstance->submissionLock != NULL)
+    {
+        if (Lock(iotHubClientInstance->LockHandle) != LOCK_OK)
+        {
+            LogError("failed locking for ScheduleWork_Thread_ForMultiplexing");
+        }
+        else
+        {
+            if (drain_submitted_events(iotHubClientInstance) != 0)
+            {
+                signal_transport = signal_pending_work(iotHubClientInstance);
+            }
+            (void)Unlock(iotHubClientInstance->LockHandle);
+        }
+    }
+
+    /*Codes_SRS_IOTHUBCLIENT_44_052: [ The worker thread of a client of a shared transport shall take its queued callbacks under a lock of the client, without taking the transport lock. ]*/
+    if (lock_user_callbacks(iotHubClientInstance) != 0)
+    {
+        LogError("failed locking for ScheduleWork_Thread_ForMultiplexing");
+    }
+    else
+    {
+        VECTOR_HANDLE call_backs = NULL;
+
+        if (iotHubClientInstance->dispatchers != NULL)
+        {
+            route_user_callbacks(iotHubClientInstance);
+        }
+        else if ((call_backs = take_user_callbacks(iotHubClientInstance)) == NULL)
+        {
+            LogError("Failed moving user callbacks");
+        }
+        /*Codes_SRS_IOTHUBCLIENT_44_053: [ Callbacks left queued by `OPTION_DO_WORK_CALLBACK_BUDGET` shall be run by the next pass of the worker thread without waiting for the idle time to elapse. ]*/
+        else if ((iotHubClientInstance->callback_budget != 0) && (VECTOR_size(iotHubClientInstance->saved_user_callback_list) != 0))
+        {
+            signal_transport = true;
+        }
+        unlock_user_callbacks(iotHubClientInstance);
+
+        if (call_backs != NULL)
+        {
+            dispatch_user_callbacks(iotHubClientInstance, call_backs);
+        }
+    }
+
+    if (signal_transport)
+    {
+        IoTHubTransport_SignalWork(iotHubClientInstance->TransportHandle);
+    }
+}
+
+/*called with the lock held, right after IoTHubClientCore_LL_DoWork*/
+static unsigned int get_worker_wait_time(IOTHUB_CLIENT_CORE_INSTANCE* iotHubClientInstance)
+{
+    unsigned int result = (unsigned int)iotHubClientInstance->do_work_freq_ms;
+
+    /*Codes_SRS_IOTHUBCLIENT_44_010: [ Once `OPTION_DO_WORK_IDLE_FREQ_IN_MS` is set, the worker thread shall wait `do_work_freq_ms` while `IoTHubClientCore_LL_GetNextWorkDeadline` reports queued work, and up to `do_work_idle_freq_ms` otherwise. ]*/
+    if (iotHubClientInstance->WorkCondition != NULL)
+    {
+        unsigned int msUntilNextWork;
+        if (IoTHubClientCore_LL_GetNextWorkDeadline(iotHubClientInstance->IoTHubClientLLHandle, &msUntilNextWork) != IOTHUB_CLIENT_OK)
+        {
+            LogError("IoTHubClientCore_LL_GetNextWorkDeadline failed");
+        }
+        else if (msUntilNextWork > result)
+        {
+            result = (msUntilNextWork < iotHubClientInstance->do_work_idle_freq_ms) ? msUntilNextWork : (unsigned int)iotHubClientInstance->do_work_idle_freq_ms;
+        }
+    }
+
+    return result;
+}
+
+static void wait_for_work(IOTHUB_CLIENT_CORE_INSTANCE* iotHubClientInstance, COND_HANDLE workCondition, unsigned int wait_time_in_ms)
+{
+    if (Lock(iotHubClientInstance->LockHandle) != LOCK_OK)
+    {
+        (void)ThreadAPI_Sleep(wait_time_in_ms);
+    }
+    else
+    {
+        /*work queued while the callbacks were dispatched shall not wait*/
+        if (!iotHubClientInstance->StopThread && !iotHubClientInstance->WorkSignaled && start_waiting_for_submissions(iotHubClientInstance))
+        {
+            (void)Condition_Wait(workCondition, iotHubClientInstance->LockHandle, (int)wait_time_in_ms);
+            stop_waiting_for_submissions(iotHubClientInstance);
+        }
+        (void)Unlock(iotHubClientInstance->LockHandle);
+    }
+}
+
+static int ScheduleWork_Thread(void* threadArgument)
+{
+    IOTHUB_CLIENT_CORE_INSTANCE* iotHubClientInstance = (IOTHUB_CLIENT_CORE_INSTANCE*)threadArgument;
+    unsigned int sleeptime_in_ms = DO_WORK_FREQ_DEFAULT;
+
+    srand((unsigned int)get_time(NULL));
+
+    while (1)
+    {
+        COND_HANDLE workCondition = NULL;
+        VECTOR_HANDLE call_backs = NULL;
+
+        if (Lock(iotHubClientInstance->LockHandle) == LOCK_OK)
+        {
+            /*Codes_SRS_IOTHUBCLIENT_01_038: [ The thread shall exit when IoTHubClient_Destroy is called. ]*/
+            if (iotHubClientInstance->StopThread)
+            {
+                (void)Unlock(iotHubClientInstance->LockHandle);
+                break; /*gets out of the thread*/
+            }
+            else
+            {
+                /* Codes_SRS_IOTHUBCLIENT_01_037: [The thread created by IoTHubClient_SendEvent or IoTHubClient_SetMessageCallback shall call IoTHubClientCore_LL_DoWork every 1 ms by default.] */
+                /* Codes_SRS_IOTHUBCLIENT_01_039: [All calls to IoTHubClientCore_LL_DoWork shall be protected by the lock created in IotHubClient_Create.] */
+                iotHubClientInstance->WorkSignaled = 0;
+                if (iotHubClientInstance->submissionLock != NULL)
+                {
+                    drain_submitted_events(iotHubClientInstance);
+                }
+                IoTHubClientCore_LL_DoWork(iotHubClientInstance->IoTHubClientLLHandle);
+
+                garbageCollectorImpl(iotHubClientInstance);
+                if (iotHubClientInstance->dispatchers != NULL)
+                {
+                    route_user_callbacks(iotHubClientInstance);
+                }
+                else if ((call_backs = take_user_callbacks(iotHubClientInstance)) == NULL)
+                {
+                    LogError("VECTOR_move failed");
+                }
+                /*Codes_SRS_IOTHUBCLIENT_44_053: [ Callbacks left queued by `OPTION_DO_WORK_CALLBACK_BUDGET` shall be run by the next pass of the worker thread without waiting for the idle time to elapse. ]*/
+                else if ((iotHubClientInstance->callback_budget != 0) && (VECTOR_size(iotHubClientInstance->saved_user_callback_list) != 0))
+                {
+                    iotHubClientInstance->WorkSignaled = 1;
+                }
+                workCondition = iotHubClientInstance->WorkCondition;
+                sleeptime_in_ms = get_worker_wait_time(iotHubClientInstance); // Update the sleepval within the locked thread.
+                (void)Unlock(iotHubClientInstance->LockHandle);
+                if (call_backs != NULL)
+                {
+                    dispatch_user_callbacks(iotHubClientInstance, call_backs);
+                }
+
+
+            }
+        }
+        else
+        {
+            /*Codes_SRS_IOTHUBCLIENT_01_040: [If acquiring the lock fails, IoTHubClientCore_LL_DoWork shall not be called.]*/
+            /*no code, shall retry*/
+        }
+        if (workCondition == NULL)
+        {
+            /* Codes_SRS_IOTHUBCLIENT_041_02: [The thread shall sleep for a specified time in ms as provided through IoTHubClientCore_SetOption, with a default of 1 ms ] */
+            (void)ThreadAPI_Sleep(sleeptime_in_ms);
+        }
+        else
+        {
+            wait_for_work(iotHubClientInstance, workCondition, sleeptime_in_ms);
+        }
+    }
+
+    ThreadAPI_Exit(0);
+    return 0;
+}
+
+static IOTHUB_CLIENT_RESULT StartWorkerThreadIfNeeded(IOTHUB_CLIENT_CORE_INSTANCE* iotHubClientInstance)
+{
+    IOTHUB_CLIENT_RESULT result;
+    if (iotHubClientInstance->TransportHandle == NULL)
+    {
+        if (iotHubClientInstance->ThreadHandle == NULL)
+        {
+            iotHubClientInstance->StopThread = 0;
+            if (ThreadAPI_Create(&iotHubClientInstance->ThreadHandle, ScheduleWork_Thread, iotHubClientInstance) != THREADAPI_OK)
+            {
+                LogError("ThreadAPI_Create failed");
+                iotHubClientInstance->ThreadHandle = NULL;
+                result = IOTHUB_CLIENT_ERROR;
+            }
+            else
+            {
+                result = IOTHUB_CLIENT_OK;
+            }
+        }
+        else
+        {
+            result = IOTHUB_CLIENT_OK;
+        }
+    }
+    else
+    {
+        /*Codes_SRS_IOTHUBCLIENT_17_012: [ If the transport connection is shared, the thread shall be started by calling IoTHubTransport_StartWorkerThread. ]*/
+        /*Codes_SRS_IOTHUBCLIENT_17_011: [ If the transport connection is shared, the thread shall be started by calling IoTHubTransport_StartWorkerThread*/
+        result = IoTHubTransport_StartWorkerThread(iotHubClientInstance->TransportHandle, iotHubClientInstance, ScheduleWork_Thread_ForMultiplexing);
+    }
+    return result;
+}
+
+static IOTHUB_CLIENT_CORE_INSTANCE* create_iothub_instance(CREATE_HUB_INSTANCE_TYPE create_hub_instance_type, const IOTHUB_CLIENT_CONFIG* config, TRANSPORT_HANDLE transportHandle, const char* connectionString, IOTHUB_CLIENT_TRANSPORT_PROVIDER protocol, const char* iothub_uri, const char* device_id)
+{
+    /* Codes_SRS_IOTHUBCLIENT_12_020: [** `IoTHubClient_CreateFromDeviceAuth` shall allocate a new `IoTHubClient` instance. **] */
+    IOTHUB_CLIENT_CORE_INSTANCE* result = (IOTHUB_CLIENT_CORE_INSTANCE*)malloc(sizeof(IOTHUB_CLIENT_CORE_INSTANCE));
+    (void)create_hub_instance_type;
+
+    /* Codes_SRS_IOTHUBCLIENT_12_021: [** If allocating memory for the new `IoTHubClient` instance fails, then `IoTHubClient_CreateFromDeviceAuth` shall return `NULL`. **] */
+    /* Codes_SRS_IOTHUBCLIENT_01_004: [If allocating memory for the new IoTHubClient instance fails, then IoTHubClient_Create shall return NULL.] */
+    if (result != NULL)
+    {
+        memset((void *)result, 0, sizeof(IOTHUB_CLIENT_CORE_INSTANCE));
+
+        /* Codes_SRS_IOTHUBCLIENT_41_02 [] */
+        result->do_work_freq_ms = DO_WORK_FREQ_DEFAULT;
+        result->dispatcher_queue_size = CALLBACK_DISPATCHER_QUEUE_SIZE_DEFAULT;
+        result->upload_queue_size = BLOB_UPLOAD_QUEUE_SIZE_DEFAULT;
+        /* Default currentMessageTimeout to NULL until it is set by SetOption */
+        result->currentMessageTimeout = 0;
+
+        /* Codes_SRS_IOTHUBCLIENT_01_029: [IoTHubClient_Create shall create a lock object to be used later for serializing IoTHubClient calls.] */
+        if ((result->saved_user_callback_list = VECTOR_create(sizeof(USER_CALLBACK_INFO))) == NULL)
+        {
+            LogError("Failed creating VECTOR");
+            free(result);
+            result = NULL;
+        }
+        else
+        {
+            /*Codes_SRS_IOTHUBCLIENT_02_060: [ IoTHubClient_Create shall create a SINGLYLINKEDLIST_HANDLE containing THREAD_HANDLE (created by future calls to IoTHubClient_UploadToBlobAsync). ]*/
+            if ((result->httpWorkerThreadInfoList = singlylinkedlist_create()) == NULL)
+            {
+                /*Codes_SRS_IOTHUBCLIENT_02_061: [ If creating the SINGLYLINKEDLIST_HANDLE fails then IoTHubClient_Create shall fail and return NULL. ]*/
+                LogError("unable to singlylinkedlist_create");
+                VECTOR_destroy(result->saved_user_callback_list);
+                free(result);
+                result = NULL;
+            }
+            else
+            {
+                result->TransportHandle = transportHandle;
+                result->created_with_transport_handle = 0;
+                if (config != NULL)
+                {
+                    if (transportHandle != NULL)
+                    {
+                        /*Codes_SRS_IOTHUBCLIENT_17_005: [ IoTHubClient_CreateWithTransport shall call IoTHubTransport_GetLock to get the transport lock to be used later for serializing IoTHubClient calls. ]*/
+                        result->LockHandle = IoTHubTransport_GetLock(transportHandle);
+                        if (result->LockHandle == NULL)
+                        {
+                            LogError("unable to IoTHubTransport_GetLock");
+                            result->IoTHubClientLLHandle = NULL;
+                        }
+                        /*Codes_SRS_IOTHUBCLIENT_44_052: [ The worker thread of a client of a shared transport shall take its queued callbacks under a lock of the client, without taking the transport lock. ]*/
+                        else if ((result->callbackLock = Lock_Init()) == NULL)
+                        {
+                            LogError("Failure creating the callback lock");
+                            result->IoTHubClientLLHandle = NULL;
+                        }
+                        else
+                        {
+                            IOTHUB_CLIENT_DEVICE_CONFIG deviceConfig;
+                            deviceConfig.deviceId = config->deviceId;
+                            deviceConfig.deviceKey = config->deviceKey;
+                            deviceConfig.protocol = config->protocol;
+                            deviceConfig.deviceSasToken = config->deviceSasToken;
+
+                            /*Codes_SRS_IOTHUBCLIENT_17_003: [ IoTHubClient_CreateWithTransport shall call IoTHubTransport_GetLLTransport on transportHandle to get lower layer transport. ]*/
+                            deviceConfig.transportHandle = IoTHubTransport_GetLLTransport(transportHandle);
+                            if (deviceConfig.transportHandle == NULL)
+                            {
+                                LogError("unable to IoTHubTransport_GetLLTransport");
                                 result->IoTHubClientLLHandle = NULL;
                             }
                             else
@@ -1040,6 +1818,10 @@ static IOTHUB_CLIENT_CORE_INSTANCE* create_iothub_instance(CREATE_HUB_INSTANCE_T
                     {
                         Lock_Deinit(result->LockHandle);
                     }
+                    if (result->callbackLock != NULL)
+                    {
+                        Lock_Deinit(result->callbackLock);
+                    }
                     singlylinkedlist_destroy(result->httpWorkerThreadInfoList);
                     LogError("Failure creating iothub handle");
                     VECTOR_destroy(result->saved_user_callback_list);
@@ -1053,6 +1835,8 @@ static IOTHUB_CLIENT_CORE_INSTANCE* create_iothub_instance(CREATE_HUB_INSTANCE_T
                     result->devicetwin_user_context = NULL;
                     result->connection_status_callback = NULL;
                     result->connection_status_user_context = NULL;
+                    result->queue_state_callback = NULL;
+                    result->queue_state_user_context = NULL;
                     result->message_callback = NULL;
                     result->message_user_context = NULL;
                     result->method_user_context = NULL;
@@ -1166,6 +1950,9 @@ void IoTHubClientCore_Destroy(IOTHUB_CLIENT_CORE_HANDLE iotHubClientHandle)
         bool joinClientThread;
         bool joinTransportThread;
         size_t vector_size;
+#if !defined(DONT_USE_UPLOADTOBLOB)
+        THREAD_HANDLE* uploadWorkers;
+#endif /*DONT_USE_UPLOADTOBLOB*/
 
         IOTHUB_CLIENT_CORE_INSTANCE* iotHubClientInstance = (IOTHUB_CLIENT_CORE_INSTANCE*)iotHubClientHandle;
 
@@ -1188,6 +1975,10 @@ void IoTHubClientCore_Destroy(IOTHUB_CLIENT_CORE_HANDLE iotHubClientHandle)
         if (iotHubClientInstance->ThreadHandle != NULL)
         {
             iotHubClientInstance->StopThread = 1;
+            if (iotHubClientInstance->WorkCondition != NULL)
+            {
+                (void)Condition_Post(iotHubClientInstance->WorkCondition);
+            }
             joinClientThread = true;
         }
         else
@@ -1195,6 +1986,12 @@ void IoTHubClientCore_Destroy(IOTHUB_CLIENT_CORE_HANDLE iotHubClientHandle)
             joinClientThread = false;
         }
 
+#if !defined(DONT_USE_UPLOADTOBLOB)
+        /*uploads read uploadWorkers under this lock, the workers are stopped once it is released*/
+        uploadWorkers = iotHubClientInstance->uploadWorkers;
+        iotHubClientInstance->uploadWorkers = NULL;
+#endif /*DONT_USE_UPLOADTOBLOB*/
+
         /*Codes_SRS_IOTHUBCLIENT_02_045: [ IoTHubClient_Destroy shall unlock the serializing lock. ]*/
         if (Unlock(iotHubClientInstance->LockHandle) != LOCK_OK)
         {
@@ -1217,6 +2014,21 @@ void IoTHubClientCore_Destroy(IOTHUB_CLIENT_CORE_HANDLE iotHubClientHandle)
             IoTHubTransport_JoinWorkerThread(iotHubClientInstance->TransportHandle, iotHubClientHandle);
         }
 
+        if (iotHubClientInstance->dispatchers != NULL)
+        {
+            /*Codes_SRS_IOTHUBCLIENT_44_022: [ `IoTHubClient_Destroy` shall stop and join the dispatcher threads before destroying the IoTHubClientCore_LL instance, and free the callbacks they did not run along with the ones still queued. ]*/
+            stop_callback_dispatchers(iotHubClientInstance, iotHubClientInstance->dispatcherLock, iotHubClientInstance->dispatchers, iotHubClientInstance->dispatcher_count);
+            iotHubClientInstance->dispatchers = NULL;
+        }
+
+#if !defined(DONT_USE_UPLOADTOBLOB)
+        if (uploadWorkers != NULL)
+        {
+            /*Codes_SRS_IOTHUBCLIENT_44_038: [ `IoTHubClient_Destroy` shall let the upload worker threads finish the queued uploads, then join them before destroying the IoTHubClientCore_LL instance. ]*/
+            stop_upload_workers(iotHubClientInstance, uploadWorkers, iotHubClientInstance->upload_worker_count);
+        }
+#endif /*DONT_USE_UPLOADTOBLOB*/
+
         if (Lock(iotHubClientInstance->LockHandle) != LOCK_OK)
         {
             LogError("unable to Lock - - will still proceed to try to end the thread without locking");
@@ -1234,6 +2046,12 @@ void IoTHubClientCore_Destroy(IOTHUB_CLIENT_CORE_HANDLE iotHubClientHandle)
             singlylinkedlist_destroy(iotHubClientInstance->httpWorkerThreadInfoList);
         }
 
+        if (iotHubClientInstance->submissionLock != NULL)
+        {
+            /*Codes_SRS_IOTHUBCLIENT_44_028: [ `IoTHubClient_Destroy` shall pass the messages still in the submission queue to the IoTHubClientCore_LL instance before destroying it, so they are completed with `IOTHUB_CLIENT_CONFIRMATION_BECAUSE_DESTROY`. ]*/
+            drain_submitted_events(iotHubClientInstance);
+        }
+
         /* Codes_SRS_IOTHUBCLIENT_01_006: [That includes destroying the IoTHubClientCore_LL instance by calling IoTHubClientCore_LL_Destroy.] */
         IoTHubClientCore_LL_Destroy(iotHubClientInstance->IoTHubClientLLHandle);
 
@@ -1242,63 +2060,186 @@ void IoTHubClientCore_Destroy(IOTHUB_CLIENT_CORE_HANDLE iotHubClientHandle)
             LogError("unable to Unlock");
         }
 
-
-        vector_size = VECTOR_size(iotHubClientInstance->saved_user_callback_list);
-        size_t index = 0;
-        for (index = 0; index < vector_size; index++)
+
+        vector_size = VECTOR_size(iotHubClientInstance->saved_user_callback_list);
+        size_t index = 0;
+        for (index = 0; index < vector_size; index++)
+        {
+            USER_CALLBACK_INFO* queue_cb_info = (USER_CALLBACK_INFO*)VECTOR_element(iotHubClientInstance->saved_user_callback_list, index);
+            if (queue_cb_info != NULL)
+            {
+                if ((queue_cb_info->type == CALLBACK_TYPE_DEVICE_METHOD) || (queue_cb_info->type == CALLBACK_TYPE_INBOUD_DEVICE_METHOD))
+                {
+                    STRING_delete(queue_cb_info->iothub_callback.method_cb_info.method_name);
+                    BUFFER_delete(queue_cb_info->iothub_callback.method_cb_info.payload);
+                }
+                else if (queue_cb_info->type == CALLBACK_TYPE_DEVICE_TWIN)
+                {
+                    if (queue_cb_info->iothub_callback.dev_twin_cb_info.payLoad != NULL)
+                    {
+                        free(queue_cb_info->iothub_callback.dev_twin_cb_info.payLoad);
+                    }
+                }
+                else if (queue_cb_info->type == CALLBACK_TYPE_EVENT_CONFIRM)
+                {
+                    if (queue_cb_info->iothub_callback.event_confirm_cb_info.eventConfirmationCallback)
+                    {
+                        queue_cb_info->iothub_callback.event_confirm_cb_info.eventConfirmationCallback(queue_cb_info->iothub_callback.event_confirm_cb_info.confirm_result, queue_cb_info->userContextCallback);
+                    }
+                }
+            }
+        }
+        VECTOR_destroy(iotHubClientInstance->saved_user_callback_list);
+
+        if (iotHubClientInstance->TransportHandle == NULL)
+        {
+            /* Codes_SRS_IOTHUBCLIENT_01_032: [If the lock was allocated in IoTHubClient_Create, it shall be also freed..] */
+            Lock_Deinit(iotHubClientInstance->LockHandle);
+        }
+        if (iotHubClientInstance->callbackLock != NULL)
+        {
+            Lock_Deinit(iotHubClientInstance->callbackLock);
+        }
+        if (iotHubClientInstance->WorkCondition != NULL)
+        {
+            Condition_Deinit(iotHubClientInstance->WorkCondition);
+        }
+        if (iotHubClientInstance->submissionLock != NULL)
+        {
+            Lock_Deinit(iotHubClientInstance->submissionLock);
+            free(iotHubClientInstance->submitted_events);
+            free(iotHubClientInstance->draining_events);
+        }
+        if (iotHubClientInstance->devicetwin_user_context != NULL)
+        {
+            free(iotHubClientInstance->devicetwin_user_context);
+        }
+        if (iotHubClientInstance->connection_status_user_context != NULL)
+        {
+            free(iotHubClientInstance->connection_status_user_context);
+        }
+        if (iotHubClientInstance->queue_state_user_context != NULL)
+        {
+            free(iotHubClientInstance->queue_state_user_context);
+        }
+        if (iotHubClientInstance->message_user_context != NULL)
+        {
+            free(iotHubClientInstance->message_user_context);
+        }
+        if (iotHubClientInstance->method_user_context != NULL)
+        {
+            free(iotHubClientInstance->method_user_context);
+        }
+        free(iotHubClientInstance);
+    }
+}
+
+typedef IOTHUB_CLIENT_RESULT(*LL_SEND_EVENT_ASYNC_FUNC)(IOTHUB_CLIENT_CORE_LL_HANDLE iotHubClientHandle, IOTHUB_MESSAGE_HANDLE eventMessageHandle, IOTHUB_CLIENT_EVENT_CONFIRMATION_CALLBACK eventConfirmationCallback, void* userContextCallback);
+
+/*queues the message for the worker thread, without taking the lock held by IoTHubClientCore_LL_DoWork*/
+static IOTHUB_CLIENT_RESULT submit_event(IOTHUB_CLIENT_CORE_INSTANCE* iotHubClientInstance, bool take_ownership, IOTHUB_MESSAGE_HANDLE eventMessageHandle, IOTHUB_CLIENT_EVENT_CONFIRMATION_CALLBACK eventConfirmationCallback, void* userContextCallback)
+{
+    IOTHUB_CLIENT_RESULT result;
+    SUBMITTED_EVENT submitted_event;
+    bool wake_worker = false;
+    bool signal_transport = false;
+
+    /*Codes_SRS_IOTHUBCLIENT_44_024: [ Once `OPTION_SUBMISSION_QUEUE_SIZE` is set, `IoTHubClient_SendEventAsync` shall clone the message, unless called through `IoTHubClient_SendEventAsync_TakeOwnership`, and queue it for the worker thread without acquiring the lock created in `IoTHubClient_Create`. ]*/
+    if ((submitted_event.message = take_ownership ? eventMessageHandle : IoTHubMessage_Clone(eventMessageHandle)) == NULL)
+    {
+        result = IOTHUB_CLIENT_ERROR;
+        LogError("Failed cloning the message");
+    }
+    else
+    {
+        if (iotHubClientInstance->created_with_transport_handle != 0 || eventConfirmationCallback == NULL)
+        {
+            submitted_event.eventConfirmationCallback = eventConfirmationCallback;
+            submitted_event.userContextCallback = userContextCallback;
+            result = IOTHUB_CLIENT_OK;
+        }
+        else
+        {
+            IOTHUB_QUEUE_CONTEXT* queue_context = (IOTHUB_QUEUE_CONTEXT*)malloc(sizeof(IOTHUB_QUEUE_CONTEXT));
+            if (queue_context == NULL)
+            {
+                result = IOTHUB_CLIENT_ERROR;
+                LogError("Failed allocating QUEUE_CONTEXT");
+            }
+            else
+            {
+                queue_context->iotHubClientHandle = iotHubClientInstance;
+                queue_context->userContextCallback = userContextCallback;
+                queue_context->callbackFunction.eventConfirmationCallback = eventConfirmationCallback;
+                submitted_event.eventConfirmationCallback = iothub_ll_event_confirm_callback;
+                submitted_event.userContextCallback = queue_context;
+                result = IOTHUB_CLIENT_OK;
+            }
+        }
+
+        if (result == IOTHUB_CLIENT_OK)
         {
-            USER_CALLBACK_INFO* queue_cb_info = (USER_CALLBACK_INFO*)VECTOR_element(iotHubClientInstance->saved_user_callback_list, index);
-            if (queue_cb_info != NULL)
+            if (Lock(iotHubClientInstance->submissionLock) != LOCK_OK)
             {
-                if ((queue_cb_info->type == CALLBACK_TYPE_DEVICE_METHOD) || (queue_cb_info->type == CALLBACK_TYPE_INBOUD_DEVICE_METHOD))
-                {
-                    STRING_delete(queue_cb_info->iothub_callback.method_cb_info.method_name);
-                    BUFFER_delete(queue_cb_info->iothub_callback.method_cb_info.payload);
-                }
-                else if (queue_cb_info->type == CALLBACK_TYPE_DEVICE_TWIN)
+                result = IOTHUB_CLIENT_ERROR;
+                LogError("Could not acquire the submission lock");
+            }
+            else
+            {
+                /*Codes_SRS_IOTHUBCLIENT_44_025: [ If `submission_queue_size` messages are already queued, `IoTHubClient_SendEventAsync` shall return `IOTHUB_CLIENT_QUEUE_FULL`. ]*/
+                if (iotHubClientInstance->submitted_count == iotHubClientInstance->submission_queue_size)
                 {
-                    if (queue_cb_info->iothub_callback.dev_twin_cb_info.payLoad != NULL)
-                    {
-                        free(queue_cb_info->iothub_callback.dev_twin_cb_info.payLoad);
-                    }
+                    result = IOTHUB_CLIENT_QUEUE_FULL;
+                    LogError("The submission queue is full");
                 }
-                else if (queue_cb_info->type == CALLBACK_TYPE_EVENT_CONFIRM)
+                else
                 {
-                    if (queue_cb_info->iothub_callback.event_confirm_cb_info.eventConfirmationCallback)
-                    {
-                        queue_cb_info->iothub_callback.event_confirm_cb_info.eventConfirmationCallback(queue_cb_info->iothub_callback.event_confirm_cb_info.confirm_result, queue_cb_info->userContextCallback);
-                    }
+                    iotHubClientInstance->submitted_events[iotHubClientInstance->submitted_count++] = submitted_event;
+
+                    /*Codes_SRS_IOTHUBCLIENT_44_043: [ If the worker thread waits for work, `IoTHubClient_SendEventAsync` shall wake it up through the lock created in `IoTHubClient_Create`, and if the transport is shared and the submission queue was empty, it shall call `IoTHubTransport_SignalWork`. ]*/
+                    wake_worker = (iotHubClientInstance->workerWaiting != 0);
+                    iotHubClientInstance->workerWaiting = 0;
+                    signal_transport = (iotHubClientInstance->TransportHandle != NULL) && (iotHubClientInstance->submitted_count == 1);
                 }
+                (void)Unlock(iotHubClientInstance->submissionLock);
             }
-        }
-        VECTOR_destroy(iotHubClientInstance->saved_user_callback_list);
 
-        if (iotHubClientInstance->TransportHandle == NULL)
-        {
-            /* Codes_SRS_IOTHUBCLIENT_01_032: [If the lock was allocated in IoTHubClient_Create, it shall be also freed..] */
-            Lock_Deinit(iotHubClientInstance->LockHandle);
-        }
-        if (iotHubClientInstance->devicetwin_user_context != NULL)
-        {
-            free(iotHubClientInstance->devicetwin_user_context);
+            if (result != IOTHUB_CLIENT_OK && submitted_event.eventConfirmationCallback == iothub_ll_event_confirm_callback)
+            {
+                free(submitted_event.userContextCallback);
+            }
         }
-        if (iotHubClientInstance->connection_status_user_context != NULL)
+
+        if (result != IOTHUB_CLIENT_OK)
         {
-            free(iotHubClientInstance->connection_status_user_context);
+            if (!take_ownership)
+            {
+                IoTHubMessage_Destroy(submitted_event.message);
+            }
         }
-        if (iotHubClientInstance->message_user_context != NULL)
+        else if (wake_worker)
         {
-            free(iotHubClientInstance->message_user_context);
+            /*the worker thread holds the lock until it waits, so the signal cannot be lost*/
+            if (Lock(iotHubClientInstance->LockHandle) != LOCK_OK)
+            {
+                LogError("Could not acquire lock, the message is sent once do_work_idle_freq_ms elapses");
+            }
+            else
+            {
+                (void)signal_pending_work(iotHubClientInstance);
+                (void)Unlock(iotHubClientInstance->LockHandle);
+            }
         }
-        if (iotHubClientInstance->method_user_context != NULL)
+        else if (signal_transport)
         {
-            free(iotHubClientInstance->method_user_context);
+            IoTHubTransport_SignalWork(iotHubClientInstance->TransportHandle);
         }
-        free(iotHubClientInstance);
     }
+
+    return result;
 }
 
-IOTHUB_CLIENT_RESULT IoTHubClientCore_SendEventAsync(IOTHUB_CLIENT_CORE_HANDLE iotHubClientHandle, IOTHUB_MESSAGE_HANDLE eventMessageHandle, IOTHUB_CLIENT_EVENT_CONFIRMATION_CALLBACK eventConfirmationCallback, void* userContextCallback)
+static IOTHUB_CLIENT_RESULT send_event_async(IOTHUB_CLIENT_CORE_HANDLE iotHubClientHandle, LL_SEND_EVENT_ASYNC_FUNC ll_send_event_async, bool take_ownership, IOTHUB_MESSAGE_HANDLE eventMessageHandle, IOTHUB_CLIENT_EVENT_CONFIRMATION_CALLBACK eventConfirmationCallback, void* userContextCallback)
 {
     IOTHUB_CLIENT_RESULT result;
 
@@ -1319,6 +2260,10 @@ IOTHUB_CLIENT_RESULT IoTHubClientCore_SendEventAsync(IOTHUB_CLIENT_CORE_HANDLE i
             result = IOTHUB_CLIENT_ERROR;
             LogError("Could not start worker thread");
         }
+        else if (iotHubClientInstance->submissionLock != NULL)
+        {
+            result = submit_event(iotHubClientInstance, take_ownership, eventMessageHandle, eventConfirmationCallback, userContextCallback);
+        }
         else
         {
             /* Codes_SRS_IOTHUBCLIENT_01_025: [IoTHubClient_SendEventAsync shall be made thread-safe by using the lock created in IoTHubClient_Create.] */
@@ -1330,9 +2275,11 @@ IOTHUB_CLIENT_RESULT IoTHubClientCore_SendEventAsync(IOTHUB_CLIENT_CORE_HANDLE i
             }
             else
             {
+                bool signal_transport = false;
+
                 if (iotHubClientInstance->created_with_transport_handle != 0 || eventConfirmationCallback == NULL)
                 {
-                    result = IoTHubClientCore_LL_SendEventAsync(iotHubClientInstance->IoTHubClientLLHandle, eventMessageHandle, eventConfirmationCallback, userContextCallback);
+                    result = ll_send_event_async(iotHubClientInstance->IoTHubClientLLHandle, eventMessageHandle, eventConfirmationCallback, userContextCallback);
                 }
                 else
                 {
@@ -1350,7 +2297,7 @@ IOTHUB_CLIENT_RESULT IoTHubClientCore_SendEventAsync(IOTHUB_CLIENT_CORE_HANDLE i
                         queue_context->callbackFunction.eventConfirmationCallback = eventConfirmationCallback;
                         /* Codes_SRS_IOTHUBCLIENT_01_012: [IoTHubClient_SendEventAsync shall call IoTHubClientCore_LL_SendEventAsync, while passing the IoTHubClientCore_LL handle created by IoTHubClient_Create and the parameters eventMessageHandle, eventConfirmationCallback and userContextCallback.] */
                         /* Codes_SRS_IOTHUBCLIENT_01_013: [When IoTHubClientCore_LL_SendEventAsync is called, IoTHubClient_SendEventAsync shall return the result of IoTHubClientCore_LL_SendEventAsync.] */
-                        result = IoTHubClientCore_LL_SendEventAsync(iotHubClientInstance->IoTHubClientLLHandle, eventMessageHandle, iothub_ll_event_confirm_callback, queue_context);
+                        result = ll_send_event_async(iotHubClientInstance->IoTHubClientLLHandle, eventMessageHandle, iothub_ll_event_confirm_callback, queue_context);
                         if (result != IOTHUB_CLIENT_OK)
                         {
                             LogError("IoTHubClientCore_LL_SendEventAsync failed");
@@ -1359,8 +2306,133 @@ IOTHUB_CLIENT_RESULT IoTHubClientCore_SendEventAsync(IOTHUB_CLIENT_CORE_HANDLE i
                     }
                 }
 
+                if (result == IOTHUB_CLIENT_OK)
+                {
+                    signal_transport = signal_pending_work(iotHubClientInstance);
+                }
+
                 /* Codes_SRS_IOTHUBCLIENT_01_025: [IoTHubClient_SendEventAsync shall be made thread-safe by using the lock created in IoTHubClient_Create.] */
                 (void)Unlock(iotHubClientInstance->LockHandle);
+
+                if (signal_transport)
+                {
+                    IoTHubTransport_SignalWork(iotHubClientInstance->TransportHandle);
+                }
+            }
+        }
+    }
+
+    return result;
+}
+
+IOTHUB_CLIENT_RESULT IoTHubClientCore_SendEventAsync(IOTHUB_CLIENT_CORE_HANDLE iotHubClientHandle, IOTHUB_MESSAGE_HANDLE eventMessageHandle, IOTHUB_CLIENT_EVENT_CONFIRMATION_CALLBACK eventConfirmationCallback, void* userContextCallback)
+{
+    return send_event_async(iotHubClientHandle, IoTHubClientCore_LL_SendEventAsync, false, eventMessageHandle, eventConfirmationCallback, userContextCallback);
+}
+
+IOTHUB_CLIENT_RESULT IoTHubClientCore_SendEventAsync_TakeOwnership(IOTHUB_CLIENT_CORE_HANDLE iotHubClientHandle, IOTHUB_MESSAGE_HANDLE eventMessageHandle, IOTHUB_CLIENT_EVENT_CONFIRMATION_CALLBACK eventConfirmationCallback, void* userContextCallback)
+{
+    /* Codes_SRS_IOTHUBCLIENT_44_001: [ IoTHubClient_SendEventAsync_TakeOwnership shall behave like IoTHubClient_SendEventAsync but call IoTHubClientCore_LL_SendEventAsync_TakeOwnership so the message is not cloned. ] */
+    return send_event_async(iotHubClientHandle, IoTHubClientCore_LL_SendEventAsync_TakeOwnership, true, eventMessageHandle, eventConfirmationCallback, userContextCallback);
+}
+
+IOTHUB_CLIENT_RESULT IoTHubClientCore_SendEventBatchAsync(IOTHUB_CLIENT_CORE_HANDLE iotHubClientHandle, IOTHUB_MESSAGE_HANDLE* eventMessageHandles, size_t eventMessageCount, IOTHUB_CLIENT_BATCH_CONFIRMATION confirmationMode, IOTHUB_CLIENT_EVENT_CONFIRMATION_CALLBACK eventConfirmationCallback, void* userContextCallback)
+{
+    IOTHUB_CLIENT_RESULT result;
+
+    if (iotHubClientHandle == NULL)
+    {
+        /* Codes_SRS_IOTHUBCLIENT_44_002: [ If iotHubClientHandle is NULL, IoTHubClient_SendEventBatchAsync shall return IOTHUB_CLIENT_INVALID_ARG. ] */
+        result = IOTHUB_CLIENT_INVALID_ARG;
+        LogError("NULL iothubClientHandle");
+    }
+    else
+    {
+        IOTHUB_CLIENT_CORE_INSTANCE* iotHubClientInstance = (IOTHUB_CLIENT_CORE_INSTANCE*)iotHubClientHandle;
+
+        if ((result = StartWorkerThreadIfNeeded(iotHubClientInstance)) != IOTHUB_CLIENT_OK)
+        {
+            result = IOTHUB_CLIENT_ERROR;
+            LogError("Could not start worker thread");
+        }
+        /* Codes_SRS_IOTHUBCLIENT_44_003: [ IoTHubClient_SendEventBatchAsync shall acquire the lock created in IoTHubClient_Create once for the whole batch. ] */
+        else if (Lock(iotHubClientInstance->LockHandle) != LOCK_OK)
+        {
+            result = IOTHUB_CLIENT_ERROR;
+            LogError("Could not acquire lock");
+        }
+        else
+        {
+            bool signal_transport = false;
+
+            /* Codes_SRS_IOTHUBCLIENT_44_045: [ Once `OPTION_SUBMISSION_QUEUE_SIZE` is set, `IoTHubClient_SendEventBatchAsync` shall first pass the messages already in the submission queue to IoTHubClientCore_LL, so the batch does not overtake them. ] */
+            if (iotHubClientInstance->submissionLock != NULL)
+            {
+                (void)drain_submitted_events(iotHubClientInstance);
+            }
+
+            if (iotHubClientInstance->created_with_transport_handle != 0 || eventConfirmationCallback == NULL)
+            {
+                result = IoTHubClientCore_LL_SendEventBatchAsync(iotHubClientInstance->IoTHubClientLLHandle, eventMessageHandles, eventMessageCount, confirmationMode, eventConfirmationCallback, userContextCallback);
+            }
+            else if (confirmationMode == IOTHUB_CLIENT_BATCH_CONFIRMATION_PER_MESSAGE)
+            {
+                /* Codes_SRS_IOTHUBCLIENT_44_004: [ In IOTHUB_CLIENT_BATCH_CONFIRMATION_PER_MESSAGE mode IoTHubClient_SendEventBatchAsync shall allocate a single context shared by all the messages of the batch and release it after the last confirmation. ] */
+                IOTHUB_QUEUE_BATCH_CONTEXT* batch_context = (IOTHUB_QUEUE_BATCH_CONTEXT*)malloc(sizeof(IOTHUB_QUEUE_BATCH_CONTEXT));
+                if (batch_context == NULL)
+                {
+                    result = IOTHUB_CLIENT_ERROR;
+                    LogError("Failed allocating QUEUE_BATCH_CONTEXT");
+                }
+                else
+                {
+                    batch_context->queue_context.iotHubClientHandle = iotHubClientInstance;
+                    batch_context->queue_context.userContextCallback = userContextCallback;
+                    batch_context->queue_context.callbackFunction.eventConfirmationCallback = eventConfirmationCallback;
+                    batch_context->pending_count = eventMessageCount;
+
+                    result = IoTHubClientCore_LL_SendEventBatchAsync(iotHubClientInstance->IoTHubClientLLHandle, eventMessageHandles, eventMessageCount, confirmationMode, iothub_ll_event_batch_confirm_callback, batch_context);
+                    if (result != IOTHUB_CLIENT_OK)
+                    {
+                        LogError("IoTHubClientCore_LL_SendEventBatchAsync failed");
+                        free(batch_context);
+                    }
+                }
+            }
+            else
+            {
+                /* Codes_SRS_IOTHUBCLIENT_44_005: [ In IOTHUB_CLIENT_BATCH_CONFIRMATION_PER_BATCH mode IoTHubClient_SendEventBatchAsync shall allocate a single IOTHUB_QUEUE_CONTEXT for the batch. ] */
+                IOTHUB_QUEUE_CONTEXT* queue_context = (IOTHUB_QUEUE_CONTEXT*)malloc(sizeof(IOTHUB_QUEUE_CONTEXT));
+                if (queue_context == NULL)
+                {
+                    result = IOTHUB_CLIENT_ERROR;
+                    LogError("Failed allocating QUEUE_CONTEXT");
+                }
+                else
+                {
+                    queue_context->iotHubClientHandle = iotHubClientInstance;
+                    queue_context->userContextCallback = userContextCallback;
+                    queue_context->callbackFunction.eventConfirmationCallback = eventConfirmationCallback;
+
+                    result = IoTHubClientCore_LL_SendEventBatchAsync(iotHubClientInstance->IoTHubClientLLHandle, eventMessageHandles, eventMessageCount, confirmationMode, iothub_ll_event_confirm_callback, queue_context);
+                    if (result != IOTHUB_CLIENT_OK)
+                    {
+                        LogError("IoTHubClientCore_LL_SendEventBatchAsync failed");
+                        free(queue_context);
+                    }
+                }
+            }
+
+            if (result == IOTHUB_CLIENT_OK)
+            {
+                signal_transport = signal_pending_work(iotHubClientInstance);
+            }
+
+            (void)Unlock(iotHubClientInstance->LockHandle);
+
+            if (signal_transport)
+            {
+                IoTHubTransport_SignalWork(iotHubClientInstance->TransportHandle);
             }
         }
     }
@@ -1562,6 +2634,75 @@ IOTHUB_CLIENT_RESULT IoTHubClientCore_SetConnectionStatusCallback(IOTHUB_CLIENT_
     return result;
 }
 
+IOTHUB_CLIENT_RESULT IoTHubClientCore_SetOutgoingQueueStateCallback(IOTHUB_CLIENT_CORE_HANDLE iotHubClientHandle, IOTHUB_CLIENT_QUEUE_STATE_CALLBACK queueStateCallback, void* userContextCallback)
+{
+    IOTHUB_CLIENT_RESULT result;
+
+    if (iotHubClientHandle == NULL)
+    {
+        /* Codes_SRS_IOTHUBCLIENT_44_006: [ If `iotHubClientHandle` is `NULL`, `IoTHubClientCore_SetOutgoingQueueStateCallback` shall return `IOTHUB_CLIENT_INVALID_ARG`. ]*/
+        result = IOTHUB_CLIENT_INVALID_ARG;
+        LogError("NULL iothubClientHandle");
+    }
+    else
+    {
+        IOTHUB_CLIENT_CORE_INSTANCE* iotHubClientInstance = (IOTHUB_CLIENT_CORE_INSTANCE*)iotHubClientHandle;
+
+        /* Codes_SRS_IOTHUBCLIENT_44_007: [ `IoTHubClientCore_SetOutgoingQueueStateCallback` shall start the worker thread if it was not previously started. ]*/
+        if ((result = StartWorkerThreadIfNeeded(iotHubClientInstance)) != IOTHUB_CLIENT_OK)
+        {
+            result = IOTHUB_CLIENT_ERROR;
+            LogError("Could not start worker thread");
+        }
+        else if (Lock(iotHubClientInstance->LockHandle) != LOCK_OK)
+        {
+            result = IOTHUB_CLIENT_ERROR;
+            LogError("Could not acquire lock");
+        }
+        else
+        {
+            if (iotHubClientInstance->created_with_transport_handle == 0)
+            {
+                iotHubClientInstance->queue_state_callback = queueStateCallback;
+            }
+
+            if (iotHubClientInstance->created_with_transport_handle != 0 || queueStateCallback == NULL)
+            {
+                result = IoTHubClientCore_LL_SetOutgoingQueueStateCallback(iotHubClientInstance->IoTHubClientLLHandle, queueStateCallback, userContextCallback);
+            }
+            else
+            {
+                if (iotHubClientInstance->queue_state_user_context != NULL)
+                {
+                    free(iotHubClientInstance->queue_state_user_context);
+                }
+                iotHubClientInstance->queue_state_user_context = (IOTHUB_QUEUE_CONTEXT*)malloc(sizeof(IOTHUB_QUEUE_CONTEXT));
+                if (iotHubClientInstance->queue_state_user_context == NULL)
+                {
+                    result = IOTHUB_CLIENT_ERROR;
+                    LogError("Failed allocating QUEUE_CONTEXT");
+                }
+                else
+                {
+                    iotHubClientInstance->queue_state_user_context->iotHubClientHandle = iotHubClientInstance;
+                    iotHubClientInstance->queue_state_user_context->userContextCallback = userContextCallback;
+
+                    /* Codes_SRS_IOTHUBCLIENT_44_008: [ `IoTHubClientCore_SetOutgoingQueueStateCallback` shall call `IoTHubClientCore_LL_SetOutgoingQueueStateCallback` and invoke `queueStateCallback` from the callback dispatch of the worker thread, with the lock not held. ]*/
+                    result = IoTHubClientCore_LL_SetOutgoingQueueStateCallback(iotHubClientInstance->IoTHubClientLLHandle, iothub_ll_queue_state_callback, iotHubClientInstance->queue_state_user_context);
+                    if (result != IOTHUB_CLIENT_OK)
+                    {
+                        LogError("IoTHubClientCore_LL_SetOutgoingQueueStateCallback failed");
+                        free(iotHubClientInstance->queue_state_user_context);
+                        iotHubClientInstance->queue_state_user_context = NULL;
+                    }
+                }
+            }
+            (void)Unlock(iotHubClientInstance->LockHandle);
+        }
+    }
+    return result;
+}
+
 IOTHUB_CLIENT_RESULT IoTHubClientCore_SetRetryPolicy(IOTHUB_CLIENT_CORE_HANDLE iotHubClientHandle, IOTHUB_CLIENT_RETRY_POLICY retryPolicy, size_t retryTimeoutLimitInSeconds)
 {
     IOTHUB_CLIENT_RESULT result;
@@ -1682,6 +2823,38 @@ IOTHUB_CLIENT_RESULT IoTHubClientCore_GetLastMessageReceiveTime(IOTHUB_CLIENT_CO
     return result;
 }
 
+IOTHUB_CLIENT_RESULT IoTHubClientCore_GetRttStatistics(IOTHUB_CLIENT_CORE_HANDLE iotHubClientHandle, IOTHUB_CLIENT_RTT_STATISTICS* rttStatistics)
+{
+    IOTHUB_CLIENT_RESULT result;
+
+    if (iotHubClientHandle == NULL)
+    {
+        /* Codes_SRS_IOTHUBCLIENT_44_049: [If iotHubClientHandle is NULL, IoTHubClient_GetRttStatistics shall return IOTHUB_CLIENT_INVALID_ARG.] */
+        result = IOTHUB_CLIENT_INVALID_ARG;
+        LogError("NULL iothubClientHandle");
+    }
+    else
+    {
+        IOTHUB_CLIENT_CORE_INSTANCE* iotHubClientInstance = (IOTHUB_CLIENT_CORE_INSTANCE*)iotHubClientHandle;
+
+        if (Lock(iotHubClientInstance->LockHandle) != LOCK_OK)
+        {
+            /* Codes_SRS_IOTHUBCLIENT_44_050: [If acquiring the lock created in IoTHubClient_Create fails, IoTHubClient_GetRttStatistics shall return IOTHUB_CLIENT_ERROR.] */
+            result = IOTHUB_CLIENT_ERROR;
+            LogError("Could not acquire lock");
+        }
+        else
+        {
+            /* Codes_SRS_IOTHUBCLIENT_44_051: [Otherwise, IoTHubClient_GetRttStatistics shall return the result of IoTHubClient_LL_GetRttStatistics, called under the lock.] */
+            result = IoTHubClientCore_LL_GetRttStatistics(iotHubClientInstance->IoTHubClientLLHandle, rttStatistics);
+
+            (void)Unlock(iotHubClientInstance->LockHandle);
+        }
+    }
+
+    return result;
+}
+
 IOTHUB_CLIENT_RESULT IoTHubClientCore_SetOption(IOTHUB_CLIENT_CORE_HANDLE iotHubClientHandle, const char* optionName, const void* value)
 {
     IOTHUB_CLIENT_RESULT result;
@@ -1710,31 +2883,233 @@ IOTHUB_CLIENT_RESULT IoTHubClientCore_SetOption(IOTHUB_CLIENT_CORE_HANDLE iotHub
         }
         else
         {
+            unsigned int transport_idle_time_ms = 0;
+            tickcounter_ms_t previous_idle_freq_ms = iotHubClientInstance->do_work_idle_freq_ms;
+
             /* Codes_SRS_IOTHUBCLIENT_41_001 [ If parameter `optionName` is `OPTION_DO_WORK_FREQUENCY_IN_MS` then `IoTHubClient_SetOption` shall set `do_work_freq_ms` parameter of `IoTHubClientInstance` ]*/
             if (strcmp(OPTION_DO_WORK_FREQUENCY_IN_MS, optionName) == 0)
             {
-                /* Codes_SRS_IOTHUBCLIENT_41_003: [ The value for `OPTION_DO_WORK_FREQUENCY_IN_MS` shall be limited to 100 to follow SDK best practices by not reducing the DoWork frequency below 10 Hz ]*/
-                if (0 < * (unsigned int *)value && * (unsigned int *)value <= 100)
+                /* Codes_SRS_IOTHUBCLIENT_41_003: [ The value for `OPTION_DO_WORK_FREQUENCY_IN_MS` shall be limited to 100 to follow SDK best practices by not reducing the DoWork frequency below 10 Hz ]*/
+                if (0 < * (unsigned int *)value && * (unsigned int *)value <= 100)
+                {
+                    /* Codes_SRS_IOTHUBCLIENT_41_004: [ If `currentMessageTimeout` is not greater than `do_work_freq_ms`, `IotHubClientCore_SetOption` shall return `IOTHUB_CLIENT_INVALID_ARG` ]*/
+                    /* Codes_SRS_IOTHUBCLIENT_41_007: [** If parameter `optionName` is `OPTION_DO_WORK_FREQUENCY_IN_MS` then `value` should be of type `tickcounter_ms_t *`. **]*/
+                    if ((!iotHubClientInstance->currentMessageTimeout) || ( * (tickcounter_ms_t *)value < iotHubClientInstance->currentMessageTimeout))
+                    {
+                        iotHubClientInstance->do_work_freq_ms = * (tickcounter_ms_t *)value;
+                        result = IOTHUB_CLIENT_OK;
+                    }
+                    else
+                    {
+                        result = IOTHUB_CLIENT_INVALID_ARG;
+                        LogError("Invalid value: OPTION_DO_WORK_FREQUENCY_IN_MS cannot exceed that of OPTION_MESSAGE_TIMEOUT.");
+                    }
+                }
+                else
+                {
+                    result = IOTHUB_CLIENT_INVALID_ARG;
+                    LogError("Invalid value: OPTION_DO_WORK_FREQUENCY_IN_MS cannot exceed 100 ms. If you wish to reduce the frequency further, consider using the LL layer.");
+                }
+            }
+            else if (strcmp(OPTION_DO_WORK_IDLE_FREQ_IN_MS, optionName) == 0)
+            {
+                tickcounter_ms_t idle_freq_ms = *(tickcounter_ms_t*)value;
+
+                /* Codes_SRS_IOTHUBCLIENT_44_009: [ If parameter `optionName` is `OPTION_DO_WORK_IDLE_FREQ_IN_MS` and `value` is lower than `do_work_freq_ms` or greater than 1000, `IoTHubClient_SetOption` shall return `IOTHUB_CLIENT_INVALID_ARG`. ]*/
+                if ((idle_freq_ms < iotHubClientInstance->do_work_freq_ms) || (idle_freq_ms > DO_WORK_IDLE_FREQ_MAX))
+                {
+                    result = IOTHUB_CLIENT_INVALID_ARG;
+                    LogError("Invalid value: OPTION_DO_WORK_IDLE_FREQ_IN_MS must be between OPTION_DO_WORK_FREQUENCY_IN_MS and %d ms", DO_WORK_IDLE_FREQ_MAX);
+                }
+                /* Codes_SRS_IOTHUBCLIENT_44_012: [ If the transport is shared, `IoTHubClient_SetOption` shall set the idle time of the transport worker thread by calling `IoTHubTransport_SetWorkerIdleTime` once the lock is released, and return `IOTHUB_CLIENT_ERROR` if it fails. ]*/
+                else if (iotHubClientInstance->TransportHandle != NULL)
+                {
+                    /*IoTHubTransport_SetWorkerIdleTime takes the transport lock, which is the lock held here, so it is called once the lock is released*/
+                    iotHubClientInstance->do_work_idle_freq_ms = idle_freq_ms;
+                    transport_idle_time_ms = (unsigned int)idle_freq_ms;
+                    result = IOTHUB_CLIENT_OK;
+                }
+                /* Codes_SRS_IOTHUBCLIENT_44_013: [ Otherwise `IoTHubClient_SetOption` shall create the condition the worker thread waits on, and fail with `IOTHUB_CLIENT_ERROR` if it cannot be created. ]*/
+                else if ((iotHubClientInstance->WorkCondition == NULL) && ((iotHubClientInstance->WorkCondition = Condition_Init()) == NULL))
+                {
+                    result = IOTHUB_CLIENT_ERROR;
+                    LogError("Condition_Init failed");
+                }
+                else
+                {
+                    iotHubClientInstance->do_work_idle_freq_ms = idle_freq_ms;
+                    result = IOTHUB_CLIENT_OK;
+                }
+            }
+            else if (strcmp(OPTION_CALLBACK_DISPATCHER_THREADS, optionName) == 0)
+            {
+                size_t dispatcher_count = *(size_t*)value;
+
+                /* Codes_SRS_IOTHUBCLIENT_44_014: [ If parameter `optionName` is `OPTION_CALLBACK_DISPATCHER_THREADS` and `value` is 0 or greater than the number of callback types, `IoTHubClient_SetOption` shall return `IOTHUB_CLIENT_INVALID_ARG`. ]*/
+                if ((dispatcher_count == 0) || (dispatcher_count > CALLBACK_DISPATCHER_MAX_THREADS))
                 {
-                    /* Codes_SRS_IOTHUBCLIENT_41_004: [ If `currentMessageTimeout` is not greater than `do_work_freq_ms`, `IotHubClientCore_SetOption` shall return `IOTHUB_CLIENT_INVALID_ARG` ]*/
-                    /* Codes_SRS_IOTHUBCLIENT_41_007: [** If parameter `optionName` is `OPTION_DO_WORK_FREQUENCY_IN_MS` then `value` should be of type `tickcounter_ms_t *`. **]*/
-                    if ((!iotHubClientInstance->currentMessageTimeout) || ( * (tickcounter_ms_t *)value < iotHubClientInstance->currentMessageTimeout))
+                    result = IOTHUB_CLIENT_INVALID_ARG;
+                    LogError("Invalid value: OPTION_CALLBACK_DISPATCHER_THREADS must be between 1 and %d", CALLBACK_DISPATCHER_MAX_THREADS);
+                }
+                /* Codes_SRS_IOTHUBCLIENT_44_015: [ If the dispatcher threads were already started, `IoTHubClient_SetOption` shall return `IOTHUB_CLIENT_ERROR`. ]*/
+                else if (iotHubClientInstance->dispatchers != NULL)
+                {
+                    result = IOTHUB_CLIENT_ERROR;
+                    LogError("OPTION_CALLBACK_DISPATCHER_THREADS can only be set once");
+                }
+                /* Codes_SRS_IOTHUBCLIENT_44_016: [ Otherwise `IoTHubClient_SetOption` shall start `value` dispatcher threads, and fail with `IOTHUB_CLIENT_ERROR` if any of them cannot be started. ]*/
+                else if (start_callback_dispatchers(iotHubClientInstance, dispatcher_count) != 0)
+                {
+                    result = IOTHUB_CLIENT_ERROR;
+                    LogError("failed starting the callback dispatchers");
+                }
+                else
+                {
+                    result = IOTHUB_CLIENT_OK;
+                }
+            }
+            else if (strcmp(OPTION_CALLBACK_DISPATCHER_QUEUE_SIZE, optionName) == 0)
+            {
+                /* Codes_SRS_IOTHUBCLIENT_44_017: [ If parameter `optionName` is `OPTION_CALLBACK_DISPATCHER_QUEUE_SIZE` and `value` is 0, `IoTHubClient_SetOption` shall return `IOTHUB_CLIENT_INVALID_ARG`. ]*/
+                if (*(size_t*)value == 0)
+                {
+                    result = IOTHUB_CLIENT_INVALID_ARG;
+                    LogError("Invalid value: OPTION_CALLBACK_DISPATCHER_QUEUE_SIZE cannot be 0");
+                }
+                else if (lock_user_callbacks(iotHubClientInstance) != 0)
+                {
+                    result = IOTHUB_CLIENT_ERROR;
+                }
+                /* Codes_SRS_IOTHUBCLIENT_44_018: [ Otherwise `IoTHubClient_SetOption` shall set the number of callbacks each dispatcher thread can have waiting to `value` and return `IOTHUB_CLIENT_OK`. ]*/
+                else
+                {
+                    iotHubClientInstance->dispatcher_queue_size = *(size_t*)value;
+                    unlock_user_callbacks(iotHubClientInstance);
+                    result = IOTHUB_CLIENT_OK;
+                }
+            }
+            else if (strcmp(OPTION_DO_WORK_CALLBACK_BUDGET, optionName) == 0)
+            {
+                /* Codes_SRS_IOTHUBCLIENT_44_042: [ If parameter `optionName` is `OPTION_DO_WORK_CALLBACK_BUDGET`, `IoTHubClient_SetOption` shall set the number of callbacks run on each pass of the worker thread to `value`, 0 meaning all of them, and return `IOTHUB_CLIENT_OK`. ]*/
+                if (lock_user_callbacks(iotHubClientInstance) != 0)
+                {
+                    result = IOTHUB_CLIENT_ERROR;
+                }
+                else
+                {
+                    iotHubClientInstance->callback_budget = *(size_t*)value;
+                    unlock_user_callbacks(iotHubClientInstance);
+                    result = IOTHUB_CLIENT_OK;
+                }
+            }
+            else if (strcmp(OPTION_TRANSPORT_WORKER_THREADS, optionName) == 0)
+            {
+                /* Codes_SRS_IOTHUBCLIENT_44_039: [ If parameter `optionName` is `OPTION_TRANSPORT_WORKER_THREADS` and the transport is not shared, `IoTHubClient_SetOption` shall return `IOTHUB_CLIENT_INVALID_ARG`. ]*/
+                if (iotHubClientInstance->TransportHandle == NULL)
+                {
+                    result = IOTHUB_CLIENT_INVALID_ARG;
+                    LogError("OPTION_TRANSPORT_WORKER_THREADS only applies to a shared transport");
+                }
+                /* Codes_SRS_IOTHUBCLIENT_44_040: [ Otherwise `IoTHubClient_SetOption` shall return the result of calling `IoTHubTransport_SetWorkerThreadCount` with `value`. ]*/
+                else if ((result = IoTHubTransport_SetWorkerThreadCount(iotHubClientInstance->TransportHandle, *(size_t*)value)) != IOTHUB_CLIENT_OK)
+                {
+                    LogError("IoTHubTransport_SetWorkerThreadCount failed");
+                }
+            }
+            else if (strcmp(OPTION_SUBMISSION_QUEUE_SIZE, optionName) == 0)
+            {
+                size_t submission_queue_size = *(size_t*)value;
+
+                /* Codes_SRS_IOTHUBCLIENT_44_023: [ If parameter `optionName` is `OPTION_SUBMISSION_QUEUE_SIZE` and `value` is 0, or the submission queue was already created, `IoTHubClient_SetOption` shall fail. ]*/
+                if (submission_queue_size == 0)
+                {
+                    result = IOTHUB_CLIENT_INVALID_ARG;
+                    LogError("Invalid value: OPTION_SUBMISSION_QUEUE_SIZE cannot be 0");
+                }
+                else if (iotHubClientInstance->submissionLock != NULL)
+                {
+                    result = IOTHUB_CLIENT_ERROR;
+                    LogError("OPTION_SUBMISSION_QUEUE_SIZE can only be set once");
+                }
+                else if (submission_queue_size > SIZE_MAX / sizeof(SUBMITTED_EVENT))
+                {
+                    result = IOTHUB_CLIENT_INVALID_ARG;
+                    LogError("Invalid value: OPTION_SUBMISSION_QUEUE_SIZE is too large");
+                }
+                else
+                {
+                    SUBMITTED_EVENT* submitted_events = (SUBMITTED_EVENT*)malloc(submission_queue_size * sizeof(SUBMITTED_EVENT));
+                    SUBMITTED_EVENT* draining_events = (SUBMITTED_EVENT*)malloc(submission_queue_size * sizeof(SUBMITTED_EVENT));
+                    LOCK_HANDLE submissionLock;
+
+                    if (submitted_events == NULL || draining_events == NULL)
                     {
-                        iotHubClientInstance->do_work_freq_ms = * (tickcounter_ms_t *)value;
-                        result = IOTHUB_CLIENT_OK;
+                        result = IOTHUB_CLIENT_ERROR;
+                        LogError("Failed allocating the submission queue");
+                        free(submitted_events);
+                        free(draining_events);
+                    }
+                    else if ((submissionLock = Lock_Init()) == NULL)
+                    {
+                        result = IOTHUB_CLIENT_ERROR;
+                        LogError("Failure creating the submission lock");
+                        free(submitted_events);
+                        free(draining_events);
                     }
                     else
                     {
-                        result = IOTHUB_CLIENT_INVALID_ARG;
-                        LogError("Invalid value: OPTION_DO_WORK_FREQUENCY_IN_MS cannot exceed that of OPTION_MESSAGE_TIMEOUT.");
+                        iotHubClientInstance->submitted_events = submitted_events;
+                        iotHubClientInstance->draining_events = draining_events;
+                        iotHubClientInstance->submitted_count = 0;
+                        iotHubClientInstance->submission_queue_size = submission_queue_size;
+                        iotHubClientInstance->submissionLock = submissionLock;
+                        result = IOTHUB_CLIENT_OK;
                     }
                 }
+            }
+#if !defined(DONT_USE_UPLOADTOBLOB)
+            else if (strcmp(OPTION_BLOB_UPLOAD_WORKER_THREADS, optionName) == 0)
+            {
+                size_t upload_worker_count = *(size_t*)value;
+
+                /* Codes_SRS_IOTHUBCLIENT_44_029: [ If parameter `optionName` is `OPTION_BLOB_UPLOAD_WORKER_THREADS` and `value` is 0 or greater than 16, `IoTHubClient_SetOption` shall return `IOTHUB_CLIENT_INVALID_ARG`. ]*/
+                if ((upload_worker_count == 0) || (upload_worker_count > BLOB_UPLOAD_WORKER_THREADS_MAX))
+                {
+                    result = IOTHUB_CLIENT_INVALID_ARG;
+                    LogError("Invalid value: OPTION_BLOB_UPLOAD_WORKER_THREADS must be between 1 and %d", BLOB_UPLOAD_WORKER_THREADS_MAX);
+                }
+                /* Codes_SRS_IOTHUBCLIENT_44_030: [ If the upload worker threads were already started, `IoTHubClient_SetOption` shall return `IOTHUB_CLIENT_ERROR`. ]*/
+                else if (iotHubClientInstance->uploadWorkers != NULL)
+                {
+                    result = IOTHUB_CLIENT_ERROR;
+                    LogError("OPTION_BLOB_UPLOAD_WORKER_THREADS can only be set once");
+                }
+                /* Codes_SRS_IOTHUBCLIENT_44_031: [ Otherwise `IoTHubClient_SetOption` shall start `value` upload worker threads, and fail with `IOTHUB_CLIENT_ERROR` if any of them cannot be started. ]*/
+                else if (start_upload_workers(iotHubClientInstance, upload_worker_count) != 0)
+                {
+                    result = IOTHUB_CLIENT_ERROR;
+                    LogError("failed starting the upload workers");
+                }
                 else
+                {
+                    result = IOTHUB_CLIENT_OK;
+                }
+            }
+            else if (strcmp(OPTION_BLOB_UPLOAD_QUEUE_SIZE, optionName) == 0)
+            {
+                /* Codes_SRS_IOTHUBCLIENT_44_032: [ If parameter `optionName` is `OPTION_BLOB_UPLOAD_QUEUE_SIZE` and `value` is 0, `IoTHubClient_SetOption` shall return `IOTHUB_CLIENT_INVALID_ARG`, otherwise it shall set the number of uploads that can wait for an upload worker thread to `value`. ]*/
+                if (*(size_t*)value == 0)
                 {
                     result = IOTHUB_CLIENT_INVALID_ARG;
-                    LogError("Invalid value: OPTION_DO_WORK_FREQUENCY_IN_MS cannot exceed 100 ms. If you wish to reduce the frequency further, consider using the LL layer.");
+                    LogError("Invalid value: OPTION_BLOB_UPLOAD_QUEUE_SIZE cannot be 0");
+                }
+                else
+                {
+                    iotHubClientInstance->upload_queue_size = *(size_t*)value;
+                    result = IOTHUB_CLIENT_OK;
                 }
             }
+#endif /*DONT_USE_UPLOADTOBLOB*/
             /* Codes_SRS_IOTHUBCLIENT_41_005: [ If parameter `optionName` is `OPTION_MESSAGE_TIMEOUT` then `IoTHubClientCore_SetOption` shall set `currentMessageTimeout` parameter of `IoTHubClientInstance` ]*/
             else if (strcmp(OPTION_MESSAGE_TIMEOUT, optionName) == 0)
             {
@@ -1766,6 +3141,19 @@ IOTHUB_CLIENT_RESULT IoTHubClientCore_SetOption(IOTHUB_CLIENT_CORE_HANDLE iotHub
                 }
             }
             (void)Unlock(iotHubClientInstance->LockHandle);
+
+            if ((transport_idle_time_ms != 0) &&
+                (IoTHubTransport_SetWorkerIdleTime(iotHubClientInstance->TransportHandle, transport_idle_time_ms) != IOTHUB_CLIENT_OK))
+            {
+                result = IOTHUB_CLIENT_ERROR;
+                LogError("IoTHubTransport_SetWorkerIdleTime failed");
+
+                if (Lock(iotHubClientInstance->LockHandle) == LOCK_OK)
+                {
+                    iotHubClientInstance->do_work_idle_freq_ms = previous_idle_freq_ms;
+                    (void)Unlock(iotHubClientInstance->LockHandle);
+                }
+            }
         }
     }
     return result;
@@ -1881,6 +3269,8 @@ IOTHUB_CLIENT_RESULT IoTHubClientCore_SendReportedState(IOTHUB_CLIENT_CORE_HANDL
             }
             else
             {
+                bool signal_transport = false;
+
                 if (iotHubClientInstance->created_with_transport_handle != 0 || reportedStateCallback == NULL)
                 {
                     /*Codes_SRS_IOTHUBCLIENT_10_017: [** `IoTHubClient_SendReportedState` shall call `IoTHubClientCore_LL_SendReportedState`, while passing the `IoTHubClientCore_LL handle` created by `IoTHubClientCore_LL_Create` along with the parameters `reportedState`, `size`, `reportedStateCallback`, and `userContextCallback`. ]*/
@@ -1912,7 +3302,17 @@ IOTHUB_CLIENT_RESULT IoTHubClientCore_SendReportedState(IOTHUB_CLIENT_CORE_HANDL
                     }
                 }
 
+                if (result == IOTHUB_CLIENT_OK)
+                {
+                    signal_transport = signal_pending_work(iotHubClientInstance);
+                }
+
                 (void)Unlock(iotHubClientInstance->LockHandle);
+
+                if (signal_transport)
+                {
+                    IoTHubTransport_SignalWork(iotHubClientInstance->TransportHandle);
+                }
             }
         }
     }
@@ -1965,6 +3365,8 @@ IOTHUB_CLIENT_RESULT IoTHubClientCore_GetTwinAsync(IOTHUB_CLIENT_CORE_HANDLE iot
                 }
                 else
                 {
+                    bool signal_transport = false;
+
                     // Codes_SRS_IOTHUBCLIENT_09_014: [ `IoTHubClientCore_GetTwinAsync` shall call `IoTHubClientCore_LL_GetTwinAsync`, passing the `IoTHubClient_LL handle`, `deviceTwinCallback` and `userContextCallback` as arguments ]
                     // Codes_SRS_IOTHUBCLIENT_09_015: [ When `IoTHubClientCore_LL_GetTwinAsync` is called, `IoTHubClientCore_GetTwinAsync` shall return the result of `IoTHubClientCore_LL_GetTwinAsync`. ]
                     result = IoTHubClientCore_LL_GetTwinAsync(iotHubClientInstance->IoTHubClientLLHandle, iothub_ll_get_device_twin_async_callback, queueContext);
@@ -1974,8 +3376,17 @@ IOTHUB_CLIENT_RESULT IoTHubClientCore_GetTwinAsync(IOTHUB_CLIENT_CORE_HANDLE iot
                         LogError("IoTHubClientCore_LL_GetTwinAsync failed");
                         free(queueContext);
                     }
+                    else
+                    {
+                        signal_transport = signal_pending_work(iotHubClientInstance);
+                    }
 
                     (void)Unlock(iotHubClientInstance->LockHandle);
+
+                    if (signal_transport)
+                    {
+                        IoTHubTransport_SignalWork(iotHubClientInstance->TransportHandle);
+                    }
                 }
             }
         }
@@ -2229,23 +3640,30 @@ static IOTHUB_CLIENT_RESULT startHttpWorkerThread(IOTHUB_CLIENT_CORE_HANDLE iotH
 
 static int markThreadReadyToBeGarbageCollected(HTTPWORKER_THREAD_INFO* threadInfo)
 {
-    /*Codes_SRS_IOTHUBCLIENT_02_071: [ The thread shall mark itself as disposable. ]*/
-    if (Lock(threadInfo->lockGarbage) != LOCK_OK)
+    if (threadInfo->uploadJobFunc != NULL)
     {
-        LogError("unable to Lock - trying anyway");
-        threadInfo->canBeGarbageCollected = 1;
+        /*run by an upload worker, which frees threadInfo and goes on with the next upload*/
     }
     else
     {
-        threadInfo->canBeGarbageCollected = 1;
-
-        if (Unlock(threadInfo->lockGarbage) != LOCK_OK)
+        /*Codes_SRS_IOTHUBCLIENT_02_071: [ The thread shall mark itself as disposable. ]*/
+        if (Lock(threadInfo->lockGarbage) != LOCK_OK)
         {
-            LogError("unable to Unlock after locking");
+            LogError("unable to Lock - trying anyway");
+            threadInfo->canBeGarbageCollected = 1;
         }
-    }
+        else
+        {
+            threadInfo->canBeGarbageCollected = 1;
 
-    ThreadAPI_Exit(0);
+            if (Unlock(threadInfo->lockGarbage) != LOCK_OK)
+            {
+                LogError("unable to Unlock after locking");
+            }
+        }
+
+        ThreadAPI_Exit(0);
+    }
     return 0;
 }
 
@@ -2314,6 +3732,75 @@ static IOTHUB_CLIENT_RESULT initializeUploadToBlobData(HTTPWORKER_THREAD_INFO* t
 }
 
 
+static IOTHUB_CLIENT_RESULT startUploadJob(IOTHUB_CLIENT_CORE_HANDLE iotHubClientHandle, HTTPWORKER_THREAD_INFO* threadInfo, THREAD_START_FUNC uploadFunc, IOTHUB_CLIENT_UPLOAD_JOB_ID* uploadJobId)
+{
+    IOTHUB_CLIENT_RESULT result;
+
+    /*Codes_SRS_IOTHUBCLIENT_44_046: [ `IoTHubClient_UploadToBlobAsync` and `IoTHubClient_UploadMultipleBlocksToBlobAsync(Ex)` shall check whether the upload worker threads are started and give the upload the next upload job id, skipping 0, while holding the lock used by `IoTHubClient_SetOption` and `IoTHubClient_Destroy` to start and stop them. ]*/
+    if (Lock(iotHubClientHandle->LockHandle) != LOCK_OK)
+    {
+        LogError("Lock failed");
+        result = IOTHUB_CLIENT_ERROR;
+    }
+    else
+    {
+        bool runOnItsOwnThread = (iotHubClientHandle->uploadWorkers == NULL);
+
+        if (++iotHubClientHandle->last_upload_job_id == 0)
+        {
+            iotHubClientHandle->last_upload_job_id = 1;
+        }
+        threadInfo->uploadJobId = iotHubClientHandle->last_upload_job_id;
+        /*threadInfo belongs to the upload once it is started*/
+        *uploadJobId = threadInfo->uploadJobId;
+
+        if (runOnItsOwnThread)
+        {
+            result = IOTHUB_CLIENT_OK;
+        }
+        /*Codes_SRS_IOTHUBCLIENT_44_033: [ Once the upload worker threads are started, `IoTHubClient_UploadToBlobAsync` and `IoTHubClient_UploadMultipleBlocksToBlobAsync(Ex)` shall queue the upload for them instead of spawning a thread, and return `IOTHUB_CLIENT_QUEUE_FULL` if `OPTION_BLOB_UPLOAD_QUEUE_SIZE` uploads are already waiting. ]*/
+        else if (Lock(iotHubClientHandle->uploadWorkerLock) != LOCK_OK)
+        {
+            LogError("Lock failed");
+            result = IOTHUB_CLIENT_ERROR;
+        }
+        else
+        {
+            if (iotHubClientHandle->pending_upload_count >= iotHubClientHandle->upload_queue_size)
+            {
+                LogError("%lu uploads are already waiting for an upload worker", (unsigned long)iotHubClientHandle->pending_upload_count);
+                result = IOTHUB_CLIENT_QUEUE_FULL;
+            }
+            else
+            {
+                threadInfo->uploadJobFunc = uploadFunc;
+                if (singlylinkedlist_add(iotHubClientHandle->pendingUploads, threadInfo) == NULL)
+                {
+                    LogError("Adding item to list failed");
+                    threadInfo->uploadJobFunc = NULL;
+                    result = IOTHUB_CLIENT_ERROR;
+                }
+                else
+                {
+                    iotHubClientHandle->pending_upload_count++;
+                    (void)Condition_Post(iotHubClientHandle->uploadWorkerCondition);
+                    result = IOTHUB_CLIENT_OK;
+                }
+            }
+            (void)Unlock(iotHubClientHandle->uploadWorkerLock);
+        }
+        (void)Unlock(iotHubClientHandle->LockHandle);
+
+        if (runOnItsOwnThread)
+        {
+            /*startHttpWorkerThread takes the lock itself*/
+            result = startHttpWorkerThread(iotHubClientHandle, threadInfo, uploadFunc);
+        }
+    }
+
+    return result;
+}
+
 static int uploadingThread(void *data)
 {
     IOTHUB_CLIENT_FILE_UPLOAD_RESULT upload_result;
@@ -2343,7 +3830,7 @@ static int uploadingThread(void *data)
     return markThreadReadyToBeGarbageCollected(threadInfo);
 }
 
-IOTHUB_CLIENT_RESULT IoTHubClientCore_UploadToBlobAsync(IOTHUB_CLIENT_CORE_HANDLE iotHubClientHandle, const char* destinationFileName, const unsigned char* source, size_t size, IOTHUB_CLIENT_FILE_UPLOAD_CALLBACK iotHubClientFileUploadCallback, void* context)
+static IOTHUB_CLIENT_RESULT upload_to_blob_async(IOTHUB_CLIENT_CORE_HANDLE iotHubClientHandle, const char* destinationFileName, const unsigned char* source, size_t size, IOTHUB_CLIENT_FILE_UPLOAD_CALLBACK iotHubClientFileUploadCallback, void* context, IOTHUB_CLIENT_UPLOAD_JOB_ID* uploadJobId)
 {
     IOTHUB_CLIENT_RESULT result;
     /*Codes_SRS_IOTHUBCLIENT_02_047: [ If iotHubClientHandle is NULL then IoTHubClient_UploadToBlobAsync shall fail and return IOTHUB_CLIENT_INVALID_ARG. ]*/
@@ -2367,6 +3854,7 @@ IOTHUB_CLIENT_RESULT IoTHubClientCore_UploadToBlobAsync(IOTHUB_CLIENT_CORE_HANDL
     }
     else
     {
+        IOTHUB_CLIENT_UPLOAD_JOB_ID jobId;
         /*Codes_SRS_IOTHUBCLIENT_02_051: [IoTHubClient_UploadToBlobAsync shall copy the souce, size, iotHubClientFileUploadCallback, context into a structure.]*/
         HTTPWORKER_THREAD_INFO *threadInfo = allocateUploadToBlob(destinationFileName, iotHubClientHandle, context);
         if (threadInfo == NULL)
@@ -2382,7 +3870,7 @@ IOTHUB_CLIENT_RESULT IoTHubClientCore_UploadToBlobAsync(IOTHUB_CLIENT_CORE_HANDL
             result = IOTHUB_CLIENT_ERROR;
         }
         /*Codes_SRS_IOTHUBCLIENT_02_052: [ IoTHubClient_UploadToBlobAsync shall spawn a thread passing the structure build in SRS IOTHUBCLIENT 02 051 as thread data.]*/
-        else if ((result = startHttpWorkerThread(iotHubClientHandle, threadInfo, uploadingThread)) != IOTHUB_CLIENT_OK)
+        else if ((result = startUploadJob(iotHubClientHandle, threadInfo, uploadingThread, &jobId)) != IOTHUB_CLIENT_OK)
         {
             /*Codes_SRS_IOTHUBCLIENT_02_053: [ If copying to the structure or spawning the thread fails, then IoTHubClient_UploadToBlobAsync shall fail and return IOTHUB_CLIENT_ERROR. ]*/
             LogError("unable to start upload thread");
@@ -2390,6 +3878,11 @@ IOTHUB_CLIENT_RESULT IoTHubClientCore_UploadToBlobAsync(IOTHUB_CLIENT_CORE_HANDL
         }
         else
         {
+            if (uploadJobId != NULL)
+            {
+                /*Codes_SRS_IOTHUBCLIENT_44_048: [ Otherwise they shall behave as `IoTHubClient_UploadToBlobAsync` and `IoTHubClient_UploadMultipleBlocksToBlobAsync(Ex)`, and on success write the upload job id of the upload to `uploadJobId`. ]*/
+                *uploadJobId = jobId;
+            }
             result = IOTHUB_CLIENT_OK;
         }
     }
@@ -2397,6 +3890,29 @@ IOTHUB_CLIENT_RESULT IoTHubClientCore_UploadToBlobAsync(IOTHUB_CLIENT_CORE_HANDL
     return result;
 }
 
+IOTHUB_CLIENT_RESULT IoTHubClientCore_UploadToBlobAsync(IOTHUB_CLIENT_CORE_HANDLE iotHubClientHandle, const char* destinationFileName, const unsigned char* source, size_t size, IOTHUB_CLIENT_FILE_UPLOAD_CALLBACK iotHubClientFileUploadCallback, void* context)
+{
+    return upload_to_blob_async(iotHubClientHandle, destinationFileName, source, size, iotHubClientFileUploadCallback, context, NULL);
+}
+
+IOTHUB_CLIENT_RESULT IoTHubClientCore_QueueUploadToBlobAsync(IOTHUB_CLIENT_CORE_HANDLE iotHubClientHandle, const char* destinationFileName, const unsigned char* source, size_t size, IOTHUB_CLIENT_FILE_UPLOAD_CALLBACK iotHubClientFileUploadCallback, void* context, IOTHUB_CLIENT_UPLOAD_JOB_ID* uploadJobId)
+{
+    IOTHUB_CLIENT_RESULT result;
+
+    /*Codes_SRS_IOTHUBCLIENT_44_047: [ If `uploadJobId` is `NULL`, `IoTHubClient_QueueUploadToBlobAsync` and `IoTHubClient_QueueUploadMultipleBlocksToBlobAsync` shall return `IOTHUB_CLIENT_INVALID_ARG`. ]*/
+    if (uploadJobId == NULL)
+    {
+        LogError("invalid parameter IOTHUB_CLIENT_UPLOAD_JOB_ID* uploadJobId = NULL");
+        result = IOTHUB_CLIENT_INVALID_ARG;
+    }
+    else
+    {
+        result = upload_to_blob_async(iotHubClientHandle, destinationFileName, source, size, iotHubClientFileUploadCallback, context, uploadJobId);
+    }
+
+    return result;
+}
+
 static int uploadMultipleBlock_thread(void* data)
 {
     HTTPWORKER_THREAD_INFO* threadInfo = (HTTPWORKER_THREAD_INFO*)data;
@@ -2420,7 +3936,7 @@ static int uploadMultipleBlock_thread(void* data)
     return result;
 }
 
-IOTHUB_CLIENT_RESULT IoTHubClientCore_UploadMultipleBlocksToBlobAsync(IOTHUB_CLIENT_CORE_HANDLE iotHubClientHandle, const char* destinationFileName, IOTHUB_CLIENT_FILE_UPLOAD_GET_DATA_CALLBACK getDataCallback, IOTHUB_CLIENT_FILE_UPLOAD_GET_DATA_CALLBACK_EX getDataCallbackEx, void* context)
+static IOTHUB_CLIENT_RESULT upload_multiple_blocks_to_blob_async(IOTHUB_CLIENT_CORE_HANDLE iotHubClientHandle, const char* destinationFileName, IOTHUB_CLIENT_FILE_UPLOAD_GET_DATA_CALLBACK getDataCallback, IOTHUB_CLIENT_FILE_UPLOAD_GET_DATA_CALLBACK_EX getDataCallbackEx, void* context, IOTHUB_CLIENT_UPLOAD_JOB_ID* uploadJobId)
 {
     IOTHUB_CLIENT_RESULT result;
 
@@ -2443,6 +3959,7 @@ IOTHUB_CLIENT_RESULT IoTHubClientCore_UploadMultipleBlocksToBlobAsync(IOTHUB_CLI
     }
     else
     {
+        IOTHUB_CLIENT_UPLOAD_JOB_ID jobId;
         /*Codes_SRS_IOTHUBCLIENT_99_075: [ `IoTHubClient_UploadMultipleBlocksToBlobAsync(Ex)` shall copy the `destinationFileName`, `getDataCallback`, `context`  and `iotHubClientHandle` into a structure. ]*/
         HTTPWORKER_THREAD_INFO *threadInfo = allocateUploadToBlob(destinationFileName, iotHubClientHandle, context);
         if (threadInfo == NULL)
@@ -2457,7 +3974,7 @@ IOTHUB_CLIENT_RESULT IoTHubClientCore_UploadMultipleBlocksToBlobAsync(IOTHUB_CLI
             threadInfo->uploadBlobMultiblockSavedData.getDataCallback = getDataCallback;
             threadInfo->uploadBlobMultiblockSavedData.getDataCallbackEx = getDataCallbackEx;
 
-            if ((result = startHttpWorkerThread(iotHubClientHandle, threadInfo, uploadMultipleBlock_thread)) != IOTHUB_CLIENT_OK)
+            if ((result = startUploadJob(iotHubClientHandle, threadInfo, uploadMultipleBlock_thread, &jobId)) != IOTHUB_CLIENT_OK)
             {
                 /*Codes_SRS_IOTHUBCLIENT_02_053: [ If copying to the structure or spawning the thread fails, then IoTHubClient_UploadToBlobAsync shall fail and return IOTHUB_CLIENT_ERROR. ]*/
                 LogError("unable to start upload thread");
@@ -2465,6 +3982,11 @@ IOTHUB_CLIENT_RESULT IoTHubClientCore_UploadMultipleBlocksToBlobAsync(IOTHUB_CLI
             }
             else
             {
+                if (uploadJobId != NULL)
+                {
+                    /*Codes_SRS_IOTHUBCLIENT_44_048: [ Otherwise they shall behave as `IoTHubClient_UploadToBlobAsync` and `IoTHubClient_UploadMultipleBlocksToBlobAsync(Ex)`, and on success write the upload job id of the upload to `uploadJobId`. ]*/
+                    *uploadJobId = jobId;
+                }
                 /*Codes_SRS_IOTHUBCLIENT_99_077: [ If copying to the structure and spawning the thread succeeds, then `IoTHubClient_UploadMultipleBlocksToBlobAsync(Ex)` shall return `IOTHUB_CLIENT_OK`. ]*/
                 result = IOTHUB_CLIENT_OK;
             }
@@ -2473,6 +3995,110 @@ IOTHUB_CLIENT_RESULT IoTHubClientCore_UploadMultipleBlocksToBlobAsync(IOTHUB_CLI
     return result;
 }
 
+IOTHUB_CLIENT_RESULT IoTHubClientCore_UploadMultipleBlocksToBlobAsync(IOTHUB_CLIENT_CORE_HANDLE iotHubClientHandle, const char* destinationFileName, IOTHUB_CLIENT_FILE_UPLOAD_GET_DATA_CALLBACK getDataCallback, IOTHUB_CLIENT_FILE_UPLOAD_GET_DATA_CALLBACK_EX getDataCallbackEx, void* context)
+{
+    return upload_multiple_blocks_to_blob_async(iotHubClientHandle, destinationFileName, getDataCallback, getDataCallbackEx, context, NULL);
+}
+
+IOTHUB_CLIENT_RESULT IoTHubClientCore_QueueUploadMultipleBlocksToBlobAsync(IOTHUB_CLIENT_CORE_HANDLE iotHubClientHandle, const char* destinationFileName, IOTHUB_CLIENT_FILE_UPLOAD_GET_DATA_CALLBACK getDataCallback, IOTHUB_CLIENT_FILE_UPLOAD_GET_DATA_CALLBACK_EX getDataCallbackEx, void* context, IOTHUB_CLIENT_UPLOAD_JOB_ID* uploadJobId)
+{
+    IOTHUB_CLIENT_RESULT result;
+
+    /*Codes_SRS_IOTHUBCLIENT_44_047: [ If `uploadJobId` is `NULL`, `IoTHubClient_QueueUploadToBlobAsync` and `IoTHubClient_QueueUploadMultipleBlocksToBlobAsync` shall return `IOTHUB_CLIENT_INVALID_ARG`. ]*/
+    if (uploadJobId == NULL)
+    {
+        LogError("invalid parameter IOTHUB_CLIENT_UPLOAD_JOB_ID* uploadJobId = NULL");
+        result = IOTHUB_CLIENT_INVALID_ARG;
+    }
+    else
+    {
+        result = upload_multiple_blocks_to_blob_async(iotHubClientHandle, destinationFileName, getDataCallback, getDataCallbackEx, context, uploadJobId);
+    }
+
+    return result;
+}
+
+static void reportCancelledUpload(HTTPWORKER_THREAD_INFO* threadInfo)
+{
+    if (threadInfo->uploadBlobMultiblockSavedData.getDataCallback != NULL)
+    {
+        threadInfo->uploadBlobMultiblockSavedData.getDataCallback(FILE_UPLOAD_ERROR, NULL, NULL, threadInfo->context);
+    }
+    else if (threadInfo->uploadBlobMultiblockSavedData.getDataCallbackEx != NULL)
+    {
+        (void)threadInfo->uploadBlobMultiblockSavedData.getDataCallbackEx(FILE_UPLOAD_ERROR, NULL, NULL, threadInfo->context);
+    }
+    else if (threadInfo->uploadBlobSavedData.iotHubClientFileUploadCallback != NULL)
+    {
+        threadInfo->uploadBlobSavedData.iotHubClientFileUploadCallback(FILE_UPLOAD_ERROR, threadInfo->context);
+    }
+}
+
+IOTHUB_CLIENT_RESULT IoTHubClientCore_CancelUploadToBlobAsync(IOTHUB_CLIENT_CORE_HANDLE iotHubClientHandle, IOTHUB_CLIENT_UPLOAD_JOB_ID uploadJobId)
+{
+    IOTHUB_CLIENT_RESULT result;
+
+    /*Codes_SRS_IOTHUBCLIENT_44_035: [ If `iotHubClientHandle` is `NULL` or `uploadJobId` is 0, `IoTHubClient_CancelUploadToBlobAsync` shall return `IOTHUB_CLIENT_INVALID_ARG`. ]*/
+    if ((iotHubClientHandle == NULL) || (uploadJobId == 0))
+    {
+        LogError("invalid parameters iotHubClientHandle = %p , uploadJobId = %lu", iotHubClientHandle, (unsigned long)uploadJobId);
+        result = IOTHUB_CLIENT_INVALID_ARG;
+    }
+    else if (Lock(iotHubClientHandle->LockHandle) != LOCK_OK)
+    {
+        LogError("Lock failed");
+        result = IOTHUB_CLIENT_ERROR;
+    }
+    else
+    {
+        HTTPWORKER_THREAD_INFO* cancelledUpload = NULL;
+
+        /*Codes_SRS_IOTHUBCLIENT_44_036: [ `IoTHubClient_CancelUploadToBlobAsync` shall remove the upload `uploadJobId` from the upload queue if no upload worker thread has started it, and return `IOTHUB_CLIENT_ERROR` otherwise. ]*/
+        if (iotHubClientHandle->uploadWorkers == NULL)
+        {
+            LogError("only uploads waiting for an upload worker can be cancelled, OPTION_BLOB_UPLOAD_WORKER_THREADS is not set");
+        }
+        else if (Lock(iotHubClientHandle->uploadWorkerLock) != LOCK_OK)
+        {
+            LogError("Lock failed");
+        }
+        else
+        {
+            LIST_ITEM_HANDLE item = singlylinkedlist_get_head_item(iotHubClientHandle->pendingUploads);
+            while (item != NULL)
+            {
+                HTTPWORKER_THREAD_INFO* threadInfo = (HTTPWORKER_THREAD_INFO*)singlylinkedlist_item_get_value(item);
+
+                if (threadInfo->uploadJobId == uploadJobId)
+                {
+                    (void)singlylinkedlist_remove(iotHubClientHandle->pendingUploads, item);
+                    iotHubClientHandle->pending_upload_count--;
+                    cancelledUpload = threadInfo;
+                    break;
+                }
+                item = singlylinkedlist_get_next_item(item);
+            }
+            (void)Unlock(iotHubClientHandle->uploadWorkerLock);
+        }
+        (void)Unlock(iotHubClientHandle->LockHandle);
+
+        if (cancelledUpload == NULL)
+        {
+            LogError("upload %lu is not waiting for an upload worker", (unsigned long)uploadJobId);
+            result = IOTHUB_CLIENT_ERROR;
+        }
+        else
+        {
+            /*Codes_SRS_IOTHUBCLIENT_44_037: [ `IoTHubClient_CancelUploadToBlobAsync` shall report the removed upload as failed, calling `iotHubClientFileUploadCallback` or `getDataCallback(Ex)` with `FILE_UPLOAD_ERROR` after releasing the locks. ]*/
+            reportCancelledUpload(cancelledUpload);
+            freeHttpWorkerThreadInfo(cancelledUpload);
+            result = IOTHUB_CLIENT_OK;
+        }
+    }
+
+    return result;
+}
+
 #endif /*DONT_USE_UPLOADTOBLOB*/
 
 IOTHUB_CLIENT_RESULT IoTHubClientCore_SendEventToOutputAsync(IOTHUB_CLIENT_CORE_HANDLE iotHubClientHandle, IOTHUB_MESSAGE_HANDLE eventMessageHandle, const char* outputName, IOTHUB_CLIENT_EVENT_CONFIRMATION_CALLBACK eventConfirmationCallback, void* userContextCallback)
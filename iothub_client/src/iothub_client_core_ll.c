@@ -3,6 +3,7 @@
 
 #include <stdlib.h>
 #include <stdint.h>
+#include <limits.h>
 #include <string.h>
 #include <errno.h>
 
@@ -26,6 +27,7 @@
 #include "internal/iothub_client_private.h"
 #include "internal/iothub_client_diagnostic.h"
 #include "internal/iothubtransport.h"
+#include "internal/timeout_heap.h"
 
 #ifndef DONT_USE_UPLOADTOBLOB
 #include "internal/iothub_client_ll_uploadtoblob.h"
@@ -37,6 +39,10 @@
 #include "internal/iothub_client_edge.h"
 #endif
 
+#ifdef USE_MESSAGE_STORE
+#include "internal/message_store.h"
+#endif
+
 #define LOG_ERROR_RESULT LogError("result = %s", MU_ENUM_TO_STRING(IOTHUB_CLIENT_RESULT, result));
 #define INDEFINITE_TIME ((time_t)(-1))
 #define ERROR_CODE_BECAUSE_DESTROY 0
@@ -97,6 +103,29 @@ typedef struct GET_TWIN_CONTEXT_TAG
     void* context;
 } GET_TWIN_CONTEXT;
 
+typedef struct OUTGOING_QUEUE_DATA_TAG
+{
+    size_t max_messages; /*0 means no limit*/
+    size_t max_bytes; /*0 means no limit*/
+    IOTHUB_CLIENT_QUEUE_FULL_POLICY full_policy;
+    unsigned int high_watermark_percent;
+    unsigned int low_watermark_percent;
+    size_t message_count; /*messages accepted by SendEventAsync and not completed yet, either in waitingToSend or owned by the transport*/
+    size_t byte_count;
+    bool is_above_high_watermark;
+    IOTHUB_CLIENT_QUEUE_STATE_CALLBACK state_callback;
+    void* state_callback_context;
+} OUTGOING_QUEUE_DATA;
+
+#define PRIORITY_LANE_COUNT (IOTHUB_MESSAGE_PRIORITY_HIGH + 1)
+
+/*waitingToSend holds one run of messages per priority, highest priority first*/
+typedef struct PRIORITY_LANE_TAG
+{
+    IOTHUB_MESSAGE_LIST* first; /*NULL when waitingToSend has no message of this priority*/
+    IOTHUB_MESSAGE_LIST* last;
+} PRIORITY_LANE;
+
 typedef struct IOTHUB_CLIENT_CORE_LL_HANDLE_DATA_TAG
 {
     DLIST_ENTRY waitingToSend;
@@ -113,6 +142,10 @@ typedef struct IOTHUB_CLIENT_CORE_LL_HANDLE_DATA_TAG
     time_t lastMessageReceiveTime;
     TICK_COUNTER_HANDLE tickCounter; /*shared tickcounter used to track message timeouts in waitingToSend list*/
     tickcounter_ms_t currentMessageTimeout;
+    PRIORITY_LANE priorityLanes[PRIORITY_LANE_COUNT]; /*the run of messages of each priority in waitingToSend*/
+    uint64_t nextQueueSequence;
+    TIMEOUT_HEAP messageTimeouts; /*deadlines of the messages queued with a timeout that have not been completed yet*/
+    OUTGOING_QUEUE_DATA outgoing_queue;
     uint64_t current_device_twin_timeout;
     IOTHUB_CLIENT_DEVICE_TWIN_CALLBACK deviceTwinCallback;
     void* deviceTwinContextCallback;
@@ -123,6 +156,9 @@ typedef struct IOTHUB_CLIENT_CORE_LL_HANDLE_DATA_TAG
 #endif
 #ifdef USE_EDGE_MODULES
     IOTHUB_CLIENT_EDGE_HANDLE methodHandle;
+#endif
+#ifdef USE_MESSAGE_STORE
+    MESSAGE_STORE_HANDLE messageStore; /*NULL until OPTION_MESSAGE_STORE_DIRECTORY is set*/
 #endif
     uint32_t data_msg_id;
     bool complete_twin_update_encountered;
@@ -133,6 +169,10 @@ typedef struct IOTHUB_CLIENT_CORE_LL_HANDLE_DATA_TAG
     STRING_HANDLE model_id;
 }IOTHUB_CLIENT_CORE_LL_HANDLE_DATA;
 
+#define DEFAULT_QUEUE_HIGH_WATERMARK_PERCENT 80
+#define DEFAULT_QUEUE_LOW_WATERMARK_PERCENT 50
+#define MAX_TIMES_OVERTAKEN 16
+
 static const char HOSTNAME_TOKEN[] = "HostName";
 static const char DEVICEID_TOKEN[] = "DeviceId";
 static const char X509_TOKEN[] = "x509";
@@ -294,6 +334,7 @@ static void setTransportProtocol(IOTHUB_CLIENT_CORE_LL_HANDLE_DATA* handleData,
     handleData->IoTHubTransport_Unsubscribe_InputQueue = protocol->IoTHubTransport_Unsubscribe_InputQueue;
     handleData->IoTHubTransport_SetCallbackContext = protocol->IoTHubTransport_SetCallbackContext;
     handleData->IoTHubTransport_GetSupportedPlatformInfo = protocol->IoTHubTransport_GetSupportedPlatformInfo;
+    handleData->IoTHubTransport_GetRttStatistics = protocol->IoTHubTransport_GetRttStatistics;
 }
 
 static bool is_event_equal(IOTHUB_EVENT_CALLBACK *event_callback, const char *input_name)
@@ -489,6 +530,482 @@ static STRING_HANDLE make_product_info(const char* product, PLATFORM_INFO_OPTION
     return result;
 }
 
+static size_t get_message_payload_size(IOTHUB_MESSAGE_HANDLE messageHandle)
+{
+    size_t result = 0;
+    IOTHUBMESSAGE_CONTENT_TYPE contentType = IoTHubMessage_GetContentType(messageHandle);
+
+    if (contentType == IOTHUBMESSAGE_BYTEARRAY)
+    {
+        const unsigned char* buffer;
+        if (IoTHubMessage_GetByteArray(messageHandle, &buffer, &result) != IOTHUB_MESSAGE_OK)
+        {
+            LogError("unable to get the message payload size");
+            result = 0;
+        }
+    }
+    else if (contentType == IOTHUBMESSAGE_STRING)
+    {
+        const char* text = IoTHubMessage_GetString(messageHandle);
+        result = (text == NULL) ? 0 : strlen(text);
+    }
+
+    return result;
+}
+
+/*limit * percent / 100, without overflowing size_t*/
+static size_t get_queue_watermark(size_t limit, unsigned int percent)
+{
+    return ((limit / 100) * percent) + (((limit % 100) * percent) / 100);
+}
+
+static bool is_queue_at_high_watermark(const OUTGOING_QUEUE_DATA* queue)
+{
+    size_t watermark;
+    bool result = false;
+
+    if (queue->max_messages != 0)
+    {
+        watermark = get_queue_watermark(queue->max_messages, queue->high_watermark_percent);
+        result = (queue->message_count >= ((watermark == 0) ? 1 : watermark));
+    }
+
+    if (!result && queue->max_bytes != 0)
+    {
+        watermark = get_queue_watermark(queue->max_bytes, queue->high_watermark_percent);
+        result = (queue->byte_count >= ((watermark == 0) ? 1 : watermark));
+    }
+
+    return result;
+}
+
+static bool is_queue_at_low_watermark(const OUTGOING_QUEUE_DATA* queue)
+{
+    /*with small limits both watermarks can round to the same value, the queue has to drop below the high one*/
+    return
+        !is_queue_at_high_watermark(queue) &&
+        ((queue->max_messages == 0) || (queue->message_count <= get_queue_watermark(queue->max_messages, queue->low_watermark_percent))) &&
+        ((queue->max_bytes == 0) || (queue->byte_count <= get_queue_watermark(queue->max_bytes, queue->low_watermark_percent)));
+}
+
+static void update_queue_state(IOTHUB_CLIENT_CORE_LL_HANDLE_DATA* handleData)
+{
+    OUTGOING_QUEUE_DATA* queue = &handleData->outgoing_queue;
+
+    if (!queue->is_above_high_watermark)
+    {
+        /*Codes_SRS_IOTHUBCLIENT_LL_44_018: [ When the number of queued messages or bytes reaches the high watermark of its limit, the queue state callback shall be invoked once with IOTHUB_CLIENT_QUEUE_STATE_HIGH_WATERMARK. ]*/
+        if (is_queue_at_high_watermark(queue))
+        {
+            queue->is_above_high_watermark = true;
+            if (queue->state_callback != NULL)
+            {
+                queue->state_callback(IOTHUB_CLIENT_QUEUE_STATE_HIGH_WATERMARK, queue->message_count, queue->byte_count, queue->state_callback_context);
+            }
+        }
+    }
+    /*Codes_SRS_IOTHUBCLIENT_LL_44_019: [ After that, when both the number of queued messages and bytes drain to the low watermark of their limits, the queue state callback shall be invoked once with IOTHUB_CLIENT_QUEUE_STATE_LOW_WATERMARK. ]*/
+    else if (is_queue_at_low_watermark(queue))
+    {
+        queue->is_above_high_watermark = false;
+        if (queue->state_callback != NULL)
+        {
+            queue->state_callback(IOTHUB_CLIENT_QUEUE_STATE_LOW_WATERMARK, queue->message_count, queue->byte_count, queue->state_callback_context);
+        }
+    }
+}
+
+static void track_queued_message(IOTHUB_CLIENT_CORE_LL_HANDLE_DATA* handleData, const IOTHUB_MESSAGE_LIST* message)
+{
+    handleData->outgoing_queue.message_count++;
+    handleData->outgoing_queue.byte_count += message->message_size;
+}
+
+static void untrack_queued_message(IOTHUB_CLIENT_CORE_LL_HANDLE_DATA* handleData, const IOTHUB_MESSAGE_LIST* message)
+{
+    /*Codes_SRS_IOTHUBCLIENT_LL_44_017: [ Once a message is completed, for any reason, it shall no longer count against OPTION_MAX_QUEUED_MESSAGES and OPTION_MAX_QUEUED_BYTES. ]*/
+    if (handleData->outgoing_queue.message_count > 0)
+    {
+        handleData->outgoing_queue.message_count--;
+    }
+
+    if (handleData->outgoing_queue.byte_count != 0)
+    {
+        handleData->outgoing_queue.byte_count -= (message->message_size < handleData->outgoing_queue.byte_count) ? message->message_size : handleData->outgoing_queue.byte_count;
+    }
+}
+
+/*keeps a copy of the message in the message store, if there is one, until the message is completed*/
+static int store_message(IOTHUB_CLIENT_CORE_LL_HANDLE_DATA* handleData, IOTHUB_MESSAGE_LIST* message)
+{
+    int result = 0;
+
+    message->store_position = 0;
+#ifdef USE_MESSAGE_STORE
+    /*Codes_SRS_IOTHUBCLIENT_LL_44_036: [ Once OPTION_MESSAGE_STORE_DIRECTORY is set, every message shall be appended to the message store before it is queued in waitingToSend. ]*/
+    if ((handleData->messageStore != NULL) && (message_store_append(handleData->messageStore, message->messageHandle, &message->store_position) != 0))
+    {
+        LogError("unable to store the message");
+        result = MU_FAILURE;
+    }
+#else
+    (void)handleData;
+#endif
+
+    return result;
+}
+
+static void release_stored_message(IOTHUB_CLIENT_CORE_LL_HANDLE_DATA* handleData, const IOTHUB_MESSAGE_LIST* message)
+{
+#ifdef USE_MESSAGE_STORE
+    if ((handleData->messageStore != NULL) && (message->store_position != 0))
+    {
+        message_store_release(handleData->messageStore, message->store_position);
+    }
+#else
+    (void)handleData;
+    (void)message;
+#endif
+}
+
+static bool outgoing_queue_has_room(const OUTGOING_QUEUE_DATA* queue, size_t message_count, size_t byte_count)
+{
+    return
+        ((queue->max_messages == 0) || (queue->message_count + message_count <= queue->max_messages)) &&
+        ((queue->max_bytes == 0) || (queue->byte_count + byte_count <= queue->max_bytes));
+}
+
+/*the transports take messages from the head of waitingToSend without telling the client, so the lanes they emptied are trimmed here*/
+static void sync_priority_lanes(IOTHUB_CLIENT_CORE_LL_HANDLE_DATA* handleData)
+{
+    int priority;
+
+    if (handleData->waitingToSend.Flink == &(handleData->waitingToSend))
+    {
+        for (priority = 0; priority < PRIORITY_LANE_COUNT; priority++)
+        {
+            handleData->priorityLanes[priority].first = NULL;
+            handleData->priorityLanes[priority].last = NULL;
+        }
+    }
+    else
+    {
+        IOTHUB_MESSAGE_LIST* head = containingRecord(handleData->waitingToSend.Flink, IOTHUB_MESSAGE_LIST, entry);
+
+        for (priority = PRIORITY_LANE_COUNT - 1; priority > (int)head->priority; priority--)
+        {
+            handleData->priorityLanes[priority].first = NULL;
+            handleData->priorityLanes[priority].last = NULL;
+        }
+        handleData->priorityLanes[head->priority].first = head;
+    }
+}
+
+/*returns the first message of the highest priority lane below priority, that is the message a message of that priority is queued in front of*/
+static IOTHUB_MESSAGE_LIST* get_first_message_below(IOTHUB_CLIENT_CORE_LL_HANDLE_DATA* handleData, IOTHUB_MESSAGE_PRIORITY priority)
+{
+    IOTHUB_MESSAGE_LIST* result = NULL;
+    int lower;
+
+    for (lower = (int)priority - 1; (lower >= 0) && (result == NULL); lower--)
+    {
+        result = handleData->priorityLanes[lower].first;
+    }
+
+    return result;
+}
+
+/*Codes_SRS_IOTHUBCLIENT_LL_44_044: [ The messages of each priority shall be tracked as a lane of waitingToSend, so that queuing or dropping a message does not walk waitingToSend. ]*/
+/*links the message at the tail (or at the head) of the lane of its priority*/
+static void link_message_in_lane(IOTHUB_CLIENT_CORE_LL_HANDLE_DATA* handleData, IOTHUB_MESSAGE_LIST* message, bool at_lane_head)
+{
+    PRIORITY_LANE* lane = &handleData->priorityLanes[message->priority];
+    PDLIST_ENTRY insertBefore;
+
+    if (lane->first == NULL)
+    {
+        IOTHUB_MESSAGE_LIST* next = get_first_message_below(handleData, message->priority);
+        insertBefore = (next == NULL) ? &(handleData->waitingToSend) : &(next->entry);
+        lane->first = message;
+        lane->last = message;
+    }
+    else if (at_lane_head)
+    {
+        insertBefore = &(lane->first->entry);
+        lane->first = message;
+    }
+    else
+    {
+        insertBefore = lane->last->entry.Flink;
+        lane->last = message;
+    }
+
+    /*inserting at the tail of the list headed by insertBefore puts the message right before it*/
+    DList_InsertTailList(insertBefore, &(message->entry));
+}
+
+static void unlink_message_from_lane(IOTHUB_CLIENT_CORE_LL_HANDLE_DATA* handleData, IOTHUB_MESSAGE_LIST* message)
+{
+    PRIORITY_LANE* lane = &handleData->priorityLanes[message->priority];
+
+    if (lane->first == lane->last)
+    {
+        lane->first = NULL;
+        lane->last = NULL;
+    }
+    else if (lane->first == message)
+    {
+        lane->first = containingRecord(message->entry.Flink, IOTHUB_MESSAGE_LIST, entry);
+    }
+    else if (lane->last == message)
+    {
+        lane->last = containingRecord(message->entry.Blink, IOTHUB_MESSAGE_LIST, entry);
+    }
+
+    (void)DList_RemoveEntryList(&(message->entry));
+}
+
+/*the transports only take messages from the head of waitingToSend, so a message is still in it if it is not older than the first message left in its lane*/
+static bool is_message_waiting_to_send(IOTHUB_CLIENT_CORE_LL_HANDLE_DATA* handleData, const IOTHUB_MESSAGE_LIST* message)
+{
+    const PRIORITY_LANE* lane = &handleData->priorityLanes[message->priority];
+    return (lane->first != NULL) && (lane->first->queue_sequence <= message->queue_sequence);
+}
+
+static IOTHUB_MESSAGE_LIST* get_message_to_drop(IOTHUB_CLIENT_CORE_LL_HANDLE_DATA* handleData, IOTHUB_MESSAGE_PRIORITY priority)
+{
+    IOTHUB_MESSAGE_LIST* result;
+
+    sync_priority_lanes(handleData);
+
+    /*only the messages still in waitingToSend can be dropped, the transport owns the ones it took out of it*/
+    if (handleData->waitingToSend.Flink == &(handleData->waitingToSend))
+    {
+        result = NULL;
+    }
+    else
+    {
+        /*waitingToSend is ordered by priority, so its tail is the newest message of the lowest priority*/
+        IOTHUB_MESSAGE_LIST* lowest = containingRecord(handleData->waitingToSend.Blink, IOTHUB_MESSAGE_LIST, entry);
+
+        if (lowest->priority > priority)
+        {
+            /*Codes_SRS_IOTHUBCLIENT_LL_44_029: [ A message shall never be dropped to make room for a message of lower priority. ]*/
+            result = NULL;
+        }
+        else if (handleData->outgoing_queue.full_policy == IOTHUB_CLIENT_QUEUE_FULL_DROP_LOWEST_PRIORITY)
+        {
+            /*Codes_SRS_IOTHUBCLIENT_LL_44_030: [ If the queue full policy is IOTHUB_CLIENT_QUEUE_FULL_DROP_LOWEST_PRIORITY, the newest message of the lowest priority shall be dropped first. ]*/
+            result = lowest;
+        }
+        else
+        {
+            /*Codes_SRS_IOTHUBCLIENT_LL_44_031: [ If the queue full policy is IOTHUB_CLIENT_QUEUE_FULL_DROP_OLDEST, the oldest message of the lowest priority shall be dropped first. ]*/
+            result = handleData->priorityLanes[lowest->priority].first;
+        }
+    }
+
+    return result;
+}
+
+/*puts back a message removed by get_message_to_drop, messages have to be restored in the reverse order they were dropped*/
+static void restore_dropped_message(IOTHUB_CLIENT_CORE_LL_HANDLE_DATA* handleData, IOTHUB_MESSAGE_LIST* message)
+{
+    /*it was either the newest or the oldest message of its priority*/
+    link_message_in_lane(handleData, message, handleData->outgoing_queue.full_policy != IOTHUB_CLIENT_QUEUE_FULL_DROP_LOWEST_PRIORITY);
+    track_queued_message(handleData, message);
+}
+
+/*makes room for message_count messages of byte_count bytes and at most the given priority, moving the messages it drops into dropped (initialized only when something is dropped)*/
+static IOTHUB_CLIENT_RESULT make_room_in_outgoing_queue(IOTHUB_CLIENT_CORE_LL_HANDLE_DATA* handleData, size_t message_count, size_t byte_count, IOTHUB_MESSAGE_PRIORITY priority, PDLIST_ENTRY dropped, size_t* dropped_count)
+{
+    IOTHUB_CLIENT_RESULT result;
+    OUTGOING_QUEUE_DATA* queue = &handleData->outgoing_queue;
+
+    *dropped_count = 0;
+
+    if (outgoing_queue_has_room(queue, message_count, byte_count))
+    {
+        result = IOTHUB_CLIENT_OK;
+    }
+    /*Codes_SRS_IOTHUBCLIENT_LL_44_014: [ If queuing the message would exceed OPTION_MAX_QUEUED_MESSAGES or OPTION_MAX_QUEUED_BYTES and the queue full policy is IOTHUB_CLIENT_QUEUE_FULL_REJECT, the message shall not be queued and IOTHUB_CLIENT_QUEUE_FULL shall be returned. ]*/
+    else if (queue->full_policy == IOTHUB_CLIENT_QUEUE_FULL_REJECT)
+    {
+        result = IOTHUB_CLIENT_QUEUE_FULL;
+        LogError("outgoing queue is full (%lu messages, %lu bytes)", (unsigned long)queue->message_count, (unsigned long)queue->byte_count);
+    }
+    else
+    {
+        IOTHUB_MESSAGE_LIST* message_to_drop;
+
+        DList_InitializeListHead(dropped);
+
+        /*Codes_SRS_IOTHUBCLIENT_LL_44_015: [ If the queue full policy is IOTHUB_CLIENT_QUEUE_FULL_DROP_OLDEST or IOTHUB_CLIENT_QUEUE_FULL_DROP_LOWEST_PRIORITY, messages shall be removed from waitingToSend until the new message fits, and completed with IOTHUB_CLIENT_CONFIRMATION_MESSAGE_DROPPED once the new message is queued. ]*/
+        while (!outgoing_queue_has_room(queue, message_count, byte_count) && ((message_to_drop = get_message_to_drop(handleData, priority)) != NULL))
+        {
+            unlink_message_from_lane(handleData, message_to_drop);
+            untrack_queued_message(handleData, message_to_drop);
+            DList_InsertTailList(dropped, &(message_to_drop->entry));
+            (*dropped_count)++;
+        }
+
+        if (outgoing_queue_has_room(queue, message_count, byte_count))
+        {
+            result = IOTHUB_CLIENT_OK;
+        }
+        else
+        {
+            /*Codes_SRS_IOTHUBCLIENT_LL_44_016: [ If dropping every message in waitingToSend is not enough, the dropped messages shall be put back in waitingToSend, in their original order, and IOTHUB_CLIENT_QUEUE_FULL shall be returned. ]*/
+            while (dropped->Blink != dropped)
+            {
+                IOTHUB_MESSAGE_LIST* message_to_restore = containingRecord(dropped->Blink, IOTHUB_MESSAGE_LIST, entry);
+                (void)DList_RemoveEntryList(&(message_to_restore->entry));
+                restore_dropped_message(handleData, message_to_restore);
+            }
+            *dropped_count = 0;
+
+            result = IOTHUB_CLIENT_QUEUE_FULL;
+            LogError("outgoing queue is full and the messages waiting to be sent cannot make room (%lu messages, %lu bytes)", (unsigned long)queue->message_count, (unsigned long)queue->byte_count);
+        }
+    }
+
+    return result;
+}
+
+/*the message at the head of the next lower lane is now sent after the messages of the given priority*/
+static void promote_message(IOTHUB_CLIENT_CORE_LL_HANDLE_DATA* handleData, IOTHUB_MESSAGE_LIST* message, IOTHUB_MESSAGE_PRIORITY priority)
+{
+    PRIORITY_LANE* lane = &handleData->priorityLanes[message->priority];
+
+    if (lane->first == lane->last)
+    {
+        lane->first = NULL;
+        lane->last = NULL;
+    }
+    else
+    {
+        lane->first = containingRecord(message->entry.Flink, IOTHUB_MESSAGE_LIST, entry);
+    }
+
+    message->priority = priority;
+    message->queue_sequence = handleData->nextQueueSequence++;
+
+    lane = &handleData->priorityLanes[priority];
+    if (lane->first == NULL)
+    {
+        lane->first = message;
+    }
+    lane->last = message;
+}
+
+static void track_message_timeout(IOTHUB_CLIENT_CORE_LL_HANDLE_DATA* handleData, IOTHUB_MESSAGE_LIST* message)
+{
+    if (message->message_timeout_value != 0)
+    {
+        /*the message times out once more than message_timeout_value ms have passed*/
+        timeout_heap_insert(&handleData->messageTimeouts, &message->timeout_entry, message->ms_timesOutAfter + message->message_timeout_value + 1);
+    }
+}
+
+static void untrack_message_timeout(IOTHUB_CLIENT_CORE_LL_HANDLE_DATA* handleData, IOTHUB_MESSAGE_LIST* message)
+{
+    /*messages that already timed out while owned by the transport are no longer in the heap, removing them has no effect*/
+    if (message->message_timeout_value != 0)
+    {
+        timeout_heap_remove(&handleData->messageTimeouts, &message->timeout_entry);
+    }
+}
+
+static void insert_message_by_priority(IOTHUB_CLIENT_CORE_LL_HANDLE_DATA* handleData, IOTHUB_MESSAGE_LIST* message)
+{
+    IOTHUB_MESSAGE_LIST* overtaken;
+
+    sync_priority_lanes(handleData);
+
+    /*Codes_SRS_IOTHUBCLIENT_LL_44_026: [ A message shall be queued in waitingToSend ahead of all the messages of lower priority, so that the transports send the highest priority messages first. ]*/
+    /*Codes_SRS_IOTHUBCLIENT_LL_44_028: [ A message that has already been overtaken by MAX_TIMES_OVERTAKEN higher priority messages shall not be overtaken again, and shall be sent as if it had the priority of the message that tried to overtake it. ]*/
+    while (((overtaken = get_first_message_below(handleData, message->priority)) != NULL) && (overtaken->times_overtaken >= MAX_TIMES_OVERTAKEN))
+    {
+        promote_message(handleData, overtaken, message->priority);
+    }
+
+    if (overtaken != NULL)
+    {
+        overtaken->times_overtaken++;
+    }
+
+    /*Codes_SRS_IOTHUBCLIENT_LL_44_027: [ Messages of the same priority shall be sent in the order they were queued. ]*/
+    message->queue_sequence = handleData->nextQueueSequence++;
+    link_message_in_lane(handleData, message, false);
+    track_message_timeout(handleData, message);
+}
+
+/*accounts for the messages appended to the tail of waitingToSend, starting at first*/
+static void append_messages_to_lanes(IOTHUB_CLIENT_CORE_LL_HANDLE_DATA* handleData, PDLIST_ENTRY first)
+{
+    PDLIST_ENTRY entry;
+
+    for (entry = first; entry != &(handleData->waitingToSend); entry = entry->Flink)
+    {
+        IOTHUB_MESSAGE_LIST* message = containingRecord(entry, IOTHUB_MESSAGE_LIST, entry);
+        PRIORITY_LANE* lane = &handleData->priorityLanes[message->priority];
+
+        message->queue_sequence = handleData->nextQueueSequence++;
+        if (lane->first == NULL)
+        {
+            lane->first = message;
+        }
+        lane->last = message;
+        track_message_timeout(handleData, message);
+    }
+}
+
+static void complete_dropped_messages(IOTHUB_CLIENT_CORE_LL_HANDLE_DATA* handleData, PDLIST_ENTRY dropped)
+{
+    PDLIST_ENTRY entry;
+    while ((entry = DList_RemoveHeadList(dropped)) != dropped)
+    {
+        IOTHUB_MESSAGE_LIST* message = containingRecord(entry, IOTHUB_MESSAGE_LIST, entry);
+        untrack_message_timeout(handleData, message);
+        release_stored_message(handleData, message);
+        if (message->callback != NULL)
+        {
+            message->callback(IOTHUB_CLIENT_CONFIRMATION_MESSAGE_DROPPED, message->context);
+        }
+        IoTHubMessage_Destroy(message->messageHandle);
+        free(message);
+    }
+}
+
+#ifdef USE_MESSAGE_STORE
+static void on_stored_message(IOTHUB_MESSAGE_HANDLE message, size_t position, void* context)
+{
+    IOTHUB_CLIENT_CORE_LL_HANDLE_DATA* handleData = (IOTHUB_CLIENT_CORE_LL_HANDLE_DATA*)context;
+    IOTHUB_MESSAGE_LIST* newEntry;
+
+    if ((newEntry = (IOTHUB_MESSAGE_LIST*)malloc(sizeof(IOTHUB_MESSAGE_LIST))) == NULL)
+    {
+        LogError("unable to queue a stored message, it will be sent the next time the message store is opened");
+        IoTHubMessage_Destroy(message);
+    }
+    else
+    {
+        /*Codes_SRS_IOTHUBCLIENT_LL_44_035: [ The messages left in the message store by a previous run shall be queued in waitingToSend by priority, without confirmation callback and without timeout, even if that exceeds OPTION_MAX_QUEUED_MESSAGES or OPTION_MAX_QUEUED_BYTES. ]*/
+        newEntry->messageHandle = message;
+        newEntry->callback = NULL;
+        newEntry->context = NULL;
+        newEntry->ms_timesOutAfter = 0;
+        newEntry->message_timeout_value = 0;
+        newEntry->priority = IoTHubMessage_GetPriority(message);
+        newEntry->times_overtaken = 0;
+        newEntry->message_size = (handleData->outgoing_queue.max_bytes == 0) ? 0 : get_message_payload_size(message);
+        newEntry->store_position = position;
+        insert_message_by_priority(handleData, newEntry);
+        track_queued_message(handleData, newEntry);
+    }
+}
+#endif
+
 static void IoTHubClientCore_LL_SendComplete(PDLIST_ENTRY completed, IOTHUB_CLIENT_CONFIRMATION_RESULT result, void* ctx)
 {
     /*Codes_SRS_IOTHUBCLIENT_LL_02_022: [If parameter completed is NULL, or parameter handle is NULL then IoTHubClientCore_LL_SendBatch shall return.]*/
@@ -504,10 +1021,18 @@ static void IoTHubClientCore_LL_SendComplete(PDLIST_ENTRY completed, IOTHUB_CLIE
     {
         /*Codes_SRS_IOTHUBCLIENT_LL_02_027: [If parameter result is IOTHUB_CLIENT_CONFIRMATION_ERROR then IoTHubClientCore_LL_SendComplete shall call all the non-NULL callbacks with the result parameter set to IOTHUB_CLIENT_CONFIRMATION_ERROR and the context set to the context passed originally in the SendEventAsync call.] */
         /*Codes_SRS_IOTHUBCLIENT_LL_02_025: [If parameter result is IOTHUB_CLIENT_CONFIRMATION_OK then IoTHubClientCore_LL_SendComplete shall call all the non-NULL callbacks with the result parameter set to IOTHUB_CLIENT_CONFIRMATION_OK and the context set to the context passed originally in the SendEventAsync call.]*/
+        IOTHUB_CLIENT_CORE_LL_HANDLE_DATA* handleData = (IOTHUB_CLIENT_CORE_LL_HANDLE_DATA*)ctx;
         PDLIST_ENTRY oldest;
         while ((oldest = DList_RemoveHeadList(completed)) != completed)
         {
             IOTHUB_MESSAGE_LIST* messageList = (IOTHUB_MESSAGE_LIST*)containingRecord(oldest, IOTHUB_MESSAGE_LIST, entry);
+            untrack_message_timeout(handleData, messageList);
+            untrack_queued_message(handleData, messageList);
+            /*Codes_SRS_IOTHUBCLIENT_LL_44_037: [ A stored message shall be released from the message store once it is completed, unless it is completed with IOTHUB_CLIENT_CONFIRMATION_BECAUSE_DESTROY, so that it is sent again the next time the message store is opened. ]*/
+            if (result != IOTHUB_CLIENT_CONFIRMATION_BECAUSE_DESTROY)
+            {
+                release_stored_message(handleData, messageList);
+            }
             /*Codes_SRS_IOTHUBCLIENT_LL_02_026: [If any callback is NULL then there shall not be a callback call.]*/
             if (messageList->callback != NULL)
             {
@@ -516,6 +1041,7 @@ static void IoTHubClientCore_LL_SendComplete(PDLIST_ENTRY completed, IOTHUB_CLIE
             IoTHubMessage_Destroy(messageList->messageHandle);
             free(messageList);
         }
+        update_queue_state(handleData);
     }
 }
 
@@ -1072,6 +1598,13 @@ static IOTHUB_CLIENT_CORE_LL_HANDLE_DATA* initialize_iothub_client(const IOTHUB_
                     {
                         /*Codes_SRS_IOTHUBCLIENT_LL_02_042: [ By default, messages shall not timeout. ]*/
                         result->currentMessageTimeout = 0;
+                        timeout_heap_initialize(&result->messageTimeouts);
+                        /*Codes_SRS_IOTHUBCLIENT_LL_44_012: [ By default the outgoing queue shall not be bounded, and its high and low watermarks shall be 80% and 50% of the limits. ]*/
+                        result->outgoing_queue.max_messages = 0;
+                        result->outgoing_queue.max_bytes = 0;
+                        result->outgoing_queue.full_policy = IOTHUB_CLIENT_QUEUE_FULL_REJECT;
+                        result->outgoing_queue.high_watermark_percent = DEFAULT_QUEUE_HIGH_WATERMARK_PERCENT;
+                        result->outgoing_queue.low_watermark_percent = DEFAULT_QUEUE_LOW_WATERMARK_PERCENT;
                         result->current_device_twin_timeout = 0;
 
                         result->diagnostic_setting.currentMessageNumber = 0;
@@ -1782,6 +2315,13 @@ void IoTHubClientCore_LL_Destroy(IOTHUB_CLIENT_CORE_LL_HANDLE iotHubClientHandle
 #endif
 #ifdef USE_EDGE_MODULES
         IoTHubClient_EdgeHandle_Destroy(handleData->methodHandle);
+#endif
+#ifdef USE_MESSAGE_STORE
+        /*Codes_SRS_IOTHUBCLIENT_LL_44_040: [ IoTHubClientCore_LL_Destroy shall close the message store without releasing the messages that were not completed, so they are sent again the next time it is opened. ]*/
+        if (handleData->messageStore != NULL)
+        {
+            message_store_close(handleData->messageStore);
+        }
 #endif
         STRING_delete(handleData->product_info);
         STRING_delete(handleData->model_id);
@@ -1789,7 +2329,15 @@ void IoTHubClientCore_LL_Destroy(IOTHUB_CLIENT_CORE_LL_HANDLE iotHubClientHandle
     }
 }
 
-/*Codes_SRS_IOTHUBCLIENT_LL_02_044: [ Messages already delivered to IoTHubClientCore_LL shall not have their timeouts modified by a new call to IoTHubClientCore_LL_SetOption. ]*/
+typedef struct EVENT_BATCH_CONFIRMATION_CONTEXT_TAG
+{
+    IOTHUB_CLIENT_EVENT_CONFIRMATION_CALLBACK eventConfirmationCallback;
+    void* userContextCallback;
+    size_t pendingCount;
+    IOTHUB_CLIENT_CONFIRMATION_RESULT batchResult;
+} EVENT_BATCH_CONFIRMATION_CONTEXT;
+
+/*Codes_SRS_IOTHUBCLIENT_LL_02_044: [ Messages already delivered to IoTHubClientCore_LL shall not have their timeouts modified by a new call to IoTHubClientCore_LL_SetOption. ]*/
 /*returns 0 on success, any other value is error*/
 static int attach_ms_timesOutAfter(IOTHUB_CLIENT_CORE_LL_HANDLE_DATA* handleData, IOTHUB_MESSAGE_LIST *newEntry)
 {
@@ -1818,6 +2366,105 @@ static int attach_ms_timesOutAfter(IOTHUB_CLIENT_CORE_LL_HANDLE_DATA* handleData
     return result;
 }
 
+static IOTHUB_CLIENT_RESULT queue_event_message(IOTHUB_CLIENT_CORE_LL_HANDLE_DATA* handleData, IOTHUB_MESSAGE_HANDLE eventMessageHandle, bool take_ownership, IOTHUB_CLIENT_EVENT_CONFIRMATION_CALLBACK eventConfirmationCallback, void* userContextCallback)
+{
+    IOTHUB_CLIENT_RESULT result;
+    IOTHUB_MESSAGE_LIST *newEntry = (IOTHUB_MESSAGE_LIST*)malloc(sizeof(IOTHUB_MESSAGE_LIST));
+    if (newEntry == NULL)
+    {
+        result = IOTHUB_CLIENT_ERROR;
+        LOG_ERROR_RESULT;
+    }
+    else
+    {
+        if (attach_ms_timesOutAfter(handleData, newEntry) != 0)
+        {
+            result = IOTHUB_CLIENT_ERROR;
+            LOG_ERROR_RESULT;
+            free(newEntry);
+        }
+        else
+        {
+            if (take_ownership)
+            {
+                /*Codes_SRS_IOTHUBCLIENT_LL_44_001: [ IoTHubClientCore_LL_SendEventAsync_TakeOwnership shall add eventMessageHandle to the DLIST waitingToSend without cloning it. ]*/
+                newEntry->messageHandle = eventMessageHandle;
+            }
+            else
+            {
+                /*Codes_SRS_IOTHUBCLIENT_LL_02_013: [IoTHubClientCore_LL_SendEventAsync shall add the DLIST waitingToSend a new record cloning the information from eventMessageHandle, eventConfirmationCallback, userContextCallback.]*/
+                newEntry->messageHandle = IoTHubMessage_Clone(eventMessageHandle);
+            }
+
+            if (newEntry->messageHandle == NULL)
+            {
+                result = IOTHUB_CLIENT_ERROR;
+                free(newEntry);
+                LOG_ERROR_RESULT;
+            }
+            else if (IoTHubClient_Diagnostic_AddIfNecessary(&handleData->diagnostic_setting, newEntry->messageHandle) != 0)
+            {
+                /*Codes_SRS_IOTHUBCLIENT_LL_02_014: [If cloning and/or adding the information/diagnostic fails for any reason, IoTHubClientCore_LL_SendEventAsync shall fail and return IOTHUB_CLIENT_ERROR.] */
+                /*Codes_SRS_IOTHUBCLIENT_LL_44_002: [ If IoTHubClientCore_LL_SendEventAsync_TakeOwnership fails, the ownership of eventMessageHandle shall remain with the caller. ]*/
+                result = IOTHUB_CLIENT_ERROR;
+                if (!take_ownership)
+                {
+                    IoTHubMessage_Destroy(newEntry->messageHandle);
+                }
+                free(newEntry);
+                LOG_ERROR_RESULT;
+            }
+            else
+            {
+                DLIST_ENTRY dropped;
+                size_t dropped_count;
+
+                newEntry->priority = IoTHubMessage_GetPriority(newEntry->messageHandle);
+                newEntry->times_overtaken = 0;
+                /*Codes_SRS_IOTHUBCLIENT_LL_44_013: [ Every queued message shall count against OPTION_MAX_QUEUED_MESSAGES, and its payload size against OPTION_MAX_QUEUED_BYTES if that option is set. ]*/
+                newEntry->message_size = (handleData->outgoing_queue.max_bytes == 0) ? 0 : get_message_payload_size(newEntry->messageHandle);
+
+                if (store_message(handleData, newEntry) != 0)
+                {
+                    /*Codes_SRS_IOTHUBCLIENT_LL_44_038: [ If a message cannot be appended to the message store, it shall not be queued and IOTHUB_CLIENT_QUEUE_FULL shall be returned. ]*/
+                    result = IOTHUB_CLIENT_QUEUE_FULL;
+                    LOG_ERROR_RESULT;
+                }
+                else if ((result = make_room_in_outgoing_queue(handleData, 1, newEntry->message_size, newEntry->priority, &dropped, &dropped_count)) != IOTHUB_CLIENT_OK)
+                {
+                    release_stored_message(handleData, newEntry);
+                }
+                else
+                {
+                    /*Codes_SRS_IOTHUBCLIENT_LL_02_013: [IoTHubClientCore_LL_SendEventAsync shall add the DLIST waitingToSend a new record cloning the information from eventMessageHandle, eventConfirmationCallback, userContextCallback.]*/
+                    newEntry->callback = eventConfirmationCallback;
+                    newEntry->context = userContextCallback;
+                    insert_message_by_priority(handleData, newEntry);
+                    track_queued_message(handleData, newEntry);
+
+                    if (dropped_count != 0)
+                    {
+                        complete_dropped_messages(handleData, &dropped);
+                    }
+                    update_queue_state(handleData);
+                    /*Codes_SRS_IOTHUBCLIENT_LL_02_015: [Otherwise IoTHubClientCore_LL_SendEventAsync shall succeed and return IOTHUB_CLIENT_OK.] */
+                    result = IOTHUB_CLIENT_OK;
+                }
+
+                if (result != IOTHUB_CLIENT_OK)
+                {
+                    if (!take_ownership)
+                    {
+                        IoTHubMessage_Destroy(newEntry->messageHandle);
+                    }
+                    free(newEntry);
+                }
+            }
+        }
+    }
+    return result;
+}
+
 IOTHUB_CLIENT_RESULT IoTHubClientCore_LL_SendEventAsync(IOTHUB_CLIENT_CORE_LL_HANDLE iotHubClientHandle, IOTHUB_MESSAGE_HANDLE eventMessageHandle, IOTHUB_CLIENT_EVENT_CONFIRMATION_CALLBACK eventConfirmationCallback, void* userContextCallback)
 {
     IOTHUB_CLIENT_RESULT result;
@@ -1834,26 +2481,128 @@ IOTHUB_CLIENT_RESULT IoTHubClientCore_LL_SendEventAsync(IOTHUB_CLIENT_CORE_LL_HA
     }
     else
     {
-        IOTHUB_MESSAGE_LIST *newEntry = (IOTHUB_MESSAGE_LIST*)malloc(sizeof(IOTHUB_MESSAGE_LIST));
-        if (newEntry == NULL)
+        result = queue_event_message((IOTHUB_CLIENT_CORE_LL_HANDLE_DATA*)iotHubClientHandle, eventMessageHandle, false, eventConfirmationCallback, userContextCallback);
+    }
+    return result;
+}
+
+IOTHUB_CLIENT_RESULT IoTHubClientCore_LL_SendEventAsync_TakeOwnership(IOTHUB_CLIENT_CORE_LL_HANDLE iotHubClientHandle, IOTHUB_MESSAGE_HANDLE eventMessageHandle, IOTHUB_CLIENT_EVENT_CONFIRMATION_CALLBACK eventConfirmationCallback, void* userContextCallback)
+{
+    IOTHUB_CLIENT_RESULT result;
+    /*Codes_SRS_IOTHUBCLIENT_LL_44_003: [ IoTHubClientCore_LL_SendEventAsync_TakeOwnership shall fail and return IOTHUB_CLIENT_INVALID_ARG if parameter iotHubClientHandle or eventMessageHandle is NULL, or if eventConfirmationCallback is NULL and userContextCallback is not NULL. ]*/
+    if (
+        (iotHubClientHandle == NULL) ||
+        (eventMessageHandle == NULL) ||
+        ((eventConfirmationCallback == NULL) && (userContextCallback != NULL))
+        )
+    {
+        result = IOTHUB_CLIENT_INVALID_ARG;
+        LOG_ERROR_RESULT;
+    }
+    else
+    {
+        result = queue_event_message((IOTHUB_CLIENT_CORE_LL_HANDLE_DATA*)iotHubClientHandle, eventMessageHandle, true, eventConfirmationCallback, userContextCallback);
+    }
+    return result;
+}
+
+static void on_event_batch_message_confirmed(IOTHUB_CLIENT_CONFIRMATION_RESULT result, void* context)
+{
+    EVENT_BATCH_CONFIRMATION_CONTEXT* batch_context = (EVENT_BATCH_CONFIRMATION_CONTEXT*)context;
+
+    /*Codes_SRS_IOTHUBCLIENT_LL_44_008: [ In IOTHUB_CLIENT_BATCH_CONFIRMATION_PER_BATCH mode eventConfirmationCallback shall be invoked once, after the last message of the batch completes, with IOTHUB_CLIENT_CONFIRMATION_OK if all messages succeeded or with the first failure result otherwise. ]*/
+    if (result != IOTHUB_CLIENT_CONFIRMATION_OK && batch_context->batchResult == IOTHUB_CLIENT_CONFIRMATION_OK)
+    {
+        batch_context->batchResult = result;
+    }
+
+    batch_context->pendingCount--;
+
+    if (batch_context->pendingCount == 0)
+    {
+        batch_context->eventConfirmationCallback(batch_context->batchResult, batch_context->userContextCallback);
+        free(batch_context);
+    }
+}
+
+static void destroy_event_batch_entries(IOTHUB_CLIENT_CORE_LL_HANDLE_DATA* handleData, PDLIST_ENTRY batch_list)
+{
+    PDLIST_ENTRY entry;
+    while ((entry = DList_RemoveHeadList(batch_list)) != batch_list)
+    {
+        IOTHUB_MESSAGE_LIST* message_list = containingRecord(entry, IOTHUB_MESSAGE_LIST, entry);
+        release_stored_message(handleData, message_list);
+        IoTHubMessage_Destroy(message_list->messageHandle);
+        free(message_list);
+    }
+}
+
+IOTHUB_CLIENT_RESULT IoTHubClientCore_LL_SendEventBatchAsync(IOTHUB_CLIENT_CORE_LL_HANDLE iotHubClientHandle, IOTHUB_MESSAGE_HANDLE* eventMessageHandles, size_t eventMessageCount, IOTHUB_CLIENT_BATCH_CONFIRMATION confirmationMode, IOTHUB_CLIENT_EVENT_CONFIRMATION_CALLBACK eventConfirmationCallback, void* userContextCallback)
+{
+    IOTHUB_CLIENT_RESULT result;
+    size_t index = 0;
+
+    if (eventMessageHandles != NULL)
+    {
+        while (index < eventMessageCount && eventMessageHandles[index] != NULL)
+        {
+            index++;
+        }
+    }
+
+    /*Codes_SRS_IOTHUBCLIENT_LL_44_004: [ IoTHubClientCore_LL_SendEventBatchAsync shall fail and return IOTHUB_CLIENT_INVALID_ARG if iotHubClientHandle or eventMessageHandles is NULL, if eventMessageCount is 0, if any of the message handles is NULL, if confirmationMode is not a valid value, or if eventConfirmationCallback is NULL and userContextCallback is not NULL. ]*/
+    if (
+        (iotHubClientHandle == NULL) ||
+        (eventMessageHandles == NULL) ||
+        (eventMessageCount == 0) ||
+        (index != eventMessageCount) ||
+        (confirmationMode != IOTHUB_CLIENT_BATCH_CONFIRMATION_PER_MESSAGE && confirmationMode != IOTHUB_CLIENT_BATCH_CONFIRMATION_PER_BATCH) ||
+        ((eventConfirmationCallback == NULL) && (userContextCallback != NULL))
+        )
+    {
+        result = IOTHUB_CLIENT_INVALID_ARG;
+        LOG_ERROR_RESULT;
+    }
+    else
+    {
+        IOTHUB_CLIENT_CORE_LL_HANDLE_DATA* handleData = (IOTHUB_CLIENT_CORE_LL_HANDLE_DATA*)iotHubClientHandle;
+        EVENT_BATCH_CONFIRMATION_CONTEXT* batch_context = NULL;
+        tickcounter_ms_t batch_start_time = 0;
+
+        /*Codes_SRS_IOTHUBCLIENT_LL_44_005: [ IoTHubClientCore_LL_SendEventBatchAsync shall read the current time once and use it as the timeout start time of every message in the batch. ]*/
+        if (handleData->currentMessageTimeout != 0 && tickcounter_get_current_ms(handleData->tickCounter, &batch_start_time) != 0)
+        {
+            result = IOTHUB_CLIENT_ERROR;
+            LOG_ERROR_RESULT;
+        }
+        else if (confirmationMode == IOTHUB_CLIENT_BATCH_CONFIRMATION_PER_BATCH && eventConfirmationCallback != NULL &&
+            (batch_context = (EVENT_BATCH_CONFIRMATION_CONTEXT*)malloc(sizeof(EVENT_BATCH_CONFIRMATION_CONTEXT))) == NULL)
         {
             result = IOTHUB_CLIENT_ERROR;
             LOG_ERROR_RESULT;
         }
         else
         {
-            IOTHUB_CLIENT_CORE_LL_HANDLE_DATA* handleData = (IOTHUB_CLIENT_CORE_LL_HANDLE_DATA*)iotHubClientHandle;
+            DLIST_ENTRY batch_list;
+            DLIST_ENTRY dropped;
+            size_t dropped_count = 0;
+            size_t batch_size = 0;
+            IOTHUB_MESSAGE_PRIORITY previous_priority = IOTHUB_MESSAGE_PRIORITY_HIGH;
+            IOTHUB_MESSAGE_PRIORITY lowest_batch_priority = IOTHUB_MESSAGE_PRIORITY_HIGH;
+            bool is_batch_in_priority_order = true;
+            DList_InitializeListHead(&batch_list);
+            result = IOTHUB_CLIENT_OK;
 
-            if (attach_ms_timesOutAfter(handleData, newEntry) != 0)
-            {
-                result = IOTHUB_CLIENT_ERROR;
-                LOG_ERROR_RESULT;
-                free(newEntry);
-            }
-            else
+            for (index = 0; index < eventMessageCount && result == IOTHUB_CLIENT_OK; index++)
             {
-                /*Codes_SRS_IOTHUBCLIENT_LL_02_013: [IoTHubClientCore_LL_SendEventAsync shall add the DLIST waitingToSend a new record cloning the information from eventMessageHandle, eventConfirmationCallback, userContextCallback.]*/
-                if ((newEntry->messageHandle = IoTHubMessage_Clone(eventMessageHandle)) == NULL)
+                IOTHUB_MESSAGE_LIST* newEntry;
+
+                if ((newEntry = (IOTHUB_MESSAGE_LIST*)malloc(sizeof(IOTHUB_MESSAGE_LIST))) == NULL)
+                {
+                    result = IOTHUB_CLIENT_ERROR;
+                    LOG_ERROR_RESULT;
+                }
+                else if ((newEntry->messageHandle = IoTHubMessage_Clone(eventMessageHandles[index])) == NULL)
                 {
                     result = IOTHUB_CLIENT_ERROR;
                     free(newEntry);
@@ -1861,24 +2610,109 @@ IOTHUB_CLIENT_RESULT IoTHubClientCore_LL_SendEventAsync(IOTHUB_CLIENT_CORE_LL_HA
                 }
                 else if (IoTHubClient_Diagnostic_AddIfNecessary(&handleData->diagnostic_setting, newEntry->messageHandle) != 0)
                 {
-                    /*Codes_SRS_IOTHUBCLIENT_LL_02_014: [If cloning and/or adding the information/diagnostic fails for any reason, IoTHubClientCore_LL_SendEventAsync shall fail and return IOTHUB_CLIENT_ERROR.] */
                     result = IOTHUB_CLIENT_ERROR;
                     IoTHubMessage_Destroy(newEntry->messageHandle);
                     free(newEntry);
                     LOG_ERROR_RESULT;
                 }
+                else if (store_message(handleData, newEntry) != 0)
+                {
+                    result = IOTHUB_CLIENT_QUEUE_FULL;
+                    IoTHubMessage_Destroy(newEntry->messageHandle);
+                    free(newEntry);
+                    LOG_ERROR_RESULT;
+                }
                 else
                 {
-                    /*Codes_SRS_IOTHUBCLIENT_LL_02_013: [IoTHubClientCore_LL_SendEventAsync shall add the DLIST waitingToSend a new record cloning the information from eventMessageHandle, eventConfirmationCallback, userContextCallback.]*/
-                    newEntry->callback = eventConfirmationCallback;
-                    newEntry->context = userContextCallback;
-                    DList_InsertTailList(&(iotHubClientHandle->waitingToSend), &(newEntry->entry));
-                    /*Codes_SRS_IOTHUBCLIENT_LL_02_015: [Otherwise IoTHubClientCore_LL_SendEventAsync shall succeed and return IOTHUB_CLIENT_OK.] */
-                    result = IOTHUB_CLIENT_OK;
+                    newEntry->ms_timesOutAfter = batch_start_time;
+                    newEntry->message_timeout_value = handleData->currentMessageTimeout;
+                    newEntry->priority = IoTHubMessage_GetPriority(newEntry->messageHandle);
+                    newEntry->times_overtaken = 0;
+                    newEntry->message_size = (handleData->outgoing_queue.max_bytes == 0) ? 0 : get_message_payload_size(newEntry->messageHandle);
+                    batch_size += newEntry->message_size;
+
+                    if (newEntry->priority > previous_priority)
+                    {
+                        is_batch_in_priority_order = false;
+                    }
+                    if (newEntry->priority < lowest_batch_priority)
+                    {
+                        lowest_batch_priority = newEntry->priority;
+                    }
+                    previous_priority = newEntry->priority;
+
+                    if (batch_context != NULL)
+                    {
+                        newEntry->callback = on_event_batch_message_confirmed;
+                        newEntry->context = batch_context;
+                    }
+                    else
+                    {
+                        /*Codes_SRS_IOTHUBCLIENT_LL_44_007: [ In IOTHUB_CLIENT_BATCH_CONFIRMATION_PER_MESSAGE mode eventConfirmationCallback shall be invoked once for every message with userContextCallback. ]*/
+                        newEntry->callback = eventConfirmationCallback;
+                        newEntry->context = userContextCallback;
+                    }
+
+                    DList_InsertTailList(&batch_list, &(newEntry->entry));
+                }
+            }
+
+            /*Codes_SRS_IOTHUBCLIENT_LL_44_020: [ IoTHubClientCore_LL_SendEventBatchAsync shall make room for, or reject, the whole batch at once, and return IOTHUB_CLIENT_QUEUE_FULL if it does not fit in the outgoing queue. ]*/
+            if (result == IOTHUB_CLIENT_OK)
+            {
+                result = make_room_in_outgoing_queue(handleData, eventMessageCount, batch_size, lowest_batch_priority, &dropped, &dropped_count);
+            }
+
+            if (result != IOTHUB_CLIENT_OK)
+            {
+                /*Codes_SRS_IOTHUBCLIENT_LL_44_009: [ If cloning or queuing any of the messages fails, IoTHubClientCore_LL_SendEventBatchAsync shall release all the messages of the batch, queue none of them and return IOTHUB_CLIENT_ERROR. ]*/
+                destroy_event_batch_entries(handleData, &batch_list);
+                free(batch_context);
+            }
+            else
+            {
+                if (batch_context != NULL)
+                {
+                    batch_context->eventConfirmationCallback = eventConfirmationCallback;
+                    batch_context->userContextCallback = userContextCallback;
+                    batch_context->pendingCount = eventMessageCount;
+                    batch_context->batchResult = IOTHUB_CLIENT_CONFIRMATION_OK;
+                }
+
+                sync_priority_lanes(handleData);
+
+                if (is_batch_in_priority_order &&
+                    ((handleData->waitingToSend.Blink == &(handleData->waitingToSend)) ||
+                    (containingRecord(handleData->waitingToSend.Blink, IOTHUB_MESSAGE_LIST, entry)->priority >= containingRecord(batch_list.Flink, IOTHUB_MESSAGE_LIST, entry)->priority)))
+                {
+                    PDLIST_ENTRY appended = batch_list.Flink;
+
+                    /*Codes_SRS_IOTHUBCLIENT_LL_44_006: [ IoTHubClientCore_LL_SendEventBatchAsync shall clone every message of the batch and append all of them to waitingToSend, in order, in a single operation. ]*/
+                    DList_AppendTailList(&(handleData->waitingToSend), &batch_list);
+                    (void)DList_RemoveEntryList(&batch_list);
+                    append_messages_to_lanes(handleData, appended);
+                }
+                else
+                {
+                    /*Codes_SRS_IOTHUBCLIENT_LL_44_032: [ If appending the batch would break the priority order of waitingToSend, IoTHubClientCore_LL_SendEventBatchAsync shall queue its messages one by one by priority instead. ]*/
+                    PDLIST_ENTRY entry;
+                    while ((entry = DList_RemoveHeadList(&batch_list)) != &batch_list)
+                    {
+                        insert_message_by_priority(handleData, containingRecord(entry, IOTHUB_MESSAGE_LIST, entry));
+                    }
+                }
+                handleData->outgoing_queue.message_count += eventMessageCount;
+                handleData->outgoing_queue.byte_count += batch_size;
+
+                if (dropped_count != 0)
+                {
+                    complete_dropped_messages(handleData, &dropped);
                 }
+                update_queue_state(handleData);
             }
         }
     }
+
     return result;
 }
 
@@ -2051,28 +2885,31 @@ static void DoTimeouts(IOTHUB_CLIENT_CORE_LL_HANDLE_DATA* handleData)
     }
     else
     {
-        DLIST_ENTRY* currentItemInWaitingToSend = handleData->waitingToSend.Flink;
-        while (currentItemInWaitingToSend != &(handleData->waitingToSend)) /*while we are not at the end of the list*/
+        TIMEOUT_HEAP_ENTRY* expired;
+
+        /*Codes_SRS_IOTHUBCLIENT_LL_44_010: [ DoTimeouts shall only visit the messages whose timeout has expired, in the order of their deadlines. ]*/
+        sync_priority_lanes(handleData);
+        while ((expired = timeout_heap_pop_expired(&handleData->messageTimeouts, nowTick)) != NULL)
         {
-            IOTHUB_MESSAGE_LIST* fullEntry = containingRecord(currentItemInWaitingToSend, IOTHUB_MESSAGE_LIST, entry);
-            /*Codes_SRS_IOTHUBCLIENT_LL_02_041: [ If more than value miliseconds have passed since the call to IoTHubClientCore_LL_SendEventAsync then the message callback shall be called with a status code of IOTHUB_CLIENT_CONFIRMATION_TIMEOUT. ]*/
-            if ((fullEntry->ms_timesOutAfter != 0) && ((nowTick - fullEntry->ms_timesOutAfter) > fullEntry->message_timeout_value))
+            IOTHUB_MESSAGE_LIST* fullEntry = containingRecord(expired, IOTHUB_MESSAGE_LIST, timeout_entry);
+
+            /*Codes_SRS_IOTHUBCLIENT_LL_44_011: [ A message that has already been taken out of waitingToSend by the transport shall not be timed out by DoTimeouts. ]*/
+            if (is_message_waiting_to_send(handleData, fullEntry))
             {
-                PDLIST_ENTRY theNext = currentItemInWaitingToSend->Flink; /*need to save the next item, because the below operations are destructive*/
-                DList_RemoveEntryList(currentItemInWaitingToSend);
+                /*Codes_SRS_IOTHUBCLIENT_LL_02_041: [ If more than value miliseconds have passed since the call to IoTHubClientCore_LL_SendEventAsync then the message callback shall be called with a status code of IOTHUB_CLIENT_CONFIRMATION_TIMEOUT. ]*/
+                unlink_message_from_lane(handleData, fullEntry);
+                untrack_queued_message(handleData, fullEntry);
+                release_stored_message(handleData, fullEntry);
                 if (fullEntry->callback != NULL)
                 {
                     fullEntry->callback(IOTHUB_CLIENT_CONFIRMATION_MESSAGE_TIMEOUT, fullEntry->context);
                 }
                 IoTHubMessage_Destroy(fullEntry->messageHandle); /*because it has been cloned*/
                 free(fullEntry);
-                currentItemInWaitingToSend = theNext;
-            }
-            else
-            {
-                currentItemInWaitingToSend = currentItemInWaitingToSend->Flink;
             }
         }
+
+        update_queue_state(handleData);
     }
 }
 
@@ -2084,6 +2921,14 @@ void IoTHubClientCore_LL_DoWork(IOTHUB_CLIENT_CORE_LL_HANDLE iotHubClientHandle)
         IOTHUB_CLIENT_CORE_LL_HANDLE_DATA* handleData = (IOTHUB_CLIENT_CORE_LL_HANDLE_DATA*)iotHubClientHandle;
         DoTimeouts(handleData);
 
+#ifdef USE_MESSAGE_STORE
+        /*Codes_SRS_IOTHUBCLIENT_LL_44_039: [ IoTHubClientCore_LL_DoWork shall flush the message store to disk once, for all the messages stored and released since the previous call, before invoking the underlaying layer's _DoWork function. ]*/
+        if ((handleData->messageStore != NULL) && (message_store_commit(handleData->messageStore) != 0))
+        {
+            LogError("unable to flush the message store, it will be retried on the next call");
+        }
+#endif
+
         /*Codes_SRS_IOTHUBCLIENT_LL_07_008: [ IoTHubClientCore_LL_DoWork shall iterate the message queue and execute the underlying transports IoTHubTransport_ProcessItem function for each item. ] */
         DLIST_ENTRY* client_item = handleData->iot_msg_queue.Flink;
         while (client_item != &(handleData->iot_msg_queue)) /*while we are not at the end of the list*/
@@ -2166,6 +3011,111 @@ IOTHUB_CLIENT_RESULT IoTHubClientCore_LL_SetConnectionStatusCallback(IOTHUB_CLIE
     return result;
 }
 
+IOTHUB_CLIENT_RESULT IoTHubClientCore_LL_GetNextWorkDeadline(IOTHUB_CLIENT_CORE_LL_HANDLE iotHubClientHandle, unsigned int* msUntilNextWork)
+{
+    IOTHUB_CLIENT_RESULT result;
+    /*Codes_SRS_IOTHUBCLIENT_LL_44_041: [ IoTHubClientCore_LL_GetNextWorkDeadline shall return IOTHUB_CLIENT_INVALID_ARG if iotHubClientHandle or msUntilNextWork is NULL. ]*/
+    if ((iotHubClientHandle == NULL) || (msUntilNextWork == NULL))
+    {
+        result = IOTHUB_CLIENT_INVALID_ARG;
+        LOG_ERROR_RESULT;
+    }
+    else
+    {
+        IOTHUB_CLIENT_CORE_LL_HANDLE_DATA* handleData = (IOTHUB_CLIENT_CORE_LL_HANDLE_DATA*)iotHubClientHandle;
+        TIMEOUT_HEAP_ENTRY* earliest;
+        tickcounter_ms_t nowTick;
+
+        /*Codes_SRS_IOTHUBCLIENT_LL_44_042: [ If waitingToSend or the device twin queue are not empty, IoTHubClientCore_LL_GetNextWorkDeadline shall set msUntilNextWork to 0. ]*/
+        if ((DList_IsListEmpty(&handleData->waitingToSend) == 0) || (DList_IsListEmpty(&handleData->iot_msg_queue) == 0))
+        {
+            *msUntilNextWork = 0;
+            result = IOTHUB_CLIENT_OK;
+        }
+        /*Codes_SRS_IOTHUBCLIENT_LL_44_043: [ Otherwise, if no message waits for its confirmation timeout, IoTHubClientCore_LL_GetNextWorkDeadline shall set msUntilNextWork to UINT_MAX. ]*/
+        else if ((earliest = timeout_heap_peek(&handleData->messageTimeouts)) == NULL)
+        {
+            *msUntilNextWork = UINT_MAX;
+            result = IOTHUB_CLIENT_OK;
+        }
+        /*Codes_SRS_IOTHUBCLIENT_LL_44_045: [ If getting the current time fails, IoTHubClientCore_LL_GetNextWorkDeadline shall return IOTHUB_CLIENT_ERROR. ]*/
+        else if (tickcounter_get_current_ms(handleData->tickCounter, &nowTick) != 0)
+        {
+            result = IOTHUB_CLIENT_ERROR;
+            LogError("unable to get the current ms");
+        }
+        /*Codes_SRS_IOTHUBCLIENT_LL_44_046: [ Otherwise IoTHubClientCore_LL_GetNextWorkDeadline shall set msUntilNextWork to the time left until the earliest message timeout, 0 if it has already expired. ]*/
+        else
+        {
+            if (earliest->deadline <= nowTick)
+            {
+                *msUntilNextWork = 0;
+            }
+            else if (earliest->deadline - nowTick >= UINT_MAX)
+            {
+                *msUntilNextWork = UINT_MAX - 1;
+            }
+            else
+            {
+                *msUntilNextWork = (unsigned int)(earliest->deadline - nowTick);
+            }
+            result = IOTHUB_CLIENT_OK;
+        }
+    }
+
+    return result;
+}
+
+IOTHUB_CLIENT_RESULT IoTHubClientCore_LL_GetRttStatistics(IOTHUB_CLIENT_CORE_LL_HANDLE iotHubClientHandle, IOTHUB_CLIENT_RTT_STATISTICS* rttStatistics)
+{
+    IOTHUB_CLIENT_RESULT result;
+    /*Codes_SRS_IOTHUBCLIENT_LL_44_047: [ IoTHubClientCore_LL_GetRttStatistics shall return IOTHUB_CLIENT_INVALID_ARG if iotHubClientHandle or rttStatistics is NULL. ]*/
+    if ((iotHubClientHandle == NULL) || (rttStatistics == NULL))
+    {
+        result = IOTHUB_CLIENT_INVALID_ARG;
+        LOG_ERROR_RESULT;
+    }
+    else
+    {
+        IOTHUB_CLIENT_CORE_LL_HANDLE_DATA* handleData = (IOTHUB_CLIENT_CORE_LL_HANDLE_DATA*)iotHubClientHandle;
+
+        /*Codes_SRS_IOTHUBCLIENT_LL_44_049: [ If the transport provider has no IoTHubTransport_GetRttStatistics, IoTHubClientCore_LL_GetRttStatistics shall return IOTHUB_CLIENT_ERROR. ]*/
+        if (handleData->IoTHubTransport_GetRttStatistics == NULL)
+        {
+            result = IOTHUB_CLIENT_ERROR;
+            LogError("the transport does not measure the round trip time");
+        }
+        else
+        {
+            /*Codes_SRS_IOTHUBCLIENT_LL_44_048: [ Otherwise IoTHubClientCore_LL_GetRttStatistics shall call IoTHubTransport_GetRttStatistics and return its result. ]*/
+            result = handleData->IoTHubTransport_GetRttStatistics(handleData->transportHandle, rttStatistics);
+        }
+    }
+
+    return result;
+}
+
+IOTHUB_CLIENT_RESULT IoTHubClientCore_LL_SetOutgoingQueueStateCallback(IOTHUB_CLIENT_CORE_LL_HANDLE iotHubClientHandle, IOTHUB_CLIENT_QUEUE_STATE_CALLBACK queueStateCallback, void* userContextCallback)
+{
+    IOTHUB_CLIENT_RESULT result;
+    /*Codes_SRS_IOTHUBCLIENT_LL_44_024: [ IoTHubClientCore_LL_SetOutgoingQueueStateCallback shall return IOTHUB_CLIENT_INVALID_ARG if iotHubClientHandle is NULL. ]*/
+    if (iotHubClientHandle == NULL)
+    {
+        result = IOTHUB_CLIENT_INVALID_ARG;
+        LOG_ERROR_RESULT;
+    }
+    else
+    {
+        IOTHUB_CLIENT_CORE_LL_HANDLE_DATA* handleData = (IOTHUB_CLIENT_CORE_LL_HANDLE_DATA*)iotHubClientHandle;
+        /*Codes_SRS_IOTHUBCLIENT_LL_44_025: [ IoTHubClientCore_LL_SetOutgoingQueueStateCallback shall save queueStateCallback and userContextCallback and return IOTHUB_CLIENT_OK. ]*/
+        handleData->outgoing_queue.state_callback = queueStateCallback;
+        handleData->outgoing_queue.state_callback_context = userContextCallback;
+        result = IOTHUB_CLIENT_OK;
+    }
+
+    return result;
+}
+
 IOTHUB_CLIENT_RESULT IoTHubClientCore_LL_SetRetryPolicy(IOTHUB_CLIENT_CORE_LL_HANDLE iotHubClientHandle, IOTHUB_CLIENT_RETRY_POLICY retryPolicy, size_t retryTimeoutLimitInSeconds)
 {
     IOTHUB_CLIENT_RESULT result;
@@ -2285,6 +3235,87 @@ IOTHUB_CLIENT_RESULT IoTHubClientCore_LL_SetOption(IOTHUB_CLIENT_CORE_LL_HANDLE
             handleData->currentMessageTimeout = *(const tickcounter_ms_t*)value;
             result = IOTHUB_CLIENT_OK;
         }
+        /*Codes_SRS_IOTHUBCLIENT_LL_44_021: [ "max_queued_messages" and "max_queued_bytes" shall set the limits of the outgoing queue. Value is a pointer to a size_t, 0 removes the limit. ]*/
+        else if (strcmp(optionName, OPTION_MAX_QUEUED_MESSAGES) == 0)
+        {
+            handleData->outgoing_queue.max_messages = *(const size_t*)value;
+            update_queue_state(handleData);
+            result = IOTHUB_CLIENT_OK;
+        }
+        else if (strcmp(optionName, OPTION_MAX_QUEUED_BYTES) == 0)
+        {
+            handleData->outgoing_queue.max_bytes = *(const size_t*)value;
+            update_queue_state(handleData);
+            result = IOTHUB_CLIENT_OK;
+        }
+        else if (strcmp(optionName, OPTION_QUEUE_FULL_POLICY) == 0)
+        {
+            IOTHUB_CLIENT_QUEUE_FULL_POLICY policy = *(const IOTHUB_CLIENT_QUEUE_FULL_POLICY*)value;
+            if (policy != IOTHUB_CLIENT_QUEUE_FULL_REJECT && policy != IOTHUB_CLIENT_QUEUE_FULL_DROP_OLDEST && policy != IOTHUB_CLIENT_QUEUE_FULL_DROP_LOWEST_PRIORITY)
+            {
+                /*Codes_SRS_IOTHUBCLIENT_LL_44_022: [ Calling IoTHubClientCore_LL_SetOption with "queue_full_policy" and a value that is not an IOTHUB_CLIENT_QUEUE_FULL_POLICY shall return IOTHUB_CLIENT_INVALID_ARG. ]*/
+                LogError("invalid queue_full_policy %d", (int)policy);
+                result = IOTHUB_CLIENT_INVALID_ARG;
+            }
+            else
+            {
+                handleData->outgoing_queue.full_policy = policy;
+                result = IOTHUB_CLIENT_OK;
+            }
+        }
+        else if (strcmp(optionName, OPTION_QUEUE_HIGH_WATERMARK_PERCENT) == 0)
+        {
+            unsigned int percent = *(const unsigned int*)value;
+            if (percent == 0 || percent > 100 || percent <= handleData->outgoing_queue.low_watermark_percent)
+            {
+                /*Codes_SRS_IOTHUBCLIENT_LL_44_023: [ Calling IoTHubClientCore_LL_SetOption with a watermark percentage that is out of range, or that would not keep the low watermark below the high watermark, shall return IOTHUB_CLIENT_INVALID_ARG. ]*/
+                LogError("queue_high_watermark_percent %u is not in (%u, 100]", percent, handleData->outgoing_queue.low_watermark_percent);
+                result = IOTHUB_CLIENT_INVALID_ARG;
+            }
+            else
+            {
+                handleData->outgoing_queue.high_watermark_percent = percent;
+                update_queue_state(handleData);
+                result = IOTHUB_CLIENT_OK;
+            }
+        }
+        else if (strcmp(optionName, OPTION_QUEUE_LOW_WATERMARK_PERCENT) == 0)
+        {
+            unsigned int percent = *(const unsigned int*)value;
+            if (percent >= handleData->outgoing_queue.high_watermark_percent)
+            {
+                LogError("queue_low_watermark_percent %u is not lower than the high watermark %u", percent, handleData->outgoing_queue.high_watermark_percent);
+                result = IOTHUB_CLIENT_INVALID_ARG;
+            }
+            else
+            {
+                handleData->outgoing_queue.low_watermark_percent = percent;
+                update_queue_state(handleData);
+                result = IOTHUB_CLIENT_OK;
+            }
+        }
+#ifdef USE_MESSAGE_STORE
+        else if (strcmp(optionName, OPTION_MESSAGE_STORE_DIRECTORY) == 0)
+        {
+            if (handleData->messageStore != NULL)
+            {
+                /*Codes_SRS_IOTHUBCLIENT_LL_44_033: [ If OPTION_MESSAGE_STORE_DIRECTORY has already been set, IoTHubClientCore_LL_SetOption shall fail and return IOTHUB_CLIENT_ERROR. ]*/
+                LogError("the message store directory can only be set once");
+                result = IOTHUB_CLIENT_ERROR;
+            }
+            /*Codes_SRS_IOTHUBCLIENT_LL_44_034: [ IoTHubClientCore_LL_SetOption shall open the message store kept in the directory given by OPTION_MESSAGE_STORE_DIRECTORY, and fail with IOTHUB_CLIENT_ERROR if it cannot be opened. ]*/
+            else if ((handleData->messageStore = message_store_open((const char*)value, on_stored_message, handleData)) == NULL)
+            {
+                LogError("unable to open the message store in %s", (const char*)value);
+                result = IOTHUB_CLIENT_ERROR;
+            }
+            else
+            {
+                update_queue_state(handleData);
+                result = IOTHUB_CLIENT_OK;
+            }
+        }
+#endif
         else if (strcmp(optionName, OPTION_PRODUCT_INFO) == 0)
         {
             /*Codes_SRS_IOTHUBCLIENT_LL_10_033: [repeat calls with "product_info" will erase the previously set product information if applicatble. ]*/
@@ -33,6 +33,7 @@ typedef struct IOTHUB_MESSAGE_HANDLE_DATA_TAG
     char* connectionDeviceId;
     IOTHUB_MESSAGE_DIAGNOSTIC_PROPERTY_DATA_HANDLE diagnosticData;
     bool is_security_message;
+    IOTHUB_MESSAGE_PRIORITY priority;
 }IOTHUB_MESSAGE_HANDLE_DATA;
 
 static bool ContainsOnlyUsAscii(const char* asciiValue)
@@ -188,6 +189,8 @@ IOTHUB_MESSAGE_HANDLE IoTHubMessage_CreateFromByteArray(const unsigned char* byt
             memset(result, 0, sizeof(*result));
             /*Codes_SRS_IOTHUBMESSAGE_02_026: [The type of the new message shall be IOTHUBMESSAGE_BYTEARRAY.] */
             result->contentType = IOTHUBMESSAGE_BYTEARRAY;
+            /*Codes_SRS_IOTHUBMESSAGE_44_001: [ New messages shall have the priority IOTHUB_MESSAGE_PRIORITY_NORMAL. ]*/
+            result->priority = IOTHUB_MESSAGE_PRIORITY_NORMAL;
 
             if (size != 0)
             {
@@ -256,6 +259,8 @@ IOTHUB_MESSAGE_HANDLE IoTHubMessage_CreateFromString(const char* source)
             memset(result, 0, sizeof(*result));
             /*Codes_SRS_IOTHUBMESSAGE_02_032: [The type of the new message shall be IOTHUBMESSAGE_STRING.] */
             result->contentType = IOTHUBMESSAGE_STRING;
+            /*Codes_SRS_IOTHUBMESSAGE_44_001: [ New messages shall have the priority IOTHUB_MESSAGE_PRIORITY_NORMAL. ]*/
+            result->priority = IOTHUB_MESSAGE_PRIORITY_NORMAL;
 
             /*Codes_SRS_IOTHUBMESSAGE_02_027: [IoTHubMessage_CreateFromString shall call STRING_construct passing source as parameter.] */
             if ((result->value.string = STRING_construct(source)) == NULL)
@@ -305,6 +310,8 @@ IOTHUB_MESSAGE_HANDLE IoTHubMessage_Clone(IOTHUB_MESSAGE_HANDLE iotHubMessageHan
             memset(result, 0, sizeof(*result));
             result->contentType = source->contentType;
             result->is_security_message = source->is_security_message;
+            /*Codes_SRS_IOTHUBMESSAGE_44_002: [ IoTHubMessage_Clone shall copy the priority of the message. ]*/
+            result->priority = source->priority;
 
             if (source->messageId != NULL && mallocAndStrcpy_s(&result->messageId, source->messageId) != 0)
             {
@@ -1070,6 +1077,42 @@ bool IoTHubMessage_IsSecurityMessage(IOTHUB_MESSAGE_HANDLE iotHubMessageHandle)
     return result;
 }
 
+IOTHUB_MESSAGE_RESULT IoTHubMessage_SetPriority(IOTHUB_MESSAGE_HANDLE iotHubMessageHandle, IOTHUB_MESSAGE_PRIORITY priority)
+{
+    IOTHUB_MESSAGE_RESULT result;
+    if (iotHubMessageHandle == NULL ||
+        (priority != IOTHUB_MESSAGE_PRIORITY_LOW && priority != IOTHUB_MESSAGE_PRIORITY_NORMAL && priority != IOTHUB_MESSAGE_PRIORITY_HIGH))
+    {
+        /*Codes_SRS_IOTHUBMESSAGE_44_003: [ If iotHubMessageHandle is NULL or priority is not a valid IOTHUB_MESSAGE_PRIORITY, IoTHubMessage_SetPriority shall return IOTHUB_MESSAGE_INVALID_ARG. ]*/
+        LogError("Invalid argument (iotHubMessageHandle=%p, priority=%d)", iotHubMessageHandle, (int)priority);
+        result = IOTHUB_MESSAGE_INVALID_ARG;
+    }
+    else
+    {
+        /*Codes_SRS_IOTHUBMESSAGE_44_004: [ IoTHubMessage_SetPriority shall save priority and return IOTHUB_MESSAGE_OK. ]*/
+        iotHubMessageHandle->priority = priority;
+        result = IOTHUB_MESSAGE_OK;
+    }
+    return result;
+}
+
+IOTHUB_MESSAGE_PRIORITY IoTHubMessage_GetPriority(IOTHUB_MESSAGE_HANDLE iotHubMessageHandle)
+{
+    IOTHUB_MESSAGE_PRIORITY result;
+    if (iotHubMessageHandle == NULL)
+    {
+        /*Codes_SRS_IOTHUBMESSAGE_44_005: [ If iotHubMessageHandle is NULL, IoTHubMessage_GetPriority shall return IOTHUB_MESSAGE_PRIORITY_NORMAL. ]*/
+        LogError("Invalid argument (iotHubMessageHandle is NULL)");
+        result = IOTHUB_MESSAGE_PRIORITY_NORMAL;
+    }
+    else
+    {
+        /*Codes_SRS_IOTHUBMESSAGE_44_006: [ IoTHubMessage_GetPriority shall return the priority of the message. ]*/
+        result = iotHubMessageHandle->priority;
+    }
+    return result;
+}
+
 void IoTHubMessage_Destroy(IOTHUB_MESSAGE_HANDLE iotHubMessageHandle)
 {
     /*Codes_SRS_IOTHUBMESSAGE_01_004: [If iotHubMessageHandle is NULL, IoTHubMessage_Destroy shall do nothing.] */
@@ -11,6 +11,7 @@
 #include "internal/iothub_client_private.h"
 #include "azure_c_shared_utility/threadapi.h"
 #include "azure_c_shared_utility/lock.h"
+#include "azure_c_shared_utility/condition.h"
 #include "azure_c_shared_utility/xlogging.h"
 #include "azure_c_shared_utility/vector.h"
 
@@ -19,15 +20,35 @@
 #include "iothub_transport_ll.h"
 #include "iothub_client_core.h"
 
+#define TRANSPORT_WORKER_THREADS_MAX 64
+
+/*clients served by one of the threads added with IoTHubTransport_SetWorkerThreadCount*/
+typedef struct TRANSPORT_CLIENT_SHARD_TAG
+{
+    struct TRANSPORT_HANDLE_DATA_TAG* transportData;
+    THREAD_HANDLE threadHandle;
+    VECTOR_HANDLE clients;
+    LOCK_HANDLE clientsLockHandle;
+    size_t nextClient;
+    int stopThread; /*guarded by clientsLockHandle*/
+    int workSignaled; /*guarded by the transport lock*/
+} TRANSPORT_CLIENT_SHARD;
+
 typedef struct TRANSPORT_HANDLE_DATA_TAG
 {
     TRANSPORT_LL_HANDLE transportLLHandle;
     THREAD_HANDLE workerThreadHandle;
     LOCK_HANDLE lockHandle;
+    COND_HANDLE workCondition; /*only created once IoTHubTransport_SetWorkerIdleTime is called*/
+    unsigned int idleTimeInMs;
+    int workSignaled;
     sig_atomic_t stopThread;
     TRANSPORT_PROVIDER_FIELDS;
     VECTOR_HANDLE clients;
     LOCK_HANDLE clientsLockHandle;
+    size_t nextClient;
+    TRANSPORT_CLIENT_SHARD* shards; /*only created once IoTHubTransport_SetWorkerThreadCount is called with more than 1 thread*/
+    size_t shardCount;
     IOTHUB_CLIENT_MULTIPLEXED_DO_WORK clientDoWork;
 } TRANSPORT_HANDLE_DATA;
 
@@ -125,7 +146,13 @@ TRANSPORT_HANDLE IoTHubTransport_Create(IOTHUB_CLIENT_TRANSPORT_PROVIDER protoco
                     {
                         /*Codes_SRS_IOTHUBTRANSPORT_17_001: [ IoTHubTransport_Create shall return a non-NULL handle on success.]*/
                         result->stopThread = 1;
+                        result->workCondition = NULL;
+                        result->idleTimeInMs = 0;
+                        result->workSignaled = 0;
                         result->clientDoWork = NULL;
+                        result->nextClient = 0;
+                        result->shards = NULL;
+                        result->shardCount = 0;
                         result->workerThreadHandle = NULL; /* create thread when work needs to be done */
                         result->IoTHubTransport_GetHostname = transportProtocol->IoTHubTransport_GetHostname;
                         result->IoTHubTransport_SetOption = transportProtocol->IoTHubTransport_SetOption;
@@ -147,41 +174,72 @@ TRANSPORT_HANDLE IoTHubTransport_Create(IOTHUB_CLIENT_TRANSPORT_PROVIDER protoco
     return result;
 }
 
-static void multiplexed_client_do_work(TRANSPORT_HANDLE_DATA* transportData)
+/*called with the lock of clients held*/
+static void run_clients_do_work(TRANSPORT_HANDLE_DATA* transportData, VECTOR_HANDLE clients, size_t* nextClient)
 {
-    if (Lock(transportData->clientsLockHandle) != LOCK_OK)
-    {
-        LogError("failed to lock for multiplexed_client_do_work");
-    }
-    else
+    size_t numberOfClients = VECTOR_size(clients);
+    size_t iterator;
+
+    if (numberOfClients != 0)
     {
-        size_t numberOfClients;
-        size_t iterator;
+        /*Codes_SRS_IOTHUBTRANSPORT_44_007: [ Each pass of a worker thread over its clients shall start one client after the client the previous pass started with, so no client is always served first. ]*/
+        size_t firstClient = *nextClient % numberOfClients;
 
-        numberOfClients = VECTOR_size(transportData->clients);
         for (iterator = 0; iterator < numberOfClients; iterator++)
         {
-            IOTHUB_CLIENT_CORE_HANDLE* clientHandle = (IOTHUB_CLIENT_CORE_HANDLE*)VECTOR_element(transportData->clients, iterator);
+            IOTHUB_CLIENT_CORE_HANDLE* clientHandle = (IOTHUB_CLIENT_CORE_HANDLE*)VECTOR_element(clients, (firstClient + iterator) % numberOfClients);
 
             if (clientHandle != NULL)
             {
                 transportData->clientDoWork(*clientHandle);
             }
         }
+        *nextClient = firstClient + 1;
+    }
+}
 
-        if (Unlock(transportData->clientsLockHandle) != LOCK_OK)
+static void multiplexed_client_do_work(TRANSPORT_HANDLE_DATA* transportData, LOCK_HANDLE clientsLockHandle, VECTOR_HANDLE clients, size_t* nextClient)
+{
+    if (Lock(clientsLockHandle) != LOCK_OK)
+    {
+        LogError("failed to lock for multiplexed_client_do_work");
+    }
+    else
+    {
+        run_clients_do_work(transportData, clients, nextClient);
+
+        if (Unlock(clientsLockHandle) != LOCK_OK)
         {
             LogError("failed to unlock on multiplexed_client_do_work");
         }
     }
 }
 
+static void wait_for_work(TRANSPORT_HANDLE_DATA* transportData, COND_HANDLE workCondition)
+{
+    if (Lock(transportData->lockHandle) != LOCK_OK)
+    {
+        ThreadAPI_Sleep(1);
+    }
+    else
+    {
+        /*Codes_SRS_IOTHUBTRANSPORT_44_004: [ Once IoTHubTransport_SetWorkerIdleTime is called, the thread shall wait for the idle time between calls to lower layer transport DoWork, unless IoTHubTransport_SignalWork is called. ]*/
+        if (!transportData->stopThread && !transportData->workSignaled)
+        {
+            (void)Condition_Wait(workCondition, transportData->lockHandle, (int)transportData->idleTimeInMs);
+        }
+        (void)Unlock(transportData->lockHandle);
+    }
+}
+
 static int transport_worker_thread(void* threadArgument)
 {
     TRANSPORT_HANDLE_DATA* transportData = (TRANSPORT_HANDLE_DATA*)threadArgument;
 
     while (1)
     {
+        COND_HANDLE workCondition = NULL;
+
         /*Codes_SRS_IOTHUBTRANSPORT_17_030: [ All calls to lower layer transport DoWork shall be protected by the lock created in IoTHubTransport_Create. ]*/
         if (Lock(transportData->lockHandle) == LOCK_OK)
         {
@@ -194,22 +252,136 @@ static int transport_worker_thread(void* threadArgument)
             }
             else
             {
+                transportData->workSignaled = 0;
                 (transportData->IoTHubTransport_DoWork)(transportData->transportLLHandle);
+                workCondition = transportData->workCondition;
 
                 (void)Unlock(transportData->lockHandle);
             }
         }
 
-        multiplexed_client_do_work(transportData);
+        multiplexed_client_do_work(transportData, transportData->clientsLockHandle, transportData->clients, &transportData->nextClient);
 
-        /*Codes_SRS_IOTHUBTRANSPORT_17_029: [ The thread shall call lower layer transport DoWork every 1 ms. ]*/
-        ThreadAPI_Sleep(1);
+        if (workCondition == NULL)
+        {
+            /*Codes_SRS_IOTHUBTRANSPORT_17_029: [ The thread shall call lower layer transport DoWork every 1 ms. ]*/
+            ThreadAPI_Sleep(1);
+        }
+        else
+        {
+            wait_for_work(transportData, workCondition);
+        }
+    }
+
+    ThreadAPI_Exit(0);
+    return 0;
+}
+
+static int transport_shard_thread(void* threadArgument)
+{
+    TRANSPORT_CLIENT_SHARD* shard = (TRANSPORT_CLIENT_SHARD*)threadArgument;
+    TRANSPORT_HANDLE_DATA* transportData = shard->transportData;
+    bool stop = false;
+
+    /*Codes_SRS_IOTHUBTRANSPORT_44_012: [ The threads added with IoTHubTransport_SetWorkerThreadCount shall only run the work of their clients, the lower layer transport DoWork staying on the worker thread. ]*/
+    while (!stop)
+    {
+        /*the condition is only ever created, never replaced, before IoTHubTransport_Destroy*/
+        COND_HANDLE workCondition = transportData->workCondition;
+
+        if (Lock(shard->clientsLockHandle) != LOCK_OK)
+        {
+            LogError("failed to lock the clients of a worker thread");
+        }
+        else
+        {
+            /*Codes_SRS_IOTHUBTRANSPORT_44_016: [ The threads added with IoTHubTransport_SetWorkerThreadCount shall read whether to stop under the lock of their list of clients, and take the transport lock only to wait for work. ]*/
+            stop = (shard->stopThread != 0);
+            if (!stop)
+            {
+                run_clients_do_work(transportData, shard->clients, &shard->nextClient);
+            }
+            (void)Unlock(shard->clientsLockHandle);
+        }
+
+        if (stop)
+        {
+            /*no wait, the thread exits*/
+        }
+        else if (workCondition == NULL)
+        {
+            ThreadAPI_Sleep(1);
+        }
+        else if (Lock(transportData->lockHandle) != LOCK_OK)
+        {
+            ThreadAPI_Sleep(1);
+        }
+        else
+        {
+            if (!transportData->stopThread && !shard->workSignaled)
+            {
+                (void)Condition_Wait(workCondition, transportData->lockHandle, (int)transportData->idleTimeInMs);
+            }
+            shard->workSignaled = 0;
+            (void)Unlock(transportData->lockHandle);
+        }
     }
 
     ThreadAPI_Exit(0);
     return 0;
 }
 
+/*wakes up the worker thread and every shard thread waiting on the condition; called with the transport lock held*/
+static void post_work_condition(TRANSPORT_HANDLE_DATA* transportData)
+{
+    size_t index;
+
+    /*a shard thread busy with its clients does not miss the signal*/
+    for (index = 0; index < transportData->shardCount; index++)
+    {
+        transportData->shards[index].workSignaled = 1;
+    }
+
+    for (index = 0; index <= transportData->shardCount; index++)
+    {
+        (void)Condition_Post(transportData->workCondition);
+    }
+}
+
+static void start_shard_threads(TRANSPORT_HANDLE_DATA* transportData)
+{
+    size_t index;
+
+    for (index = 0; index < transportData->shardCount; index++)
+    {
+        TRANSPORT_CLIENT_SHARD* shard = &transportData->shards[index];
+
+        if (shard->threadHandle == NULL)
+        {
+            /*the thread is not running yet*/
+            shard->stopThread = 0;
+            if (ThreadAPI_Create(&shard->threadHandle, transport_shard_thread, shard) != THREADAPI_OK)
+            {
+                /*its clients go to the other threads*/
+                LogError("failed starting a worker thread of the transport");
+                shard->threadHandle = NULL;
+            }
+        }
+    }
+}
+
+static void destroy_shards(TRANSPORT_CLIENT_SHARD* shards, size_t shardCount)
+{
+    size_t index;
+
+    for (index = 0; index < shardCount; index++)
+    {
+        VECTOR_destroy(shards[index].clients);
+        Lock_Deinit(shards[index].clientsLockHandle);
+    }
+    free(shards);
+}
+
 static bool find_by_handle(const void* element, const void* value)
 {
     /* data stored at element is device handle */
@@ -218,6 +390,41 @@ static bool find_by_handle(const void* element, const void* value)
     return (*guess == match);
 }
 
+/*called with the clients lock of the worker thread held; returns the shard the client goes to, or NULL if it is already in one*/
+static TRANSPORT_CLIENT_SHARD* find_shard_for_new_client(TRANSPORT_HANDLE_DATA* transportData, IOTHUB_CLIENT_CORE_HANDLE clientHandle, size_t workerClientCount, bool* found)
+{
+    TRANSPORT_CLIENT_SHARD* result = NULL;
+    size_t fewestClients = workerClientCount;
+    size_t index;
+
+    for (index = 0; (index < transportData->shardCount) && !*found; index++)
+    {
+        TRANSPORT_CLIENT_SHARD* shard = &transportData->shards[index];
+
+        if (Lock(shard->clientsLockHandle) != LOCK_OK)
+        {
+            LogError("failed to lock the clients of a worker thread");
+        }
+        else
+        {
+            size_t clientCount = VECTOR_size(shard->clients);
+
+            if ((clientCount != 0) && (VECTOR_find_if(shard->clients, find_by_handle, clientHandle) != NULL))
+            {
+                *found = true;
+            }
+            else if ((shard->threadHandle != NULL) && (clientCount < fewestClients))
+            {
+                fewestClients = clientCount;
+                result = shard;
+            }
+            (void)Unlock(shard->clientsLockHandle);
+        }
+    }
+
+    return result;
+}
+
 static IOTHUB_CLIENT_RESULT start_worker_if_needed(TRANSPORT_HANDLE_DATA * transportData, IOTHUB_CLIENT_CORE_HANDLE clientHandle)
 {
     IOTHUB_CLIENT_RESULT result;
@@ -229,6 +436,10 @@ static IOTHUB_CLIENT_RESULT start_worker_if_needed(TRANSPORT_HANDLE_DATA * trans
         {
             transportData->workerThreadHandle = NULL;
         }
+        else
+        {
+            start_shard_threads(transportData);
+        }
     }
     if (transportData->workerThreadHandle != NULL)
     {
@@ -240,8 +451,37 @@ static IOTHUB_CLIENT_RESULT start_worker_if_needed(TRANSPORT_HANDLE_DATA * trans
         else
         {
             /*Codes_SRS_IOTHUBTRANSPORT_17_020: [ IoTHubTransport_StartWorkerThread shall search for IoTHubClient clientHandle in the list of IoTHubClient handles. ]*/
-            bool addToList = ((VECTOR_size(transportData->clients) == 0) || (VECTOR_find_if(transportData->clients, find_by_handle, clientHandle) == NULL));
-            if (addToList)
+            size_t workerClientCount = VECTOR_size(transportData->clients);
+            bool found = ((workerClientCount != 0) && (VECTOR_find_if(transportData->clients, find_by_handle, clientHandle) != NULL));
+            /*Codes_SRS_IOTHUBTRANSPORT_44_011: [ Once IoTHubTransport_SetWorkerThreadCount is called, a new client shall be added to the list of the running thread serving the fewest clients. ]*/
+            TRANSPORT_CLIENT_SHARD* shard = (transportData->shardCount == 0 || found) ? NULL : find_shard_for_new_client(transportData, clientHandle, workerClientCount, &found);
+
+            if (found)
+            {
+                result = IOTHUB_CLIENT_OK;
+            }
+            else if (shard != NULL)
+            {
+                if (Lock(shard->clientsLockHandle) != LOCK_OK)
+                {
+                    LogError("failed to lock the clients of a worker thread");
+                    result = IOTHUB_CLIENT_ERROR;
+                }
+                else
+                {
+                    if (VECTOR_push_back(shard->clients, &clientHandle, 1) != 0)
+                    {
+                        LogError("Failed adding device to list (VECTOR_push_back failed)");
+                        result = IOTHUB_CLIENT_ERROR;
+                    }
+                    else
+                    {
+                        result = IOTHUB_CLIENT_OK;
+                    }
+                    (void)Unlock(shard->clientsLockHandle);
+                }
+            }
+            else
             {
                 /*Codes_SRS_IOTHUBTRANSPORT_17_021: [ If handle is not found, then clientHandle shall be added to the list. ]*/
                 if (VECTOR_push_back(transportData->clients, &clientHandle, 1) != 0)
@@ -255,10 +495,6 @@ static IOTHUB_CLIENT_RESULT start_worker_if_needed(TRANSPORT_HANDLE_DATA * trans
                     result = IOTHUB_CLIENT_OK;
                 }
             }
-            else
-            {
-                result = IOTHUB_CLIENT_OK;
-            }
 
             if (Unlock(transportData->clientsLockHandle) != LOCK_OK)
             {
@@ -275,6 +511,25 @@ static IOTHUB_CLIENT_RESULT start_worker_if_needed(TRANSPORT_HANDLE_DATA * trans
 
 static void stop_worker_thread(TRANSPORT_HANDLE_DATA* transportData)
 {
+    size_t index;
+
+    /*the shard threads take the transport lock while they hold their own, so theirs is not taken under the transport lock*/
+    for (index = 0; index < transportData->shardCount; index++)
+    {
+        TRANSPORT_CLIENT_SHARD* shard = &transportData->shards[index];
+
+        if (Lock(shard->clientsLockHandle) != LOCK_OK)
+        {
+            LogError("Unable to lock the clients of a worker thread - will still attempt to end it");
+            shard->stopThread = 1;
+        }
+        else
+        {
+            shard->stopThread = 1;
+            (void)Unlock(shard->clientsLockHandle);
+        }
+    }
+
     /*Codes_SRS_IOTHUBTRANSPORT_17_043: [** IoTHubTransport_SignalEndWorkerThread shall signal the worker thread to end.*/
     if (Lock(transportData->lockHandle) != LOCK_OK)
     {
@@ -286,6 +541,10 @@ static void stop_worker_thread(TRANSPORT_HANDLE_DATA* transportData)
     else
     {
         transportData->stopThread = 1;
+        if (transportData->workCondition != NULL)
+        {
+            post_work_condition(transportData);
+        }
         (void)Unlock(transportData->lockHandle);
     }
 
@@ -306,6 +565,64 @@ static void wait_worker_thread(TRANSPORT_HANDLE_DATA * transportData)
             transportData->workerThreadHandle = NULL;
         }
     }
+
+    if (transportData->stopThread)
+    {
+        size_t index;
+
+        for (index = 0; index < transportData->shardCount; index++)
+        {
+            TRANSPORT_CLIENT_SHARD* shard = &transportData->shards[index];
+
+            if (shard->threadHandle != NULL)
+            {
+                int res;
+                if (ThreadAPI_Join(shard->threadHandle, &res) != THREADAPI_OK)
+                {
+                    LogError("ThreadAPI_Join failed");
+                }
+                else
+                {
+                    shard->threadHandle = NULL;
+                }
+            }
+        }
+    }
+}
+
+/*called with the clients lock of the worker thread held; removes clientHandle from the shard serving it and counts the clients left*/
+static size_t remove_client_from_shards(TRANSPORT_HANDLE_DATA* transportData, IOTHUB_CLIENT_CORE_HANDLE clientHandle, bool removed)
+{
+    size_t clientCount = 0;
+    size_t index;
+
+    for (index = 0; index < transportData->shardCount; index++)
+    {
+        TRANSPORT_CLIENT_SHARD* shard = &transportData->shards[index];
+
+        if (Lock(shard->clientsLockHandle) != LOCK_OK)
+        {
+            LogError("failed to lock the clients of a worker thread");
+            /*keeps the threads running*/
+            clientCount++;
+        }
+        else
+        {
+            if (!removed)
+            {
+                void* element = VECTOR_find_if(shard->clients, find_by_handle, clientHandle);
+                if (element != NULL)
+                {
+                    VECTOR_erase(shard->clients, element, 1);
+                    removed = true;
+                }
+            }
+            clientCount += VECTOR_size(shard->clients);
+            (void)Unlock(shard->clientsLockHandle);
+        }
+    }
+
+    return clientCount;
 }
 
 static bool signal_end_worker_thread(TRANSPORT_HANDLE_DATA * transportData, IOTHUB_CLIENT_CORE_HANDLE clientHandle)
@@ -320,15 +637,18 @@ static bool signal_end_worker_thread(TRANSPORT_HANDLE_DATA * transportData, IOTH
     else
     {
         void* element = VECTOR_find_if(transportData->clients, find_by_handle, clientHandle);
+        size_t shardClientCount;
         if (element != NULL)
         {
             /*Codes_SRS_IOTHUBTRANSPORT_17_026: [ IoTHubTransport_EndWorkerThread shall remove clientHandlehandle from handle list. ]*/
             VECTOR_erase(transportData->clients, element, 1);
         }
+        shardClientCount = (transportData->shardCount == 0) ? 0 : remove_client_from_shards(transportData, clientHandle, element != NULL);
         /*Codes_SRS_IOTHUBTRANSPORT_17_025: [ If the worker thread does not exist, then IoTHubTransport_EndWorkerThread shall return. ]*/
         if (transportData->workerThreadHandle != NULL)
         {
-            if (VECTOR_size(transportData->clients) == 0)
+            /*Codes_SRS_IOTHUBTRANSPORT_44_013: [ The worker thread and the threads added with IoTHubTransport_SetWorkerThreadCount shall be stopped once no thread serves any client. ]*/
+            if (shardClientCount == 0 && VECTOR_size(transportData->clients) == 0)
             {
                 stop_worker_thread(transportData);
                 okToJoin = true;
@@ -362,9 +682,17 @@ void IoTHubTransport_Destroy(TRANSPORT_HANDLE transportHandle)
         wait_worker_thread(transportData);
         /*Codes_SRS_IOTHUBTRANSPORT_17_010: [ IoTHubTransport_Destroy shall free all resources. ]*/
         Lock_Deinit(transportData->lockHandle);
+        if (transportData->workCondition != NULL)
+        {
+            Condition_Deinit(transportData->workCondition);
+        }
         (transportData->IoTHubTransport_Destroy)(transportData->transportLLHandle);
         VECTOR_destroy(transportData->clients);
         Lock_Deinit(transportData->clientsLockHandle);
+        if (transportData->shards != NULL)
+        {
+            destroy_shards(transportData->shards, transportData->shardCount);
+        }
         free(transportHandle);
     }
 }
@@ -463,3 +791,145 @@ void IoTHubTransport_JoinWorkerThread(TRANSPORT_HANDLE transportHandle, IOTHUB_C
         wait_worker_thread(transportData);
     }
 }
+
+IOTHUB_CLIENT_RESULT IoTHubTransport_SetWorkerIdleTime(TRANSPORT_HANDLE transportHandle, unsigned int idleTimeInMs)
+{
+    IOTHUB_CLIENT_RESULT result;
+    /*Codes_SRS_IOTHUBTRANSPORT_44_001: [ If transportHandle is NULL or idleTimeInMs is 0, IoTHubTransport_SetWorkerIdleTime shall return IOTHUB_CLIENT_INVALID_ARG. ]*/
+    if (transportHandle == NULL || idleTimeInMs == 0)
+    {
+        LogError("Invalid argument (transportHandle=%p, idleTimeInMs=%u)", transportHandle, idleTimeInMs);
+        result = IOTHUB_CLIENT_INVALID_ARG;
+    }
+    else
+    {
+        TRANSPORT_HANDLE_DATA * transportData = (TRANSPORT_HANDLE_DATA*)transportHandle;
+
+        /*Codes_SRS_IOTHUBTRANSPORT_44_014: [ IoTHubTransport_SetWorkerIdleTime shall hold the transport lock while it changes the idle time, and return IOTHUB_CLIENT_ERROR if it cannot be acquired. ]*/
+        if (Lock(transportData->lockHandle) != LOCK_OK)
+        {
+            LogError("Unable to lock transport");
+            result = IOTHUB_CLIENT_ERROR;
+        }
+        else
+        {
+            /*Codes_SRS_IOTHUBTRANSPORT_44_002: [ IoTHubTransport_SetWorkerIdleTime shall create the condition the worker thread waits on, and return IOTHUB_CLIENT_ERROR if it cannot be created. ]*/
+            if ((transportData->workCondition == NULL) && ((transportData->workCondition = Condition_Init()) == NULL))
+            {
+                LogError("Condition_Init failed");
+                result = IOTHUB_CLIENT_ERROR;
+            }
+            else
+            {
+                /*Codes_SRS_IOTHUBTRANSPORT_44_003: [ IoTHubTransport_SetWorkerIdleTime shall save idleTimeInMs and return IOTHUB_CLIENT_OK. ]*/
+                transportData->idleTimeInMs = idleTimeInMs;
+                result = IOTHUB_CLIENT_OK;
+            }
+            (void)Unlock(transportData->lockHandle);
+        }
+    }
+    return result;
+}
+
+void IoTHubTransport_SignalWork(TRANSPORT_HANDLE transportHandle)
+{
+    /*Codes_SRS_IOTHUBTRANSPORT_44_005: [ If transportHandle is NULL, IoTHubTransport_SignalWork shall return. ]*/
+    if (transportHandle != NULL)
+    {
+        TRANSPORT_HANDLE_DATA * transportData = (TRANSPORT_HANDLE_DATA*)transportHandle;
+
+        /*Codes_SRS_IOTHUBTRANSPORT_44_015: [ IoTHubTransport_SignalWork shall hold the transport lock while it signals the worker thread, so the signal cannot be lost between the worker thread checking for work and starting to wait. ]*/
+        if (Lock(transportData->lockHandle) != LOCK_OK)
+        {
+            LogError("Unable to lock transport");
+        }
+        else
+        {
+            /*Codes_SRS_IOTHUBTRANSPORT_44_006: [ IoTHubTransport_SignalWork shall wake up the worker thread if it is waiting for the idle time. ]*/
+            if (transportData->workCondition != NULL)
+            {
+                transportData->workSignaled = 1;
+                post_work_condition(transportData);
+            }
+            (void)Unlock(transportData->lockHandle);
+        }
+    }
+}
+
+IOTHUB_CLIENT_RESULT IoTHubTransport_SetWorkerThreadCount(TRANSPORT_HANDLE transportHandle, size_t threadCount)
+{
+    IOTHUB_CLIENT_RESULT result;
+    /*Codes_SRS_IOTHUBTRANSPORT_44_008: [ If transportHandle is NULL, or threadCount is 0 or greater than 64, IoTHubTransport_SetWorkerThreadCount shall return IOTHUB_CLIENT_INVALID_ARG. ]*/
+    if (transportHandle == NULL || threadCount == 0 || threadCount > TRANSPORT_WORKER_THREADS_MAX)
+    {
+        LogError("Invalid argument (transportHandle=%p, threadCount=%lu)", transportHandle, (unsigned long)threadCount);
+        result = IOTHUB_CLIENT_INVALID_ARG;
+    }
+    else
+    {
+        TRANSPORT_HANDLE_DATA * transportData = (TRANSPORT_HANDLE_DATA*)transportHandle;
+
+        if (threadCount == transportData->shardCount + 1)
+        {
+            result = IOTHUB_CLIENT_OK;
+        }
+        /*Codes_SRS_IOTHUBTRANSPORT_44_009: [ If the worker thread is running, IoTHubTransport_SetWorkerThreadCount shall return IOTHUB_CLIENT_ERROR unless threadCount is the current number of threads. ]*/
+        else if (transportData->workerThreadHandle != NULL)
+        {
+            LogError("The number of worker threads cannot change while they are running");
+            result = IOTHUB_CLIENT_ERROR;
+        }
+        else
+        {
+            TRANSPORT_CLIENT_SHARD* shards = NULL;
+            size_t shardCount = threadCount - 1;
+            size_t index = 0;
+
+            /*Codes_SRS_IOTHUBTRANSPORT_44_010: [ IoTHubTransport_SetWorkerThreadCount shall create a list of clients and a lock for each thread but the worker thread, and return IOTHUB_CLIENT_ERROR if any cannot be created. ]*/
+            if ((shardCount != 0) && ((shards = (TRANSPORT_CLIENT_SHARD*)malloc(shardCount * sizeof(TRANSPORT_CLIENT_SHARD))) == NULL))
+            {
+                LogError("Failed allocating the worker threads");
+                result = IOTHUB_CLIENT_ERROR;
+            }
+            else
+            {
+                for (index = 0; index < shardCount; index++)
+                {
+                    shards[index].transportData = transportData;
+                    shards[index].threadHandle = NULL;
+                    shards[index].nextClient = 0;
+                    shards[index].stopThread = 0;
+                    shards[index].workSignaled = 0;
+                    if ((shards[index].clientsLockHandle = Lock_Init()) == NULL)
+                    {
+                        break;
+                    }
+                    else if ((shards[index].clients = VECTOR_create(sizeof(IOTHUB_CLIENT_CORE_HANDLE))) == NULL)
+                    {
+                        Lock_Deinit(shards[index].clientsLockHandle);
+                        break;
+                    }
+                }
+
+                if (index < shardCount)
+                {
+                    LogError("Failed creating the clients of a worker thread");
+                    destroy_shards(shards, index);
+                    result = IOTHUB_CLIENT_ERROR;
+                }
+                else
+                {
+                    /*the threads are stopped, so the shards being replaced serve no client*/
+                    if (transportData->shards != NULL)
+                    {
+                        destroy_shards(transportData->shards, transportData->shardCount);
+                    }
+                    transportData->shards = shards;
+                    transportData->shardCount = shardCount;
+                    result = IOTHUB_CLIENT_OK;
+                }
+            }
+        }
+    }
+    return result;
+}
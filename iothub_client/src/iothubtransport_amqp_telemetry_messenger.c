@@ -74,6 +74,8 @@ typedef struct TELEMETRY_MESSENGER_INSTANCE_TAG
     size_t event_send_timeout_secs;
     time_t last_message_sender_state_change_time;
     time_t last_message_receiver_state_change_time;
+
+    UAMQP_ENCODING_BUFFER encoding_buffer;     // Reused by send_pending_events to encode each event before it is added to the batch
 } TELEMETRY_MESSENGER_INSTANCE;
 
 // MESSENGER_SEND_EVENT_CALLER_INFORMATION corresponds to a message sent from the API, including
@@ -1172,6 +1174,8 @@ static int get_max_message_size_for_batching(TELEMETRY_MESSENGER_INSTANCE* insta
     else
     {
         *max_messagesize -= AMQP_BATCHING_RESERVE_SIZE;
+        // A single event can never be sent in a batch larger than this, so there's no point in growing the encoding buffer past it.
+        instance->encoding_buffer.max_capacity = (*max_messagesize > SIZE_MAX) ? SIZE_MAX : (size_t)(*max_messagesize);
         result = 0;
     }
 
@@ -1196,11 +1200,7 @@ static int send_pending_events(TELEMETRY_MESSENGER_INSTANCE* instance)
     // Codes_SRS_IOTHUBTRANSPORT_AMQP_MESSENGER_31_199: [Errors specific to a message (e.g. failure to encode) are NOT fatal but we'll keep processing.  More general errors (e.g. out of memory) will stop processing.]
     while ((caller_info = get_next_caller_message_to_send(instance)) != NULL)
     {
-        if (body_binary_data.bytes != NULL)
-        {
-            // Free here as this may have been set during previous run through loop.
-            free((unsigned char*)body_binary_data.bytes);
-        }
+        // body_binary_data points into instance->encoding_buffer, which is owned by the instance and not freed here.
         memset(&body_binary_data, 0, sizeof(body_binary_data));
 
         if ((0 == max_messagesize) && (get_max_message_size_for_batching(instance, &max_messagesize)) != 0)
@@ -1220,10 +1220,11 @@ static int send_pending_events(TELEMETRY_MESSENGER_INSTANCE* instance)
             break;
         }
         // Codes_SRS_IOTHUBTRANSPORT_AMQP_MESSENGER_31_200: [Retrieve an AMQP encoded representation of this message for later appending to main batched message.  On error, invoke callback but continue send loop; this is NOT a fatal error.]
-        else if (message_create_uamqp_encoding_from_iothub_message(send_pending_events_state.message_batch_container, caller_info->message->messageHandle, &body_binary_data) != RESULT_OK)
+        // Codes_SRS_IOTHUBTRANSPORT_AMQP_MESSENGER_44_001: [Each message shall be encoded with message_create_uamqp_encoding_from_iothub_message_into_buffer() into `instance->encoding_buffer`, whose `max_capacity` is the maximum message size for batching.]
+        else if (message_create_uamqp_encoding_from_iothub_message_into_buffer(send_pending_events_state.message_batch_container, caller_info->message->messageHandle, &instance->encoding_buffer, &body_binary_data) != RESULT_OK)
         {
             // Codes_SRS_IOTHUBTRANSPORT_AMQP_MESSENGER_31_201: [If message_create_uamqp_encoding_from_iothub_message fails, invoke callback with TELEMETRY_MESSENGER_EVENT_SEND_COMPLETE_RESULT_ERROR_CANNOT_PARSE]
-            LogError("message_create_uamqp_encoding_from_iothub_message() failed.  Will continue to try to process messages, result");
+            LogError("message_create_uamqp_encoding_from_iothub_message_into_buffer() failed.  Will continue to try to process messages, result");
             invoke_callback_on_error(caller_info, TELEMETRY_MESSENGER_EVENT_SEND_COMPLETE_RESULT_ERROR_CANNOT_PARSE);
             free(caller_info);
             continue;
@@ -1289,11 +1290,6 @@ static int send_pending_events(TELEMETRY_MESSENGER_INSTANCE* instance)
         }
     }
 
-    if (body_binary_data.bytes != NULL)
-    {
-        free((unsigned char*)body_binary_data.bytes);
-    }
-
     // A non-NULL task indicates error, since otherwise send_batched_message_and_reset_state would've sent off messages and reset send_pending_events_state
     if (send_pending_events_state.task != NULL)
     {
@@ -1962,6 +1958,12 @@ void telemetry_messenger_destroy(TELEMETRY_MESSENGER_HANDLE messenger_handle)
 
         STRING_delete(instance->module_id);
 
+        // Codes_SRS_IOTHUBTRANSPORT_AMQP_MESSENGER_44_002: [`instance->encoding_buffer.bytes` shall be destroyed using free(), if it was ever allocated]
+        if (instance->encoding_buffer.bytes != NULL)
+        {
+            free(instance->encoding_buffer.bytes);
+        }
+
         // Codes_SRS_IOTHUBTRANSPORT_AMQP_MESSENGER_09_114: [telemetry_messenger_destroy() shall destroy `instance` with free()]
         (void)free(instance);
     }
@@ -26,6 +26,9 @@
 #include "internal/iothubtransport_mqtt_common.h"
 #include "internal/iothubtransport.h"
 #include "internal/iothub_internal_consts.h"
+#include "internal/timeout_heap.h"
+#include "internal/packet_id_table.h"
+#include "internal/mqtt_topic_trie.h"
 
 #include "azure_umqtt_c/mqtt_client.h"
 
@@ -45,7 +48,12 @@
 #define BUILD_CONFIG_USERNAME               24
 #define SAS_TOKEN_DEFAULT_LEN               10
 #define RESEND_TIMEOUT_VALUE_MIN            1*60
+#define RESEND_TIMEOUT_MS                   ((RESEND_TIMEOUT_VALUE_MIN + 1) * 1000)
 #define MAX_SEND_RECOUNT_LIMIT              2
+// A message is only given up on once it has waited this long, however quickly it was resent.
+#define MESSAGE_ACK_DEADLINE_MS             (MAX_SEND_RECOUNT_LIMIT * RESEND_TIMEOUT_MS)
+#define RESEND_TIMEOUT_MIN_MS               1000
+#define RESEND_TIMEOUT_MAX_MS               (4 * RESEND_TIMEOUT_MS)
 #define DEFAULT_CONNECTION_INTERVAL         30
 #define FAILED_CONN_BACKOFF_VALUE           5
 #define STATUS_CODE_FAILURE_VALUE           500
@@ -60,6 +68,7 @@
 
 static const char TOPIC_DEVICE_TWIN_PREFIX[] = "$iothub/twin";
 static const char TOPIC_DEVICE_METHOD_PREFIX[] = "$iothub/methods";
+static const char TOPIC_LEVEL_PATCH[] = "PATCH";
 
 static const char* TOPIC_GET_DESIRED_STATE = "$iothub/twin/res/#";
 static const char* TOPIC_NOTIFICATION_STATE = "$iothub/twin/PATCH/properties/desired/#";
@@ -79,6 +88,7 @@ static const char* GET_PROPERTIES_TOPIC = "$iothub/twin/GET/?$rid=%"PRIu16;
 static const char* DEVICE_METHOD_RESPONSE_TOPIC = "$iothub/methods/res/%d/?$rid=%s";
 
 static const char* REQUEST_ID_PROPERTY = "?$rid=";
+static const char* VERSION_PROPERTY = "?$version=";
 
 static const char* MESSAGE_ID_PROPERTY = "mid";
 static const char* CORRELATION_ID_PROPERTY = "cid";
@@ -93,9 +103,10 @@ static const char* DIAGNOSTIC_CONTEXT_CREATION_TIME_UTC_PROPERTY = "creationtime
 
 static const char DT_MODEL_ID_TOKEN[] = "digital-twin-model-id";
 
-static const char DEFAULT_IOTHUB_PRODUCT_IDENTIFIER[] = CLIENT_DEVICE_TYPE_PREFIX "/" IOTHUB_SDK_VERSION;
+#define TELEMETRY_TOPIC_INITIAL_SIZE    256
+#define URL_ENCODED_STRING_CACHE_SIZE   16
 
-#define TOLOWER(c) (((c>='A') && (c<='Z'))?c-'A'+'a':c)
+static const char DEFAULT_IOTHUB_PRODUCT_IDENTIFIER[] = CLIENT_DEVICE_TYPE_PREFIX "/" IOTHUB_SDK_VERSION;
 
 #define UNSUBSCRIBE_FROM_TOPIC                  0x0000
 #define SUBSCRIBE_GET_REPORTED_STATE_TOPIC      0x0001
@@ -129,8 +140,6 @@ static SYSTEM_PROPERTY_INFO sysPropList[] = {
     { "%24.cmid", 8 }
 };
 
-static const int slashes_to_reach_input_name = 5;
-
 typedef enum DEVICE_TWIN_MSG_TYPE_TAG
 {
     REPORTED_STATE,
@@ -154,6 +163,12 @@ typedef enum MQTT_CLIENT_STATUS_TAG
     MQTT_CLIENT_STATUS_EXECUTE_DISCONNECT
 } MQTT_CLIENT_STATUS;
 
+typedef struct URL_ENCODED_STRING_TAG
+{
+    char* text;
+    char* encoded_text;
+} URL_ENCODED_STRING;
+
 typedef struct MQTTTRANSPORT_HANDLE_DATA_TAG
 {
     // Topic control
@@ -166,6 +181,10 @@ typedef struct MQTTTRANSPORT_HANDLE_DATA_TAG
     STRING_HANDLE topic_DeviceMethods;
 
     uint32_t topics_ToSubscribe;
+    // Topics the broker keeps subscribed in the session, and those waiting for the SUBACK of subscribe_packet_id.
+    uint32_t topics_Subscribed;
+    uint32_t topics_Subscribing;
+    uint16_t subscribe_packet_id;
 
     // Connection related constants
     STRING_HANDLE hostAddress;
@@ -203,6 +222,12 @@ typedef struct MQTTTRANSPORT_HANDLE_DATA_TAG
     bool device_twin_get_sent;
     bool twin_resp_sub_recv;
     bool isRecoverableError;
+    // Rely on the session kept by the broker across connections.
+    bool persistent_session;
+    // $version of the last desired properties patch received, 0 if unknown.
+    size_t desired_version;
+    // The full twin was received in the current session.
+    bool session_twin_received;
     uint16_t keepAliveValue;
     uint16_t connect_timeout_in_sec;
     tickcounter_ms_t mqtt_connect_time;
@@ -216,16 +241,47 @@ typedef struct MQTTTRANSPORT_HANDLE_DATA_TAG
     // Internal lists for message tracking
     PDLIST_ENTRY waitingToSend;
     DLIST_ENTRY ack_waiting_queue;
+    PACKET_ID_TABLE ack_waiting_queue_by_packet_id;
 
     DLIST_ENTRY pending_get_twin_queue;
+    // Twin requests, either pending or waiting for their response, by the time they expire.
+    TIMEOUT_HEAP twin_request_timeouts;
 
     // Message tracking
     CONTROL_PACKET_TYPE currPacketState;
 
     // Telemetry specific
     DLIST_ENTRY telemetry_waitingForAck;
+    PACKET_ID_TABLE telemetry_waitingForAck_by_packet_id;
+    TIMEOUT_HEAP telemetry_ack_timeouts;
     bool auto_url_encode_decode;
 
+    // Telemetry topics are built after a copy of topic_MqttEvent kept at the start of this buffer.
+    char* telemetry_topic;
+    size_t telemetry_topic_size;
+    size_t telemetry_topic_length;
+    size_t telemetry_topic_prefix_length;
+    // Property names and values sent on most messages, already URL encoded.
+    URL_ENCODED_STRING url_encoded_strings[URL_ENCODED_STRING_CACHE_SIZE];
+    size_t next_url_encoded_string;
+    // Telemetry flow control, 0 meaning no limit.
+    size_t max_inflight;
+    size_t publish_budget_messages;
+    size_t publish_budget_bytes;
+    // Publish telemetry with QoS 0, without tracking it for acknowledgement.
+    bool telemetry_at_most_once;
+    // PUBLISH to PUBACK round trip time of the current connection, smoothed as in RFC 6298.
+    tickcounter_ms_t smoothed_rtt_ms;
+    tickcounter_ms_t rtt_variance_ms;
+    size_t rtt_sample_count;
+    tickcounter_ms_t resend_timeout_ms;
+
+    // Classifies received topics by the prefixes of the topics subscribed to.
+    MQTT_TOPIC_TRIE inbound_topics;
+    // Input names of received messages are NULL-terminated here, growing to the longest one received.
+    char* input_name;
+    size_t input_name_size;
+
     // Controls frequency of reconnection logic.
     RETRY_CONTROL_HANDLE retry_control_handle;
 
@@ -254,18 +310,23 @@ typedef struct MQTT_DEVICE_TWIN_ITEM_TAG
     IOTHUB_DEVICE_TWIN* device_twin_data;
     DEVICE_TWIN_MSG_TYPE device_twin_msg_type;
     DLIST_ENTRY entry;
+    TIMEOUT_HEAP_ENTRY request_timeout;
     IOTHUB_CLIENT_DEVICE_TWIN_CALLBACK userCallback;
     void* userContext;
 } MQTT_DEVICE_TWIN_ITEM;
 
 typedef struct MQTT_MESSAGE_DETAILS_LIST_TAG
 {
+    tickcounter_ms_t msgFirstPublishTime;
     tickcounter_ms_t msgPublishTime;
     size_t retryCount;
     IOTHUB_MESSAGE_LIST* iotHubMessageEntry;
+    // The telemetry topic the message is published to, stored right after this structure.
+    char* topic;
     void* context;
     uint16_t packet_id;
     DLIST_ENTRY entry;
+    TIMEOUT_HEAP_ENTRY ack_timeout;
 } MQTT_MESSAGE_DETAILS_LIST, *PMQTT_MESSAGE_DETAILS_LIST;
 
 typedef struct DEVICE_METHOD_INFO_TAG
@@ -273,6 +334,21 @@ typedef struct DEVICE_METHOD_INFO_TAG
     STRING_HANDLE request_id;
 } DEVICE_METHOD_INFO;
 
+typedef struct INBOUND_TOPIC_INFO_TAG
+{
+    IOTHUB_IDENTITY_TYPE type;
+    // Device twin responses and patches.
+    bool patch_msg;
+    int status_code;
+    size_t request_id;
+    size_t version;
+    // Method name or input name, and method request id: parts of the topic, not NULL-terminated.
+    const char* name;
+    size_t name_length;
+    const char* method_request_id;
+    size_t method_request_id_length;
+} INBOUND_TOPIC_INFO;
+
 static void free_proxy_data(MQTTTRANSPORT_HANDLE_DATA* mqtt_transport_instance)
 {
     if (mqtt_transport_instance->http_proxy_hostname != NULL)
@@ -310,8 +386,32 @@ static void set_saved_tls_options(PMQTTTRANSPORT_HANDLE_DATA transport, OPTIONHA
     transport->saved_tls_options = new_options;
 }
 
+static void free_telemetry_topic_data(MQTTTRANSPORT_HANDLE_DATA* transport_data)
+{
+    size_t index;
+
+    if (transport_data->telemetry_topic != NULL)
+    {
+        free(transport_data->telemetry_topic);
+        transport_data->telemetry_topic = NULL;
+    }
+
+    for (index = 0; index < URL_ENCODED_STRING_CACHE_SIZE; index++)
+    {
+        if (transport_data->url_encoded_strings[index].text != NULL)
+        {
+            // encoded_text lives in the same allocation as text.
+            free(transport_data->url_encoded_strings[index].text);
+            transport_data->url_encoded_strings[index].text = NULL;
+            transport_data->url_encoded_strings[index].encoded_text = NULL;
+        }
+    }
+}
+
 static void free_transport_handle_data(MQTTTRANSPORT_HANDLE_DATA* transport_data)
 {
+    free_telemetry_topic_data(transport_data);
+
     if (transport_data->mqttClient != NULL)
     {
         mqtt_client_deinit(transport_data->mqttClient);
@@ -339,6 +439,7 @@ static void free_transport_handle_data(MQTTTRANSPORT_HANDLE_DATA* transport_data
     STRING_delete(transport_data->topic_NotifyState);
     STRING_delete(transport_data->topic_DeviceMethods);
     STRING_delete(transport_data->topic_InputQueue);
+    free(transport_data->input_name);
 
     DestroyXioTransport(transport_data);
 
@@ -395,6 +496,29 @@ static uint16_t get_next_packet_id(PMQTTTRANSPORT_HANDLE_DATA transport_data)
     return transport_data->packetId;
 }
 
+// Codes_SRS_IOTHUB_TRANSPORT_MQTT_COMMON_44_031: [ When the packet id wraps around onto ids still in use, the next id not in use shall be taken, failing only when every packet id is in use. ]
+static int get_next_free_packet_id(PMQTTTRANSPORT_HANDLE_DATA transport_data, PACKET_ID_TABLE* in_use, uint16_t* packet_id)
+{
+    int result;
+
+    // get_next_packet_id hands out 1 to USHRT_MAX - 1.
+    if (in_use->count >= USHRT_MAX - 1)
+    {
+        LogError("All %lu packet ids are in use", (unsigned long)in_use->count);
+        result = MU_FAILURE;
+    }
+    else
+    {
+        do
+        {
+            *packet_id = get_next_packet_id(transport_data);
+        } while (packet_id_table_find(in_use, *packet_id) != NULL);
+        result = 0;
+    }
+
+    return result;
+}
+
 #ifndef NO_LOGGING
 static const char* retrieve_mqtt_return_codes(CONNECT_RETURN_CODE rtn_code)
 {
@@ -419,182 +543,182 @@ static const char* retrieve_mqtt_return_codes(CONNECT_RETURN_CODE rtn_code)
 }
 #endif // NO_LOGGING
 
-static int retrieve_device_method_rid_info(const char* resp_topic, STRING_HANDLE method_name, STRING_HANDLE request_id)
+// Finds the next level of a topic, skipping any empty level before it.
+static const char* get_next_topic_level(const char** cursor, size_t* level_length)
+{
+    const char* level;
+
+    while (**cursor == '/')
+    {
+        (*cursor)++;
+    }
+
+    level = *cursor;
+    while (**cursor != '\0' && **cursor != '/')
+    {
+        (*cursor)++;
+    }
+
+    *level_length = (size_t)(*cursor - level);
+    return (*level_length == 0) ? NULL : level;
+}
+
+static size_t parse_topic_number(const char* text)
+{
+    size_t result = 0;
+
+    while (*text >= '0' && *text <= '9')
+    {
+        result = (result * 10) + (size_t)(*text - '0');
+        text++;
+    }
+
+    return result;
+}
+
+// cursor follows the $iothub/twin prefix of $iothub/twin/PATCH/properties/desired/?$version={version}
+// or $iothub/twin/res/{status}/?$rid={request id}.
+static int parse_device_twin_topic(const char* cursor, INBOUND_TOPIC_INFO* topic_info)
 {
     int result;
+    size_t level_length;
+    const char* level = get_next_topic_level(&cursor, &level_length);
 
-    STRING_TOKENIZER_HANDLE token_handle = STRING_TOKENIZER_create_from_char(resp_topic);
-    if (token_handle == NULL)
+    if (level == NULL)
     {
-        LogError("Failed creating token from device twin topic.");
+        LogError("Failure: device twin topic has no message type");
+        result = MU_FAILURE;
+    }
+    else if (level_length == sizeof(TOPIC_LEVEL_PATCH) - 1 && memcmp(level, TOPIC_LEVEL_PATCH, level_length) == 0)
+    {
+        const char* version = strstr(cursor, VERSION_PROPERTY);
+
+        topic_info->patch_msg = true;
+        topic_info->version = (version == NULL) ? 0 : parse_topic_number(version + strlen(VERSION_PROPERTY));
+        result = 0;
+    }
+    else if ((level = get_next_topic_level(&cursor, &level_length)) == NULL)
+    {
+        LogError("Failure: device twin topic has no status code");
         result = MU_FAILURE;
     }
     else
     {
-        STRING_HANDLE token_value;
-        if ((token_value = STRING_new()) == NULL)
-        {
-            LogError("Failed allocating new string .");
-            result = MU_FAILURE;
-        }
-        else
-        {
-            size_t token_index = 0;
-            size_t request_id_length = strlen(REQUEST_ID_PROPERTY);
-            result = MU_FAILURE;
-            while (STRING_TOKENIZER_get_next_token(token_handle, token_value, "/") == 0)
-            {
-                if (token_index == 3)
-                {
-                    if (STRING_concat_with_STRING(method_name, token_value) != 0)
-                    {
-                        LogError("Failed STRING_concat_with_STRING.");
-                        result = MU_FAILURE;
-                        break;
-                    }
-                }
-                else if (token_index == 4)
-                {
-                    if (STRING_length(token_value) >= request_id_length)
-                    {
-                        const char* request_id_value = STRING_c_str(token_value);
-                        if (memcmp(request_id_value, REQUEST_ID_PROPERTY, request_id_length) == 0)
-                        {
-                            if (STRING_concat(request_id, request_id_value + request_id_length) != 0)
-                            {
-                                LogError("Failed STRING_concat failed.");
-                                result = MU_FAILURE;
-                            }
-                            else
-                            {
-                                result = 0;
-                            }
-                            break;
-                        }
-                    }
-                }
-                token_index++;
-            }
-            STRING_delete(token_value);
-        }
-        STRING_TOKENIZER_destroy(token_handle);
+        const char* request_id = strstr(cursor, REQUEST_ID_PROPERTY);
+
+        topic_info->status_code = (int)parse_topic_number(level);
+        topic_info->request_id = (request_id == NULL) ? 0 : parse_topic_number(request_id + strlen(REQUEST_ID_PROPERTY));
+        result = 0;
     }
 
     return result;
 }
 
-static int parse_device_twin_topic_info(const char* resp_topic, bool* patch_msg, size_t* request_id, int* status_code)
+// cursor follows the $iothub/methods prefix of $iothub/methods/POST/{method name}/?$rid={request id}.
+static int parse_device_method_topic(const char* cursor, INBOUND_TOPIC_INFO* topic_info)
 {
     int result;
-    STRING_TOKENIZER_HANDLE token_handle = STRING_TOKENIZER_create_from_char(resp_topic);
-    if (token_handle == NULL)
+    size_t request_id_property_length = strlen(REQUEST_ID_PROPERTY);
+    size_t level_length;
+    const char* level;
+
+    if (get_next_topic_level(&cursor, &level_length) == NULL ||
+        (topic_info->name = get_next_topic_level(&cursor, &topic_info->name_length)) == NULL ||
+        (level = get_next_topic_level(&cursor, &level_length)) == NULL ||
+        level_length < request_id_property_length ||
+        memcmp(level, REQUEST_ID_PROPERTY, request_id_property_length) != 0)
     {
-        LogError("Failed creating token from device twin topic.");
+        LogError("Failure: device method topic has no method name or request id");
         result = MU_FAILURE;
-        *status_code = 0;
-        *request_id = 0;
-        *patch_msg = false;
     }
     else
     {
-        STRING_HANDLE token_value;
-        if ((token_value = STRING_new()) == NULL)
-        {
-            LogError("Failed allocating new string .");
-            result = MU_FAILURE;
-            *status_code = 0;
-            *request_id = 0;
-            *patch_msg = false;
-        }
-        else
-        {
-            result = MU_FAILURE;
-            size_t token_count = 0;
-            while (STRING_TOKENIZER_get_next_token(token_handle, token_value, "/") == 0)
-            {
-                if (token_count == 2)
-                {
-                    if (strcmp(STRING_c_str(token_value), "PATCH") == 0)
-                    {
-                        *patch_msg = true;
-                        *status_code = 0;
-                        *request_id = 0;
-                        result = 0;
-                        break;
-                    }
-                    else
-                    {
-                        *patch_msg = false;
-                    }
-                }
-                else if (token_count == 3)
-                {
-                    *status_code = (int)atol(STRING_c_str(token_value));
-                    if (STRING_TOKENIZER_get_next_token(token_handle, token_value, "/?$rid=") == 0)
-                    {
-                        *request_id = (size_t)atol(STRING_c_str(token_value));
-                    }
-                    *patch_msg = false;
-                    result = 0;
-                    break;
-                }
-                token_count++;
-            }
-            STRING_delete(token_value);
-        }
-        STRING_TOKENIZER_destroy(token_handle);
+        topic_info->method_request_id = level + request_id_property_length;
+        topic_info->method_request_id_length = level_length - request_id_property_length;
+        result = 0;
     }
+
     return result;
 }
 
-static int InternStrnicmp(const char* s1, const char* s2, size_t n)
+// cursor follows the devices/{device id}/modules/{module id}/ prefix of
+// devices/{device id}/modules/{module id}/inputs/{input name}/{properties}.
+static int parse_input_queue_topic(const char* cursor, INBOUND_TOPIC_INFO* topic_info)
 {
     int result;
+    size_t level_length;
 
-    if (s1 == NULL) result = -1;
-    else if (s2 == NULL) result = 1;
+    if (get_next_topic_level(&cursor, &level_length) == NULL ||
+        (topic_info->name = get_next_topic_level(&cursor, &topic_info->name_length)) == NULL)
+    {
+        // Codes_SRS_IOTHUB_TRANSPORT_MQTT_COMMON_31_062: [ If IoTHubTransport_MQTT_Common_DoWork receives a malformatted inputQueue, it shall fail ]
+        LogError("Not enough '/' to contain input name");
+        result = MU_FAILURE;
+    }
     else
     {
         result = 0;
-
-        while (n-- && result == 0)
-        {
-            if (*s1 == 0) result = -1;
-            else if (*s2 == 0) result = 1;
-            else
-            {
-
-                result = TOLOWER(*s1) - TOLOWER(*s2);
-                ++s1;
-                ++s2;
-            }
-        }
     }
+
     return result;
 }
 
-static IOTHUB_IDENTITY_TYPE retrieve_topic_type(const char* topic_resp, const char* input_queue)
+static int parse_inbound_topic(PMQTTTRANSPORT_HANDLE_DATA transport_data, const char* topic, INBOUND_TOPIC_INFO* topic_info)
 {
-    IOTHUB_IDENTITY_TYPE type;
-    if (InternStrnicmp(topic_resp, TOPIC_DEVICE_TWIN_PREFIX, sizeof(TOPIC_DEVICE_TWIN_PREFIX) - 1) == 0)
-    {
-        type = IOTHUB_TYPE_DEVICE_TWIN;
-    }
-    else if (InternStrnicmp(topic_resp, TOPIC_DEVICE_METHOD_PREFIX, sizeof(TOPIC_DEVICE_METHOD_PREFIX) - 1) == 0)
+    int result;
+    size_t prefix_length;
+
+    (void)memset(topic_info, 0, sizeof(INBOUND_TOPIC_INFO));
+
+    // Codes_SRS_IOTHUB_TRANSPORT_MQTT_COMMON_44_022: [ `mqtt_notification_callback` shall classify the received topic with the prefix trie and, in the same pass over the topic and without allocating memory, parse the status code and request id of twin responses, the method name and request id of method requests and the input name of input queue messages. ]
+    topic_info->type = (IOTHUB_IDENTITY_TYPE)mqtt_topic_trie_match(&transport_data->inbound_topics, topic, &prefix_length);
+    switch (topic_info->type)
     {
-        type = IOTHUB_TYPE_DEVICE_METHODS;
+        case IOTHUB_TYPE_DEVICE_TWIN:
+            result = parse_device_twin_topic(topic + prefix_length, topic_info);
+            break;
+        case IOTHUB_TYPE_DEVICE_METHODS:
+            result = parse_device_method_topic(topic + prefix_length, topic_info);
+            break;
+        case IOTHUB_TYPE_EVENT_QUEUE:
+            result = parse_input_queue_topic(topic + prefix_length, topic_info);
+            break;
+        default:
+            result = 0;
+            break;
     }
-    // input_queue contains additional "#" from subscribe, which we strip off on comparing incoming.
-    else if ((input_queue != NULL) && InternStrnicmp(topic_resp, input_queue, strlen(input_queue) - 1) == 0)
+
+    return result;
+}
+
+static void initialize_inbound_topics(PMQTTTRANSPORT_HANDLE_DATA transport_data)
+{
+    // The trie has room for many more prefixes, so these cannot fail.
+    mqtt_topic_trie_initialize(&transport_data->inbound_topics);
+    (void)mqtt_topic_trie_add(&transport_data->inbound_topics, "", 0, IOTHUB_TYPE_TELEMETRY);
+    (void)mqtt_topic_trie_add(&transport_data->inbound_topics, TOPIC_DEVICE_TWIN_PREFIX, sizeof(TOPIC_DEVICE_TWIN_PREFIX) - 1, IOTHUB_TYPE_DEVICE_TWIN);
+    (void)mqtt_topic_trie_add(&transport_data->inbound_topics, TOPIC_DEVICE_METHOD_PREFIX, sizeof(TOPIC_DEVICE_METHOD_PREFIX) - 1, IOTHUB_TYPE_DEVICE_METHODS);
+}
+
+static int add_input_queue_to_inbound_topics(PMQTTTRANSPORT_HANDLE_DATA transport_data)
+{
+    int result;
+    const char* input_queue = STRING_c_str(transport_data->topic_InputQueue);
+    size_t input_queue_length = (input_queue == NULL) ? 0 : strlen(input_queue);
+
+    // The trie points into topic_InputQueue, which is only deleted along with the trie entry or the transport.
+    // The subscribed topic ends with "#", which received topics do not have.
+    if (input_queue_length == 0)
     {
-        type = IOTHUB_TYPE_EVENT_QUEUE;
+        LogError("Input queue topic is empty");
+        result = MU_FAILURE;
     }
     else
     {
-        type = IOTHUB_TYPE_TELEMETRY;
+        result = mqtt_topic_trie_add(&transport_data->inbound_topics, input_queue, input_queue_length - 1, IOTHUB_TYPE_EVENT_QUEUE);
     }
-    return type;
 
+    return result;
 }
 
 static void sendMsgComplete(IOTHUB_MESSAGE_LIST* iothubMsgList, PMQTTTRANSPORT_HANDLE_DATA transport_data, IOTHUB_CLIENT_CONFIRMATION_RESULT confirmResult)
@@ -605,7 +729,122 @@ static void sendMsgComplete(IOTHUB_MESSAGE_LIST* iothubMsgList, PMQTTTRANSPORT_H
     transport_data->transport_callbacks.send_complete_cb(&messageCompleted, confirmResult, transport_data->transport_ctx);
 }
 
-static int addUserPropertiesTouMqttMessage(IOTHUB_MESSAGE_HANDLE iothub_message_handle, STRING_HANDLE topic_string, size_t* index_ptr, bool urlencode)
+static int append_to_telemetry_topic(PMQTTTRANSPORT_HANDLE_DATA transport_data, const char* text)
+{
+    int result;
+    size_t text_length = strlen(text);
+    size_t required_size = transport_data->telemetry_topic_length + text_length + 1;
+
+    if (required_size > transport_data->telemetry_topic_size)
+    {
+        size_t new_size = transport_data->telemetry_topic_size * 2;
+        char* new_topic;
+
+        if (new_size < required_size)
+        {
+            new_size = required_size;
+        }
+
+        if ((new_topic = (char*)realloc(transport_data->telemetry_topic, new_size)) == NULL)
+        {
+            LogError("Failed growing the telemetry topic to %lu bytes", (unsigned long)new_size);
+            result = MU_FAILURE;
+        }
+        else
+        {
+            transport_data->telemetry_topic = new_topic;
+            transport_data->telemetry_topic_size = new_size;
+            result = 0;
+        }
+    }
+    else
+    {
+        result = 0;
+    }
+
+    if (result == 0)
+    {
+        (void)memcpy(transport_data->telemetry_topic + transport_data->telemetry_topic_length, text, text_length + 1);
+        transport_data->telemetry_topic_length += text_length;
+    }
+
+    return result;
+}
+
+static int append_property_to_telemetry_topic(PMQTTTRANSPORT_HANDLE_DATA transport_data, size_t index, const char* key_prefix, const char* key, const char* value)
+{
+    int result;
+
+    if ((index != 0 && append_to_telemetry_topic(transport_data, PROPERTY_SEPARATOR) != 0) ||
+        append_to_telemetry_topic(transport_data, key_prefix) != 0 ||
+        append_to_telemetry_topic(transport_data, key) != 0 ||
+        append_to_telemetry_topic(transport_data, "=") != 0 ||
+        append_to_telemetry_topic(transport_data, value) != 0)
+    {
+        LogError("Failed setting %s.", key);
+        result = MU_FAILURE;
+    }
+    else
+    {
+        result = 0;
+    }
+
+    return result;
+}
+
+static const char* get_url_encoded_string(PMQTTTRANSPORT_HANDLE_DATA transport_data, const char* text)
+{
+    const char* result = NULL;
+    size_t index;
+
+    for (index = 0; index < URL_ENCODED_STRING_CACHE_SIZE && result == NULL; index++)
+    {
+        if (transport_data->url_encoded_strings[index].text != NULL && strcmp(transport_data->url_encoded_strings[index].text, text) == 0)
+        {
+            result = transport_data->url_encoded_strings[index].encoded_text;
+        }
+    }
+
+    if (result == NULL)
+    {
+        STRING_HANDLE encoded_string = URL_EncodeString(text);
+        if (encoded_string == NULL)
+        {
+            LogError("Failed URL encoding %s.", text);
+        }
+        else
+        {
+            const char* encoded_text = STRING_c_str(encoded_string);
+            size_t text_size = strlen(text) + 1;
+            size_t encoded_text_size = strlen(encoded_text) + 1;
+            char* cached_text = (char*)malloc(text_size + encoded_text_size);
+            if (cached_text == NULL)
+            {
+                LogError("Failed caching the URL encoded %s.", text);
+            }
+            else
+            {
+                // The oldest entry makes room for the new one.
+                URL_ENCODED_STRING* entry = &transport_data->url_encoded_strings[transport_data->next_url_encoded_string];
+                if (entry->text != NULL)
+                {
+                    free(entry->text);
+                }
+                (void)memcpy(cached_text, text, text_size);
+                (void)memcpy(cached_text + text_size, encoded_text, encoded_text_size);
+                entry->text = cached_text;
+                entry->encoded_text = cached_text + text_size;
+                transport_data->next_url_encoded_string = (transport_data->next_url_encoded_string + 1) % URL_ENCODED_STRING_CACHE_SIZE;
+                result = entry->encoded_text;
+            }
+            STRING_delete(encoded_string);
+        }
+    }
+
+    return result;
+}
+
+static int addUserPropertiesTouMqttMessage(PMQTTTRANSPORT_HANDLE_DATA transport_data, IOTHUB_MESSAGE_HANDLE iothub_message_handle, size_t* index_ptr, bool urlencode)
 {
     int result = 0;
     const char* const* propertyKeys;
@@ -628,24 +867,32 @@ static int addUserPropertiesTouMqttMessage(IOTHUB_MESSAGE_HANDLE iothub_message_
                 {
                     if (urlencode)
                     {
-                        STRING_HANDLE property_key = URL_EncodeString(propertyKeys[index]);
-                        STRING_HANDLE property_value = URL_EncodeString(propertyValues[index]);
-                        if ((property_key == NULL) || (property_value == NULL))
+                        // Codes_SRS_IOTHUB_TRANSPORT_MQTT_COMMON_44_006: [ URL encoded property names, content types, content encodings and the security interface id shall be kept by the transport in a cache of up to 16 entries, so they are encoded once for all the messages sending them. ]
+                        const char* encoded_key = get_url_encoded_string(transport_data, propertyKeys[index]);
+                        STRING_HANDLE property_value;
+                        if (encoded_key == NULL)
                         {
                             LogError("Failed URL Encoding properties");
                             result = MU_FAILURE;
                         }
-                        else if (STRING_sprintf(topic_string, "%s=%s%s", STRING_c_str(property_key), STRING_c_str(property_value), propertyCount - 1 == index ? "" : PROPERTY_SEPARATOR) != 0)
+                        else if ((property_value = URL_EncodeString(propertyValues[index])) == NULL)
                         {
-                            LogError("Failed constructing property string.");
+                            LogError("Failed URL Encoding properties");
                             result = MU_FAILURE;
                         }
-                        STRING_delete(property_key);
-                        STRING_delete(property_value);
+                        else
+                        {
+                            if (append_property_to_telemetry_topic(transport_data, index, "", encoded_key, STRING_c_str(property_value)) != 0)
+                            {
+                                LogError("Failed constructing property string.");
+                                result = MU_FAILURE;
+                            }
+                            STRING_delete(property_value);
+                        }
                     }
                     else
                     {
-                        if (STRING_sprintf(topic_string, "%s=%s%s", propertyKeys[index], propertyValues[index], propertyCount - 1 == index ? "" : PROPERTY_SEPARATOR) != 0)
+                        if (append_property_to_telemetry_topic(transport_data, index, "", propertyKeys[index], propertyValues[index]) != 0)
                         {
                             LogError("Failed constructing property string.");
                             result = MU_FAILURE;
@@ -659,37 +906,45 @@ static int addUserPropertiesTouMqttMessage(IOTHUB_MESSAGE_HANDLE iothub_message_
     return result;
 }
 
-static int addSystemPropertyToTopicString(STRING_HANDLE topic_string, size_t index, const char* property_key, const char* property_value, bool urlencode)
+static int addSystemPropertyToTopicString(PMQTTTRANSPORT_HANDLE_DATA transport_data, size_t index, const char* property_key, const char* property_value, bool urlencode, bool cache_encoding)
 {
     int result = 0;
 
-    if (urlencode)
+    if (urlencode && cache_encoding)
     {
-        STRING_HANDLE encoded_property_value = URL_EncodeString(property_value);
+        const char* encoded_property_value = get_url_encoded_string(transport_data, property_value);
         if (encoded_property_value == NULL)
         {
             LogError("Failed URL encoding %s.", property_key);
             result = MU_FAILURE;
         }
-        else if (STRING_sprintf(topic_string, "%s%%24.%s=%s", index == 0 ? "" : PROPERTY_SEPARATOR, property_key, STRING_c_str(encoded_property_value)) != 0)
+        else
         {
-            LogError("Failed setting %s.", property_key);
-            result = MU_FAILURE;
+            result = append_property_to_telemetry_topic(transport_data, index, "%24.", property_key, encoded_property_value);
         }
-        STRING_delete(encoded_property_value);
     }
-    else
+    else if (urlencode)
     {
-        if (STRING_sprintf(topic_string, "%s%%24.%s=%s", index == 0 ? "" : PROPERTY_SEPARATOR, property_key, property_value) != 0)
+        STRING_HANDLE encoded_property_value = URL_EncodeString(property_value);
+        if (encoded_property_value == NULL)
         {
-            LogError("Failed setting %s.", property_key);
+            LogError("Failed URL encoding %s.", property_key);
             result = MU_FAILURE;
         }
+        else
+        {
+            result = append_property_to_telemetry_topic(transport_data, index, "%24.", property_key, STRING_c_str(encoded_property_value));
+            STRING_delete(encoded_property_value);
+        }
+    }
+    else
+    {
+        result = append_property_to_telemetry_topic(transport_data, index, "%24.", property_key, property_value);
     }
     return result;
 }
 
-static int addSystemPropertiesTouMqttMessage(IOTHUB_MESSAGE_HANDLE iothub_message_handle, STRING_HANDLE topic_string, size_t* index_ptr, bool urlencode)
+static int addSystemPropertiesTouMqttMessage(PMQTTTRANSPORT_HANDLE_DATA transport_data, IOTHUB_MESSAGE_HANDLE iothub_message_handle, size_t* index_ptr, bool urlencode)
 {
     int result = 0;
     size_t index = *index_ptr;
@@ -699,7 +954,7 @@ static int addSystemPropertiesTouMqttMessage(IOTHUB_MESSAGE_HANDLE iothub_messag
     const char* correlation_id = IoTHubMessage_GetCorrelationId(iothub_message_handle);
     if (correlation_id != NULL)
     {
-        result = addSystemPropertyToTopicString(topic_string, index, CORRELATION_ID_PROPERTY, correlation_id, urlencode);
+        result = addSystemPropertyToTopicString(transport_data, index, CORRELATION_ID_PROPERTY, correlation_id, urlencode, false);
         index++;
     }
     /* Codes_SRS_IOTHUB_TRANSPORT_MQTT_COMMON_07_053: [ IoTHubTransport_MQTT_Common_DoWork shall check for the MessageId property and if found add the value as a system property in the format of $.mid=<id> ] */
@@ -708,7 +963,7 @@ static int addSystemPropertiesTouMqttMessage(IOTHUB_MESSAGE_HANDLE iothub_messag
         const char* msg_id = IoTHubMessage_GetMessageId(iothub_message_handle);
         if (msg_id != NULL)
         {
-            result = addSystemPropertyToTopicString(topic_string, index, MESSAGE_ID_PROPERTY, msg_id, urlencode);
+            result = addSystemPropertyToTopicString(transport_data, index, MESSAGE_ID_PROPERTY, msg_id, urlencode, false);
             index++;
         }
     }
@@ -718,7 +973,7 @@ static int addSystemPropertiesTouMqttMessage(IOTHUB_MESSAGE_HANDLE iothub_messag
         const char* content_type = IoTHubMessage_GetContentTypeSystemProperty(iothub_message_handle);
         if (content_type != NULL)
         {
-            result = addSystemPropertyToTopicString(topic_string, index, CONTENT_TYPE_PROPERTY, content_type, urlencode);
+            result = addSystemPropertyToTopicString(transport_data, index, CONTENT_TYPE_PROPERTY, content_type, urlencode, true);
             index++;
         }
     }
@@ -729,7 +984,7 @@ static int addSystemPropertiesTouMqttMessage(IOTHUB_MESSAGE_HANDLE iothub_messag
         if (content_encoding != NULL)
         {
             // Security message require content encoding
-            result = addSystemPropertyToTopicString(topic_string, index, CONTENT_ENCODING_PROPERTY, content_encoding, is_security_msg ? true : urlencode);
+            result = addSystemPropertyToTopicString(transport_data, index, CONTENT_ENCODING_PROPERTY, content_encoding, is_security_msg ? true : urlencode, true);
             index++;
         }
     }
@@ -738,7 +993,7 @@ static int addSystemPropertiesTouMqttMessage(IOTHUB_MESSAGE_HANDLE iothub_messag
         if (is_security_msg)
         {
             // The Security interface Id value must be encoded
-            if (addSystemPropertyToTopicString(topic_string, index++, SECURITY_INTERFACE_ID_MQTT, SECURITY_INTERFACE_ID_VALUE, true) != 0)
+            if (addSystemPropertyToTopicString(transport_data, index++, SECURITY_INTERFACE_ID_MQTT, SECURITY_INTERFACE_ID_VALUE, true, true) != 0)
             {
                 LogError("Failed setting Security interface id");
                 result = MU_FAILURE;
@@ -753,7 +1008,7 @@ static int addSystemPropertiesTouMqttMessage(IOTHUB_MESSAGE_HANDLE iothub_messag
     return result;
 }
 
-static int addDiagnosticPropertiesTouMqttMessage(IOTHUB_MESSAGE_HANDLE iothub_message_handle, STRING_HANDLE topic_string, size_t* index_ptr)
+static int addDiagnosticPropertiesTouMqttMessage(PMQTTTRANSPORT_HANDLE_DATA transport_data, IOTHUB_MESSAGE_HANDLE iothub_message_handle, size_t* index_ptr)
 {
     int result = 0;
     size_t index = *index_ptr;
@@ -767,7 +1022,7 @@ static int addDiagnosticPropertiesTouMqttMessage(IOTHUB_MESSAGE_HANDLE iothub_me
         //diagid and creationtimeutc must be present/unpresent simultaneously
         if (diag_id != NULL && creation_time_utc != NULL)
         {
-            if (STRING_sprintf(topic_string, "%s%%24.%s=%s", index == 0 ? "" : PROPERTY_SEPARATOR, DIAGNOSTIC_ID_PROPERTY, diag_id) != 0)
+            if (append_property_to_telemetry_topic(transport_data, index, "%24.", DIAGNOSTIC_ID_PROPERTY, diag_id) != 0)
             {
                 LogError("Failed setting diagnostic id");
                 result = MU_FAILURE;
@@ -791,7 +1046,7 @@ static int addDiagnosticPropertiesTouMqttMessage(IOTHUB_MESSAGE_HANDLE iothub_me
                     if (encodedContextValueHandle != NULL &&
                         (encodedContextValueString = STRING_c_str(encodedContextValueHandle)) != NULL)
                     {
-                        if (STRING_sprintf(topic_string, "%s%%24.%s=%s", index == 0 ? "" : PROPERTY_SEPARATOR, DIAGNOSTIC_CONTEXT_PROPERTY, encodedContextValueString) != 0)
+                        if (append_property_to_telemetry_topic(transport_data, index, "%24.", DIAGNOSTIC_CONTEXT_PROPERTY, encodedContextValueString) != 0)
                         {
                             LogError("Failed setting diagnostic context");
                             result = MU_FAILURE;
@@ -820,32 +1075,65 @@ static int addDiagnosticPropertiesTouMqttMessage(IOTHUB_MESSAGE_HANDLE iothub_me
     return result;
 }
 
-
-static STRING_HANDLE addPropertiesTouMqttMessage(IOTHUB_MESSAGE_HANDLE iothub_message_handle, const char* eventTopic, bool urlencode)
+static int initialize_telemetry_topic(PMQTTTRANSPORT_HANDLE_DATA transport_data)
 {
-    size_t index = 0;
-    STRING_HANDLE result = STRING_construct(eventTopic);
-    if (result == NULL)
+    int result;
+    const char* event_topic = STRING_c_str(transport_data->topic_MqttEvent);
+    size_t event_topic_size = strlen(event_topic) + 1;
+    size_t topic_size = event_topic_size > TELEMETRY_TOPIC_INITIAL_SIZE ? event_topic_size : TELEMETRY_TOPIC_INITIAL_SIZE;
+
+    if ((transport_data->telemetry_topic = (char*)malloc(topic_size)) == NULL)
     {
-        LogError("Failed to create event topic string handle");
+        LogError("Failed allocating the telemetry topic");
+        result = MU_FAILURE;
     }
-    else if (addUserPropertiesTouMqttMessage(iothub_message_handle, result, &index, urlencode) != 0)
+    else
     {
-        LogError("Failed adding Properties to uMQTT Message");
-        STRING_delete(result);
-        result = NULL;
+        (void)memcpy(transport_data->telemetry_topic, event_topic, event_topic_size);
+        transport_data->telemetry_topic_size = topic_size;
+        transport_data->telemetry_topic_prefix_length = event_topic_size - 1;
+        result = 0;
     }
-    else if (addSystemPropertiesTouMqttMessage(iothub_message_handle, result, &index, urlencode) != 0)
+
+    return result;
+}
+
+// Codes_SRS_IOTHUB_TRANSPORT_MQTT_COMMON_44_005: [ The telemetry topic shall be built in a buffer kept by the transport, after a copy of the device or module event topic made on the first publish, so publishing a message only allocates memory when its topic is longer than any before it. ]
+static const char* addPropertiesTouMqttMessage(PMQTTTRANSPORT_HANDLE_DATA transport_data, IOTHUB_MESSAGE_HANDLE iothub_message_handle, bool urlencode)
+{
+    const char* result;
+    size_t index = 0;
+
+    if (transport_data->telemetry_topic == NULL && initialize_telemetry_topic(transport_data) != 0)
     {
-        LogError("Failed adding System Properties to uMQTT Message");
-        STRING_delete(result);
+        LogError("Failed to create event topic string handle");
         result = NULL;
     }
-    else if (addDiagnosticPropertiesTouMqttMessage(iothub_message_handle, result, &index) != 0)
+    else
     {
-        LogError("Failed adding Diagnostic Properties to uMQTT Message");
-        STRING_delete(result);
-        result = NULL;
+        // Drop the properties of the previous message, keeping the event topic in front of them.
+        transport_data->telemetry_topic_length = transport_data->telemetry_topic_prefix_length;
+        transport_data->telemetry_topic[transport_data->telemetry_topic_length] = '\0';
+
+        if (addUserPropertiesTouMqttMessage(transport_data, iothub_message_handle, &index, urlencode) != 0)
+        {
+            LogError("Failed adding Properties to uMQTT Message");
+            result = NULL;
+        }
+        else if (addSystemPropertiesTouMqttMessage(transport_data, iothub_message_handle, &index, urlencode) != 0)
+        {
+            LogError("Failed adding System Properties to uMQTT Message");
+            result = NULL;
+        }
+        else if (addDiagnosticPropertiesTouMqttMessage(transport_data, iothub_message_handle, &index) != 0)
+        {
+            LogError("Failed adding Diagnostic Properties to uMQTT Message");
+            result = NULL;
+        }
+        else
+        {
+            result = transport_data->telemetry_topic;
+        }
     }
 
     // Codes_SRS_IOTHUB_TRANSPORT_MQTT_COMMON_31_060: [ `IoTHubTransport_MQTT_Common_DoWork` shall check for the OutputName property and if found add the value as a system property in the format of $.on=<value> ]
@@ -854,12 +1142,17 @@ static STRING_HANDLE addPropertiesTouMqttMessage(IOTHUB_MESSAGE_HANDLE iothub_me
         const char* output_name = IoTHubMessage_GetOutputName(iothub_message_handle);
         if (output_name != NULL)
         {
-            if (STRING_sprintf(result, "%s%%24.on=%s/", index == 0 ? "" : PROPERTY_SEPARATOR, output_name) != 0)
+            if (append_property_to_telemetry_topic(transport_data, index, "%24.", "on", output_name) != 0 ||
+                append_to_telemetry_topic(transport_data, "/") != 0)
             {
                 LogError("Failed setting output name.");
-                STRING_delete(result);
                 result = NULL;
             }
+            else
+            {
+                // The buffer may have moved while growing.
+                result = transport_data->telemetry_topic;
+            }
             index++;
         }
     }
@@ -870,7 +1163,51 @@ static STRING_HANDLE addPropertiesTouMqttMessage(IOTHUB_MESSAGE_HANDLE iothub_me
 static int publish_mqtt_telemetry_msg(PMQTTTRANSPORT_HANDLE_DATA transport_data, MQTT_MESSAGE_DETAILS_LIST* mqttMsgEntry, const unsigned char* payload, size_t len)
 {
     int result;
-    STRING_HANDLE msgTopic = addPropertiesTouMqttMessage(mqttMsgEntry->iotHubMessageEntry->messageHandle, STRING_c_str(transport_data->topic_MqttEvent), transport_data->auto_url_encode_decode);
+    MQTT_MESSAGE_HANDLE mqttMsg = mqttmessage_create_in_place(mqttMsgEntry->packet_id, mqttMsgEntry->topic, DELIVER_AT_LEAST_ONCE, payload, len);
+    if (mqttMsg == NULL)
+    {
+        LogError("Failed creating mqtt message");
+        result = MU_FAILURE;
+    }
+    else
+    {
+        /* Codes_SRS_IOTHUB_TRANSPORT_MQTT_COMMON_44_018: [ When a message is resent, it shall be published to the topic saved with it, with the DUP flag set. ] */
+        if (mqttMsgEntry->retryCount > 0 && mqttmessage_setIsDuplicateMsg(mqttMsg, true) != 0)
+        {
+            LogError("Failed setting the DUP flag on the mqtt message");
+            result = MU_FAILURE;
+        }
+        else if (tickcounter_get_current_ms(transport_data->msgTickCounter, &mqttMsgEntry->msgPublishTime) != 0)
+        {
+            LogError("Failed retrieving tickcounter info");
+            result = MU_FAILURE;
+        }
+        else
+        {
+            if (mqtt_client_publish(transport_data->mqttClient, mqttMsg) != 0)
+            {
+                LogError("Failed attempting to publish mqtt message");
+                result = MU_FAILURE;
+            }
+            else
+            {
+                if (mqttMsgEntry->retryCount == 0)
+                {
+                    mqttMsgEntry->msgFirstPublishTime = mqttMsgEntry->msgPublishTime;
+                }
+                mqttMsgEntry->retryCount++;
+                result = 0;
+            }
+        }
+        mqttmessage_destroy(mqttMsg);
+    }
+    return result;
+}
+
+static int publish_mqtt_telemetry_msg_at_most_once(PMQTTTRANSPORT_HANDLE_DATA transport_data, IOTHUB_MESSAGE_HANDLE messageHandle, const unsigned char* payload, size_t len)
+{
+    int result;
+    const char* msgTopic = addPropertiesTouMqttMessage(transport_data, messageHandle, transport_data->auto_url_encode_decode);
     if (msgTopic == NULL)
     {
         LogError("Failed adding properties to mqtt message");
@@ -878,7 +1215,8 @@ static int publish_mqtt_telemetry_msg(PMQTTTRANSPORT_HANDLE_DATA transport_data,
     }
     else
     {
-        MQTT_MESSAGE_HANDLE mqttMsg = mqttmessage_create_in_place(mqttMsgEntry->packet_id, STRING_c_str(msgTopic), DELIVER_AT_LEAST_ONCE, payload, len);
+        // QoS 0 publishes carry no packet id
+        MQTT_MESSAGE_HANDLE mqttMsg = mqttmessage_create_in_place(0, msgTopic, DELIVER_AT_MOST_ONCE, payload, len);
         if (mqttMsg == NULL)
         {
             LogError("Failed creating mqtt message");
@@ -886,31 +1224,30 @@ static int publish_mqtt_telemetry_msg(PMQTTTRANSPORT_HANDLE_DATA transport_data,
         }
         else
         {
-            if (tickcounter_get_current_ms(transport_data->msgTickCounter, &mqttMsgEntry->msgPublishTime) != 0)
+            if (mqtt_client_publish(transport_data->mqttClient, mqttMsg) != 0)
             {
-                LogError("Failed retrieving tickcounter info");
+                LogError("Failed attempting to publish mqtt message");
                 result = MU_FAILURE;
             }
             else
             {
-                if (mqtt_client_publish(transport_data->mqttClient, mqttMsg) != 0)
-                {
-                    LogError("Failed attempting to publish mqtt message");
-                    result = MU_FAILURE;
-                }
-                else
-                {
-                    mqttMsgEntry->retryCount++;
-                    result = 0;
-                }
+                result = 0;
             }
             mqttmessage_destroy(mqttMsg);
         }
-        STRING_delete(msgTopic);
     }
     return result;
 }
 
+// Accounts for a telemetry message published by DoWork, returning whether the publish budget allows more.
+static bool add_to_publish_budget(PMQTTTRANSPORT_HANDLE_DATA transport_data, size_t* published_messages, size_t* published_bytes, size_t message_length)
+{
+    (*published_messages)++;
+    (*published_bytes) += message_length;
+    /* Codes_SRS_IOTHUB_TRANSPORT_MQTT_COMMON_44_008: [ If `mqtt_publish_budget_messages` is set, IoTHubTransport_MQTT_Common_DoWork shall publish at most that many telemetry messages per call. ] */
+    return transport_data->publish_budget_messages == 0 || *published_messages < transport_data->publish_budget_messages;
+}
+
 static int publish_device_method_message(MQTTTRANSPORT_HANDLE_DATA* transport_data, int status_code, STRING_HANDLE request_id, const unsigned char* response, size_t response_size)
 {
     int result;
@@ -949,11 +1286,52 @@ static int publish_device_method_message(MQTTTRANSPORT_HANDLE_DATA* transport_da
 }
 
 
-static void destroy_device_twin_get_message(MQTT_DEVICE_TWIN_ITEM* msg_entry)
+static void destroy_device_twin_get_message(MQTTTRANSPORT_HANDLE_DATA* transport_data, MQTT_DEVICE_TWIN_ITEM* msg_entry)
 {
+    // Has no effect on requests never scheduled or already expired.
+    timeout_heap_remove(&transport_data->twin_request_timeouts, &msg_entry->request_timeout);
     free(msg_entry);
 }
 
+// Codes_SRS_IOTHUB_TRANSPORT_MQTT_COMMON_44_024: [ A twin request shall expire 60 seconds after it was created if it retrieves properties, and 5 minutes after if it reports them. ]
+static void schedule_device_twin_request_timeout(MQTTTRANSPORT_HANDLE_DATA* transport_data, MQTT_DEVICE_TWIN_ITEM* msg_entry)
+{
+    tickcounter_ms_t timeout_ms = (msg_entry->device_twin_msg_type == RETRIEVE_PROPERTIES) ?
+        ON_DEMAND_GET_TWIN_REQUEST_TIMEOUT_SECS * 1000 : TWIN_REPORT_UPDATE_TIMEOUT_SECS * 1000;
+
+    timeout_heap_insert(&transport_data->twin_request_timeouts, &msg_entry->request_timeout, msg_entry->msgCreationTime + timeout_ms);
+}
+
+// Codes_SRS_IOTHUB_TRANSPORT_MQTT_COMMON_44_023: [ Twin requests waiting for their response shall be indexed by their request id, so a response is matched to its request without walking the requests waiting for one. ]
+static int add_device_twin_request_to_ack_waiting_queue(MQTTTRANSPORT_HANDLE_DATA* transport_data, MQTT_DEVICE_TWIN_ITEM* msg_entry)
+{
+    int result;
+
+    if (packet_id_table_insert(&transport_data->ack_waiting_queue_by_packet_id, msg_entry->packet_id, msg_entry) != 0)
+    {
+        LogError("Failed indexing twin request %u", (unsigned int)msg_entry->packet_id);
+        result = MU_FAILURE;
+    }
+    else
+    {
+        DList_InsertTailList(&transport_data->ack_waiting_queue, &msg_entry->entry);
+        result = 0;
+    }
+
+    return result;
+}
+
+static void remove_device_twin_request_from_queue(MQTTTRANSPORT_HANDLE_DATA* transport_data, MQTT_DEVICE_TWIN_ITEM* msg_entry)
+{
+    (void)DList_RemoveEntryList(&msg_entry->entry);
+
+    // Pending requests are not indexed, and their packet id may be reused by one that is.
+    if (packet_id_table_find(&transport_data->ack_waiting_queue_by_packet_id, msg_entry->packet_id) == msg_entry)
+    {
+        (void)packet_id_table_remove(&transport_data->ack_waiting_queue_by_packet_id, msg_entry->packet_id);
+    }
+}
+
 static MQTT_DEVICE_TWIN_ITEM* create_device_twin_message(MQTTTRANSPORT_HANDLE_DATA* transport_data, DEVICE_TWIN_MSG_TYPE device_twin_msg_type, uint32_t iothub_msg_id)
 {
     MQTT_DEVICE_TWIN_ITEM* result;
@@ -972,10 +1350,18 @@ static MQTT_DEVICE_TWIN_ITEM* create_device_twin_message(MQTTTRANSPORT_HANDLE_DA
     else
     {
         memset(result, 0, sizeof(*result));
-        result->msgCreationTime = current_time;
-        result->packet_id = get_next_packet_id(transport_data);
-        result->iothub_msg_id = iothub_msg_id;
-        result->device_twin_msg_type = device_twin_msg_type;
+        if (get_next_free_packet_id(transport_data, &transport_data->ack_waiting_queue_by_packet_id, &result->packet_id) != 0)
+        {
+            LogError("Failed getting a request id for the twin request");
+            free(result);
+            result = NULL;
+        }
+        else
+        {
+            result->msgCreationTime = current_time;
+            result->iothub_msg_id = iothub_msg_id;
+            result->device_twin_msg_type = device_twin_msg_type;
+        }
     }
 
     return result;
@@ -1006,9 +1392,13 @@ static int publish_device_twin_get_message(MQTTTRANSPORT_HANDLE_DATA* transport_
                 LogError("Failed publishing to mqtt client.");
                 result = MU_FAILURE;
             }
+            else if (add_device_twin_request_to_ack_waiting_queue(transport_data, mqtt_info) != 0)
+            {
+                LogError("Failed queuing get twin request.");
+                result = MU_FAILURE;
+            }
             else
             {
-                DList_InsertTailList(&transport_data->ack_waiting_queue, &mqtt_info->entry);
                 result = 0;
             }
             mqttmessage_destroy(mqtt_get_msg);
@@ -1033,7 +1423,7 @@ static void sendPendingGetTwinRequests(PMQTTTRANSPORT_HANDLE_DATA transportData)
         if (publish_device_twin_get_message(transportData, msg_entry) != 0)
         {
             LogError("Failed sending pending get twin request");
-            destroy_device_twin_get_message(msg_entry);
+            destroy_device_twin_get_message(transportData, msg_entry);
         }
         else
         {
@@ -1045,52 +1435,34 @@ static void sendPendingGetTwinRequests(PMQTTTRANSPORT_HANDLE_DATA transportData)
 }
 
 
-static void removeExpiredTwinRequestsFromList(PMQTTTRANSPORT_HANDLE_DATA transport_data, tickcounter_ms_t current_ms, DLIST_ENTRY* twin_list)
+static void removeExpiredTwinRequests(PMQTTTRANSPORT_HANDLE_DATA transport_data)
 {
-    PDLIST_ENTRY list_item = twin_list->Flink;
-    
-    while (list_item != twin_list)
+    tickcounter_ms_t current_ms;
+
+    if (tickcounter_get_current_ms(transport_data->msgTickCounter, &current_ms) == 0)
     {
-        DLIST_ENTRY next_list_item;
-        next_list_item.Flink = list_item->Flink;
-        MQTT_DEVICE_TWIN_ITEM* msg_entry = containingRecord(list_item, MQTT_DEVICE_TWIN_ITEM, entry);
-        bool item_timed_out = false;
+        TIMEOUT_HEAP_ENTRY* expired_entry;
 
-        if ((msg_entry->device_twin_msg_type == RETRIEVE_PROPERTIES) &&
-            (((current_ms - msg_entry->msgCreationTime) / 1000) >= ON_DEMAND_GET_TWIN_REQUEST_TIMEOUT_SECS))
+        // Codes_SRS_IOTHUB_TRANSPORT_MQTT_COMMON_44_025: [ IoTHubTransport_MQTT_Common_DoWork shall only visit the twin requests that expired, in the order they expired. ]
+        while ((expired_entry = timeout_heap_pop_expired(&transport_data->twin_request_timeouts, current_ms)) != NULL)
         {
-            item_timed_out = true;
-            if (msg_entry->userCallback != NULL)
+            MQTT_DEVICE_TWIN_ITEM* msg_entry = containingRecord(expired_entry, MQTT_DEVICE_TWIN_ITEM, request_timeout);
+
+            if (msg_entry->device_twin_msg_type == RETRIEVE_PROPERTIES)
             {
-                msg_entry->userCallback(DEVICE_TWIN_UPDATE_COMPLETE, NULL, 0, msg_entry->userContext);
+                if (msg_entry->userCallback != NULL)
+                {
+                    msg_entry->userCallback(DEVICE_TWIN_UPDATE_COMPLETE, NULL, 0, msg_entry->userContext);
+                }
+            }
+            else
+            {
+                transport_data->transport_callbacks.twin_rpt_state_complete_cb(msg_entry->iothub_msg_id, STATUS_CODE_TIMEOUT_VALUE, transport_data->transport_ctx);
             }
-        }
-        else if ((msg_entry->device_twin_msg_type == REPORTED_STATE) &&
-                 (((current_ms - msg_entry->msgCreationTime) / 1000) >= TWIN_REPORT_UPDATE_TIMEOUT_SECS))
-        {
-            item_timed_out = true;
-            transport_data->transport_callbacks.twin_rpt_state_complete_cb(msg_entry->iothub_msg_id, STATUS_CODE_TIMEOUT_VALUE, transport_data->transport_ctx);
-        }
 
-        if (item_timed_out)
-        {
-            (void)DList_RemoveEntryList(list_item);
-            destroy_device_twin_get_message(msg_entry);
+            remove_device_twin_request_from_queue(transport_data, msg_entry);
+            destroy_device_twin_get_message(transport_data, msg_entry);
         }
-
-        list_item = next_list_item.Flink;
-    }
-
-}
-
-static void removeExpiredTwinRequests(PMQTTTRANSPORT_HANDLE_DATA transport_data)
-{
-    tickcounter_ms_t current_ms;
-
-    if (tickcounter_get_current_ms(transport_data->msgTickCounter, &current_ms) == 0)
-    {
-        removeExpiredTwinRequestsFromList(transport_data, current_ms, &transport_data->pending_get_twin_queue);
-        removeExpiredTwinRequestsFromList(transport_data, current_ms, &transport_data->ack_waiting_queue);
     }
 }
 
@@ -1159,6 +1531,17 @@ static void changeStateToSubscribeIfAllowed(PMQTTTRANSPORT_HANDLE_DATA transport
     }
 }
 
+static void requestFullDeviceTwin(PMQTTTRANSPORT_HANDLE_DATA transport_data)
+{
+    transport_data->device_twin_get_sent = false;
+    transport_data->session_twin_received = false;
+    if (transport_data->currPacketState == PUBLISH_TYPE)
+    {
+        // DoWork sends the twin GET that follows a SUBACK.
+        transport_data->currPacketState = SUBACK_TYPE;
+    }
+}
+
 static int subscribeToNotifyStateIfNeeded(PMQTTTRANSPORT_HANDLE_DATA transport_data)
 {
     int result;
@@ -1208,53 +1591,42 @@ static bool isSystemProperty(const char* tokenData)
 }
 
 // Codes_SRS_IOTHUB_TRANSPORT_MQTT_COMMON_31_061: [ If the message is sent to an input queue, `IoTHubTransport_MQTT_Common_DoWork` shall parse out to the input queue name and store it in the message with IoTHubMessage_SetInputName ]
-// Codes_SRS_IOTHUB_TRANSPORT_MQTT_COMMON_31_062: [ If IoTHubTransport_MQTT_Common_DoWork receives a malformatted inputQueue, it shall fail ]
-static int addInputNamePropertyToMessage(IOTHUB_MESSAGE_HANDLE IoTHubMessage, const char* topic_name)
+static int addInputNamePropertyToMessage(PMQTTTRANSPORT_HANDLE_DATA transport_data, IOTHUB_MESSAGE_HANDLE IoTHubMessage, const INBOUND_TOPIC_INFO* topic_info)
 {
-    int result = MU_FAILURE;
-    int number_tokens_read = 0;
+    int result;
 
-    STRING_TOKENIZER_HANDLE token_handle = STRING_TOKENIZER_create_from_char(topic_name);
-    if (token_handle == NULL)
-    {
-        LogError("STRING_TOKENIZER_create_from_char failed\n");
-        result = MU_FAILURE;
-    }
-    else
+    // The input name is copied to be NULL-terminated, in a buffer only growing when a longer name is received.
+    if (topic_info->name_length >= transport_data->input_name_size)
     {
-        STRING_HANDLE token_value;
-        if ((token_value = STRING_new()) == NULL)
+        char* new_input_name;
+
+        if ((new_input_name = (char*)realloc(transport_data->input_name, topic_info->name_length + 1)) == NULL)
         {
-            LogError("Failed allocating token_value");
+            LogError("Failed growing the input name to %lu bytes", (unsigned long)(topic_info->name_length + 1));
+            result = MU_FAILURE;
         }
         else
         {
-            while (STRING_TOKENIZER_get_next_token(token_handle, token_value, "/") == 0)
-            {
-                number_tokens_read++;
-                if (number_tokens_read == (slashes_to_reach_input_name + 1))
-                {
-                    if ((IOTHUB_MESSAGE_OK != IoTHubMessage_SetInputName(IoTHubMessage, STRING_c_str(token_value))))
-                    {
-                        LogError("Failed adding input name to msg");
-                        result = MU_FAILURE;
-                    }
-                    else
-                    {
-                        result = 0;
-                    }
-                    break;
-                }
-            }
+            transport_data->input_name = new_input_name;
+            transport_data->input_name_size = topic_info->name_length + 1;
+            result = 0;
         }
-        STRING_delete(token_value);
+    }
+    else
+    {
+        result = 0;
+    }
 
-        if (number_tokens_read != (slashes_to_reach_input_name + 1))
+    if (result == 0)
+    {
+        (void)memcpy(transport_data->input_name, topic_info->name, topic_info->name_length);
+        transport_data->input_name[topic_info->name_length] = '\0';
+
+        if (IoTHubMessage_SetInputName(IoTHubMessage, transport_data->input_name) != IOTHUB_MESSAGE_OK)
         {
-            LogError("Not enough '/' to contain input name.  Got %d, need at least %d", number_tokens_read, (slashes_to_reach_input_name + 1));
+            LogError("Failed adding input name to msg");
             result = MU_FAILURE;
         }
-        STRING_TOKENIZER_destroy(token_handle);
     }
 
     return result;
@@ -1516,107 +1888,104 @@ static void mqtt_notification_callback(MQTT_MESSAGE_HANDLE msgHandle, void* call
         else
         {
             PMQTTTRANSPORT_HANDLE_DATA transportData = (PMQTTTRANSPORT_HANDLE_DATA)callbackCtx;
+            INBOUND_TOPIC_INFO topic_info;
 
-            IOTHUB_IDENTITY_TYPE type = retrieve_topic_type(topic_resp, STRING_c_str(transportData->topic_InputQueue));
-            if (type == IOTHUB_TYPE_DEVICE_TWIN)
+            if (parse_inbound_topic(transportData, topic_resp, &topic_info) != 0)
             {
-                size_t request_id;
-                int status_code;
-                bool notification_msg;
-                if (parse_device_twin_topic_info(topic_resp, &notification_msg, &request_id, &status_code) != 0)
-                {
-                    LogError("Failure: parsing device topic info");
-                }
-                else
+                LogError("Failure: parsing topic info");
+            }
+            else if (topic_info.type == IOTHUB_TYPE_DEVICE_TWIN)
+            {
+                const APP_PAYLOAD* payload = mqttmessage_getApplicationMsg(msgHandle);
+                if (topic_info.patch_msg)
                 {
-                    const APP_PAYLOAD* payload = mqttmessage_getApplicationMsg(msgHandle);
-                    if (notification_msg)
+                    if (transportData->persistent_session && transportData->desired_version != 0 && topic_info.version != 0 && topic_info.version <= transportData->desired_version)
                     {
-                        transportData->transport_callbacks.twin_retrieve_prop_complete_cb(DEVICE_TWIN_UPDATE_PARTIAL, payload->message, payload->length, transportData->transport_ctx);
+                        // Codes_SRS_IOTHUB_TRANSPORT_MQTT_COMMON_44_034: [ If `mqtt_persistent_session` is set and a desired properties patch is not newer than the last one received, `mqtt_notification_callback` shall drop it without retrieving the whole twin and keep the version of the last one received. ]
+                        LogInfo("Desired properties version %lu is not newer than %lu, dropping it", (unsigned long)topic_info.version, (unsigned long)transportData->desired_version);
                     }
                     else
                     {
-                        PDLIST_ENTRY dev_twin_item = transportData->ack_waiting_queue.Flink;
-                        while (dev_twin_item != &transportData->ack_waiting_queue)
+                        if (transportData->persistent_session && transportData->desired_version != 0 && (topic_info.version == 0 || topic_info.version > transportData->desired_version + 1))
+                        {
+                            // Codes_SRS_IOTHUB_TRANSPORT_MQTT_COMMON_44_030: [ If `mqtt_persistent_session` is set and a desired properties patch is more than one version ahead of the last one received, `mqtt_notification_callback` shall drop it and have IoTHubTransport_MQTT_Common_DoWork retrieve the whole twin. ]
+                            LogInfo("Desired properties version %lu does not follow %lu, retrieving the twin", (unsigned long)topic_info.version, (unsigned long)transportData->desired_version);
+                            requestFullDeviceTwin(transportData);
+                        }
+                        else
+                        {
+                            transportData->transport_callbacks.twin_retrieve_prop_complete_cb(DEVICE_TWIN_UPDATE_PARTIAL, payload->message, payload->length, transportData->transport_ctx);
+                        }
+                        transportData->desired_version = topic_info.version;
+                    }
+                }
+                else
+                {
+                    // Codes_SRS_IOTHUB_TRANSPORT_MQTT_COMMON_44_023: [ Twin requests waiting for their response shall be indexed by their request id, so a response is matched to its request without walking the requests waiting for one. ]
+                    MQTT_DEVICE_TWIN_ITEM* msg_entry = (topic_info.request_id > UINT16_MAX) ? NULL :
+                        (MQTT_DEVICE_TWIN_ITEM*)packet_id_table_remove(&transportData->ack_waiting_queue_by_packet_id, (uint16_t)topic_info.request_id);
+                    if (msg_entry != NULL)
+                    {
+                        (void)DList_RemoveEntryList(&msg_entry->entry);
+                        if (msg_entry->device_twin_msg_type == RETRIEVE_PROPERTIES)
                         {
-                            DLIST_ENTRY saveListEntry;
-                            saveListEntry.Flink = dev_twin_item->Flink;
-                            MQTT_DEVICE_TWIN_ITEM* msg_entry = containingRecord(dev_twin_item, MQTT_DEVICE_TWIN_ITEM, entry);
-                            if (request_id == msg_entry->packet_id)
+                            if (msg_entry->userCallback == NULL)
                             {
-                                (void)DList_RemoveEntryList(dev_twin_item);
-                                if (msg_entry->device_twin_msg_type == RETRIEVE_PROPERTIES)
-                                {
-                                    if (msg_entry->userCallback == NULL)
-                                    {
-                                        /* Codes_SRS_IOTHUB_MQTT_TRANSPORT_07_054: [ If type is IOTHUB_TYPE_DEVICE_TWIN, then on success if msg_type is RETRIEVE_PROPERTIES then mqtt_notification_callback shall call IoTHubClientCore_LL_RetrievePropertyComplete... ] */
-                                        transportData->transport_callbacks.twin_retrieve_prop_complete_cb(DEVICE_TWIN_UPDATE_COMPLETE, payload->message, payload->length, transportData->transport_ctx);
-                                        // Only after receiving device twin request should we start listening for patches.
-                                        (void)subscribeToNotifyStateIfNeeded(transportData);
-                                    }
-                                    else
-                                    {
-                                        // This is a on-demand get twin request.
-                                        msg_entry->userCallback(DEVICE_TWIN_UPDATE_COMPLETE, payload->message, payload->length, msg_entry->userContext);
-                                    }
-                                }
-                                else
-                                {
-                                    /* Codes_SRS_IOTHUB_MQTT_TRANSPORT_07_055: [ if device_twin_msg_type is not RETRIEVE_PROPERTIES then mqtt_notification_callback shall call IoTHubClientCore_LL_ReportedStateComplete ] */
-                                    transportData->transport_callbacks.twin_rpt_state_complete_cb(msg_entry->iothub_msg_id, status_code, transportData->transport_ctx);
-                                    // Only after receiving device twin request should we start listening for patches.
-                                    (void)subscribeToNotifyStateIfNeeded(transportData);
-                                }
-
-                                destroy_device_twin_get_message(msg_entry);
-                                break;
+                                /* Codes_SRS_IOTHUB_MQTT_TRANSPORT_07_054: [ If type is IOTHUB_TYPE_DEVICE_TWIN, then on success if msg_type is RETRIEVE_PROPERTIES then mqtt_notification_callback shall call IoTHubClientCore_LL_RetrievePropertyComplete... ] */
+                                transportData->transport_callbacks.twin_retrieve_prop_complete_cb(DEVICE_TWIN_UPDATE_COMPLETE, payload->message, payload->length, transportData->transport_ctx);
+                                // The version of the twin is in its document, the next patch tells it.
+                                transportData->desired_version = 0;
+                                transportData->session_twin_received = true;
+                                // Only after receiving device twin request should we start listening for patches.
+                                (void)subscribeToNotifyStateIfNeeded(transportData);
                             }
-                            dev_twin_item = saveListEntry.Flink;
+                            else
+                            {
+                                // This is a on-demand get twin request.
+                                msg_entry->userCallback(DEVICE_TWIN_UPDATE_COMPLETE, payload->message, payload->length, msg_entry->userContext);
+                            }
+                        }
+                        else
+                        {
+                            /* Codes_SRS_IOTHUB_MQTT_TRANSPORT_07_055: [ if device_twin_msg_type is not RETRIEVE_PROPERTIES then mqtt_notification_callback shall call IoTHubClientCore_LL_ReportedStateComplete ] */
+                            transportData->transport_callbacks.twin_rpt_state_complete_cb(msg_entry->iothub_msg_id, topic_info.status_code, transportData->transport_ctx);
+                            // Only after receiving device twin request should we start listening for patches.
+                            (void)subscribeToNotifyStateIfNeeded(transportData);
                         }
+
+                        destroy_device_twin_get_message(transportData, msg_entry);
                     }
                 }
             }
-            else if (type == IOTHUB_TYPE_DEVICE_METHODS)
+            else if (topic_info.type == IOTHUB_TYPE_DEVICE_METHODS)
             {
-                STRING_HANDLE method_name = STRING_new();
-                if (method_name == NULL)
+                // The method name is only needed during the callback, so it is kept NULL-terminated right after the method info.
+                DEVICE_METHOD_INFO* dev_method_info = malloc(sizeof(DEVICE_METHOD_INFO) + topic_info.name_length + 1);
+                if (dev_method_info == NULL)
+                {
+                    LogError("Failure: allocating DEVICE_METHOD_INFO object");
+                }
+                else if ((dev_method_info->request_id = STRING_construct_n(topic_info.method_request_id, topic_info.method_request_id_length)) == NULL)
                 {
-                    LogError("Failure: allocating method_name string value");
+                    LogError("Failure constructing request_id string");
+                    free(dev_method_info);
                 }
                 else
                 {
-                    DEVICE_METHOD_INFO* dev_method_info = malloc(sizeof(DEVICE_METHOD_INFO));
-                    if (dev_method_info == NULL)
-                    {
-                        LogError("Failure: allocating DEVICE_METHOD_INFO object");
-                    }
-                    else
+                    char* method_name = (char*)(dev_method_info + 1);
+                    const APP_PAYLOAD* payload;
+
+                    (void)memcpy(method_name, topic_info.name, topic_info.name_length);
+                    method_name[topic_info.name_length] = '\0';
+
+                    /* CodesSRS_IOTHUB_MQTT_TRANSPORT_07_053: [ If type is IOTHUB_TYPE_DEVICE_METHODS, then on success mqtt_notification_callback shall call IoTHubClientCore_LL_DeviceMethodComplete. ] */
+                    payload = mqttmessage_getApplicationMsg(msgHandle);
+                    if (transportData->transport_callbacks.method_complete_cb(method_name, payload->message, payload->length, (void*)dev_method_info, transportData->transport_ctx) != 0)
                     {
-                        dev_method_info->request_id = STRING_new();
-                        if (dev_method_info->request_id == NULL)
-                        {
-                            LogError("Failure constructing request_id string");
-                            free(dev_method_info);
-                        }
-                        else if (retrieve_device_method_rid_info(topic_resp, method_name, dev_method_info->request_id) != 0)
-                        {
-                            LogError("Failure: retrieve device topic info");
-                            STRING_delete(dev_method_info->request_id);
-                            free(dev_method_info);
-                        }
-                        else
-                        {
-                            /* CodesSRS_IOTHUB_MQTT_TRANSPORT_07_053: [ If type is IOTHUB_TYPE_DEVICE_METHODS, then on success mqtt_notification_callback shall call IoTHubClientCore_LL_DeviceMethodComplete. ] */
-                            const APP_PAYLOAD* payload = mqttmessage_getApplicationMsg(msgHandle);
-                            if (transportData->transport_callbacks.method_complete_cb(STRING_c_str(method_name), payload->message, payload->length, (void*)dev_method_info, transportData->transport_ctx) != 0)
-                            {
-                                LogError("Failure: IoTHubClientCore_LL_DeviceMethodComplete");
-                                STRING_delete(dev_method_info->request_id);
-                                free(dev_method_info);
-                            }
-                        }
+                        LogError("Failure: IoTHubClientCore_LL_DeviceMethodComplete");
+                        STRING_delete(dev_method_info->request_id);
+                        free(dev_method_info);
                     }
-                    STRING_delete(method_name);
                 }
             }
             else
@@ -1629,9 +1998,10 @@ static void mqtt_notification_callback(MQTT_MESSAGE_HANDLE msgHandle, void* call
                 }
                 else
                 {
-                    if ((type == IOTHUB_TYPE_EVENT_QUEUE) && (addInputNamePropertyToMessage(IoTHubMessage, topic_resp) != 0))
+                    if ((topic_info.type == IOTHUB_TYPE_EVENT_QUEUE) && (addInputNamePropertyToMessage(transportData, IoTHubMessage, &topic_info) != 0))
                     {
                         LogError("failure adding input name to property.");
+                        IoTHubMessage_Destroy(IoTHubMessage);
                     }
                     // Will need to update this when the service has messages that can be rejected
                     else if (extractMqttProperties(IoTHubMessage, topic_resp, transportData->auto_url_encode_decode) != 0)
@@ -1650,7 +2020,7 @@ static void mqtt_notification_callback(MQTT_MESSAGE_HANDLE msgHandle, void* call
                             messageData->messageHandle = IoTHubMessage;
                             messageData->transportContext = NULL;
 
-                            if (type == IOTHUB_TYPE_EVENT_QUEUE)
+                            if (topic_info.type == IOTHUB_TYPE_EVENT_QUEUE)
                             {
                                 // Codes_SRS_IOTHUB_MQTT_TRANSPORT_31_065: [ If type is IOTHUB_TYPE_TELEMETRY and sent to an input queue, then on success `mqtt_notification_callback` shall call `IoTHubClient_LL_MessageCallback`. ]
                                 if (!transportData->transport_callbacks.msg_input_cb(messageData, transportData->transport_ctx))
@@ -1679,6 +2049,43 @@ static void mqtt_notification_callback(MQTT_MESSAGE_HANDLE msgHandle, void* call
     }
 }
 
+static void reset_rtt_estimate(PMQTTTRANSPORT_HANDLE_DATA transport_data)
+{
+    transport_data->smoothed_rtt_ms = 0;
+    transport_data->rtt_variance_ms = 0;
+    transport_data->rtt_sample_count = 0;
+    transport_data->resend_timeout_ms = RESEND_TIMEOUT_MS;
+}
+
+static void add_rtt_sample(PMQTTTRANSPORT_HANDLE_DATA transport_data, tickcounter_ms_t rtt_ms)
+{
+    tickcounter_ms_t resend_timeout_ms;
+
+    if (transport_data->rtt_sample_count == 0)
+    {
+        transport_data->smoothed_rtt_ms = rtt_ms;
+        transport_data->rtt_variance_ms = rtt_ms / 2;
+    }
+    else
+    {
+        tickcounter_ms_t deviation_ms = (rtt_ms > transport_data->smoothed_rtt_ms) ? (rtt_ms - transport_data->smoothed_rtt_ms) : (transport_data->smoothed_rtt_ms - rtt_ms);
+        transport_data->rtt_variance_ms = (3 * transport_data->rtt_variance_ms + deviation_ms) / 4;
+        transport_data->smoothed_rtt_ms = (7 * transport_data->smoothed_rtt_ms + rtt_ms) / 8;
+    }
+    transport_data->rtt_sample_count++;
+
+    resend_timeout_ms = transport_data->smoothed_rtt_ms + 4 * transport_data->rtt_variance_ms;
+    if (resend_timeout_ms < RESEND_TIMEOUT_MIN_MS)
+    {
+        resend_timeout_ms = RESEND_TIMEOUT_MIN_MS;
+    }
+    else if (resend_timeout_ms > RESEND_TIMEOUT_MAX_MS)
+    {
+        resend_timeout_ms = RESEND_TIMEOUT_MAX_MS;
+    }
+    transport_data->resend_timeout_ms = resend_timeout_ms;
+}
+
 static void mqtt_operation_complete_callback(MQTT_CLIENT_HANDLE handle, MQTT_CLIENT_EVENT_RESULT actionResult, const void* msgInfo, void* callbackCtx)
 {
     (void)handle;
@@ -1694,20 +2101,28 @@ static void mqtt_operation_complete_callback(MQTT_CLIENT_HANDLE handle, MQTT_CLI
                 const PUBLISH_ACK* puback = (const PUBLISH_ACK*)msgInfo;
                 if (puback != NULL)
                 {
-                    PDLIST_ENTRY currentListEntry = transport_data->telemetry_waitingForAck.Flink;
-                    while (currentListEntry != &transport_data->telemetry_waitingForAck)
+                    /* Codes_SRS_IOTHUB_TRANSPORT_MQTT_COMMON_44_003: [ When a PUBACK is received, the acknowledged message shall be looked up by its packet id in constant time, without walking the messages waiting for acknowledgement. ] */
+                    MQTT_MESSAGE_DETAILS_LIST* mqttMsgEntry = (MQTT_MESSAGE_DETAILS_LIST*)packet_id_table_remove(&transport_data->telemetry_waitingForAck_by_packet_id, puback->packetId);
+                    if (mqttMsgEntry != NULL)
                     {
-                        MQTT_MESSAGE_DETAILS_LIST* mqttMsgEntry = containingRecord(currentListEntry, MQTT_MESSAGE_DETAILS_LIST, entry);
-                        DLIST_ENTRY saveListEntry;
-                        saveListEntry.Flink = currentListEntry->Flink;
-
-                        if (puback->packetId == mqttMsgEntry->packet_id)
+                        /* Codes_SRS_IOTHUB_TRANSPORT_MQTT_COMMON_44_013: [ When a PUBACK is received for a message that was only published once, the time since it was published shall be added to the smoothed round trip time and round trip time variance of the connection, as in RFC 6298. ] */
+                        // A resent message cannot tell which of its publishes is acknowledged, so it is not measured.
+                        if (mqttMsgEntry->retryCount == 1)
                         {
-                            (void)DList_RemoveEntryList(currentListEntry); //First remove the item from Waiting for Ack List.
-                            sendMsgComplete(mqttMsgEntry->iotHubMessageEntry, transport_data, IOTHUB_CLIENT_CONFIRMATION_OK);
-                            free(mqttMsgEntry);
+                            tickcounter_ms_t current_ms;
+                            if (tickcounter_get_current_ms(transport_data->msgTickCounter, &current_ms) != 0)
+                            {
+                                LogError("Failed retrieving tickcounter info, round trip time not measured");
+                            }
+                            else
+                            {
+                                add_rtt_sample(transport_data, current_ms - mqttMsgEntry->msgPublishTime);
+                            }
                         }
-                        currentListEntry = saveListEntry.Flink;
+                        (void)DList_RemoveEntryList(&mqttMsgEntry->entry); //First remove the item from Waiting for Ack List.
+                        timeout_heap_remove(&transport_data->telemetry_ack_timeouts, &mqttMsgEntry->ack_timeout);
+                        sendMsgComplete(mqttMsgEntry->iotHubMessageEntry, transport_data, IOTHUB_CLIENT_CONFIRMATION_OK);
+                        free(mqttMsgEntry);
                     }
                 }
                 else
@@ -1727,6 +2142,23 @@ static void mqtt_operation_complete_callback(MQTT_CLIENT_HANDLE handle, MQTT_CLI
                         transport_data->currPacketState = CONNACK_TYPE;
                         transport_data->isRecoverableError = true;
                         transport_data->mqttClientStatus = MQTT_CLIENT_STATUS_CONNECTED;
+                        // Round trip times are measured again for each connection
+                        reset_rtt_estimate(transport_data);
+
+                        if (transport_data->persistent_session && connack->isSessionPresent)
+                        {
+                            // Codes_SRS_IOTHUB_TRANSPORT_MQTT_COMMON_44_027: [ If `mqtt_persistent_session` is set and the CONNACK reports a session present, the topics subscribed to in that session shall not be subscribed to again, and the twin shall not be retrieved again if it was retrieved in that session. ]
+                            transport_data->topics_ToSubscribe &= ~transport_data->topics_Subscribed;
+                            transport_data->device_twin_get_sent = transport_data->session_twin_received;
+                        }
+                        else
+                        {
+                            // Codes_SRS_IOTHUB_TRANSPORT_MQTT_COMMON_44_028: [ Otherwise the broker keeps no subscription from a previous connection, and every topic shall be subscribed to again. ]
+                            transport_data->topics_Subscribed = 0;
+                            transport_data->desired_version = 0;
+                            transport_data->session_twin_received = false;
+                        }
+                        transport_data->topics_Subscribing = 0;
 
                         // Codes_SRS_IOTHUB_TRANSPORT_MQTT_COMMON_09_008: [ Upon successful connection the retry control shall be reset using retry_control_reset() ]
                         retry_control_reset(transport_data->retry_control_handle);
@@ -1769,12 +2201,22 @@ static void mqtt_operation_complete_callback(MQTT_CLIENT_HANDLE handle, MQTT_CLI
                 if (suback != NULL)
                 {
                     size_t index = 0;
+                    bool subscribed = true;
                     for (index = 0; index < suback->qosCount; index++)
                     {
                         if (suback->qosReturn[index] == DELIVER_FAILURE)
                         {
                             LogError("Subscribe delivery failure of subscribe %lu", (unsigned long)index);
+                            subscribed = false;
+                        }
+                    }
+                    if (suback->packetId == transport_data->subscribe_packet_id)
+                    {
+                        if (subscribed)
+                        {
+                            transport_data->topics_Subscribed |= transport_data->topics_Subscribing;
                         }
+                        transport_data->topics_Subscribing = 0;
                     }
                     // The subscribed packet has been acked
                     transport_data->currPacketState = SUBACK_TYPE;
@@ -1960,7 +2402,8 @@ static void SubscribeToMqttProtocol(PMQTTTRANSPORT_HANDLE_DATA transport_data)
         if ((transport_data->topic_NotifyState != NULL) && (SUBSCRIBE_NOTIFICATION_STATE_TOPIC & transport_data->topics_ToSubscribe))
         {
             subscribe[subscribe_count].subscribeTopic = STRING_c_str(transport_data->topic_NotifyState);
-            subscribe[subscribe_count].qosReturn = DELIVER_AT_MOST_ONCE;
+            // Codes_SRS_IOTHUB_TRANSPORT_MQTT_COMMON_44_029: [ If `mqtt_persistent_session` is set, the desired properties patches shall be subscribed to with QoS 1, so the broker keeps those sent while the device is disconnected. ]
+            subscribe[subscribe_count].qosReturn = transport_data->persistent_session ? DELIVER_AT_LEAST_ONCE : DELIVER_AT_MOST_ONCE;
             topic_subscription |= SUBSCRIBE_NOTIFICATION_STATE_TOPIC;
             subscribe_count++;
         }
@@ -1991,6 +2434,9 @@ static void SubscribeToMqttProtocol(PMQTTTRANSPORT_HANDLE_DATA transport_data)
             {
                 /* Codes_SRS_IOTHUB_MQTT_TRANSPORT_07_018: [On success IoTHubTransport_MQTT_Common_Subscribe shall return 0.] */
                 transport_data->topics_ToSubscribe &= ~topic_subscription;
+                // SUBACKs come in order, so the last one also covers the topics of any earlier SUBSCRIBE.
+                transport_data->topics_Subscribing |= topic_subscription;
+                transport_data->subscribe_packet_id = packet_id;
                 transport_data->currPacketState = SUBSCRIBE_TYPE;
             }
         }
@@ -2001,6 +2447,13 @@ static void SubscribeToMqttProtocol(PMQTTTRANSPORT_HANDLE_DATA transport_data)
         }
         transport_data->currPacketState = SUBSCRIBE_TYPE;
     }
+    else if (transport_data->currPacketState == CONNACK_TYPE &&
+        (transport_data->topic_NotifyState != NULL || transport_data->topic_GetState != NULL) &&
+        !transport_data->device_twin_get_sent)
+    {
+        // Codes_SRS_IOTHUB_TRANSPORT_MQTT_COMMON_44_033: [ If no topic is left to subscribe to after a CONNACK and the twin has not been retrieved, IoTHubTransport_MQTT_Common_DoWork shall send the twin get message as if a SUBACK had been received. ]
+        transport_data->currPacketState = SUBACK_TYPE;
+    }
     else
     {
         transport_data->currPacketState = PUBLISH_TYPE;
@@ -2047,23 +2500,48 @@ static bool RetrieveMessagePayload(IOTHUB_MESSAGE_HANDLE messageHandle, const un
     return result;
 }
 
+static void schedule_telemetry_ack_timeout(PMQTTTRANSPORT_HANDLE_DATA transport_data, MQTT_MESSAGE_DETAILS_LIST* msg_detail_entry)
+{
+    /* Codes_SRS_IOTHUB_TRANSPORT_MQTT_COMMON_44_014: [ A message shall be resent once it has waited for its PUBACK for the resend timeout of the connection, doubled for every time it was already resent, up to 4 times the default resend timeout. ] */
+    tickcounter_ms_t timeout_ms = transport_data->resend_timeout_ms;
+    size_t resend_count;
+
+    for (resend_count = 1; resend_count < msg_detail_entry->retryCount && timeout_ms < RESEND_TIMEOUT_MAX_MS; resend_count++)
+    {
+        timeout_ms *= 2;
+    }
+    if (timeout_ms > RESEND_TIMEOUT_MAX_MS)
+    {
+        timeout_ms = RESEND_TIMEOUT_MAX_MS;
+    }
+
+    timeout_heap_insert(&transport_data->telemetry_ack_timeouts, &msg_detail_entry->ack_timeout, msg_detail_entry->msgPublishTime + timeout_ms);
+}
+
 static void process_queued_ack_messages(PMQTTTRANSPORT_HANDLE_DATA transport_data)
 {
-    PDLIST_ENTRY current_entry = transport_data->telemetry_waitingForAck.Flink;
     tickcounter_ms_t current_ms;
-    (void)tickcounter_get_current_ms(transport_data->msgTickCounter, &current_ms);
-    while (current_entry != &transport_data->telemetry_waitingForAck)
+
+    if (tickcounter_get_current_ms(transport_data->msgTickCounter, &current_ms) != 0)
+    {
+        LogError("Failed retrieving tickcounter info, resend timeouts will not be processed");
+    }
+    else
     {
-        MQTT_MESSAGE_DETAILS_LIST* msg_detail_entry = containingRecord(current_entry, MQTT_MESSAGE_DETAILS_LIST, entry);
-        DLIST_ENTRY nextListEntry;
-        nextListEntry.Flink = current_entry->Flink;
+        TIMEOUT_HEAP_ENTRY* expired_entry;
 
-        if (((current_ms - msg_detail_entry->msgPublishTime) / 1000) > RESEND_TIMEOUT_VALUE_MIN)
+        /* Codes_SRS_IOTHUB_TRANSPORT_MQTT_COMMON_44_001: [ IoTHubTransport_MQTT_Common_DoWork shall only visit the messages waiting for acknowledgement whose resend timeout has expired, in the order their timeouts expire. ] */
+        while ((expired_entry = timeout_heap_pop_expired(&transport_data->telemetry_ack_timeouts, current_ms)) != NULL)
         {
-            if (msg_detail_entry->retryCount >= MAX_SEND_RECOUNT_LIMIT)
+            MQTT_MESSAGE_DETAILS_LIST* msg_detail_entry = containingRecord(expired_entry, MQTT_MESSAGE_DETAILS_LIST, ack_timeout);
+            PDLIST_ENTRY current_entry = &msg_detail_entry->entry;
+
+            /* Codes_SRS_IOTHUB_TRANSPORT_MQTT_COMMON_44_015: [ A message shall only be failed with IOTHUB_CLIENT_CONFIRMATION_MESSAGE_TIMEOUT once it has been sent twice and it was first published at least 2 default resend timeouts ago. ] */
+            if (msg_detail_entry->retryCount >= MAX_SEND_RECOUNT_LIMIT && current_ms - msg_detail_entry->msgFirstPublishTime >= MESSAGE_ACK_DEADLINE_MS)
             {
                 sendMsgComplete(msg_detail_entry->iotHubMessageEntry, transport_data, IOTHUB_CLIENT_CONFIRMATION_MESSAGE_TIMEOUT);
                 (void)DList_RemoveEntryList(current_entry);
+                (void)packet_id_table_remove(&transport_data->telemetry_waitingForAck_by_packet_id, msg_detail_entry->packet_id);
                 free(msg_detail_entry);
 
                 DisconnectFromClient(transport_data);
@@ -2079,6 +2557,7 @@ static void process_queued_ack_messages(PMQTTTRANSPORT_HANDLE_DATA transport_dat
                     if (!RetrieveMessagePayload(msg_detail_entry->iotHubMessageEntry->messageHandle, &messagePayload, &messageLength))
                     {
                         (void)DList_RemoveEntryList(current_entry);
+                        (void)packet_id_table_remove(&transport_data->telemetry_waitingForAck_by_packet_id, msg_detail_entry->packet_id);
                         sendMsgComplete(msg_detail_entry->iotHubMessageEntry, transport_data, IOTHUB_CLIENT_CONFIRMATION_ERROR);
                     }
                     else
@@ -2086,19 +2565,25 @@ static void process_queued_ack_messages(PMQTTTRANSPORT_HANDLE_DATA transport_dat
                         if (publish_mqtt_telemetry_msg(transport_data, msg_detail_entry, messagePayload, messageLength) != 0)
                         {
                             (void)DList_RemoveEntryList(current_entry);
+                            (void)packet_id_table_remove(&transport_data->telemetry_waitingForAck_by_packet_id, msg_detail_entry->packet_id);
                             sendMsgComplete(msg_detail_entry->iotHubMessageEntry, transport_data, IOTHUB_CLIENT_CONFIRMATION_ERROR);
                             free(msg_detail_entry);
                         }
+                        else
+                        {
+                            /* Codes_SRS_IOTHUB_TRANSPORT_MQTT_COMMON_44_002: [ When a message is resent, its resend timeout shall be rescheduled from the new publish time. ] */
+                            schedule_telemetry_ack_timeout(transport_data, msg_detail_entry);
+                        }
                     }
                 }
                 else
                 {
                     msg_detail_entry->retryCount++;
                     msg_detail_entry->msgPublishTime = current_ms;
+                    schedule_telemetry_ack_timeout(transport_data, msg_detail_entry);
                 }
             }
         }
-        current_entry = nextListEntry.Flink;
     }
 }
 
@@ -2602,8 +3087,15 @@ static PMQTTTRANSPORT_HANDLE_DATA InitializeTransportHandleData(const IOTHUB_CLI
                     {
                         /* Codes_SRS_IOTHUB_MQTT_TRANSPORT_07_010: [IoTHubTransport_MQTT_Common_Create shall allocate memory to save its internal state where all topics, hostname, device_id, device_key, sasTokenSr and client handle shall be saved.] */
                         DList_InitializeListHead(&(state->telemetry_waitingForAck));
+                        packet_id_table_initialize(&(state->telemetry_waitingForAck_by_packet_id));
+                        timeout_heap_initialize(&(state->telemetry_ack_timeouts));
+                        reset_rtt_estimate(state);
+                        // Codes_SRS_IOTHUB_TRANSPORT_MQTT_COMMON_44_019: [ IoTHubTransport_MQTT_Common_Create shall build a prefix trie classifying received topics starting with `$iothub/twin` as IOTHUB_TYPE_DEVICE_TWIN, with `$iothub/methods` as IOTHUB_TYPE_DEVICE_METHODS and any other as IOTHUB_TYPE_TELEMETRY, ignoring case. ]
+                        initialize_inbound_topics(state);
                         DList_InitializeListHead(&(state->ack_waiting_queue));
+                        packet_id_table_initialize(&(state->ack_waiting_queue_by_packet_id));
                         DList_InitializeListHead(&(state->pending_get_twin_queue));
+                        timeout_heap_initialize(&(state->twin_request_timeouts));
                         state->mqttClientStatus = MQTT_CLIENT_STATUS_NOT_CONNECTED;
                         state->isRecoverableError = true;
                         state->packetId = 1;
@@ -2743,6 +3235,8 @@ void IoTHubTransport_MQTT_Common_Destroy(TRANSPORT_LL_HANDLE handle)
             sendMsgComplete(mqttMsgEntry->iotHubMessageEntry, transport_data, IOTHUB_CLIENT_CONFIRMATION_BECAUSE_DESTROY);
             free(mqttMsgEntry);
         }
+        packet_id_table_deinitialize(&transport_data->telemetry_waitingForAck_by_packet_id);
+        timeout_heap_initialize(&transport_data->telemetry_ack_timeouts);
         while (!DList_IsListEmpty(&transport_data->ack_waiting_queue))
         {
             PDLIST_ENTRY currentEntry = DList_RemoveHeadList(&transport_data->ack_waiting_queue);
@@ -2757,8 +3251,9 @@ void IoTHubTransport_MQTT_Common_Destroy(TRANSPORT_LL_HANDLE handle)
                 mqtt_device_twin->userCallback(DEVICE_TWIN_UPDATE_COMPLETE, NULL, 0, mqtt_device_twin->userContext);
             }
 
-            destroy_device_twin_get_message(mqtt_device_twin);
+            destroy_device_twin_get_message(transport_data, mqtt_device_twin);
         }
+        packet_id_table_deinitialize(&transport_data->ack_waiting_queue_by_packet_id);
         while (!DList_IsListEmpty(&transport_data->pending_get_twin_queue))
         {
             PDLIST_ENTRY currentEntry = DList_RemoveHeadList(&transport_data->pending_get_twin_queue);
@@ -2767,7 +3262,7 @@ void IoTHubTransport_MQTT_Common_Destroy(TRANSPORT_LL_HANDLE handle)
 
             mqtt_device_twin->userCallback(DEVICE_TWIN_UPDATE_COMPLETE, NULL, 0, mqtt_device_twin->userContext);
 
-            destroy_device_twin_get_message(mqtt_device_twin);
+            destroy_device_twin_get_message(transport_data, mqtt_device_twin);
         }
 
         /* Codes_SRS_IOTHUB_MQTT_TRANSPORT_07_014: [IoTHubTransport_MQTT_Common_Destroy shall free all the resources currently in use.] */
@@ -2827,6 +3322,7 @@ void IoTHubTransport_MQTT_Common_Unsubscribe_DeviceTwin(TRANSPORT_LL_HANDLE hand
         {
             /* Codes_SRS_IOTHUB_MQTT_TRANSPORT_07_049: [If subscribe_state is set to IOTHUB_DEVICE_TWIN_DESIRED_STATE then IoTHubTransport_MQTT_Common_Unsubscribe_DeviceTwin shall unsubscribe from the topic_GetState to the mqtt client.] */
             transport_data->topics_ToSubscribe &= ~SUBSCRIBE_GET_REPORTED_STATE_TOPIC;
+            transport_data->topics_Subscribed &= ~SUBSCRIBE_GET_REPORTED_STATE_TOPIC;
             STRING_delete(transport_data->topic_GetState);
             transport_data->topic_GetState = NULL;
         }
@@ -2834,6 +3330,7 @@ void IoTHubTransport_MQTT_Common_Unsubscribe_DeviceTwin(TRANSPORT_LL_HANDLE hand
         {
             /* Codes_SRS_IOTHUB_MQTT_TRANSPORT_07_050: [If subscribe_state is set to IOTHUB_DEVICE_TWIN_NOTIFICATION_STATE then IoTHubTransport_MQTT_Common_Unsubscribe_DeviceTwin shall unsubscribe from the topic_NotifyState to the mqtt client.] */
             transport_data->topics_ToSubscribe &= ~SUBSCRIBE_NOTIFICATION_STATE_TOPIC;
+            transport_data->topics_Subscribed &= ~SUBSCRIBE_NOTIFICATION_STATE_TOPIC;
             STRING_delete(transport_data->topic_NotifyState);
             transport_data->topic_NotifyState = NULL;
         }
@@ -2868,7 +3365,7 @@ IOTHUB_CLIENT_RESULT IoTHubTransport_MQTT_Common_GetTwinAsync(IOTHUB_DEVICE_HAND
         else if (tickcounter_get_current_ms(transport_data->msgTickCounter, &mqtt_info->msgCreationTime) != 0)
         {
             LogError("Failed setting the get twin request enqueue time");
-            destroy_device_twin_get_message(mqtt_info);
+            destroy_device_twin_get_message(transport_data, mqtt_info);
             // Codes_SRS_IOTHUB_MQTT_TRANSPORT_09_003: [ If any failure occurs, IoTHubTransport_MQTT_Common_GetTwinAsync shall return IOTHUB_CLIENT_ERROR ]
             result = IOTHUB_CLIENT_ERROR;
         }
@@ -2879,6 +3376,7 @@ IOTHUB_CLIENT_RESULT IoTHubTransport_MQTT_Common_GetTwinAsync(IOTHUB_DEVICE_HAND
 
             // Codes_SRS_IOTHUB_MQTT_TRANSPORT_09_002: [ The request shall be queued to be sent when the transport is connected, through DoWork ]
             DList_InsertTailList(&transport_data->pending_get_twin_queue, &mqtt_info->entry);
+            schedule_device_twin_request_timeout(transport_data, mqtt_info);
 
             // Codes_SRS_IOTHUB_MQTT_TRANSPORT_09_004: [ If no failure occurs, IoTHubTransport_MQTT_Common_GetTwinAsync shall return IOTHUB_CLIENT_OK ]
             result = IOTHUB_CLIENT_OK;
@@ -2957,6 +3455,7 @@ void IoTHubTransport_MQTT_Common_Unsubscribe_DeviceMethod(TRANSPORT_LL_HANDLE ha
             STRING_delete(transport_data->topic_DeviceMethods);
             transport_data->topic_DeviceMethods = NULL;
             transport_data->topics_ToSubscribe &= ~SUBSCRIBE_DEVICE_METHOD_TOPIC;
+            transport_data->topics_Subscribed &= ~SUBSCRIBE_DEVICE_METHOD_TOPIC;
         }
     }
     else
@@ -3061,6 +3560,7 @@ void IoTHubTransport_MQTT_Common_Unsubscribe(TRANSPORT_LL_HANDLE handle)
         STRING_delete(transport_data->topic_MqttMessage);
         transport_data->topic_MqttMessage = NULL;
         transport_data->topics_ToSubscribe &= ~SUBSCRIBE_TELEMETRY_TOPIC;
+        transport_data->topics_Subscribed &= ~SUBSCRIBE_TELEMETRY_TOPIC;
     }
     else
     {
@@ -3096,18 +3596,22 @@ IOTHUB_PROCESS_ITEM_RESULT IoTHubTransport_MQTT_Common_ProcessItem(TRANSPORT_LL_
                 {
                     /*Codes_SRS_IOTHUBCLIENT_LL_07_003: [ IoTHubTransport_MQTT_Common_ProcessItem shall publish a message to the mqtt protocol with the message topic for the message type.]*/
                     /* Codes_SRS_IOTHUBCLIENT_LL_07_005: [ If successful IoTHubTransport_MQTT_Common_ProcessItem shall add mqtt info structure acknowledgement queue. ] */
-                    DList_InsertTailList(&transport_data->ack_waiting_queue, &mqtt_info->entry);
-
-                    if (publish_device_twin_message(transport_data, iothub_item->device_twin, mqtt_info) != 0)
+                    if (add_device_twin_request_to_ack_waiting_queue(transport_data, mqtt_info) != 0)
                     {
-                        DList_RemoveEntryList(&mqtt_info->entry);
-
-                        free(mqtt_info);
+                        destroy_device_twin_get_message(transport_data, mqtt_info);
+                        /* Codes_SRS_IOTHUBCLIENT_LL_07_004: [ If any errors are encountered IoTHubTransport_MQTT_Common_ProcessItem shall return IOTHUB_PROCESS_ERROR. ]*/
+                        result = IOTHUB_PROCESS_ERROR;
+                    }
+                    else if (publish_device_twin_message(transport_data, iothub_item->device_twin, mqtt_info) != 0)
+                    {
+                        remove_device_twin_request_from_queue(transport_data, mqtt_info);
+                        destroy_device_twin_get_message(transport_data, mqtt_info);
                         /* Codes_SRS_IOTHUBCLIENT_LL_07_004: [ If any errors are encountered IoTHubTransport_MQTT_Common_ProcessItem shall return IOTHUB_PROCESS_ERROR. ]*/
                         result = IOTHUB_PROCESS_ERROR;
                     }
                     else
                     {
+                        schedule_device_twin_request_timeout(transport_data, mqtt_info);
                         result = IOTHUB_PROCESS_OK;
                     }
                 }
@@ -3159,12 +3663,13 @@ void IoTHubTransport_MQTT_Common_DoWork(TRANSPORT_LL_HANDLE handle)
                     }
                     else if (publish_device_twin_get_message(transport_data, mqtt_info) == 0)
                     {
+                        schedule_device_twin_request_timeout(transport_data, mqtt_info);
                         transport_data->device_twin_get_sent = true;
                     }
                     else
                     {
                         LogError("Failure: sending device twin get property command.");
-                        destroy_device_twin_get_message(mqtt_info);
+                        destroy_device_twin_get_message(transport_data, mqtt_info);
                     }
                 }
                 // Publish can be called now
@@ -3173,8 +3678,11 @@ void IoTHubTransport_MQTT_Common_DoWork(TRANSPORT_LL_HANDLE handle)
             else if (transport_data->currPacketState == PUBLISH_TYPE)
             {
                 PDLIST_ENTRY currentListEntry = transport_data->waitingToSend->Flink;
+                size_t published_messages = 0;
+                size_t published_bytes = 0;
+                bool can_publish = true;
                 /* Codes_SRS_IOTHUB_MQTT_TRANSPORT_07_027: [IoTHubTransport_MQTT_Common_DoWork shall inspect the "waitingToSend" DLIST passed in config structure.] */
-                while (currentListEntry != transport_data->waitingToSend)
+                while (currentListEntry != transport_data->waitingToSend && can_publish)
                 {
                     IOTHUB_MESSAGE_LIST* iothubMsgList = containingRecord(currentListEntry, IOTHUB_MESSAGE_LIST, entry);
                     DLIST_ENTRY savedFromCurrentListEntry;
@@ -3183,27 +3691,74 @@ void IoTHubTransport_MQTT_Common_DoWork(TRANSPORT_LL_HANDLE handle)
                     /* Codes_SRS_IOTHUB_MQTT_TRANSPORT_07_027: [IoTHubTransport_MQTT_Common_DoWork shall inspect the "waitingToSend" DLIST passed in config structure.] */
                     size_t messageLength;
                     const unsigned char* messagePayload = NULL;
-                    if (!RetrieveMessagePayload(iothubMsgList->messageHandle, &messagePayload, &messageLength))
+                    /* Codes_SRS_IOTHUB_TRANSPORT_MQTT_COMMON_44_007: [ If `mqtt_max_inflight` is set and as many telemetry messages are waiting for their PUBACK, IoTHubTransport_MQTT_Common_DoWork shall leave the remaining messages in waitingToSend, unless `mqtt_telemetry_at_most_once` is set. ] */
+                    if (!transport_data->telemetry_at_most_once &&
+                        transport_data->max_inflight != 0 && transport_data->telemetry_waitingForAck_by_packet_id.count >= transport_data->max_inflight)
+                    {
+                        can_publish = false;
+                    }
+                    else if (!RetrieveMessagePayload(iothubMsgList->messageHandle, &messagePayload, &messageLength))
                     {
                         (void)(DList_RemoveEntryList(currentListEntry));
                         sendMsgComplete(iothubMsgList, transport_data, IOTHUB_CLIENT_CONFIRMATION_ERROR);
                         LogError("Failure result from IoTHubMessage_GetData");
                     }
+                    /* Codes_SRS_IOTHUB_TRANSPORT_MQTT_COMMON_44_009: [ If `mqtt_publish_budget_bytes` is set and a message would take the payload bytes published by this call over it, IoTHubTransport_MQTT_Common_DoWork shall leave the remaining messages in waitingToSend, unless no message was published yet. ] */
+                    else if (transport_data->publish_budget_bytes != 0 && published_messages != 0 &&
+                        (published_bytes >= transport_data->publish_budget_bytes || messageLength > transport_data->publish_budget_bytes - published_bytes))
+                    {
+                        can_publish = false;
+                    }
+                    /* Codes_SRS_IOTHUB_TRANSPORT_MQTT_COMMON_44_011: [ If `mqtt_telemetry_at_most_once` is set, IoTHubTransport_MQTT_Common_DoWork shall publish telemetry with QoS 0 and complete each message as soon as `mqtt_client_publish` returns, with IOTHUB_CLIENT_CONFIRMATION_OK on success and IOTHUB_CLIENT_CONFIRMATION_ERROR otherwise, without waiting for a PUBACK. ] */
+                    else if (transport_data->telemetry_at_most_once)
+                    {
+                        (void)(DList_RemoveEntryList(currentListEntry));
+                        if (publish_mqtt_telemetry_msg_at_most_once(transport_data, iothubMsgList->messageHandle, messagePayload, messageLength) != 0)
+                        {
+                            sendMsgComplete(iothubMsgList, transport_data, IOTHUB_CLIENT_CONFIRMATION_ERROR);
+                        }
+                        else
+                        {
+                            sendMsgComplete(iothubMsgList, transport_data, IOTHUB_CLIENT_CONFIRMATION_OK);
+                            can_publish = add_to_publish_budget(transport_data, &published_messages, &published_bytes, messageLength);
+                        }
+                    }
                     else
                     {
                         /* Codes_SRS_IOTHUB_MQTT_TRANSPORT_07_029: [IoTHubTransport_MQTT_Common_DoWork shall create a MQTT_MESSAGE_HANDLE and pass this to a call to mqtt_client_publish.] */
-                        MQTT_MESSAGE_DETAILS_LIST* mqttMsgEntry = (MQTT_MESSAGE_DETAILS_LIST*)malloc(sizeof(MQTT_MESSAGE_DETAILS_LIST));
-                        if (mqttMsgEntry == NULL)
+                        const char* msgTopic = addPropertiesTouMqttMessage(transport_data, iothubMsgList->messageHandle, transport_data->auto_url_encode_decode);
+                        MQTT_MESSAGE_DETAILS_LIST* mqttMsgEntry;
+                        if (msgTopic == NULL)
+                        {
+                            LogError("Failed adding properties to mqtt message");
+                            (void)(DList_RemoveEntryList(currentListEntry));
+                            sendMsgComplete(iothubMsgList, transport_data, IOTHUB_CLIENT_CONFIRMATION_ERROR);
+                        }
+                        /* Codes_SRS_IOTHUB_TRANSPORT_MQTT_COMMON_44_017: [ IoTHubTransport_MQTT_Common_DoWork shall save the telemetry topic of a message in the same allocation as its MQTT_MESSAGE_DETAILS_LIST entry, so resending the message does not build its topic again. ] */
+                        else if ((mqttMsgEntry = (MQTT_MESSAGE_DETAILS_LIST*)malloc(sizeof(MQTT_MESSAGE_DETAILS_LIST) + transport_data->telemetry_topic_length + 1)) == NULL)
                         {
                             LogError("Allocation Error: Failure allocating MQTT Message Detail List.");
+                            /*the message stays at the head of waitingToSend, the client expects messages to be taken from there in order*/
+                            can_publish = false;
                         }
                         else
                         {
+                            mqttMsgEntry->topic = (char*)(mqttMsgEntry + 1);
+                            (void)memcpy(mqttMsgEntry->topic, msgTopic, transport_data->telemetry_topic_length + 1);
                             mqttMsgEntry->retryCount = 0;
                             mqttMsgEntry->iotHubMessageEntry = iothubMsgList;
-                            mqttMsgEntry->packet_id = get_next_packet_id(transport_data);
-                            if (publish_mqtt_telemetry_msg(transport_data, mqttMsgEntry, messagePayload, messageLength) != 0)
+                            /* Codes_SRS_IOTHUB_TRANSPORT_MQTT_COMMON_44_004: [ If the message cannot be indexed by its packet id, IoTHubTransport_MQTT_Common_DoWork shall complete it with IOTHUB_CLIENT_CONFIRMATION_ERROR without publishing it. ] */
+                            if (get_next_free_packet_id(transport_data, &transport_data->telemetry_waitingForAck_by_packet_id, &mqttMsgEntry->packet_id) != 0 ||
+                                packet_id_table_insert(&transport_data->telemetry_waitingForAck_by_packet_id, mqttMsgEntry->packet_id, mqttMsgEntry) != 0)
                             {
+                                LogError("Failure indexing the message by its packet id");
+                                (void)(DList_RemoveEntryList(currentListEntry));
+                                sendMsgComplete(iothubMsgList, transport_data, IOTHUB_CLIENT_CONFIRMATION_ERROR);
+                                free(mqttMsgEntry);
+                            }
+                            else if (publish_mqtt_telemetry_msg(transport_data, mqttMsgEntry, messagePayload, messageLength) != 0)
+                            {
+                                (void)packet_id_table_remove(&transport_data->telemetry_waitingForAck_by_packet_id, mqttMsgEntry->packet_id);
                                 (void)(DList_RemoveEntryList(currentListEntry));
                                 sendMsgComplete(iothubMsgList, transport_data, IOTHUB_CLIENT_CONFIRMATION_ERROR);
                                 free(mqttMsgEntry);
@@ -3214,6 +3769,8 @@ void IoTHubTransport_MQTT_Common_DoWork(TRANSPORT_LL_HANDLE handle)
                                 (void)(DList_RemoveEntryList(currentListEntry));
                                 // and add it to the ack queue
                                 DList_InsertTailList(&(transport_data->telemetry_waitingForAck), &(mqttMsgEntry->entry));
+                                schedule_telemetry_ack_timeout(transport_data, mqttMsgEntry);
+                                can_publish = add_to_publish_budget(transport_data, &published_messages, &published_bytes, messageLength);
                             }
                         }
                     }
@@ -3297,6 +3854,34 @@ IOTHUB_CLIENT_RESULT IoTHubTransport_MQTT_Common_SetOption(TRANSPORT_LL_HANDLE h
             transport_data->auto_url_encode_decode = *((bool*)value);
             result = IOTHUB_CLIENT_OK;
         }
+        /* Codes_SRS_IOTHUB_TRANSPORT_MQTT_COMMON_44_010: [ If the option parameter is set to "mqtt_max_inflight", "mqtt_publish_budget_messages" or "mqtt_publish_budget_bytes" then the value shall be a size_t* and IoTHubTransport_MQTT_Common_SetOption shall save it and return IOTHUB_CLIENT_OK. ] */
+        else if (strcmp(OPTION_MQTT_MAX_INFLIGHT, option) == 0)
+        {
+            transport_data->max_inflight = *((size_t*)value);
+            result = IOTHUB_CLIENT_OK;
+        }
+        else if (strcmp(OPTION_MQTT_PUBLISH_BUDGET_MESSAGES, option) == 0)
+        {
+            transport_data->publish_budget_messages = *((size_t*)value);
+            result = IOTHUB_CLIENT_OK;
+        }
+        else if (strcmp(OPTION_MQTT_PUBLISH_BUDGET_BYTES, option) == 0)
+        {
+            transport_data->publish_budget_bytes = *((size_t*)value);
+            result = IOTHUB_CLIENT_OK;
+        }
+        /* Codes_SRS_IOTHUB_TRANSPORT_MQTT_COMMON_44_012: [ If the option parameter is set to "mqtt_telemetry_at_most_once" then the value shall be a bool* and IoTHubTransport_MQTT_Common_SetOption shall save it and return IOTHUB_CLIENT_OK. ] */
+        else if (strcmp(OPTION_MQTT_TELEMETRY_AT_MOST_ONCE, option) == 0)
+        {
+            transport_data->telemetry_at_most_once = *((bool*)value);
+            result = IOTHUB_CLIENT_OK;
+        }
+        /* Codes_SRS_IOTHUB_TRANSPORT_MQTT_COMMON_44_026: [ If the option parameter is set to "mqtt_persistent_session" then the value shall be a bool* and IoTHubTransport_MQTT_Common_SetOption shall save it and return IOTHUB_CLIENT_OK. ] */
+        else if (strcmp(OPTION_MQTT_PERSISTENT_SESSION, option) == 0)
+        {
+            transport_data->persistent_session = *((bool*)value);
+            result = IOTHUB_CLIENT_OK;
+        }
         else if (strcmp(OPTION_CONNECTION_TIMEOUT, option) == 0)
         {
             int* connection_time = (int*)value;
@@ -3627,6 +4212,14 @@ int IoTHubTransport_MQTT_Common_Subscribe_InputQueue(TRANSPORT_LL_HANDLE handle)
         LogError("Failure constructing Message Topic");
         result = MU_FAILURE;
     }
+    // Codes_SRS_IOTHUB_TRANSPORT_MQTT_COMMON_44_020: [ IoTHubTransport_MQTT_Common_Subscribe_InputQueue shall add the input queue topic, without its trailing `#`, to the prefix trie classifying received topics as IOTHUB_TYPE_EVENT_QUEUE, and fail if it cannot. ]
+    else if (add_input_queue_to_inbound_topics(transport_data) != 0)
+    {
+        LogError("Failure adding the input queue topic to the received topics");
+        STRING_delete(transport_data->topic_InputQueue);
+        transport_data->topic_InputQueue = NULL;
+        result = MU_FAILURE;
+    }
     else
     {
         // Codes_SRS_IOTHUB_TRANSPORT_MQTT_COMMON_31_067: [ IoTHubTransport_MQTT_Common_Subscribe_InputQueue shall set a flag to enable mqtt_client_subscribe to be called to subscribe to the input queue Message Topic.]
@@ -3653,6 +4246,9 @@ void IoTHubTransport_MQTT_Common_Unsubscribe_InputQueue(TRANSPORT_LL_HANDLE hand
         STRING_delete(transport_data->topic_InputQueue);
         transport_data->topic_InputQueue = NULL;
         transport_data->topics_ToSubscribe &= ~SUBSCRIBE_INPUT_QUEUE_TOPIC;
+        transport_data->topics_Subscribed &= ~SUBSCRIBE_INPUT_QUEUE_TOPIC;
+        // Codes_SRS_IOTHUB_TRANSPORT_MQTT_COMMON_44_021: [ IoTHubTransport_MQTT_Common_Unsubscribe_InputQueue shall remove the input queue topic from the prefix trie classifying received topics. ]
+        initialize_inbound_topics(transport_data);
     }
     else
     {
@@ -3695,3 +4291,28 @@ int IoTHubTransport_MQTT_GetSupportedPlatformInfo(TRANSPORT_LL_HANDLE handle, PL
 
     return result;
 }
+
+IOTHUB_CLIENT_RESULT IoTHubTransport_MQTT_Common_GetRttStatistics(TRANSPORT_LL_HANDLE handle, IOTHUB_CLIENT_RTT_STATISTICS* rttStatistics)
+{
+    IOTHUB_CLIENT_RESULT result;
+
+    // Codes_SRS_IOTHUB_TRANSPORT_MQTT_COMMON_44_032: [ If handle or rttStatistics are NULL, IoTHubTransport_MQTT_Common_GetRttStatistics shall return IOTHUB_CLIENT_INVALID_ARG. ]
+    if (handle == NULL || rttStatistics == NULL)
+    {
+        LogError("Invalid parameter specified (handle: %p, rttStatistics: %p)", handle, rttStatistics);
+        result = IOTHUB_CLIENT_INVALID_ARG;
+    }
+    else
+    {
+        PMQTTTRANSPORT_HANDLE_DATA transport_data = (PMQTTTRANSPORT_HANDLE_DATA)handle;
+
+        // Codes_SRS_IOTHUB_TRANSPORT_MQTT_COMMON_44_016: [ IoTHubTransport_MQTT_Common_GetRttStatistics shall fill rttStatistics with the round trip time measured on the connection and return IOTHUB_CLIENT_OK. ]
+        rttStatistics->smoothed_rtt_ms = (size_t)transport_data->smoothed_rtt_ms;
+        rttStatistics->rtt_variance_ms = (size_t)transport_data->rtt_variance_ms;
+        rttStatistics->resend_timeout_ms = (size_t)transport_data->resend_timeout_ms;
+        rttStatistics->sample_count = transport_data->rtt_sample_count;
+        result = IOTHUB_CLIENT_OK;
+    }
+
+    return result;
+}
@@ -187,6 +187,15 @@ static int IoTHubTransportAMQP_GetSupportedPlatformInfo(TRANSPORT_LL_HANDLE hand
     return IoTHubTransport_AMQP_Common_GetSupportedPlatformInfo(handle, info);
 }
 
+static IOTHUB_CLIENT_RESULT IoTHubTransportAMQP_GetRttStatistics(TRANSPORT_LL_HANDLE handle, IOTHUB_CLIENT_RTT_STATISTICS* rttStatistics)
+{
+    // Codes_SRS_IOTHUBTRANSPORTAMQP_44_001: [IoTHubTransportAMQP_GetRttStatistics shall return IOTHUB_CLIENT_ERROR as the round trip time is only measured by MQTT]
+    (void)handle;
+    (void)rttStatistics;
+    LogError("AMQP does not measure the round trip time");
+    return IOTHUB_CLIENT_ERROR;
+}
+
 static TRANSPORT_PROVIDER thisTransportProvider =
 {
     IoTHubTransportAMQP_SendMessageDisposition,     /*pfIotHubTransport_Send_Message_Disposition IoTHubTransport_Send_Message_Disposition;*/
@@ -211,7 +220,8 @@ static TRANSPORT_PROVIDER thisTransportProvider =
     IotHubTransportAMQP_Unsubscribe_InputQueue,     /*pfIoTHubTransport_Unsubscribe_InputQueue IoTHubTransport_Unsubscribe_InputQueue; */
     IoTHubTransportAMQP_SetCallbackContext,         /*pfIoTHubTransport_SetTransportCallbacks IoTHubTransport_SetTransportCallbacks; */
     IoTHubTransportAMQP_GetTwinAsync,               /*pfIoTHubTransport_GetTwinAsync IoTHubTransport_GetTwinAsync;*/
-    IoTHubTransportAMQP_GetSupportedPlatformInfo      /*pfIoTHubTransport_GetSupportedPlatformInfo IoTHubTransport_GetSupportedPlatformInfo;*/
+    IoTHubTransportAMQP_GetSupportedPlatformInfo,     /*pfIoTHubTransport_GetSupportedPlatformInfo IoTHubTransport_GetSupportedPlatformInfo;*/
+    IoTHubTransportAMQP_GetRttStatistics            /*pfIoTHubTransport_GetRttStatistics IoTHubTransport_GetRttStatistics;*/
 };
 
 /* Codes_SRS_IOTHUBTRANSPORTAMQP_09_019: [This function shall return a pointer to a structure of type TRANSPORT_PROVIDER having the following values for it's fields:
@@ -229,7 +239,8 @@ IoTHubTransport_Unsubscribe = IoTHubTransportAMQP_Unsubscribe
 IoTHubTransport_DoWork = IoTHubTransportAMQP_DoWork
 IoTHubTransport_SetRetryPolicy = IoTHubTransportAMQP_SetRetryPolicy
 IoTHubTransport_SetOption = IoTHubTransportAMQP_SetOption
-IoTHubTransport_GetSupportedPlatformInfo = IoTHubTransportAMQP_GetSupportedPlatformInfo]*/
+IoTHubTransport_GetSupportedPlatformInfo = IoTHubTransportAMQP_GetSupportedPlatformInfo
+IoTHubTransport_GetRttStatistics = IoTHubTransportAMQP_GetRttStatistics]*/
 extern const TRANSPORT_PROVIDER* AMQP_Protocol(void)
 {
     return &thisTransportProvider;
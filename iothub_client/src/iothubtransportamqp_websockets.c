@@ -239,6 +239,15 @@ static int IoTHubTransportAMQP_WS_GetSupportedPlatformInfo(TRANSPORT_LL_HANDLE h
     return IoTHubTransport_AMQP_Common_GetSupportedPlatformInfo(handle, info);
 }
 
+static IOTHUB_CLIENT_RESULT IoTHubTransportAMQP_WS_GetRttStatistics(TRANSPORT_LL_HANDLE handle, IOTHUB_CLIENT_RTT_STATISTICS* rttStatistics)
+{
+    // Codes_SRS_IOTHUBTRANSPORTAMQP_WS_44_001: [IoTHubTransportAMQP_WS_GetRttStatistics shall return IOTHUB_CLIENT_ERROR as the round trip time is only measured by MQTT]
+    (void)handle;
+    (void)rttStatistics;
+    LogError("AMQP does not measure the round trip time");
+    return IOTHUB_CLIENT_ERROR;
+}
+
 static TRANSPORT_PROVIDER thisTransportProvider_WebSocketsOverTls =
 {
     IoTHubTransportAMQP_WS_SendMessageDisposition,                     /*pfIotHubTransport_Send_Message_Disposition IoTHubTransport_Send_Message_Disposition;*/
@@ -263,7 +272,8 @@ static TRANSPORT_PROVIDER thisTransportProvider_WebSocketsOverTls =
     IotHubTransportAMQP_WS_Unsubscribe_InputQueue,                     /*pfIoTHubTransport_Unsubscribe_InputQueue IoTHubTransport_Unsubscribe_InputQueue; */
     IoTHubTransportAMQP_WS_SetCallbackContext,                         /*pfIoTHubTransport_SetCallbackContext IoTHubTransport_SetCallbackContext; */
     IoTHubTransportAMQP_WS_GetTwinAsync,                               /*pfIoTHubTransport_GetTwinAsync IoTHubTransport_GetTwinAsync;*/
-    IoTHubTransportAMQP_WS_GetSupportedPlatformInfo                         /*pfIoTHubTransport_GetSupportedPlatformInfo IoTHubTransport_GetSupportedPlatformInfo;*/
+    IoTHubTransportAMQP_WS_GetSupportedPlatformInfo,                        /*pfIoTHubTransport_GetSupportedPlatformInfo IoTHubTransport_GetSupportedPlatformInfo;*/
+    IoTHubTransportAMQP_WS_GetRttStatistics                            /*pfIoTHubTransport_GetRttStatistics IoTHubTransport_GetRttStatistics;*/
 };
 
 /* Codes_SRS_IoTHubTransportAMQP_WS_09_019: [This function shall return a pointer to a structure of type TRANSPORT_PROVIDER having the following values for it's fields:
@@ -284,7 +294,8 @@ IoTHubTransport_DoWork = IoTHubTransportAMQP_WS_DoWork
 IoTHubTransport_SetRetryLogic = IoTHubTransportAMQP_WS_SetRetryLogic
 IoTHubTransport_SetOption = IoTHubTransportAMQP_WS_SetOption
 IoTHubTransport_GetSendStatus = IoTHubTransportAMQP_WS_GetSendStatus
-IoTHubTransport_GetSupportedPlatformInfo = IoTHubTransportAMQP_WS_GetSupportedPlatformInfo] */
+IoTHubTransport_GetSupportedPlatformInfo = IoTHubTransportAMQP_WS_GetSupportedPlatformInfo
+IoTHubTransport_GetRttStatistics = IoTHubTransportAMQP_WS_GetRttStatistics] */
 extern const TRANSPORT_PROVIDER* AMQP_Protocol_over_WebSocketsTls(void)
 {
     return &thisTransportProvider_WebSocketsOverTls;
@@ -2,6 +2,8 @@
 // Licensed under the MIT license. See LICENSE file in the project root for full license information.
 
 #include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
 #include "azure_c_shared_utility/gballoc.h"
 
 #include <time.h>
@@ -18,14 +20,17 @@
 #include "azure_c_shared_utility/httpapiexsas.h"
 #include "azure_c_shared_utility/urlencode.h"
 #include "azure_c_shared_utility/xlogging.h"
+#include "azure_c_shared_utility/httpapi.h"
 #include "azure_c_shared_utility/httpapiex.h"
 #include "azure_c_shared_utility/httpapiexsas.h"
 #include "azure_c_shared_utility/strings.h"
-#include "azure_c_shared_utility/azure_base64.h"
 #include "azure_c_shared_utility/doublylinkedlist.h"
 #include "azure_c_shared_utility/vector.h"
 #include "azure_c_shared_utility/httpheaders.h"
 #include "azure_c_shared_utility/agenttime.h"
+#include "azure_c_shared_utility/threadapi.h"
+#include "azure_c_shared_utility/lock.h"
+#include "azure_c_shared_utility/condition.h"
 
 #define IOTHUB_APP_PREFIX "iothub-app-"
 static const char* IOTHUB_MESSAGE_ID = "iothub-messageid";
@@ -49,19 +54,52 @@ static const char* IOTHUB_AUTH_HEADER_VALUE = "Authorization";
 /*the default is 25 minutes*/
 #define DEFAULT_GETMINIMUMPOLLINGTIME ((unsigned int)25*60)
 
+/*DEFAULT_GETMAXIMUMPOLLINGTIME is the longest time in seconds adaptive polling backs off to when the device queue is empty*/
+/*the default matches the fixed polling time, so the worst case latency does not change when adaptive polling is turned on*/
+#define DEFAULT_GETMAXIMUMPOLLINGTIME DEFAULT_GETMINIMUMPOLLINGTIME
+
+/*MAXIMUM_HTTP_CONNECTION_POOL_SIZE caps how many connections (and so DoWork threads) a transport may use*/
+#define MAXIMUM_HTTP_CONNECTION_POOL_SIZE 64
+
 #define MAXIMUM_MESSAGE_SIZE (255*1024-1)
 #define MAXIMUM_PAYLOAD_OVERHEAD 384
 #define MAXIMUM_PROPERTY_OVERHEAD 16
+#define BATCH_PAYLOAD_INITIAL_SIZE 1024
+
+/*one connection of the pool; connection k serves devices k, k + connectionCount, k + 2*connectionCount...*/
+typedef struct HTTPTRANSPORT_CONNECTION_TAG
+{
+    struct HTTPTRANSPORT_HANDLE_DATA_TAG* handleData;
+    HTTPAPIEX_HANDLE httpApiExHandle;
+    size_t index;
+    THREAD_HANDLE threadHandle; /*started by the first DoWork, serves the connection until the pool is destroyed*/
+    LOCK_HANDLE lock; /*created with threadHandle, guards hasWork and stopThread*/
+    COND_HANDLE condition; /*posted when a pass is handed to the thread, and when the thread is done with it*/
+    bool hasWork;
+    bool stopThread;
+} HTTPTRANSPORT_CONNECTION;
+
+/*used by unittests only*/
+const size_t IoTHubTransportHttp_ConnectionWorkOffset = offsetof(HTTPTRANSPORT_CONNECTION, hasWork);
 
-/*forward declaration*/
-static int appendMapToJSON(STRING_HANDLE existing, const char* const* keys, const char* const* values, size_t count);
+/*an option passed down to HTTPAPIEX, kept so it can be replayed on connections created later*/
+typedef struct HTTPTRANSPORT_SAVED_OPTION_TAG
+{
+    char* name;
+    const void* value;
+} HTTPTRANSPORT_SAVED_OPTION;
 
 typedef struct HTTPTRANSPORT_HANDLE_DATA_TAG
 {
     STRING_HANDLE hostName;
     HTTPAPIEX_HANDLE httpApiExHandle;
+    HTTPTRANSPORT_CONNECTION* connections; /*NULL when the pool size is 1, connections[0] always reuses httpApiExHandle*/
+    size_t connectionCount;
+    VECTOR_HANDLE savedOptions;
     bool doBatchedTransfers;
     unsigned int getMinimumPollingTime;
+    unsigned int getMaximumPollingTime;
+    bool doAdaptivePolling;
     VECTOR_HANDLE perDeviceList;
 
     TRANSPORT_CALLBACKS_INFO transport_callbacks;
@@ -78,13 +116,23 @@ typedef struct HTTPTRANSPORT_PERDEVICE_DATA_TAG
     STRING_HANDLE deviceSasToken;
     STRING_HANDLE eventHTTPrelativePath;
     STRING_HANDLE messageHTTPrelativePath;
-    HTTP_HEADERS_HANDLE eventHTTPrequestHeaders;
+    HTTP_HEADERS_HANDLE eventHTTPrequestHeaders; /*pre-rendered for batches, "Content-Type" is "application/vnd.microsoft.iothub.json"*/
+    HTTP_HEADERS_HANDLE singleEventHTTPrequestHeaders; /*pre-rendered for single events, "Content-Type" is "application/octet-stream"*/
     HTTP_HEADERS_HANDLE messageHTTPrequestHeaders;
+    char* appPropertyName; /*reused to build "iothub-app-" header names*/
+    size_t appPropertyNameSize;
     STRING_HANDLE abandonHTTPrelativePathBegin;
     HTTPAPIEX_SAS_HANDLE sasObject;
+    HTTPAPIEX_HANDLE httpApiExHandle; /*connection of the pool that last served this device*/
     bool DoWork_PullMessage;
     time_t lastPollTime;
     bool isFirstPoll;
+    unsigned int adaptivePollingTime; /*current back off of adaptive polling, in seconds*/
+    bool hasPendingMessages; /*the last GET returned a message, so more are likely queued*/
+    bool deferCallbacks; /*set while a thread of the pool serves the device, its callbacks then run on the DoWork thread once the pass is over*/
+    bool hasPendingConfirmation;
+    IOTHUB_CLIENT_CONFIRMATION_RESULT pendingConfirmationResult;
+    MESSAGE_CALLBACK_INFO* pendingMessage;
 
     void* device_transport_ctx;
     PDLIST_ENTRY waitingToSend;
@@ -245,39 +293,62 @@ static int retrieve_message_properties(HTTP_HEADERS_HANDLE resp_header, IOTHUB_M
     return result;
 }
 
-static int set_system_properties(IOTHUB_MESSAGE_LIST* message, HTTP_HEADERS_HANDLE headers)
+/*system properties of a message that become per-message HTTP headers*/
+typedef struct MESSAGE_SYSTEM_PROPERTIES_TAG
 {
-    int result;
-    const char* msgId;
-    const char* corrId;
-    const char* content_type;
+    const char* messageId;
+    const char* correlationId;
+    const char* contentType;
     const char* contentEncoding;
+    bool isSecurityMessage;
+} MESSAGE_SYSTEM_PROPERTIES;
+
+static void get_system_properties(IOTHUB_MESSAGE_LIST* message, MESSAGE_SYSTEM_PROPERTIES* properties)
+{
+    properties->messageId = IoTHubMessage_GetMessageId(message->messageHandle);
+    properties->correlationId = IoTHubMessage_GetCorrelationId(message->messageHandle);
+    properties->contentType = IoTHubMessage_GetContentTypeSystemProperty(message->messageHandle);
+    properties->contentEncoding = IoTHubMessage_GetContentEncodingSystemProperty(message->messageHandle);
+    properties->isSecurityMessage = IoTHubMessage_IsSecurityMessage(message->messageHandle);
+}
+
+static bool has_system_properties(const MESSAGE_SYSTEM_PROPERTIES* properties)
+{
+    return (properties->messageId != NULL) ||
+        (properties->correlationId != NULL) ||
+        (properties->contentType != NULL) ||
+        (properties->contentEncoding != NULL) ||
+        properties->isSecurityMessage;
+}
+
+static int set_system_properties(const MESSAGE_SYSTEM_PROPERTIES* properties, HTTP_HEADERS_HANDLE headers)
+{
+    int result;
 
     // Add the Message Id and the Correlation Id
-    msgId = IoTHubMessage_GetMessageId(message->messageHandle);
-    if (msgId != NULL && HTTPHeaders_ReplaceHeaderNameValuePair(headers, IOTHUB_MESSAGE_ID, msgId) != HTTP_HEADERS_OK)
+    if (properties->messageId != NULL && HTTPHeaders_ReplaceHeaderNameValuePair(headers, IOTHUB_MESSAGE_ID, properties->messageId) != HTTP_HEADERS_OK)
     {
         LogError("unable to HTTPHeaders_ReplaceHeaderNameValuePair");
         result = MU_FAILURE;
     }
-    else if ((corrId = IoTHubMessage_GetCorrelationId(message->messageHandle)) != NULL && HTTPHeaders_ReplaceHeaderNameValuePair(headers, IOTHUB_CORRELATION_ID, corrId) != HTTP_HEADERS_OK)
+    else if (properties->correlationId != NULL && HTTPHeaders_ReplaceHeaderNameValuePair(headers, IOTHUB_CORRELATION_ID, properties->correlationId) != HTTP_HEADERS_OK)
     {
         LogError("unable to HTTPHeaders_ReplaceHeaderNameValuePair");
         result = MU_FAILURE;
     }
     // Codes_SRS_TRANSPORTMULTITHTTP_09_001: [ If the IoTHubMessage being sent contains property `content-type` it shall be added to the HTTP headers as "iothub-contenttype":"value". ]
-    else if ((content_type = IoTHubMessage_GetContentTypeSystemProperty(message->messageHandle)) != NULL && HTTPHeaders_ReplaceHeaderNameValuePair(headers, IOTHUB_CONTENT_TYPE_D2C, content_type) != HTTP_HEADERS_OK)
+    else if (properties->contentType != NULL && HTTPHeaders_ReplaceHeaderNameValuePair(headers, IOTHUB_CONTENT_TYPE_D2C, properties->contentType) != HTTP_HEADERS_OK)
     {
         LogError("unable to HTTPHeaders_ReplaceHeaderNameValuePair (content-type)");
         result = MU_FAILURE;
     }
     // Codes_SRS_TRANSPORTMULTITHTTP_09_002: [ If the IoTHubMessage being sent contains property `content-encoding` it shall be added to the HTTP headers as "iothub-contentencoding":"value". ]
-    else if ((contentEncoding = IoTHubMessage_GetContentEncodingSystemProperty(message->messageHandle)) != NULL && HTTPHeaders_ReplaceHeaderNameValuePair(headers, IOTHUB_CONTENT_ENCODING_D2C, contentEncoding) != HTTP_HEADERS_OK)
+    else if (properties->contentEncoding != NULL && HTTPHeaders_ReplaceHeaderNameValuePair(headers, IOTHUB_CONTENT_ENCODING_D2C, properties->contentEncoding) != HTTP_HEADERS_OK)
     {
         LogError("unable to HTTPHeaders_ReplaceHeaderNameValuePair (content-encoding)");
         result = MU_FAILURE;
     }
-    else if (IoTHubMessage_IsSecurityMessage(message->messageHandle) && HTTPHeaders_ReplaceHeaderNameValuePair(headers, SECURITY_INTERFACE_ID, SECURITY_INTERFACE_ID_VALUE) != HTTP_HEADERS_OK)
+    else if (properties->isSecurityMessage && HTTPHeaders_ReplaceHeaderNameValuePair(headers, SECURITY_INTERFACE_ID, SECURITY_INTERFACE_ID_VALUE) != HTTP_HEADERS_OK)
     {
         LogError("unable to set security message header info");
         result = MU_FAILURE;
@@ -289,58 +360,60 @@ static int set_system_properties(IOTHUB_MESSAGE_LIST* message, HTTP_HEADERS_HAND
     return result;
 }
 
-static bool set_message_properties(IOTHUB_MESSAGE_LIST* message, size_t* msg_size, HTTP_HEADERS_HANDLE headers, HTTPTRANSPORT_HANDLE_DATA* handleData, HTTPTRANSPORT_PERDEVICE_DATA* deviceData)
+static const char* get_app_property_header_name(HTTPTRANSPORT_PERDEVICE_DATA* deviceData, const char* key)
 {
-    bool result = true;
+    /*Codes_SRS_TRANSPORTMULTITHTTP_44_019: [ The "iothub-app-" header names shall be built in a per device buffer that is only reallocated when a longer name is needed. ]*/
+    const char* result;
+    size_t keyLength = strlen(key);
+    size_t neededSize = (sizeof(IOTHUB_APP_PREFIX) - 1) + keyLength + 1;
+    if (neededSize > deviceData->appPropertyNameSize)
+    {
+        char* newName = (char*)realloc(deviceData->appPropertyName, neededSize);
+        if (newName == NULL)
+        {
+            LogError("unable to realloc the app property header name");
+        }
+        else
+        {
+            (void)memcpy(newName, IOTHUB_APP_PREFIX, sizeof(IOTHUB_APP_PREFIX) - 1);
+            deviceData->appPropertyName = newName;
+            deviceData->appPropertyNameSize = neededSize;
+        }
+    }
 
-    /*Codes_SRS_TRANSPORTMULTITHTTP_17_078: [Every message property "property":"value" shall be added to the HTTP headers as an individual header "iothub-app-property":"value".] */
-    MAP_HANDLE map = IoTHubMessage_Properties(message->messageHandle);
-    const char*const* keys;
-    const char*const* values;
-    size_t count;
-    if (Map_GetInternals(map, &keys, &values, &count) != MAP_OK)
-    {
-        /*Codes_SRS_TRANSPORTMULTITHTTP_17_079: [If any HTTP header operation fails, _DoWork shall advance to the next action.] */
-        LogError("unable to Map_GetInternals");
-        result = false;
+    if (neededSize > deviceData->appPropertyNameSize)
+    {
+        result = NULL;
     }
     else
     {
-        for (size_t index = 0; index < count; index++)
+        (void)memcpy(deviceData->appPropertyName + (sizeof(IOTHUB_APP_PREFIX) - 1), key, keyLength + 1);
+        result = deviceData->appPropertyName;
+    }
+    return result;
+}
+
+static bool set_message_properties(const char* const* keys, const char* const* values, size_t count, HTTP_HEADERS_HANDLE headers, HTTPTRANSPORT_PERDEVICE_DATA* deviceData)
+{
+    bool result = true;
+
+    /*Codes_SRS_TRANSPORTMULTITHTTP_17_078: [Every message property "property":"value" shall be added to the HTTP headers as an individual header "iothub-app-property":"value".] */
+    for (size_t index = 0; index < count; index++)
+    {
+        const char* headerName = get_app_property_header_name(deviceData, keys[index]);
+        if (headerName == NULL)
         {
-            /*Codes_SRS_TRANSPORTMULTITHTTP_17_074: [Every property name shall add  to the message size the length of the property name + the length of the property value + 16 bytes.] */
-            *msg_size += (strlen(values[index]) + strlen(keys[index]) + MAXIMUM_PROPERTY_OVERHEAD);
-            if (*msg_size > MAXIMUM_MESSAGE_SIZE)
-            {
-                /*Codes_SRS_TRANSPORTMULTITHTTP_17_072: [The message size shall be limited to 255KB -1 bytes.] */
-                PDLIST_ENTRY head = DList_RemoveHeadList(deviceData->waitingToSend); /*actually this is the same as "actual", but now it is removed*/
-                DList_InsertTailList(&(deviceData->eventConfirmations), head);
-                handleData->transport_callbacks.send_complete_cb(&(deviceData->eventConfirmations), IOTHUB_CLIENT_CONFIRMATION_ERROR, deviceData->device_transport_ctx); // takes care of emptying the list too
-                result = false;
-                break;
-            }
-            else
-            {
-                STRING_HANDLE app_construct = STRING_construct_sprintf("%s%s", IOTHUB_APP_PREFIX, keys[index]);
-                if (app_construct == NULL)
-                {
-                    /*Codes_SRS_TRANSPORTMULTITHTTP_17_079: [If any HTTP header operation fails, _DoWork shall advance to the next action.] */
-                    LogError("Unable to construct app header");
-                    result = false;
-                    break;
-                }
-                else
-                {
-                    if (HTTPHeaders_ReplaceHeaderNameValuePair(headers, STRING_c_str(app_construct), values[index]) != HTTP_HEADERS_OK)
-                    {
-                        /*Codes_SRS_TRANSPORTMULTITHTTP_17_079: [If any HTTP header operation fails, _DoWork shall advance to the next action.] */
-                        LogError("Unable to add app properties to http header");
-                        result = false;
-                        break;
-                    }
-                    STRING_delete(app_construct);
-                }
-            }
+            /*Codes_SRS_TRANSPORTMULTITHTTP_17_079: [If any HTTP header operation fails, _DoWork shall advance to the next action.] */
+            LogError("Unable to construct app header");
+            result = false;
+            break;
+        }
+        else if (HTTPHeaders_ReplaceHeaderNameValuePair(headers, headerName, values[index]) != HTTP_HEADERS_OK)
+        {
+            /*Codes_SRS_TRANSPORTMULTITHTTP_17_079: [If any HTTP header operation fails, _DoWork shall advance to the next action.] */
+            LogError("Unable to add app properties to http header");
+            result = false;
+            break;
         }
     }
     return result;
@@ -407,11 +480,13 @@ static HTTP_HEADERS_RESULT addUserAgentHeaderInfo(HTTPTRANSPORT_HANDLE_DATA* tra
     return result;
 }
 
-static bool create_eventHTTPrequestHeaders(HTTPTRANSPORT_PERDEVICE_DATA* handleData, HTTPTRANSPORT_HANDLE_DATA* transport_data, const char * deviceId, bool is_x509_used)
+static bool create_eventHTTPrequestHeaders(HTTPTRANSPORT_PERDEVICE_DATA* handleData, HTTPTRANSPORT_HANDLE_DATA* transport_data, const char * deviceId, const char* authorization)
 {
     /*Codes_SRS_TRANSPORTMULTITHTTP_17_021: [ IoTHubTransportHttp_Register shall create a set of HTTP headers (further called "event HTTP request headers") consisting of the following fixed field names and values: "iothub-to":"/devices/" + URL_ENCODED(deviceId) + "/messages/events"; "Authorization":""
     "Accept":"application/json"
-    "Connection":"Keep-Alive" ]*/
+    "Connection":"Keep-Alive"
+    "Content-Type":"application/vnd.microsoft.iothub.json" ]*/
+    /*Codes_SRS_TRANSPORTMULTITHTTP_44_016: [ If a deviceSasToken exists, the "Authorization" header of the event HTTP request headers and of the message HTTP request headers shall be created with the value of deviceSasToken. ]*/
     bool result;
     handleData->eventHTTPrequestHeaders = HTTPHeaders_Alloc();
     if (handleData->eventHTTPrequestHeaders == NULL)
@@ -445,10 +520,11 @@ static bool create_eventHTTPrequestHeaders(HTTPTRANSPORT_PERDEVICE_DATA* handleD
             {
                 if (!(
                     (HTTPHeaders_AddHeaderNameValuePair(handleData->eventHTTPrequestHeaders, "iothub-to", STRING_c_str(temp)) == HTTP_HEADERS_OK) &&
-                    (is_x509_used || (HTTPHeaders_AddHeaderNameValuePair(handleData->eventHTTPrequestHeaders, IOTHUB_AUTH_HEADER_VALUE, " ") == HTTP_HEADERS_OK)) &&
+                    ((authorization == NULL) || (HTTPHeaders_AddHeaderNameValuePair(handleData->eventHTTPrequestHeaders, IOTHUB_AUTH_HEADER_VALUE, authorization) == HTTP_HEADERS_OK)) &&
                     (HTTPHeaders_AddHeaderNameValuePair(handleData->eventHTTPrequestHeaders, "Accept", "application/json") == HTTP_HEADERS_OK) &&
                     (HTTPHeaders_AddHeaderNameValuePair(handleData->eventHTTPrequestHeaders, "Connection", "Keep-Alive") == HTTP_HEADERS_OK) &&
-                    (addUserAgentHeaderInfo(transport_data, handleData->eventHTTPrequestHeaders) == HTTP_HEADERS_OK)
+                    (addUserAgentHeaderInfo(transport_data, handleData->eventHTTPrequestHeaders) == HTTP_HEADERS_OK) &&
+                    (HTTPHeaders_AddHeaderNameValuePair(handleData->eventHTTPrequestHeaders, CONTENT_TYPE, APPLICATION_VND_MICROSOFT_IOTHUB_JSON) == HTTP_HEADERS_OK)
                     ))
                 {
                     /*Codes_SRS_TRANSPORTMULTITHTTP_17_022: [ If creating the event HTTP request headers fails, then IoTHubTransportHttp_Register shall fail and return NULL.] */
@@ -468,13 +544,44 @@ static bool create_eventHTTPrequestHeaders(HTTPTRANSPORT_PERDEVICE_DATA* handleD
     return result;
 }
 
+static void destroy_singleEventHTTPrequestHeaders(HTTPTRANSPORT_PERDEVICE_DATA* handleData)
+{
+    HTTPHeaders_Free(handleData->singleEventHTTPrequestHeaders);
+    handleData->singleEventHTTPrequestHeaders = NULL;
+}
+
+static bool create_singleEventHTTPrequestHeaders(HTTPTRANSPORT_PERDEVICE_DATA* handleData)
+{
+    /*Codes_SRS_TRANSPORTMULTITHTTP_44_017: [ IoTHubTransportHttp_Register shall create a clone of the event HTTP request headers (further called "single event HTTP request headers") that has "Content-Type" set to "application/octet-stream". ]*/
+    bool result;
+    handleData->singleEventHTTPrequestHeaders = HTTPHeaders_Clone(handleData->eventHTTPrequestHeaders);
+    if (handleData->singleEventHTTPrequestHeaders == NULL)
+    {
+        /*Codes_SRS_TRANSPORTMULTITHTTP_44_018: [ If creating the single event HTTP request headers fails, then IoTHubTransportHttp_Register shall fail and return NULL. ]*/
+        LogError("HTTPHeaders_Clone failed.");
+        result = false;
+    }
+    else if (HTTPHeaders_ReplaceHeaderNameValuePair(handleData->singleEventHTTPrequestHeaders, CONTENT_TYPE, APPLICATION_OCTET_STREAM) != HTTP_HEADERS_OK)
+    {
+        /*Codes_SRS_TRANSPORTMULTITHTTP_44_018: [ If creating the single event HTTP request headers fails, then IoTHubTransportHttp_Register shall fail and return NULL. ]*/
+        LogError("HTTPHeaders_ReplaceHeaderNameValuePair failed.");
+        result = false;
+        destroy_singleEventHTTPrequestHeaders(handleData);
+    }
+    else
+    {
+        result = true;
+    }
+    return result;
+}
+
 static void destroy_messageHTTPrequestHeaders(HTTPTRANSPORT_PERDEVICE_DATA* handleData)
 {
     HTTPHeaders_Free(handleData->messageHTTPrequestHeaders);
     handleData->messageHTTPrequestHeaders = NULL;
 }
 
-static bool create_messageHTTPrequestHeaders(HTTPTRANSPORT_PERDEVICE_DATA* handleData, HTTPTRANSPORT_HANDLE_DATA* transport_data, bool is_x509_used)
+static bool create_messageHTTPrequestHeaders(HTTPTRANSPORT_PERDEVICE_DATA* handleData, HTTPTRANSPORT_HANDLE_DATA* transport_data, const char* authorization)
 {
     /*Codes_SRS_TRANSPORTMULTITHTTP_17_132: [ IoTHubTransportHttp_Register shall create a set of HTTP headers (further called "message HTTP request headers") consisting of the following fixed field names and values:
     "Authorization": "" ]*/
@@ -489,7 +596,7 @@ static bool create_messageHTTPrequestHeaders(HTTPTRANSPORT_PERDEVICE_DATA* handl
     {
         if (!(
             (addUserAgentHeaderInfo(transport_data, handleData->messageHTTPrequestHeaders) == HTTP_HEADERS_OK) &&
-            (is_x509_used || (HTTPHeaders_AddHeaderNameValuePair(handleData->messageHTTPrequestHeaders, IOTHUB_AUTH_HEADER_VALUE, " ") == HTTP_HEADERS_OK))
+            ((authorization == NULL) || (HTTPHeaders_AddHeaderNameValuePair(handleData->messageHTTPrequestHeaders, IOTHUB_AUTH_HEADER_VALUE, authorization) == HTTP_HEADERS_OK))
             ))
         {
             /*Codes_SRS_TRANSPORTMULTITHTTP_17_023: [ If creating message HTTP request headers then IoTHubTransportHttp_Register shall fail and return NULL. ]*/
@@ -791,17 +898,20 @@ static IOTHUB_DEVICE_HANDLE IoTHubTransportHttp_Register(TRANSPORT_LL_HANDLE han
 
             bool was_eventHTTPrelativePath_ok = (was_create_deviceKey_ok || was_create_deviceSasToken_ok || was_x509_ok) && create_eventHTTPrelativePath(result, device->deviceId);
             bool was_messageHTTPrelativePath_ok = was_eventHTTPrelativePath_ok && create_messageHTTPrelativePath(result, device->deviceId);
+            /*x509 requests carry no "Authorization" header, key based ones get it from HTTPAPIEX_SAS_ExecuteRequest*/
+            const char* authorization = was_x509_ok ? NULL : ((device->deviceSasToken != NULL) ? device->deviceSasToken : " ");
             bool was_eventHTTPrequestHeaders_ok;
             if (was_messageHTTPrelativePath_ok)
             {
                 result->device_transport_ctx = handleData->transport_ctx;
-                was_eventHTTPrequestHeaders_ok = create_eventHTTPrequestHeaders(result, handleData, device->deviceId, was_x509_ok);
+                was_eventHTTPrequestHeaders_ok = create_eventHTTPrequestHeaders(result, handleData, device->deviceId, authorization);
             }
             else
             {
                 was_eventHTTPrequestHeaders_ok = false;
             }
-            bool was_messageHTTPrequestHeaders_ok = was_eventHTTPrequestHeaders_ok && create_messageHTTPrequestHeaders(result, handleData, was_x509_ok);
+            bool was_singleEventHTTPrequestHeaders_ok = was_eventHTTPrequestHeaders_ok && create_singleEventHTTPrequestHeaders(result);
+            bool was_messageHTTPrequestHeaders_ok = was_singleEventHTTPrequestHeaders_ok && create_messageHTTPrequestHeaders(result, handleData, authorization);
             bool was_abandonHTTPrelativePathBegin_ok = was_messageHTTPrequestHeaders_ok && create_abandonHTTPrelativePathBegin(result, device->deviceId);
 
             if (was_x509_ok)
@@ -827,6 +937,14 @@ static IOTHUB_DEVICE_HANDLE IoTHubTransportHttp_Register(TRANSPORT_LL_HANDLE han
                 /*Codes_SRS_TRANSPORTMULTITHTTP_17_128: [ IoTHubTransportHttp_Register shall mark this device as unsubscribed. ]*/
                 result->DoWork_PullMessage = false;
                 result->isFirstPoll = true;
+                result->httpApiExHandle = ((HTTPTRANSPORT_HANDLE_DATA*)handle)->httpApiExHandle;
+                result->adaptivePollingTime = 0;
+                result->hasPendingMessages = false;
+                result->deferCallbacks = false;
+                result->hasPendingConfirmation = false;
+                result->pendingMessage = NULL;
+                result->appPropertyName = NULL;
+                result->appPropertyNameSize = 0;
                 result->waitingToSend = waitingToSend;
                 DList_InitializeListHead(&(result->eventConfirmations));
                 result->transportHandle = (HTTPTRANSPORT_HANDLE_DATA *)handle;
@@ -838,6 +956,7 @@ static IOTHUB_DEVICE_HANDLE IoTHubTransportHttp_Register(TRANSPORT_LL_HANDLE han
                 if (was_abandonHTTPrelativePathBegin_ok) destroy_abandonHTTPrelativePathBegin(result);
                 if (was_messageHTTPrelativePath_ok) destroy_messageHTTPrelativePath(result);
                 if (was_eventHTTPrequestHeaders_ok) destroy_eventHTTPrequestHeaders(result);
+                if (was_singleEventHTTPrequestHeaders_ok) destroy_singleEventHTTPrequestHeaders(result);
                 if (was_messageHTTPrequestHeaders_ok) destroy_messageHTTPrequestHeaders(result);
                 if (was_eventHTTPrelativePath_ok) destroy_eventHTTPrelativePath(result);
                 if (was_create_deviceId_ok) destroy_deviceId(result);
@@ -862,7 +981,13 @@ static void destroy_perDeviceData(HTTPTRANSPORT_PERDEVICE_DATA * perDeviceItem)
     destroy_eventHTTPrelativePath(perDeviceItem);
     destroy_messageHTTPrelativePath(perDeviceItem);
     destroy_eventHTTPrequestHeaders(perDeviceItem);
+    destroy_singleEventHTTPrequestHeaders(perDeviceItem);
     destroy_messageHTTPrequestHeaders(perDeviceItem);
+    if (perDeviceItem->appPropertyName != NULL)
+    {
+        free(perDeviceItem->appPropertyName);
+        perDeviceItem->appPropertyName = NULL;
+    }
     destroy_abandonHTTPrelativePathBegin(perDeviceItem);
     destroy_SASObject(perDeviceItem);
 }
@@ -990,6 +1115,61 @@ static bool create_httpApiExHandle(HTTPTRANSPORT_HANDLE_DATA* handleData, const
     return result;
 }
 
+static void stop_connection_thread(HTTPTRANSPORT_CONNECTION* connection)
+{
+    int res;
+
+    if (Lock(connection->lock) != LOCK_OK)
+    {
+        LogError("unable to Lock - - will still attempt to end the thread of connection %lu", (unsigned long)connection->index);
+    }
+    connection->stopThread = true;
+    (void)Condition_Post(connection->condition);
+    (void)Unlock(connection->lock);
+
+    if (ThreadAPI_Join(connection->threadHandle, &res) != THREADAPI_OK)
+    {
+        LogError("ThreadAPI_Join failed");
+    }
+    connection->threadHandle = NULL;
+    Condition_Deinit(connection->condition);
+    Lock_Deinit(connection->lock);
+}
+
+static void destroy_connectionPool(HTTPTRANSPORT_CONNECTION* connections, size_t connectionCount)
+{
+    if (connections != NULL)
+    {
+        /*connections[0] is the transport's own httpApiExHandle, destroyed with the transport*/
+        for (size_t i = 1; i < connectionCount; i++)
+        {
+            if (connections[i].threadHandle != NULL)
+            {
+                /*Codes_SRS_TRANSPORTMULTITHTTP_44_022: [ The threads of the pool shall be stopped and joined when the pool is replaced or the transport is destroyed. ]*/
+                stop_connection_thread(&connections[i]);
+            }
+            HTTPAPIEX_Destroy(connections[i].httpApiExHandle);
+        }
+        free(connections);
+    }
+}
+
+static void destroy_savedOptions(HTTPTRANSPORT_HANDLE_DATA* handleData)
+{
+    if (handleData->savedOptions != NULL)
+    {
+        size_t savedOptionsCount = VECTOR_size(handleData->savedOptions);
+        for (size_t i = 0; i < savedOptionsCount; i++)
+        {
+            HTTPTRANSPORT_SAVED_OPTION* savedOption = (HTTPTRANSPORT_SAVED_OPTION*)VECTOR_element(handleData->savedOptions, i);
+            free(savedOption->name);
+            free((void*)savedOption->value);
+        }
+        VECTOR_destroy(handleData->savedOptions);
+        handleData->savedOptions = NULL;
+    }
+}
+
 static void destroy_perDeviceList(HTTPTRANSPORT_HANDLE_DATA* handleData)
 {
     VECTOR_destroy(handleData->perDeviceList);
@@ -1078,6 +1258,11 @@ static TRANSPORT_LL_HANDLE IoTHubTransportHttp_Create(const IOTHUBTRANSPORT_CONF
                 /*Codes_SRS_TRANSPORTMULTITHTTP_17_011: [ Otherwise, IoTHubTransportHttp_Create shall succeed and return a non-NULL value. ]*/
                 result->doBatchedTransfers = false;
                 result->getMinimumPollingTime = DEFAULT_GETMINIMUMPOLLINGTIME;
+                result->getMaximumPollingTime = DEFAULT_GETMAXIMUMPOLLINGTIME;
+                result->doAdaptivePolling = false;
+                result->connections = NULL;
+                result->connectionCount = 0;
+                result->savedOptions = NULL;
 
                 result->transport_ctx = ctx;
                 memcpy(&result->transport_callbacks, cb_info, sizeof(TRANSPORT_CALLBACKS_INFO));
@@ -1116,6 +1301,8 @@ static void IoTHubTransportHttp_Destroy(TRANSPORT_LL_HANDLE handle)
         }
 
         destroy_hostName((HTTPTRANSPORT_HANDLE_DATA *)handle);
+        destroy_connectionPool(handleData->connections, handleData->connectionCount);
+        destroy_savedOptions(handleData);
         destroy_httpApiExHandle((HTTPTRANSPORT_HANDLE_DATA *)handle);
         destroy_perDeviceList((HTTPTRANSPORT_HANDLE_DATA *)handle);
         HTTPAPIEX_Deinit();
@@ -1207,6 +1394,15 @@ static IOTHUB_CLIENT_RESULT IoTHubTransportHttp_GetTwinAsync(IOTHUB_DEVICE_HANDL
     return IOTHUB_CLIENT_ERROR;
 }
 
+static IOTHUB_CLIENT_RESULT IoTHubTransportHttp_GetRttStatistics(TRANSPORT_LL_HANDLE handle, IOTHUB_CLIENT_RTT_STATISTICS* rttStatistics)
+{
+    (void)handle;
+    (void)rttStatistics;
+    LogError("Currently Not Supported.");
+    // Codes_SRS_TRANSPORTMULTITHTTP_44_023: [ `IoTHubTransportHttp_GetRttStatistics` shall return IOTHUB_CLIENT_ERROR]
+    return IOTHUB_CLIENT_ERROR;
+}
+
 static int IoTHubTransportHttp_Subscribe_DeviceMethod(IOTHUB_DEVICE_HANDLE handle)
 {
     (void)handle;
@@ -1232,68 +1428,126 @@ static int IoTHubTransportHttp_DeviceMethod_Response(IOTHUB_DEVICE_HANDLE handle
     return MU_FAILURE;
 }
 
-/*produces a representation of the properties, if they exist*/
-/*if they do not exist, produces ""*/
-static int concat_Properties(STRING_HANDLE existing, MAP_HANDLE map, size_t* propertiesMessageSizeContribution)
+/*the batched payload is built in a single buffer that grows geometrically, so appending n bytes in total costs O(n)*/
+typedef struct BATCH_PAYLOAD_TAG
+{
+    unsigned char* buffer;
+    size_t length;
+    size_t capacity;
+} BATCH_PAYLOAD;
+
+static const char base64Alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+static int reserveBatchPayload(BATCH_PAYLOAD* payload, size_t size)
 {
     int result;
-    const char*const* keys;
-    const char*const* values;
-    size_t count;
-    if (Map_GetInternals(map, &keys, &values, &count) != MAP_OK)
+    if (payload->capacity - payload->length >= size)
     {
-        result = MU_FAILURE;
-        LogError("error while Map_GetInternals");
+        result = 0;
     }
     else
     {
+        size_t newCapacity = (payload->capacity == 0) ? BATCH_PAYLOAD_INITIAL_SIZE : payload->capacity;
+        unsigned char* newBuffer;
+        while (newCapacity - payload->length < size)
+        {
+            newCapacity *= 2;
+        }
 
-        if (count == 0)
+        if ((newBuffer = (unsigned char*)realloc(payload->buffer, newCapacity)) == NULL)
         {
-            /*Codes_SRS_TRANSPORTMULTITHTTP_17_064: [If IoTHubMessage does not have properties, then "properties":{...} shall be missing from the payload*/
-            /*no properties - do nothing with existing*/
-            result = 0;
-            *propertiesMessageSizeContribution = 0;
+            LogError("unable to grow the batched payload to %lu bytes", (unsigned long)newCapacity);
+            result = MU_FAILURE;
         }
         else
         {
-            /*Codes_SRS_TRANSPORTMULTITHTTP_17_058: [If IoTHubMessage has properties, then they shall be serialized at the same level as "body" using the following pattern: "properties":{"iothub-app-name1":"value1","iothub-app-name2":"value2*/
-            if (STRING_concat(existing, ",\"properties\":") != 0)
-            {
-                /*go ahead and return it*/
-                result = MU_FAILURE;
-                LogError("failed STRING_concat");
-            }
-            else if (appendMapToJSON(existing, keys, values, count) != 0)
-            {
-                result = MU_FAILURE;
-                LogError("unable to append the properties");
-            }
-            else
-            {
-                /*all is fine*/
-                size_t i;
-                *propertiesMessageSizeContribution = 0;
-                for (i = 0; i < count; i++)
-                {
-                    /*Codes_SRS_TRANSPORTMULTITHTTP_17_063: [Every property name shall add to the message size the length of the property name + the length of the property value + 16 bytes.] */
-                    *propertiesMessageSizeContribution += (strlen(keys[i]) + strlen(values[i]) + MAXIMUM_PROPERTY_OVERHEAD);
-                }
-                result = 0;
-            }
+            payload->buffer = newBuffer;
+            payload->capacity = newCapacity;
+            result = 0;
+        }
+    }
+    return result;
+}
+
+static int appendToBatchPayload(BATCH_PAYLOAD* payload, const char* source, size_t size)
+{
+    int result;
+    if (reserveBatchPayload(payload, size) != 0)
+    {
+        result = MU_FAILURE;
+    }
+    else
+    {
+        (void)memcpy(payload->buffer + payload->length, source, size);
+        payload->length += size;
+        result = 0;
+    }
+    return result;
+}
+
+static int appendStringToBatchPayload(BATCH_PAYLOAD* payload, const char* source)
+{
+    return appendToBatchPayload(payload, source, strlen(source));
+}
+
+/*encodes straight into the payload, instead of going through a STRING_HANDLE per message*/
+static int appendBase64ToBatchPayload(BATCH_PAYLOAD* payload, const unsigned char* source, size_t size)
+{
+    int result;
+    size_t encodedSize = 4 * ((size + 2) / 3);
+    if (reserveBatchPayload(payload, encodedSize) != 0)
+    {
+        result = MU_FAILURE;
+    }
+    else
+    {
+        unsigned char* destination = payload->buffer + payload->length;
+        size_t index = 0;
+        while (size - index >= 3)
+        {
+            destination[0] = base64Alphabet[source[index] >> 2];
+            destination[1] = base64Alphabet[((source[index] & 0x03) << 4) | (source[index + 1] >> 4)];
+            destination[2] = base64Alphabet[((source[index + 1] & 0x0F) << 2) | (source[index + 2] >> 6)];
+            destination[3] = base64Alphabet[source[index + 2] & 0x3F];
+            destination += 4;
+            index += 3;
+        }
+
+        if (size - index == 1)
+        {
+            destination[0] = base64Alphabet[source[index] >> 2];
+            destination[1] = base64Alphabet[(source[index] & 0x03) << 4];
+            destination[2] = '=';
+            destination[3] = '=';
+        }
+        else if (size - index == 2)
+        {
+            destination[0] = base64Alphabet[source[index] >> 2];
+            destination[1] = base64Alphabet[((source[index] & 0x03) << 4) | (source[index + 1] >> 4)];
+            destination[2] = base64Alphabet[(source[index + 1] & 0x0F) << 2];
+            destination[3] = '=';
         }
+
+        payload->length += encodedSize;
+        result = 0;
     }
     return result;
 }
 
-/*produces a JSON representation of the map : {"a": "value_of_a","b":"value_of_b"}*/
-static int appendMapToJSON(STRING_HANDLE existing, const char* const* keys, const char* const* values, size_t count) /*under consideration: move to MAP module when it has more than 1 user*/
+/*produces a JSON representation of the properties, if they exist: ,"properties":{"iothub-app-a":"value_of_a","iothub-app-b":"value_of_b"}*/
+/*if they do not exist, produces ""*/
+static int appendPropertiesToBatchPayload(BATCH_PAYLOAD* payload, const char* const* keys, const char* const* values, size_t count)
 {
     int result;
-    if (STRING_concat(existing, "{") != 0)
+    if (count == 0)
     {
-        /*go on and return it*/
-        LogError("STRING_construct failed");
+        /*Codes_SRS_TRANSPORTMULTITHTTP_17_064: [If IoTHubMessage does not have properties, then "properties":{...} shall be missing from the payload*/
+        result = 0;
+    }
+    /*Codes_SRS_TRANSPORTMULTITHTTP_17_058: [If IoTHubMessage has properties, then they shall be serialized at the same level as "body" using the following pattern: "properties":{"iothub-app-name1":"value1","iothub-app-name2":"value2*/
+    else if (appendStringToBatchPayload(payload, ",\"properties\":{") != 0)
+    {
+        LogError("unable to append the properties");
         result = MU_FAILURE;
     }
     else
@@ -1302,14 +1556,14 @@ static int appendMapToJSON(STRING_HANDLE existing, const char* const* keys, cons
         for (i = 0; i < count; i++)
         {
             if (!(
-                (STRING_concat(existing, (i == 0) ? "\"" IOTHUB_APP_PREFIX : ",\"" IOTHUB_APP_PREFIX) == 0) &&
-                (STRING_concat(existing, keys[i]) == 0) &&
-                (STRING_concat(existing, "\":\"") == 0) &&
-                (STRING_concat(existing, values[i]) == 0) &&
-                (STRING_concat(existing, "\"") == 0)
+                (appendStringToBatchPayload(payload, (i == 0) ? "\"" IOTHUB_APP_PREFIX : ",\"" IOTHUB_APP_PREFIX) == 0) &&
+                (appendStringToBatchPayload(payload, keys[i]) == 0) &&
+                (appendStringToBatchPayload(payload, "\":\"") == 0) &&
+                (appendStringToBatchPayload(payload, values[i]) == 0) &&
+                (appendStringToBatchPayload(payload, "\"") == 0)
                 ))
             {
-                LogError("unable to STRING_concat");
+                LogError("unable to append the properties");
                 break;
             }
         }
@@ -1317,143 +1571,138 @@ static int appendMapToJSON(STRING_HANDLE existing, const char* const* keys, cons
         if (i < count)
         {
             result = MU_FAILURE;
-            /*error, let it go through*/
         }
-        else if (STRING_concat(existing, "}") != 0)
+        else if (appendStringToBatchPayload(payload, "}") != 0)
         {
-            LogError("unable to STRING_concat");
+            LogError("unable to append the properties");
             result = MU_FAILURE;
         }
         else
         {
-            /*all is fine*/
             result = 0;
         }
     }
     return result;
 }
 
-/*makes the following string:{"body":"base64 encoding of the message content"[,"properties":{"a":"valueOfA"}]}*/
-/*return NULL if there was a failure, or a non-NULL STRING_HANDLE that contains the intended data*/
-static STRING_HANDLE make1EventJSONitem(PDLIST_ENTRY item, size_t *messageSizeContribution)
+#define APPEND_EVENT_RESULT_VALUES \
+    APPEND_EVENT_OK, /*returned when the item was appended to the payload*/ \
+    APPEND_EVENT_DOES_NOT_FIT, /*returned when the item would take the payload past MAXIMUM_MESSAGE_SIZE, nothing was appended*/ \
+    APPEND_EVENT_ERROR /*returned when there were errors, nothing was appended*/
+
+MU_DEFINE_ENUM(APPEND_EVENT_RESULT, APPEND_EVENT_RESULT_VALUES);
+
+/*appends the following string to the payload:{"body":"base64 encoding of the message content"[,"properties":{"a":"valueOfA"}]},*/
+/*the size of the item is computed before anything is encoded, so an item that does not fit costs nothing*/
+static APPEND_EVENT_RESULT append1EventJSONitem(BATCH_PAYLOAD* payload, PDLIST_ENTRY item, size_t allMessagesSize, size_t* messageSizeContribution)
 {
-    STRING_HANDLE result; /*temp wants to contain :{"body":"base64 encoding of the message content"[,"properties":{"a":"valueOfA"}]}*/
+    APPEND_EVENT_RESULT result;
     IOTHUB_MESSAGE_LIST* message = containingRecord(item, IOTHUB_MESSAGE_LIST, entry);
     IOTHUBMESSAGE_CONTENT_TYPE contentType = IoTHubMessage_GetContentType(message->messageHandle);
+    const unsigned char* source = NULL;
+    size_t size = 0;
 
-    switch (contentType)
+    if (contentType == IOTHUBMESSAGE_BYTEARRAY)
     {
-    case IOTHUBMESSAGE_BYTEARRAY:
+        if (IoTHubMessage_GetByteArray(message->messageHandle, &source, &size) != IOTHUB_MESSAGE_OK)
+        {
+            LogError("unable to get the data for the message.");
+            source = NULL;
+        }
+    }
+    /*Codes_SRS_TRANSPORTMULTITHTTP_17_057: [If a messages to be send has type IOTHUBMESSAGE_STRING, then its serialization shall be {"body":"JSON encoding of the string", "base64Encoded":false}] */
+    else if (contentType == IOTHUBMESSAGE_STRING)
     {
-        result = STRING_construct("{\"body\":\"");
-        if (result == NULL)
+        if ((source = (const unsigned char*)IoTHubMessage_GetString(message->messageHandle)) == NULL)
         {
-            LogError("unable to STRING_construct");
+            LogError("unable to IoTHubMessage_GetString");
         }
         else
         {
-            const unsigned char* source;
-            size_t size;
-
-            if (IoTHubMessage_GetByteArray(message->messageHandle, &source, &size) != IOTHUB_MESSAGE_OK)
-            {
-                LogError("unable to get the data for the message.");
-                STRING_delete(result);
-                result = NULL;
-            }
-            else
-            {
-                STRING_HANDLE encoded = Azure_Base64_Encode_Bytes(source, size);
-                if (encoded == NULL)
-                {
-                    LogError("unable to Azure_Base64_Encode_Bytes.");
-                    STRING_delete(result);
-                    result = NULL;
-                }
-                else
-                {
-                    size_t propertiesSize = 0;
-                    if (!(
-                        (STRING_concat_with_STRING(result, encoded) == 0) &&
-                        (STRING_concat(result, "\"") == 0) && /*\" because closing value*/
-                        (concat_Properties(result, IoTHubMessage_Properties(message->messageHandle), &propertiesSize) == 0) &&
-                        (STRING_concat(result, "},") == 0) /*the last comma shall be replaced by a ']' by DaCr's suggestion (which is awesome enough to receive credits in the source code)*/
-                        ))
-                    {
-                        STRING_delete(result);
-                        result = NULL;
-                        LogError("unable to STRING_concat_with_STRING.");
-                    }
-                    else
-                    {
-                        /*all is fine... */
-                        /*Codes_SRS_TRANSPORTMULTITHTTP_17_062: [The message size is computed from the length of the payload + 384.] */
-                        *messageSizeContribution = size + MAXIMUM_PAYLOAD_OVERHEAD + propertiesSize;
-                    }
-                    STRING_delete(encoded);
-                }
-            }
+            size = strlen((const char*)source);
         }
-        break;
     }
-    /*Codes_SRS_TRANSPORTMULTITHTTP_17_057: [If a messages to be send has type IOTHUBMESSAGE_STRING, then its serialization shall be {"body":"JSON encoding of the string", "base64Encoded":false}] */
-    case IOTHUBMESSAGE_STRING:
+    else
     {
-        result = STRING_construct("{\"body\":");
-        if (result == NULL)
+        LogError("an unknown message type was encountered (%d)", contentType);
+    }
+
+    if (source == NULL)
+    {
+        result = APPEND_EVENT_ERROR;
+    }
+    else
+    {
+        const char*const* keys;
+        const char*const* values;
+        size_t count;
+        if (Map_GetInternals(IoTHubMessage_Properties(message->messageHandle), &keys, &values, &count) != MAP_OK)
         {
-            LogError("unable to STRING_construct");
+            LogError("error while Map_GetInternals");
+            result = APPEND_EVENT_ERROR;
         }
         else
         {
-            const char* source = IoTHubMessage_GetString(message->messageHandle);
-            if (source == NULL)
+            size_t i;
+            size_t originalLength = payload->length;
+
+            /*Codes_SRS_TRANSPORTMULTITHTTP_17_062: [The message size is computed from the length of the payload + 384.] */
+            *messageSizeContribution = size + MAXIMUM_PAYLOAD_OVERHEAD;
+            for (i = 0; i < count; i++)
             {
-                LogError("unable to IoTHubMessage_GetString");
-                STRING_delete(result);
-                result = NULL;
+                /*Codes_SRS_TRANSPORTMULTITHTTP_17_063: [Every property name shall add to the message size the length of the property name + the length of the property value + 16 bytes.] */
+                *messageSizeContribution += (strlen(keys[i]) + strlen(values[i]) + MAXIMUM_PROPERTY_OVERHEAD);
+            }
+
+            /*Codes_SRS_TRANSPORTMULTITHTTP_17_061: [The message size shall be limited to 255KB - 1 byte.]*/
+            /*Codes_SRS_TRANSPORTMULTITHTTP_44_001: [ The size of a message shall be computed before it is encoded, and a message that does not fit in the batch shall not be encoded. ]*/
+            if (allMessagesSize + *messageSizeContribution > MAXIMUM_MESSAGE_SIZE)
+            {
+                result = APPEND_EVENT_DOES_NOT_FIT;
             }
             else
             {
-                STRING_HANDLE asJson = STRING_new_JSON(source);
-                if (asJson == NULL)
+                int encodeResult;
+                if (contentType == IOTHUBMESSAGE_BYTEARRAY)
                 {
-                    LogError("unable to STRING_new_JSON");
-                    STRING_delete(result);
-                    result = NULL;
+                    encodeResult = ((appendStringToBatchPayload(payload, "{\"body\":\"") == 0) &&
+                        (appendBase64ToBatchPayload(payload, source, size) == 0) &&
+                        (appendStringToBatchPayload(payload, "\"") == 0)) ? 0 : MU_FAILURE; /*\" because closing value*/
                 }
                 else
                 {
-                    size_t propertiesSize = 0;
-                    if (!(
-                        (STRING_concat_with_STRING(result, asJson) == 0) &&
-                        (STRING_concat(result, ",\"base64Encoded\":false") == 0) &&
-                        (concat_Properties(result, IoTHubMessage_Properties(message->messageHandle), &propertiesSize) == 0) &&
-                        (STRING_concat(result, "},") == 0) /*the last comma shall be replaced by a ']' by DaCr's suggestion (which is awesome enough to receive credits in the source code)*/
-                        ))
+                    STRING_HANDLE asJson = STRING_new_JSON((const char*)source);
+                    if (asJson == NULL)
                     {
-                        LogError("unable to STRING_concat_with_STRING");
-                        STRING_delete(result);
-                        result = NULL;
+                        LogError("unable to STRING_new_JSON");
+                        encodeResult = MU_FAILURE;
                     }
                     else
                     {
-                        /*result has the intended content*/
-                        /*Codes_SRS_TRANSPORTMULTITHTTP_17_062: [The message size is computed from the length of the payload + 384.] */
-                        *messageSizeContribution = strlen(source) + MAXIMUM_PAYLOAD_OVERHEAD + propertiesSize;
+                        encodeResult = ((appendStringToBatchPayload(payload, "{\"body\":") == 0) &&
+                            (appendToBatchPayload(payload, STRING_c_str(asJson), STRING_length(asJson)) == 0) &&
+                            (appendStringToBatchPayload(payload, ",\"base64Encoded\":false") == 0)) ? 0 : MU_FAILURE;
+                        STRING_delete(asJson);
                     }
-                    STRING_delete(asJson);
+                }
+
+                if (!(
+                    (encodeResult == 0) &&
+                    (appendPropertiesToBatchPayload(payload, keys, values, count) == 0) &&
+                    (appendStringToBatchPayload(payload, "},") == 0) /*the last comma shall be replaced by a ']' by DaCr's suggestion (which is awesome enough to receive credits in the source code)*/
+                    ))
+                {
+                    LogError("unable to append the message to the batched payload");
+                    /*Codes_SRS_TRANSPORTMULTITHTTP_44_002: [ The messages shall be encoded directly into a single payload buffer that grows geometrically, and a message that fails to encode shall be removed from it, leaving the messages before it untouched. ]*/
+                    payload->length = originalLength;
+                    result = APPEND_EVENT_ERROR;
+                }
+                else
+                {
+                    result = APPEND_EVENT_OK;
                 }
             }
         }
-        break;
-    }
-    default:
-    {
-        LogError("an unknown message type was encountered (%d)", contentType);
-        result = NULL; /*unknown message type*/
-        break;
-    }
     }
     return result;
 }
@@ -1468,14 +1717,16 @@ MU_DEFINE_ENUM(MAKE_PAYLOAD_RESULT, MAKE_PAYLOAD_RESULT_VALUES);
 
 /*this function assembles several {"body":"base64 encoding of the message content"," base64Encoded": true} into 1 payload*/
 /*Codes_SRS_TRANSPORTMULTITHTTP_17_056: [IoTHubTransportHttp_DoWork shall build the following string:[{"body":"base64 encoding of the message1 content"},{"body":"base64 encoding of the message2 content"}...]]*/
-static MAKE_PAYLOAD_RESULT makePayload(HTTPTRANSPORT_PERDEVICE_DATA* deviceData, STRING_HANDLE* payload)
+static MAKE_PAYLOAD_RESULT makePayload(HTTPTRANSPORT_PERDEVICE_DATA* deviceData, BATCH_PAYLOAD* payload)
 {
     MAKE_PAYLOAD_RESULT result;
     size_t allMessagesSize = 0;
-    *payload = STRING_construct("[");
-    if (*payload == NULL)
+    payload->buffer = NULL;
+    payload->length = 0;
+    payload->capacity = 0;
+    if (appendStringToBatchPayload(payload, "[") != 0)
     {
-        LogError("unable to STRING_construct");
+        LogError("unable to start the batched payload");
         result = MAKE_PAYLOAD_ERROR;
     }
     else
@@ -1487,99 +1738,47 @@ static MAKE_PAYLOAD_RESULT makePayload(HTTPTRANSPORT_PERDEVICE_DATA* deviceData,
         result = MAKE_PAYLOAD_OK; /*optimistically initializing it*/
         while (keepGoing && ((actual = deviceData->waitingToSend->Flink) != deviceData->waitingToSend))
         {
-            size_t messageSize;
-            STRING_HANDLE temp = make1EventJSONitem(actual, &messageSize);
-            if (isFirst)
+            size_t messageSize = 0;
+            APPEND_EVENT_RESULT appendResult = append1EventJSONitem(payload, actual, allMessagesSize, &messageSize);
+            if (appendResult == APPEND_EVENT_OK)
             {
-                isFirst = false;
-                /*Codes_SRS_TRANSPORTMULTITHTTP_17_067: [If there is no valid payload, IoTHubTransportHttp_DoWork shall advance to the next activity.]*/
-                if (temp == NULL) /*first item failed to create, nothing to send*/
-                {
-                    result = MAKE_PAYLOAD_ERROR;
-                    STRING_delete(*payload);
-                    *payload = NULL;
-                    keepGoing = false;
-                }
-                else
-                {
-                    /*Codes_SRS_TRANSPORTMULTITHTTP_17_065: [If the oldest message in waitingToSend causes the message size to exceed the message size limit then it shall be removed from waitingToSend, and IoTHubClientCore_LL_SendComplete shall be called. Parameter PDLIST_ENTRY completed shall point to a list containing only the oldest item, and parameter IOTHUB_CLIENT_CONFIRMATION_RESULT result shall be set to IOTHUB_CLIENT_CONFIRMATION_BATCHSTATE_FAILED.]*/
-                    /*Codes_SRS_TRANSPORTMULTITHTTP_17_061: [The message size shall be limited to 255KB - 1 byte.]*/
-                    if (messageSize > MAXIMUM_MESSAGE_SIZE)
-                    {
-                        PDLIST_ENTRY head = DList_RemoveHeadList(deviceData->waitingToSend); /*actually this is the same as "actual", but now it is removed*/
-                        DList_InsertTailList(&(deviceData->eventConfirmations), head);
-                        result = MAKE_PAYLOAD_FIRST_ITEM_DOES_NOT_FIT;
-                        STRING_delete(*payload);
-                        *payload = NULL;
-                        keepGoing = false;
-                    }
-                    else
-                    {
-                        if (STRING_concat_with_STRING(*payload, temp) != 0)
-                        {
-                            /*Codes_SRS_TRANSPORTMULTITHTTP_17_067: [If there is no valid payload, IoTHubTransportHttp_DoWork shall advance to the next activity.]*/
-                            result = MAKE_PAYLOAD_ERROR;
-                            STRING_delete(*payload);
-                            *payload = NULL;
-                            keepGoing = false;
-                        }
-                        else
-                        {
-                            /*first item was put nicely in the payload*/
-                            PDLIST_ENTRY head = DList_RemoveHeadList(deviceData->waitingToSend); /*actually this is the same as "actual", but now it is removed*/
-                            DList_InsertTailList(&(deviceData->eventConfirmations), head);
-                            allMessagesSize += messageSize;
-                        }
-                    }
-                    STRING_delete(temp);
-                }
+                /*the item was put nicely in the payload*/
+                PDLIST_ENTRY head = DList_RemoveHeadList(deviceData->waitingToSend); /*actually this is the same as "actual", but now it is removed*/
+                DList_InsertTailList(&(deviceData->eventConfirmations), head);
+                allMessagesSize += messageSize;
+            }
+            else if (!isFirst)
+            {
+                /*this item doesn't make it to the payload, but the payload is valid so far*/
+                /*Codes_SRS_TRANSPORTMULTITHTTP_17_066: [If at any point during construction of the string there are errors, IoTHubTransportHttp_DoWork shall use the so far constructed string as payload.]*/
+                keepGoing = false;
+            }
+            else if (appendResult == APPEND_EVENT_DOES_NOT_FIT)
+            {
+                /*Codes_SRS_TRANSPORTMULTITHTTP_17_065: [If the oldest message in waitingToSend causes the message size to exceed the message size limit then it shall be removed from waitingToSend, and IoTHubClientCore_LL_SendComplete shall be called. Parameter PDLIST_ENTRY completed shall point to a list containing only the oldest item, and parameter IOTHUB_CLIENT_CONFIRMATION_RESULT result shall be set to IOTHUB_CLIENT_CONFIRMATION_BATCHSTATE_FAILED.]*/
+                PDLIST_ENTRY head = DList_RemoveHeadList(deviceData->waitingToSend); /*actually this is the same as "actual", but now it is removed*/
+                DList_InsertTailList(&(deviceData->eventConfirmations), head);
+                result = MAKE_PAYLOAD_FIRST_ITEM_DOES_NOT_FIT;
+                keepGoing = false;
             }
             else
             {
-                /*there is at least 1 item already in the payload*/
-                if (temp == NULL)
-                {
-                    /*there are multiple payloads encoded, the last one had an internal error, just go with those - closing the payload happens "after the loop"*/
-                    /*Codes_SRS_TRANSPORTMULTITHTTP_17_066: [If at any point during construction of the string there are errors, IoTHubTransportHttp_DoWork shall use the so far constructed string as payload.]*/
-                    result = MAKE_PAYLOAD_OK;
-                    keepGoing = false;
-                }
-                else
-                {
-                    if (allMessagesSize + messageSize > MAXIMUM_MESSAGE_SIZE)
-                    {
-                        /*this item doesn't make it to the payload, but the payload is valid so far*/
-                        /*Codes_SRS_TRANSPORTMULTITHTTP_17_066: [If at any point during construction of the string there are errors, IoTHubTransportHttp_DoWork shall use the so far constructed string as payload.]*/
-                        result = MAKE_PAYLOAD_OK;
-                        keepGoing = false;
-                    }
-                    else if (STRING_concat_with_STRING(*payload, temp) != 0)
-                    {
-                        /*should still send what there is so far...*/
-                        /*Codes_SRS_TRANSPORTMULTITHTTP_17_066: [If at any point during construction of the string there are errors, IoTHubTransportHttp_DoWork shall use the so far constructed string as payload.]*/
-                        result = MAKE_PAYLOAD_OK;
-                        keepGoing = false;
-                    }
-                    else
-                    {
-                        /*cool, the payload made it there, let's continue... */
-                        PDLIST_ENTRY head = DList_RemoveHeadList(deviceData->waitingToSend); /*actually this is the same as "actual", but now it is removed*/
-                        DList_InsertTailList(&(deviceData->eventConfirmations), head);
-                        allMessagesSize += messageSize;
-                    }
-                    STRING_delete(temp);
-                }
+                /*Codes_SRS_TRANSPORTMULTITHTTP_17_067: [If there is no valid payload, IoTHubTransportHttp_DoWork shall advance to the next activity.]*/
+                result = MAKE_PAYLOAD_ERROR;
+                keepGoing = false;
             }
+            isFirst = false;
         }
 
         /*closing the payload*/
         if (result == MAKE_PAYLOAD_OK)
         {
-            ((char*)STRING_c_str(*payload))[STRING_length(*payload) - 1] = ']'; /*TODO - do this in STRING_HANDLE*/
+            payload->buffer[payload->length - 1] = ']';
         }
         else
         {
-            /*no need to close anything*/
+            free(payload->buffer);
+            payload->buffer = NULL;
         }
     }
     return result;
@@ -1593,6 +1792,20 @@ static void reversePutListBackIn(PDLIST_ENTRY source, PDLIST_ENTRY destination)
     DList_InitializeListHead(source);
 }
 
+static void complete_events(HTTPTRANSPORT_HANDLE_DATA* handleData, HTTPTRANSPORT_PERDEVICE_DATA* deviceData, IOTHUB_CLIENT_CONFIRMATION_RESULT confirmationResult)
+{
+    if (deviceData->deferCallbacks)
+    {
+        /*eventConfirmations keeps the items until the DoWork thread completes them*/
+        deviceData->pendingConfirmationResult = confirmationResult;
+        deviceData->hasPendingConfirmation = true;
+    }
+    else
+    {
+        handleData->transport_callbacks.send_complete_cb(&(deviceData->eventConfirmations), confirmationResult, deviceData->device_transport_ctx); // takes care of emptying the list too
+    }
+}
+
 static void DoEvent(HTTPTRANSPORT_HANDLE_DATA* handleData, HTTPTRANSPORT_PERDEVICE_DATA* deviceData)
 {
 
@@ -1605,99 +1818,91 @@ static void DoEvent(HTTPTRANSPORT_HANDLE_DATA* handleData, HTTPTRANSPORT_PERDEVI
         /*Codes_SRS_TRANSPORTMULTITHTTP_17_053: [If option SetBatching is true then _Dowork shall send batched event message as specced below.] */
         if (handleData->doBatchedTransfers)
         {
-            /*Codes_SRS_TRANSPORTMULTITHTTP_17_054: [Request HTTP headers shall have the value of "Content-Type" created or updated to "application/vnd.microsoft.iothub.json" by a call to HTTPHeaders_ReplaceHeaderNameValuePair.] */
-            if (HTTPHeaders_ReplaceHeaderNameValuePair(deviceData->eventHTTPrequestHeaders, CONTENT_TYPE, APPLICATION_VND_MICROSOFT_IOTHUB_JSON) != HTTP_HEADERS_OK)
+            /*Codes_SRS_TRANSPORTMULTITHTTP_17_054: [The event HTTP request headers created by _Register already have "Content-Type" set to "application/vnd.microsoft.iothub.json" and shall be used as is.] */
+            /*Codes_SRS_TRANSPORTMULTITHTTP_17_059: [It shall inspect the "waitingToSend" DLIST passed in config structure.] */
+            BATCH_PAYLOAD payload;
+            switch (makePayload(deviceData, &payload))
             {
-                /*Codes_SRS_TRANSPORTMULTITHTTP_17_055: [If updating Content-Type fails for any reason, then _DoWork shall advance to the next action.] */
-                LogError("unable to HTTPHeaders_ReplaceHeaderNameValuePair");
-            }
-            else
+            case MAKE_PAYLOAD_OK:
             {
-                /*Codes_SRS_TRANSPORTMULTITHTTP_17_059: [It shall inspect the "waitingToSend" DLIST passed in config structure.] */
-                STRING_HANDLE payload;
-                switch (makePayload(deviceData, &payload))
+                /*Codes_SRS_TRANSPORTMULTITHTTP_17_068: [Once a final payload has been obtained, IoTHubTransportHttp_DoWork shall call HTTPAPIEX_SAS_ExecuteRequest passing the following parameters:] */
+                BUFFER_HANDLE temp = BUFFER_new();
+                if (temp == NULL)
                 {
-                case MAKE_PAYLOAD_OK:
+                    LogError("unable to BUFFER_new");
+                    /*Codes_SRS_TRANSPORTMULTITHTTP_17_067: [If there is no valid payload, IoTHubTransportHttp_DoWork shall advance to the next activity.]*/
+                    reversePutListBackIn(&(deviceData->eventConfirmations), deviceData->waitingToSend);
+                }
+                else
                 {
-                    /*Codes_SRS_TRANSPORTMULTITHTTP_17_068: [Once a final payload has been obtained, IoTHubTransportHttp_DoWork shall call HTTPAPIEX_SAS_ExecuteRequest passing the following parameters:] */
-                    BUFFER_HANDLE temp = BUFFER_new();
-                    if (temp == NULL)
+                    if (BUFFER_build(temp, payload.buffer, payload.length) != 0)
                     {
-                        LogError("unable to BUFFER_new");
+                        LogError("unable to BUFFER_build");
+                        //items go back to waitingToSend
                         /*Codes_SRS_TRANSPORTMULTITHTTP_17_067: [If there is no valid payload, IoTHubTransportHttp_DoWork shall advance to the next activity.]*/
                         reversePutListBackIn(&(deviceData->eventConfirmations), deviceData->waitingToSend);
                     }
                     else
                     {
-                        if (BUFFER_build(temp, (const unsigned char*)STRING_c_str(payload), STRING_length(payload)) != 0)
+                        unsigned int statusCode;
+                        if (HTTPAPIEX_SAS_ExecuteRequest(
+                            deviceData->sasObject,
+                            deviceData->httpApiExHandle,
+                            HTTPAPI_REQUEST_POST,
+                            STRING_c_str(deviceData->eventHTTPrelativePath),
+                            deviceData->eventHTTPrequestHeaders,
+                            temp,
+                            &statusCode,
+                            NULL,
+                            NULL
+                        ) != HTTPAPIEX_OK)
                         {
-                            LogError("unable to BUFFER_build");
+                            LogError("unable to HTTPAPIEX_ExecuteRequest");
                             //items go back to waitingToSend
-                            /*Codes_SRS_TRANSPORTMULTITHTTP_17_067: [If there is no valid payload, IoTHubTransportHttp_DoWork shall advance to the next activity.]*/
+                            /*Codes_SRS_TRANSPORTMULTITHTTP_17_069: [if HTTPAPIEX_SAS_ExecuteRequest fails or the http status code >=300 then IoTHubTransportHttp_DoWork shall not do any other action (it is assumed at the next _DoWork it shall be retried).] */
                             reversePutListBackIn(&(deviceData->eventConfirmations), deviceData->waitingToSend);
                         }
                         else
                         {
-                            unsigned int statusCode;
-                            if (HTTPAPIEX_SAS_ExecuteRequest(
-                                deviceData->sasObject,
-                                handleData->httpApiExHandle,
-                                HTTPAPI_REQUEST_POST,
-                                STRING_c_str(deviceData->eventHTTPrelativePath),
-                                deviceData->eventHTTPrequestHeaders,
-                                temp,
-                                &statusCode,
-                                NULL,
-                                NULL
-                            ) != HTTPAPIEX_OK)
+                            if (statusCode < 300)
                             {
-                                LogError("unable to HTTPAPIEX_ExecuteRequest");
-                                //items go back to waitingToSend
-                                /*Codes_SRS_TRANSPORTMULTITHTTP_17_069: [if HTTPAPIEX_SAS_ExecuteRequest fails or the http status code >=300 then IoTHubTransportHttp_DoWork shall not do any other action (it is assumed at the next _DoWork it shall be retried).] */
-                                reversePutListBackIn(&(deviceData->eventConfirmations), deviceData->waitingToSend);
+                                /*Codes_SRS_TRANSPORTMULTITHTTP_17_070: [If HTTPAPIEX_SAS_ExecuteRequest does not fail and http status code <300 then IoTHubTransportHttp_DoWork shall call IoTHubClientCore_LL_SendComplete. Parameter PDLIST_ENTRY completed shall point to a list containing all the items batched, and parameter IOTHUB_CLIENT_CONFIRMATION_RESULT result shall be set to IOTHUB_CLIENT_CONFIRMATION_OK. The batched items shall be removed from waitingToSend.] */
+                                complete_events(handleData, deviceData, IOTHUB_CLIENT_CONFIRMATION_OK);
                             }
                             else
                             {
-                                if (statusCode < 300)
-                                {
-                                    /*Codes_SRS_TRANSPORTMULTITHTTP_17_070: [If HTTPAPIEX_SAS_ExecuteRequest does not fail and http status code <300 then IoTHubTransportHttp_DoWork shall call IoTHubClientCore_LL_SendComplete. Parameter PDLIST_ENTRY completed shall point to a list containing all the items batched, and parameter IOTHUB_CLIENT_CONFIRMATION_RESULT result shall be set to IOTHUB_CLIENT_CONFIRMATION_OK. The batched items shall be removed from waitingToSend.] */
-                                    handleData->transport_callbacks.send_complete_cb(&(deviceData->eventConfirmations), IOTHUB_CLIENT_CONFIRMATION_OK, deviceData->device_transport_ctx);
-                                }
-                                else
-                                {
-                                    //items go back to waitingToSend
-                                    /*Codes_SRS_TRANSPORTMULTITHTTP_17_069: [if HTTPAPIEX_SAS_ExecuteRequest fails or the http status code >=300 then IoTHubTransportHttp_DoWork shall not do any other action (it is assumed at the next _DoWork it shall be retried).] */
-                                    LogError("unexpected HTTP status code (%u)", statusCode);
-                                    reversePutListBackIn(&(deviceData->eventConfirmations), deviceData->waitingToSend);
-                                }
+                                //items go back to waitingToSend
+                                /*Codes_SRS_TRANSPORTMULTITHTTP_17_069: [if HTTPAPIEX_SAS_ExecuteRequest fails or the http status code >=300 then IoTHubTransportHttp_DoWork shall not do any other action (it is assumed at the next _DoWork it shall be retried).] */
+                                LogError("unexpected HTTP status code (%u)", statusCode);
+                                reversePutListBackIn(&(deviceData->eventConfirmations), deviceData->waitingToSend);
                             }
                         }
-                        BUFFER_delete(temp);
                     }
-                    STRING_delete(payload);
-                    break;
-                }
-                case MAKE_PAYLOAD_FIRST_ITEM_DOES_NOT_FIT:
-                {
-                    handleData->transport_callbacks.send_complete_cb(&(deviceData->eventConfirmations), IOTHUB_CLIENT_CONFIRMATION_ERROR, deviceData->device_transport_ctx); // takes care of emptying the list too
-                    break;
-                }
-                case MAKE_PAYLOAD_ERROR:
-                {
-                    LogError("unrecoverable errors while building a batch message");
-                    break;
-                }
-                case MAKE_PAYLOAD_NO_ITEMS:
-                {
-                    /*do nothing*/
-                    break;
-                }
-                default:
-                {
-                    LogError("internal error: switch's default branch reached when never intended");
-                    break;
-                }
+                    BUFFER_delete(temp);
                 }
+                free(payload.buffer);
+                break;
+            }
+            case MAKE_PAYLOAD_FIRST_ITEM_DOES_NOT_FIT:
+            {
+                complete_events(handleData, deviceData, IOTHUB_CLIENT_CONFIRMATION_ERROR);
+                break;
+            }
+            case MAKE_PAYLOAD_ERROR:
+            {
+                LogError("unrecoverable errors while building a batch message");
+                break;
+            }
+            case MAKE_PAYLOAD_NO_ITEMS:
+            {
+                /*do nothing*/
+                break;
+            }
+            default:
+            {
+                LogError("internal error: switch's default branch reached when never intended");
+                break;
+            }
             }
         }
         else
@@ -1731,108 +1936,120 @@ static void DoEvent(HTTPTRANSPORT_HANDLE_DATA* handleData, HTTPTRANSPORT_PERDEVI
             }
             else
             {
-                /*Codes_SRS_TRANSPORTMULTITHTTP_17_075: [If the oldest message in waitingToSend causes the message to exceed the message size limit then it shall be removed from waitingToSend, and IoTHubClientCore_LL_SendComplete shall be called. Parameter PDLIST_ENTRY completed shall point to a list containing only the oldest item, and parameter IOTHUB_CLIENT_CONFIRMATION_RESULT result shall be set to IOTHUB_CLIENT_CONFIRMATION_BATCHSTATE_FAILED.]*/
-                /*Codes_SRS_TRANSPORTMULTITHTTP_17_072: [The message size shall be limited to 255KB -1 bytes.] */
-                if (messageSize > MAXIMUM_MESSAGE_SIZE)
+                /*Codes_SRS_TRANSPORTMULTITHTTP_17_078: [Every message property "property":"value" shall be added to the HTTP headers as an individual header "iothub-app-property":"value".] */
+                MAP_HANDLE map = IoTHubMessage_Properties(message->messageHandle);
+                const char*const* keys;
+                const char*const* values;
+                size_t count;
+                if (Map_GetInternals(map, &keys, &values, &count) != MAP_OK)
                 {
-                    PDLIST_ENTRY head = DList_RemoveHeadList(deviceData->waitingToSend); /*actually this is the same as "actual", but now it is removed*/
-                    DList_InsertTailList(&(deviceData->eventConfirmations), head);
-                    handleData->transport_callbacks.send_complete_cb(&(deviceData->eventConfirmations), IOTHUB_CLIENT_CONFIRMATION_ERROR, deviceData->device_transport_ctx); // takes care of emptying the list too
+                    /*Codes_SRS_TRANSPORTMULTITHTTP_17_079: [If any HTTP header operation fails, _DoWork shall advance to the next action.] */
+                    LogError("unable to Map_GetInternals");
                 }
                 else
                 {
-                    /*Codes_SRS_TRANSPORTMULTITHTTP_17_071: [If option SetBatching is false then _Dowork shall send individual event message as specced below.] */
-                    /*Codes_SRS_TRANSPORTMULTITHTTP_17_076: [A clone of the event HTTP request headers shall be created.]*/
-                    HTTP_HEADERS_HANDLE clonedEventHTTPrequestHeaders = HTTPHeaders_Clone(deviceData->eventHTTPrequestHeaders);
-                    if (clonedEventHTTPrequestHeaders == NULL)
+                    /*Codes_SRS_TRANSPORTMULTITHTTP_17_074: [Every property name shall add  to the message size the length of the property name + the length of the property value + 16 bytes.] */
+                    for (size_t index = 0; index < count; index++)
+                    {
+                        messageSize += (strlen(values[index]) + strlen(keys[index]) + MAXIMUM_PROPERTY_OVERHEAD);
+                    }
+
+                    /*Codes_SRS_TRANSPORTMULTITHTTP_17_075: [If the oldest message in waitingToSend causes the message to exceed the message size limit then it shall be removed from waitingToSend, and IoTHubClientCore_LL_SendComplete shall be called. Parameter PDLIST_ENTRY completed shall point to a list containing only the oldest item, and parameter IOTHUB_CLIENT_CONFIRMATION_RESULT result shall be set to IOTHUB_CLIENT_CONFIRMATION_BATCHSTATE_FAILED.]*/
+                    /*Codes_SRS_TRANSPORTMULTITHTTP_17_072: [The message size shall be limited to 255KB -1 bytes.] */
+                    if (messageSize > MAXIMUM_MESSAGE_SIZE)
                     {
-                        /*Codes_SRS_TRANSPORTMULTITHTTP_17_079: [If any HTTP header operation fails, _DoWork shall advance to the next action.] */
-                        LogError("HTTPHeaders_Clone failed");
+                        PDLIST_ENTRY head = DList_RemoveHeadList(deviceData->waitingToSend); /*actually this is the same as "actual", but now it is removed*/
+                        DList_InsertTailList(&(deviceData->eventConfirmations), head);
+                        complete_events(handleData, deviceData, IOTHUB_CLIENT_CONFIRMATION_ERROR);
                     }
                     else
                     {
-                        /*Codes_SRS_TRANSPORTMULTITHTTP_17_077: [The cloned HTTP headers shall have the HTTP header "Content-Type" set to "application/octet-stream".] */
-                        if (HTTPHeaders_ReplaceHeaderNameValuePair(clonedEventHTTPrequestHeaders, CONTENT_TYPE, APPLICATION_OCTET_STREAM) != HTTP_HEADERS_OK)
+                        /*Codes_SRS_TRANSPORTMULTITHTTP_17_071: [If option SetBatching is false then _Dowork shall send individual event message as specced below.] */
+                        MESSAGE_SYSTEM_PROPERTIES systemProperties;
+                        HTTP_HEADERS_HANDLE requestHeaders;
+                        get_system_properties(message, &systemProperties);
+                        if ((count == 0) && !has_system_properties(&systemProperties))
                         {
-                            /*Codes_SRS_TRANSPORTMULTITHTTP_17_079: [If any HTTP header operation fails, _DoWork shall advance to the next action.] */
-                            LogError("HTTPHeaders_ReplaceHeaderNameValuePair failed");
+                            /*Codes_SRS_TRANSPORTMULTITHTTP_44_020: [ If the message has neither properties nor system properties, the single event HTTP request headers shall be used as they are, without being cloned. ]*/
+                            requestHeaders = deviceData->singleEventHTTPrequestHeaders;
                         }
                         else
                         {
-                            // set_message_properties returning false does not necessarily mean the the function failed, it just means
-                            // the the adding of messages should not continue and should try the next time.  So you should not log if this
-                            // returns false
-                            if (set_message_properties(message, &messageSize, clonedEventHTTPrequestHeaders, handleData, deviceData))
+                            /*Codes_SRS_TRANSPORTMULTITHTTP_17_076: [A clone of the single event HTTP request headers shall be created.]*/
+                            requestHeaders = HTTPHeaders_Clone(deviceData->singleEventHTTPrequestHeaders);
+                            if (requestHeaders == NULL)
+                            {
+                                /*Codes_SRS_TRANSPORTMULTITHTTP_17_079: [If any HTTP header operation fails, _DoWork shall advance to the next action.] */
+                                LogError("HTTPHeaders_Clone failed");
+                            }
+                            else if (!set_message_properties(keys, values, count, requestHeaders, deviceData) ||
+                                (set_system_properties(&systemProperties, requestHeaders) != 0))
                             {
+                                /*Codes_SRS_TRANSPORTMULTITHTTP_17_079: [If any HTTP header operation fails, _DoWork shall advance to the next action.] */
+                                HTTPHeaders_Free(requestHeaders);
+                                requestHeaders = NULL;
+                            }
+                        }
 
-                                if (set_system_properties(message, clonedEventHTTPrequestHeaders) != 0)
+                        if (requestHeaders != NULL)
+                        {
+                            BUFFER_HANDLE toBeSend = BUFFER_create(messageContent, originalMessageSize);
+                            if (toBeSend == NULL)
+                            {
+                                LogError("unable to BUFFER_new");
+                            }
+                            else
+                            {
+                                unsigned int statusCode = 0;
+                                HTTPAPIEX_RESULT r;
+                                if (deviceData->deviceSasToken != NULL)
                                 {
-                                    /*Codes_SRS_TRANSPORTMULTITHTTP_17_079: [If any HTTP header operation fails, _DoWork shall advance to the next action.] */
+                                    /*Codes_SRS_TRANSPORTMULTITHTTP_03_003: [If a deviceSasToken exists, IoTHubTransportHttp_DoWork shall call HTTPAPIEX_ExecuteRequest passing the following parameters] */
+                                    if ((r = HTTPAPIEX_ExecuteRequest(
+                                        deviceData->httpApiExHandle, HTTPAPI_REQUEST_POST, STRING_c_str(deviceData->eventHTTPrelativePath),
+                                        requestHeaders, toBeSend, &statusCode, NULL, NULL)) != HTTPAPIEX_OK)
+                                    {
+                                        LogError("Unable to HTTPAPIEX_ExecuteRequest.");
+                                    }
                                 }
                                 else
                                 {
-                                    BUFFER_HANDLE toBeSend = BUFFER_create(messageContent, originalMessageSize);
-                                    if (toBeSend == NULL)
+                                    /*Codes_SRS_TRANSPORTMULTITHTTP_17_080: [If a deviceSasToken does not exist, IoTHubTransportHttp_DoWork shall call HTTPAPIEX_SAS_ExecuteRequest passing the following parameters] */
+                                    if ((r = HTTPAPIEX_SAS_ExecuteRequest(deviceData->sasObject, deviceData->httpApiExHandle, HTTPAPI_REQUEST_POST, STRING_c_str(deviceData->eventHTTPrelativePath),
+                                        requestHeaders, toBeSend, &statusCode, NULL, NULL )) != HTTPAPIEX_OK)
+                                    {
+                                        LogError("unable to HTTPAPIEX_SAS_ExecuteRequest");
+                                    }
+                                }
+                                if (r == HTTPAPIEX_OK)
+                                {
+                                    if (statusCode < 300)
                                     {
-                                        LogError("unable to BUFFER_new");
+                                        /*Codes_SRS_TRANSPORTMULTITHTTP_17_082: [If HTTPAPIEX_SAS_ExecuteRequest does not fail and http status code <300 then IoTHubTransportHttp_DoWork shall call IoTHubClientCore_LL_SendComplete. Parameter PDLIST_ENTRY completed shall point to a list the item send, and parameter IOTHUB_CLIENT_CONFIRMATION_RESULT result shall be set to IOTHUB_CLIENT_CONFIRMATION_OK. The item shall be removed from waitingToSend.] */
+                                        PDLIST_ENTRY justSent = DList_RemoveHeadList(deviceData->waitingToSend); /*actually this is the same as "actual", but now it is removed*/
+                                        DList_InsertTailList(&(deviceData->eventConfirmations), justSent);
+                                        complete_events(handleData, deviceData, IOTHUB_CLIENT_CONFIRMATION_OK);
                                     }
                                     else
                                     {
-                                        unsigned int statusCode = 0;
-                                        HTTPAPIEX_RESULT r;
-                                        if (deviceData->deviceSasToken != NULL)
-                                        {
-                                            /*Codes_SRS_TRANSPORTMULTITHTTP_03_001: [if a deviceSasToken exists, HTTPHeaders_ReplaceHeaderNameValuePair shall be invoked with "Authorization" as its second argument and STRING_c_str (deviceSasToken) as its third argument.]*/
-                                            if (HTTPHeaders_ReplaceHeaderNameValuePair(clonedEventHTTPrequestHeaders, IOTHUB_AUTH_HEADER_VALUE, STRING_c_str(deviceData->deviceSasToken)) != HTTP_HEADERS_OK)
-                                            {
-                                                r = HTTPAPIEX_ERROR;
-                                                /*Codes_SRS_TRANSPORTMULTITHTTP_03_002: [If the result of the invocation of HTTPHeaders_ReplaceHeaderNameValuePair is NOT HTTP_HEADERS_OK then fallthrough.]*/
-                                                LogError("Unable to replace the old SAS Token.");
-                                            }
-                                            /*Codes_SRS_TRANSPORTMULTITHTTP_03_003: [If a deviceSasToken exists, IoTHubTransportHttp_DoWork shall call HTTPAPIEX_ExecuteRequest passing the following parameters] */
-                                            else if ((r = HTTPAPIEX_ExecuteRequest(
-                                                handleData->httpApiExHandle, HTTPAPI_REQUEST_POST, STRING_c_str(deviceData->eventHTTPrelativePath),
-                                                clonedEventHTTPrequestHeaders, toBeSend, &statusCode, NULL, NULL)) != HTTPAPIEX_OK)
-                                            {
-                                                LogError("Unable to HTTPAPIEX_ExecuteRequest.");
-                                            }
-                                        }
-                                        else
-                                        {
-                                            /*Codes_SRS_TRANSPORTMULTITHTTP_17_080: [If a deviceSasToken does not exist, IoTHubTransportHttp_DoWork shall call HTTPAPIEX_SAS_ExecuteRequest passing the following parameters] */
-                                            if ((r = HTTPAPIEX_SAS_ExecuteRequest(deviceData->sasObject, handleData->httpApiExHandle, HTTPAPI_REQUEST_POST, STRING_c_str(deviceData->eventHTTPrelativePath),
-                                                clonedEventHTTPrequestHeaders, toBeSend, &statusCode, NULL, NULL )) != HTTPAPIEX_OK)
-                                            {
-                                                LogError("unable to HTTPAPIEX_SAS_ExecuteRequest");
-                                            }
-                                        }
-                                        if (r == HTTPAPIEX_OK)
-                                        {
-                                            if (statusCode < 300)
-                                            {
-                                                /*Codes_SRS_TRANSPORTMULTITHTTP_17_082: [If HTTPAPIEX_SAS_ExecuteRequest does not fail and http status code <300 then IoTHubTransportHttp_DoWork shall call IoTHubClientCore_LL_SendComplete. Parameter PDLIST_ENTRY completed shall point to a list the item send, and parameter IOTHUB_CLIENT_CONFIRMATION_RESULT result shall be set to IOTHUB_CLIENT_CONFIRMATION_OK. The item shall be removed from waitingToSend.] */
-                                                PDLIST_ENTRY justSent = DList_RemoveHeadList(deviceData->waitingToSend); /*actually this is the same as "actual", but now it is removed*/
-                                                DList_InsertTailList(&(deviceData->eventConfirmations), justSent);
-                                                handleData->transport_callbacks.send_complete_cb(&(deviceData->eventConfirmations), IOTHUB_CLIENT_CONFIRMATION_OK, deviceData->device_transport_ctx); // takes care of emptying the list too
-                                            }
-                                            else
-                                            {
-                                                /*Codes_SRS_TRANSPORTMULTITHTTP_17_081: [If HTTPAPIEX_SAS_ExecuteRequest fails or the http status code >=300 then IoTHubTransportHttp_DoWork shall not do any other action (it is assumed at the next _DoWork it shall be retried).] */
-                                                LogError("unexpected HTTP status code (%u)", statusCode);
-                                            }
-                                        }
-                                        else if (r == HTTPAPIEX_RECOVERYFAILED)
-                                        {
-                                            PDLIST_ENTRY justSent = DList_RemoveHeadList(deviceData->waitingToSend); /*actually this is the same as "actual", but now it is removed*/
-                                            DList_InsertTailList(&(deviceData->eventConfirmations), justSent);
-                                            handleData->transport_callbacks.send_complete_cb(&(deviceData->eventConfirmations), IOTHUB_CLIENT_CONFIRMATION_ERROR, deviceData->device_transport_ctx); // takes care of emptying the list too
-                                        }
+                                        /*Codes_SRS_TRANSPORTMULTITHTTP_17_081: [If HTTPAPIEX_SAS_ExecuteRequest fails or the http status code >=300 then IoTHubTransportHttp_DoWork shall not do any other action (it is assumed at the next _DoWork it shall be retried).] */
+                                        LogError("unexpected HTTP status code (%u)", statusCode);
                                     }
-                                    BUFFER_delete(toBeSend);
+                                }
+                                else if (r == HTTPAPIEX_RECOVERYFAILED)
+                                {
+                                    PDLIST_ENTRY justSent = DList_RemoveHeadList(deviceData->waitingToSend); /*actually this is the same as "actual", but now it is removed*/
+                                    DList_InsertTailList(&(deviceData->eventConfirmations), justSent);
+                                    complete_events(handleData, deviceData, IOTHUB_CLIENT_CONFIRMATION_ERROR);
                                 }
                             }
+                            BUFFER_delete(toBeSend);
+
+                            if (requestHeaders != deviceData->singleEventHTTPrequestHeaders)
+                            {
+                                HTTPHeaders_Free(requestHeaders);
+                            }
                         }
-                        HTTPHeaders_Free(clonedEventHTTPrequestHeaders);
                     }
                 }
             }
@@ -1947,7 +2164,7 @@ static bool abandonOrAcceptMessage(HTTPTRANSPORT_HANDLE_DATA* handleData, HTTPTR
                                 result = false;
                             }
                             else if ((r = HTTPAPIEX_ExecuteRequest(
-                                handleData->httpApiExHandle,
+                                deviceData->httpApiExHandle,
                                 (action == IOTHUBMESSAGE_ABANDONED) ? HTTPAPI_REQUEST_POST : HTTPAPI_REQUEST_DELETE,                               /*-requestType: POST                                                                                                       */
                                 STRING_c_str(fullAbandonRelativePath),              /*-relativePath: abandon relative path begin (as created by _Create) + value of ETag + "/abandon?api-version=2016-11-14"   */
                                 abandonRequestHttpHeaders,                          /*- requestHttpHeadersHandle: an HTTP headers instance containing the following                                            */
@@ -1966,7 +2183,7 @@ static bool abandonOrAcceptMessage(HTTPTRANSPORT_HANDLE_DATA* handleData, HTTPTR
                         }
                         else if ((r = HTTPAPIEX_SAS_ExecuteRequest(
                             deviceData->sasObject,
-                            handleData->httpApiExHandle,
+                            deviceData->httpApiExHandle,
                             (action == IOTHUBMESSAGE_ABANDONED) ? HTTPAPI_REQUEST_POST : HTTPAPI_REQUEST_DELETE,                               /*-requestType: POST                                                                                                       */
                             STRING_c_str(fullAbandonRelativePath),              /*-relativePath: abandon relative path begin (as created by _Create) + value of ETag + "/abandon?api-version=2016-11-14"   */
                             abandonRequestHttpHeaders,                          /*- requestHttpHeadersHandle: an HTTP headers instance containing the following                                            */
@@ -2124,6 +2341,81 @@ static MESSAGE_CALLBACK_INFO* MESSAGE_CALLBACK_INFO_Create(IOTHUB_MESSAGE_HANDLE
     return result;
 }
 
+static unsigned int getPollingTime(HTTPTRANSPORT_HANDLE_DATA* handleData, HTTPTRANSPORT_PERDEVICE_DATA* deviceData)
+{
+    unsigned int result;
+    if (!handleData->doAdaptivePolling)
+    {
+        result = handleData->getMinimumPollingTime;
+    }
+    else
+    {
+        /*Codes_SRS_TRANSPORTMULTITHTTP_44_005: [ The adaptive polling time shall never be longer than MaximumPollingTime nor shorter than MinimumPollingTime; if the bounds cross, MinimumPollingTime wins. ]*/
+        result = deviceData->adaptivePollingTime;
+        if (result > handleData->getMaximumPollingTime)
+        {
+            result = handleData->getMaximumPollingTime;
+        }
+        if (result < handleData->getMinimumPollingTime)
+        {
+            result = handleData->getMinimumPollingTime;
+        }
+    }
+    return result;
+}
+
+static void updateAdaptivePollingTime(HTTPTRANSPORT_HANDLE_DATA* handleData, HTTPTRANSPORT_PERDEVICE_DATA* deviceData, unsigned int statusCode)
+{
+    if (statusCode == 200)
+    {
+        /*Codes_SRS_TRANSPORTMULTITHTTP_44_003: [ If "AdaptivePolling" is on and a GET returns status code 200, the next GET shall be allowed on the next _DoWork and the polling time shall go back to MinimumPollingTime. ]*/
+        deviceData->hasPendingMessages = true;
+        deviceData->adaptivePollingTime = 0;
+    }
+    else
+    {
+        if (!deviceData->hasPendingMessages)
+        {
+            /*Codes_SRS_TRANSPORTMULTITHTTP_44_004: [ If "AdaptivePolling" is on and a GET that did not follow a received message returns any other status code, the polling time shall double, starting from 1 second. ]*/
+            unsigned int pollingTime = getPollingTime(handleData, deviceData);
+            if (pollingTime == 0)
+            {
+                deviceData->adaptivePollingTime = 1;
+            }
+            else if (pollingTime > handleData->getMaximumPollingTime / 2)
+            {
+                deviceData->adaptivePollingTime = handleData->getMaximumPollingTime;
+            }
+            else
+            {
+                deviceData->adaptivePollingTime = pollingTime * 2;
+            }
+        }
+        /*else the queue was just drained, the next GET happens MinimumPollingTime later*/
+        deviceData->hasPendingMessages = false;
+    }
+}
+
+static void deliver_message(HTTPTRANSPORT_HANDLE_DATA* handleData, HTTPTRANSPORT_PERDEVICE_DATA* deviceData, MESSAGE_CALLBACK_INFO* messageData)
+{
+    bool abandon;
+    if (handleData->transport_callbacks.msg_cb(messageData, deviceData->device_transport_ctx))
+    {
+        abandon = false;
+    }
+    else
+    {
+        LogError("IoTHubClientCore_LL_MessageCallback failed");
+        abandon = true;
+    }
+
+    /*Codes_SRS_TRANSPORTMULTITHTTP_17_096: [If IoTHubClientCore_LL_MessageCallback returns false then _DoWork shall "abandon" the message.] */
+    if (abandon)
+    {
+        (void)IoTHubTransportHttp_SendMessageDisposition(messageData, IOTHUBMESSAGE_ABANDONED);
+    }
+}
+
 static void DoMessages(HTTPTRANSPORT_HANDLE_DATA* handleData, HTTPTRANSPORT_PERDEVICE_DATA* deviceData)
 {
     /*Codes_SRS_TRANSPORTMULTITHTTP_17_083: [ If device is not subscribed then _DoWork shall advance to the next action. ] */
@@ -2132,8 +2424,9 @@ static void DoMessages(HTTPTRANSPORT_HANDLE_DATA* handleData, HTTPTRANSPORT_PERD
         /*Codes_SRS_TRANSPORTMULTITHTTP_17_123: [After client creation, the first GET shall be allowed no matter what the value of GetMinimumPollingTime.] */
         /*Codes_SRS_TRANSPORTMULTITHTTP_17_124: [If time is not available then all calls shall be treated as if they are the first one.] */
         /*Codes_SRS_TRANSPORTMULTITHTTP_17_122: [A GET request that happens earlier than GetMinimumPollingTime shall be ignored.] */
+        /*Codes_SRS_TRANSPORTMULTITHTTP_44_003: [ If "AdaptivePolling" is on and a GET returns status code 200, the next GET shall be allowed on the next _DoWork and the polling time shall go back to MinimumPollingTime. ]*/
         time_t timeNow = get_time(NULL);
-        bool isPollingAllowed = deviceData->isFirstPoll || (timeNow == (time_t)(-1)) || (get_difftime(timeNow, deviceData->lastPollTime) > handleData->getMinimumPollingTime);
+        bool isPollingAllowed = deviceData->isFirstPoll || (handleData->doAdaptivePolling && deviceData->hasPendingMessages) || (timeNow == (time_t)(-1)) || (get_difftime(timeNow, deviceData->lastPollTime) > getPollingTime(handleData, deviceData));
         if (isPollingAllowed)
         {
             HTTP_HEADERS_HANDLE responseHTTPHeaders = HTTPHeaders_Alloc();
@@ -2156,15 +2449,9 @@ static void DoMessages(HTTPTRANSPORT_HANDLE_DATA* handleData, HTTPTRANSPORT_PERD
                     HTTPAPIEX_RESULT r;
                     if (deviceData->deviceSasToken != NULL)
                     {
-                        /*Codes_SRS_TRANSPORTMULTITHTTP_03_001: [if a deviceSasToken exists, HTTPHeaders_ReplaceHeaderNameValuePair shall be invoked with "Authorization" as its second argument and STRING_c_str (deviceSasToken) as its third argument.]*/
-                        if (HTTPHeaders_ReplaceHeaderNameValuePair(deviceData->messageHTTPrequestHeaders, IOTHUB_AUTH_HEADER_VALUE, STRING_c_str(deviceData->deviceSasToken)) != HTTP_HEADERS_OK)
-                        {
-                            r = HTTPAPIEX_ERROR;
-                            /*Codes_SRS_TRANSPORTMULTITHTTP_03_002: [If the result of the invocation of HTTPHeaders_ReplaceHeaderNameValuePair is NOT HTTP_HEADERS_OK then fallthrough.]*/
-                            LogError("Unable to replace the old SAS Token.");
-                        }
-                        else if ((r = HTTPAPIEX_ExecuteRequest(
-                            handleData->httpApiExHandle,
+                        /*Codes_SRS_TRANSPORTMULTITHTTP_44_016: [ If a deviceSasToken exists, the "Authorization" header of the event HTTP request headers and of the message HTTP request headers shall be created with the value of deviceSasToken. ]*/
+                        if ((r = HTTPAPIEX_ExecuteRequest(
+                            deviceData->httpApiExHandle,
                             HTTPAPI_REQUEST_GET,                                            /*requestType: GET*/
                             STRING_c_str(deviceData->messageHTTPrelativePath),         /*relativePath: the message HTTP relative path*/
                             deviceData->messageHTTPrequestHeaders,                     /*requestHttpHeadersHandle: message HTTP request headers created by _Create*/
@@ -2190,7 +2477,7 @@ static void DoMessages(HTTPTRANSPORT_HANDLE_DATA* handleData, HTTPTRANSPORT_PERD
                     */
                     else if ((r = HTTPAPIEX_SAS_ExecuteRequest(
                         deviceData->sasObject,
-                        handleData->httpApiExHandle,
+                        deviceData->httpApiExHandle,
                         HTTPAPI_REQUEST_GET,                                            /*requestType: GET*/
                         STRING_c_str(deviceData->messageHTTPrelativePath),         /*relativePath: the message HTTP relative path*/
                         deviceData->messageHTTPrequestHeaders,                     /*requestHttpHeadersHandle: message HTTP request headers created by _Create*/
@@ -2215,6 +2502,10 @@ static void DoMessages(HTTPTRANSPORT_HANDLE_DATA* handleData, HTTPTRANSPORT_PERD
                             deviceData->isFirstPoll = false;
                             deviceData->lastPollTime = timeNow;
                         }
+                        if (handleData->doAdaptivePolling)
+                        {
+                            updateAdaptivePollingTime(handleData, deviceData, statusCode);
+                        }
                         if (statusCode == 204)
                         {
                             /*Codes_SRS_TRANSPORTMULTITHTTP_17_086: [If the HTTPAPIEX_SAS_ExecuteRequest executed successfully then status code shall be examined. Any status code different than 200 causes _DoWork to advance to the next action.] */
@@ -2285,24 +2576,14 @@ static void DoMessages(HTTPTRANSPORT_HANDLE_DATA* handleData, HTTPTRANSPORT_PERD
                                                     LogError("HTTP Transport layer failed to report ABANDON disposition");
                                                 }
                                             }
+                                            else if (deviceData->deferCallbacks)
+                                            {
+                                                /*a GET returns at most one message, the DoWork thread hands it to the client once the pass is over*/
+                                                deviceData->pendingMessage = messageData;
+                                            }
                                             else
                                             {
-                                                bool abandon;
-                                                if (handleData->transport_callbacks.msg_cb(messageData, deviceData->device_transport_ctx))
-                                                {
-                                                    abandon = false;
-                                                }
-                                                else
-                                                {
-                                                    LogError("IoTHubClientCore_LL_MessageCallback failed");
-                                                    abandon = true;
-                                                }
-
-                                                /*Codes_SRS_TRANSPORTMULTITHTTP_17_096: [If IoTHubClientCore_LL_MessageCallback returns false then _DoWork shall "abandon" the message.] */
-                                                if (abandon)
-                                                {
-                                                    (void)IoTHubTransportHttp_SendMessageDisposition(messageData, IOTHUBMESSAGE_ABANDONED);
-                                                }
+                                                deliver_message(handleData, deviceData, messageData);
                                             }
                                         }
                                         IoTHubMessage_Destroy(receivedMessage);
@@ -2333,23 +2614,227 @@ static IOTHUB_PROCESS_ITEM_RESULT IoTHubTransportHttp_ProcessItem(TRANSPORT_LL_H
     return IOTHUB_PROCESS_ERROR;
 }
 
+static void DoWorkForConnection(HTTPTRANSPORT_CONNECTION* connection, bool deferCallbacks)
+{
+    HTTPTRANSPORT_HANDLE_DATA* handleData = connection->handleData;
+    size_t deviceListSize = VECTOR_size(handleData->perDeviceList);
+    /*Codes_SRS_TRANSPORTMULTITHTTP_44_009: [ Connection k of the pool shall serve the devices at positions k, k + pool size, k + 2 * pool size... of the transport device list, one after the other. ]*/
+    for (size_t i = connection->index; i < deviceListSize; i += handleData->connectionCount)
+    {
+        IOTHUB_DEVICE_HANDLE* listItem = (IOTHUB_DEVICE_HANDLE *)VECTOR_element(handleData->perDeviceList, i);
+        HTTPTRANSPORT_PERDEVICE_DATA* perDeviceItem = *(HTTPTRANSPORT_PERDEVICE_DATA**)(listItem);
+        perDeviceItem->httpApiExHandle = connection->httpApiExHandle;
+        perDeviceItem->deferCallbacks = deferCallbacks;
+        DoEvent(handleData, perDeviceItem);
+        DoMessages(handleData, perDeviceItem);
+        perDeviceItem->deferCallbacks = false;
+    }
+}
+
+static int connection_worker_thread(void* threadArgument)
+{
+    HTTPTRANSPORT_CONNECTION* connection = (HTTPTRANSPORT_CONNECTION*)threadArgument;
+
+    while (1)
+    {
+        if (Lock(connection->lock) != LOCK_OK)
+        {
+            LogError("failed locking connection %lu of the pool", (unsigned long)connection->index);
+            ThreadAPI_Sleep(1);
+        }
+        else
+        {
+            while (!connection->stopThread && !connection->hasWork)
+            {
+                /*0 waits until the condition is posted*/
+                (void)Condition_Wait(connection->condition, connection->lock, 0);
+            }
+
+            if (connection->stopThread)
+            {
+                (void)Unlock(connection->lock);
+                break;
+            }
+            (void)Unlock(connection->lock);
+
+            DoWorkForConnection(connection, true);
+
+            if (Lock(connection->lock) != LOCK_OK)
+            {
+                LogError("unable to Lock - - will still report the pass of connection %lu done", (unsigned long)connection->index);
+            }
+            connection->hasWork = false;
+            (void)Condition_Post(connection->condition);
+            (void)Unlock(connection->lock);
+        }
+    }
+
+    ThreadAPI_Exit(0);
+    return 0;
+}
+
+static int start_connection_thread(HTTPTRANSPORT_CONNECTION* connection)
+{
+    int result;
+
+    if ((connection->lock = Lock_Init()) == NULL)
+    {
+        LogError("Lock_Init failed for connection %lu of the pool", (unsigned long)connection->index);
+        result = MU_FAILURE;
+    }
+    else if ((connection->condition = Condition_Init()) == NULL)
+    {
+        LogError("Condition_Init failed for connection %lu of the pool", (unsigned long)connection->index);
+        Lock_Deinit(connection->lock);
+        connection->lock = NULL;
+        result = MU_FAILURE;
+    }
+    else
+    {
+        connection->hasWork = false;
+        connection->stopThread = false;
+        if (ThreadAPI_Create(&connection->threadHandle, connection_worker_thread, connection) != THREADAPI_OK)
+        {
+            LogError("ThreadAPI_Create failed, connection %lu is served on the calling thread", (unsigned long)connection->index);
+            connection->threadHandle = NULL;
+            Condition_Deinit(connection->condition);
+            connection->condition = NULL;
+            Lock_Deinit(connection->lock);
+            connection->lock = NULL;
+            result = MU_FAILURE;
+        }
+        else
+        {
+            result = 0;
+        }
+    }
+
+    return result;
+}
+
+static bool hand_pass_to_thread(HTTPTRANSPORT_CONNECTION* connection)
+{
+    bool result;
+
+    if ((connection->threadHandle == NULL) && (start_connection_thread(connection) != 0))
+    {
+        result = false;
+    }
+    else if (Lock(connection->lock) != LOCK_OK)
+    {
+        LogError("failed locking connection %lu of the pool, it is served on the calling thread", (unsigned long)connection->index);
+        result = false;
+    }
+    else
+    {
+        connection->hasWork = true;
+        (void)Condition_Post(connection->condition);
+        (void)Unlock(connection->lock);
+        result = true;
+    }
+
+    return result;
+}
+
+static void wait_for_pass(HTTPTRANSPORT_CONNECTION* connection)
+{
+    if (Lock(connection->lock) != LOCK_OK)
+    {
+        LogError("failed locking connection %lu of the pool", (unsigned long)connection->index);
+    }
+    else
+    {
+        while (connection->hasWork)
+        {
+            /*0 waits until the condition is posted*/
+            (void)Condition_Wait(connection->condition, connection->lock, 0);
+        }
+        (void)Unlock(connection->lock);
+    }
+}
+
+/*runs the callbacks the threads of the pool left to the DoWork thread, in the order of the device list*/
+static void deliver_deferred_callbacks(HTTPTRANSPORT_HANDLE_DATA* handleData)
+{
+    size_t deviceListSize = VECTOR_size(handleData->perDeviceList);
+    for (size_t i = 0; i < deviceListSize; i++)
+    {
+        IOTHUB_DEVICE_HANDLE* listItem = (IOTHUB_DEVICE_HANDLE *)VECTOR_element(handleData->perDeviceList, i);
+        HTTPTRANSPORT_PERDEVICE_DATA* perDeviceItem = *(HTTPTRANSPORT_PERDEVICE_DATA**)(listItem);
+
+        if (perDeviceItem->hasPendingConfirmation)
+        {
+            perDeviceItem->hasPendingConfirmation = false;
+            handleData->transport_callbacks.send_complete_cb(&(perDeviceItem->eventConfirmations), perDeviceItem->pendingConfirmationResult, perDeviceItem->device_transport_ctx);
+        }
+
+        if (perDeviceItem->pendingMessage != NULL)
+        {
+            MESSAGE_CALLBACK_INFO* messageData = perDeviceItem->pendingMessage;
+            perDeviceItem->pendingMessage = NULL;
+            deliver_message(handleData, perDeviceItem, messageData);
+        }
+    }
+}
+
+static void DoWorkOnConnectionPool(HTTPTRANSPORT_HANDLE_DATA* handleData)
+{
+    bool servedByThread[MAXIMUM_HTTP_CONNECTION_POOL_SIZE] = { false };
+    bool anyServedByThread = false;
+
+    /*Codes_SRS_TRANSPORTMULTITHTTP_44_010: [ If the pool has more than one connection, IoTHubTransportHttp_DoWork shall hand every connection but the first one to its own thread, started with ThreadAPI_Create by the first call and kept until the pool is destroyed, serve the first one on the calling thread, and wait for the threads to finish the pass before returning. ]*/
+    for (size_t i = 1; i < handleData->connectionCount; i++)
+    {
+        servedByThread[i] = hand_pass_to_thread(&handleData->connections[i]);
+        anyServedByThread = anyServedByThread || servedByThread[i];
+    }
+
+    DoWorkForConnection(&handleData->connections[0], false);
+
+    for (size_t i = 1; i < handleData->connectionCount; i++)
+    {
+        if (!servedByThread[i])
+        {
+            /*Codes_SRS_TRANSPORTMULTITHTTP_44_011: [ If ThreadAPI_Create fails, the devices of that connection shall be served on the calling thread. ]*/
+            DoWorkForConnection(&handleData->connections[i], false);
+        }
+        else
+        {
+            wait_for_pass(&handleData->connections[i]);
+        }
+    }
+
+    if (anyServedByThread)
+    {
+        /*Codes_SRS_TRANSPORTMULTITHTTP_44_021: [ The confirmations and messages of the devices served by the threads of the pool shall be handed to IoTHubClientCore_LL on the calling thread, once every connection is done with the pass. ]*/
+        deliver_deferred_callbacks(handleData);
+    }
+}
+
 static void IoTHubTransportHttp_DoWork(TRANSPORT_LL_HANDLE handle)
 {
     /*Codes_SRS_TRANSPORTMULTITHTTP_17_049: [ If handle is NULL, then IoTHubTransportHttp_DoWork shall do nothing. ]*/
     if (handle != NULL)
     {
         HTTPTRANSPORT_HANDLE_DATA* handleData = (HTTPTRANSPORT_HANDLE_DATA*)handle;
-        IOTHUB_DEVICE_HANDLE* listItem;
-        size_t deviceListSize = VECTOR_size(handleData->perDeviceList);
-        /*Codes_SRS_TRANSPORTMULTITHTTP_17_052: [ IoTHubTransportHttp_DoWork shall perform a round-robin loop through every deviceHandle in the transport device list. ]*/
-        /*Codes_SRS_TRANSPORTMULTITHTTP_17_050: [ IoTHubTransportHttp_DoWork shall call loop through the device list. ] */
-        /*Codes_SRS_TRANSPORTMULTITHTTP_17_051: [ IF the list is empty, then IoTHubTransportHttp_DoWork shall do nothing. ]*/
-        for (size_t i = 0; i < deviceListSize; i++)
+        if (handleData->connections != NULL)
         {
-            listItem = (IOTHUB_DEVICE_HANDLE *)VECTOR_element(handleData->perDeviceList, i);
-            HTTPTRANSPORT_PERDEVICE_DATA* perDeviceItem = *(HTTPTRANSPORT_PERDEVICE_DATA**)(listItem);
-            DoEvent(handleData, perDeviceItem);
-            DoMessages(handleData, perDeviceItem);
+            DoWorkOnConnectionPool(handleData);
+        }
+        else
+        {
+            IOTHUB_DEVICE_HANDLE* listItem;
+            size_t deviceListSize = VECTOR_size(handleData->perDeviceList);
+            /*Codes_SRS_TRANSPORTMULTITHTTP_17_052: [ IoTHubTransportHttp_DoWork shall perform a round-robin loop through every deviceHandle in the transport device list. ]*/
+            /*Codes_SRS_TRANSPORTMULTITHTTP_17_050: [ IoTHubTransportHttp_DoWork shall call loop through the device list. ] */
+            /*Codes_SRS_TRANSPORTMULTITHTTP_17_051: [ IF the list is empty, then IoTHubTransportHttp_DoWork shall do nothing. ]*/
+            for (size_t i = 0; i < deviceListSize; i++)
+            {
+                listItem = (IOTHUB_DEVICE_HANDLE *)VECTOR_element(handleData->perDeviceList, i);
+                HTTPTRANSPORT_PERDEVICE_DATA* perDeviceItem = *(HTTPTRANSPORT_PERDEVICE_DATA**)(listItem);
+                DoEvent(handleData, perDeviceItem);
+                DoMessages(handleData, perDeviceItem);
+            }
         }
     }
     else
@@ -2403,6 +2888,155 @@ static IOTHUB_CLIENT_RESULT IoTHubTransportHttp_GetSendStatus(IOTHUB_DEVICE_HAND
     return result;
 }
 
+static void saveOption(HTTPTRANSPORT_HANDLE_DATA* handleData, const char* option, const void* value)
+{
+    const void* clonedValue;
+    if ((handleData->savedOptions == NULL) && ((handleData->savedOptions = VECTOR_create(sizeof(HTTPTRANSPORT_SAVED_OPTION))) == NULL))
+    {
+        LogError("unable to VECTOR_create, option %s will not reach new connections", option);
+    }
+    else if (HTTPAPI_CloneOption(option, value, &clonedValue) != HTTPAPI_OK)
+    {
+        LogError("unable to HTTPAPI_CloneOption, option %s will not reach new connections", option);
+    }
+    else
+    {
+        size_t savedOptionsCount = VECTOR_size(handleData->savedOptions);
+        size_t i;
+        for (i = 0; i < savedOptionsCount; i++)
+        {
+            HTTPTRANSPORT_SAVED_OPTION* savedOption = (HTTPTRANSPORT_SAVED_OPTION*)VECTOR_element(handleData->savedOptions, i);
+            if (strcmp(savedOption->name, option) == 0)
+            {
+                free((void*)savedOption->value);
+                savedOption->value = clonedValue;
+                break;
+            }
+        }
+
+        if (i == savedOptionsCount)
+        {
+            HTTPTRANSPORT_SAVED_OPTION newOption;
+            size_t nameLength = strlen(option);
+            if ((newOption.name = (char*)malloc(nameLength + 1)) == NULL)
+            {
+                LogError("unable to malloc, option %s will not reach new connections", option);
+                free((void*)clonedValue);
+            }
+            else
+            {
+                (void)memcpy(newOption.name, option, nameLength + 1);
+                newOption.value = clonedValue;
+                if (VECTOR_push_back(handleData->savedOptions, &newOption, 1) != 0)
+                {
+                    LogError("unable to VECTOR_push_back, option %s will not reach new connections", option);
+                    free(newOption.name);
+                    free((void*)clonedValue);
+                }
+            }
+        }
+    }
+}
+
+/*Codes_SRS_TRANSPORTMULTITHTTP_44_013: [ Every other connection shall be created with HTTPAPIEX_Create and shall receive, through HTTPAPIEX_SetOption, every option previously passed down to HTTPAPIEX. ]*/
+static HTTPAPIEX_HANDLE create_poolConnection(HTTPTRANSPORT_HANDLE_DATA* handleData)
+{
+    HTTPAPIEX_HANDLE result = HTTPAPIEX_Create(STRING_c_str(handleData->hostName));
+    if (result == NULL)
+    {
+        LogError("unable to HTTPAPIEX_Create");
+    }
+    else if (handleData->savedOptions != NULL)
+    {
+        size_t savedOptionsCount = VECTOR_size(handleData->savedOptions);
+        for (size_t i = 0; i < savedOptionsCount; i++)
+        {
+            HTTPTRANSPORT_SAVED_OPTION* savedOption = (HTTPTRANSPORT_SAVED_OPTION*)VECTOR_element(handleData->savedOptions, i);
+            if (HTTPAPIEX_SetOption(result, savedOption->name, savedOption->value) != HTTPAPIEX_OK)
+            {
+                LogError("unable to HTTPAPIEX_SetOption %s", savedOption->name);
+                HTTPAPIEX_Destroy(result);
+                result = NULL;
+                break;
+            }
+        }
+    }
+    return result;
+}
+
+static IOTHUB_CLIENT_RESULT setConnectionPoolSize(HTTPTRANSPORT_HANDLE_DATA* handleData, unsigned int poolSize)
+{
+    IOTHUB_CLIENT_RESULT result;
+    if ((poolSize == 0) || (poolSize > MAXIMUM_HTTP_CONNECTION_POOL_SIZE))
+    {
+        /*Codes_SRS_TRANSPORTMULTITHTTP_44_012: [ If the pool size is 0 or bigger than 64 then IoTHubTransportHttp_SetOption shall return IOTHUB_CLIENT_INVALID_ARG. ]*/
+        LogError("invalid HTTP connection pool size %u, expected 1 to %u", poolSize, (unsigned int)MAXIMUM_HTTP_CONNECTION_POOL_SIZE);
+        result = IOTHUB_CLIENT_INVALID_ARG;
+    }
+    else
+    {
+        HTTPTRANSPORT_CONNECTION* connections;
+        if (poolSize == 1)
+        {
+            connections = NULL;
+            result = IOTHUB_CLIENT_OK;
+        }
+        else if ((connections = (HTTPTRANSPORT_CONNECTION*)malloc(poolSize * sizeof(HTTPTRANSPORT_CONNECTION))) == NULL)
+        {
+            LogError("unable to malloc the HTTP connection pool");
+            result = IOTHUB_CLIENT_ERROR;
+        }
+        else
+        {
+            size_t i;
+            result = IOTHUB_CLIENT_OK;
+            for (i = 0; i < poolSize; i++)
+            {
+                connections[i].handleData = handleData;
+                connections[i].index = i;
+                connections[i].threadHandle = NULL;
+                connections[i].lock = NULL;
+                connections[i].condition = NULL;
+                connections[i].hasWork = false;
+                connections[i].stopThread = false;
+                if (i == 0)
+                {
+                    connections[i].httpApiExHandle = handleData->httpApiExHandle;
+                }
+                else if ((connections[i].httpApiExHandle = create_poolConnection(handleData)) == NULL)
+                {
+                    LogError("unable to create connection %lu of the pool", (unsigned long)i);
+                    result = IOTHUB_CLIENT_ERROR;
+                    break;
+                }
+            }
+
+            if (result != IOTHUB_CLIENT_OK)
+            {
+                /*Codes_SRS_TRANSPORTMULTITHTTP_44_014: [ If building the pool fails, IoTHubTransportHttp_SetOption shall keep the previous pool and return IOTHUB_CLIENT_ERROR. ]*/
+                destroy_connectionPool(connections, i);
+            }
+        }
+
+        if (result == IOTHUB_CLIENT_OK)
+        {
+            /*devices that used a connection about to be destroyed go back to the transport's own connection until the next DoWork*/
+            size_t deviceListSize = VECTOR_size(handleData->perDeviceList);
+            for (size_t i = 0; i < deviceListSize; i++)
+            {
+                IOTHUB_DEVICE_HANDLE* listItem = (IOTHUB_DEVICE_HANDLE *)VECTOR_element(handleData->perDeviceList, i);
+                HTTPTRANSPORT_PERDEVICE_DATA* perDeviceItem = *(HTTPTRANSPORT_PERDEVICE_DATA**)(listItem);
+                perDeviceItem->httpApiExHandle = handleData->httpApiExHandle;
+            }
+
+            destroy_connectionPool(handleData->connections, handleData->connectionCount);
+            handleData->connections = connections;
+            handleData->connectionCount = (connections == NULL) ? 0 : poolSize;
+        }
+    }
+    return result;
+}
+
 static IOTHUB_CLIENT_RESULT IoTHubTransportHttp_SetOption(TRANSPORT_LL_HANDLE handle, const char* option, const void* value)
 {
     IOTHUB_CLIENT_RESULT result;
@@ -2434,6 +3068,23 @@ static IOTHUB_CLIENT_RESULT IoTHubTransportHttp_SetOption(TRANSPORT_LL_HANDLE ha
             handleData->getMinimumPollingTime = *(unsigned int*)value;
             result = IOTHUB_CLIENT_OK;
         }
+        /*Codes_SRS_TRANSPORTMULTITHTTP_44_006: ["MaximumPollingTime"] */
+        else if (strcmp(OPTION_MAX_POLLING_TIME, option) == 0)
+        {
+            handleData->getMaximumPollingTime = *(unsigned int*)value;
+            result = IOTHUB_CLIENT_OK;
+        }
+        /*Codes_SRS_TRANSPORTMULTITHTTP_44_007: ["AdaptivePolling"] */
+        else if (strcmp(OPTION_ADAPTIVE_POLLING, option) == 0)
+        {
+            handleData->doAdaptivePolling = *(bool*)value;
+            result = IOTHUB_CLIENT_OK;
+        }
+        /*Codes_SRS_TRANSPORTMULTITHTTP_44_008: ["HttpConnectionPoolSize"] */
+        else if (strcmp(OPTION_HTTP_CONNECTION_POOL_SIZE, option) == 0)
+        {
+            result = setConnectionPoolSize(handleData, *(unsigned int*)value);
+        }
         else
         {
             /*Codes_SRS_TRANSPORTMULTITHTTP_17_126: [ "TrustedCerts"] */
@@ -2444,6 +3095,15 @@ static IOTHUB_CLIENT_RESULT IoTHubTransportHttp_SetOption(TRANSPORT_LL_HANDLE ha
             /*Codes_SRS_TRANSPORTMULTITHTTP_17_119: [The following table translates HTTPAPIEX return codes to IOTHUB_CLIENT_RESULT return codes:] */
             if (HTTPAPIEX_result == HTTPAPIEX_OK)
             {
+                /*Codes_SRS_TRANSPORTMULTITHTTP_44_015: [ Options accepted by HTTPAPIEX shall be saved with HTTPAPI_CloneOption and passed down to every other connection of the pool. ]*/
+                saveOption(handleData, option, value);
+                for (size_t i = 1; i < handleData->connectionCount; i++)
+                {
+                    if (HTTPAPIEX_SetOption(handleData->connections[i].httpApiExHandle, option, value) != HTTPAPIEX_OK)
+                    {
+                        LogError("unable to HTTPAPIEX_SetOption %s on connection %lu of the pool", option, (unsigned long)i);
+                    }
+                }
                 result = IOTHUB_CLIENT_OK;
             }
             else if (HTTPAPIEX_result == HTTPAPIEX_INVALID_ARG)
@@ -2563,7 +3223,8 @@ static TRANSPORT_PROVIDER thisTransportProvider =
     IotHubTransportHttp_Unsubscribe_InputQueue,     /*pfIoTHubTransport_Unsubscribe_InputQueue IoTHubTransport_Unsubscribe_InputQueue; */
     IoTHubTransportHttp_SetCallbackContext,         /*pfIoTHubTransport_SetTransportCallbacks IoTHubTransport_SetTransportCallbacks; */
     IoTHubTransportHttp_GetTwinAsync,               /*pfIoTHubTransport_GetTwinAsync IoTHubTransport_GetTwinAsync;*/
-    IoTHubTransportHttp_GetSupportedPlatformInfo      /*pfIoTHubTransport_GetSupportedPlatformInfo IoTHubTransport_GetSupportedPlatformInfo;*/
+    IoTHubTransportHttp_GetSupportedPlatformInfo,     /*pfIoTHubTransport_GetSupportedPlatformInfo IoTHubTransport_GetSupportedPlatformInfo;*/
+    IoTHubTransportHttp_GetRttStatistics            /*pfIoTHubTransport_GetRttStatistics IoTHubTransport_GetRttStatistics;*/
 };
 
 const TRANSPORT_PROVIDER* HTTP_Protocol(void)
@@ -179,6 +179,12 @@ static int IotHubTransportMqtt_GetSupportedPlatformInfo(TRANSPORT_LL_HANDLE hand
     return IoTHubTransport_MQTT_GetSupportedPlatformInfo(handle, info);
 }
 
+static IOTHUB_CLIENT_RESULT IotHubTransportMqtt_GetRttStatistics(TRANSPORT_LL_HANDLE handle, IOTHUB_CLIENT_RTT_STATISTICS* rttStatistics)
+{
+    // Codes_SRS_IOTHUB_MQTT_TRANSPORT_44_001: [ IotHubTransportMqtt_GetRttStatistics shall call into the IoTHubTransport_MQTT_Common_GetRttStatistics function and return its result. ]
+    return IoTHubTransport_MQTT_Common_GetRttStatistics(handle, rttStatistics);
+}
+
 static TRANSPORT_PROVIDER myfunc =
 {
     IoTHubTransportMqtt_SendMessageDisposition,     /*pfIotHubTransport_SendMessageDisposition IoTHubTransport_SendMessageDisposition;*/
@@ -203,7 +209,8 @@ static TRANSPORT_PROVIDER myfunc =
     IotHubTransportMqtt_Unsubscribe_InputQueue,     /*pfIoTHubTransport_Unsubscribe_InputQueue IoTHubTransport_Unsubscribe_InputQueue; */
     IotHubTransportMqtt_SetCallbackContext,         /*pfIoTHubTransport_SetCallbackContext IoTHubTransport_SetCallbackContext; */
     IoTHubTransportMqtt_GetTwinAsync,               /*pfIoTHubTransport_GetTwinAsync IoTHubTransport_GetTwinAsync;*/
-    IotHubTransportMqtt_GetSupportedPlatformInfo      /*pfIoTHubTransport_GetSupportedPlatformInfo IoTHubTransport_GetSupportedPlatformInfo;*/
+    IotHubTransportMqtt_GetSupportedPlatformInfo,     /*pfIoTHubTransport_GetSupportedPlatformInfo IoTHubTransport_GetSupportedPlatformInfo;*/
+    IotHubTransportMqtt_GetRttStatistics            /*pfIoTHubTransport_GetRttStatistics IoTHubTransport_GetRttStatistics;*/
 };
 
 /* Codes_SRS_IOTHUB_MQTT_TRANSPORT_07_022: [This function shall return a pointer to a structure of type TRANSPORT_PROVIDER */
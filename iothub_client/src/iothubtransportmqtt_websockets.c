@@ -236,6 +236,12 @@ static int IotHubTransportMqtt_WS_GetSupportedPlatformInfo(TRANSPORT_LL_HANDLE h
     return IoTHubTransport_MQTT_GetSupportedPlatformInfo(handle, info);
 }
 
+static IOTHUB_CLIENT_RESULT IotHubTransportMqtt_WS_GetRttStatistics(TRANSPORT_LL_HANDLE handle, IOTHUB_CLIENT_RTT_STATISTICS* rttStatistics)
+{
+    // Codes_SRS_IOTHUB_MQTT_WEBSOCKET_TRANSPORT_44_001: [ IotHubTransportMqtt_WS_GetRttStatistics shall call into the IoTHubTransport_MQTT_Common_GetRttStatistics function and return its result. ]
+    return IoTHubTransport_MQTT_Common_GetRttStatistics(handle, rttStatistics);
+}
+
 /* Codes_SRS_IOTHUB_MQTT_WEBSOCKET_TRANSPORT_07_011: [ This function shall return a pointer to a structure of type TRANSPORT_PROVIDER having the following values for its fields:
 IoTHubTransport_SendMessageDisposition = IoTHubTransport_WS_SendMessageDisposition
 IoTHubTransport_Subscribe_DeviceMethod = IoTHubTransport_WS_Subscribe_DeviceMethod
@@ -249,7 +255,8 @@ IoTHubTransport_Subscribe = IoTHubTransportMqtt_WS_Subscribe
 IoTHubTransport_Unsubscribe = IoTHubTransportMqtt_WS_Unsubscribe
 IoTHubTransport_DoWork = IoTHubTransportMqtt_WS_DoWork
 IoTHubTransport_SetOption = IoTHubTransportMqtt_WS_SetOption 
-IoTHubTransport_GetSupportedPlatformInfo = IoTHubTransportMqtt_WS_GetSupportedPlatformInfo ] */
+IoTHubTransport_GetSupportedPlatformInfo = IoTHubTransportMqtt_WS_GetSupportedPlatformInfo
+IoTHubTransport_GetRttStatistics = IoTHubTransportMqtt_WS_GetRttStatistics ] */
 static TRANSPORT_PROVIDER thisTransportProvider_WebSocketsOverTls = {
     IoTHubTransportMqtt_WS_SendMessageDisposition,
     IoTHubTransportMqtt_WS_Subscribe_DeviceMethod,
@@ -273,7 +280,8 @@ static TRANSPORT_PROVIDER thisTransportProvider_WebSocketsOverTls = {
     IoTHubTransportMqtt_WS_Unsubscribe_InputQueue,
     IotHubTransportMqtt_WS_SetCallbackContext,
     IoTHubTransportMqtt_WS_GetTwinAsync,
-    IotHubTransportMqtt_WS_GetSupportedPlatformInfo
+    IotHubTransportMqtt_WS_GetSupportedPlatformInfo,
+    IotHubTransportMqtt_WS_GetRttStatistics
 };
 
 const TRANSPORT_PROVIDER* MQTT_WebSocket_Protocol(void)
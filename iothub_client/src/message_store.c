@@ -0,0 +1,860 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "azure_c_shared_utility/optimize_size.h"
+#include "azure_c_shared_utility/gballoc.h"
+#include "azure_c_shared_utility/xlogging.h"
+#include "azure_c_shared_utility/map.h"
+
+#include "iothub_message.h"
+#include "internal/message_store.h"
+
+#ifndef MESSAGE_STORE_SEGMENT_SIZE
+#define MESSAGE_STORE_SEGMENT_SIZE (1024 * 1024)
+#endif
+
+#ifndef MESSAGE_STORE_SEGMENT_COUNT
+#define MESSAGE_STORE_SEGMENT_COUNT 16
+#endif
+
+#define SEGMENT_FILE_NAME_FORMAT "%s/segment_%02lu.log"
+#define SEGMENT_MAGIC 0x4753534D
+#define RECORD_MAGIC 0x4352534D
+#define RECORD_STATE_PENDING 1
+#define RECORD_STATE_RELEASED 2
+#define RECORD_ALIGNMENT 8
+#define ALIGN_RECORD_SIZE(size) (((size) + (RECORD_ALIGNMENT - 1)) & ~((size_t)RECORD_ALIGNMENT - 1))
+#define RECORDS_OFFSET ALIGN_RECORD_SIZE(sizeof(SEGMENT_HEADER))
+#define MESSAGE_HEADER_SIZE 4
+
+// Layout of a segment file:
+//     SEGMENT_HEADER, then records, each one a RECORD_HEADER followed by the serialized message, padded to RECORD_ALIGNMENT.
+// A record is only valid if its checksum matches and its sequence is not lower than the base sequence of the segment,
+// so records left over from before the segment was reused, or torn by a power loss, are ignored.
+//
+// Layout of a serialized message:
+//     content type, priority, security flag and a reserved byte
+//     payload length (uint32) and payload, including the terminating '\0' for string messages
+//     the system properties of MESSAGE_STRING_FIELDS, each one a length (uint32, 0 when not set) and a '\0' terminated string
+//     property count (uint32), then every key and value as above
+
+typedef struct SEGMENT_HEADER_TAG
+{
+    uint32_t magic;
+    uint32_t segment_size;
+    uint64_t base_sequence; /*sequence of the first record written since the segment was last reused*/
+} SEGMENT_HEADER;
+
+typedef struct RECORD_HEADER_TAG
+{
+    uint32_t magic;
+    uint32_t length; /*of the serialized message following the header*/
+    uint64_t sequence;
+    uint32_t checksum; /*of length, sequence and the serialized message*/
+    uint32_t state;
+} RECORD_HEADER;
+
+typedef struct SEGMENT_TAG
+{
+    int file;
+    unsigned char* memory;
+    size_t live_count; /*records not released yet, the segment cannot be reused until it drops to 0*/
+    size_t dirty_begin;
+    size_t dirty_end; /*equal to dirty_begin when nothing changed since the last commit*/
+    size_t end_offset; /*only used while the log is opened*/
+    uint64_t first_sequence;
+    uint64_t last_sequence;
+} SEGMENT;
+
+typedef struct MESSAGE_STORE_TAG
+{
+    SEGMENT segments[MESSAGE_STORE_SEGMENT_COUNT];
+    size_t current_segment;
+    size_t write_offset;
+    uint64_t next_sequence;
+    size_t page_size;
+} MESSAGE_STORE;
+
+typedef const char*(*GET_MESSAGE_STRING)(IOTHUB_MESSAGE_HANDLE message);
+typedef IOTHUB_MESSAGE_RESULT(*SET_MESSAGE_STRING)(IOTHUB_MESSAGE_HANDLE message, const char* value);
+
+typedef struct MESSAGE_STRING_FIELD_TAG
+{
+    GET_MESSAGE_STRING get;
+    SET_MESSAGE_STRING set;
+} MESSAGE_STRING_FIELD;
+
+static const MESSAGE_STRING_FIELD MESSAGE_STRING_FIELDS[] =
+{
+    { IoTHubMessage_GetMessageId, IoTHubMessage_SetMessageId },
+    { IoTHubMessage_GetCorrelationId, IoTHubMessage_SetCorrelationId },
+    { IoTHubMessage_GetContentTypeSystemProperty, IoTHubMessage_SetContentTypeSystemProperty },
+    { IoTHubMessage_GetContentEncodingSystemProperty, IoTHubMessage_SetContentEncodingSystemProperty },
+    { IoTHubMessage_GetOutputName, IoTHubMessage_SetOutputName }
+};
+
+#define MESSAGE_STRING_FIELD_COUNT (sizeof(MESSAGE_STRING_FIELDS) / sizeof(MESSAGE_STRING_FIELDS[0]))
+
+typedef struct MESSAGE_CONTENTS_TAG
+{
+    IOTHUBMESSAGE_CONTENT_TYPE content_type;
+    const unsigned char* payload;
+    size_t payload_size;
+    const char* strings[MESSAGE_STRING_FIELD_COUNT];
+    const char* const* keys;
+    const char* const* values;
+    size_t property_count;
+    size_t serialized_size;
+} MESSAGE_CONTENTS;
+
+typedef struct RECORD_READER_TAG
+{
+    const unsigned char* position;
+    size_t remaining;
+} RECORD_READER;
+
+static uint32_t update_checksum(uint32_t checksum, const void* data, size_t length)
+{
+    // FNV-1a
+    const unsigned char* bytes = (const unsigned char*)data;
+    size_t index;
+
+    for (index = 0; index < length; index++)
+    {
+        checksum ^= bytes[index];
+        checksum *= 16777619u;
+    }
+
+    return checksum;
+}
+
+static uint32_t compute_record_checksum(const RECORD_HEADER* record)
+{
+    uint32_t checksum = 2166136261u;
+    checksum = update_checksum(checksum, &record->length, sizeof(record->length));
+    checksum = update_checksum(checksum, &record->sequence, sizeof(record->sequence));
+    return update_checksum(checksum, (const unsigned char*)record + sizeof(RECORD_HEADER), record->length);
+}
+
+static size_t get_serialized_string_size(const char* value)
+{
+    return sizeof(uint32_t) + ((value == NULL) ? 0 : strlen(value) + 1);
+}
+
+static unsigned char* write_uint32(unsigned char* destination, uint32_t value)
+{
+    (void)memcpy(destination, &value, sizeof(value));
+    return destination + sizeof(value);
+}
+
+static unsigned char* write_string(unsigned char* destination, const char* value)
+{
+    uint32_t length = (value == NULL) ? 0 : (uint32_t)(strlen(value) + 1);
+
+    destination = write_uint32(destination, length);
+    if (length != 0)
+    {
+        (void)memcpy(destination, value, length);
+    }
+
+    return destination + length;
+}
+
+static int get_message_contents(IOTHUB_MESSAGE_HANDLE message, MESSAGE_CONTENTS* contents)
+{
+    int result;
+    MAP_HANDLE properties;
+
+    contents->content_type = IoTHubMessage_GetContentType(message);
+
+    if (contents->content_type == IOTHUBMESSAGE_BYTEARRAY)
+    {
+        result = (IoTHubMessage_GetByteArray(message, &contents->payload, &contents->payload_size) == IOTHUB_MESSAGE_OK) ? 0 : MU_FAILURE;
+    }
+    else if (contents->content_type == IOTHUBMESSAGE_STRING)
+    {
+        const char* payload = IoTHubMessage_GetString(message);
+        contents->payload = (const unsigned char*)payload;
+        contents->payload_size = (payload == NULL) ? 0 : strlen(payload) + 1;
+        result = (payload == NULL) ? MU_FAILURE : 0;
+    }
+    else
+    {
+        result = MU_FAILURE;
+    }
+
+    if (result != 0)
+    {
+        LogError("unable to get the payload of the message");
+    }
+    else if ((properties = IoTHubMessage_Properties(message)) == NULL ||
+        Map_GetInternals(properties, &contents->keys, &contents->values, &contents->property_count) != MAP_OK)
+    {
+        LogError("unable to get the properties of the message");
+        result = MU_FAILURE;
+    }
+    else
+    {
+        size_t index;
+
+        contents->serialized_size = MESSAGE_HEADER_SIZE + sizeof(uint32_t) + contents->payload_size;
+
+        for (index = 0; index < MESSAGE_STRING_FIELD_COUNT; index++)
+        {
+            contents->strings[index] = MESSAGE_STRING_FIELDS[index].get(message);
+            contents->serialized_size += get_serialized_string_size(contents->strings[index]);
+        }
+
+        contents->serialized_size += sizeof(uint32_t);
+        for (index = 0; index < contents->property_count; index++)
+        {
+            contents->serialized_size += get_serialized_string_size(contents->keys[index]) + get_serialized_string_size(contents->values[index]);
+        }
+
+        result = 0;
+    }
+
+    return result;
+}
+
+static void serialize_message(IOTHUB_MESSAGE_HANDLE message, const MESSAGE_CONTENTS* contents, unsigned char* destination)
+{
+    size_t index;
+
+    destination[0] = (unsigned char)contents->content_type;
+    destination[1] = (unsigned char)IoTHubMessage_GetPriority(message);
+    destination[2] = IoTHubMessage_IsSecurityMessage(message) ? 1 : 0;
+    destination[3] = 0;
+    destination += MESSAGE_HEADER_SIZE;
+
+    destination = write_uint32(destination, (uint32_t)contents->payload_size);
+    if (contents->payload_size != 0)
+    {
+        (void)memcpy(destination, contents->payload, contents->payload_size);
+        destination += contents->payload_size;
+    }
+
+    for (index = 0; index < MESSAGE_STRING_FIELD_COUNT; index++)
+    {
+        destination = write_string(destination, contents->strings[index]);
+    }
+
+    destination = write_uint32(destination, (uint32_t)contents->property_count);
+    for (index = 0; index < contents->property_count; index++)
+    {
+        destination = write_string(destination, contents->keys[index]);
+        destination = write_string(destination, contents->values[index]);
+    }
+}
+
+static int read_bytes(RECORD_READER* reader, size_t size, const unsigned char** bytes)
+{
+    int result;
+
+    if (size > reader->remaining)
+    {
+        result = MU_FAILURE;
+    }
+    else
+    {
+        *bytes = reader->position;
+        reader->position += size;
+        reader->remaining -= size;
+        result = 0;
+    }
+
+    return result;
+}
+
+static int read_uint32(RECORD_READER* reader, uint32_t* value)
+{
+    int result;
+    const unsigned char* bytes;
+
+    if (read_bytes(reader, sizeof(*value), &bytes) != 0)
+    {
+        result = MU_FAILURE;
+    }
+    else
+    {
+        (void)memcpy(value, bytes, sizeof(*value));
+        result = 0;
+    }
+
+    return result;
+}
+
+static int read_string(RECORD_READER* reader, const char** value)
+{
+    int result;
+    uint32_t length;
+    const unsigned char* bytes;
+
+    if (read_uint32(reader, &length) != 0)
+    {
+        result = MU_FAILURE;
+    }
+    else if (length == 0)
+    {
+        *value = NULL;
+        result = 0;
+    }
+    else if (read_bytes(reader, length, &bytes) != 0 || bytes[length - 1] != '\0')
+    {
+        result = MU_FAILURE;
+    }
+    else
+    {
+        *value = (const char*)bytes;
+        result = 0;
+    }
+
+    return result;
+}
+
+static int read_message_properties(RECORD_READER* reader, IOTHUB_MESSAGE_HANDLE message)
+{
+    int result = 0;
+    size_t index;
+    uint32_t property_count;
+
+    for (index = 0; index < MESSAGE_STRING_FIELD_COUNT && result == 0; index++)
+    {
+        const char* value;
+        if (read_string(reader, &value) != 0 ||
+            (value != NULL && MESSAGE_STRING_FIELDS[index].set(message, value) != IOTHUB_MESSAGE_OK))
+        {
+            result = MU_FAILURE;
+        }
+    }
+
+    if (result == 0 && read_uint32(reader, &property_count) != 0)
+    {
+        result = MU_FAILURE;
+    }
+
+    for (index = 0; result == 0 && index < property_count; index++)
+    {
+        const char* key;
+        const char* value;
+        if (read_string(reader, &key) != 0 || read_string(reader, &value) != 0 ||
+            key == NULL || value == NULL ||
+            IoTHubMessage_SetProperty(message, key, value) != IOTHUB_MESSAGE_OK)
+        {
+            result = MU_FAILURE;
+        }
+    }
+
+    return result;
+}
+
+static IOTHUB_MESSAGE_HANDLE create_message_from_record(const RECORD_HEADER* record)
+{
+    IOTHUB_MESSAGE_HANDLE result;
+    RECORD_READER reader;
+    const unsigned char* header;
+    const unsigned char* payload;
+    uint32_t payload_size;
+
+    reader.position = (const unsigned char*)record + sizeof(RECORD_HEADER);
+    reader.remaining = record->length;
+
+    if (read_bytes(&reader, MESSAGE_HEADER_SIZE, &header) != 0 ||
+        read_uint32(&reader, &payload_size) != 0 ||
+        read_bytes(&reader, payload_size, &payload) != 0)
+    {
+        result = NULL;
+    }
+    else if (header[0] == IOTHUBMESSAGE_STRING)
+    {
+        result = (payload_size == 0 || payload[payload_size - 1] != '\0') ? NULL : IoTHubMessage_CreateFromString((const char*)payload);
+    }
+    else if (header[0] == IOTHUBMESSAGE_BYTEARRAY)
+    {
+        result = IoTHubMessage_CreateFromByteArray(payload, payload_size);
+    }
+    else
+    {
+        result = NULL;
+    }
+
+    if (result != NULL &&
+        (read_message_properties(&reader, result) != 0 ||
+        IoTHubMessage_SetPriority(result, (IOTHUB_MESSAGE_PRIORITY)header[1]) != IOTHUB_MESSAGE_OK ||
+        (header[2] != 0 && IoTHubMessage_SetAsSecurityMessage(result) != IOTHUB_MESSAGE_OK)))
+    {
+        IoTHubMessage_Destroy(result);
+        result = NULL;
+    }
+
+    return result;
+}
+
+static void mark_dirty(SEGMENT* segment, size_t offset, size_t size)
+{
+    if (segment->dirty_begin == segment->dirty_end)
+    {
+        segment->dirty_begin = offset;
+        segment->dirty_end = offset + size;
+    }
+    else
+    {
+        if (offset < segment->dirty_begin)
+        {
+            segment->dirty_begin = offset;
+        }
+        if (offset + size > segment->dirty_end)
+        {
+            segment->dirty_end = offset + size;
+        }
+    }
+}
+
+static RECORD_HEADER* get_record(const SEGMENT* segment, size_t offset)
+{
+    return (RECORD_HEADER*)(segment->memory + offset);
+}
+
+static size_t get_record_size(const RECORD_HEADER* record)
+{
+    return ALIGN_RECORD_SIZE(sizeof(RECORD_HEADER) + record->length);
+}
+
+static bool is_valid_record(const SEGMENT* segment, size_t offset, uint64_t min_sequence)
+{
+    bool result;
+
+    if (offset + sizeof(RECORD_HEADER) > MESSAGE_STORE_SEGMENT_SIZE)
+    {
+        result = false;
+    }
+    else
+    {
+        const RECORD_HEADER* record = get_record(segment, offset);
+        result =
+            (record->magic == RECORD_MAGIC) &&
+            (record->length <= MESSAGE_STORE_SEGMENT_SIZE - offset - sizeof(RECORD_HEADER)) &&
+            (record->sequence >= min_sequence) &&
+            (record->state == RECORD_STATE_PENDING || record->state == RECORD_STATE_RELEASED) &&
+            (record->checksum == compute_record_checksum(record));
+    }
+
+    return result;
+}
+
+static int map_segment(SEGMENT* segment, const char* directory, size_t index)
+{
+    int result;
+    size_t path_size = strlen(directory) + sizeof(SEGMENT_FILE_NAME_FORMAT) + 20;
+    char* path;
+
+    if ((path = (char*)malloc(path_size)) == NULL)
+    {
+        LogError("unable to allocate the segment path");
+        result = MU_FAILURE;
+    }
+    else
+    {
+        struct stat file_status;
+        void* memory;
+
+        (void)snprintf(path, path_size, SEGMENT_FILE_NAME_FORMAT, directory, (unsigned long)index);
+
+        if ((segment->file = open(path, O_RDWR | O_CREAT, S_IRUSR | S_IWUSR)) < 0)
+        {
+            LogError("unable to open %s (errno %d)", path, errno);
+            result = MU_FAILURE;
+        }
+        else if (fstat(segment->file, &file_status) != 0)
+        {
+            LogError("unable to get the size of %s (errno %d)", path, errno);
+            result = MU_FAILURE;
+        }
+        else if (file_status.st_size != 0 && file_status.st_size != (off_t)MESSAGE_STORE_SEGMENT_SIZE)
+        {
+            LogError("%s is not a message store segment of %lu bytes", path, (unsigned long)MESSAGE_STORE_SEGMENT_SIZE);
+            result = MU_FAILURE;
+        }
+        else if (file_status.st_size == 0 && ftruncate(segment->file, (off_t)MESSAGE_STORE_SEGMENT_SIZE) != 0)
+        {
+            LogError("unable to size %s (errno %d)", path, errno);
+            result = MU_FAILURE;
+        }
+        else if ((memory = mmap(NULL, MESSAGE_STORE_SEGMENT_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, segment->file, 0)) == MAP_FAILED)
+        {
+            LogError("unable to map %s (errno %d)", path, errno);
+            result = MU_FAILURE;
+        }
+        else
+        {
+            segment->memory = (unsigned char*)memory;
+            result = 0;
+        }
+
+        free(path);
+    }
+
+    return result;
+}
+
+static void unmap_segments(MESSAGE_STORE* store)
+{
+    size_t index;
+
+    for (index = 0; index < MESSAGE_STORE_SEGMENT_COUNT; index++)
+    {
+        if (store->segments[index].memory != NULL)
+        {
+            (void)munmap(store->segments[index].memory, MESSAGE_STORE_SEGMENT_SIZE);
+        }
+        if (store->segments[index].file >= 0)
+        {
+            (void)close(store->segments[index].file);
+        }
+    }
+}
+
+static void scan_segment(SEGMENT* segment)
+{
+    SEGMENT_HEADER* header = (SEGMENT_HEADER*)segment->memory;
+
+    segment->end_offset = RECORDS_OFFSET;
+    segment->first_sequence = 0;
+    segment->last_sequence = 0;
+    segment->live_count = 0;
+
+    if (header->magic != SEGMENT_MAGIC || header->segment_size != MESSAGE_STORE_SEGMENT_SIZE)
+    {
+        header->magic = SEGMENT_MAGIC;
+        header->segment_size = MESSAGE_STORE_SEGMENT_SIZE;
+        header->base_sequence = 0;
+        mark_dirty(segment, 0, sizeof(SEGMENT_HEADER));
+    }
+    else
+    {
+        uint64_t min_sequence = header->base_sequence;
+
+        while (is_valid_record(segment, segment->end_offset, min_sequence))
+        {
+            const RECORD_HEADER* record = get_record(segment, segment->end_offset);
+
+            if (segment->first_sequence == 0)
+            {
+                segment->first_sequence = record->sequence;
+            }
+            segment->last_sequence = record->sequence;
+            if (record->state == RECORD_STATE_PENDING)
+            {
+                segment->live_count++;
+            }
+
+            min_sequence = record->sequence + 1;
+            segment->end_offset += get_record_size(record);
+        }
+    }
+}
+
+static void replay_segment(MESSAGE_STORE* store, size_t segment_index, ON_STORED_MESSAGE on_stored_message, void* context)
+{
+    SEGMENT* segment = &store->segments[segment_index];
+    size_t offset = RECORDS_OFFSET;
+
+    while (offset < segment->end_offset)
+    {
+        RECORD_HEADER* record = get_record(segment, offset);
+
+        if (record->state == RECORD_STATE_PENDING)
+        {
+            IOTHUB_MESSAGE_HANDLE message = create_message_from_record(record);
+            if (message == NULL)
+            {
+                LogError("stored message %lu cannot be read back and is dropped", (unsigned long)record->sequence);
+                record->state = RECORD_STATE_RELEASED;
+                segment->live_count--;
+                mark_dirty(segment, offset, sizeof(RECORD_HEADER));
+            }
+            else
+            {
+                on_stored_message(message, (segment_index * MESSAGE_STORE_SEGMENT_SIZE) + offset, context);
+            }
+        }
+
+        offset += get_record_size(record);
+    }
+}
+
+static void open_log(MESSAGE_STORE* store, ON_STORED_MESSAGE on_stored_message, void* context)
+{
+    size_t index;
+    size_t replayed_count;
+    uint64_t replayed_sequence = 0;
+
+    store->current_segment = 0;
+    store->write_offset = RECORDS_OFFSET;
+    store->next_sequence = 1;
+
+    for (index = 0; index < MESSAGE_STORE_SEGMENT_COUNT; index++)
+    {
+        SEGMENT* segment = &store->segments[index];
+        scan_segment(segment);
+
+        // new messages are appended after the newest one
+        if (segment->last_sequence >= store->next_sequence)
+        {
+            store->current_segment = index;
+            store->write_offset = segment->end_offset;
+            store->next_sequence = segment->last_sequence + 1;
+        }
+    }
+
+    // segments are replayed from the oldest to the newest
+    for (replayed_count = 0; replayed_count < MESSAGE_STORE_SEGMENT_COUNT; replayed_count++)
+    {
+        size_t oldest = MESSAGE_STORE_SEGMENT_COUNT;
+
+        for (index = 0; index < MESSAGE_STORE_SEGMENT_COUNT; index++)
+        {
+            uint64_t first_sequence = store->segments[index].first_sequence;
+            if (first_sequence > replayed_sequence &&
+                (oldest == MESSAGE_STORE_SEGMENT_COUNT || first_sequence < store->segments[oldest].first_sequence))
+            {
+                oldest = index;
+            }
+        }
+
+        if (oldest == MESSAGE_STORE_SEGMENT_COUNT)
+        {
+            break;
+        }
+
+        replay_segment(store, oldest, on_stored_message, context);
+        replayed_sequence = store->segments[oldest].first_sequence;
+    }
+}
+
+static int move_to_next_segment(MESSAGE_STORE* store)
+{
+    int result;
+    size_t next = (store->current_segment + 1) % MESSAGE_STORE_SEGMENT_COUNT;
+    SEGMENT* segment = &store->segments[next];
+
+    if (segment->live_count != 0)
+    {
+        LogError("the message store is full, the oldest segment still has %lu messages to send", (unsigned long)segment->live_count);
+        result = MU_FAILURE;
+    }
+    else
+    {
+        ((SEGMENT_HEADER*)segment->memory)->base_sequence = store->next_sequence;
+        mark_dirty(segment, 0, sizeof(SEGMENT_HEADER));
+        store->current_segment = next;
+        store->write_offset = RECORDS_OFFSET;
+        result = 0;
+    }
+
+    return result;
+}
+
+MESSAGE_STORE_HANDLE message_store_open(const char* directory, ON_STORED_MESSAGE on_stored_message, void* context)
+{
+    MESSAGE_STORE* result;
+
+    if (directory == NULL || on_stored_message == NULL)
+    {
+        // Codes_SRS_MESSAGE_STORE_44_001: [ If `directory` or `on_stored_message` are NULL, `message_store_open` shall fail and return NULL. ]
+        LogError("Invalid argument (directory=%p, on_stored_message=%p)", directory, on_stored_message);
+        result = NULL;
+    }
+    else if ((result = (MESSAGE_STORE*)malloc(sizeof(MESSAGE_STORE))) == NULL)
+    {
+        LogError("unable to allocate the message store");
+    }
+    else
+    {
+        size_t index;
+        int map_result = 0;
+
+        (void)memset(result, 0, sizeof(MESSAGE_STORE));
+        result->page_size = (size_t)sysconf(_SC_PAGESIZE);
+        for (index = 0; index < MESSAGE_STORE_SEGMENT_COUNT; index++)
+        {
+            result->segments[index].file = -1;
+        }
+
+        // Codes_SRS_MESSAGE_STORE_44_002: [ `message_store_open` shall create the segment files of the log in `directory` if they do not exist, and map them in memory. ]
+        for (index = 0; index < MESSAGE_STORE_SEGMENT_COUNT && map_result == 0; index++)
+        {
+            map_result = map_segment(&result->segments[index], directory, index);
+        }
+
+        if (map_result != 0)
+        {
+            // Codes_SRS_MESSAGE_STORE_44_003: [ If any of the segment files cannot be opened, created or mapped, `message_store_open` shall fail and return NULL. ]
+            unmap_segments(result);
+            free(result);
+            result = NULL;
+        }
+        else
+        {
+            // Codes_SRS_MESSAGE_STORE_44_004: [ `message_store_open` shall call `on_stored_message` for every message of the log that was never released, oldest first. ]
+            // Codes_SRS_MESSAGE_STORE_44_005: [ Records that are torn or were written before their segment was reused shall be ignored. ]
+            open_log(result, on_stored_message, context);
+        }
+    }
+
+    return result;
+}
+
+void message_store_close(MESSAGE_STORE_HANDLE store)
+{
+    if (store == NULL)
+    {
+        // Codes_SRS_MESSAGE_STORE_44_006: [ If `store` is NULL, `message_store_close` shall return. ]
+        LogError("Invalid argument (store is NULL)");
+    }
+    else
+    {
+        // Codes_SRS_MESSAGE_STORE_44_007: [ `message_store_close` shall commit the log, unmap and close its segment files and free the store, keeping the messages that were not released. ]
+        (void)message_store_commit(store);
+        unmap_segments(store);
+        free(store);
+    }
+}
+
+int message_store_append(MESSAGE_STORE_HANDLE store, IOTHUB_MESSAGE_HANDLE message, size_t* position)
+{
+    int result;
+    MESSAGE_CONTENTS contents;
+
+    if (store == NULL || message == NULL || position == NULL)
+    {
+        // Codes_SRS_MESSAGE_STORE_44_008: [ If `store`, `message` or `position` are NULL, `message_store_append` shall fail and return a non-zero value. ]
+        LogError("Invalid argument (store=%p, message=%p, position=%p)", store, message, position);
+        result = MU_FAILURE;
+    }
+    else if (get_message_contents(message, &contents) != 0)
+    {
+        result = MU_FAILURE;
+    }
+    else
+    {
+        size_t record_size = ALIGN_RECORD_SIZE(sizeof(RECORD_HEADER) + contents.serialized_size);
+
+        if (record_size > MESSAGE_STORE_SEGMENT_SIZE - RECORDS_OFFSET)
+        {
+            // Codes_SRS_MESSAGE_STORE_44_009: [ If the message does not fit in a segment, `message_store_append` shall fail and return a non-zero value. ]
+            LogError("a message of %lu bytes does not fit in a segment of the message store", (unsigned long)contents.serialized_size);
+            result = MU_FAILURE;
+        }
+        // Codes_SRS_MESSAGE_STORE_44_010: [ If the message does not fit in the current segment and the next one still has messages that were not released, `message_store_append` shall fail and return a non-zero value. ]
+        else if ((store->write_offset + record_size > MESSAGE_STORE_SEGMENT_SIZE) && (move_to_next_segment(store) != 0))
+        {
+            result = MU_FAILURE;
+        }
+        else
+        {
+            // Codes_SRS_MESSAGE_STORE_44_011: [ `message_store_append` shall serialize the payload, properties, system properties and priority of `message` directly into the mapped log, without flushing it to disk. ]
+            SEGMENT* segment = &store->segments[store->current_segment];
+            RECORD_HEADER* record = get_record(segment, store->write_offset);
+
+            serialize_message(message, &contents, (unsigned char*)record + sizeof(RECORD_HEADER));
+            record->magic = RECORD_MAGIC;
+            record->length = (uint32_t)contents.serialized_size;
+            record->sequence = store->next_sequence++;
+            record->state = RECORD_STATE_PENDING;
+            record->checksum = compute_record_checksum(record);
+
+            mark_dirty(segment, store->write_offset, record_size);
+            segment->live_count++;
+
+            // Codes_SRS_MESSAGE_STORE_44_012: [ On success `message_store_append` shall set `position` to the non-zero position of the message in the log and return 0. ]
+            *position = (store->current_segment * MESSAGE_STORE_SEGMENT_SIZE) + store->write_offset;
+            store->write_offset += record_size;
+            result = 0;
+        }
+    }
+
+    return result;
+}
+
+void message_store_release(MESSAGE_STORE_HANDLE store, size_t position)
+{
+    size_t segment_index = position / MESSAGE_STORE_SEGMENT_SIZE;
+    size_t offset = position % MESSAGE_STORE_SEGMENT_SIZE;
+
+    if (store == NULL || segment_index >= MESSAGE_STORE_SEGMENT_COUNT || offset < RECORDS_OFFSET || offset + sizeof(RECORD_HEADER) > MESSAGE_STORE_SEGMENT_SIZE)
+    {
+        // Codes_SRS_MESSAGE_STORE_44_013: [ If `store` is NULL or `position` is not in the log, `message_store_release` shall return. ]
+        LogError("Invalid argument (store=%p, position=%lu)", store, (unsigned long)position);
+    }
+    else
+    {
+        SEGMENT* segment = &store->segments[segment_index];
+        RECORD_HEADER* record = get_record(segment, offset);
+
+        if (record->magic != RECORD_MAGIC || record->state != RECORD_STATE_PENDING)
+        {
+            LogError("there is no pending message at position %lu", (unsigned long)position);
+        }
+        else
+        {
+            // Codes_SRS_MESSAGE_STORE_44_014: [ `message_store_release` shall mark the message as released, so it is not replayed by `message_store_open` and its segment can be reused once all its messages are released. ]
+            record->state = RECORD_STATE_RELEASED;
+            segment->live_count--;
+            mark_dirty(segment, offset, sizeof(RECORD_HEADER));
+        }
+    }
+}
+
+int message_store_commit(MESSAGE_STORE_HANDLE store)
+{
+    int result;
+
+    if (store == NULL)
+    {
+        // Codes_SRS_MESSAGE_STORE_44_015: [ If `store` is NULL, `message_store_commit` shall fail and return a non-zero value. ]
+        LogError("Invalid argument (store is NULL)");
+        result = MU_FAILURE;
+    }
+    else
+    {
+        size_t index;
+        result = 0;
+
+        // Codes_SRS_MESSAGE_STORE_44_016: [ `message_store_commit` shall synchronously flush to disk the parts of the segments changed since the previous commit, with one flush per changed segment. ]
+        for (index = 0; index < MESSAGE_STORE_SEGMENT_COUNT; index++)
+        {
+            SEGMENT* segment = &store->segments[index];
+
+            if (segment->dirty_end != segment->dirty_begin)
+            {
+                size_t begin = segment->dirty_begin - (segment->dirty_begin % store->page_size);
+
+                if (msync(segment->memory + begin, segment->dirty_end - begin, MS_SYNC) != 0)
+                {
+                    // Codes_SRS_MESSAGE_STORE_44_017: [ If flushing any segment fails, `message_store_commit` shall return a non-zero value, and try again on the next commit. ]
+                    LogError("unable to flush segment %lu of the message store (errno %d)", (unsigned long)index, errno);
+                    result = MU_FAILURE;
+                }
+                else
+                {
+                    segment->dirty_begin = 0;
+                    segment->dirty_end = 0;
+                }
+            }
+        }
+    }
+
+    return result;
+}
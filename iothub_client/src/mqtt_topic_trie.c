@@ -0,0 +1,228 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include "azure_c_shared_utility/optimize_size.h"
+#include "azure_c_shared_utility/xlogging.h"
+
+#include "internal/mqtt_topic_trie.h"
+
+// Each node is labelled with the characters its incoming edge consumes, so prefixes sharing their start
+// ("$iothub/") share its nodes and a prefix never needs more than two new nodes: the node it ends at and
+// the one splitting an existing label where it diverges. Children are kept in a list, which for topic
+// prefixes is short enough that scanning it beats any index.
+
+static char to_lower(char c)
+{
+    return ((c >= 'A') && (c <= 'Z')) ? (char)(c - 'A' + 'a') : c;
+}
+
+static size_t get_common_length(const char* label, const char* text, size_t length)
+{
+    size_t index = 0;
+
+    // A NULL-terminated text stops this at its end, as labels never contain the terminator.
+    while (index < length && to_lower(label[index]) == to_lower(text[index]))
+    {
+        index++;
+    }
+
+    return index;
+}
+
+static size_t find_child(const MQTT_TOPIC_TRIE* trie, size_t node, char first_character)
+{
+    size_t child = trie->nodes[node].first_child;
+
+    while (child != 0 && to_lower(trie->nodes[child].label[0]) != to_lower(first_character))
+    {
+        child = trie->nodes[child].next_sibling;
+    }
+
+    return child;
+}
+
+static size_t* find_child_link(MQTT_TOPIC_TRIE* trie, size_t node, char first_character)
+{
+    size_t* link = &trie->nodes[node].first_child;
+
+    while (*link != 0 && to_lower(trie->nodes[*link].label[0]) != to_lower(first_character))
+    {
+        link = &trie->nodes[*link].next_sibling;
+    }
+
+    return link;
+}
+
+static size_t add_node(MQTT_TOPIC_TRIE* trie, const char* label, size_t label_length, size_t first_child, int value)
+{
+    size_t index = trie->node_count++;
+
+    trie->nodes[index].label = label;
+    trie->nodes[index].label_length = label_length;
+    trie->nodes[index].first_child = first_child;
+    trie->nodes[index].next_sibling = 0;
+    trie->nodes[index].value = value;
+
+    return index;
+}
+
+void mqtt_topic_trie_initialize(MQTT_TOPIC_TRIE* trie)
+{
+    if (trie == NULL)
+    {
+        // Codes_SRS_MQTT_TOPIC_TRIE_44_001: [ If `trie` is NULL, `mqtt_topic_trie_initialize` shall return. ]
+        LogError("Invalid argument (trie is NULL)");
+    }
+    else
+    {
+        // Codes_SRS_MQTT_TOPIC_TRIE_44_002: [ `mqtt_topic_trie_initialize` shall set the trie as holding no prefix. ]
+        trie->node_count = 0;
+        (void)add_node(trie, "", 0, 0, MQTT_TOPIC_TRIE_NO_MATCH);
+    }
+}
+
+int mqtt_topic_trie_add(MQTT_TOPIC_TRIE* trie, const char* prefix, size_t prefix_length, int value)
+{
+    int result;
+
+    if (trie == NULL || (prefix == NULL && prefix_length != 0) || value < 0)
+    {
+        // Codes_SRS_MQTT_TOPIC_TRIE_44_003: [ If `trie` is NULL, `prefix` is NULL with a non-zero `prefix_length` or `value` is negative, `mqtt_topic_trie_add` shall fail and return a non-zero value. ]
+        LogError("Invalid argument (trie=%p, prefix=%p, value=%d)", trie, prefix, value);
+        result = MU_FAILURE;
+    }
+    else
+    {
+        size_t node = 0;
+        size_t* link = NULL;
+        size_t common_length = 0;
+        size_t nodes_needed;
+        bool descending = true;
+
+        // Walk down the nodes whose whole label the prefix starts with.
+        while (descending && prefix_length > 0)
+        {
+            link = find_child_link(trie, node, prefix[0]);
+            if (*link == 0)
+            {
+                descending = false;
+            }
+            else
+            {
+                size_t label_length = trie->nodes[*link].label_length;
+                common_length = get_common_length(trie->nodes[*link].label, prefix, label_length < prefix_length ? label_length : prefix_length);
+                if (common_length < label_length)
+                {
+                    descending = false;
+                }
+                else
+                {
+                    node = *link;
+                    prefix += common_length;
+                    prefix_length -= common_length;
+                }
+            }
+        }
+
+        if (descending)
+        {
+            nodes_needed = 0;
+        }
+        else if (*link == 0)
+        {
+            nodes_needed = 1;
+        }
+        else
+        {
+            nodes_needed = (common_length < prefix_length) ? 2 : 1;
+        }
+
+        if (trie->node_count + nodes_needed > MQTT_TOPIC_TRIE_MAX_NODES)
+        {
+            // Codes_SRS_MQTT_TOPIC_TRIE_44_004: [ If `trie` has no room for the nodes `prefix` needs, `mqtt_topic_trie_add` shall fail and return a non-zero value, leaving `trie` unchanged. ]
+            LogError("No room left for the topic prefix (%lu nodes)", (unsigned long)trie->node_count);
+            result = MU_FAILURE;
+        }
+        else
+        {
+            // Codes_SRS_MQTT_TOPIC_TRIE_44_005: [ Otherwise `mqtt_topic_trie_add` shall add `prefix` to `trie` so that matching topics starting with it returns `value`, replacing the value of a prefix added before with the same characters, and return 0. ]
+            if (descending)
+            {
+                trie->nodes[node].value = value;
+            }
+            else if (*link == 0)
+            {
+                *link = add_node(trie, prefix, prefix_length, 0, value);
+            }
+            else
+            {
+                // The prefix diverges from (or ends within) the label of the child, which is split where it does.
+                size_t child = *link;
+                size_t split = add_node(trie, trie->nodes[child].label, common_length, child, MQTT_TOPIC_TRIE_NO_MATCH);
+
+                trie->nodes[split].next_sibling = trie->nodes[child].next_sibling;
+                trie->nodes[child].label += common_length;
+                trie->nodes[child].label_length -= common_length;
+                trie->nodes[child].next_sibling = 0;
+                *link = split;
+
+                if (common_length == prefix_length)
+                {
+                    trie->nodes[split].value = value;
+                }
+                else
+                {
+                    trie->nodes[child].next_sibling = add_node(trie, prefix + common_length, prefix_length - common_length, 0, value);
+                }
+            }
+
+            result = 0;
+        }
+    }
+
+    return result;
+}
+
+int mqtt_topic_trie_match(const MQTT_TOPIC_TRIE* trie, const char* topic, size_t* matched_length)
+{
+    int result;
+    size_t result_length = 0;
+
+    if (trie == NULL || topic == NULL)
+    {
+        // Codes_SRS_MQTT_TOPIC_TRIE_44_006: [ If `trie` or `topic` are NULL, `mqtt_topic_trie_match` shall return MQTT_TOPIC_TRIE_NO_MATCH. ]
+        LogError("Invalid argument (trie=%p, topic=%p)", trie, topic);
+        result = MQTT_TOPIC_TRIE_NO_MATCH;
+    }
+    else
+    {
+        size_t node = 0;
+        size_t length = 0;
+        size_t child;
+
+        // Codes_SRS_MQTT_TOPIC_TRIE_44_007: [ `mqtt_topic_trie_match` shall return the value of the longest prefix added to `trie` that `topic` starts with, ignoring ASCII case, or MQTT_TOPIC_TRIE_NO_MATCH if there is none. ]
+        result = trie->nodes[0].value;
+        while (topic[length] != '\0' &&
+            (child = find_child(trie, node, topic[length])) != 0 &&
+            get_common_length(trie->nodes[child].label, topic + length, trie->nodes[child].label_length) == trie->nodes[child].label_length)
+        {
+            node = child;
+            length += trie->nodes[child].label_length;
+            if (trie->nodes[node].value != MQTT_TOPIC_TRIE_NO_MATCH)
+            {
+                result = trie->nodes[node].value;
+                result_length = length;
+            }
+        }
+    }
+
+    // Codes_SRS_MQTT_TOPIC_TRIE_44_008: [ If `matched_length` is not NULL, `mqtt_topic_trie_match` shall store in it the length of the matched prefix, or 0 if there is none. ]
+    if (matched_length != NULL)
+    {
+        *matched_length = result_length;
+    }
+
+    return result;
+}
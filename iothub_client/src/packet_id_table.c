@@ -0,0 +1,205 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include <stdlib.h>
+#include <string.h>
+#include "azure_c_shared_utility/optimize_size.h"
+#include "azure_c_shared_utility/gballoc.h"
+#include "azure_c_shared_utility/xlogging.h"
+
+#include "internal/packet_id_table.h"
+
+// Linear probing over a power-of-two number of slots, kept at most 3/4 full. Packet ids are handed out
+// sequentially, so they are spread with Fibonacci hashing instead of being used as the index directly,
+// which would pack them in long runs that any colliding id then has to probe through. Removal shifts the
+// following entries back instead of leaving tombstones, so lookups never get slower as items come and go.
+
+#define INLINE_SLOT_COUNT_BITS 4
+#define FIBONACCI_MULTIPLIER 2654435769u
+
+static size_t get_home_slot(size_t slot_count_bits, uint16_t packet_id)
+{
+    return (size_t)(((uint32_t)packet_id * FIBONACCI_MULTIPLIER) >> (32 - slot_count_bits));
+}
+
+static size_t find_slot(const PACKET_ID_TABLE_SLOT* slots, size_t slot_count_bits, uint16_t packet_id)
+{
+    size_t mask = ((size_t)1 << slot_count_bits) - 1;
+    size_t index = get_home_slot(slot_count_bits, packet_id);
+
+    while (slots[index].value != NULL && slots[index].packet_id != packet_id)
+    {
+        index = (index + 1) & mask;
+    }
+
+    return index;
+}
+
+static int grow_table(PACKET_ID_TABLE* table)
+{
+    int result;
+    size_t new_slot_count_bits = table->slot_count_bits + 1;
+    size_t new_slot_count = (size_t)1 << new_slot_count_bits;
+    PACKET_ID_TABLE_SLOT* new_slots = (PACKET_ID_TABLE_SLOT*)malloc(new_slot_count * sizeof(PACKET_ID_TABLE_SLOT));
+
+    if (new_slots == NULL)
+    {
+        LogError("Failed allocating %lu packet id slots", (unsigned long)new_slot_count);
+        result = MU_FAILURE;
+    }
+    else
+    {
+        size_t old_slot_count = (size_t)1 << table->slot_count_bits;
+        size_t index;
+
+        (void)memset(new_slots, 0, new_slot_count * sizeof(PACKET_ID_TABLE_SLOT));
+        for (index = 0; index < old_slot_count; index++)
+        {
+            if (table->slots[index].value != NULL)
+            {
+                new_slots[find_slot(new_slots, new_slot_count_bits, table->slots[index].packet_id)] = table->slots[index];
+            }
+        }
+
+        if (table->slots != table->inline_slots)
+        {
+            free(table->slots);
+        }
+
+        table->slots = new_slots;
+        table->slot_count_bits = new_slot_count_bits;
+        result = 0;
+    }
+
+    return result;
+}
+
+void packet_id_table_initialize(PACKET_ID_TABLE* table)
+{
+    if (table == NULL)
+    {
+        // Codes_SRS_PACKET_ID_TABLE_44_001: [ If `table` is NULL, `packet_id_table_initialize` shall return. ]
+        LogError("Invalid argument (table is NULL)");
+    }
+    else
+    {
+        // Codes_SRS_PACKET_ID_TABLE_44_002: [ `packet_id_table_initialize` shall set the table as empty, using the slots stored in the table itself. ]
+        (void)memset(table->inline_slots, 0, sizeof(table->inline_slots));
+        table->slots = table->inline_slots;
+        table->slot_count_bits = INLINE_SLOT_COUNT_BITS;
+        table->count = 0;
+    }
+}
+
+void packet_id_table_deinitialize(PACKET_ID_TABLE* table)
+{
+    if (table == NULL)
+    {
+        // Codes_SRS_PACKET_ID_TABLE_44_003: [ If `table` is NULL, `packet_id_table_deinitialize` shall return. ]
+        LogError("Invalid argument (table is NULL)");
+    }
+    else
+    {
+        // Codes_SRS_PACKET_ID_TABLE_44_004: [ `packet_id_table_deinitialize` shall free the slots allocated by the table and set it as empty. ]
+        if (table->slots != table->inline_slots)
+        {
+            free(table->slots);
+        }
+        packet_id_table_initialize(table);
+    }
+}
+
+int packet_id_table_insert(PACKET_ID_TABLE* table, uint16_t packet_id, void* value)
+{
+    int result;
+
+    if (table == NULL || value == NULL)
+    {
+        // Codes_SRS_PACKET_ID_TABLE_44_005: [ If `table` or `value` are NULL, `packet_id_table_insert` shall fail and return a non-zero value. ]
+        LogError("Invalid argument (table=%p, value=%p)", table, value);
+        result = MU_FAILURE;
+    }
+    else if (table->slots[find_slot(table->slots, table->slot_count_bits, packet_id)].value != NULL)
+    {
+        // Codes_SRS_PACKET_ID_TABLE_44_006: [ If `packet_id` is already in `table`, `packet_id_table_insert` shall fail and return a non-zero value. ]
+        LogError("Packet id %u is already in use", (unsigned int)packet_id);
+        result = MU_FAILURE;
+    }
+    // Codes_SRS_PACKET_ID_TABLE_44_007: [ If adding `value` would make `table` more than 3/4 full, `packet_id_table_insert` shall move the entries to twice as many slots, allocated on the heap. ]
+    else if (((table->count + 1) * 4 > ((size_t)3 << table->slot_count_bits)) && (grow_table(table) != 0))
+    {
+        // Codes_SRS_PACKET_ID_TABLE_44_008: [ If allocating the slots fails, `packet_id_table_insert` shall fail and return a non-zero value, leaving `table` unchanged. ]
+        result = MU_FAILURE;
+    }
+    else
+    {
+        // Codes_SRS_PACKET_ID_TABLE_44_009: [ Otherwise `packet_id_table_insert` shall add `value` to `table` under `packet_id` and return 0. ]
+        PACKET_ID_TABLE_SLOT* slot = &table->slots[find_slot(table->slots, table->slot_count_bits, packet_id)];
+        slot->value = value;
+        slot->packet_id = packet_id;
+        table->count++;
+        result = 0;
+    }
+
+    return result;
+}
+
+void* packet_id_table_find(PACKET_ID_TABLE* table, uint16_t packet_id)
+{
+    void* result;
+
+    if (table == NULL)
+    {
+        // Codes_SRS_PACKET_ID_TABLE_44_010: [ If `table` is NULL, `packet_id_table_find` shall return NULL. ]
+        LogError("Invalid argument (table is NULL)");
+        result = NULL;
+    }
+    else
+    {
+        // Codes_SRS_PACKET_ID_TABLE_44_011: [ `packet_id_table_find` shall return the value added under `packet_id`, or NULL if `packet_id` is not in `table`. ]
+        result = table->slots[find_slot(table->slots, table->slot_count_bits, packet_id)].value;
+    }
+
+    return result;
+}
+
+void* packet_id_table_remove(PACKET_ID_TABLE* table, uint16_t packet_id)
+{
+    void* result;
+
+    if (table == NULL)
+    {
+        // Codes_SRS_PACKET_ID_TABLE_44_012: [ If `table` is NULL, `packet_id_table_remove` shall return NULL. ]
+        LogError("Invalid argument (table is NULL)");
+        result = NULL;
+    }
+    else
+    {
+        size_t mask = ((size_t)1 << table->slot_count_bits) - 1;
+        size_t hole = find_slot(table->slots, table->slot_count_bits, packet_id);
+
+        // Codes_SRS_PACKET_ID_TABLE_44_013: [ `packet_id_table_remove` shall remove the value added under `packet_id` from `table` and return it, or return NULL if `packet_id` is not in `table`. ]
+        result = table->slots[hole].value;
+        if (result != NULL)
+        {
+            size_t index = (hole + 1) & mask;
+
+            // Move back every following entry of the run that would otherwise no longer be reachable from its home slot.
+            while (table->slots[index].value != NULL)
+            {
+                size_t home = get_home_slot(table->slot_count_bits, table->slots[index].packet_id);
+                if (((index - home) & mask) >= ((index - hole) & mask))
+                {
+                    table->slots[hole] = table->slots[index];
+                    hole = index;
+                }
+                index = (index + 1) & mask;
+            }
+
+            table->slots[hole].value = NULL;
+            table->count--;
+        }
+    }
+
+    return result;
+}
@@ -0,0 +1,229 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include "azure_c_shared_utility/xlogging.h"
+
+#include "internal/timeout_heap.h"
+
+// The heap is a pairing heap: every entry keeps a pointer to its first child, and the children of an
+// entry form a doubly linked list through next/prev. Insertion is O(1); removing the earliest or an
+// arbitrary entry is O(log n) amortized.
+
+static bool entry_expires_before(const TIMEOUT_HEAP_ENTRY* first, const TIMEOUT_HEAP_ENTRY* second)
+{
+    return (first->deadline < second->deadline) ||
+        ((first->deadline == second->deadline) && (first->sequence < second->sequence));
+}
+
+static bool is_entry_in_heap(const TIMEOUT_HEAP* heap, const TIMEOUT_HEAP_ENTRY* entry)
+{
+    return (heap->root == entry) || (entry->prev != NULL);
+}
+
+// Links two detached sub-heaps, making the later one the first child of the earlier one.
+static TIMEOUT_HEAP_ENTRY* link_sub_heaps(TIMEOUT_HEAP_ENTRY* first, TIMEOUT_HEAP_ENTRY* second)
+{
+    TIMEOUT_HEAP_ENTRY* result;
+
+    if (first == NULL)
+    {
+        result = second;
+    }
+    else if (second == NULL)
+    {
+        result = first;
+    }
+    else
+    {
+        TIMEOUT_HEAP_ENTRY* child;
+
+        if (entry_expires_before(second, first))
+        {
+            result = second;
+            child = first;
+        }
+        else
+        {
+            result = first;
+            child = second;
+        }
+
+        child->next = result->child;
+        if (result->child != NULL)
+        {
+            result->child->prev = child;
+        }
+        child->prev = result;
+        result->child = child;
+    }
+
+    return result;
+}
+
+// Standard two-pass pairing: link siblings pairwise from left to right, then fold the pairs from right to left.
+static TIMEOUT_HEAP_ENTRY* merge_siblings(TIMEOUT_HEAP_ENTRY* first_sibling)
+{
+    TIMEOUT_HEAP_ENTRY* pairs = NULL;
+    TIMEOUT_HEAP_ENTRY* result = NULL;
+
+    while (first_sibling != NULL)
+    {
+        TIMEOUT_HEAP_ENTRY* first = first_sibling;
+        TIMEOUT_HEAP_ENTRY* second = first->next;
+        TIMEOUT_HEAP_ENTRY* pair;
+
+        first_sibling = (second == NULL) ? NULL : second->next;
+
+        first->next = NULL;
+        first->prev = NULL;
+        if (second != NULL)
+        {
+            second->next = NULL;
+            second->prev = NULL;
+        }
+
+        pair = link_sub_heaps(first, second);
+        pair->next = pairs;
+        pairs = pair;
+    }
+
+    while (pairs != NULL)
+    {
+        TIMEOUT_HEAP_ENTRY* pair = pairs;
+        pairs = pair->next;
+        pair->next = NULL;
+        result = link_sub_heaps(result, pair);
+    }
+
+    return result;
+}
+
+static void clear_entry_links(TIMEOUT_HEAP_ENTRY* entry)
+{
+    entry->child = NULL;
+    entry->next = NULL;
+    entry->prev = NULL;
+}
+
+void timeout_heap_initialize(TIMEOUT_HEAP* heap)
+{
+    if (heap == NULL)
+    {
+        // Codes_SRS_TIMEOUT_HEAP_44_001: [ If `heap` is NULL, `timeout_heap_initialize` shall return. ]
+        LogError("Invalid argument (heap is NULL)");
+    }
+    else
+    {
+        // Codes_SRS_TIMEOUT_HEAP_44_002: [ `timeout_heap_initialize` shall set the heap as empty. ]
+        heap->root = NULL;
+        heap->next_sequence = 0;
+        heap->count = 0;
+    }
+}
+
+void timeout_heap_insert(TIMEOUT_HEAP* heap, TIMEOUT_HEAP_ENTRY* entry, tickcounter_ms_t deadline)
+{
+    if (heap == NULL || entry == NULL)
+    {
+        // Codes_SRS_TIMEOUT_HEAP_44_003: [ If `heap` or `entry` are NULL, `timeout_heap_insert` shall return. ]
+        LogError("Invalid argument (heap=%p, entry=%p)", heap, entry);
+    }
+    else
+    {
+        // Codes_SRS_TIMEOUT_HEAP_44_004: [ `timeout_heap_insert` shall add `entry` to `heap` with the given `deadline`, without allocating memory. ]
+        // Codes_SRS_TIMEOUT_HEAP_44_005: [ Entries with the same `deadline` shall expire in the order they were inserted. ]
+        clear_entry_links(entry);
+        entry->deadline = deadline;
+        entry->sequence = heap->next_sequence++;
+        heap->root = link_sub_heaps(heap->root, entry);
+        heap->count++;
+    }
+}
+
+void timeout_heap_remove(TIMEOUT_HEAP* heap, TIMEOUT_HEAP_ENTRY* entry)
+{
+    if (heap == NULL || entry == NULL)
+    {
+        // Codes_SRS_TIMEOUT_HEAP_44_006: [ If `heap` or `entry` are NULL, `timeout_heap_remove` shall return. ]
+        LogError("Invalid argument (heap=%p, entry=%p)", heap, entry);
+    }
+    else if (is_entry_in_heap(heap, entry))
+    {
+        // Codes_SRS_TIMEOUT_HEAP_44_007: [ `timeout_heap_remove` shall remove `entry` from `heap`, keeping the order of the remaining entries. ]
+        if (entry == heap->root)
+        {
+            heap->root = merge_siblings(entry->child);
+        }
+        else
+        {
+            if (entry->prev->child == entry)
+            {
+                entry->prev->child = entry->next;
+            }
+            else
+            {
+                entry->prev->next = entry->next;
+            }
+
+            if (entry->next != NULL)
+            {
+                entry->next->prev = entry->prev;
+            }
+
+            heap->root = link_sub_heaps(heap->root, merge_siblings(entry->child));
+        }
+
+        clear_entry_links(entry);
+        heap->count--;
+    }
+    else
+    {
+        // Codes_SRS_TIMEOUT_HEAP_44_008: [ If `entry` is not in `heap`, `timeout_heap_remove` shall return without changing `heap`. ]
+    }
+}
+
+TIMEOUT_HEAP_ENTRY* timeout_heap_peek(TIMEOUT_HEAP* heap)
+{
+    TIMEOUT_HEAP_ENTRY* result;
+
+    if (heap == NULL)
+    {
+        // Codes_SRS_TIMEOUT_HEAP_44_009: [ If `heap` is NULL, `timeout_heap_peek` shall return NULL. ]
+        LogError("Invalid argument (heap is NULL)");
+        result = NULL;
+    }
+    else
+    {
+        // Codes_SRS_TIMEOUT_HEAP_44_010: [ `timeout_heap_peek` shall return the entry with the earliest deadline, or NULL if `heap` is empty. ]
+        result = heap->root;
+    }
+
+    return result;
+}
+
+TIMEOUT_HEAP_ENTRY* timeout_heap_pop_expired(TIMEOUT_HEAP* heap, tickcounter_ms_t current_ms)
+{
+    TIMEOUT_HEAP_ENTRY* result;
+
+    if (heap == NULL)
+    {
+        // Codes_SRS_TIMEOUT_HEAP_44_011: [ If `heap` is NULL, `timeout_heap_pop_expired` shall return NULL. ]
+        LogError("Invalid argument (heap is NULL)");
+        result = NULL;
+    }
+    else if (heap->root == NULL || heap->root->deadline > current_ms)
+    {
+        // Codes_SRS_TIMEOUT_HEAP_44_012: [ If `heap` is empty or the earliest deadline is after `current_ms`, `timeout_heap_pop_expired` shall return NULL. ]
+        result = NULL;
+    }
+    else
+    {
+        // Codes_SRS_TIMEOUT_HEAP_44_013: [ Otherwise `timeout_heap_pop_expired` shall remove the entry with the earliest deadline from `heap` and return it. ]
+        result = heap->root;
+        timeout_heap_remove(heap, result);
+    }
+
+    return result;
+}
@@ -27,6 +27,7 @@
 #endif
 
 #define MESSAGE_ID_MAX_SIZE 128
+#define ENCODING_BUFFER_INITIAL_CAPACITY 1024
 
 #define AMQP_DIAGNOSTIC_ID_KEY "Diagnostic-Id"
 #define AMQP_DIAGNOSTIC_CONTEXT_KEY "Correlation-Context"
@@ -652,9 +653,72 @@ static int create_data_to_encode(IOTHUB_MESSAGE_HANDLE messageHandle, AMQP_VALUE
     return result;
 }
 
-// Codes_SRS_UAMQP_MESSAGING_31_120: [Create a blob that contains AMQP encoding of IOTHUB_MESSAGE_HANDLE.]
-// Codes_SRS_UAMQP_MESSAGING_31_121: [Any errors during `message_create_uamqp_encoding_from_iothub_message` stop processing on this message.]
-int message_create_uamqp_encoding_from_iothub_message(MESSAGE_HANDLE message_batch_container, IOTHUB_MESSAGE_HANDLE message_handle, BINARY_DATA* body_binary_data)
+// Codes_SRS_UAMQP_MESSAGING_44_002: [If `encoding_buffer->capacity` is smaller than the encoded length, `encoding_buffer->bytes` shall be grown with realloc(), doubling from ENCODING_BUFFER_INITIAL_CAPACITY and never past `encoding_buffer->max_capacity`.]
+static int reserve_encoding_buffer(UAMQP_ENCODING_BUFFER* encoding_buffer, size_t encoded_length)
+{
+    int result;
+
+    if (encoded_length <= encoding_buffer->capacity)
+    {
+        result = RESULT_OK;
+    }
+    else
+    {
+        unsigned char* new_bytes;
+        size_t new_capacity = (encoding_buffer->capacity == 0) ? ENCODING_BUFFER_INITIAL_CAPACITY : encoding_buffer->capacity;
+
+        while (new_capacity < encoded_length)
+        {
+            new_capacity = (new_capacity > (SIZE_MAX / 2)) ? encoded_length : (new_capacity * 2);
+        }
+
+        if (new_capacity > encoding_buffer->max_capacity)
+        {
+            new_capacity = encoding_buffer->max_capacity;
+        }
+
+        if ((new_bytes = (unsigned char*)realloc(encoding_buffer->bytes, new_capacity)) == NULL)
+        {
+            LogError("realloc of encoding buffer to %lu bytes failed", (unsigned long)new_capacity);
+            result = MU_FAILURE;
+        }
+        else
+        {
+            encoding_buffer->bytes = new_bytes;
+            encoding_buffer->capacity = new_capacity;
+            result = RESULT_OK;
+        }
+    }
+
+    return result;
+}
+
+static unsigned char* get_encoding_destination(UAMQP_ENCODING_BUFFER* encoding_buffer, size_t encoded_length)
+{
+    unsigned char* result;
+
+    if (encoding_buffer == NULL)
+    {
+        if ((result = (unsigned char*)malloc(encoded_length)) == NULL)
+        {
+            LogError("malloc of %lu bytes failed", (unsigned long)encoded_length);
+        }
+    }
+    else if (reserve_encoding_buffer(encoding_buffer, encoded_length) != RESULT_OK)
+    {
+        LogError("reserve_encoding_buffer of %lu bytes failed", (unsigned long)encoded_length);
+        result = NULL;
+    }
+    else
+    {
+        result = encoding_buffer->bytes;
+    }
+
+    return result;
+}
+
+// Encodes the message into a freshly malloc'd blob owned by the caller if `encoding_buffer` is NULL, or into `encoding_buffer` otherwise.
+static int create_uamqp_encoding(MESSAGE_HANDLE message_batch_container, IOTHUB_MESSAGE_HANDLE message_handle, UAMQP_ENCODING_BUFFER* encoding_buffer, BINARY_DATA* body_binary_data)
 {
     int result;
 
@@ -690,9 +754,16 @@ int message_create_uamqp_encoding_from_iothub_message(MESSAGE_HANDLE message_bat
         LogError("create_data_to_encode() failed");
         result = MU_FAILURE;
     }
-    else if ((body_binary_data->bytes = malloc(message_properties_length + application_properties_length + data_length + message_annotations_length)) == NULL)
+    // Codes_SRS_UAMQP_MESSAGING_44_003: [If the encoded length is greater than `encoding_buffer->max_capacity`, nothing shall be encoded; `body_binary_data->bytes` shall be NULL, `body_binary_data->length` shall be the encoded length and RESULT_OK shall be returned.]
+    else if ((encoding_buffer != NULL) &&
+        ((message_properties_length + application_properties_length + data_length + message_annotations_length) > encoding_buffer->max_capacity))
+    {
+        body_binary_data->length = message_properties_length + application_properties_length + data_length + message_annotations_length;
+        result = RESULT_OK;
+    }
+    else if ((body_binary_data->bytes = get_encoding_destination(encoding_buffer, message_properties_length + application_properties_length + data_length + message_annotations_length)) == NULL)
     {
-        LogError("malloc of %lu bytes failed", (unsigned long)(message_properties_length + application_properties_length + data_length + message_annotations_length));
+        LogError("get_encoding_destination() failed");
         result = MU_FAILURE;
     }
     // Codes_SRS_UAMQP_MESSAGING_31_119: [Invoke underlying AMQP encode routines on data waiting to be encoded.]
@@ -745,6 +816,32 @@ int message_create_uamqp_encoding_from_iothub_message(MESSAGE_HANDLE message_bat
     return result;
 }
 
+// Codes_SRS_UAMQP_MESSAGING_31_120: [Create a blob that contains AMQP encoding of IOTHUB_MESSAGE_HANDLE.]
+// Codes_SRS_UAMQP_MESSAGING_31_121: [Any errors during `message_create_uamqp_encoding_from_iothub_message` stop processing on this message.]
+int message_create_uamqp_encoding_from_iothub_message(MESSAGE_HANDLE message_batch_container, IOTHUB_MESSAGE_HANDLE message_handle, BINARY_DATA* body_binary_data)
+{
+    return create_uamqp_encoding(message_batch_container, message_handle, NULL, body_binary_data);
+}
+
+// Codes_SRS_UAMQP_MESSAGING_44_001: [`message_create_uamqp_encoding_from_iothub_message_into_buffer` shall encode the message the same way as `message_create_uamqp_encoding_from_iothub_message`, but into `encoding_buffer->bytes`; `body_binary_data->bytes` shall point into `encoding_buffer` and is only valid until the next call with the same buffer.]
+// Codes_SRS_UAMQP_MESSAGING_44_004: [If `encoding_buffer` is NULL, `message_create_uamqp_encoding_from_iothub_message_into_buffer` shall fail and return a non-zero value.]
+int message_create_uamqp_encoding_from_iothub_message_into_buffer(MESSAGE_HANDLE message_batch_container, IOTHUB_MESSAGE_HANDLE message_handle, UAMQP_ENCODING_BUFFER* encoding_buffer, BINARY_DATA* body_binary_data)
+{
+    int result;
+
+    if (encoding_buffer == NULL)
+    {
+        LogError("Invalid argument (encoding_buffer is NULL)");
+        result = MU_FAILURE;
+    }
+    else
+    {
+        result = create_uamqp_encoding(message_batch_container, message_handle, encoding_buffer, body_binary_data);
+    }
+
+    return result;
+}
+
 static int readMessageIdFromuAQMPMessage(IOTHUB_MESSAGE_HANDLE iothub_message_handle, PROPERTIES_HANDLE uamqp_message_properties)
 {
     int result;
@@ -0,0 +1,323 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "azure_c_shared_utility/gballoc.h"
+#include "azure_c_shared_utility/xlogging.h"
+#include "azure_c_shared_utility/strings.h"
+#include "azure_c_shared_utility/doublylinkedlist.h"
+#include "azure_c_shared_utility/tickcounter.h"
+#include "internal/iothub_transport_ll_private.h"
+#include "iothub_client_common_perf.h"
+
+#define PERF_TRANSPORT_HOSTNAME "perf.azure-devices.net"
+
+typedef struct PERF_TRANSPORT_INSTANCE_TAG
+{
+    PDLIST_ENTRY waitingToSend;
+    pfTransport_SendComplete_Callback send_complete_cb;
+    void* transport_ctx;
+} PERF_TRANSPORT_INSTANCE;
+
+static size_t g_completed_count;
+
+static IOTHUB_CLIENT_RESULT PerfTransport_SendMessageDisposition(MESSAGE_CALLBACK_INFO* message_data, IOTHUBMESSAGE_DISPOSITION_RESULT disposition)
+{
+    (void)message_data;
+    (void)disposition;
+    return IOTHUB_CLIENT_OK;
+}
+
+static int PerfTransport_Subscribe_DeviceMethod(IOTHUB_DEVICE_HANDLE handle)
+{
+    (void)handle;
+    return 0;
+}
+
+static void PerfTransport_Unsubscribe_DeviceMethod(IOTHUB_DEVICE_HANDLE handle)
+{
+    (void)handle;
+}
+
+static int PerfTransport_DeviceMethod_Response(IOTHUB_DEVICE_HANDLE handle, METHOD_HANDLE methodId, const unsigned char* response, size_t response_size, int status_response)
+{
+    (void)handle;
+    (void)methodId;
+    (void)response;
+    (void)response_size;
+    (void)status_response;
+    return 0;
+}
+
+static int PerfTransport_Subscribe_DeviceTwin(IOTHUB_DEVICE_HANDLE handle)
+{
+    (void)handle;
+    return 0;
+}
+
+static void PerfTransport_Unsubscribe_DeviceTwin(IOTHUB_DEVICE_HANDLE handle)
+{
+    (void)handle;
+}
+
+static IOTHUB_PROCESS_ITEM_RESULT PerfTransport_ProcessItem(TRANSPORT_LL_HANDLE handle, IOTHUB_IDENTITY_TYPE item_type, IOTHUB_IDENTITY_INFO* iothub_item)
+{
+    (void)handle;
+    (void)item_type;
+    (void)iothub_item;
+    return IOTHUB_PROCESS_OK;
+}
+
+static STRING_HANDLE PerfTransport_GetHostname(TRANSPORT_LL_HANDLE handle)
+{
+    (void)handle;
+    return STRING_construct(PERF_TRANSPORT_HOSTNAME);
+}
+
+static IOTHUB_CLIENT_RESULT PerfTransport_SetOption(TRANSPORT_LL_HANDLE handle, const char* option, const void* value)
+{
+    (void)handle;
+    (void)option;
+    (void)value;
+    return IOTHUB_CLIENT_OK;
+}
+
+static TRANSPORT_LL_HANDLE PerfTransport_Create(const IOTHUBTRANSPORT_CONFIG* config, TRANSPORT_CALLBACKS_INFO* cb_info, void* ctx)
+{
+    PERF_TRANSPORT_INSTANCE* result;
+
+    if (config == NULL || cb_info == NULL)
+    {
+        LogError("Invalid argument config=%p, cb_info=%p", config, cb_info);
+        result = NULL;
+    }
+    else if ((result = (PERF_TRANSPORT_INSTANCE*)malloc(sizeof(PERF_TRANSPORT_INSTANCE))) == NULL)
+    {
+        LogError("Failed allocating perf transport");
+    }
+    else
+    {
+        result->waitingToSend = config->waitingToSend;
+        result->send_complete_cb = cb_info->send_complete_cb;
+        result->transport_ctx = ctx;
+    }
+
+    return (TRANSPORT_LL_HANDLE)result;
+}
+
+static void PerfTransport_Destroy(TRANSPORT_LL_HANDLE handle)
+{
+    free(handle);
+}
+
+static IOTHUB_DEVICE_HANDLE PerfTransport_Register(TRANSPORT_LL_HANDLE handle, const IOTHUB_DEVICE_CONFIG* device, PDLIST_ENTRY waitingToSend)
+{
+    PERF_TRANSPORT_INSTANCE* transport_instance = (PERF_TRANSPORT_INSTANCE*)handle;
+    (void)device;
+    transport_instance->waitingToSend = waitingToSend;
+    return (IOTHUB_DEVICE_HANDLE)handle;
+}
+
+static void PerfTransport_Unregister(IOTHUB_DEVICE_HANDLE deviceHandle)
+{
+    (void)deviceHandle;
+}
+
+static int PerfTransport_Subscribe(IOTHUB_DEVICE_HANDLE handle)
+{
+    (void)handle;
+    return 0;
+}
+
+static void PerfTransport_Unsubscribe(IOTHUB_DEVICE_HANDLE handle)
+{
+    (void)handle;
+}
+
+static void PerfTransport_DoWork(TRANSPORT_LL_HANDLE handle)
+{
+    PERF_TRANSPORT_INSTANCE* transport_instance = (PERF_TRANSPORT_INSTANCE*)handle;
+    DLIST_ENTRY completed;
+    PDLIST_ENTRY current;
+
+    DList_InitializeListHead(&completed);
+
+    while ((current = DList_RemoveHeadList(transport_instance->waitingToSend)) != transport_instance->waitingToSend)
+    {
+        DList_InsertTailList(&completed, current);
+        g_completed_count++;
+    }
+
+    if (!DList_IsListEmpty(&completed))
+    {
+        transport_instance->send_complete_cb(&completed, IOTHUB_CLIENT_CONFIRMATION_OK, transport_instance->transport_ctx);
+    }
+}
+
+static int PerfTransport_SetRetryPolicy(TRANSPORT_LL_HANDLE handle, IOTHUB_CLIENT_RETRY_POLICY retryPolicy, size_t retryTimeoutLimitInSeconds)
+{
+    (void)handle;
+    (void)retryPolicy;
+    (void)retryTimeoutLimitInSeconds;
+    return 0;
+}
+
+static IOTHUB_CLIENT_RESULT PerfTransport_GetSendStatus(IOTHUB_DEVICE_HANDLE handle, IOTHUB_CLIENT_STATUS* iotHubClientStatus)
+{
+    PERF_TRANSPORT_INSTANCE* transport_instance = (PERF_TRANSPORT_INSTANCE*)handle;
+    *iotHubClientStatus = DList_IsListEmpty(transport_instance->waitingToSend) ? IOTHUB_CLIENT_SEND_STATUS_IDLE : IOTHUB_CLIENT_SEND_STATUS_BUSY;
+    return IOTHUB_CLIENT_OK;
+}
+
+static int PerfTransport_Subscribe_InputQueue(IOTHUB_DEVICE_HANDLE handle)
+{
+    (void)handle;
+    return 0;
+}
+
+static void PerfTransport_Unsubscribe_InputQueue(IOTHUB_DEVICE_HANDLE handle)
+{
+    (void)handle;
+}
+
+static int PerfTransport_SetCallbackContext(TRANSPORT_LL_HANDLE handle, void* ctx)
+{
+    PERF_TRANSPORT_INSTANCE* transport_instance = (PERF_TRANSPORT_INSTANCE*)handle;
+    transport_instance->transport_ctx = ctx;
+    return 0;
+}
+
+static IOTHUB_CLIENT_RESULT PerfTransport_GetTwinAsync(IOTHUB_DEVICE_HANDLE handle, IOTHUB_CLIENT_DEVICE_TWIN_CALLBACK completionCallback, void* callbackContext)
+{
+    (void)handle;
+    (void)completionCallback;
+    (void)callbackContext;
+    return IOTHUB_CLIENT_ERROR;
+}
+
+static int PerfTransport_GetSupportedPlatformInfo(TRANSPORT_LL_HANDLE handle, PLATFORM_INFO_OPTION* info)
+{
+    (void)handle;
+    *info = PLATFORM_INFO_OPTION_DEFAULT;
+    return 0;
+}
+
+static IOTHUB_CLIENT_RESULT PerfTransport_GetRttStatistics(TRANSPORT_LL_HANDLE handle, IOTHUB_CLIENT_RTT_STATISTICS* rttStatistics)
+{
+    (void)handle;
+    (void)rttStatistics;
+    return IOTHUB_CLIENT_ERROR;
+}
+
+static TRANSPORT_PROVIDER perfTransportProvider =
+{
+    PerfTransport_SendMessageDisposition,
+    PerfTransport_Subscribe_DeviceMethod,
+    PerfTransport_Unsubscribe_DeviceMethod,
+    PerfTransport_DeviceMethod_Response,
+    PerfTransport_Subscribe_DeviceTwin,
+    PerfTransport_Unsubscribe_DeviceTwin,
+    PerfTransport_ProcessItem,
+    PerfTransport_GetHostname,
+    PerfTransport_SetOption,
+    PerfTransport_Create,
+    PerfTransport_Destroy,
+    PerfTransport_Register,
+    PerfTransport_Unregister,
+    PerfTransport_Subscribe,
+    PerfTransport_Unsubscribe,
+    PerfTransport_DoWork,
+    PerfTransport_SetRetryPolicy,
+    PerfTransport_GetSendStatus,
+    PerfTransport_Subscribe_InputQueue,
+    PerfTransport_Unsubscribe_InputQueue,
+    PerfTransport_SetCallbackContext,
+    PerfTransport_GetTwinAsync,
+    PerfTransport_GetSupportedPlatformInfo,
+    PerfTransport_GetRttStatistics
+};
+
+const TRANSPORT_PROVIDER* PerfTransport_ProtocolProvider(void)
+{
+    return &perfTransportProvider;
+}
+
+size_t perf_transport_get_completed_count(void)
+{
+    return g_completed_count;
+}
+
+void perf_transport_reset_completed_count(void)
+{
+    g_completed_count = 0;
+}
+
+static size_t get_allocation_count(void)
+{
+#ifdef GB_MEASURE_MEMORY_FOR_THIS
+    return gballoc_getAllocationCount();
+#else
+    return 0;
+#endif
+}
+
+int perf_measurement_init(PERF_MEASUREMENT* measurement)
+{
+    int result;
+
+    (void)memset(measurement, 0, sizeof(PERF_MEASUREMENT));
+
+    if ((measurement->tick_counter = tickcounter_create()) == NULL)
+    {
+        LogError("Failed creating tick counter");
+        result = MU_FAILURE;
+    }
+    else
+    {
+#ifdef GB_MEASURE_MEMORY_FOR_THIS
+        (void)gballoc_init();
+#endif
+        result = 0;
+    }
+
+    return result;
+}
+
+void perf_measurement_deinit(PERF_MEASUREMENT* measurement)
+{
+    tickcounter_destroy(measurement->tick_counter);
+#ifdef GB_MEASURE_MEMORY_FOR_THIS
+    gballoc_deinit();
+#endif
+}
+
+void perf_measurement_start(PERF_MEASUREMENT* measurement)
+{
+    measurement->start_allocation_count = get_allocation_count();
+    (void)tickcounter_get_current_ms(measurement->tick_counter, &measurement->start_time_ms);
+}
+
+void perf_measurement_stop(PERF_MEASUREMENT* measurement)
+{
+    tickcounter_ms_t now_ms;
+    (void)tickcounter_get_current_ms(measurement->tick_counter, &now_ms);
+    measurement->elapsed_ms = now_ms - measurement->start_time_ms;
+    measurement->allocation_count = get_allocation_count() - measurement->start_allocation_count;
+}
+
+void perf_measurement_print(const PERF_MEASUREMENT* measurement, const char* label, size_t iterations)
+{
+    double usec_per_iteration = iterations == 0 ? 0.0 : ((double)measurement->elapsed_ms * 1000.0) / (double)iterations;
+
+#ifdef GB_MEASURE_MEMORY_FOR_THIS
+    double allocations_per_iteration = iterations == 0 ? 0.0 : (double)measurement->allocation_count / (double)iterations;
+    (void)printf("%-40s %10lu iterations %10lu ms %10.3f us/iteration %8.2f allocations/iteration\r\n",
+        label, (unsigned long)iterations, (unsigned long)measurement->elapsed_ms, usec_per_iteration, allocations_per_iteration);
+#else
+    (void)printf("%-40s %10lu iterations %10lu ms %10.3f us/iteration (build with memory_trace=ON to count allocations)\r\n",
+        label, (unsigned long)iterations, (unsigned long)measurement->elapsed_ms, usec_per_iteration);
+#endif
+}
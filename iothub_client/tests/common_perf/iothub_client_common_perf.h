@@ -0,0 +1,34 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#ifndef IOTHUB_CLIENT_COMMON_PERF_H
+#define IOTHUB_CLIENT_COMMON_PERF_H
+
+#include <stdlib.h>
+#include <stddef.h>
+#include "azure_c_shared_utility/tickcounter.h"
+#include "iothub_transport_ll.h"
+
+// In-process transport used by the performance benchmarks. Every message found in
+// waitingToSend during DoWork is completed immediately with IOTHUB_CLIENT_CONFIRMATION_OK,
+// so the measurements only cover the client layers and not the network.
+extern const TRANSPORT_PROVIDER* PerfTransport_ProtocolProvider(void);
+extern size_t perf_transport_get_completed_count(void);
+extern void perf_transport_reset_completed_count(void);
+
+typedef struct PERF_MEASUREMENT_TAG
+{
+    TICK_COUNTER_HANDLE tick_counter;
+    tickcounter_ms_t start_time_ms;
+    size_t start_allocation_count;
+    size_t allocation_count;
+    tickcounter_ms_t elapsed_ms;
+} PERF_MEASUREMENT;
+
+extern int perf_measurement_init(PERF_MEASUREMENT* measurement);
+extern void perf_measurement_deinit(PERF_MEASUREMENT* measurement);
+extern void perf_measurement_start(PERF_MEASUREMENT* measurement);
+extern void perf_measurement_stop(PERF_MEASUREMENT* measurement);
+extern void perf_measurement_print(const PERF_MEASUREMENT* measurement, const char* label, size_t iterations);
+
+#endif // IOTHUB_CLIENT_COMMON_PERF_H
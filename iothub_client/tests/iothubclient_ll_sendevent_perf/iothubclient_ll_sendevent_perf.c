@@ -0,0 +1,158 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+// Compares the per-message cost of IoTHubDeviceClient_LL_SendEventAsync, which clones the
+// message, with IoTHubDeviceClient_LL_SendEventAsync_TakeOwnership, which queues the
+// caller's handle as-is.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+
+#include "azure_c_shared_utility/gballoc.h"
+#include "azure_c_shared_utility/xlogging.h"
+#include "azure_c_shared_utility/platform.h"
+#include "iothub_device_client_ll.h"
+#include "iothub_message.h"
+#include "../common_perf/iothub_client_common_perf.h"
+
+#define PERF_MESSAGE_COUNT      100000
+#define PERF_DOWORK_INTERVAL    100
+#define PERF_PAYLOAD_SIZE       256
+
+static size_t g_confirmation_count;
+
+static void send_confirmation_callback(IOTHUB_CLIENT_CONFIRMATION_RESULT result, void* userContextCallback)
+{
+    (void)userContextCallback;
+    if (result == IOTHUB_CLIENT_CONFIRMATION_OK)
+    {
+        g_confirmation_count++;
+    }
+}
+
+static int run_send_benchmark(IOTHUB_DEVICE_CLIENT_LL_HANDLE device_ll_handle, bool take_ownership, PERF_MEASUREMENT* measurement)
+{
+    int result = 0;
+    unsigned char payload[PERF_PAYLOAD_SIZE];
+    size_t index;
+
+    (void)memset(payload, 'x', sizeof(payload));
+    g_confirmation_count = 0;
+
+    perf_measurement_start(measurement);
+
+    for (index = 0; index < PERF_MESSAGE_COUNT && result == 0; index++)
+    {
+        IOTHUB_MESSAGE_HANDLE message_handle;
+
+        if ((message_handle = IoTHubMessage_CreateFromByteArray(payload, sizeof(payload))) == NULL)
+        {
+            LogError("Failed creating message %lu", (unsigned long)index);
+            result = MU_FAILURE;
+        }
+        else if (take_ownership)
+        {
+            if (IoTHubDeviceClient_LL_SendEventAsync_TakeOwnership(device_ll_handle, message_handle, send_confirmation_callback, NULL) != IOTHUB_CLIENT_OK)
+            {
+                LogError("IoTHubDeviceClient_LL_SendEventAsync_TakeOwnership failed");
+                IoTHubMessage_Destroy(message_handle);
+                result = MU_FAILURE;
+            }
+        }
+        else
+        {
+            if (IoTHubDeviceClient_LL_SendEventAsync(device_ll_handle, message_handle, send_confirmation_callback, NULL) != IOTHUB_CLIENT_OK)
+            {
+                LogError("IoTHubDeviceClient_LL_SendEventAsync failed");
+                result = MU_FAILURE;
+            }
+            IoTHubMessage_Destroy(message_handle);
+        }
+
+        if ((index + 1) % PERF_DOWORK_INTERVAL == 0)
+        {
+            IoTHubDeviceClient_LL_DoWork(device_ll_handle);
+        }
+    }
+
+    IoTHubDeviceClient_LL_DoWork(device_ll_handle);
+
+    perf_measurement_stop(measurement);
+
+    if (result == 0 && g_confirmation_count != PERF_MESSAGE_COUNT)
+    {
+        LogError("Expected %lu confirmations, got %lu", (unsigned long)PERF_MESSAGE_COUNT, (unsigned long)g_confirmation_count);
+        result = MU_FAILURE;
+    }
+
+    return result;
+}
+
+int main(void)
+{
+    int result;
+    PERF_MEASUREMENT measurement;
+
+    if (platform_init() != 0)
+    {
+        LogError("Failed initializing the platform");
+        result = MU_FAILURE;
+    }
+    else
+    {
+        if (perf_measurement_init(&measurement) != 0)
+        {
+            LogError("Failed initializing the measurement");
+            result = MU_FAILURE;
+        }
+        else
+        {
+            IOTHUB_CLIENT_CONFIG client_config;
+            IOTHUB_DEVICE_CLIENT_LL_HANDLE device_ll_handle;
+
+            (void)memset(&client_config, 0, sizeof(client_config));
+            client_config.protocol = PerfTransport_ProtocolProvider;
+            client_config.deviceId = "perf-device";
+            client_config.deviceKey = "cGVyZi1kZXZpY2Uta2V5";
+            client_config.iotHubName = "perf";
+            client_config.iotHubSuffix = "azure-devices.net";
+
+            if ((device_ll_handle = IoTHubDeviceClient_LL_Create(&client_config)) == NULL)
+            {
+                LogError("Failed creating the device client");
+                result = MU_FAILURE;
+            }
+            else
+            {
+                if (run_send_benchmark(device_ll_handle, false, &measurement) != 0)
+                {
+                    result = MU_FAILURE;
+                }
+                else
+                {
+                    perf_measurement_print(&measurement, "SendEventAsync (clone)", PERF_MESSAGE_COUNT);
+
+                    if (run_send_benchmark(device_ll_handle, true, &measurement) != 0)
+                    {
+                        result = MU_FAILURE;
+                    }
+                    else
+                    {
+                        perf_measurement_print(&measurement, "SendEventAsync_TakeOwnership", PERF_MESSAGE_COUNT);
+                        result = 0;
+                    }
+                }
+
+                IoTHubDeviceClient_LL_Destroy(device_ll_handle);
+            }
+
+            perf_measurement_deinit(&measurement);
+        }
+
+        platform_deinit();
+    }
+
+    return result;
+}
@@ -10,6 +10,7 @@
 #include <stddef.h>
 #include <stdbool.h>
 #endif
+#include <limits.h>
 
 static void* my_gballoc_malloc(size_t size)
 {
@@ -73,7 +74,12 @@ void* my_gballoc_realloc(void* ptr, size_t size)
 #include "internal/iothub_client_ll_uploadtoblob.h"
 #endif
 
+#ifdef USE_MESSAGE_STORE
+#include "internal/message_store.h"
+#endif
+
 MOCKABLE_FUNCTION(, void, test_event_confirmation_callback, IOTHUB_CLIENT_CONFIRMATION_RESULT, result, void*, userContextCallback);
+MOCKABLE_FUNCTION(, void, test_queue_state_callback, IOTHUB_CLIENT_QUEUE_STATE, queue_state, size_t, queued_messages, size_t, queued_bytes, void*, userContextCallback);
 MOCKABLE_FUNCTION(, IOTHUBMESSAGE_DISPOSITION_RESULT, test_message_callback_async, IOTHUB_MESSAGE_HANDLE, message, void*, userContextCallback);
 MOCKABLE_FUNCTION(, void, iothub_reported_state_callback, int, status_code, void*, userContextCallback);
 MOCKABLE_FUNCTION(, void, iothub_device_twin_callback, DEVICE_TWIN_UPDATE_STATE, update_state, const unsigned char*, payLoad, size_t, size, void*, userContextCallback);
@@ -110,6 +116,7 @@ MOCKABLE_FUNCTION(, int, FAKE_IotHubTransport_Subscribe_InputQueue, IOTHUB_DEVIC
 MOCKABLE_FUNCTION(, void, FAKE_IotHubTransport_Unsubscribe_InputQueue, IOTHUB_DEVICE_HANDLE, handle);
 MOCKABLE_FUNCTION(, int, FAKE_IoTHubTransport_SetCallbackContext, TRANSPORT_LL_HANDLE, handle, void*, ctx);
 MOCKABLE_FUNCTION(, int, FAKE_IoTHubTransport_GetSupportedPlatformInfo, TRANSPORT_LL_HANDLE, handle, PLATFORM_INFO_OPTION*, info);
+MOCKABLE_FUNCTION(, IOTHUB_CLIENT_RESULT, FAKE_IoTHubTransport_GetRttStatistics, TRANSPORT_LL_HANDLE, handle, IOTHUB_CLIENT_RTT_STATISTICS*, rttStatistics);
 MOCKABLE_FUNCTION(, bool, messageInputCallbackEx, MESSAGE_CALLBACK_INFO*, messageData, void*, userContextCallback);
 
 MOCKABLE_FUNCTION(, bool, Transport_MessageCallbackFromInput, MESSAGE_CALLBACK_INFO*, messageData, void*, ctx);
@@ -500,6 +507,49 @@ static void my_IoTHubModuleClient_LL_MethodHandle_Destroy(IOTHUB_CLIENT_EDGE_HAN
 }
 #endif
 
+#ifdef USE_MESSAGE_STORE
+#define TEST_MESSAGE_STORE_HANDLE (MESSAGE_STORE_HANDLE)0x4343
+#define TEST_MESSAGE_STORE_DIRECTORY "/var/lib/telemetry"
+#define TEST_STORED_MESSAGE_HANDLE (IOTHUB_MESSAGE_HANDLE)0x54
+#define TEST_STORE_POSITION 64
+
+static size_t g_message_store_replay_count;
+static size_t g_message_store_release_count;
+static bool g_message_store_closed;
+
+static MESSAGE_STORE_HANDLE my_message_store_open(const char* directory, ON_STORED_MESSAGE on_stored_message, void* context)
+{
+    size_t index;
+    (void)directory;
+    for (index = 0; index < g_message_store_replay_count; index++)
+    {
+        on_stored_message(TEST_STORED_MESSAGE_HANDLE, TEST_STORE_POSITION * (index + 1), context);
+    }
+    return TEST_MESSAGE_STORE_HANDLE;
+}
+
+static int my_message_store_append(MESSAGE_STORE_HANDLE store, IOTHUB_MESSAGE_HANDLE message, size_t* position)
+{
+    (void)store;
+    (void)message;
+    *position = TEST_STORE_POSITION;
+    return 0;
+}
+
+static void my_message_store_release(MESSAGE_STORE_HANDLE store, size_t position)
+{
+    (void)store;
+    (void)position;
+    g_message_store_release_count++;
+}
+
+static void my_message_store_close(MESSAGE_STORE_HANDLE store)
+{
+    (void)store;
+    g_message_store_closed = true;
+}
+#endif
+
 static TRANSPORT_LL_HANDLE my_FAKE_IoTHubTransport_Create(const IOTHUBTRANSPORT_CONFIG* config, TRANSPORT_CALLBACKS_INFO* cb_info, void* ctx)
 {
     (void)config;
@@ -516,11 +566,13 @@ static TRANSPORT_LL_HANDLE my_FAKE_IoTHubTransport_Create(const IOTHUBTRANSPORT_
     return TEST_TRANSPORT_LL_HANDLE;
 }
 
+static PDLIST_ENTRY g_waitingToSend;
+
 static IOTHUB_DEVICE_HANDLE my_FAKE_IoTHubTransport_Register(TRANSPORT_LL_HANDLE handle, const IOTHUB_DEVICE_CONFIG* device, PDLIST_ENTRY waitingToSend)
 {
     (void)handle;
     (void)device;
-    (void)waitingToSend;
+    g_waitingToSend = waitingToSend;
     return (IOTHUB_DEVICE_HANDLE)my_gballoc_malloc(1);
 }
 
@@ -623,7 +675,8 @@ static TRANSPORT_PROVIDER FAKE_transport_provider =
     FAKE_IotHubTransport_Unsubscribe_InputQueue, /*pfIoTHubTransport_Unsubscribe_InputQueue IoTHubTransport_Unsubscribe_InputQueue; */
     FAKE_IoTHubTransport_SetCallbackContext,
     FAKE_IoTHubTransport_GetTwinAsync,   /*pfIoTHubTransport_GetTwinAsync IoTHubTransport_GetTwinAsync;*/
-    FAKE_IoTHubTransport_GetSupportedPlatformInfo
+    FAKE_IoTHubTransport_GetSupportedPlatformInfo,
+    FAKE_IoTHubTransport_GetRttStatistics
 };
 
 static const TRANSPORT_PROVIDER* provideFAKE(void)
@@ -780,6 +833,10 @@ TEST_SUITE_INITIALIZE(suite_init)
     REGISTER_UMOCK_ALIAS_TYPE(IOTHUB_CLIENT_CONNECTION_STATUS, int);
     REGISTER_UMOCK_ALIAS_TYPE(IOTHUB_CLIENT_CONNECTION_STATUS_REASON, int);
     REGISTER_UMOCK_ALIAS_TYPE(IOTHUB_CLIENT_RETRY_POLICY, int);
+    REGISTER_UMOCK_ALIAS_TYPE(IOTHUB_CLIENT_QUEUE_STATE, int);
+    REGISTER_UMOCK_ALIAS_TYPE(IOTHUB_MESSAGE_PRIORITY, int);
+    REGISTER_UMOCK_ALIAS_TYPE(IOTHUBMESSAGE_CONTENT_TYPE, int);
+    REGISTER_UMOCK_ALIAS_TYPE(IOTHUB_MESSAGE_RESULT, int);
     REGISTER_UMOCK_ALIAS_TYPE(SINGLYLINKEDLIST_HANDLE, void*);
     REGISTER_UMOCK_ALIAS_TYPE(LIST_MATCH_FUNCTION, void*);
     REGISTER_UMOCK_ALIAS_TYPE(LIST_ITEM_HANDLE, void*);
@@ -797,6 +854,11 @@ TEST_SUITE_INITIALIZE(suite_init)
     REGISTER_UMOCK_ALIAS_TYPE(IOTHUB_SECURITY_TYPE, int);
 #endif // USE_EDGE_MODULES
 
+#ifdef USE_MESSAGE_STORE
+    REGISTER_UMOCK_ALIAS_TYPE(MESSAGE_STORE_HANDLE, void*);
+    REGISTER_UMOCK_ALIAS_TYPE(ON_STORED_MESSAGE, void*);
+#endif // USE_MESSAGE_STORE
+
     REGISTER_GLOBAL_MOCK_RETURN(IoTHubClient_GetVersionString, "version 1.0");
 
     REGISTER_GLOBAL_MOCK_RETURN(FAKE_IoTHubTransport_Subscribe_DeviceTwin, 0);
@@ -832,6 +894,7 @@ TEST_SUITE_INITIALIZE(suite_init)
 
     REGISTER_GLOBAL_MOCK_RETURN(FAKE_IoTHubTransport_SetCallbackContext, 0);
     REGISTER_GLOBAL_MOCK_RETURN(FAKE_IoTHubTransport_GetSupportedPlatformInfo, 0);
+    REGISTER_GLOBAL_MOCK_RETURN(FAKE_IoTHubTransport_GetRttStatistics, IOTHUB_CLIENT_OK);
 
     REGISTER_GLOBAL_MOCK_FAIL_RETURN(FAKE_IoTHubTransport_Subscribe_DeviceMethod, MU_FAILURE);
     REGISTER_GLOBAL_MOCK_RETURN(FAKE_IoTHubMessage_GetMessageId, "1");
@@ -858,6 +921,16 @@ TEST_SUITE_INITIALIZE(suite_init)
     REGISTER_GLOBAL_MOCK_FAIL_RETURN(iothub_security_init, 1);
 #endif
 
+#ifdef USE_MESSAGE_STORE
+    REGISTER_GLOBAL_MOCK_HOOK(message_store_open, my_message_store_open);
+    REGISTER_GLOBAL_MOCK_FAIL_RETURN(message_store_open, NULL);
+    REGISTER_GLOBAL_MOCK_HOOK(message_store_append, my_message_store_append);
+    REGISTER_GLOBAL_MOCK_FAIL_RETURN(message_store_append, MU_FAILURE);
+    REGISTER_GLOBAL_MOCK_HOOK(message_store_release, my_message_store_release);
+    REGISTER_GLOBAL_MOCK_HOOK(message_store_close, my_message_store_close);
+    REGISTER_GLOBAL_MOCK_RETURN(message_store_commit, 0);
+#endif
+
     REGISTER_GLOBAL_MOCK_RETURN(environment_get_variable, ENVVARIABLE);
     REGISTER_GLOBAL_MOCK_FAIL_RETURN(environment_get_variable, NULL);
 
@@ -865,6 +938,7 @@ TEST_SUITE_INITIALIZE(suite_init)
 
     REGISTER_GLOBAL_MOCK_RETURN(IoTHubMessage_CreateFromString, (IOTHUB_MESSAGE_HANDLE)0x44);
     REGISTER_GLOBAL_MOCK_RETURN(IoTHubMessage_Clone, (IOTHUB_MESSAGE_HANDLE)0x44);
+    REGISTER_GLOBAL_MOCK_RETURN(IoTHubMessage_GetPriority, IOTHUB_MESSAGE_PRIORITY_NORMAL);
     REGISTER_GLOBAL_MOCK_FAIL_RETURN(IoTHubMessage_Clone, NULL);
 
     REGISTER_GLOBAL_MOCK_RETURN(IoTHubMessage_SetOutputName, IOTHUB_MESSAGE_OK);
@@ -978,6 +1052,12 @@ TEST_FUNCTION_INITIALIZE(method_init)
     my_FAKE_IoTHubTransport_GetTwinAsync_handle = NULL;
     my_FAKE_IoTHubTransport_GetTwinAsync_completionCallback = NULL;
     my_FAKE_IoTHubTransport_GetTwinAsync_callbackContext = NULL;
+
+#ifdef USE_MESSAGE_STORE
+    g_message_store_replay_count = 0;
+    g_message_store_release_count = 0;
+    g_message_store_closed = false;
+#endif
 }
 
 TEST_FUNCTION_CLEANUP(TestMethodCleanup)
@@ -1072,6 +1152,7 @@ static void setup_IoTHubClientCore_LL_sendeventasync_mocks(bool invoke_tickcount
     STRICT_EXPECTED_CALL(IoTHubClient_Diagnostic_AddIfNecessary(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
         .IgnoreArgument(1)
         .IgnoreArgument(2);
+    STRICT_EXPECTED_CALL(IoTHubMessage_GetPriority(IGNORED_PTR_ARG));
 
     STRICT_EXPECTED_CALL(DList_InsertTailList(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
         .IgnoreArgument(1)
@@ -2314,7 +2395,7 @@ TEST_FUNCTION(IoTHubClientCore_LL_SendEventAsync_fails)
     umock_c_negative_tests_snapshot();
 
     // act
-    size_t calls_cannot_fail[] = { 4 };
+    size_t calls_cannot_fail[] = { 4, 5 };
     size_t count = umock_c_negative_tests_call_count();
     for (size_t index = 0; index < count; index++)
     {
@@ -2340,278 +2421,1431 @@ TEST_FUNCTION(IoTHubClientCore_LL_SendEventAsync_fails)
     umock_c_negative_tests_deinit();
 }
 
-/*Tests_SRS_IoTHubClientCore_LL_25_111: [IoTHubClientCore_LL_SetConnectionStatusCallback shall return IOTHUB_CLIENT_INVALID_ARG if called with NULL parameter iotHubClientHandle]*/
-TEST_FUNCTION(IoTHubClientCore_LL_SetConnectionStatusCallback_with_NULL_iotHubClientHandle_fails)
+/*Tests_SRS_IOTHUBCLIENT_LL_44_003: [ IoTHubClientCore_LL_SendEventAsync_TakeOwnership shall fail and return IOTHUB_CLIENT_INVALID_ARG if parameter iotHubClientHandle or eventMessageHandle is NULL, or if eventConfirmationCallback is NULL and userContextCallback is not NULL. ]*/
+TEST_FUNCTION(IoTHubClientCore_LL_SendEventAsync_TakeOwnership_with_NULL_iotHubClientHandle_fails)
 {
-    ///arrange
+    //arrange
 
-    ///act
-    IOTHUB_CLIENT_RESULT result = IoTHubClientCore_LL_SetConnectionStatusCallback(NULL, connectionStatusCallback, (void*)1);
+    //act
+    IOTHUB_CLIENT_RESULT result = IoTHubClientCore_LL_SendEventAsync_TakeOwnership(NULL, TEST_MESSAGE_HANDLE, test_event_confirmation_callback, (void*)3);
 
-    ///assert
+    //assert
     ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result);
-    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
 }
 
-/*Tests_SRS_IoTHubClientCore_LL_25_112: [IoTHubClientCore_LL_SetConnectionStatusCallback shall return IOTHUB_CLIENT_OK and save the callback and userContext as a member of the handle.]*/
-TEST_FUNCTION(IoTHubClientCore_LL_SetConnectionStatusCallback_with_non_NULL_succeeds)
+/*Tests_SRS_IOTHUBCLIENT_LL_44_003: [ IoTHubClientCore_LL_SendEventAsync_TakeOwnership shall fail and return IOTHUB_CLIENT_INVALID_ARG if parameter iotHubClientHandle or eventMessageHandle is NULL, or if eventConfirmationCallback is NULL and userContextCallback is not NULL. ]*/
+TEST_FUNCTION(IoTHubClientCore_LL_SendEventAsync_TakeOwnership_with_NULL_messageHandle_fails)
 {
-    ///arrange
-
+    //arrange
     IOTHUB_CLIENT_CORE_LL_HANDLE handle = IoTHubClientCore_LL_Create(&TEST_CONFIG);
     umock_c_reset_all_calls();
 
-    ///act
-    IOTHUB_CLIENT_RESULT result = IoTHubClientCore_LL_SetConnectionStatusCallback(handle, connectionStatusCallback, (void*)1);
+    //act
+    IOTHUB_CLIENT_RESULT result = IoTHubClientCore_LL_SendEventAsync_TakeOwnership(handle, NULL, test_event_confirmation_callback, (void*)3);
 
-    ///assert
-    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
+    //assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result);
     ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
 
-    ///cleanup
+    //cleanup
     IoTHubClientCore_LL_Destroy(handle);
 }
 
-/*Tests_SRS_IoTHubClientCore_LL_02_016: [IoTHubClientCore_LL_SetMessageCallback shall fail and return IOTHUB_CLIENT_INVALID_ARG if parameter iotHubClientHandle is NULL.]*/
-TEST_FUNCTION(IoTHubClientCore_LL_SetMessageCallback_with_NULL_iotHubClientHandle_fails)
+/*Tests_SRS_IOTHUBCLIENT_LL_44_003: [ IoTHubClientCore_LL_SendEventAsync_TakeOwnership shall fail and return IOTHUB_CLIENT_INVALID_ARG if parameter iotHubClientHandle or eventMessageHandle is NULL, or if eventConfirmationCallback is NULL and userContextCallback is not NULL. ]*/
+TEST_FUNCTION(IoTHubClientCore_LL_SendEventAsync_TakeOwnership_with_NULL_callback_and_non_NULL_context_fails)
 {
-    ///arrange
+    //arrange
+    IOTHUB_CLIENT_CORE_LL_HANDLE handle = IoTHubClientCore_LL_Create(&TEST_CONFIG);
+    umock_c_reset_all_calls();
 
-    ///act
-    IOTHUB_CLIENT_RESULT result = IoTHubClientCore_LL_SetMessageCallback(NULL, messageCallback, (void*)1);
+    //act
+    IOTHUB_CLIENT_RESULT result = IoTHubClientCore_LL_SendEventAsync_TakeOwnership(handle, TEST_MESSAGE_HANDLE, NULL, (void*)3);
 
-    ///assert
+    //assert
     ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result);
     ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    //cleanup
+    IoTHubClientCore_LL_Destroy(handle);
 }
 
-/*Tests_SRS_IoTHubClientCore_LL_02_019: [If parameter messageCallback is NULL then IoTHubClientCore_LL_SetMessageCallback shall call the underlying layer's _Unsubscribe function and return IOTHUB_CLIENT_OK.] */
-TEST_FUNCTION(IoTHubClientCore_LL_SetMessageCallback_with_NULL_calls_Unsubscribe_and_succeeds)
+/*Tests_SRS_IOTHUBCLIENT_LL_44_001: [ IoTHubClientCore_LL_SendEventAsync_TakeOwnership shall add eventMessageHandle to the DLIST waitingToSend without cloning it. ]*/
+TEST_FUNCTION(IoTHubClientCore_LL_SendEventAsync_TakeOwnership_succeeds)
 {
-    ///arrange
+    //arrange
     IOTHUB_CLIENT_CORE_LL_HANDLE handle = IoTHubClientCore_LL_Create(&TEST_CONFIG);
-    (void)IoTHubClientCore_LL_SetMessageCallback(handle, test_message_callback_async, (void*)1);
     umock_c_reset_all_calls();
 
-    STRICT_EXPECTED_CALL(FAKE_IoTHubTransport_Unsubscribe(IGNORED_PTR_ARG))
-        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
+    STRICT_EXPECTED_CALL(IoTHubClient_Diagnostic_AddIfNecessary(IGNORED_PTR_ARG, TEST_MESSAGE_HANDLE));
+    STRICT_EXPECTED_CALL(IoTHubMessage_GetPriority(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(DList_InsertTailList(IGNORED_PTR_ARG, IGNORED_PTR_ARG));
 
-    ///act
-    IOTHUB_CLIENT_RESULT result = IoTHubClientCore_LL_SetMessageCallback(handle, NULL, (void*)1);
+    //act
+    IOTHUB_CLIENT_RESULT result = IoTHubClientCore_LL_SendEventAsync_TakeOwnership(handle, TEST_MESSAGE_HANDLE, test_event_confirmation_callback, (void*)1);
 
-    ///assert
+    //assert
     ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
     ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
 
-    ///cleanup
+    //cleanup
     IoTHubClientCore_LL_Destroy(handle);
 }
 
-/*Tests_SRS_IoTHubClientCore_LL_10_010: [If parameter messageCallback is NULL and the _SetMessageCallback had not been called to subscribe for messages, then IoTHubClientCore_LL_SetMessageCallback shall fail and return IOTHUB_CLIENT_ERROR.] */
-TEST_FUNCTION(IoTHubClientCore_LL_SetMessageCallback_with_NULL_after_SetMessageCallbacEx_fails)
+/*Tests_SRS_IOTHUBCLIENT_LL_44_002: [ If IoTHubClientCore_LL_SendEventAsync_TakeOwnership fails, the ownership of eventMessageHandle shall remain with the caller. ]*/
+TEST_FUNCTION(IoTHubClientCore_LL_SendEventAsync_TakeOwnership_diagnostic_fails_does_not_destroy_message)
 {
-    ///arrange
+    //arrange
     IOTHUB_CLIENT_CORE_LL_HANDLE handle = IoTHubClientCore_LL_Create(&TEST_CONFIG);
-    (void)IoTHubClientCore_LL_SetMessageCallback_Ex(handle, messageCallbackEx, (void*)1);
     umock_c_reset_all_calls();
 
-    ///act
-    IOTHUB_CLIENT_RESULT result = IoTHubClientCore_LL_SetMessageCallback(handle, NULL, (void*)1);
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
+    STRICT_EXPECTED_CALL(IoTHubClient_Diagnostic_AddIfNecessary(IGNORED_PTR_ARG, TEST_MESSAGE_HANDLE))
+        .SetReturn(1);
+    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG));
 
-    ///assert
+    //act
+    IOTHUB_CLIENT_RESULT result = IoTHubClientCore_LL_SendEventAsync_TakeOwnership(handle, TEST_MESSAGE_HANDLE, test_event_confirmation_callback, (void*)1);
+
+    //assert
     ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_ERROR, result);
     ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
 
-    ///cleanup
+    //cleanup
     IoTHubClientCore_LL_Destroy(handle);
 }
 
-/* Tests_SRS_IoTHubClientCore_LL_10_011: [If parameter messageCallback is non-NULL and the _SetMessageCallback_Ex had been used to susbscribe for messages, then IoTHubClientCore_LL_SetMessageCallback shall fail and return IOTHUB_CLIENT_ERROR.] */
-TEST_FUNCTION(IoTHubClientCore_LL_SetMessageCallback_after_SetMessageCallbacEx_fails)
-{
-    ///arrange
-    IOTHUB_CLIENT_CORE_LL_HANDLE handle = IoTHubClientCore_LL_Create(&TEST_CONFIG);
-    (void)IoTHubClientCore_LL_SetMessageCallback_Ex(handle, messageCallbackEx, (void*)1);
-    umock_c_reset_all_calls();
-
-    ///act
-    IOTHUB_CLIENT_RESULT result = IoTHubClientCore_LL_SetMessageCallback(handle, messageCallback, (void*)1);
+static size_t g_batch_confirmation_count;
+static IOTHUB_CLIENT_CONFIRMATION_RESULT g_batch_confirmation_result;
 
-    ///assert
-    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_ERROR, result);
-    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+static void test_batch_confirmation_callback(IOTHUB_CLIENT_CONFIRMATION_RESULT result, void* userContextCallback)
+{
+    (void)userContextCallback;
+    g_batch_confirmation_count++;
+    g_batch_confirmation_result = result;
+}
 
-    ///cleanup
-    IoTHubClientCore_LL_Destroy(handle);
+static void setup_IoTHubClientCore_LL_sendeventbatchasync_message_mocks(size_t message_count)
+{
+    size_t index;
+    for (index = 0; index < message_count; index++)
+    {
+        STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
+        STRICT_EXPECTED_CALL(IoTHubMessage_Clone(TEST_MESSAGE_HANDLE));
+        STRICT_EXPECTED_CALL(IoTHubClient_Diagnostic_AddIfNecessary(IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+        STRICT_EXPECTED_CALL(IoTHubMessage_GetPriority(IGNORED_PTR_ARG));
+        STRICT_EXPECTED_CALL(DList_InsertTailList(IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+    }
+    STRICT_EXPECTED_CALL(DList_AppendTailList(IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(DList_RemoveEntryList(IGNORED_PTR_ARG));
 }
 
-/*Tests_SRS_IoTHubClientCore_LL_10_021: [IoTHubClientCore_LL_SetMessageCallback_Ex shall fail and return IOTHUB_CLIENT_INVALID_ARG if parameter iotHubClientHandle is NULL.] */
-TEST_FUNCTION(IoTHubClientCore_LL_SetMessageCallback_Ex_with_NULL_iotHubClientHandle_fails)
+/*Tests_SRS_IOTHUBCLIENT_LL_44_004: [ IoTHubClientCore_LL_SendEventBatchAsync shall fail and return IOTHUB_CLIENT_INVALID_ARG if iotHubClientHandle or eventMessageHandles is NULL, if eventMessageCount is 0, if any of the message handles is NULL, if confirmationMode is not a valid value, or if eventConfirmationCallback is NULL and userContextCallback is not NULL. ]*/
+TEST_FUNCTION(IoTHubClientCore_LL_SendEventBatchAsync_with_NULL_iotHubClientHandle_fails)
 {
-    ///arrange
+    //arrange
+    IOTHUB_MESSAGE_HANDLE messages[] = { TEST_MESSAGE_HANDLE, TEST_MESSAGE_HANDLE };
 
-    ///act
-    IOTHUB_CLIENT_RESULT result = IoTHubClientCore_LL_SetMessageCallback_Ex(NULL, messageCallbackEx, (void*)1);
+    //act
+    IOTHUB_CLIENT_RESULT result = IoTHubClientCore_LL_SendEventBatchAsync(NULL, messages, 2, IOTHUB_CLIENT_BATCH_CONFIRMATION_PER_MESSAGE, test_event_confirmation_callback, (void*)1);
 
-    ///assert
+    //assert
     ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result);
     ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
 }
 
-/*Tests_SRS_IoTHubClientCore_LL_10_018: [If parameter messageCallback is NULL and IoTHubClientCore_LL_SetMessageCallback_Ex had not been used to subscribe for messages, then IoTHubClientCore_LL_SetMessageCallback_Ex shall fail and return IOTHUB_CLIENT_ERROR.] */
-TEST_FUNCTION(IoTHubClientCore_LL_SetMessageCallback_Ex_with_NULL_not_subscribed_fails)
+/*Tests_SRS_IOTHUBCLIENT_LL_44_004: [ IoTHubClientCore_LL_SendEventBatchAsync shall fail and return IOTHUB_CLIENT_INVALID_ARG if iotHubClientHandle or eventMessageHandles is NULL, if eventMessageCount is 0, if any of the message handles is NULL, if confirmationMode is not a valid value, or if eventConfirmationCallback is NULL and userContextCallback is not NULL. ]*/
+TEST_FUNCTION(IoTHubClientCore_LL_SendEventBatchAsync_with_zero_count_fails)
 {
-    ///arrange
+    //arrange
+    IOTHUB_MESSAGE_HANDLE messages[] = { TEST_MESSAGE_HANDLE };
     IOTHUB_CLIENT_CORE_LL_HANDLE handle = IoTHubClientCore_LL_Create(&TEST_CONFIG);
     umock_c_reset_all_calls();
 
-    ///act
-    IOTHUB_CLIENT_RESULT result = IoTHubClientCore_LL_SetMessageCallback_Ex(handle, NULL, (void*)1);
+    //act
+    IOTHUB_CLIENT_RESULT result = IoTHubClientCore_LL_SendEventBatchAsync(handle, messages, 0, IOTHUB_CLIENT_BATCH_CONFIRMATION_PER_MESSAGE, test_event_confirmation_callback, (void*)1);
 
-    ///assert
-    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_ERROR, result);
+    //assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result);
     ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
 
-    ///cleanup
+    //cleanup
     IoTHubClientCore_LL_Destroy(handle);
 }
 
-/*Tests_SRS_IoTHubClientCore_LL_10_019: [If parameter messageCallback is NULL and IoTHubClientCore_LL_SetMessageCallback had been used to subscribe for messages, then IoTHubClientCore_LL_SetMessageCallback_Ex shall fail and return IOTHUB_CLIENT_ERROR.] */
-TEST_FUNCTION(IoTHubClientCore_LL_SetMessageCallback_Ex_with_NULL_after_SetMessageCallback_fails)
+/*Tests_SRS_IOTHUBCLIENT_LL_44_004: [ IoTHubClientCore_LL_SendEventBatchAsync shall fail and return IOTHUB_CLIENT_INVALID_ARG if iotHubClientHandle or eventMessageHandles is NULL, if eventMessageCount is 0, if any of the message handles is NULL, if confirmationMode is not a valid value, or if eventConfirmationCallback is NULL and userContextCallback is not NULL. ]*/
+TEST_FUNCTION(IoTHubClientCore_LL_SendEventBatchAsync_with_NULL_message_in_batch_fails)
 {
-    ///arrange
+    //arrange
+    IOTHUB_MESSAGE_HANDLE messages[] = { TEST_MESSAGE_HANDLE, NULL };
     IOTHUB_CLIENT_CORE_LL_HANDLE handle = IoTHubClientCore_LL_Create(&TEST_CONFIG);
-    (void)IoTHubClientCore_LL_SetMessageCallback(handle, messageCallback, (void*)1);
     umock_c_reset_all_calls();
 
-    ///act
-    IOTHUB_CLIENT_RESULT result = IoTHubClientCore_LL_SetMessageCallback_Ex(handle, NULL, (void*)1);
+    //act
+    IOTHUB_CLIENT_RESULT result = IoTHubClientCore_LL_SendEventBatchAsync(handle, messages, 2, IOTHUB_CLIENT_BATCH_CONFIRMATION_PER_MESSAGE, test_event_confirmation_callback, (void*)1);
 
-    ///assert
-    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_ERROR, result);
+    //assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result);
     ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
 
-    ///cleanup
+    //cleanup
     IoTHubClientCore_LL_Destroy(handle);
 }
 
-/*Tests_SRS_IoTHubClientCore_LL_10_023: [If parameter messageCallback is NULL then IoTHubClientCore_LL_SetMessageCallback_Ex shall call the underlying layer's _Unsubscribe function and return IOTHUB_CLIENT_OK.] */
-TEST_FUNCTION(IoTHubClientCore_LL_SetMessageCallback_Ex_with_NULL_unsubscribe_succeeds)
+/*Tests_SRS_IOTHUBCLIENT_LL_44_006: [ IoTHubClientCore_LL_SendEventBatchAsync shall clone every message of the batch and append all of them to waitingToSend, in order, in a single operation. ]*/
+/*Tests_SRS_IOTHUBCLIENT_LL_44_007: [ In IOTHUB_CLIENT_BATCH_CONFIRMATION_PER_MESSAGE mode eventConfirmationCallback shall be invoked once for every message with userContextCallback. ]*/
+TEST_FUNCTION(IoTHubClientCore_LL_SendEventBatchAsync_per_message_succeeds)
 {
-    ///arrange
+    //arrange
+    IOTHUB_MESSAGE_HANDLE messages[] = { TEST_MESSAGE_HANDLE, TEST_MESSAGE_HANDLE, TEST_MESSAGE_HANDLE };
     IOTHUB_CLIENT_CORE_LL_HANDLE handle = IoTHubClientCore_LL_Create(&TEST_CONFIG);
-    (void)IoTHubClientCore_LL_SetMessageCallback_Ex(handle, messageCallbackEx, (void*)1);
     umock_c_reset_all_calls();
+    g_batch_confirmation_count = 0;
 
-    STRICT_EXPECTED_CALL(FAKE_IoTHubTransport_Unsubscribe(IGNORED_PTR_ARG))
-        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(DList_InitializeListHead(IGNORED_PTR_ARG));
+    setup_IoTHubClientCore_LL_sendeventbatchasync_message_mocks(3);
 
-    ///act
-    IOTHUB_CLIENT_RESULT result = IoTHubClientCore_LL_SetMessageCallback_Ex(handle, NULL, (void*)1);
+    //act
+    IOTHUB_CLIENT_RESULT result = IoTHubClientCore_LL_SendEventBatchAsync(handle, messages, 3, IOTHUB_CLIENT_BATCH_CONFIRMATION_PER_MESSAGE, test_batch_confirmation_callback, NULL);
 
-    ///assert
+    //assert
     ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
     ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
 
-    ///cleanup
+    //cleanup
     IoTHubClientCore_LL_Destroy(handle);
+    ASSERT_ARE_EQUAL(size_t, 3, g_batch_confirmation_count);
 }
 
-/*Tests_SRS_IoTHubClientCore_LL_10_025: [If the underlying layer's _Subscribe function fails, then IoTHubClientCore_LL_SetMessageCallback_Ex shall fail and return IOTHUB_CLIENT_ERROR. Otherwise IoTHubClientCore_LL_SetMessageCallback shall succeed and return IOTHUB_CLIENT_OK.] */
-TEST_FUNCTION(IoTHubClientCore_LL_SetMessageCallback_Ex_Subscribe_fails)
+/*Tests_SRS_IOTHUBCLIENT_LL_44_005: [ IoTHubClientCore_LL_SendEventBatchAsync shall read the current time once and use it as the timeout start time of every message in the batch. ]*/
+/*Tests_SRS_IOTHUBCLIENT_LL_44_008: [ In IOTHUB_CLIENT_BATCH_CONFIRMATION_PER_BATCH mode eventConfirmationCallback shall be invoked once, after the last message of the batch completes, with IOTHUB_CLIENT_CONFIRMATION_OK if all messages succeeded or with the first failure result otherwise. ]*/
+TEST_FUNCTION(IoTHubClientCore_LL_SendEventBatchAsync_per_batch_succeeds)
 {
-    ///arrange
+    //arrange
+    IOTHUB_MESSAGE_HANDLE messages[] = { TEST_MESSAGE_HANDLE, TEST_MESSAGE_HANDLE, TEST_MESSAGE_HANDLE };
     IOTHUB_CLIENT_CORE_LL_HANDLE handle = IoTHubClientCore_LL_Create(&TEST_CONFIG);
+    tickcounter_ms_t thisIsNotZero = 312984751;
+    (void)IoTHubClientCore_LL_SetOption(handle, "messageTimeout", &thisIsNotZero);
     umock_c_reset_all_calls();
+    g_batch_confirmation_count = 0;
 
-    STRICT_EXPECTED_CALL(FAKE_IoTHubTransport_Subscribe(IGNORED_PTR_ARG))
-        .IgnoreArgument_handle()
-        .SetReturn(__LINE__);
+    STRICT_EXPECTED_CALL(tickcounter_get_current_ms(IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
+    STRICT_EXPECTED_CALL(DList_InitializeListHead(IGNORED_PTR_ARG));
+    setup_IoTHubClientCore_LL_sendeventbatchasync_message_mocks(3);
 
-    ///act
-    IOTHUB_CLIENT_RESULT result = IoTHubClientCore_LL_SetMessageCallback_Ex(handle, messageCallbackEx, (void*)1);
+    //act
+    IOTHUB_CLIENT_RESULT result = IoTHubClientCore_LL_SendEventBatchAsync(handle, messages, 3, IOTHUB_CLIENT_BATCH_CONFIRMATION_PER_BATCH, test_batch_confirmation_callback, NULL);
 
-    ///assert
-    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_ERROR, result);
+    //assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
     ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
 
-    ///cleanup
+    //cleanup
     IoTHubClientCore_LL_Destroy(handle);
+    ASSERT_ARE_EQUAL(size_t, 1, g_batch_confirmation_count);
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_CONFIRMATION_RESULT, IOTHUB_CLIENT_CONFIRMATION_BECAUSE_DESTROY, g_batch_confirmation_result);
 }
 
-/*Tests_SRS_IoTHubClientCore_LL_10_020: [If parameter messageCallback is non-NULL, and IoTHubClientCore_LL_SetMessageCallback had been used to subscribe for messages, then IoTHubClientCore_LL_SetMessageCallback_Ex shall fail and return IOTHUB_CLIENT_ERROR.] */
-TEST_FUNCTION(IoTHubClientCore_LL_SetMessageCallback_Ex_after_SetMessageCallback_fails)
+/*Tests_SRS_IOTHUBCLIENT_LL_44_009: [ If cloning or queuing any of the messages fails, IoTHubClientCore_LL_SendEventBatchAsync shall release all the messages of the batch, queue none of them and return IOTHUB_CLIENT_ERROR. ]*/
+TEST_FUNCTION(IoTHubClientCore_LL_SendEventBatchAsync_clone_fails_queues_nothing)
 {
-    ///arrange
+    //arrange
+    IOTHUB_MESSAGE_HANDLE messages[] = { TEST_MESSAGE_HANDLE, TEST_MESSAGE_HANDLE };
     IOTHUB_CLIENT_CORE_LL_HANDLE handle = IoTHubClientCore_LL_Create(&TEST_CONFIG);
-    (void)IoTHubClientCore_LL_SetMessageCallback(handle, messageCallback, (void*)1);
     umock_c_reset_all_calls();
+    g_batch_confirmation_count = 0;
 
-    ///act
-    IOTHUB_CLIENT_RESULT result = IoTHubClientCore_LL_SetMessageCallback_Ex(handle, messageCallbackEx, (void*)1);
+    STRICT_EXPECTED_CALL(DList_InitializeListHead(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
+    STRICT_EXPECTED_CALL(IoTHubMessage_Clone(TEST_MESSAGE_HANDLE));
+    STRICT_EXPECTED_CALL(IoTHubClient_Diagnostic_AddIfNecessary(IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(IoTHubMessage_GetPriority(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(DList_InsertTailList(IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
+    STRICT_EXPECTED_CALL(IoTHubMessage_Clone(TEST_MESSAGE_HANDLE))
+        .SetReturn(NULL);
+    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(DList_RemoveHeadList(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(IoTHubMessage_Destroy(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(DList_RemoveHeadList(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(gballoc_free(NULL));
 
-    ///assert
+    //act
+    IOTHUB_CLIENT_RESULT result = IoTHubClientCore_LL_SendEventBatchAsync(handle, messages, 2, IOTHUB_CLIENT_BATCH_CONFIRMATION_PER_MESSAGE, test_batch_confirmation_callback, NULL);
+
+    //assert
     ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_ERROR, result);
     ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
 
-    ///cleanup
+    //cleanup
     IoTHubClientCore_LL_Destroy(handle);
+    ASSERT_ARE_EQUAL(size_t, 0, g_batch_confirmation_count);
 }
 
-/*Tests_SRS_IoTHubClientCore_LL_10_024: [If parameter messageCallback is non-NULL then IoTHubClientCore_LL_SetMessageCallback_Ex shall call the underlying layer's _Subscribe function.]*/
-TEST_FUNCTION(IoTHubClientCore_LL_SetMessageCallback_Ex_happy_path_succeeds)
+static void set_queue_limits(IOTHUB_CLIENT_CORE_LL_HANDLE handle, size_t max_messages, size_t max_bytes, IOTHUB_CLIENT_QUEUE_FULL_POLICY policy)
 {
-    ///arrange
-    IOTHUB_CLIENT_CORE_LL_HANDLE handle = IoTHubClientCore_LL_Create(&TEST_CONFIG);
-    umock_c_reset_all_calls();
-
-    STRICT_EXPECTED_CALL(FAKE_IoTHubTransport_Subscribe(IGNORED_PTR_ARG))
-        .IgnoreArgument_handle();
-
-    ///act
-    IOTHUB_CLIENT_RESULT result = IoTHubClientCore_LL_SetMessageCallback_Ex(handle, messageCallbackEx, (void*)1);
-
-    ///assert
-    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
-    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
-
-    ///cleanup
-    IoTHubClientCore_LL_Destroy(handle);
+    (void)IoTHubClientCore_LL_SetOption(handle, OPTION_MAX_QUEUED_MESSAGES, &max_messages);
+    (void)IoTHubClientCore_LL_SetOption(handle, OPTION_MAX_QUEUED_BYTES, &max_bytes);
+    (void)IoTHubClientCore_LL_SetOption(handle, OPTION_QUEUE_FULL_POLICY, &policy);
 }
 
-/*Tests_SRS_IoTHubClientCore_LL_10_026: [IoTHubClientCore_LL_SendMessageDisposition shall fail and return IOTHUB_CLIENT_INVALID_ARG if parameter iotHubClientHandle is NULL.]*/
-TEST_FUNCTION(IoTHubClientCore_LL_SendMessageDisposition_with_first_NULL_fails)
+static void setup_queued_message_size_mocks(size_t* message_size)
 {
-    ///act
-    IOTHUB_CLIENT_RESULT result = IoTHubClientCore_LL_SendMessageDisposition(NULL, NULL, IOTHUBMESSAGE_ACCEPTED);
-
-    ///assert
-    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result);
-    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    STRICT_EXPECTED_CALL(IoTHubMessage_GetContentType(IGNORED_PTR_ARG))
+        .SetReturn(IOTHUBMESSAGE_BYTEARRAY);
+    STRICT_EXPECTED_CALL(IoTHubMessage_GetByteArray(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .CopyOutArgumentBuffer_size(message_size, sizeof(*message_size))
+        .SetReturn(IOTHUB_MESSAGE_OK);
 }
 
-/*Tests_SRS_IoTHubClientCore_LL_10_027: [IoTHubClientCore_LL_SendMessageDisposition shall return the result from calling the underlying layer's _Send_Message_Disposition.]*/
-TEST_FUNCTION(IoTHubClientCore_LL_SendMessageDisposition_with_second_NULL_fails)
+/*Tests_SRS_IOTHUBCLIENT_LL_44_012: [ By default the outgoing queue shall not be bounded, and its high and low watermarks shall be 80% and 50% of the limits. ]*/
+/*Tests_SRS_IOTHUBCLIENT_LL_44_014: [ If queuing the message would exceed OPTION_MAX_QUEUED_MESSAGES or OPTION_MAX_QUEUED_BYTES and the queue full policy is IOTHUB_CLIENT_QUEUE_FULL_REJECT, the message shall not be queued and IOTHUB_CLIENT_QUEUE_FULL shall be returned. ]*/
+TEST_FUNCTION(IoTHubClientCore_LL_SendEventAsync_max_queued_messages_reached_rejects)
 {
-    ///arrange
+    //arrange
+    size_t max_messages = 1;
     IOTHUB_CLIENT_CORE_LL_HANDLE handle = IoTHubClientCore_LL_Create(&TEST_CONFIG);
+    (void)IoTHubClientCore_LL_SetOption(handle, OPTION_MAX_QUEUED_MESSAGES, &max_messages);
+    (void)IoTHubClientCore_LL_SendEventAsync(handle, TEST_MESSAGE_HANDLE, test_event_confirmation_callback, (void*)1);
     umock_c_reset_all_calls();
 
-    ///act
-    IOTHUB_CLIENT_RESULT result = IoTHubClientCore_LL_SendMessageDisposition(NULL, NULL, IOTHUBMESSAGE_ACCEPTED);
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
+    STRICT_EXPECTED_CALL(IoTHubMessage_Clone(TEST_MESSAGE_HANDLE));
+    STRICT_EXPECTED_CALL(IoTHubClient_Diagnostic_AddIfNecessary(IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(IoTHubMessage_GetPriority(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(IoTHubMessage_Destroy(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG));
 
-    ///assert
-    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result);
+    //act
+    IOTHUB_CLIENT_RESULT result = IoTHubClientCore_LL_SendEventAsync(handle, TEST_MESSAGE_HANDLE, test_event_confirmation_callback, (void*)2);
+
+    //assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_QUEUE_FULL, result);
     ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
 
-    ///cleanup
+    //cleanup
     IoTHubClientCore_LL_Destroy(handle);
 }
 
-/*Tests_SRS_IoTHubClientCore_LL_10_027: [IoTHubClientCore_LL_SendMessageDisposition shall return the result from calling the underlying layer's Send_MessageDisposition.]*/
-TEST_FUNCTION(IoTHubClientCore_LL_SendMessageDisposition_Succeeds)
+/*Tests_SRS_IOTHUBCLIENT_LL_44_013: [ Every queued message shall count against OPTION_MAX_QUEUED_MESSAGES, and its payload size against OPTION_MAX_QUEUED_BYTES if that option is set. ]*/
+/*Tests_SRS_IOTHUBCLIENT_LL_44_014: [ If queuing the message would exceed OPTION_MAX_QUEUED_MESSAGES or OPTION_MAX_QUEUED_BYTES and the queue full policy is IOTHUB_CLIENT_QUEUE_FULL_REJECT, the message shall not be queued and IOTHUB_CLIENT_QUEUE_FULL shall be returned. ]*/
+TEST_FUNCTION(IoTHubClientCore_LL_SendEventAsync_max_queued_bytes_exceeded_rejects)
 {
-    ///arrange
+    //arrange
+    size_t message_size = 5;
+    IOTHUB_CLIENT_CORE_LL_HANDLE handle = IoTHubClientCore_LL_Create(&TEST_CONFIG);
+    set_queue_limits(handle, 0, 4, IOTHUB_CLIENT_QUEUE_FULL_REJECT);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
+    STRICT_EXPECTED_CALL(IoTHubMessage_Clone(TEST_MESSAGE_HANDLE));
+    STRICT_EXPECTED_CALL(IoTHubClient_Diagnostic_AddIfNecessary(IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(IoTHubMessage_GetPriority(IGNORED_PTR_ARG));
+    setup_queued_message_size_mocks(&message_size);
+    STRICT_EXPECTED_CALL(IoTHubMessage_Destroy(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG));
+
+    //act
+    IOTHUB_CLIENT_RESULT result = IoTHubClientCore_LL_SendEventAsync(handle, TEST_MESSAGE_HANDLE, test_event_confirmation_callback, (void*)1);
+
+    //assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_QUEUE_FULL, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    //cleanup
+    IoTHubClientCore_LL_Destroy(handle);
+}
+
+/*Tests_SRS_IOTHUBCLIENT_LL_44_015: [ If the queue full policy is IOTHUB_CLIENT_QUEUE_FULL_DROP_OLDEST or IOTHUB_CLIENT_QUEUE_FULL_DROP_LOWEST_PRIORITY, messages shall be removed from waitingToSend until the new message fits, and completed with IOTHUB_CLIENT_CONFIRMATION_MESSAGE_DROPPED once the new message is queued. ]*/
+TEST_FUNCTION(IoTHubClientCore_LL_SendEventAsync_drop_oldest_drops_the_oldest_waiting_message)
+{
+    //arrange
+    IOTHUB_CLIENT_CORE_LL_HANDLE handle = IoTHubClientCore_LL_Create(&TEST_CONFIG);
+    set_queue_limits(handle, 1, 0, IOTHUB_CLIENT_QUEUE_FULL_DROP_OLDEST);
+    (void)IoTHubClientCore_LL_SendEventAsync(handle, TEST_MESSAGE_HANDLE, test_event_confirmation_callback, (void*)1);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
+    STRICT_EXPECTED_CALL(IoTHubMessage_Clone(TEST_MESSAGE_HANDLE));
+    STRICT_EXPECTED_CALL(IoTHubClient_Diagnostic_AddIfNecessary(IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(IoTHubMessage_GetPriority(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(DList_InitializeListHead(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(DList_RemoveEntryList(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(DList_InsertTailList(IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(DList_InsertTailList(IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(DList_RemoveHeadList(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(test_event_confirmation_callback(IOTHUB_CLIENT_CONFIRMATION_MESSAGE_DROPPED, (void*)1));
+    STRICT_EXPECTED_CALL(IoTHubMessage_Destroy(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(DList_RemoveHeadList(IGNORED_PTR_ARG));
+
+    //act
+    IOTHUB_CLIENT_RESULT result = IoTHubClientCore_LL_SendEventAsync(handle, TEST_MESSAGE_HANDLE, test_event_confirmation_callback, (void*)2);
+
+    //assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    //cleanup
+    IoTHubClientCore_LL_Destroy(handle);
+}
+
+/*Tests_SRS_IOTHUBCLIENT_LL_44_016: [ If dropping every message in waitingToSend is not enough, the dropped messages shall be put back in waitingToSend, in their original order, and IOTHUB_CLIENT_QUEUE_FULL shall be returned. ]*/
+TEST_FUNCTION(IoTHubClientCore_LL_SendEventAsync_drop_oldest_without_enough_room_restores_the_queue)
+{
+    //arrange
+    size_t small_message_size = 2;
+    size_t large_message_size = 5;
+    IOTHUB_CLIENT_CORE_LL_HANDLE handle = IoTHubClientCore_LL_Create(&TEST_CONFIG);
+    set_queue_limits(handle, 0, 4, IOTHUB_CLIENT_QUEUE_FULL_DROP_OLDEST);
+    umock_c_reset_all_calls();
+    setup_queued_message_size_mocks(&small_message_size);
+    (void)IoTHubClientCore_LL_SendEventAsync(handle, TEST_MESSAGE_HANDLE, test_event_confirmation_callback, (void*)1);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
+    STRICT_EXPECTED_CALL(IoTHubMessage_Clone(TEST_MESSAGE_HANDLE));
+    STRICT_EXPECTED_CALL(IoTHubClient_Diagnostic_AddIfNecessary(IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(IoTHubMessage_GetPriority(IGNORED_PTR_ARG));
+    setup_queued_message_size_mocks(&large_message_size);
+    STRICT_EXPECTED_CALL(DList_InitializeListHead(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(DList_RemoveEntryList(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(DList_InsertTailList(IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(DList_RemoveEntryList(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(DList_InsertTailList(IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(IoTHubMessage_Destroy(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG));
+
+    //act
+    IOTHUB_CLIENT_RESULT result = IoTHubClientCore_LL_SendEventAsync(handle, TEST_MESSAGE_HANDLE, test_event_confirmation_callback, (void*)2);
+
+    //assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_QUEUE_FULL, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_IS_FALSE(DList_IsListEmpty(g_waitingToSend));
+
+    //cleanup
+    IoTHubClientCore_LL_Destroy(handle);
+}
+
+/*Tests_SRS_IOTHUBCLIENT_LL_44_020: [ IoTHubClientCore_LL_SendEventBatchAsync shall make room for, or reject, the whole batch at once, and return IOTHUB_CLIENT_QUEUE_FULL if it does not fit in the outgoing queue. ]*/
+TEST_FUNCTION(IoTHubClientCore_LL_SendEventBatchAsync_larger_than_max_queued_messages_rejects_the_batch)
+{
+    //arrange
+    IOTHUB_MESSAGE_HANDLE messages[] = { TEST_MESSAGE_HANDLE, TEST_MESSAGE_HANDLE };
+    IOTHUB_CLIENT_CORE_LL_HANDLE handle = IoTHubClientCore_LL_Create(&TEST_CONFIG);
+    set_queue_limits(handle, 1, 0, IOTHUB_CLIENT_QUEUE_FULL_REJECT);
+    umock_c_reset_all_calls();
+    g_batch_confirmation_count = 0;
+
+    STRICT_EXPECTED_CALL(DList_InitializeListHead(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
+    STRICT_EXPECTED_CALL(IoTHubMessage_Clone(TEST_MESSAGE_HANDLE));
+    STRICT_EXPECTED_CALL(IoTHubClient_Diagnostic_AddIfNecessary(IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(IoTHubMessage_GetPriority(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(DList_InsertTailList(IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
+    STRICT_EXPECTED_CALL(IoTHubMessage_Clone(TEST_MESSAGE_HANDLE));
+    STRICT_EXPECTED_CALL(IoTHubClient_Diagnostic_AddIfNecessary(IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(IoTHubMessage_GetPriority(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(DList_InsertTailList(IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(DList_RemoveHeadList(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(IoTHubMessage_Destroy(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(DList_RemoveHeadList(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(IoTHubMessage_Destroy(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(DList_RemoveHeadList(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(gballoc_free(NULL));
+
+    //act
+    IOTHUB_CLIENT_RESULT result = IoTHubClientCore_LL_SendEventBatchAsync(handle, messages, 2, IOTHUB_CLIENT_BATCH_CONFIRMATION_PER_MESSAGE, test_batch_confirmation_callback, NULL);
+
+    //assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_QUEUE_FULL, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    //cleanup
+    IoTHubClientCore_LL_Destroy(handle);
+    ASSERT_ARE_EQUAL(size_t, 0, g_batch_confirmation_count);
+}
+
+/*Tests_SRS_IOTHUBCLIENT_LL_44_017: [ Once a message is completed, for any reason, it shall no longer count against OPTION_MAX_QUEUED_MESSAGES and OPTION_MAX_QUEUED_BYTES. ]*/
+/*Tests_SRS_IOTHUBCLIENT_LL_44_018: [ When the number of queued messages or bytes reaches the high watermark of its limit, the queue state callback shall be invoked once with IOTHUB_CLIENT_QUEUE_STATE_HIGH_WATERMARK. ]*/
+/*Tests_SRS_IOTHUBCLIENT_LL_44_019: [ After that, when both the number of queued messages and bytes drain to the low watermark of their limits, the queue state callback shall be invoked once with IOTHUB_CLIENT_QUEUE_STATE_LOW_WATERMARK. ]*/
+TEST_FUNCTION(IoTHubClientCore_LL_outgoing_queue_reports_high_and_low_watermarks)
+{
+    //arrange
+    DLIST_ENTRY completed;
+    IOTHUB_CLIENT_CORE_LL_HANDLE handle = IoTHubClientCore_LL_Create(&TEST_CONFIG);
+    set_queue_limits(handle, 2, 0, IOTHUB_CLIENT_QUEUE_FULL_REJECT);
+    (void)IoTHubClientCore_LL_SetOutgoingQueueStateCallback(handle, test_queue_state_callback, (void*)5);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
+    STRICT_EXPECTED_CALL(IoTHubMessage_Clone(TEST_MESSAGE_HANDLE));
+    STRICT_EXPECTED_CALL(IoTHubClient_Diagnostic_AddIfNecessary(IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(IoTHubMessage_GetPriority(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(DList_InsertTailList(IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(test_queue_state_callback(IOTHUB_CLIENT_QUEUE_STATE_HIGH_WATERMARK, 1, 0, (void*)5));
+    (void)IoTHubClientCore_LL_SendEventAsync(handle, TEST_MESSAGE_HANDLE, test_event_confirmation_callback, (void*)1);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    /*the transport takes the message out of waitingToSend and completes it*/
+    DList_InitializeListHead(&completed);
+    DList_InsertTailList(&completed, DList_RemoveHeadList(g_waitingToSend));
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(DList_RemoveHeadList(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(test_event_confirmation_callback(IOTHUB_CLIENT_CONFIRMATION_OK, (void*)1));
+    STRICT_EXPECTED_CALL(IoTHubMessage_Destroy(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(DList_RemoveHeadList(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(test_queue_state_callback(IOTHUB_CLIENT_QUEUE_STATE_LOW_WATERMARK, 0, 0, (void*)5));
+
+    //act
+    g_transport_cb_info.send_complete_cb(&completed, IOTHUB_CLIENT_CONFIRMATION_OK, g_transport_cb_ctx);
+
+    //assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    //cleanup
+    IoTHubClientCore_LL_Destroy(handle);
+}
+
+static void* get_waiting_message_context(size_t position)
+{
+    PDLIST_ENTRY entry = g_waitingToSend->Flink;
+    while (position > 0)
+    {
+        entry = entry->Flink;
+        position--;
+    }
+    return containingRecord(entry, IOTHUB_MESSAGE_LIST, entry)->context;
+}
+
+static void queue_message_with_priority(IOTHUB_CLIENT_CORE_LL_HANDLE handle, IOTHUB_MESSAGE_PRIORITY priority, void* context)
+{
+    umock_c_reset_all_calls();
+    STRICT_EXPECTED_CALL(IoTHubMessage_GetPriority(IGNORED_PTR_ARG))
+        .SetReturn(priority);
+    (void)IoTHubClientCore_LL_SendEventAsync(handle, TEST_MESSAGE_HANDLE, test_event_confirmation_callback, context);
+}
+
+/*Tests_SRS_IOTHUBCLIENT_LL_44_026: [ A message shall be queued in waitingToSend ahead of all the messages of lower priority, so that the transports send the highest priority messages first. ]*/
+/*Tests_SRS_IOTHUBCLIENT_LL_44_027: [ Messages of the same priority shall be sent in the order they were queued. ]*/
+TEST_FUNCTION(IoTHubClientCore_LL_SendEventAsync_high_priority_message_is_queued_ahead_of_normal_ones)
+{
+    //arrange
+    IOTHUB_CLIENT_CORE_LL_HANDLE handle = IoTHubClientCore_LL_Create(&TEST_CONFIG);
+    queue_message_with_priority(handle, IOTHUB_MESSAGE_PRIORITY_NORMAL, (void*)1);
+    queue_message_with_priority(handle, IOTHUB_MESSAGE_PRIORITY_HIGH, (void*)2);
+    queue_message_with_priority(handle, IOTHUB_MESSAGE_PRIORITY_NORMAL, (void*)3);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
+    STRICT_EXPECTED_CALL(IoTHubMessage_Clone(TEST_MESSAGE_HANDLE));
+    STRICT_EXPECTED_CALL(IoTHubClient_Diagnostic_AddIfNecessary(IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(IoTHubMessage_GetPriority(IGNORED_PTR_ARG))
+        .SetReturn(IOTHUB_MESSAGE_PRIORITY_HIGH);
+    STRICT_EXPECTED_CALL(DList_InsertTailList(IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+
+    //act
+    IOTHUB_CLIENT_RESULT result = IoTHubClientCore_LL_SendEventAsync(handle, TEST_MESSAGE_HANDLE, test_event_confirmation_callback, (void*)4);
+
+    //assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_ARE_EQUAL(void_ptr, (void*)2, get_waiting_message_context(0));
+    ASSERT_ARE_EQUAL(void_ptr, (void*)4, get_waiting_message_context(1));
+    ASSERT_ARE_EQUAL(void_ptr, (void*)1, get_waiting_message_context(2));
+    ASSERT_ARE_EQUAL(void_ptr, (void*)3, get_waiting_message_context(3));
+
+    //cleanup
+    IoTHubClientCore_LL_Destroy(handle);
+}
+
+/*Tests_SRS_IOTHUBCLIENT_LL_44_028: [ A message that has already been overtaken by MAX_TIMES_OVERTAKEN higher priority messages shall not be overtaken again, and shall be sent as if it had the priority of the message that tried to overtake it. ]*/
+TEST_FUNCTION(IoTHubClientCore_LL_SendEventAsync_low_priority_message_is_not_overtaken_forever)
+{
+    //arrange
+    size_t index;
+    IOTHUB_CLIENT_CORE_LL_HANDLE handle = IoTHubClientCore_LL_Create(&TEST_CONFIG);
+    queue_message_with_priority(handle, IOTHUB_MESSAGE_PRIORITY_LOW, (void*)1);
+
+    //act
+    for (index = 0; index < 17; index++)
+    {
+        queue_message_with_priority(handle, IOTHUB_MESSAGE_PRIORITY_HIGH, (void*)(index + 2));
+    }
+
+    //assert
+    ASSERT_ARE_EQUAL(void_ptr, (void*)17, get_waiting_message_context(15));
+    ASSERT_ARE_EQUAL(void_ptr, (void*)1, get_waiting_message_context(16));
+    ASSERT_ARE_EQUAL(void_ptr, (void*)18, get_waiting_message_context(17));
+
+    //cleanup
+    IoTHubClientCore_LL_Destroy(handle);
+}
+
+/*Tests_SRS_IOTHUBCLIENT_LL_44_030: [ If the queue full policy is IOTHUB_CLIENT_QUEUE_FULL_DROP_LOWEST_PRIORITY, the newest message of the lowest priority shall be dropped first. ]*/
+TEST_FUNCTION(IoTHubClientCore_LL_SendEventAsync_drop_lowest_priority_drops_the_newest_lowest_priority_message)
+{
+    //arrange
+    IOTHUB_CLIENT_CORE_LL_HANDLE handle = IoTHubClientCore_LL_Create(&TEST_CONFIG);
+    set_queue_limits(handle, 3, 0, IOTHUB_CLIENT_QUEUE_FULL_DROP_LOWEST_PRIORITY);
+    queue_message_with_priority(handle, IOTHUB_MESSAGE_PRIORITY_LOW, (void*)1);
+    queue_message_with_priority(handle, IOTHUB_MESSAGE_PRIORITY_LOW, (void*)2);
+    queue_message_with_priority(handle, IOTHUB_MESSAGE_PRIORITY_HIGH, (void*)3);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
+    STRICT_EXPECTED_CALL(IoTHubMessage_Clone(TEST_MESSAGE_HANDLE));
+    STRICT_EXPECTED_CALL(IoTHubClient_Diagnostic_AddIfNecessary(IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(IoTHubMessage_GetPriority(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(DList_InitializeListHead(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(DList_RemoveEntryList(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(DList_InsertTailList(IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(DList_InsertTailList(IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(DList_RemoveHeadList(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(test_event_confirmation_callback(IOTHUB_CLIENT_CONFIRMATION_MESSAGE_DROPPED, (void*)2));
+    STRICT_EXPECTED_CALL(IoTHubMessage_Destroy(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(DList_RemoveHeadList(IGNORED_PTR_ARG));
+
+    //act
+    IOTHUB_CLIENT_RESULT result = IoTHubClientCore_LL_SendEventAsync(handle, TEST_MESSAGE_HANDLE, test_event_confirmation_callback, (void*)4);
+
+    //assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_ARE_EQUAL(void_ptr, (void*)3, get_waiting_message_context(0));
+    ASSERT_ARE_EQUAL(void_ptr, (void*)4, get_waiting_message_context(1));
+    ASSERT_ARE_EQUAL(void_ptr, (void*)1, get_waiting_message_context(2));
+
+    //cleanup
+    IoTHubClientCore_LL_Destroy(handle);
+}
+
+/*Tests_SRS_IOTHUBCLIENT_LL_44_029: [ A message shall never be dropped to make room for a message of lower priority. ]*/
+TEST_FUNCTION(IoTHubClientCore_LL_SendEventAsync_drop_oldest_does_not_drop_higher_priority_messages)
+{
+    //arrange
+    IOTHUB_CLIENT_CORE_LL_HANDLE handle = IoTHubClientCore_LL_Create(&TEST_CONFIG);
+    set_queue_limits(handle, 1, 0, IOTHUB_CLIENT_QUEUE_FULL_DROP_OLDEST);
+    queue_message_with_priority(handle, IOTHUB_MESSAGE_PRIORITY_HIGH, (void*)1);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
+    STRICT_EXPECTED_CALL(IoTHubMessage_Clone(TEST_MESSAGE_HANDLE));
+    STRICT_EXPECTED_CALL(IoTHubClient_Diagnostic_AddIfNecessary(IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(IoTHubMessage_GetPriority(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(DList_InitializeListHead(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(IoTHubMessage_Destroy(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG));
+
+    //act
+    IOTHUB_CLIENT_RESULT result = IoTHubClientCore_LL_SendEventAsync(handle, TEST_MESSAGE_HANDLE, test_event_confirmation_callback, (void*)2);
+
+    //assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_QUEUE_FULL, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_ARE_EQUAL(void_ptr, (void*)1, get_waiting_message_context(0));
+
+    //cleanup
+    IoTHubClientCore_LL_Destroy(handle);
+}
+
+/*Tests_SRS_IOTHUBCLIENT_LL_44_032: [ If appending the batch would break the priority order of waitingToSend, IoTHubClientCore_LL_SendEventBatchAsync shall queue its messages one by one by priority instead. ]*/
+TEST_FUNCTION(IoTHubClientCore_LL_SendEventBatchAsync_out_of_priority_order_batch_is_queued_by_priority)
+{
+    //arrange
+    IOTHUB_MESSAGE_HANDLE messages[] = { TEST_MESSAGE_HANDLE, TEST_MESSAGE_HANDLE };
+    IOTHUB_CLIENT_CORE_LL_HANDLE handle = IoTHubClientCore_LL_Create(&TEST_CONFIG);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(DList_InitializeListHead(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
+    STRICT_EXPECTED_CALL(IoTHubMessage_Clone(TEST_MESSAGE_HANDLE));
+    STRICT_EXPECTED_CALL(IoTHubClient_Diagnostic_AddIfNecessary(IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(IoTHubMessage_GetPriority(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(DList_InsertTailList(IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
+    STRICT_EXPECTED_CALL(IoTHubMessage_Clone(TEST_MESSAGE_HANDLE));
+    STRICT_EXPECTED_CALL(IoTHubClient_Diagnostic_AddIfNecessary(IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(IoTHubMessage_GetPriority(IGNORED_PTR_ARG))
+        .SetReturn(IOTHUB_MESSAGE_PRIORITY_HIGH);
+    STRICT_EXPECTED_CALL(DList_InsertTailList(IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(DList_RemoveHeadList(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(DList_InsertTailList(IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(DList_RemoveHeadList(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(DList_InsertTailList(IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(DList_RemoveHeadList(IGNORED_PTR_ARG));
+
+    //act
+    IOTHUB_CLIENT_RESULT result = IoTHubClientCore_LL_SendEventBatchAsync(handle, messages, 2, IOTHUB_CLIENT_BATCH_CONFIRMATION_PER_MESSAGE, test_event_confirmation_callback, NULL);
+
+    //assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_ARE_EQUAL(int, IOTHUB_MESSAGE_PRIORITY_HIGH, containingRecord(g_waitingToSend->Flink, IOTHUB_MESSAGE_LIST, entry)->priority);
+    ASSERT_ARE_EQUAL(int, IOTHUB_MESSAGE_PRIORITY_NORMAL, containingRecord(g_waitingToSend->Blink, IOTHUB_MESSAGE_LIST, entry)->priority);
+
+    //cleanup
+    IoTHubClientCore_LL_Destroy(handle);
+}
+
+#ifdef USE_MESSAGE_STORE
+static IOTHUB_CLIENT_CORE_LL_HANDLE create_handle_with_message_store(void)
+{
+    IOTHUB_CLIENT_CORE_LL_HANDLE handle = IoTHubClientCore_LL_Create(&TEST_CONFIG);
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, IoTHubClientCore_LL_SetOption(handle, OPTION_MESSAGE_STORE_DIRECTORY, TEST_MESSAGE_STORE_DIRECTORY));
+    umock_c_reset_all_calls();
+    return handle;
+}
+
+/*Tests_SRS_IOTHUBCLIENT_LL_44_034: [ IoTHubClientCore_LL_SetOption shall open the message store kept in the directory given by OPTION_MESSAGE_STORE_DIRECTORY, and fail with IOTHUB_CLIENT_ERROR if it cannot be opened. ]*/
+/*Tests_SRS_IOTHUBCLIENT_LL_44_035: [ The messages left in the message store by a previous run shall be queued in waitingToSend by priority, without confirmation callback and without timeout, even if that exceeds OPTION_MAX_QUEUED_MESSAGES or OPTION_MAX_QUEUED_BYTES. ]*/
+TEST_FUNCTION(IoTHubClientCore_LL_SetOption_message_store_directory_queues_the_stored_messages)
+{
+    //arrange
+    IOTHUB_CLIENT_CORE_LL_HANDLE handle = IoTHubClientCore_LL_Create(&TEST_CONFIG);
+    IOTHUB_MESSAGE_LIST* stored;
+    g_message_store_replay_count = 1;
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(message_store_open(TEST_MESSAGE_STORE_DIRECTORY, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
+    STRICT_EXPECTED_CALL(IoTHubMessage_GetPriority(TEST_STORED_MESSAGE_HANDLE));
+    STRICT_EXPECTED_CALL(DList_InsertTailList(IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+
+    //act
+    IOTHUB_CLIENT_RESULT result = IoTHubClientCore_LL_SetOption(handle, OPTION_MESSAGE_STORE_DIRECTORY, TEST_MESSAGE_STORE_DIRECTORY);
+
+    //assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    stored = containingRecord(g_waitingToSend->Flink, IOTHUB_MESSAGE_LIST, entry);
+    ASSERT_ARE_EQUAL(void_ptr, TEST_STORED_MESSAGE_HANDLE, stored->messageHandle);
+    ASSERT_IS_NULL(stored->callback);
+    ASSERT_ARE_EQUAL(size_t, TEST_STORE_POSITION, stored->store_position);
+
+    //cleanup
+    IoTHubClientCore_LL_Destroy(handle);
+}
+
+/*Tests_SRS_IOTHUBCLIENT_LL_44_034: [ IoTHubClientCore_LL_SetOption shall open the message store kept in the directory given by OPTION_MESSAGE_STORE_DIRECTORY, and fail with IOTHUB_CLIENT_ERROR if it cannot be opened. ]*/
+TEST_FUNCTION(IoTHubClientCore_LL_SetOption_message_store_directory_open_fails)
+{
+    //arrange
+    IOTHUB_CLIENT_CORE_LL_HANDLE handle = IoTHubClientCore_LL_Create(&TEST_CONFIG);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(message_store_open(TEST_MESSAGE_STORE_DIRECTORY, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .SetReturn(NULL);
+
+    //act
+    IOTHUB_CLIENT_RESULT result = IoTHubClientCore_LL_SetOption(handle, OPTION_MESSAGE_STORE_DIRECTORY, TEST_MESSAGE_STORE_DIRECTORY);
+
+    //assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_ERROR, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    //cleanup
+    IoTHubClientCore_LL_Destroy(handle);
+}
+
+/*Tests_SRS_IOTHUBCLIENT_LL_44_033: [ If OPTION_MESSAGE_STORE_DIRECTORY has already been set, IoTHubClientCore_LL_SetOption shall fail and return IOTHUB_CLIENT_ERROR. ]*/
+TEST_FUNCTION(IoTHubClientCore_LL_SetOption_message_store_directory_twice_fails)
+{
+    //arrange
+    IOTHUB_CLIENT_CORE_LL_HANDLE handle = create_handle_with_message_store();
+
+    //act
+    IOTHUB_CLIENT_RESULT result = IoTHubClientCore_LL_SetOption(handle, OPTION_MESSAGE_STORE_DIRECTORY, TEST_MESSAGE_STORE_DIRECTORY);
+
+    //assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_ERROR, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    //cleanup
+    IoTHubClientCore_LL_Destroy(handle);
+}
+
+/*Tests_SRS_IOTHUBCLIENT_LL_44_036: [ Once OPTION_MESSAGE_STORE_DIRECTORY is set, every message shall be appended to the message store before it is queued in waitingToSend. ]*/
+TEST_FUNCTION(IoTHubClientCore_LL_SendEventAsync_appends_the_message_to_the_message_store)
+{
+    //arrange
+    IOTHUB_CLIENT_CORE_LL_HANDLE handle = create_handle_with_message_store();
+
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
+    STRICT_EXPECTED_CALL(IoTHubMessage_Clone(TEST_MESSAGE_HANDLE));
+    STRICT_EXPECTED_CALL(IoTHubClient_Diagnostic_AddIfNecessary(IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(IoTHubMessage_GetPriority(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(message_store_append(TEST_MESSAGE_STORE_HANDLE, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(DList_InsertTailList(IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+
+    //act
+    IOTHUB_CLIENT_RESULT result = IoTHubClientCore_LL_SendEventAsync(handle, TEST_MESSAGE_HANDLE, test_event_confirmation_callback, (void*)1);
+
+    //assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_ARE_EQUAL(size_t, TEST_STORE_POSITION, containingRecord(g_waitingToSend->Flink, IOTHUB_MESSAGE_LIST, entry)->store_position);
+
+    //cleanup
+    IoTHubClientCore_LL_Destroy(handle);
+}
+
+/*Tests_SRS_IOTHUBCLIENT_LL_44_038: [ If a message cannot be appended to the message store, it shall not be queued and IOTHUB_CLIENT_QUEUE_FULL shall be returned. ]*/
+TEST_FUNCTION(IoTHubClientCore_LL_SendEventAsync_message_store_full_rejects)
+{
+    //arrange
+    IOTHUB_CLIENT_CORE_LL_HANDLE handle = create_handle_with_message_store();
+
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
+    STRICT_EXPECTED_CALL(IoTHubMessage_Clone(TEST_MESSAGE_HANDLE));
+    STRICT_EXPECTED_CALL(IoTHubClient_Diagnostic_AddIfNecessary(IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(IoTHubMessage_GetPriority(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(message_store_append(TEST_MESSAGE_STORE_HANDLE, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .SetReturn(MU_FAILURE);
+    STRICT_EXPECTED_CALL(IoTHubMessage_Destroy(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG));
+
+    //act
+    IOTHUB_CLIENT_RESULT result = IoTHubClientCore_LL_SendEventAsync(handle, TEST_MESSAGE_HANDLE, test_event_confirmation_callback, (void*)1);
+
+    //assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_QUEUE_FULL, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_IS_TRUE(g_waitingToSend->Flink == g_waitingToSend);
+
+    //cleanup
+    IoTHubClientCore_LL_Destroy(handle);
+}
+
+/*Tests_SRS_IOTHUBCLIENT_LL_44_037: [ A stored message shall be released from the message store once it is completed, unless it is completed with IOTHUB_CLIENT_CONFIRMATION_BECAUSE_DESTROY, so that it is sent again the next time the message store is opened. ]*/
+TEST_FUNCTION(IoTHubClientCore_LL_SendComplete_releases_the_stored_message)
+{
+    //arrange
+    DLIST_ENTRY completed;
+    IOTHUB_CLIENT_CORE_LL_HANDLE handle = create_handle_with_message_store();
+    (void)IoTHubClientCore_LL_SendEventAsync(handle, TEST_MESSAGE_HANDLE, test_event_confirmation_callback, (void*)1);
+    DList_InitializeListHead(&completed);
+    DList_InsertTailList(&completed, DList_RemoveHeadList(g_waitingToSend));
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(DList_RemoveHeadList(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(message_store_release(TEST_MESSAGE_STORE_HANDLE, TEST_STORE_POSITION));
+    STRICT_EXPECTED_CALL(test_event_confirmation_callback(IOTHUB_CLIENT_CONFIRMATION_OK, (void*)1));
+    STRICT_EXPECTED_CALL(IoTHubMessage_Destroy(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(DList_RemoveHeadList(IGNORED_PTR_ARG));
+
+    //act
+    g_transport_cb_info.send_complete_cb(&completed, IOTHUB_CLIENT_CONFIRMATION_OK, g_transport_cb_ctx);
+
+    //assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    //cleanup
+    IoTHubClientCore_LL_Destroy(handle);
+}
+
+/*Tests_SRS_IOTHUBCLIENT_LL_44_037: [ A stored message shall be released from the message store once it is completed, unless it is completed with IOTHUB_CLIENT_CONFIRMATION_BECAUSE_DESTROY, so that it is sent again the next time the message store is opened. ]*/
+/*Tests_SRS_IOTHUBCLIENT_LL_44_040: [ IoTHubClientCore_LL_Destroy shall close the message store without releasing the messages that were not completed, so they are sent again the next time it is opened. ]*/
+TEST_FUNCTION(IoTHubClientCore_LL_Destroy_keeps_the_stored_messages)
+{
+    //arrange
+    DLIST_ENTRY completed;
+    IOTHUB_CLIENT_CORE_LL_HANDLE handle = create_handle_with_message_store();
+    (void)IoTHubClientCore_LL_SendEventAsync(handle, TEST_MESSAGE_HANDLE, test_event_confirmation_callback, (void*)1);
+    (void)IoTHubClientCore_LL_SendEventAsync(handle, TEST_MESSAGE_HANDLE, test_event_confirmation_callback, (void*)2);
+    DList_InitializeListHead(&completed);
+    DList_InsertTailList(&completed, DList_RemoveHeadList(g_waitingToSend));
+    g_transport_cb_info.send_complete_cb(&completed, IOTHUB_CLIENT_CONFIRMATION_BECAUSE_DESTROY, g_transport_cb_ctx);
+    umock_c_reset_all_calls();
+
+    //act
+    IoTHubClientCore_LL_Destroy(handle);
+
+    //assert
+    ASSERT_ARE_EQUAL(size_t, 0, g_message_store_release_count);
+    ASSERT_IS_TRUE(g_message_store_closed);
+}
+
+/*Tests_SRS_IOTHUBCLIENT_LL_44_039: [ IoTHubClientCore_LL_DoWork shall flush the message store to disk once, for all the messages stored and released since the previous call, before invoking the underlaying layer's _DoWork function. ]*/
+TEST_FUNCTION(IoTHubClientCore_LL_DoWork_commits_the_message_store)
+{
+    //arrange
+    IOTHUB_CLIENT_CORE_LL_HANDLE handle = create_handle_with_message_store();
+
+    STRICT_EXPECTED_CALL(tickcounter_get_current_ms(IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(message_store_commit(TEST_MESSAGE_STORE_HANDLE));
+    STRICT_EXPECTED_CALL(FAKE_IoTHubTransport_DoWork(IGNORED_PTR_ARG));
+
+    //act
+    IoTHubClientCore_LL_DoWork(handle);
+
+    //assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    //cleanup
+    IoTHubClientCore_LL_Destroy(handle);
+}
+#endif /* USE_MESSAGE_STORE */
+
+/*Tests_SRS_IoTHubClientCore_LL_25_111: [IoTHubClientCore_LL_SetConnectionStatusCallback shall return IOTHUB_CLIENT_INVALID_ARG if called with NULL parameter iotHubClientHandle]*/
+TEST_FUNCTION(IoTHubClientCore_LL_SetConnectionStatusCallback_with_NULL_iotHubClientHandle_fails)
+{
+    ///arrange
+
+    ///act
+    IOTHUB_CLIENT_RESULT result = IoTHubClientCore_LL_SetConnectionStatusCallback(NULL, connectionStatusCallback, (void*)1);
+
+    ///assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+/*Tests_SRS_IoTHubClientCore_LL_25_112: [IoTHubClientCore_LL_SetConnectionStatusCallback shall return IOTHUB_CLIENT_OK and save the callback and userContext as a member of the handle.]*/
+TEST_FUNCTION(IoTHubClientCore_LL_SetConnectionStatusCallback_with_non_NULL_succeeds)
+{
+    ///arrange
+
+    IOTHUB_CLIENT_CORE_LL_HANDLE handle = IoTHubClientCore_LL_Create(&TEST_CONFIG);
+    umock_c_reset_all_calls();
+
+    ///act
+    IOTHUB_CLIENT_RESULT result = IoTHubClientCore_LL_SetConnectionStatusCallback(handle, connectionStatusCallback, (void*)1);
+
+    ///assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    ///cleanup
+    IoTHubClientCore_LL_Destroy(handle);
+}
+
+/*Tests_SRS_IOTHUBCLIENT_LL_44_041: [ IoTHubClientCore_LL_GetNextWorkDeadline shall return IOTHUB_CLIENT_INVALID_ARG if iotHubClientHandle or msUntilNextWork is NULL. ]*/
+TEST_FUNCTION(IoTHubClientCore_LL_GetNextWorkDeadline_with_NULL_arguments_fails)
+{
+    ///arrange
+    unsigned int msUntilNextWork;
+    IOTHUB_CLIENT_CORE_LL_HANDLE handle = IoTHubClientCore_LL_Create(&TEST_CONFIG);
+    umock_c_reset_all_calls();
+
+    ///act
+    IOTHUB_CLIENT_RESULT result_without_handle = IoTHubClientCore_LL_GetNextWorkDeadline(NULL, &msUntilNextWork);
+    IOTHUB_CLIENT_RESULT result_without_deadline = IoTHubClientCore_LL_GetNextWorkDeadline(handle, NULL);
+
+    ///assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result_without_handle);
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result_without_deadline);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    ///cleanup
+    IoTHubClientCore_LL_Destroy(handle);
+}
+
+/*Tests_SRS_IOTHUBCLIENT_LL_44_043: [ Otherwise, if no message waits for its confirmation timeout, IoTHubClientCore_LL_GetNextWorkDeadline shall set msUntilNextWork to UINT_MAX. ]*/
+TEST_FUNCTION(IoTHubClientCore_LL_GetNextWorkDeadline_without_pending_work_succeeds)
+{
+    ///arrange
+    unsigned int msUntilNextWork = 0;
+    IOTHUB_CLIENT_CORE_LL_HANDLE handle = IoTHubClientCore_LL_Create(&TEST_CONFIG);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(DList_IsListEmpty(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(DList_IsListEmpty(IGNORED_PTR_ARG));
+
+    ///act
+    IOTHUB_CLIENT_RESULT result = IoTHubClientCore_LL_GetNextWorkDeadline(handle, &msUntilNextWork);
+
+    ///assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
+    ASSERT_ARE_EQUAL(uint32_t, UINT_MAX, msUntilNextWork);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    ///cleanup
+    IoTHubClientCore_LL_Destroy(handle);
+}
+
+/*Tests_SRS_IOTHUBCLIENT_LL_44_042: [ If waitingToSend or the device twin queue are not empty, IoTHubClientCore_LL_GetNextWorkDeadline shall set msUntilNextWork to 0. ]*/
+TEST_FUNCTION(IoTHubClientCore_LL_GetNextWorkDeadline_with_queued_message_succeeds)
+{
+    ///arrange
+    unsigned int msUntilNextWork = UINT_MAX;
+    IOTHUB_CLIENT_CORE_LL_HANDLE handle = IoTHubClientCore_LL_Create(&TEST_CONFIG);
+    (void)IoTHubClientCore_LL_SendEventAsync(handle, TEST_MESSAGE_HANDLE, test_event_confirmation_callback, (void*)1);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(DList_IsListEmpty(IGNORED_PTR_ARG));
+
+    ///act
+    IOTHUB_CLIENT_RESULT result = IoTHubClientCore_LL_GetNextWorkDeadline(handle, &msUntilNextWork);
+
+    ///assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
+    ASSERT_ARE_EQUAL(uint32_t, 0, msUntilNextWork);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    ///cleanup
+    IoTHubClientCore_LL_Destroy(handle);
+}
+
+/*Tests_SRS_IOTHUBCLIENT_LL_44_046: [ Otherwise IoTHubClientCore_LL_GetNextWorkDeadline shall set msUntilNextWork to the time left until the earliest message timeout, 0 if it has already expired. ]*/
+TEST_FUNCTION(IoTHubClientCore_LL_GetNextWorkDeadline_returns_the_time_left_until_the_earliest_message_timeout)
+{
+    ///arrange
+    DLIST_ENTRY taken;
+    unsigned int msUntilNextWork = UINT_MAX;
+    IOTHUB_CLIENT_CORE_LL_HANDLE handle = IoTHubClientCore_LL_Create(&TEST_CONFIG);
+    tickcounter_ms_t five = 5;
+    (void)IoTHubClientCore_LL_SetOption(handle, "messageTimeout", &five);
+
+    tickcounter_ms_t ten = 10;
+    STRICT_EXPECTED_CALL(tickcounter_get_current_ms(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .CopyOutArgumentBuffer(2, &ten, sizeof(ten));
+    (void)IoTHubClientCore_LL_SendEventAsync(handle, TEST_DEVICEMESSAGE_HANDLE, test_event_confirmation_callback, (void*)TEST_DEVICEMESSAGE_HANDLE);
+
+    /*the transport takes the message out of waitingToSend, it times out at 16*/
+    DList_InitializeListHead(&taken);
+    DList_InsertTailList(&taken, DList_RemoveHeadList(g_waitingToSend));
+    umock_c_reset_all_calls();
+
+    tickcounter_ms_t twelve = 12;
+    STRICT_EXPECTED_CALL(DList_IsListEmpty(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(DList_IsListEmpty(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(tickcounter_get_current_ms(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .CopyOutArgumentBuffer(2, &twelve, sizeof(twelve));
+
+    ///act
+    IOTHUB_CLIENT_RESULT result = IoTHubClientCore_LL_GetNextWorkDeadline(handle, &msUntilNextWork);
+
+    ///assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
+    ASSERT_ARE_EQUAL(uint32_t, 4, msUntilNextWork);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    ///cleanup
+    g_transport_cb_info.send_complete_cb(&taken, IOTHUB_CLIENT_CONFIRMATION_OK, g_transport_cb_ctx);
+    IoTHubClientCore_LL_Destroy(handle);
+}
+
+/*Tests_SRS_IOTHUBCLIENT_LL_44_045: [ If getting the current time fails, IoTHubClientCore_LL_GetNextWorkDeadline shall return IOTHUB_CLIENT_ERROR. ]*/
+TEST_FUNCTION(IoTHubClientCore_LL_GetNextWorkDeadline_when_tickcounter_fails_fails)
+{
+    ///arrange
+    DLIST_ENTRY taken;
+    unsigned int msUntilNextWork = UINT_MAX;
+    IOTHUB_CLIENT_CORE_LL_HANDLE handle = IoTHubClientCore_LL_Create(&TEST_CONFIG);
+    tickcounter_ms_t five = 5;
+    (void)IoTHubClientCore_LL_SetOption(handle, "messageTimeout", &five);
+    (void)IoTHubClientCore_LL_SendEventAsync(handle, TEST_DEVICEMESSAGE_HANDLE, test_event_confirmation_callback, (void*)TEST_DEVICEMESSAGE_HANDLE);
+    DList_InitializeListHead(&taken);
+    DList_InsertTailList(&taken, DList_RemoveHeadList(g_waitingToSend));
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(DList_IsListEmpty(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(DList_IsListEmpty(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(tickcounter_get_current_ms(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .SetReturn(MU_FAILURE);
+
+    ///act
+    IOTHUB_CLIENT_RESULT result = IoTHubClientCore_LL_GetNextWorkDeadline(handle, &msUntilNextWork);
+
+    ///assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_ERROR, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    ///cleanup
+    g_transport_cb_info.send_complete_cb(&taken, IOTHUB_CLIENT_CONFIRMATION_OK, g_transport_cb_ctx);
+    IoTHubClientCore_LL_Destroy(handle);
+}
+
+/*Tests_SRS_IOTHUBCLIENT_LL_44_047: [ IoTHubClientCore_LL_GetRttStatistics shall return IOTHUB_CLIENT_INVALID_ARG if iotHubClientHandle or rttStatistics is NULL. ]*/
+TEST_FUNCTION(IoTHubClientCore_LL_GetRttStatistics_with_NULL_arguments_fails)
+{
+    ///arrange
+    IOTHUB_CLIENT_RTT_STATISTICS rttStatistics;
+    IOTHUB_CLIENT_CORE_LL_HANDLE handle = IoTHubClientCore_LL_Create(&TEST_CONFIG);
+    umock_c_reset_all_calls();
+
+    ///act
+    IOTHUB_CLIENT_RESULT result_without_handle = IoTHubClientCore_LL_GetRttStatistics(NULL, &rttStatistics);
+    IOTHUB_CLIENT_RESULT result_without_statistics = IoTHubClientCore_LL_GetRttStatistics(handle, NULL);
+
+    ///assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result_without_handle);
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result_without_statistics);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    ///cleanup
+    IoTHubClientCore_LL_Destroy(handle);
+}
+
+/*Tests_SRS_IOTHUBCLIENT_LL_44_048: [ Otherwise IoTHubClientCore_LL_GetRttStatistics shall call IoTHubTransport_GetRttStatistics and return its result. ]*/
+TEST_FUNCTION(IoTHubClientCore_LL_GetRttStatistics_returns_the_transport_result)
+{
+    ///arrange
+    IOTHUB_CLIENT_RTT_STATISTICS rttStatistics;
+    IOTHUB_CLIENT_CORE_LL_HANDLE handle = IoTHubClientCore_LL_Create(&TEST_CONFIG);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(FAKE_IoTHubTransport_GetRttStatistics(IGNORED_PTR_ARG, &rttStatistics))
+        .SetReturn(IOTHUB_CLIENT_ERROR);
+
+    ///act
+    IOTHUB_CLIENT_RESULT result = IoTHubClientCore_LL_GetRttStatistics(handle, &rttStatistics);
+
+    ///assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_ERROR, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    ///cleanup
+    IoTHubClientCore_LL_Destroy(handle);
+}
+
+/*Tests_SRS_IOTHUBCLIENT_LL_44_049: [ If the transport provider has no IoTHubTransport_GetRttStatistics, IoTHubClientCore_LL_GetRttStatistics shall return IOTHUB_CLIENT_ERROR. ]*/
+TEST_FUNCTION(IoTHubClientCore_LL_GetRttStatistics_without_transport_getter_fails)
+{
+    ///arrange
+    IOTHUB_CLIENT_RTT_STATISTICS rttStatistics;
+    IOTHUB_CLIENT_CORE_LL_HANDLE handle;
+    FAKE_transport_provider.IoTHubTransport_GetRttStatistics = NULL; /*a provider built before the entry existed*/
+    handle = IoTHubClientCore_LL_Create(&TEST_CONFIG);
+    umock_c_reset_all_calls();
+
+    ///act
+    IOTHUB_CLIENT_RESULT result = IoTHubClientCore_LL_GetRttStatistics(handle, &rttStatistics);
+
+    ///assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_ERROR, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    ///cleanup
+    IoTHubClientCore_LL_Destroy(handle);
+    FAKE_transport_provider.IoTHubTransport_GetRttStatistics = FAKE_IoTHubTransport_GetRttStatistics;
+}
+
+/*Tests_SRS_IOTHUBCLIENT_LL_44_024: [ IoTHubClientCore_LL_SetOutgoingQueueStateCallback shall return IOTHUB_CLIENT_INVALID_ARG if iotHubClientHandle is NULL. ]*/
+TEST_FUNCTION(IoTHubClientCore_LL_SetOutgoingQueueStateCallback_with_NULL_iotHubClientHandle_fails)
+{
+    ///act
+    IOTHUB_CLIENT_RESULT result = IoTHubClientCore_LL_SetOutgoingQueueStateCallback(NULL, test_queue_state_callback, (void*)1);
+
+    ///assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result);
+}
+
+/*Tests_SRS_IOTHUBCLIENT_LL_44_025: [ IoTHubClientCore_LL_SetOutgoingQueueStateCallback shall save queueStateCallback and userContextCallback and return IOTHUB_CLIENT_OK. ]*/
+TEST_FUNCTION(IoTHubClientCore_LL_SetOutgoingQueueStateCallback_succeeds)
+{
+    ///arrange
+    IOTHUB_CLIENT_CORE_LL_HANDLE handle = IoTHubClientCore_LL_Create(&TEST_CONFIG);
+    umock_c_reset_all_calls();
+
+    ///act
+    IOTHUB_CLIENT_RESULT result = IoTHubClientCore_LL_SetOutgoingQueueStateCallback(handle, test_queue_state_callback, (void*)1);
+
+    ///assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    ///cleanup
+    IoTHubClientCore_LL_Destroy(handle);
+}
+
+/*Tests_SRS_IOTHUBCLIENT_LL_44_022: [ Calling IoTHubClientCore_LL_SetOption with "queue_full_policy" and a value that is not an IOTHUB_CLIENT_QUEUE_FULL_POLICY shall return IOTHUB_CLIENT_INVALID_ARG. ]*/
+TEST_FUNCTION(IoTHubClientCore_LL_SetOption_queue_full_policy_with_invalid_value_fails)
+{
+    ///arrange
+    IOTHUB_CLIENT_QUEUE_FULL_POLICY policy = (IOTHUB_CLIENT_QUEUE_FULL_POLICY)42;
+    IOTHUB_CLIENT_CORE_LL_HANDLE handle = IoTHubClientCore_LL_Create(&TEST_CONFIG);
+    umock_c_reset_all_calls();
+
+    ///act
+    IOTHUB_CLIENT_RESULT result = IoTHubClientCore_LL_SetOption(handle, OPTION_QUEUE_FULL_POLICY, &policy);
+
+    ///assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    ///cleanup
+    IoTHubClientCore_LL_Destroy(handle);
+}
+
+/*Tests_SRS_IOTHUBCLIENT_LL_44_023: [ Calling IoTHubClientCore_LL_SetOption with a watermark percentage that is out of range, or that would not keep the low watermark below the high watermark, shall return IOTHUB_CLIENT_INVALID_ARG. ]*/
+TEST_FUNCTION(IoTHubClientCore_LL_SetOption_queue_watermarks_out_of_range_fail)
+{
+    ///arrange
+    unsigned int zero = 0;
+    unsigned int above_100 = 101;
+    unsigned int below_default_low = 40;
+    unsigned int above_default_high = 90;
+    IOTHUB_CLIENT_CORE_LL_HANDLE handle = IoTHubClientCore_LL_Create(&TEST_CONFIG);
+    umock_c_reset_all_calls();
+
+    ///act
+    IOTHUB_CLIENT_RESULT result_zero = IoTHubClientCore_LL_SetOption(handle, OPTION_QUEUE_HIGH_WATERMARK_PERCENT, &zero);
+    IOTHUB_CLIENT_RESULT result_above_100 = IoTHubClientCore_LL_SetOption(handle, OPTION_QUEUE_HIGH_WATERMARK_PERCENT, &above_100);
+    IOTHUB_CLIENT_RESULT result_high_below_low = IoTHubClientCore_LL_SetOption(handle, OPTION_QUEUE_HIGH_WATERMARK_PERCENT, &below_default_low);
+    IOTHUB_CLIENT_RESULT result_low_above_high = IoTHubClientCore_LL_SetOption(handle, OPTION_QUEUE_LOW_WATERMARK_PERCENT, &above_default_high);
+
+    ///assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result_zero);
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result_above_100);
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result_high_below_low);
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result_low_above_high);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    ///cleanup
+    IoTHubClientCore_LL_Destroy(handle);
+}
+
+/*Tests_SRS_IoTHubClientCore_LL_02_016: [IoTHubClientCore_LL_SetMessageCallback shall fail and return IOTHUB_CLIENT_INVALID_ARG if parameter iotHubClientHandle is NULL.]*/
+TEST_FUNCTION(IoTHubClientCore_LL_SetMessageCallback_with_NULL_iotHubClientHandle_fails)
+{
+    ///arrange
+
+    ///act
+    IOTHUB_CLIENT_RESULT result = IoTHubClientCore_LL_SetMessageCallback(NULL, messageCallback, (void*)1);
+
+    ///assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+/*Tests_SRS_IoTHubClientCore_LL_02_019: [If parameter messageCallback is NULL then IoTHubClientCore_LL_SetMessageCallback shall call the underlying layer's _Unsubscribe function and return IOTHUB_CLIENT_OK.] */
+TEST_FUNCTION(IoTHubClientCore_LL_SetMessageCallback_with_NULL_calls_Unsubscribe_and_succeeds)
+{
+    ///arrange
+    IOTHUB_CLIENT_CORE_LL_HANDLE handle = IoTHubClientCore_LL_Create(&TEST_CONFIG);
+    (void)IoTHubClientCore_LL_SetMessageCallback(handle, test_message_callback_async, (void*)1);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(FAKE_IoTHubTransport_Unsubscribe(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+
+    ///act
+    IOTHUB_CLIENT_RESULT result = IoTHubClientCore_LL_SetMessageCallback(handle, NULL, (void*)1);
+
+    ///assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    ///cleanup
+    IoTHubClientCore_LL_Destroy(handle);
+}
+
+/*Tests_SRS_IoTHubClientCore_LL_10_010: [If parameter messageCallback is NULL and the _SetMessageCallback had not been called to subscribe for messages, then IoTHubClientCore_LL_SetMessageCallback shall fail and return IOTHUB_CLIENT_ERROR.] */
+TEST_FUNCTION(IoTHubClientCore_LL_SetMessageCallback_with_NULL_after_SetMessageCallbacEx_fails)
+{
+    ///arrange
+    IOTHUB_CLIENT_CORE_LL_HANDLE handle = IoTHubClientCore_LL_Create(&TEST_CONFIG);
+    (void)IoTHubClientCore_LL_SetMessageCallback_Ex(handle, messageCallbackEx, (void*)1);
+    umock_c_reset_all_calls();
+
+    ///act
+    IOTHUB_CLIENT_RESULT result = IoTHubClientCore_LL_SetMessageCallback(handle, NULL, (void*)1);
+
+    ///assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_ERROR, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    ///cleanup
+    IoTHubClientCore_LL_Destroy(handle);
+}
+
+/* Tests_SRS_IoTHubClientCore_LL_10_011: [If parameter messageCallback is non-NULL and the _SetMessageCallback_Ex had been used to susbscribe for messages, then IoTHubClientCore_LL_SetMessageCallback shall fail and return IOTHUB_CLIENT_ERROR.] */
+TEST_FUNCTION(IoTHubClientCore_LL_SetMessageCallback_after_SetMessageCallbacEx_fails)
+{
+    ///arrange
+    IOTHUB_CLIENT_CORE_LL_HANDLE handle = IoTHubClientCore_LL_Create(&TEST_CONFIG);
+    (void)IoTHubClientCore_LL_SetMessageCallback_Ex(handle, messageCallbackEx, (void*)1);
+    umock_c_reset_all_calls();
+
+    ///act
+    IOTHUB_CLIENT_RESULT result = IoTHubClientCore_LL_SetMessageCallback(handle, messageCallback, (void*)1);
+
+    ///assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_ERROR, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    ///cleanup
+    IoTHubClientCore_LL_Destroy(handle);
+}
+
+/*Tests_SRS_IoTHubClientCore_LL_10_021: [IoTHubClientCore_LL_SetMessageCallback_Ex shall fail and return IOTHUB_CLIENT_INVALID_ARG if parameter iotHubClientHandle is NULL.] */
+TEST_FUNCTION(IoTHubClientCore_LL_SetMessageCallback_Ex_with_NULL_iotHubClientHandle_fails)
+{
+    ///arrange
+
+    ///act
+    IOTHUB_CLIENT_RESULT result = IoTHubClientCore_LL_SetMessageCallback_Ex(NULL, messageCallbackEx, (void*)1);
+
+    ///assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+/*Tests_SRS_IoTHubClientCore_LL_10_018: [If parameter messageCallback is NULL and IoTHubClientCore_LL_SetMessageCallback_Ex had not been used to subscribe for messages, then IoTHubClientCore_LL_SetMessageCallback_Ex shall fail and return IOTHUB_CLIENT_ERROR.] */
+TEST_FUNCTION(IoTHubClientCore_LL_SetMessageCallback_Ex_with_NULL_not_subscribed_fails)
+{
+    ///arrange
+    IOTHUB_CLIENT_CORE_LL_HANDLE handle = IoTHubClientCore_LL_Create(&TEST_CONFIG);
+    umock_c_reset_all_calls();
+
+    ///act
+    IOTHUB_CLIENT_RESULT result = IoTHubClientCore_LL_SetMessageCallback_Ex(handle, NULL, (void*)1);
+
+    ///assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_ERROR, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    ///cleanup
+    IoTHubClientCore_LL_Destroy(handle);
+}
+
+/*Tests_SRS_IoTHubClientCore_LL_10_019: [If parameter messageCallback is NULL and IoTHubClientCore_LL_SetMessageCallback had been used to subscribe for messages, then IoTHubClientCore_LL_SetMessageCallback_Ex shall fail and return IOTHUB_CLIENT_ERROR.] */
+TEST_FUNCTION(IoTHubClientCore_LL_SetMessageCallback_Ex_with_NULL_after_SetMessageCallback_fails)
+{
+    ///arrange
+    IOTHUB_CLIENT_CORE_LL_HANDLE handle = IoTHubClientCore_LL_Create(&TEST_CONFIG);
+    (void)IoTHubClientCore_LL_SetMessageCallback(handle, messageCallback, (void*)1);
+    umock_c_reset_all_calls();
+
+    ///act
+    IOTHUB_CLIENT_RESULT result = IoTHubClientCore_LL_SetMessageCallback_Ex(handle, NULL, (void*)1);
+
+    ///assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_ERROR, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    ///cleanup
+    IoTHubClientCore_LL_Destroy(handle);
+}
+
+/*Tests_SRS_IoTHubClientCore_LL_10_023: [If parameter messageCallback is NULL then IoTHubClientCore_LL_SetMessageCallback_Ex shall call the underlying layer's _Unsubscribe function and return IOTHUB_CLIENT_OK.] */
+TEST_FUNCTION(IoTHubClientCore_LL_SetMessageCallback_Ex_with_NULL_unsubscribe_succeeds)
+{
+    ///arrange
+    IOTHUB_CLIENT_CORE_LL_HANDLE handle = IoTHubClientCore_LL_Create(&TEST_CONFIG);
+    (void)IoTHubClientCore_LL_SetMessageCallback_Ex(handle, messageCallbackEx, (void*)1);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(FAKE_IoTHubTransport_Unsubscribe(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+
+    ///act
+    IOTHUB_CLIENT_RESULT result = IoTHubClientCore_LL_SetMessageCallback_Ex(handle, NULL, (void*)1);
+
+    ///assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    ///cleanup
+    IoTHubClientCore_LL_Destroy(handle);
+}
+
+/*Tests_SRS_IoTHubClientCore_LL_10_025: [If the underlying layer's _Subscribe function fails, then IoTHubClientCore_LL_SetMessageCallback_Ex shall fail and return IOTHUB_CLIENT_ERROR. Otherwise IoTHubClientCore_LL_SetMessageCallback shall succeed and return IOTHUB_CLIENT_OK.] */
+TEST_FUNCTION(IoTHubClientCore_LL_SetMessageCallback_Ex_Subscribe_fails)
+{
+    ///arrange
+    IOTHUB_CLIENT_CORE_LL_HANDLE handle = IoTHubClientCore_LL_Create(&TEST_CONFIG);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(FAKE_IoTHubTransport_Subscribe(IGNORED_PTR_ARG))
+        .IgnoreArgument_handle()
+        .SetReturn(__LINE__);
+
+    ///act
+    IOTHUB_CLIENT_RESULT result = IoTHubClientCore_LL_SetMessageCallback_Ex(handle, messageCallbackEx, (void*)1);
+
+    ///assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_ERROR, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    ///cleanup
+    IoTHubClientCore_LL_Destroy(handle);
+}
+
+/*Tests_SRS_IoTHubClientCore_LL_10_020: [If parameter messageCallback is non-NULL, and IoTHubClientCore_LL_SetMessageCallback had been used to subscribe for messages, then IoTHubClientCore_LL_SetMessageCallback_Ex shall fail and return IOTHUB_CLIENT_ERROR.] */
+TEST_FUNCTION(IoTHubClientCore_LL_SetMessageCallback_Ex_after_SetMessageCallback_fails)
+{
+    ///arrange
+    IOTHUB_CLIENT_CORE_LL_HANDLE handle = IoTHubClientCore_LL_Create(&TEST_CONFIG);
+    (void)IoTHubClientCore_LL_SetMessageCallback(handle, messageCallback, (void*)1);
+    umock_c_reset_all_calls();
+
+    ///act
+    IOTHUB_CLIENT_RESULT result = IoTHubClientCore_LL_SetMessageCallback_Ex(handle, messageCallbackEx, (void*)1);
+
+    ///assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_ERROR, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    ///cleanup
+    IoTHubClientCore_LL_Destroy(handle);
+}
+
+/*Tests_SRS_IoTHubClientCore_LL_10_024: [If parameter messageCallback is non-NULL then IoTHubClientCore_LL_SetMessageCallback_Ex shall call the underlying layer's _Subscribe function.]*/
+TEST_FUNCTION(IoTHubClientCore_LL_SetMessageCallback_Ex_happy_path_succeeds)
+{
+    ///arrange
+    IOTHUB_CLIENT_CORE_LL_HANDLE handle = IoTHubClientCore_LL_Create(&TEST_CONFIG);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(FAKE_IoTHubTransport_Subscribe(IGNORED_PTR_ARG))
+        .IgnoreArgument_handle();
+
+    ///act
+    IOTHUB_CLIENT_RESULT result = IoTHubClientCore_LL_SetMessageCallback_Ex(handle, messageCallbackEx, (void*)1);
+
+    ///assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    ///cleanup
+    IoTHubClientCore_LL_Destroy(handle);
+}
+
+/*Tests_SRS_IoTHubClientCore_LL_10_026: [IoTHubClientCore_LL_SendMessageDisposition shall fail and return IOTHUB_CLIENT_INVALID_ARG if parameter iotHubClientHandle is NULL.]*/
+TEST_FUNCTION(IoTHubClientCore_LL_SendMessageDisposition_with_first_NULL_fails)
+{
+    ///act
+    IOTHUB_CLIENT_RESULT result = IoTHubClientCore_LL_SendMessageDisposition(NULL, NULL, IOTHUBMESSAGE_ACCEPTED);
+
+    ///assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+/*Tests_SRS_IoTHubClientCore_LL_10_027: [IoTHubClientCore_LL_SendMessageDisposition shall return the result from calling the underlying layer's _Send_Message_Disposition.]*/
+TEST_FUNCTION(IoTHubClientCore_LL_SendMessageDisposition_with_second_NULL_fails)
+{
+    ///arrange
+    IOTHUB_CLIENT_CORE_LL_HANDLE handle = IoTHubClientCore_LL_Create(&TEST_CONFIG);
+    umock_c_reset_all_calls();
+
+    ///act
+    IOTHUB_CLIENT_RESULT result = IoTHubClientCore_LL_SendMessageDisposition(NULL, NULL, IOTHUBMESSAGE_ACCEPTED);
+
+    ///assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    ///cleanup
+    IoTHubClientCore_LL_Destroy(handle);
+}
+
+/*Tests_SRS_IoTHubClientCore_LL_10_027: [IoTHubClientCore_LL_SendMessageDisposition shall return the result from calling the underlying layer's Send_MessageDisposition.]*/
+TEST_FUNCTION(IoTHubClientCore_LL_SendMessageDisposition_Succeeds)
+{
+    ///arrange
     IOTHUB_CLIENT_CORE_LL_HANDLE handle = IoTHubClientCore_LL_Create(&TEST_CONFIG);
     MESSAGE_CALLBACK_INFO* testMessage = make_test_message_info(TEST_MESSAGE_HANDLE);
     umock_c_reset_all_calls();
@@ -2638,7 +3872,7 @@ TEST_FUNCTION(IoTHubClientCore_LL_SendComplete_with_1_items_with_callback_succee
     IOTHUB_CLIENT_CORE_LL_HANDLE handle = IoTHubClientCore_LL_Create(&TEST_CONFIG);
     DLIST_ENTRY temp;
     DList_InitializeListHead(&temp);
-    IOTHUB_MESSAGE_LIST* one = (IOTHUB_MESSAGE_LIST*)malloc(sizeof(IOTHUB_MESSAGE_LIST)); /*this is SendEvent wannabe*/
+    IOTHUB_MESSAGE_LIST* one = (IOTHUB_MESSAGE_LIST*)calloc(1, sizeof(IOTHUB_MESSAGE_LIST)); /*this is SendEvent wannabe*/
     one->messageHandle = (IOTHUB_MESSAGE_HANDLE)1;
     one->callback = eventConfirmationCallback;
     one->context = (void*)1;
@@ -2673,19 +3907,19 @@ TEST_FUNCTION(IoTHubClientCore_LL_SendComplete_with_3_items_with_callback_succee
     DLIST_ENTRY temp;
     DList_InitializeListHead(&temp);
 
-    IOTHUB_MESSAGE_LIST* one = (IOTHUB_MESSAGE_LIST*)malloc(sizeof(IOTHUB_MESSAGE_LIST)); /*this is SendEvent wannabe*/
+    IOTHUB_MESSAGE_LIST* one = (IOTHUB_MESSAGE_LIST*)calloc(1, sizeof(IOTHUB_MESSAGE_LIST)); /*this is SendEvent wannabe*/
     one->messageHandle = (IOTHUB_MESSAGE_HANDLE)1;
     one->callback = eventConfirmationCallback;
     one->context = (void*)1;
     DList_InsertTailList(&temp, &(one->entry));
 
-    IOTHUB_MESSAGE_LIST* two = (IOTHUB_MESSAGE_LIST*)malloc(sizeof(IOTHUB_MESSAGE_LIST)); /*this is SendEvent wannabe*/
+    IOTHUB_MESSAGE_LIST* two = (IOTHUB_MESSAGE_LIST*)calloc(1, sizeof(IOTHUB_MESSAGE_LIST)); /*this is SendEvent wannabe*/
     two->messageHandle = (IOTHUB_MESSAGE_HANDLE)2;
     two->callback = eventConfirmationCallback;
     two->context = (void*)2;
     DList_InsertTailList(&temp, &(two->entry));
 
-    IOTHUB_MESSAGE_LIST* three = (IOTHUB_MESSAGE_LIST*)malloc(sizeof(IOTHUB_MESSAGE_LIST)); /*this is SendEvent wannabe*/
+    IOTHUB_MESSAGE_LIST* three = (IOTHUB_MESSAGE_LIST*)calloc(1, sizeof(IOTHUB_MESSAGE_LIST)); /*this is SendEvent wannabe*/
     three->messageHandle = (IOTHUB_MESSAGE_HANDLE)3;
     three->callback = eventConfirmationCallback;
     three->context = (void*)3;
@@ -2733,19 +3967,19 @@ TEST_FUNCTION(IoTHubClientCore_LL_SendComplete_with_3_items_with_callback_but_ba
     DLIST_ENTRY temp;
     DList_InitializeListHead(&temp);
 
-    IOTHUB_MESSAGE_LIST* one = (IOTHUB_MESSAGE_LIST*)malloc(sizeof(IOTHUB_MESSAGE_LIST)); /*this is SendEvent wannabe*/
+    IOTHUB_MESSAGE_LIST* one = (IOTHUB_MESSAGE_LIST*)calloc(1, sizeof(IOTHUB_MESSAGE_LIST)); /*this is SendEvent wannabe*/
     one->messageHandle = (IOTHUB_MESSAGE_HANDLE)1;
     one->callback = eventConfirmationCallback;
     one->context = (void*)1;
     DList_InsertTailList(&temp, &(one->entry));
 
-    IOTHUB_MESSAGE_LIST* two = (IOTHUB_MESSAGE_LIST*)malloc(sizeof(IOTHUB_MESSAGE_LIST)); /*this is SendEvent wannabe*/
+    IOTHUB_MESSAGE_LIST* two = (IOTHUB_MESSAGE_LIST*)calloc(1, sizeof(IOTHUB_MESSAGE_LIST)); /*this is SendEvent wannabe*/
     two->messageHandle = (IOTHUB_MESSAGE_HANDLE)2;
     two->callback = eventConfirmationCallback;
     two->context = (void*)2;
     DList_InsertTailList(&temp, &(two->entry));
 
-    IOTHUB_MESSAGE_LIST* three = (IOTHUB_MESSAGE_LIST*)malloc(sizeof(IOTHUB_MESSAGE_LIST)); /*this is SendEvent wannabe*/
+    IOTHUB_MESSAGE_LIST* three = (IOTHUB_MESSAGE_LIST*)calloc(1, sizeof(IOTHUB_MESSAGE_LIST)); /*this is SendEvent wannabe*/
     three->messageHandle = (IOTHUB_MESSAGE_HANDLE)3;
     three->callback = eventConfirmationCallback;
     three->context = (void*)3;
@@ -3062,19 +4296,19 @@ TEST_FUNCTION(IoTHubClientCore_LL_SendComplete_with_3_items_one_without_callback
     DLIST_ENTRY temp;
     DList_InitializeListHead(&temp);
 
-    IOTHUB_MESSAGE_LIST* one = (IOTHUB_MESSAGE_LIST*)malloc(sizeof(IOTHUB_MESSAGE_LIST)); /*this is SendEvent wannabe*/
+    IOTHUB_MESSAGE_LIST* one = (IOTHUB_MESSAGE_LIST*)calloc(1, sizeof(IOTHUB_MESSAGE_LIST)); /*this is SendEvent wannabe*/
     one->messageHandle = (IOTHUB_MESSAGE_HANDLE)1;
     one->callback = test_event_confirmation_callback;
     one->context = (void*)1;
     DList_InsertTailList(&temp, &(one->entry));
 
-    IOTHUB_MESSAGE_LIST* two = (IOTHUB_MESSAGE_LIST*)malloc(sizeof(IOTHUB_MESSAGE_LIST)); /*this is SendEvent wannabe*/
+    IOTHUB_MESSAGE_LIST* two = (IOTHUB_MESSAGE_LIST*)calloc(1, sizeof(IOTHUB_MESSAGE_LIST)); /*this is SendEvent wannabe*/
     two->messageHandle = (IOTHUB_MESSAGE_HANDLE)2;
     two->callback = NULL;
     two->context = NULL;
     DList_InsertTailList(&temp, &(two->entry));
 
-    IOTHUB_MESSAGE_LIST* three = (IOTHUB_MESSAGE_LIST*)malloc(sizeof(IOTHUB_MESSAGE_LIST)); /*this is SendEvent wannabe*/
+    IOTHUB_MESSAGE_LIST* three = (IOTHUB_MESSAGE_LIST*)calloc(1, sizeof(IOTHUB_MESSAGE_LIST)); /*this is SendEvent wannabe*/
     three->messageHandle = (IOTHUB_MESSAGE_HANDLE)3;
     three->callback = test_event_confirmation_callback;
     three->context = (void*)3;
@@ -3120,19 +4354,19 @@ TEST_FUNCTION(IoTHubClientCore_LL_SendComplete_with_3_items_one_with_callback_bu
     DLIST_ENTRY temp;
     DList_InitializeListHead(&temp);
 
-    IOTHUB_MESSAGE_LIST* one = (IOTHUB_MESSAGE_LIST*)malloc(sizeof(IOTHUB_MESSAGE_LIST)); /*this is SendEvent wannabe*/
+    IOTHUB_MESSAGE_LIST* one = (IOTHUB_MESSAGE_LIST*)calloc(1, sizeof(IOTHUB_MESSAGE_LIST)); /*this is SendEvent wannabe*/
     one->messageHandle = (IOTHUB_MESSAGE_HANDLE)1;
     one->callback = NULL;
     one->context = NULL;
     DList_InsertTailList(&temp, &(one->entry));
 
-    IOTHUB_MESSAGE_LIST* two = (IOTHUB_MESSAGE_LIST*)malloc(sizeof(IOTHUB_MESSAGE_LIST)); /*this is SendEvent wannabe*/
+    IOTHUB_MESSAGE_LIST* two = (IOTHUB_MESSAGE_LIST*)calloc(1, sizeof(IOTHUB_MESSAGE_LIST)); /*this is SendEvent wannabe*/
     two->messageHandle = (IOTHUB_MESSAGE_HANDLE)2;
     two->callback = NULL;
     two->context = NULL;
     DList_InsertTailList(&temp, &(two->entry));
 
-    IOTHUB_MESSAGE_LIST* three = (IOTHUB_MESSAGE_LIST*)malloc(sizeof(IOTHUB_MESSAGE_LIST)); /*this is SendEvent wannabe*/
+    IOTHUB_MESSAGE_LIST* three = (IOTHUB_MESSAGE_LIST*)calloc(1, sizeof(IOTHUB_MESSAGE_LIST)); /*this is SendEvent wannabe*/
     three->messageHandle = (IOTHUB_MESSAGE_HANDLE)3;
     three->callback = test_event_confirmation_callback;
     three->context = (void*)3;
@@ -4181,6 +5415,99 @@ TEST_FUNCTION(IoTHubClientCore_LL_SetOption_2_messages_one_with_timeout_one_with
     IoTHubClientCore_LL_Destroy(handle);
 }
 
+/*Tests_SRS_IOTHUBCLIENT_LL_44_010: [ DoTimeouts shall only visit the messages whose timeout has expired, in the order of their deadlines. ]*/
+TEST_FUNCTION(IoTHubClientCore_LL_SetOption_3_messages_queued_at_10_20_24_with_timeout_5_calls_2_timeouts_at_26)
+{
+    //arrange
+    IOTHUB_CLIENT_CORE_LL_HANDLE handle = IoTHubClientCore_LL_Create(&TEST_CONFIG);
+    tickcounter_ms_t five = 5;
+    (void)IoTHubClientCore_LL_SetOption(handle, "messageTimeout", &five);
+
+    tickcounter_ms_t ten = 10;
+    STRICT_EXPECTED_CALL(tickcounter_get_current_ms(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .CopyOutArgumentBuffer(2, &ten, sizeof(ten));
+    (void)IoTHubClientCore_LL_SendEventAsync(handle, TEST_DEVICEMESSAGE_HANDLE, test_event_confirmation_callback, (void*)TEST_DEVICEMESSAGE_HANDLE);
+
+    tickcounter_ms_t twenty = 20;
+    STRICT_EXPECTED_CALL(tickcounter_get_current_ms(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .CopyOutArgumentBuffer(2, &twenty, sizeof(twenty));
+    (void)IoTHubClientCore_LL_SendEventAsync(handle, TEST_DEVICEMESSAGE_HANDLE, test_event_confirmation_callback, (void*)TEST_DEVICEMESSAGE_HANDLE_2);
+
+    tickcounter_ms_t twentyFour = 24;
+    STRICT_EXPECTED_CALL(tickcounter_get_current_ms(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .CopyOutArgumentBuffer(2, &twentyFour, sizeof(twentyFour));
+    (void)IoTHubClientCore_LL_SendEventAsync(handle, TEST_DEVICEMESSAGE_HANDLE, test_event_confirmation_callback, (void*)TEST_DEVICEMESSAGE_HANDLE);
+    umock_c_reset_all_calls();
+
+    tickcounter_ms_t twentySix = 26; /*26 > 10 + 5 and 26 > 20 + 5 => 2 timeouts, 26 <= 24 + 5 => the third message stays*/
+    STRICT_EXPECTED_CALL(tickcounter_get_current_ms(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .CopyOutArgumentBuffer(2, &twentySix, sizeof(twentySix));
+
+    STRICT_EXPECTED_CALL(DList_RemoveEntryList(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(test_event_confirmation_callback(IOTHUB_CLIENT_CONFIRMATION_MESSAGE_TIMEOUT, (void*)TEST_DEVICEMESSAGE_HANDLE));
+    STRICT_EXPECTED_CALL(IoTHubMessage_Destroy(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG));
+
+    STRICT_EXPECTED_CALL(DList_RemoveEntryList(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(test_event_confirmation_callback(IOTHUB_CLIENT_CONFIRMATION_MESSAGE_TIMEOUT, (void*)TEST_DEVICEMESSAGE_HANDLE_2));
+    STRICT_EXPECTED_CALL(IoTHubMessage_Destroy(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG));
+
+    EXPECTED_CALL(FAKE_IoTHubTransport_DoWork(IGNORED_PTR_ARG));
+
+    //act
+    IoTHubClientCore_LL_DoWork(handle);
+
+    ///assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    ///cleanup
+    IoTHubClientCore_LL_Destroy(handle);
+}
+
+/*Tests_SRS_IOTHUBCLIENT_LL_44_011: [ A message that has already been taken out of waitingToSend by the transport shall not be timed out by DoTimeouts. ]*/
+TEST_FUNCTION(IoTHubClientCore_LL_DoWork_does_not_time_out_a_message_taken_by_the_transport)
+{
+    //arrange
+    DLIST_ENTRY taken;
+    IOTHUB_CLIENT_CORE_LL_HANDLE handle = IoTHubClientCore_LL_Create(&TEST_CONFIG);
+    tickcounter_ms_t five = 5;
+    (void)IoTHubClientCore_LL_SetOption(handle, "messageTimeout", &five);
+
+    tickcounter_ms_t ten = 10;
+    STRICT_EXPECTED_CALL(tickcounter_get_current_ms(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .CopyOutArgumentBuffer(2, &ten, sizeof(ten));
+    (void)IoTHubClientCore_LL_SendEventAsync(handle, TEST_DEVICEMESSAGE_HANDLE, test_event_confirmation_callback, (void*)TEST_DEVICEMESSAGE_HANDLE);
+    STRICT_EXPECTED_CALL(tickcounter_get_current_ms(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .CopyOutArgumentBuffer(2, &ten, sizeof(ten));
+    (void)IoTHubClientCore_LL_SendEventAsync(handle, TEST_DEVICEMESSAGE_HANDLE, test_event_confirmation_callback, (void*)TEST_DEVICEMESSAGE_HANDLE_2);
+
+    /*the transport takes the first message out of waitingToSend*/
+    DList_InitializeListHead(&taken);
+    DList_InsertTailList(&taken, DList_RemoveHeadList(g_waitingToSend));
+    umock_c_reset_all_calls();
+
+    tickcounter_ms_t sixteen = 16;
+    STRICT_EXPECTED_CALL(tickcounter_get_current_ms(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .CopyOutArgumentBuffer(2, &sixteen, sizeof(sixteen));
+    STRICT_EXPECTED_CALL(DList_RemoveEntryList(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(test_event_confirmation_callback(IOTHUB_CLIENT_CONFIRMATION_MESSAGE_TIMEOUT, (void*)TEST_DEVICEMESSAGE_HANDLE_2));
+    STRICT_EXPECTED_CALL(IoTHubMessage_Destroy(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG));
+    EXPECTED_CALL(FAKE_IoTHubTransport_DoWork(IGNORED_PTR_ARG));
+
+    //act
+    IoTHubClientCore_LL_DoWork(handle);
+
+    ///assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_IS_TRUE(DList_IsListEmpty(g_waitingToSend));
+
+    ///cleanup
+    g_transport_cb_info.send_complete_cb(&taken, IOTHUB_CLIENT_CONFIRMATION_OK, g_transport_cb_ctx);
+    IoTHubClientCore_LL_Destroy(handle);
+}
+
 /*Tests_SRS_IoTHubClientCore_LL_02_041: [ If more than value miliseconds have passed since the call to IoTHubClientCore_LL_SendEventAsync then the message callback shall be called with a status code of IOTHUB_CLIENT_CONFIRMATION_TIMEOUT. ]*/
 TEST_FUNCTION(IoTHubClientCore_LL_SetOption_messageTimeout_when_tickcounter_fails_in_do_work_no_timeout_callbacks_are_called) /*test wants to see that message that did not timeout yet do not have their callbacks called*/
 {
@@ -5790,7 +7117,7 @@ TEST_FUNCTION(IoTHubClientCore_LL_SendEventToOutputAsync_fails)
     umock_c_negative_tests_snapshot();
 
     // act
-    size_t calls_cannot_fail[] = { 5 /*DList_InsertTailList*/ };
+    size_t calls_cannot_fail[] = { 5 /*IoTHubMessage_GetPriority*/, 6 /*DList_InsertTailList*/ };
     size_t count = umock_c_negative_tests_call_count();
     for (size_t index = 0; index < count; index++)
     {
@@ -100,6 +100,8 @@ TEST_SUITE_INITIALIZE(suite_init)
     REGISTER_UMOCK_ALIAS_TYPE(IOTHUB_CLIENT_FILE_UPLOAD_CALLBACK, void*);
     REGISTER_UMOCK_ALIAS_TYPE(IOTHUB_CLIENT_FILE_UPLOAD_GET_DATA_CALLBACK, void*);
     REGISTER_UMOCK_ALIAS_TYPE(IOTHUB_CLIENT_FILE_UPLOAD_GET_DATA_CALLBACK_EX, void*);
+    REGISTER_UMOCK_ALIAS_TYPE(IOTHUB_CLIENT_UPLOAD_JOB_ID, uint32_t);
+    REGISTER_UMOCK_ALIAS_TYPE(IOTHUB_CLIENT_UPLOAD_JOB_ID*, void*);
 
     REGISTER_GLOBAL_MOCK_RETURN(IoTHubClientCore_CreateFromConnectionString, TEST_IOTHUB_CLIENT_CORE_HANDLE);
     REGISTER_GLOBAL_MOCK_RETURN(IoTHubClientCore_Create, TEST_IOTHUB_CLIENT_CORE_HANDLE);
@@ -112,6 +114,7 @@ TEST_SUITE_INITIALIZE(suite_init)
     REGISTER_GLOBAL_MOCK_RETURN(IoTHubClientCore_SetRetryPolicy, IOTHUB_CLIENT_OK);
     REGISTER_GLOBAL_MOCK_RETURN(IoTHubClientCore_GetRetryPolicy, IOTHUB_CLIENT_OK);
     REGISTER_GLOBAL_MOCK_RETURN(IoTHubClientCore_GetLastMessageReceiveTime, IOTHUB_CLIENT_OK);
+    REGISTER_GLOBAL_MOCK_RETURN(IoTHubClientCore_GetRttStatistics, IOTHUB_CLIENT_OK);
     REGISTER_GLOBAL_MOCK_RETURN(IoTHubClientCore_SetOption, IOTHUB_CLIENT_OK);
     REGISTER_GLOBAL_MOCK_RETURN(IoTHubClientCore_SetDeviceTwinCallback, IOTHUB_CLIENT_OK);
     REGISTER_GLOBAL_MOCK_RETURN(IoTHubClientCore_SendReportedState, IOTHUB_CLIENT_OK);
@@ -121,6 +124,9 @@ TEST_SUITE_INITIALIZE(suite_init)
 #ifndef DONT_USE_UPLOADTOBLOB
     REGISTER_GLOBAL_MOCK_RETURN(IoTHubClientCore_UploadToBlobAsync, IOTHUB_CLIENT_OK);
     REGISTER_GLOBAL_MOCK_RETURN(IoTHubClientCore_UploadMultipleBlocksToBlobAsync, IOTHUB_CLIENT_OK);
+    REGISTER_GLOBAL_MOCK_RETURN(IoTHubClientCore_QueueUploadToBlobAsync, IOTHUB_CLIENT_OK);
+    REGISTER_GLOBAL_MOCK_RETURN(IoTHubClientCore_QueueUploadMultipleBlocksToBlobAsync, IOTHUB_CLIENT_OK);
+    REGISTER_GLOBAL_MOCK_RETURN(IoTHubClientCore_CancelUploadToBlobAsync, IOTHUB_CLIENT_OK);
 #endif
 }
 
@@ -289,6 +295,20 @@ TEST_FUNCTION(IoTHubDeviceClient_GetLastMessageReceiveTime_Test)
     ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
 }
 
+TEST_FUNCTION(IoTHubDeviceClient_GetRttStatistics_Test)
+{
+    //arrange
+    IOTHUB_CLIENT_RTT_STATISTICS rtt_statistics;
+    STRICT_EXPECTED_CALL(IoTHubClientCore_GetRttStatistics(TEST_IOTHUB_CLIENT_CORE_HANDLE, &rtt_statistics));
+
+    //act
+    IOTHUB_CLIENT_RESULT result = IoTHubDeviceClient_GetRttStatistics(TEST_IOTHUB_DEVICE_CLIENT_HANDLE, &rtt_statistics);
+
+    //assert
+    ASSERT_IS_TRUE(result == IOTHUB_CLIENT_OK);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
 TEST_FUNCTION(IoTHubDeviceClient_SetOption_Test)
 {
     //arrange
@@ -395,6 +415,47 @@ TEST_FUNCTION(IoTHubDeviceClient_UploadMultipleBlocksToBlobAsync_Test)
     ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
 }
 
+TEST_FUNCTION(IoTHubDeviceClient_QueueUploadToBlobAsync_Test)
+{
+    //arrange
+    IOTHUB_CLIENT_UPLOAD_JOB_ID upload_job_id;
+    STRICT_EXPECTED_CALL(IoTHubClientCore_QueueUploadToBlobAsync(TEST_IOTHUB_CLIENT_CORE_HANDLE, TEST_CHAR_PTR, TEST_UNSIGNED_CHAR, TEST_SIZE_T, TEST_FILE_UPLOAD_CALLBACK, NULL, &upload_job_id));
+
+    //act
+    IOTHUB_CLIENT_RESULT result = IoTHubDeviceClient_QueueUploadToBlobAsync(TEST_IOTHUB_DEVICE_CLIENT_HANDLE, TEST_CHAR_PTR, TEST_UNSIGNED_CHAR, TEST_SIZE_T, TEST_FILE_UPLOAD_CALLBACK, NULL, &upload_job_id);
+
+    //assert
+    ASSERT_IS_TRUE(result == IOTHUB_CLIENT_OK);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+TEST_FUNCTION(IoTHubDeviceClient_QueueUploadMultipleBlocksToBlobAsync_Test)
+{
+    //arrange
+    IOTHUB_CLIENT_UPLOAD_JOB_ID upload_job_id;
+    STRICT_EXPECTED_CALL(IoTHubClientCore_QueueUploadMultipleBlocksToBlobAsync(TEST_IOTHUB_CLIENT_CORE_HANDLE, TEST_CHAR_PTR, NULL, TEST_FILE_UPLOAD_GET_DATA_CALLBACK_EX, NULL, &upload_job_id));
+
+    //act
+    IOTHUB_CLIENT_RESULT result = IoTHubDeviceClient_QueueUploadMultipleBlocksToBlobAsync(TEST_IOTHUB_DEVICE_CLIENT_HANDLE, TEST_CHAR_PTR, TEST_FILE_UPLOAD_GET_DATA_CALLBACK_EX, NULL, &upload_job_id);
+
+    //assert
+    ASSERT_IS_TRUE(result == IOTHUB_CLIENT_OK);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+TEST_FUNCTION(IoTHubDeviceClient_CancelUploadToBlobAsync_Test)
+{
+    //arrange
+    STRICT_EXPECTED_CALL(IoTHubClientCore_CancelUploadToBlobAsync(TEST_IOTHUB_CLIENT_CORE_HANDLE, 1));
+
+    //act
+    IOTHUB_CLIENT_RESULT result = IoTHubDeviceClient_CancelUploadToBlobAsync(TEST_IOTHUB_DEVICE_CLIENT_HANDLE, 1);
+
+    //assert
+    ASSERT_IS_TRUE(result == IOTHUB_CLIENT_OK);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
 #endif // !DONT_USE_UPLOADTOBLOB
 
 
@@ -92,6 +92,8 @@ IMPLEMENT_UMOCK_C_ENUM_TYPE(IOTHUB_MESSAGE_RESULT, IOTHUB_MESSAGE_RESULT_VALUES)
 TEST_DEFINE_ENUM_TYPE(IOTHUBMESSAGE_CONTENT_TYPE, IOTHUBMESSAGE_CONTENT_TYPE_VALUES);
 IMPLEMENT_UMOCK_C_ENUM_TYPE(IOTHUBMESSAGE_CONTENT_TYPE, IOTHUBMESSAGE_CONTENT_TYPE_VALUES);
 
+TEST_DEFINE_ENUM_TYPE(IOTHUB_MESSAGE_PRIORITY, IOTHUB_MESSAGE_PRIORITY_VALUES);
+
 MU_DEFINE_ENUM_STRINGS(UMOCK_C_ERROR_CODE, UMOCK_C_ERROR_CODE_VALUES)
 
 static void on_umock_c_error(UMOCK_C_ERROR_CODE error_code)
@@ -2148,6 +2150,76 @@ TEST_FUNCTION(IoTHubMessage_IsSecurityMessage_false_Succeed)
     IoTHubMessage_Destroy(h);
 }
 
+// Tests_SRS_IOTHUBMESSAGE_44_001: [ New messages shall have the priority IOTHUB_MESSAGE_PRIORITY_NORMAL. ]
+TEST_FUNCTION(IoTHubMessage_GetPriority_default_is_normal)
+{
+    //arrange
+    IOTHUB_MESSAGE_HANDLE h = IoTHubMessage_CreateFromByteArray(c, 1);
+    umock_c_reset_all_calls();
+
+    //act
+    IOTHUB_MESSAGE_PRIORITY result = IoTHubMessage_GetPriority(h);
+
+    //assert
+    ASSERT_ARE_EQUAL(IOTHUB_MESSAGE_PRIORITY, IOTHUB_MESSAGE_PRIORITY_NORMAL, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    //cleanup
+    IoTHubMessage_Destroy(h);
+}
+
+// Tests_SRS_IOTHUBMESSAGE_44_003: [ If iotHubMessageHandle is NULL or priority is not a valid IOTHUB_MESSAGE_PRIORITY, IoTHubMessage_SetPriority shall return IOTHUB_MESSAGE_INVALID_ARG. ]
+TEST_FUNCTION(IoTHubMessage_SetPriority_invalid_args_fail)
+{
+    //arrange
+    IOTHUB_MESSAGE_HANDLE h = IoTHubMessage_CreateFromByteArray(c, 1);
+    umock_c_reset_all_calls();
+
+    //act
+    IOTHUB_MESSAGE_RESULT null_handle_result = IoTHubMessage_SetPriority(NULL, IOTHUB_MESSAGE_PRIORITY_HIGH);
+    IOTHUB_MESSAGE_RESULT invalid_priority_result = IoTHubMessage_SetPriority(h, (IOTHUB_MESSAGE_PRIORITY)42);
+
+    //assert
+    ASSERT_ARE_EQUAL(IOTHUB_MESSAGE_RESULT, IOTHUB_MESSAGE_INVALID_ARG, null_handle_result);
+    ASSERT_ARE_EQUAL(IOTHUB_MESSAGE_RESULT, IOTHUB_MESSAGE_INVALID_ARG, invalid_priority_result);
+    ASSERT_ARE_EQUAL(IOTHUB_MESSAGE_PRIORITY, IOTHUB_MESSAGE_PRIORITY_NORMAL, IoTHubMessage_GetPriority(h));
+
+    //cleanup
+    IoTHubMessage_Destroy(h);
+}
+
+// Tests_SRS_IOTHUBMESSAGE_44_002: [ IoTHubMessage_Clone shall copy the priority of the message. ]
+// Tests_SRS_IOTHUBMESSAGE_44_004: [ IoTHubMessage_SetPriority shall save priority and return IOTHUB_MESSAGE_OK. ]
+// Tests_SRS_IOTHUBMESSAGE_44_006: [ IoTHubMessage_GetPriority shall return the priority of the message. ]
+TEST_FUNCTION(IoTHubMessage_SetPriority_is_kept_by_Clone)
+{
+    //arrange
+    IOTHUB_MESSAGE_HANDLE h = IoTHubMessage_CreateFromByteArray(c, 1);
+    IOTHUB_MESSAGE_RESULT result = IoTHubMessage_SetPriority(h, IOTHUB_MESSAGE_PRIORITY_HIGH);
+
+    //act
+    IOTHUB_MESSAGE_HANDLE clone_msg = IoTHubMessage_Clone(h);
+
+    //assert
+    ASSERT_ARE_EQUAL(IOTHUB_MESSAGE_RESULT, IOTHUB_MESSAGE_OK, result);
+    ASSERT_ARE_EQUAL(IOTHUB_MESSAGE_PRIORITY, IOTHUB_MESSAGE_PRIORITY_HIGH, IoTHubMessage_GetPriority(h));
+    ASSERT_ARE_EQUAL(IOTHUB_MESSAGE_PRIORITY, IOTHUB_MESSAGE_PRIORITY_HIGH, IoTHubMessage_GetPriority(clone_msg));
+
+    //cleanup
+    IoTHubMessage_Destroy(h);
+    IoTHubMessage_Destroy(clone_msg);
+}
+
+// Tests_SRS_IOTHUBMESSAGE_44_005: [ If iotHubMessageHandle is NULL, IoTHubMessage_GetPriority shall return IOTHUB_MESSAGE_PRIORITY_NORMAL. ]
+TEST_FUNCTION(IoTHubMessage_GetPriority_NULL_handle_returns_normal)
+{
+    //act
+    IOTHUB_MESSAGE_PRIORITY result = IoTHubMessage_GetPriority(NULL);
+
+    //assert
+    ASSERT_ARE_EQUAL(IOTHUB_MESSAGE_PRIORITY, IOTHUB_MESSAGE_PRIORITY_NORMAL, result);
+}
+
 END_TEST_SUITE(iothubmessage_ut)
 
 
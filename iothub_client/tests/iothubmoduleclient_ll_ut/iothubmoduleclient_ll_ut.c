@@ -126,6 +126,8 @@ TEST_SUITE_INITIALIZE(suite_init)
     REGISTER_GLOBAL_MOCK_RETURN(IoTHubClientCore_LL_GetSendStatus, IOTHUB_CLIENT_OK);
     REGISTER_GLOBAL_MOCK_RETURN(IoTHubClientCore_LL_SetConnectionStatusCallback, IOTHUB_CLIENT_OK);
     REGISTER_GLOBAL_MOCK_RETURN(IoTHubClientCore_LL_SetRetryPolicy, IOTHUB_CLIENT_OK);
+    REGISTER_GLOBAL_MOCK_RETURN(IoTHubClientCore_LL_GetNextWorkDeadline, IOTHUB_CLIENT_OK);
+    REGISTER_GLOBAL_MOCK_RETURN(IoTHubClientCore_LL_GetRttStatistics, IOTHUB_CLIENT_OK);
     REGISTER_GLOBAL_MOCK_RETURN(IoTHubClientCore_LL_GetRetryPolicy, IOTHUB_CLIENT_OK);
     REGISTER_GLOBAL_MOCK_RETURN(IoTHubClientCore_LL_GetLastMessageReceiveTime, IOTHUB_CLIENT_OK);
     REGISTER_GLOBAL_MOCK_RETURN(IoTHubClientCore_LL_SetOption, IOTHUB_CLIENT_OK);
@@ -241,6 +243,60 @@ TEST_FUNCTION(IoTHubModuleClient_LL_SetConnectionStatusCallback_Test)
     ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
 }
 
+TEST_FUNCTION(IoTHubModuleClient_LL_GetNextWorkDeadline_Test)
+{
+    //arrange
+    unsigned int msUntilNextWork;
+    STRICT_EXPECTED_CALL(IoTHubClientCore_LL_GetNextWorkDeadline(TEST_IOTHUB_CLIENT_CORE_LL_HANDLE, &msUntilNextWork));
+
+    //act
+    IOTHUB_CLIENT_RESULT result = IoTHubModuleClient_LL_GetNextWorkDeadline(TEST_IOTHUB_MODULE_CLIENT_LL_HANDLE, &msUntilNextWork);
+
+    //assert
+    ASSERT_IS_TRUE(result == IOTHUB_CLIENT_OK);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+TEST_FUNCTION(IoTHubModuleClient_LL_GetNextWorkDeadline_NULL_handle_fails)
+{
+    //arrange
+    unsigned int msUntilNextWork;
+
+    //act
+    IOTHUB_CLIENT_RESULT result = IoTHubModuleClient_LL_GetNextWorkDeadline(NULL, &msUntilNextWork);
+
+    //assert
+    ASSERT_IS_TRUE(result == IOTHUB_CLIENT_INVALID_ARG);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+TEST_FUNCTION(IoTHubModuleClient_LL_GetRttStatistics_Test)
+{
+    //arrange
+    IOTHUB_CLIENT_RTT_STATISTICS rttStatistics;
+    STRICT_EXPECTED_CALL(IoTHubClientCore_LL_GetRttStatistics(TEST_IOTHUB_CLIENT_CORE_LL_HANDLE, &rttStatistics));
+
+    //act
+    IOTHUB_CLIENT_RESULT result = IoTHubModuleClient_LL_GetRttStatistics(TEST_IOTHUB_MODULE_CLIENT_LL_HANDLE, &rttStatistics);
+
+    //assert
+    ASSERT_IS_TRUE(result == IOTHUB_CLIENT_OK);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+TEST_FUNCTION(IoTHubModuleClient_LL_GetRttStatistics_NULL_handle_fails)
+{
+    //arrange
+    IOTHUB_CLIENT_RTT_STATISTICS rttStatistics;
+
+    //act
+    IOTHUB_CLIENT_RESULT result = IoTHubModuleClient_LL_GetRttStatistics(NULL, &rttStatistics);
+
+    //assert
+    ASSERT_IS_TRUE(result == IOTHUB_CLIENT_INVALID_ARG);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
 TEST_FUNCTION(IoTHubModuleClient_LL_SetRetryPolicy_Test)
 {
     //arrange
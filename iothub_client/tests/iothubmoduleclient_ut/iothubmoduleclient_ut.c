@@ -104,6 +104,7 @@ TEST_SUITE_INITIALIZE(suite_init)
     REGISTER_GLOBAL_MOCK_RETURN(IoTHubClientCore_SetRetryPolicy, IOTHUB_CLIENT_OK);
     REGISTER_GLOBAL_MOCK_RETURN(IoTHubClientCore_GetRetryPolicy, IOTHUB_CLIENT_OK);
     REGISTER_GLOBAL_MOCK_RETURN(IoTHubClientCore_GetLastMessageReceiveTime, IOTHUB_CLIENT_OK);
+    REGISTER_GLOBAL_MOCK_RETURN(IoTHubClientCore_GetRttStatistics, IOTHUB_CLIENT_OK);
     REGISTER_GLOBAL_MOCK_RETURN(IoTHubClientCore_SetOption, IOTHUB_CLIENT_OK);
     REGISTER_GLOBAL_MOCK_RETURN(IoTHubClientCore_SetDeviceTwinCallback, IOTHUB_CLIENT_OK);
     REGISTER_GLOBAL_MOCK_RETURN(IoTHubClientCore_SendReportedState, IOTHUB_CLIENT_OK);
@@ -241,6 +242,20 @@ TEST_FUNCTION(IoTHubModuleClient_GetLastMessageReceiveTime_Test)
     ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
 }
 
+TEST_FUNCTION(IoTHubModuleClient_GetRttStatistics_Test)
+{
+    //arrange
+    IOTHUB_CLIENT_RTT_STATISTICS rtt_statistics;
+    STRICT_EXPECTED_CALL(IoTHubClientCore_GetRttStatistics(TEST_IOTHUB_CLIENT_CORE_HANDLE, &rtt_statistics));
+
+    //act
+    IOTHUB_CLIENT_RESULT result = IoTHubModuleClient_GetRttStatistics(TEST_IOTHUB_MODULE_CLIENT_HANDLE, &rtt_statistics);
+
+    //assert
+    ASSERT_IS_TRUE(result == IOTHUB_CLIENT_OK);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
 TEST_FUNCTION(IoTHubModuleClient_SetOption_Test)
 {
     //arrange
@@ -460,10 +460,11 @@ static MESSENGER_DO_WORK_EXP_CALL_PROFILE* get_msgr_do_work_exp_call_profile(TEL
     return &g_do_work_profile;
 }
 
-static int TEST_message_create_uamqp_encoding_from_iothub_message(MESSAGE_HANDLE message_batch_container, IOTHUB_MESSAGE_HANDLE message_handle, BINARY_DATA* body_binary_data)
+static int TEST_message_create_uamqp_encoding_from_iothub_message_into_buffer(MESSAGE_HANDLE message_batch_container, IOTHUB_MESSAGE_HANDLE message_handle, UAMQP_ENCODING_BUFFER* encoding_buffer, BINARY_DATA* body_binary_data)
 {
     (void)message_batch_container;
     (void)message_handle;
+    (void)encoding_buffer;
     (void)body_binary_data;
     return 0;
 }
@@ -1329,7 +1330,7 @@ static SEND_PENDING_EVENTS_TEST_CONFIG test_send_middle_message_too_big_and_roll
 
 
 //
-//  We fail call to message_create_uamqp_encoding_from_iothub_message
+//  We fail call to message_create_uamqp_encoding_from_iothub_message_into_buffer
 //
 static SEND_PENDING_TEST_EVENTS test_create_message_failure_events[] = {
     { 10,  SEND_PENDING_EXPECT_CREATE_MESSAGE_FAILURE  },
@@ -1365,7 +1366,7 @@ static void set_expected_calls_for_message_do_work_send_pending_events(SEND_PEND
     for (i = 0; i < test_config->number_test_events; i++)
     {
         const SEND_PENDING_EXPECTED_ACTION expected_action = test_config->test_events[i].expected_action;
-        const int message_create_uamqp_encoding_from_iothub_message_return = (expected_action == SEND_PENDING_EXPECT_CREATE_MESSAGE_FAILURE) ? 1 : 0;
+        const int message_create_uamqp_encoding_from_iothub_message_into_buffer_return = (expected_action == SEND_PENDING_EXPECT_CREATE_MESSAGE_FAILURE) ? 1 : 0;
 
         STRICT_EXPECTED_CALL(singlylinkedlist_get_head_item(TEST_WAIT_TO_SEND_LIST));
         STRICT_EXPECTED_CALL(singlylinkedlist_item_get_value(IGNORED_PTR_ARG));
@@ -1383,8 +1384,8 @@ static void set_expected_calls_for_message_do_work_send_pending_events(SEND_PEND
 
         TEST_amqp_data.length = test_config->test_events[i].number_bytes_encoded;
 
-        STRICT_EXPECTED_CALL(message_create_uamqp_encoding_from_iothub_message(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-            .CopyOutArgumentBuffer(3, &TEST_amqp_data, sizeof(TEST_amqp_data)).SetReturn(message_create_uamqp_encoding_from_iothub_message_return);
+        STRICT_EXPECTED_CALL(message_create_uamqp_encoding_from_iothub_message_into_buffer(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+            .CopyOutArgumentBuffer(4, &TEST_amqp_data, sizeof(TEST_amqp_data)).SetReturn(message_create_uamqp_encoding_from_iothub_message_into_buffer_return);
 
         if ((SEND_PENDING_EXPECT_ERROR_TOO_LARGE == expected_action) || (SEND_PENDING_EXPECT_CREATE_MESSAGE_FAILURE == expected_action))
         {
@@ -1818,7 +1819,7 @@ TEST_SUITE_INITIALIZE(TestClassInitialize)
     REGISTER_GLOBAL_MOCK_HOOK(messagesender_send_async, TEST_messagesender_send_async);
     REGISTER_GLOBAL_MOCK_HOOK(messagereceiver_create, TEST_messagereceiver_create);
     REGISTER_GLOBAL_MOCK_HOOK(messagereceiver_open, TEST_messagereceiver_open);
-    REGISTER_GLOBAL_MOCK_HOOK(message_create_uamqp_encoding_from_iothub_message, TEST_message_create_uamqp_encoding_from_iothub_message);
+    REGISTER_GLOBAL_MOCK_HOOK(message_create_uamqp_encoding_from_iothub_message_into_buffer, TEST_message_create_uamqp_encoding_from_iothub_message_into_buffer);
     REGISTER_GLOBAL_MOCK_HOOK(message_create_IoTHubMessage_from_uamqp_message, TEST_message_create_IoTHubMessage_from_uamqp_message);
     REGISTER_GLOBAL_MOCK_HOOK(singlylinkedlist_add, TEST_singlylinkedlist_add);
     REGISTER_GLOBAL_MOCK_HOOK(singlylinkedlist_get_head_item, TEST_singlylinkedlist_get_head_item);
@@ -2501,6 +2502,7 @@ TEST_FUNCTION(telemetry_messenger_do_work_not_started)
 // Tests_SRS_IOTHUBTRANSPORT_AMQP_MESSENGER_09_055: [Before returning, telemetry_messenger_do_work() shall release all the temporary memory it has allocated]
 // Tests_SRS_IOTHUBTRANSPORT_AMQP_MESSENGER_31_192: [Enumerate through all messages waiting to send, building up AMQP message to send and sending when size will be greater than link max size.]
 // Tests_SRS_IOTHUBTRANSPORT_AMQP_MESSENGER_31_200: [Retrieve an AMQP encoded representation of this message for later appending to main batched message.  On error, invoke callback but continue send loop; this is NOT a fatal error.]
+// Tests_SRS_IOTHUBTRANSPORT_AMQP_MESSENGER_44_001: [Each message shall be encoded with message_create_uamqp_encoding_from_iothub_message_into_buffer() into `instance->encoding_buffer`, whose `max_capacity` is the maximum message size for batching.]
 // Tests_SRS_IOTHUBTRANSPORT_AMQP_MESSENGER_31_194: [When message is ready to send, invoke AMQP's messagesender_send and free temporary values associated with this batch.]
 // Tests_SRS_IOTHUBTRANSPORT_AMQP_MESSENGER_31_193: [If (length of current user AMQP message) + (length of user messages pending for this batched message) + (1KB reserve buffer) > maximum link send, send pending messages and create new batched message.]
 void test_send_events(SEND_PENDING_EVENTS_TEST_CONFIG *test_config, bool testing_modules)
@@ -0,0 +1,377 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+// Measures how the cost of building the batched telemetry payload of the HTTP transport grows with
+// the batch size, sending 1, 100 and 500 messages per DoWork with the "Batching" option set.
+// The benchmark provides its own HTTPAPI layer, so the platform HTTP adapter of the shared utility
+// library is not linked in: every request is answered in-process, the batched payloads are checked
+// and counted, and the measurements cover the client and the transport but not the network.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdbool.h>
+
+#include "azure_c_shared_utility/gballoc.h"
+#include "azure_c_shared_utility/xlogging.h"
+#include "azure_c_shared_utility/platform.h"
+#include "azure_c_shared_utility/httpapi.h"
+#include "iothub_device_client_ll.h"
+#include "iothub_message.h"
+#include "iothub_client_options.h"
+#include "iothubtransporthttp.h"
+#include "../common_perf/iothub_client_common_perf.h"
+
+#define PERF_MESSAGES_PER_RUN   50000
+#define PERF_PAYLOAD_SIZE       64
+// Mirrors the limits of iothubtransporthttp.c: a batch holds messages until the sum of their
+// sizes, each counted as its length + 384 bytes, would exceed 255KB - 1 byte.
+#define PERF_MAXIMUM_BATCH_SIZE         (255 * 1024 - 1)
+#define PERF_MESSAGE_SIZE_CONTRIBUTION  (PERF_PAYLOAD_SIZE + 384)
+#define PERF_MESSAGES_PER_FULL_BATCH    (PERF_MAXIMUM_BATCH_SIZE / PERF_MESSAGE_SIZE_CONTRIBUTION)
+
+#define PERF_EVENTS_PATH_PREFIX "/devices/perf-device/messages/events"
+#define PERF_BATCH_ITEM_PREFIX  "{\"body\":\""
+
+static const size_t g_batch_sizes[] = { 1, 100, 500 };
+
+static size_t g_batch_count;
+static size_t g_batched_message_count;
+static size_t g_last_batch_message_count;
+static size_t g_invalid_batch_count;
+static size_t g_confirmation_count;
+static char g_expected_body[4 * ((PERF_PAYLOAD_SIZE + 2) / 3) + 1];
+static int g_http_connection;
+
+// Counts the items of a batched payload, [{"body":"..."},{"body":"..."}], checking each body.
+static size_t count_batch_items(const unsigned char* content, size_t content_length)
+{
+    size_t item_count = 0;
+    size_t prefix_length = strlen(PERF_BATCH_ITEM_PREFIX);
+    size_t body_length = strlen(g_expected_body);
+    size_t position = 1;
+    bool valid = (content_length >= 2 && content[0] == '[' && content[content_length - 1] == ']');
+
+    while (valid && position < content_length - 1)
+    {
+        if (position + prefix_length + body_length + 3 > content_length ||
+            memcmp(content + position, PERF_BATCH_ITEM_PREFIX, prefix_length) != 0 ||
+            memcmp(content + position + prefix_length, g_expected_body, body_length) != 0 ||
+            memcmp(content + position + prefix_length + body_length, "\"}", 2) != 0)
+        {
+            valid = false;
+        }
+        else
+        {
+            item_count++;
+            position += prefix_length + body_length + 2;
+            if (content[position] == ',')
+            {
+                position++;
+            }
+        }
+    }
+
+    return valid ? item_count : 0;
+}
+
+HTTPAPI_RESULT HTTPAPI_Init(void)
+{
+    return HTTPAPI_OK;
+}
+
+void HTTPAPI_Deinit(void)
+{
+}
+
+HTTP_HANDLE HTTPAPI_CreateConnection(const char* hostName)
+{
+    (void)hostName;
+    return (HTTP_HANDLE)&g_http_connection;
+}
+
+void HTTPAPI_CloseConnection(HTTP_HANDLE handle)
+{
+    (void)handle;
+}
+
+HTTPAPI_RESULT HTTPAPI_ExecuteRequest(HTTP_HANDLE handle, HTTPAPI_REQUEST_TYPE requestType, const char* relativePath,
+    HTTP_HEADERS_HANDLE httpHeadersHandle, const unsigned char* content,
+    size_t contentLength, unsigned int* statusCode,
+    HTTP_HEADERS_HANDLE responseHeadersHandle, BUFFER_HANDLE responseContent)
+{
+    (void)handle;
+    (void)httpHeadersHandle;
+    (void)responseHeadersHandle;
+    (void)responseContent;
+
+    if (requestType == HTTPAPI_REQUEST_POST && strncmp(relativePath, PERF_EVENTS_PATH_PREFIX, strlen(PERF_EVENTS_PATH_PREFIX)) == 0)
+    {
+        size_t item_count = count_batch_items(content, contentLength);
+
+        if (item_count == 0)
+        {
+            g_invalid_batch_count++;
+        }
+        g_batch_count++;
+        g_batched_message_count += item_count;
+        g_last_batch_message_count = item_count;
+    }
+
+    // Events are accepted and there is never a cloud-to-device message waiting.
+    *statusCode = 204;
+    return HTTPAPI_OK;
+}
+
+HTTPAPI_RESULT HTTPAPI_SetOption(HTTP_HANDLE handle, const char* optionName, const void* value)
+{
+    (void)handle;
+    (void)optionName;
+    (void)value;
+    return HTTPAPI_OK;
+}
+
+HTTPAPI_RESULT HTTPAPI_CloneOption(const char* optionName, const void* value, const void** savedValue)
+{
+    (void)optionName;
+    (void)value;
+    *savedValue = NULL;
+    return HTTPAPI_OK;
+}
+
+static void send_confirmation_callback(IOTHUB_CLIENT_CONFIRMATION_RESULT result, void* userContextCallback)
+{
+    (void)userContextCallback;
+    if (result == IOTHUB_CLIENT_CONFIRMATION_OK)
+    {
+        g_confirmation_count++;
+    }
+}
+
+static IOTHUB_DEVICE_CLIENT_LL_HANDLE create_batching_client(void)
+{
+    IOTHUB_DEVICE_CLIENT_LL_HANDLE result;
+    IOTHUB_CLIENT_CONFIG client_config;
+    bool batching = true;
+
+    (void)memset(&client_config, 0, sizeof(client_config));
+    client_config.protocol = HTTP_Protocol;
+    client_config.deviceId = "perf-device";
+    client_config.deviceKey = "cGVyZi1kZXZpY2Uta2V5";
+    client_config.iotHubName = "perf";
+    client_config.iotHubSuffix = "azure-devices.net";
+
+    if ((result = IoTHubDeviceClient_LL_Create(&client_config)) == NULL)
+    {
+        LogError("Failed creating the device client");
+    }
+    else if (IoTHubDeviceClient_LL_SetOption(result, OPTION_BATCHING, &batching) != IOTHUB_CLIENT_OK)
+    {
+        LogError("Failed setting %s", OPTION_BATCHING);
+        IoTHubDeviceClient_LL_Destroy(result);
+        result = NULL;
+    }
+
+    return result;
+}
+
+static int send_messages(IOTHUB_DEVICE_CLIENT_LL_HANDLE device_ll_handle, size_t message_count)
+{
+    int result = 0;
+    unsigned char payload[PERF_PAYLOAD_SIZE];
+    size_t index;
+
+    (void)memset(payload, 'x', sizeof(payload));
+
+    for (index = 0; index < message_count && result == 0; index++)
+    {
+        IOTHUB_MESSAGE_HANDLE message_handle;
+
+        if ((message_handle = IoTHubMessage_CreateFromByteArray(payload, sizeof(payload))) == NULL)
+        {
+            LogError("Failed creating message %lu", (unsigned long)index);
+            result = MU_FAILURE;
+        }
+        else
+        {
+            if (IoTHubDeviceClient_LL_SendEventAsync(device_ll_handle, message_handle, send_confirmation_callback, NULL) != IOTHUB_CLIENT_OK)
+            {
+                LogError("IoTHubDeviceClient_LL_SendEventAsync failed");
+                result = MU_FAILURE;
+            }
+            IoTHubMessage_Destroy(message_handle);
+        }
+    }
+
+    return result;
+}
+
+static void reset_counters(void)
+{
+    g_batch_count = 0;
+    g_batched_message_count = 0;
+    g_last_batch_message_count = 0;
+    g_invalid_batch_count = 0;
+    g_confirmation_count = 0;
+}
+
+static int run_batch_benchmark(size_t batch_size, PERF_MEASUREMENT* measurement)
+{
+    int result = 0;
+    IOTHUB_DEVICE_CLIENT_LL_HANDLE device_ll_handle;
+
+    if ((device_ll_handle = create_batching_client()) == NULL)
+    {
+        result = MU_FAILURE;
+    }
+    else
+    {
+        size_t batches = PERF_MESSAGES_PER_RUN / batch_size;
+        size_t index;
+
+        // The first DoWork also polls for cloud-to-device messages, keep it out of the measurement.
+        IoTHubDeviceClient_LL_DoWork(device_ll_handle);
+        reset_counters();
+
+        perf_measurement_start(measurement);
+
+        for (index = 0; index < batches && result == 0; index++)
+        {
+            result = send_messages(device_ll_handle, batch_size);
+            IoTHubDeviceClient_LL_DoWork(device_ll_handle);
+        }
+
+        perf_measurement_stop(measurement);
+
+        if (result == 0 && (g_batch_count != batches || g_batched_message_count != batches * batch_size || g_invalid_batch_count != 0))
+        {
+            LogError("Expected %lu batches of %lu messages, got %lu batches holding %lu messages (%lu invalid)",
+                (unsigned long)batches, (unsigned long)batch_size, (unsigned long)g_batch_count, (unsigned long)g_batched_message_count, (unsigned long)g_invalid_batch_count);
+            result = MU_FAILURE;
+        }
+        else if (result == 0 && g_confirmation_count != batches * batch_size)
+        {
+            LogError("Expected %lu confirmations, got %lu", (unsigned long)(batches * batch_size), (unsigned long)g_confirmation_count);
+            result = MU_FAILURE;
+        }
+
+        IoTHubDeviceClient_LL_Destroy(device_ll_handle);
+    }
+
+    return result;
+}
+
+// Queues more messages than fit in one batch: the first batch shall stop at the size limit and
+// the next DoWork shall send the rest.
+static int check_batch_size_limit(void)
+{
+    int result;
+    IOTHUB_DEVICE_CLIENT_LL_HANDLE device_ll_handle;
+
+    if ((device_ll_handle = create_batching_client()) == NULL)
+    {
+        result = MU_FAILURE;
+    }
+    else
+    {
+        size_t overflow = 10;
+
+        IoTHubDeviceClient_LL_DoWork(device_ll_handle);
+        reset_counters();
+
+        if ((result = send_messages(device_ll_handle, PERF_MESSAGES_PER_FULL_BATCH + overflow)) == 0)
+        {
+            IoTHubDeviceClient_LL_DoWork(device_ll_handle);
+            if (g_batch_count != 1 || g_last_batch_message_count != PERF_MESSAGES_PER_FULL_BATCH)
+            {
+                LogError("Expected a first batch of %lu messages, got %lu messages in %lu batches",
+                    (unsigned long)PERF_MESSAGES_PER_FULL_BATCH, (unsigned long)g_batched_message_count, (unsigned long)g_batch_count);
+                result = MU_FAILURE;
+            }
+            else
+            {
+                IoTHubDeviceClient_LL_DoWork(device_ll_handle);
+                if (g_batch_count != 2 || g_last_batch_message_count != overflow || g_invalid_batch_count != 0)
+                {
+                    LogError("Expected a second batch of %lu messages, got %lu", (unsigned long)overflow, (unsigned long)g_last_batch_message_count);
+                    result = MU_FAILURE;
+                }
+            }
+        }
+
+        IoTHubDeviceClient_LL_Destroy(device_ll_handle);
+    }
+
+    return result;
+}
+
+static void make_expected_body(void)
+{
+    // The payload is PERF_PAYLOAD_SIZE 'x' bytes: "xxx" encodes to "eHh4", a trailing "x" to "eA==".
+    size_t index;
+    for (index = 0; index < PERF_PAYLOAD_SIZE / 3; index++)
+    {
+        (void)memcpy(g_expected_body + 4 * index, "eHh4", 4);
+    }
+    if (PERF_PAYLOAD_SIZE % 3 == 1)
+    {
+        (void)memcpy(g_expected_body + 4 * index, "eA==", 4);
+        index++;
+    }
+    else if (PERF_PAYLOAD_SIZE % 3 == 2)
+    {
+        (void)memcpy(g_expected_body + 4 * index, "eHg=", 4);
+        index++;
+    }
+    g_expected_body[4 * index] = '\0';
+}
+
+int main(void)
+{
+    int result;
+    PERF_MEASUREMENT measurement;
+
+    make_expected_body();
+
+    if (platform_init() != 0)
+    {
+        LogError("Failed initializing the platform");
+        result = MU_FAILURE;
+    }
+    else
+    {
+        if (perf_measurement_init(&measurement) != 0)
+        {
+            LogError("Failed initializing the measurement");
+            result = MU_FAILURE;
+        }
+        else
+        {
+            size_t index;
+
+            result = check_batch_size_limit();
+
+            for (index = 0; index < sizeof(g_batch_sizes) / sizeof(g_batch_sizes[0]) && result == 0; index++)
+            {
+                char label[64];
+
+                if (run_batch_benchmark(g_batch_sizes[index], &measurement) != 0)
+                {
+                    result = MU_FAILURE;
+                }
+                else
+                {
+                    (void)snprintf(label, sizeof(label), "HTTP batch of %lu messages (per message)", (unsigned long)g_batch_sizes[index]);
+                    perf_measurement_print(&measurement, label, (PERF_MESSAGES_PER_RUN / g_batch_sizes[index]) * g_batch_sizes[index]);
+                }
+            }
+
+            perf_measurement_deinit(&measurement);
+        }
+
+        platform_deinit();
+    }
+
+    return result;
+}
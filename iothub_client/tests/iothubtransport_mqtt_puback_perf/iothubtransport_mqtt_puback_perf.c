@@ -0,0 +1,199 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+// Compares the cost of matching a PUBACK to the message it acknowledges, the way the MQTT transport
+// tracks telemetry waiting for acknowledgement: walking the waiting list, as it used to, against
+// looking the packet id up in a packet_id_table. 64k messages are in flight, as after a reconnect
+// with a large window, and are acknowledged out of order.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "azure_c_shared_utility/gballoc.h"
+#include "azure_c_shared_utility/xlogging.h"
+#include "azure_c_shared_utility/platform.h"
+#include "azure_c_shared_utility/doublylinkedlist.h"
+#include "internal/packet_id_table.h"
+#include "internal/timeout_heap.h"
+#include "../common_perf/iothub_client_common_perf.h"
+
+// Packet ids are 1 to USHRT_MAX - 1, so this is every packet id the transport can have in flight.
+#define PERF_INFLIGHT_COUNT     65534
+// Prime, so stepping by it through the packet ids acknowledges each of them once, far from the publish order.
+#define PERF_ACK_STRIDE         4099
+#define PERF_RESEND_TIMEOUT_MS  300000
+
+typedef struct PERF_INFLIGHT_MESSAGE_TAG
+{
+    uint16_t packet_id;
+    DLIST_ENTRY entry;
+    TIMEOUT_HEAP_ENTRY ack_timeout;
+} PERF_INFLIGHT_MESSAGE;
+
+static PERF_INFLIGHT_MESSAGE g_messages[PERF_INFLIGHT_COUNT];
+
+static uint16_t get_acked_packet_id(size_t ack_index)
+{
+    return (uint16_t)((ack_index * PERF_ACK_STRIDE) % PERF_INFLIGHT_COUNT + 1);
+}
+
+static void publish_messages(DLIST_ENTRY* waiting_for_ack, TIMEOUT_HEAP* ack_timeouts)
+{
+    size_t index;
+
+    DList_InitializeListHead(waiting_for_ack);
+    timeout_heap_initialize(ack_timeouts);
+
+    for (index = 0; index < PERF_INFLIGHT_COUNT; index++)
+    {
+        g_messages[index].packet_id = (uint16_t)(index + 1);
+        DList_InsertTailList(waiting_for_ack, &g_messages[index].entry);
+        timeout_heap_insert(ack_timeouts, &g_messages[index].ack_timeout, (tickcounter_ms_t)index + PERF_RESEND_TIMEOUT_MS);
+    }
+}
+
+static int run_list_walk_benchmark(PERF_MEASUREMENT* measurement)
+{
+    int result = 0;
+    DLIST_ENTRY waiting_for_ack;
+    TIMEOUT_HEAP ack_timeouts;
+    size_t ack_index;
+
+    publish_messages(&waiting_for_ack, &ack_timeouts);
+
+    perf_measurement_start(measurement);
+
+    for (ack_index = 0; ack_index < PERF_INFLIGHT_COUNT && result == 0; ack_index++)
+    {
+        uint16_t packet_id = get_acked_packet_id(ack_index);
+        PDLIST_ENTRY current_entry = waiting_for_ack.Flink;
+        size_t matched = 0;
+
+        // Like the transport used to, visit every waiting message for each PUBACK.
+        while (current_entry != &waiting_for_ack)
+        {
+            PERF_INFLIGHT_MESSAGE* message = containingRecord(current_entry, PERF_INFLIGHT_MESSAGE, entry);
+            PDLIST_ENTRY next_entry = current_entry->Flink;
+
+            if (message->packet_id == packet_id)
+            {
+                (void)DList_RemoveEntryList(current_entry);
+                timeout_heap_remove(&ack_timeouts, &message->ack_timeout);
+                matched++;
+            }
+            current_entry = next_entry;
+        }
+
+        if (matched != 1)
+        {
+            LogError("PUBACK %u matched %lu messages", (unsigned int)packet_id, (unsigned long)matched);
+            result = MU_FAILURE;
+        }
+    }
+
+    perf_measurement_stop(measurement);
+
+    return result;
+}
+
+static int run_packet_id_table_benchmark(PERF_MEASUREMENT* measurement)
+{
+    int result = 0;
+    DLIST_ENTRY waiting_for_ack;
+    TIMEOUT_HEAP ack_timeouts;
+    PACKET_ID_TABLE waiting_for_ack_by_packet_id;
+    size_t index;
+
+    publish_messages(&waiting_for_ack, &ack_timeouts);
+    packet_id_table_initialize(&waiting_for_ack_by_packet_id);
+
+    // Indexing happens at publish time in the transport, so it is measured along with the acknowledgements.
+    perf_measurement_start(measurement);
+
+    for (index = 0; index < PERF_INFLIGHT_COUNT && result == 0; index++)
+    {
+        if (packet_id_table_insert(&waiting_for_ack_by_packet_id, g_messages[index].packet_id, &g_messages[index]) != 0)
+        {
+            LogError("Failed indexing packet id %u", (unsigned int)g_messages[index].packet_id);
+            result = MU_FAILURE;
+        }
+    }
+
+    for (index = 0; index < PERF_INFLIGHT_COUNT && result == 0; index++)
+    {
+        uint16_t packet_id = get_acked_packet_id(index);
+        PERF_INFLIGHT_MESSAGE* message = (PERF_INFLIGHT_MESSAGE*)packet_id_table_remove(&waiting_for_ack_by_packet_id, packet_id);
+
+        if (message == NULL || message->packet_id != packet_id)
+        {
+            LogError("PUBACK %u did not match its message", (unsigned int)packet_id);
+            result = MU_FAILURE;
+        }
+        else
+        {
+            (void)DList_RemoveEntryList(&message->entry);
+            timeout_heap_remove(&ack_timeouts, &message->ack_timeout);
+        }
+    }
+
+    perf_measurement_stop(measurement);
+
+    if (result == 0 && (!DList_IsListEmpty(&waiting_for_ack) || waiting_for_ack_by_packet_id.count != 0))
+    {
+        LogError("Messages are still waiting for acknowledgement");
+        result = MU_FAILURE;
+    }
+
+    packet_id_table_deinitialize(&waiting_for_ack_by_packet_id);
+
+    return result;
+}
+
+int main(void)
+{
+    int result;
+    PERF_MEASUREMENT measurement;
+
+    if (platform_init() != 0)
+    {
+        LogError("Failed initializing the platform");
+        result = MU_FAILURE;
+    }
+    else
+    {
+        if (perf_measurement_init(&measurement) != 0)
+        {
+            LogError("Failed initializing the measurement");
+            result = MU_FAILURE;
+        }
+        else
+        {
+            if (run_list_walk_benchmark(&measurement) != 0)
+            {
+                result = MU_FAILURE;
+            }
+            else
+            {
+                perf_measurement_print(&measurement, "PUBACK (waiting list walk)", PERF_INFLIGHT_COUNT);
+
+                if (run_packet_id_table_benchmark(&measurement) != 0)
+                {
+                    result = MU_FAILURE;
+                }
+                else
+                {
+                    perf_measurement_print(&measurement, "PUBACK (packet id table)", PERF_INFLIGHT_COUNT);
+                    result = 0;
+                }
+            }
+
+            perf_measurement_deinit(&measurement);
+        }
+
+        platform_deinit();
+    }
+
+    return result;
+}
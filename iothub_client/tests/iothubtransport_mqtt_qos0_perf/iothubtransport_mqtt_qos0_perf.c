@@ -0,0 +1,494 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+// Compares the telemetry throughput of the MQTT transport publishing at QoS 1, where every message
+// waits for its PUBACK, with the "mqtt_telemetry_at_most_once" option, where messages are published
+// at QoS 0 and completed as soon as they are written. The transport talks to an in-process broker
+// stand-in IO that acknowledges CONNECT, SUBSCRIBE, PINGREQ and QoS 1 PUBLISH packets, so the
+// measurements cover the client and the MQTT stack but not the network.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdbool.h>
+
+#include "azure_c_shared_utility/gballoc.h"
+#include "azure_c_shared_utility/xlogging.h"
+#include "azure_c_shared_utility/platform.h"
+#include "azure_c_shared_utility/xio.h"
+#include "iothub_device_client_ll.h"
+#include "iothub_message.h"
+#include "iothub_client_options.h"
+#include "iothubtransportmqtt.h"
+#include "internal/iothub_transport_ll_private.h"
+#include "internal/iothubtransport_mqtt_common.h"
+#include "../common_perf/iothub_client_common_perf.h"
+
+#define PERF_MESSAGE_COUNT      100000
+#define PERF_DOWORK_INTERVAL    100
+#define PERF_PAYLOAD_SIZE       64
+// DoWork calls allowed after the last message is sent for the outstanding confirmations to arrive.
+#define PERF_MAX_DRAIN_DOWORKS  1000
+
+#define MQTT_PACKET_CONNECT     0x10
+#define MQTT_PACKET_PUBLISH     0x30
+#define MQTT_PACKET_SUBSCRIBE   0x80
+#define MQTT_PACKET_PINGREQ     0xC0
+
+typedef struct BROKER_STANDIN_TAG
+{
+    ON_BYTES_RECEIVED on_bytes_received;
+    void* on_bytes_received_context;
+    unsigned char* received;
+    size_t received_length;
+    size_t received_size;
+    unsigned char* replies;
+    size_t replies_length;
+    size_t replies_size;
+} BROKER_STANDIN;
+
+static size_t g_qos0_publish_count;
+static size_t g_qos1_publish_count;
+static size_t g_confirmation_count;
+static TRANSPORT_PROVIDER g_standin_transport_provider;
+
+static int append_bytes(unsigned char** buffer, size_t* length, size_t* size, const unsigned char* bytes, size_t count)
+{
+    int result;
+
+    if (*length + count > *size)
+    {
+        size_t new_size = (*size == 0) ? 1024 : *size;
+        unsigned char* new_buffer;
+
+        while (new_size < *length + count)
+        {
+            new_size *= 2;
+        }
+
+        if ((new_buffer = (unsigned char*)realloc(*buffer, new_size)) == NULL)
+        {
+            LogError("Failed growing the broker stand-in buffer to %lu bytes", (unsigned long)new_size);
+            result = MU_FAILURE;
+        }
+        else
+        {
+            *buffer = new_buffer;
+            *size = new_size;
+            result = 0;
+        }
+    }
+    else
+    {
+        result = 0;
+    }
+
+    if (result == 0)
+    {
+        (void)memcpy(*buffer + *length, bytes, count);
+        *length += count;
+    }
+
+    return result;
+}
+
+static int queue_reply(BROKER_STANDIN* broker, const unsigned char* reply, size_t reply_length)
+{
+    return append_bytes(&broker->replies, &broker->replies_length, &broker->replies_size, reply, reply_length);
+}
+
+// Answers one complete packet sent by the client. `variable_header` points past the fixed header.
+static int handle_packet(BROKER_STANDIN* broker, unsigned char first_byte, const unsigned char* variable_header, size_t remaining_length)
+{
+    int result;
+
+    switch (first_byte & 0xF0)
+    {
+        case MQTT_PACKET_CONNECT:
+        {
+            static const unsigned char connack[] = { 0x20, 0x02, 0x00, 0x00 };
+            result = queue_reply(broker, connack, sizeof(connack));
+            break;
+        }
+        case MQTT_PACKET_PUBLISH:
+        {
+            if (((first_byte >> 1) & 0x03) == 0)
+            {
+                g_qos0_publish_count++;
+                result = 0;
+            }
+            else
+            {
+                size_t topic_length = ((size_t)variable_header[0] << 8) | variable_header[1];
+                unsigned char puback[] = { 0x40, 0x02, variable_header[2 + topic_length], variable_header[3 + topic_length] };
+
+                g_qos1_publish_count++;
+                result = queue_reply(broker, puback, sizeof(puback));
+            }
+            break;
+        }
+        case MQTT_PACKET_SUBSCRIBE:
+        {
+            unsigned char suback_header[] = { 0x90, 0x02, variable_header[0], variable_header[1] };
+            size_t position = 2;
+            size_t topic_count = 0;
+
+            while (position < remaining_length)
+            {
+                position += 2 + (((size_t)variable_header[position] << 8) | variable_header[position + 1]) + 1;
+                topic_count++;
+            }
+
+            // Grants QoS 1 to every topic; the stand-in never needs a multi-byte remaining length here.
+            suback_header[1] = (unsigned char)(2 + topic_count);
+            result = queue_reply(broker, suback_header, sizeof(suback_header));
+            while (result == 0 && topic_count-- > 0)
+            {
+                static const unsigned char granted_qos = 0x01;
+                result = queue_reply(broker, &granted_qos, 1);
+            }
+            break;
+        }
+        case MQTT_PACKET_PINGREQ:
+        {
+            static const unsigned char pingresp[] = { 0xD0, 0x00 };
+            result = queue_reply(broker, pingresp, sizeof(pingresp));
+            break;
+        }
+        default:
+            result = 0;
+            break;
+    }
+
+    return result;
+}
+
+// Handles every complete packet received so far, keeping a trailing partial one for the next send.
+static int handle_received_packets(BROKER_STANDIN* broker)
+{
+    int result = 0;
+    size_t position = 0;
+    bool incomplete = false;
+
+    while (result == 0 && !incomplete && position < broker->received_length)
+    {
+        size_t remaining_length = 0;
+        size_t multiplier = 1;
+        size_t header_length = 1;
+        bool length_complete = false;
+
+        while (!length_complete && position + header_length < broker->received_length && header_length <= 4)
+        {
+            unsigned char encoded_byte = broker->received[position + header_length];
+            remaining_length += (encoded_byte & 0x7F) * multiplier;
+            multiplier *= 128;
+            header_length++;
+            length_complete = ((encoded_byte & 0x80) == 0);
+        }
+
+        if (!length_complete || position + header_length + remaining_length > broker->received_length)
+        {
+            incomplete = true;
+        }
+        else
+        {
+            result = handle_packet(broker, broker->received[position], broker->received + position + header_length, remaining_length);
+            position += header_length + remaining_length;
+        }
+    }
+
+    (void)memmove(broker->received, broker->received + position, broker->received_length - position);
+    broker->received_length -= position;
+
+    return result;
+}
+
+static OPTIONHANDLER_HANDLE broker_standin_retrieveoptions(CONCRETE_IO_HANDLE handle)
+{
+    (void)handle;
+    return NULL;
+}
+
+static CONCRETE_IO_HANDLE broker_standin_create(void* io_create_parameters)
+{
+    BROKER_STANDIN* result;
+    (void)io_create_parameters;
+
+    if ((result = (BROKER_STANDIN*)malloc(sizeof(BROKER_STANDIN))) == NULL)
+    {
+        LogError("Failed allocating the broker stand-in");
+    }
+    else
+    {
+        (void)memset(result, 0, sizeof(BROKER_STANDIN));
+    }
+
+    return result;
+}
+
+static void broker_standin_destroy(CONCRETE_IO_HANDLE handle)
+{
+    BROKER_STANDIN* broker = (BROKER_STANDIN*)handle;
+
+    if (broker != NULL)
+    {
+        free(broker->received);
+        free(broker->replies);
+        free(broker);
+    }
+}
+
+static int broker_standin_open(CONCRETE_IO_HANDLE handle, ON_IO_OPEN_COMPLETE on_io_open_complete, void* on_io_open_complete_context, ON_BYTES_RECEIVED on_bytes_received, void* on_bytes_received_context, ON_IO_ERROR on_io_error, void* on_io_error_context)
+{
+    BROKER_STANDIN* broker = (BROKER_STANDIN*)handle;
+    (void)on_io_error;
+    (void)on_io_error_context;
+
+    broker->on_bytes_received = on_bytes_received;
+    broker->on_bytes_received_context = on_bytes_received_context;
+    broker->received_length = 0;
+    broker->replies_length = 0;
+    on_io_open_complete(on_io_open_complete_context, IO_OPEN_OK);
+
+    return 0;
+}
+
+static int broker_standin_close(CONCRETE_IO_HANDLE handle, ON_IO_CLOSE_COMPLETE on_io_close_complete, void* callback_context)
+{
+    BROKER_STANDIN* broker = (BROKER_STANDIN*)handle;
+
+    broker->on_bytes_received = NULL;
+    if (on_io_close_complete != NULL)
+    {
+        on_io_close_complete(callback_context);
+    }
+
+    return 0;
+}
+
+static int broker_standin_send(CONCRETE_IO_HANDLE handle, const void* buffer, size_t size, ON_SEND_COMPLETE on_send_complete, void* callback_context)
+{
+    int result;
+    BROKER_STANDIN* broker = (BROKER_STANDIN*)handle;
+
+    if (append_bytes(&broker->received, &broker->received_length, &broker->received_size, (const unsigned char*)buffer, size) != 0 ||
+        handle_received_packets(broker) != 0)
+    {
+        result = MU_FAILURE;
+    }
+    else
+    {
+        if (on_send_complete != NULL)
+        {
+            on_send_complete(callback_context, IO_SEND_OK);
+        }
+        result = 0;
+    }
+
+    return result;
+}
+
+static void broker_standin_dowork(CONCRETE_IO_HANDLE handle)
+{
+    BROKER_STANDIN* broker = (BROKER_STANDIN*)handle;
+
+    // Replies are delivered on the next DoWork, like bytes read from a socket would be.
+    while (broker->replies_length > 0 && broker->on_bytes_received != NULL)
+    {
+        size_t length = broker->replies_length;
+        unsigned char* replies = broker->replies;
+
+        // Replies queued while the client handles these ones are delivered by the next iteration.
+        broker->replies = NULL;
+        broker->replies_length = 0;
+        broker->replies_size = 0;
+        broker->on_bytes_received(broker->on_bytes_received_context, replies, length);
+        free(replies);
+    }
+}
+
+static int broker_standin_setoption(CONCRETE_IO_HANDLE handle, const char* option_name, const void* value)
+{
+    (void)handle;
+    (void)option_name;
+    (void)value;
+    return 0;
+}
+
+static const IO_INTERFACE_DESCRIPTION broker_standin_interface_description =
+{
+    broker_standin_retrieveoptions,
+    broker_standin_create,
+    broker_standin_destroy,
+    broker_standin_open,
+    broker_standin_close,
+    broker_standin_send,
+    broker_standin_dowork,
+    broker_standin_setoption
+};
+
+static XIO_HANDLE get_broker_standin_io(const char* fully_qualified_name, const MQTT_TRANSPORT_PROXY_OPTIONS* mqtt_transport_proxy_options)
+{
+    (void)fully_qualified_name;
+    (void)mqtt_transport_proxy_options;
+    return xio_create(&broker_standin_interface_description, NULL);
+}
+
+static TRANSPORT_LL_HANDLE standin_transport_create(const IOTHUBTRANSPORT_CONFIG* config, TRANSPORT_CALLBACKS_INFO* cb_info, void* ctx)
+{
+    return IoTHubTransport_MQTT_Common_Create(config, get_broker_standin_io, cb_info, ctx);
+}
+
+// The MQTT transport, connecting to the broker stand-in instead of opening a TLS connection.
+static const TRANSPORT_PROVIDER* StandinMQTT_Protocol(void)
+{
+    g_standin_transport_provider = *MQTT_Protocol();
+    g_standin_transport_provider.IoTHubTransport_Create = standin_transport_create;
+    return &g_standin_transport_provider;
+}
+
+static void send_confirmation_callback(IOTHUB_CLIENT_CONFIRMATION_RESULT result, void* userContextCallback)
+{
+    (void)userContextCallback;
+    if (result == IOTHUB_CLIENT_CONFIRMATION_OK)
+    {
+        g_confirmation_count++;
+    }
+}
+
+static int run_send_benchmark(bool at_most_once, PERF_MEASUREMENT* measurement)
+{
+    int result = 0;
+    IOTHUB_CLIENT_CONFIG client_config;
+    IOTHUB_DEVICE_CLIENT_LL_HANDLE device_ll_handle;
+
+    (void)memset(&client_config, 0, sizeof(client_config));
+    client_config.protocol = StandinMQTT_Protocol;
+    client_config.deviceId = "perf-device";
+    client_config.deviceKey = "cGVyZi1kZXZpY2Uta2V5";
+    client_config.iotHubName = "perf";
+    client_config.iotHubSuffix = "azure-devices.net";
+
+    if ((device_ll_handle = IoTHubDeviceClient_LL_Create(&client_config)) == NULL)
+    {
+        LogError("Failed creating the device client");
+        result = MU_FAILURE;
+    }
+    else if (IoTHubDeviceClient_LL_SetOption(device_ll_handle, OPTION_MQTT_TELEMETRY_AT_MOST_ONCE, &at_most_once) != IOTHUB_CLIENT_OK)
+    {
+        LogError("Failed setting %s", OPTION_MQTT_TELEMETRY_AT_MOST_ONCE);
+        IoTHubDeviceClient_LL_Destroy(device_ll_handle);
+        result = MU_FAILURE;
+    }
+    else
+    {
+        unsigned char payload[PERF_PAYLOAD_SIZE];
+        size_t index;
+
+        (void)memset(payload, 'x', sizeof(payload));
+        g_qos0_publish_count = 0;
+        g_qos1_publish_count = 0;
+        g_confirmation_count = 0;
+
+        // Connect before measuring, so both runs only time the telemetry.
+        IoTHubDeviceClient_LL_DoWork(device_ll_handle);
+        IoTHubDeviceClient_LL_DoWork(device_ll_handle);
+
+        perf_measurement_start(measurement);
+
+        for (index = 0; index < PERF_MESSAGE_COUNT && result == 0; index++)
+        {
+            IOTHUB_MESSAGE_HANDLE message_handle;
+
+            if ((message_handle = IoTHubMessage_CreateFromByteArray(payload, sizeof(payload))) == NULL)
+            {
+                LogError("Failed creating message %lu", (unsigned long)index);
+                result = MU_FAILURE;
+            }
+            else
+            {
+                if (IoTHubDeviceClient_LL_SendEventAsync(device_ll_handle, message_handle, send_confirmation_callback, NULL) != IOTHUB_CLIENT_OK)
+                {
+                    LogError("IoTHubDeviceClient_LL_SendEventAsync failed");
+                    result = MU_FAILURE;
+                }
+                IoTHubMessage_Destroy(message_handle);
+            }
+
+            if ((index + 1) % PERF_DOWORK_INTERVAL == 0)
+            {
+                IoTHubDeviceClient_LL_DoWork(device_ll_handle);
+            }
+        }
+
+        for (index = 0; index < PERF_MAX_DRAIN_DOWORKS && result == 0 && g_confirmation_count < PERF_MESSAGE_COUNT; index++)
+        {
+            IoTHubDeviceClient_LL_DoWork(device_ll_handle);
+        }
+
+        perf_measurement_stop(measurement);
+
+        if (result == 0 && g_confirmation_count != PERF_MESSAGE_COUNT)
+        {
+            LogError("Expected %lu confirmations, got %lu", (unsigned long)PERF_MESSAGE_COUNT, (unsigned long)g_confirmation_count);
+            result = MU_FAILURE;
+        }
+        else if (result == 0 && (at_most_once ? g_qos0_publish_count : g_qos1_publish_count) != PERF_MESSAGE_COUNT)
+        {
+            LogError("The broker stand-in received %lu QoS 0 and %lu QoS 1 publishes", (unsigned long)g_qos0_publish_count, (unsigned long)g_qos1_publish_count);
+            result = MU_FAILURE;
+        }
+
+        IoTHubDeviceClient_LL_Destroy(device_ll_handle);
+    }
+
+    return result;
+}
+
+int main(void)
+{
+    int result;
+    PERF_MEASUREMENT measurement;
+
+    if (platform_init() != 0)
+    {
+        LogError("Failed initializing the platform");
+        result = MU_FAILURE;
+    }
+    else
+    {
+        if (perf_measurement_init(&measurement) != 0)
+        {
+            LogError("Failed initializing the measurement");
+            result = MU_FAILURE;
+        }
+        else
+        {
+            if (run_send_benchmark(false, &measurement) != 0)
+            {
+                result = MU_FAILURE;
+            }
+            else
+            {
+                perf_measurement_print(&measurement, "MQTT telemetry (QoS 1)", PERF_MESSAGE_COUNT);
+
+                if (run_send_benchmark(true, &measurement) != 0)
+                {
+                    result = MU_FAILURE;
+                }
+                else
+                {
+                    perf_measurement_print(&measurement, "MQTT telemetry (QoS 0, mqtt_telemetry_at_most_once)", PERF_MESSAGE_COUNT);
+                    result = 0;
+                }
+            }
+
+            perf_measurement_deinit(&measurement);
+        }
+
+        platform_deinit();
+    }
+
+    return result;
+}
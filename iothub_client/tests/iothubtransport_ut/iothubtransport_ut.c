@@ -37,6 +37,7 @@ static void my_gballoc_free(void* ptr)
 #define ENABLE_MOCKS
 #include "azure_c_shared_utility/threadapi.h"
 #include "azure_c_shared_utility/lock.h"
+#include "azure_c_shared_utility/condition.h"
 #include "azure_c_shared_utility/xlogging.h"
 #include "azure_c_shared_utility/vector.h"
 #include "azure_c_shared_utility/crt_abstractions.h"
@@ -117,6 +118,7 @@ static const IOTHUB_CLIENT_CORE_HANDLE TEST_IOTHUB_CLIENT_CORE_HANDLE1 = (IOTHUB
 static const TRANSPORT_LL_HANDLE TEST_TRANSPORT_LL_HANDLE = (TRANSPORT_LL_HANDLE)0x112233;
 static const LOCK_HANDLE TEST_LOCK_HANDLE = (LOCK_HANDLE)0x4443;
 static const VECTOR_HANDLE TEST_VECTOR_HANDLE = (VECTOR_HANDLE)0x4444;
+static const COND_HANDLE TEST_COND_HANDLE = (COND_HANDLE)0x4446;
 
 #define TEST_HOSTNAME_TOKEN "HostName"
 #define TEST_HOSTNAME_VALUE "theNameoftheIotHub.theSuffixoftheIotHubHostname"
@@ -290,6 +292,8 @@ TEST_SUITE_INITIALIZE(suite_init)
     REGISTER_UMOCK_ALIAS_TYPE(PREDICATE_FUNCTION, void*);
     REGISTER_UMOCK_ALIAS_TYPE(IOTHUB_CLIENT_CORE_LL_HANDLE, void*);
     REGISTER_UMOCK_ALIAS_TYPE(LOCK_RESULT, int);
+    REGISTER_UMOCK_ALIAS_TYPE(COND_HANDLE, void*);
+    REGISTER_UMOCK_ALIAS_TYPE(COND_RESULT, int);
 
     REGISTER_GLOBAL_MOCK_HOOK(gballoc_malloc, my_gballoc_malloc);
     REGISTER_GLOBAL_MOCK_FAIL_RETURN(gballoc_malloc, NULL);
@@ -308,6 +312,11 @@ TEST_SUITE_INITIALIZE(suite_init)
     REGISTER_GLOBAL_MOCK_RETURN(Lock, LOCK_OK);
     REGISTER_GLOBAL_MOCK_FAIL_RETURN(Lock, LOCK_ERROR);
 
+    REGISTER_GLOBAL_MOCK_RETURN(Condition_Init, TEST_COND_HANDLE);
+    REGISTER_GLOBAL_MOCK_FAIL_RETURN(Condition_Init, NULL);
+    REGISTER_GLOBAL_MOCK_RETURN(Condition_Post, COND_OK);
+    REGISTER_GLOBAL_MOCK_RETURN(Condition_Wait, COND_TIMEOUT);
+
     REGISTER_GLOBAL_MOCK_HOOK(VECTOR_create, real_VECTOR_create);
     REGISTER_GLOBAL_MOCK_FAIL_RETURN(VECTOR_create, NULL);
     REGISTER_GLOBAL_MOCK_HOOK(VECTOR_move, real_VECTOR_move);
@@ -843,6 +852,364 @@ TEST_FUNCTION(IoTHubTransport_worker_thread_runs_every_1_ms)
     IoTHubTransport_Destroy(handle);
 }
 
+//Tests_SRS_IOTHUBTRANSPORT_44_001: [ If transportHandle is NULL or idleTimeInMs is 0, IoTHubTransport_SetWorkerIdleTime shall return IOTHUB_CLIENT_INVALID_ARG. ]
+TEST_FUNCTION(IoTHubTransport_SetWorkerIdleTime_handle_NULL_fail)
+{
+    //arrange
+
+    //act
+    IOTHUB_CLIENT_RESULT result = IoTHubTransport_SetWorkerIdleTime(NULL, 100);
+
+    //assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    //cleanup
+}
+
+//Tests_SRS_IOTHUBTRANSPORT_44_001: [ If transportHandle is NULL or idleTimeInMs is 0, IoTHubTransport_SetWorkerIdleTime shall return IOTHUB_CLIENT_INVALID_ARG. ]
+TEST_FUNCTION(IoTHubTransport_SetWorkerIdleTime_idle_time_0_fail)
+{
+    //arrange
+    TRANSPORT_HANDLE handle = NULL;
+    handle = IoTHubTransport_Create(TEST_CONFIG.protocol, TEST_CONFIG.iotHubName, TEST_CONFIG.iotHubSuffix);
+    umock_c_reset_all_calls();
+
+    //act
+    IOTHUB_CLIENT_RESULT result = IoTHubTransport_SetWorkerIdleTime(handle, 0);
+
+    //assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    //cleanup
+    IoTHubTransport_Destroy(handle);
+}
+
+//Tests_SRS_IOTHUBTRANSPORT_44_014: [ IoTHubTransport_SetWorkerIdleTime shall hold the transport lock while it changes the idle time, and return IOTHUB_CLIENT_ERROR if it cannot be acquired. ]
+TEST_FUNCTION(IoTHubTransport_SetWorkerIdleTime_Lock_fail)
+{
+    //arrange
+    TRANSPORT_HANDLE handle = NULL;
+    handle = IoTHubTransport_Create(TEST_CONFIG.protocol, TEST_CONFIG.iotHubName, TEST_CONFIG.iotHubSuffix);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(Lock(IGNORED_PTR_ARG)).SetReturn(LOCK_ERROR);
+
+    //act
+    IOTHUB_CLIENT_RESULT result = IoTHubTransport_SetWorkerIdleTime(handle, 100);
+
+    //assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_ERROR, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    //cleanup
+    IoTHubTransport_Destroy(handle);
+}
+
+//Tests_SRS_IOTHUBTRANSPORT_44_002: [ IoTHubTransport_SetWorkerIdleTime shall create the condition the worker thread waits on, and return IOTHUB_CLIENT_ERROR if it cannot be created. ]
+TEST_FUNCTION(IoTHubTransport_SetWorkerIdleTime_Condition_Init_fail)
+{
+    //arrange
+    TRANSPORT_HANDLE handle = NULL;
+    handle = IoTHubTransport_Create(TEST_CONFIG.protocol, TEST_CONFIG.iotHubName, TEST_CONFIG.iotHubSuffix);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(Lock(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(Condition_Init()).SetReturn(NULL);
+    STRICT_EXPECTED_CALL(Unlock(IGNORED_PTR_ARG));
+
+    //act
+    IOTHUB_CLIENT_RESULT result = IoTHubTransport_SetWorkerIdleTime(handle, 100);
+
+    //assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_ERROR, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    //cleanup
+    IoTHubTransport_Destroy(handle);
+}
+
+//Tests_SRS_IOTHUBTRANSPORT_44_002: [ IoTHubTransport_SetWorkerIdleTime shall create the condition the worker thread waits on, and return IOTHUB_CLIENT_ERROR if it cannot be created. ]
+//Tests_SRS_IOTHUBTRANSPORT_44_003: [ IoTHubTransport_SetWorkerIdleTime shall save idleTimeInMs and return IOTHUB_CLIENT_OK. ]
+TEST_FUNCTION(IoTHubTransport_SetWorkerIdleTime_creates_the_condition_once_succeed)
+{
+    //arrange
+    TRANSPORT_HANDLE handle = NULL;
+    handle = IoTHubTransport_Create(TEST_CONFIG.protocol, TEST_CONFIG.iotHubName, TEST_CONFIG.iotHubSuffix);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(Lock(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(Condition_Init());
+    STRICT_EXPECTED_CALL(Unlock(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(Lock(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(Unlock(IGNORED_PTR_ARG));
+
+    //act
+    IOTHUB_CLIENT_RESULT result1 = IoTHubTransport_SetWorkerIdleTime(handle, 100);
+    IOTHUB_CLIENT_RESULT result2 = IoTHubTransport_SetWorkerIdleTime(handle, 200);
+
+    //assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result1);
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result2);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    //cleanup
+    umock_c_reset_all_calls();
+    STRICT_EXPECTED_CALL(Condition_Deinit(TEST_COND_HANDLE));
+    IoTHubTransport_Destroy(handle);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+//Tests_SRS_IOTHUBTRANSPORT_44_005: [ If transportHandle is NULL, IoTHubTransport_SignalWork shall return. ]
+TEST_FUNCTION(IoTHubTransport_SignalWork_handle_NULL_fail)
+{
+    //arrange
+
+    //act
+    IoTHubTransport_SignalWork(NULL);
+
+    //assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    //cleanup
+}
+
+//Tests_SRS_IOTHUBTRANSPORT_44_006: [ IoTHubTransport_SignalWork shall wake up the worker thread if it is waiting for the idle time. ]
+TEST_FUNCTION(IoTHubTransport_SignalWork_without_idle_time_does_nothing)
+{
+    //arrange
+    TRANSPORT_HANDLE handle = NULL;
+    handle = IoTHubTransport_Create(TEST_CONFIG.protocol, TEST_CONFIG.iotHubName, TEST_CONFIG.iotHubSuffix);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(Lock(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(Unlock(IGNORED_PTR_ARG));
+
+    //act
+    IoTHubTransport_SignalWork(handle);
+
+    //assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    //cleanup
+    IoTHubTransport_Destroy(handle);
+}
+
+//Tests_SRS_IOTHUBTRANSPORT_44_015: [ IoTHubTransport_SignalWork shall hold the transport lock while it signals the worker thread, so the signal cannot be lost between the worker thread checking for work and starting to wait. ]
+//Tests_SRS_IOTHUBTRANSPORT_44_006: [ IoTHubTransport_SignalWork shall wake up the worker thread if it is waiting for the idle time. ]
+TEST_FUNCTION(IoTHubTransport_SignalWork_posts_the_condition_succeed)
+{
+    //arrange
+    TRANSPORT_HANDLE handle = NULL;
+    handle = IoTHubTransport_Create(TEST_CONFIG.protocol, TEST_CONFIG.iotHubName, TEST_CONFIG.iotHubSuffix);
+    (void)IoTHubTransport_SetWorkerIdleTime(handle, 100);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(Lock(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(Condition_Post(TEST_COND_HANDLE));
+    STRICT_EXPECTED_CALL(Unlock(IGNORED_PTR_ARG));
+
+    //act
+    IoTHubTransport_SignalWork(handle);
+
+    //assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    //cleanup
+    IoTHubTransport_Destroy(handle);
+}
+
+//Tests_SRS_IOTHUBTRANSPORT_44_015: [ IoTHubTransport_SignalWork shall hold the transport lock while it signals the worker thread, so the signal cannot be lost between the worker thread checking for work and starting to wait. ]
+TEST_FUNCTION(IoTHubTransport_SignalWork_Lock_fail_does_not_post)
+{
+    //arrange
+    TRANSPORT_HANDLE handle = NULL;
+    handle = IoTHubTransport_Create(TEST_CONFIG.protocol, TEST_CONFIG.iotHubName, TEST_CONFIG.iotHubSuffix);
+    (void)IoTHubTransport_SetWorkerIdleTime(handle, 100);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(Lock(IGNORED_PTR_ARG)).SetReturn(LOCK_ERROR);
+
+    //act
+    IoTHubTransport_SignalWork(handle);
+
+    //assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    //cleanup
+    IoTHubTransport_Destroy(handle);
+}
+
+//Tests_SRS_IOTHUBTRANSPORT_44_004: [ Once IoTHubTransport_SetWorkerIdleTime is called, the thread shall wait for the idle time between calls to lower layer transport DoWork, unless IoTHubTransport_SignalWork is called. ]
+TEST_FUNCTION(IoTHubTransport_worker_thread_waits_for_the_idle_time)
+{
+    //arrange
+    TRANSPORT_HANDLE handle = NULL;
+    handle = IoTHubTransport_Create(TEST_CONFIG.protocol, TEST_CONFIG.iotHubName, TEST_CONFIG.iotHubSuffix);
+    (void)IoTHubTransport_StartWorkerThread(handle, TEST_IOTHUB_CLIENT_CORE_HANDLE1, clientDoWork);
+    (void)IoTHubTransport_SetWorkerIdleTime(handle, 250);
+    g_transport_handle = handle;
+    umock_c_reset_all_calls();
+
+    g_how_many_dowork_calls = 1;
+
+    STRICT_EXPECTED_CALL(Lock(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(FAKE_IoTHubTransport_DoWork(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(Unlock(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(Lock(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(VECTOR_size(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(VECTOR_element(IGNORED_PTR_ARG, IGNORED_NUM_ARG));
+    STRICT_EXPECTED_CALL(Unlock(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(Lock(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(Condition_Wait(TEST_COND_HANDLE, IGNORED_PTR_ARG, 250));
+    STRICT_EXPECTED_CALL(Unlock(IGNORED_PTR_ARG));
+
+    // For stopping the threading
+    STRICT_EXPECTED_CALL(Lock(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(FAKE_IoTHubTransport_DoWork(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(Lock(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(VECTOR_erase(IGNORED_PTR_ARG, IGNORED_PTR_ARG, 1));
+    STRICT_EXPECTED_CALL(VECTOR_size(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(Lock(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(Condition_Post(TEST_COND_HANDLE));
+    STRICT_EXPECTED_CALL(Unlock(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(Unlock(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(Unlock(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(Lock(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(VECTOR_size(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(Unlock(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(Lock(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(Unlock(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(Lock(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(Unlock(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(ThreadAPI_Exit(IGNORED_NUM_ARG));
+
+    //act
+    threadFunc(threadFuncArg);
+
+    //assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    //cleanup
+    (void)IoTHubTransport_SignalEndWorkerThread(handle, TEST_IOTHUB_CLIENT_CORE_HANDLE1);
+    IoTHubTransport_Destroy(handle);
+}
+
+//Tests_SRS_IOTHUBTRANSPORT_44_008: [ If transportHandle is NULL, or threadCount is 0 or greater than 64, IoTHubTransport_SetWorkerThreadCount shall return IOTHUB_CLIENT_INVALID_ARG. ]
+TEST_FUNCTION(IoTHubTransport_SetWorkerThreadCount_handle_NULL_fail)
+{
+    //arrange
+
+    //act
+    IOTHUB_CLIENT_RESULT result = IoTHubTransport_SetWorkerThreadCount(NULL, 2);
+
+    //assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    //cleanup
+}
+
+//Tests_SRS_IOTHUBTRANSPORT_44_008: [ If transportHandle is NULL, or threadCount is 0 or greater than 64, IoTHubTransport_SetWorkerThreadCount shall return IOTHUB_CLIENT_INVALID_ARG. ]
+TEST_FUNCTION(IoTHubTransport_SetWorkerThreadCount_thread_count_out_of_range_fail)
+{
+    //arrange
+    TRANSPORT_HANDLE handle = NULL;
+    handle = IoTHubTransport_Create(TEST_CONFIG.protocol, TEST_CONFIG.iotHubName, TEST_CONFIG.iotHubSuffix);
+    umock_c_reset_all_calls();
+
+    //act
+    IOTHUB_CLIENT_RESULT result1 = IoTHubTransport_SetWorkerThreadCount(handle, 0);
+    IOTHUB_CLIENT_RESULT result2 = IoTHubTransport_SetWorkerThreadCount(handle, 65);
+
+    //assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result1);
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result2);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    //cleanup
+    IoTHubTransport_Destroy(handle);
+}
+
+//Tests_SRS_IOTHUBTRANSPORT_44_009: [ If the worker thread is running, IoTHubTransport_SetWorkerThreadCount shall return IOTHUB_CLIENT_ERROR unless threadCount is the current number of threads. ]
+TEST_FUNCTION(IoTHubTransport_SetWorkerThreadCount_worker_running_fail)
+{
+    //arrange
+    TRANSPORT_HANDLE handle = NULL;
+    handle = IoTHubTransport_Create(TEST_CONFIG.protocol, TEST_CONFIG.iotHubName, TEST_CONFIG.iotHubSuffix);
+    (void)IoTHubTransport_StartWorkerThread(handle, TEST_IOTHUB_CLIENT_CORE_HANDLE1, clientDoWork);
+    umock_c_reset_all_calls();
+
+    //act
+    IOTHUB_CLIENT_RESULT result1 = IoTHubTransport_SetWorkerThreadCount(handle, 1);
+    IOTHUB_CLIENT_RESULT result2 = IoTHubTransport_SetWorkerThreadCount(handle, 4);
+
+    //assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result1);
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_ERROR, result2);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    //cleanup
+    (void)IoTHubTransport_SignalEndWorkerThread(handle, TEST_IOTHUB_CLIENT_CORE_HANDLE1);
+    IoTHubTransport_Destroy(handle);
+}
+
+//Tests_SRS_IOTHUBTRANSPORT_44_010: [ IoTHubTransport_SetWorkerThreadCount shall create a list of clients and a lock for each thread but the worker thread, and return IOTHUB_CLIENT_ERROR if any cannot be created. ]
+TEST_FUNCTION(IoTHubTransport_SetWorkerThreadCount_succeed)
+{
+    //arrange
+    TRANSPORT_HANDLE handle = NULL;
+    handle = IoTHubTransport_Create(TEST_CONFIG.protocol, TEST_CONFIG.iotHubName, TEST_CONFIG.iotHubSuffix);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
+    STRICT_EXPECTED_CALL(Lock_Init());
+    STRICT_EXPECTED_CALL(VECTOR_create(IGNORED_NUM_ARG));
+    STRICT_EXPECTED_CALL(Lock_Init());
+    STRICT_EXPECTED_CALL(VECTOR_create(IGNORED_NUM_ARG));
+
+    //act
+    IOTHUB_CLIENT_RESULT result = IoTHubTransport_SetWorkerThreadCount(handle, 3);
+
+    //assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    //cleanup
+    IoTHubTransport_Destroy(handle);
+}
+
+//Tests_SRS_IOTHUBTRANSPORT_44_010: [ IoTHubTransport_SetWorkerThreadCount shall create a list of clients and a lock for each thread but the worker thread, and return IOTHUB_CLIENT_ERROR if any cannot be created. ]
+TEST_FUNCTION(IoTHubTransport_SetWorkerThreadCount_VECTOR_create_fail)
+{
+    //arrange
+    TRANSPORT_HANDLE handle = NULL;
+    handle = IoTHubTransport_Create(TEST_CONFIG.protocol, TEST_CONFIG.iotHubName, TEST_CONFIG.iotHubSuffix);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
+    STRICT_EXPECTED_CALL(Lock_Init());
+    STRICT_EXPECTED_CALL(VECTOR_create(IGNORED_NUM_ARG));
+    STRICT_EXPECTED_CALL(Lock_Init());
+    STRICT_EXPECTED_CALL(VECTOR_create(IGNORED_NUM_ARG)).SetReturn(NULL);
+    STRICT_EXPECTED_CALL(Lock_Deinit(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(VECTOR_destroy(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(Lock_Deinit(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG));
+
+    //act
+    IOTHUB_CLIENT_RESULT result = IoTHubTransport_SetWorkerThreadCount(handle, 3);
+
+    //assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_ERROR, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    //cleanup
+    IoTHubTransport_Destroy(handle);
+}
+
 TEST_FUNCTION(IoTHubTransport_JoinWorkerThread_handle_NULL_fail)
 {
     //arrange
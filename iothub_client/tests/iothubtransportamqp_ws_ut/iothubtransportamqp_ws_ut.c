@@ -1250,4 +1250,23 @@ TEST_FUNCTION(AMQP_GetSupportedPlatformInfo_NULL_info)
     // cleanup
 }
 
+// Tests_SRS_IOTHUBTRANSPORTAMQP_WS_44_001: [IoTHubTransportAMQP_WS_GetRttStatistics shall return IOTHUB_CLIENT_ERROR as the round trip time is only measured by MQTT]
+TEST_FUNCTION(AMQP_GetRttStatistics)
+{
+    // arrange
+    TRANSPORT_PROVIDER* provider = (TRANSPORT_PROVIDER*)AMQP_Protocol_over_WebSocketsTls();
+    IOTHUB_CLIENT_RTT_STATISTICS rtt_statistics;
+
+    umock_c_reset_all_calls();
+
+    // act
+    IOTHUB_CLIENT_RESULT result = provider->IoTHubTransport_GetRttStatistics(TEST_TRANSPORT_LL_HANDLE, &rtt_statistics);
+
+    // assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_ARE_EQUAL(int, IOTHUB_CLIENT_ERROR, result);
+
+    // cleanup
+}
+
 END_TEST_SUITE(iothubtransportamqp_ws_ut)
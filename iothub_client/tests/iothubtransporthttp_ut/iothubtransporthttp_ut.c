@@ -31,6 +31,11 @@ static void my_gballoc_free(void* ptr)
     free(ptr);
 }
 
+static void* my_gballoc_realloc(void* ptr, size_t size)
+{
+    return realloc(ptr, size);
+}
+
 #define ENABLE_MOCKS
 #include "azure_c_shared_utility/gballoc.h"
 #include "azure_c_shared_utility/optimize_size.h"
@@ -46,6 +51,8 @@ static void my_gballoc_free(void* ptr)
 #include "azure_c_shared_utility/vector_types_internal.h"
 #include "azure_c_shared_utility/lock.h"
 #include "azure_c_shared_utility/agenttime.h"
+#include "azure_c_shared_utility/threadapi.h"
+#include "azure_c_shared_utility/condition.h"
 
 #include "iothub_client_options.h"
 #include "iothub_client_version.h"
@@ -106,6 +113,8 @@ extern "C" {
     extern int real_DList_RemoveEntryList(PDLIST_ENTRY listEntry);
     extern PDLIST_ENTRY real_DList_RemoveHeadList(PDLIST_ENTRY listHead);
 
+    extern const size_t IoTHubTransportHttp_ConnectionWorkOffset;
+
 #ifdef __cplusplus
 }
 #endif
@@ -157,6 +166,8 @@ IMPLEMENT_UMOCK_C_ENUM_TYPE(PLATFORM_INFO_OPTION, PLATFORM_INFO_OPTION_VALUES);
 #define TEST_PROPERTY_A_VALUE "value_of_a"
 
 #define TEST_HTTPAPIEX_HANDLE (HTTPAPIEX_HANDLE)0x343
+#define TEST_LOCK_HANDLE (LOCK_HANDLE)0x344
+#define TEST_COND_HANDLE (COND_HANDLE)0x345
 
 //static const bool thisIsTrue = true;
 //static const bool thisIsFalse = false;
@@ -522,6 +533,7 @@ static pfIoTHubTransport_DoWork                         IoTHubTransportHttp_DoWo
 static pfIoTHubTransport_GetSendStatus                  IoTHubTransportHttp_GetSendStatus;
 static pfIoTHubTransport_SetCallbackContext             IoTHubTransportHttp_SetCallbackContext;
 static pfIoTHubTransport_GetSupportedPlatformInfo       IoTHubTransportHttp_GetSupportedPlatformInfo;
+static pfIoTHubTransport_GetRttStatistics               IoTHubTransportHttp_GetRttStatistics;
 
 static TEST_MUTEX_HANDLE g_testByTest;
 
@@ -551,6 +563,25 @@ static void my_HTTPAPIEX_Destroy(HTTPAPIEX_HANDLE handle)
     my_gballoc_free(handle);
 }
 
+static void* g_connection_thread_arg;
+static THREADAPI_RESULT my_ThreadAPI_Create(THREAD_HANDLE* threadHandle, THREAD_START_FUNC func, void* arg)
+{
+    (void)func;
+    *threadHandle = (THREAD_HANDLE)0x346;
+    g_connection_thread_arg = arg;
+    return THREADAPI_OK;
+}
+
+/*no pool thread runs in the unittests, the wait finishes the pass in its place*/
+static COND_RESULT my_Condition_Wait(COND_HANDLE handle, LOCK_HANDLE lock, int timeout_milliseconds)
+{
+    (void)handle;
+    (void)lock;
+    (void)timeout_milliseconds;
+    *(bool*)((char*)g_connection_thread_arg + IoTHubTransportHttp_ConnectionWorkOffset) = false;
+    return COND_OK;
+}
+
 static IOTHUB_CLIENT_RESULT my_IoTHubClientCore_LL_GetOption(IOTHUB_CLIENT_CORE_LL_HANDLE handle, const char* option, void** value)
 {
     (void)handle;
@@ -935,6 +966,7 @@ static void setupUnregisterOneDevice()
     STRICT_EXPECTED_CALL(STRING_delete(IGNORED_PTR_ARG));
     STRICT_EXPECTED_CALL(HTTPHeaders_Free(IGNORED_PTR_ARG));
     STRICT_EXPECTED_CALL(HTTPHeaders_Free(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(HTTPHeaders_Free(IGNORED_PTR_ARG));
     STRICT_EXPECTED_CALL(STRING_delete(IGNORED_PTR_ARG));
     STRICT_EXPECTED_CALL(HTTPAPIEX_SAS_Destroy(IGNORED_PTR_ARG));
 }
@@ -1006,7 +1038,7 @@ static void setupRegisterHappyPathmessageHTTPrelativePath(bool deallocateCreated
     STRICT_EXPECTED_CALL(STRING_delete(IGNORED_PTR_ARG));
 }
 
-static void setupRegisterHappyPatheventHTTPrequestHeaders(bool deallocateCreated, bool is_x509_used)
+static void setupRegisterHappyPatheventHTTPrequestHeaders(bool deallocateCreated, const char* authorization)
 {
     STRICT_EXPECTED_CALL(HTTPHeaders_Alloc());
     STRICT_EXPECTED_CALL(STRING_construct("/devices/"));
@@ -1015,14 +1047,15 @@ static void setupRegisterHappyPatheventHTTPrequestHeaders(bool deallocateCreated
     STRICT_EXPECTED_CALL(STRING_concat(IGNORED_PTR_ARG, EVENT_ENDPOINT));
     STRICT_EXPECTED_CALL(STRING_c_str(IGNORED_PTR_ARG));
     STRICT_EXPECTED_CALL(HTTPHeaders_AddHeaderNameValuePair(IGNORED_PTR_ARG, "iothub-to", "/devices/"  TEST_DEVICE_ID  EVENT_ENDPOINT));
-    if (is_x509_used == false)
+    if (authorization != NULL)
     {
-        STRICT_EXPECTED_CALL(HTTPHeaders_AddHeaderNameValuePair(IGNORED_PTR_ARG, "Authorization", TEST_BLANK_SAS_TOKEN));
+        STRICT_EXPECTED_CALL(HTTPHeaders_AddHeaderNameValuePair(IGNORED_PTR_ARG, "Authorization", authorization));
     }
     STRICT_EXPECTED_CALL(HTTPHeaders_AddHeaderNameValuePair(IGNORED_PTR_ARG, "Accept", "application/json"));
     STRICT_EXPECTED_CALL(HTTPHeaders_AddHeaderNameValuePair(IGNORED_PTR_ARG, "Connection", "Keep-Alive"));
     STRICT_EXPECTED_CALL(Transport_GetOption_Product_Info_Callback(IGNORED_PTR_ARG));
     STRICT_EXPECTED_CALL(HTTPHeaders_AddHeaderNameValuePair(IGNORED_PTR_ARG, "User-Agent", TEST_PRODUCT_INFO));
+    STRICT_EXPECTED_CALL(HTTPHeaders_AddHeaderNameValuePair(IGNORED_PTR_ARG, "Content-Type", "application/vnd.microsoft.iothub.json"));
     if (deallocateCreated == true)
     {
         STRICT_EXPECTED_CALL(HTTPHeaders_Free(IGNORED_PTR_ARG));
@@ -1031,14 +1064,24 @@ static void setupRegisterHappyPatheventHTTPrequestHeaders(bool deallocateCreated
     STRICT_EXPECTED_CALL(STRING_delete(IGNORED_PTR_ARG));
 }
 
-static void setupRegisterHappyPathmessageHTTPrequestHeaders(bool deallocateCreated, bool is_x509_used)
+static void setupRegisterHappyPathsingleEventHTTPrequestHeaders(bool deallocateCreated)
+{
+    STRICT_EXPECTED_CALL(HTTPHeaders_Clone(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(HTTPHeaders_ReplaceHeaderNameValuePair(IGNORED_PTR_ARG, "Content-Type", "application/octet-stream"));
+    if (deallocateCreated == true)
+    {
+        STRICT_EXPECTED_CALL(HTTPHeaders_Free(IGNORED_PTR_ARG));
+    }
+}
+
+static void setupRegisterHappyPathmessageHTTPrequestHeaders(bool deallocateCreated, const char* authorization)
 {
     STRICT_EXPECTED_CALL(HTTPHeaders_Alloc());
     STRICT_EXPECTED_CALL(Transport_GetOption_Product_Info_Callback(IGNORED_PTR_ARG));
     STRICT_EXPECTED_CALL(HTTPHeaders_AddHeaderNameValuePair(IGNORED_PTR_ARG, "User-Agent", TEST_PRODUCT_INFO));
-    if (is_x509_used == false)
+    if (authorization != NULL)
     {
-        STRICT_EXPECTED_CALL(HTTPHeaders_AddHeaderNameValuePair(IGNORED_PTR_ARG, "Authorization", TEST_BLANK_SAS_TOKEN));
+        STRICT_EXPECTED_CALL(HTTPHeaders_AddHeaderNameValuePair(IGNORED_PTR_ARG, "Authorization", authorization));
     }
     if (deallocateCreated == true)
     {
@@ -1098,8 +1141,9 @@ static void setupRegisterHappyPathWithSasToken(bool deallocateCreated)
     setupRegisterHappyPathcreate_deviceSasToken(deallocateCreated);
     setupRegisterHappyPatheventHTTPrelativePath(deallocateCreated);
     setupRegisterHappyPathmessageHTTPrelativePath(deallocateCreated);
-    setupRegisterHappyPatheventHTTPrequestHeaders(deallocateCreated, false);
-    setupRegisterHappyPathmessageHTTPrequestHeaders(deallocateCreated, false);
+    setupRegisterHappyPatheventHTTPrequestHeaders(deallocateCreated, TEST_DEVICE_TOKEN);
+    setupRegisterHappyPathsingleEventHTTPrequestHeaders(deallocateCreated);
+    setupRegisterHappyPathmessageHTTPrequestHeaders(deallocateCreated, TEST_DEVICE_TOKEN);
     setupRegisterHappyPathabandonHTTPrelativePathBegin(deallocateCreated);
     setupRegisterHappyPathDeviceListAdd();
     setupRegisterHappyPatheventConfirmations();
@@ -1113,8 +1157,9 @@ static void setupRegisterHappyPath(bool deallocateCreated, bool is_x509_used)
     setupRegisterHappyPathcreate_deviceKey(deallocateCreated, is_x509_used);
     setupRegisterHappyPatheventHTTPrelativePath(deallocateCreated);
     setupRegisterHappyPathmessageHTTPrelativePath(deallocateCreated);
-    setupRegisterHappyPatheventHTTPrequestHeaders(deallocateCreated, is_x509_used);
-    setupRegisterHappyPathmessageHTTPrequestHeaders(deallocateCreated, is_x509_used);
+    setupRegisterHappyPatheventHTTPrequestHeaders(deallocateCreated, is_x509_used ? NULL : TEST_BLANK_SAS_TOKEN);
+    setupRegisterHappyPathsingleEventHTTPrequestHeaders(deallocateCreated);
+    setupRegisterHappyPathmessageHTTPrequestHeaders(deallocateCreated, is_x509_used ? NULL : TEST_BLANK_SAS_TOKEN);
     setupRegisterHappyPathabandonHTTPrelativePathBegin(deallocateCreated);
     setupRegisterHappyPathsasObject(deallocateCreated, is_x509_used);
     setupRegisterHappyPathDeviceListAdd();
@@ -1178,10 +1223,16 @@ TEST_SUITE_INITIALIZE(suite_init)
 
     REGISTER_UMOCK_ALIAS_TYPE(IOTHUB_CLIENT_CONFIRMATION_RESULT, int);
     REGISTER_UMOCK_ALIAS_TYPE(IOTHUB_MESSAGE_RESULT, int);
+    REGISTER_UMOCK_ALIAS_TYPE(THREAD_HANDLE, void*);
+    REGISTER_UMOCK_ALIAS_TYPE(THREAD_START_FUNC, void*);
+    REGISTER_UMOCK_ALIAS_TYPE(THREADAPI_RESULT, int);
+    REGISTER_UMOCK_ALIAS_TYPE(HTTPAPI_RESULT, int);
 
     REGISTER_GLOBAL_MOCK_HOOK(gballoc_malloc, my_gballoc_malloc);
     REGISTER_GLOBAL_MOCK_FAIL_RETURN(gballoc_malloc, NULL);
     REGISTER_GLOBAL_MOCK_HOOK(gballoc_free, my_gballoc_free);
+    REGISTER_GLOBAL_MOCK_HOOK(gballoc_realloc, my_gballoc_realloc);
+    REGISTER_GLOBAL_MOCK_FAIL_RETURN(gballoc_realloc, NULL);
 
     REGISTER_GLOBAL_MOCK_RETURN(Transport_GetOption_Product_Info_Callback, TEST_PRODUCT_INFO);
     REGISTER_GLOBAL_MOCK_FAIL_RETURN(Transport_GetOption_Product_Info_Callback, NULL);
@@ -1217,6 +1268,17 @@ TEST_SUITE_INITIALIZE(suite_init)
     REGISTER_GLOBAL_MOCK_FAIL_RETURN(HTTPAPIEX_Init, HTTPAPIEX_ERROR);
     REGISTER_GLOBAL_MOCK_FAIL_RETURN(HTTPAPIEX_Create, NULL);
     REGISTER_GLOBAL_MOCK_HOOK(HTTPAPIEX_Destroy, my_HTTPAPIEX_Destroy);
+    REGISTER_GLOBAL_MOCK_HOOK(ThreadAPI_Create, my_ThreadAPI_Create);
+    REGISTER_GLOBAL_MOCK_FAIL_RETURN(ThreadAPI_Create, THREADAPI_ERROR);
+    REGISTER_GLOBAL_MOCK_RETURN(ThreadAPI_Join, THREADAPI_OK);
+    REGISTER_GLOBAL_MOCK_RETURN(Lock_Init, TEST_LOCK_HANDLE);
+    REGISTER_GLOBAL_MOCK_FAIL_RETURN(Lock_Init, NULL);
+    REGISTER_GLOBAL_MOCK_RETURN(Lock, LOCK_OK);
+    REGISTER_GLOBAL_MOCK_RETURN(Unlock, LOCK_OK);
+    REGISTER_GLOBAL_MOCK_RETURN(Condition_Init, TEST_COND_HANDLE);
+    REGISTER_GLOBAL_MOCK_FAIL_RETURN(Condition_Init, NULL);
+    REGISTER_GLOBAL_MOCK_RETURN(Condition_Post, COND_OK);
+    REGISTER_GLOBAL_MOCK_HOOK(Condition_Wait, my_Condition_Wait);
 
     REGISTER_GLOBAL_MOCK_HOOK(VECTOR_create, real_VECTOR_create);
     REGISTER_GLOBAL_MOCK_FAIL_RETURN(VECTOR_create, NULL);
@@ -1331,6 +1393,7 @@ TEST_SUITE_INITIALIZE(suite_init)
     IoTHubTransportHttp_GetSendStatus = ((TRANSPORT_PROVIDER*)HTTP_Protocol())->IoTHubTransport_GetSendStatus;
     IoTHubTransportHttp_SetCallbackContext = ((TRANSPORT_PROVIDER*)HTTP_Protocol())->IoTHubTransport_SetCallbackContext;
     IoTHubTransportHttp_GetSupportedPlatformInfo = ((TRANSPORT_PROVIDER*)HTTP_Protocol())->IoTHubTransport_GetSupportedPlatformInfo;
+    IoTHubTransportHttp_GetRttStatistics = ((TRANSPORT_PROVIDER*)HTTP_Protocol())->IoTHubTransport_GetRttStatistics;
 
     TEST_STRING_HANDLE = real_STRING_construct(TEST_STRING_DATA);
 }
@@ -1394,6 +1457,7 @@ TEST_FUNCTION_INITIALIZE(method_init)
     real_DList_InitializeListHead(&waitingToSend2);
     reset_test_data();
     my_IoTHubClientCore_LL_MessageCallback_return_value = true;
+    g_connection_thread_arg = NULL;
 }
 
 TEST_FUNCTION_CLEANUP(method_cleanup)
@@ -1680,6 +1744,7 @@ TEST_FUNCTION(IoTHubTransportHttp_Destroy_succeeds_One_Registered_device)
 //Tests_SRS_TRANSPORTMULTITHTTP_17_128: [ IoTHubTransportHttp_Register shall mark this device as unsubscribed. ]
 //Tests_SRS_TRANSPORTMULTITHTTP_17_041: [ IoTHubTransportHttp_Register shall call VECTOR_push_back to store the new device information. ]
 //Tests_SRS_TRANSPORTMULTITHTTP_17_043: [ Upon success, IoTHubTransportHttp_Register shall store the transport handle, iotHubClientHandle, and the waitingToSend queue in the device handle return a non-NULL value. ]
+//Tests_SRS_TRANSPORTMULTITHTTP_44_017: [ IoTHubTransportHttp_Register shall create a clone of the event HTTP request headers (further called "single event HTTP request headers") that has "Content-Type" set to "application/octet-stream". ]
 TEST_FUNCTION(IoTHubTransportHttp_Register_HappyPath_with_deviceKey_success_fun_time)
 {
     //arrange
@@ -1722,6 +1787,7 @@ TEST_FUNCTION(IoTHubTransportHttp_Register_HappyPath_with_deviceKey_success_fun_
 //Tests_SRS_TRANSPORTMULTITHTTP_17_128: [ IoTHubTransportHttp_Register shall mark this device as unsubscribed. ]
 //Tests_SRS_TRANSPORTMULTITHTTP_17_041: [ IoTHubTransportHttp_Register shall call VECTOR_push_back to store the new device information. ]
 //Tests_SRS_TRANSPORTMULTITHTTP_17_043: [ Upon success, IoTHubTransportHttp_Register shall store the transport handle, iotHubClientHandle, and the waitingToSend queue in the device handle return a non-NULL value. ]
+//Tests_SRS_TRANSPORTMULTITHTTP_44_016: [ If a deviceSasToken exists, the "Authorization" header of the event HTTP request headers and of the message HTTP request headers shall be created with the value of deviceSasToken. ]
 TEST_FUNCTION(IoTHubTransportHttp_Register_HappyPath_with_deviceSas_success_fun_time)
 {
     //arrange
@@ -1757,8 +1823,9 @@ TEST_FUNCTION(IoTHubTransportHttp_Register_2nd_device_HappyPath_success_fun_time
     setupRegisterHappyPathcreate_deviceKey(false, false);
     setupRegisterHappyPatheventHTTPrelativePath(false);
     setupRegisterHappyPathmessageHTTPrelativePath(false);
-    setupRegisterHappyPatheventHTTPrequestHeaders(false, false);
-    setupRegisterHappyPathmessageHTTPrequestHeaders(false, false);
+    setupRegisterHappyPatheventHTTPrequestHeaders(false, TEST_BLANK_SAS_TOKEN);
+    setupRegisterHappyPathsingleEventHTTPrequestHeaders(false);
+    setupRegisterHappyPathmessageHTTPrequestHeaders(false, TEST_BLANK_SAS_TOKEN);
     setupRegisterHappyPathabandonHTTPrelativePathBegin(false);
     setupRegisterHappyPathsasObject(false, false);
     setupRegisterHappyPathDeviceListAdd();
@@ -1825,7 +1892,7 @@ TEST_FUNCTION(IoTHubTransportHttp_Register_HappyPath_with_deviceKey_fail)
 
     umock_c_negative_tests_snapshot();
 
-    size_t calls_cannot_fail[] = { 0, 8, 13, 19, 24, 26, 27, 29, 36, 44, 45, 46, 47, 48, 51 };
+    size_t calls_cannot_fail[] = { 0, 8, 13, 19, 24, 27, 28, 32, 39, 47, 48, 49, 50, 51, 54 };
 
     //act
     size_t count = umock_c_negative_tests_call_count();
@@ -13859,27 +13926,20 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_SendSecurityMessage_SUCCEED)
         .IgnoreArgument(2)
         .IgnoreArgument(3);
 
-    STRICT_EXPECTED_CALL(HTTPHeaders_Clone(IGNORED_PTR_ARG));
-
-    STRICT_EXPECTED_CALL(HTTPHeaders_ReplaceHeaderNameValuePair(IGNORED_PTR_ARG, "Content-Type", "application/octet-stream"))
-        .IgnoreArgument(1);
-
-    /*no properties, so no more headers*/
+    /*the message is inspected before any header is touched*/
     STRICT_EXPECTED_CALL(IoTHubMessage_Properties(TEST_IOTHUB_MESSAGE_HANDLE_6));
     STRICT_EXPECTED_CALL(Map_GetInternals(TEST_MAP_1_PROPERTY, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
-    /*this is making http headers*/
-    STRICT_EXPECTED_CALL(STRING_c_str(IGNORED_PTR_ARG));
-    STRICT_EXPECTED_CALL(HTTPHeaders_ReplaceHeaderNameValuePair(IGNORED_PTR_ARG, "iothub-app-" TEST_RED_KEY, TEST_RED_VALUE));
-    STRICT_EXPECTED_CALL(STRING_delete(IGNORED_PTR_ARG));
-
     EXPECTED_CALL(IoTHubMessage_GetMessageId(IGNORED_PTR_ARG)).SetReturn(TEST_MESSAGE_ID);
-    STRICT_EXPECTED_CALL(HTTPHeaders_ReplaceHeaderNameValuePair(IGNORED_PTR_ARG, "iothub-messageid", TEST_MESSAGE_ID));
     EXPECTED_CALL(IoTHubMessage_GetCorrelationId(IGNORED_PTR_ARG));
     EXPECTED_CALL(IoTHubMessage_GetContentTypeSystemProperty(IGNORED_PTR_ARG)).SetReturn(NULL);
     EXPECTED_CALL(IoTHubMessage_GetContentEncodingSystemProperty(IGNORED_PTR_ARG)).SetReturn(NULL);
-
     STRICT_EXPECTED_CALL(IoTHubMessage_IsSecurityMessage(IGNORED_PTR_ARG)).SetReturn(true);
 
+    /*the message has per-message headers, so the single event template is cloned*/
+    STRICT_EXPECTED_CALL(HTTPHeaders_Clone(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(gballoc_realloc(NULL, IGNORED_NUM_ARG));
+    STRICT_EXPECTED_CALL(HTTPHeaders_ReplaceHeaderNameValuePair(IGNORED_PTR_ARG, "iothub-app-" TEST_RED_KEY, TEST_RED_VALUE));
+    STRICT_EXPECTED_CALL(HTTPHeaders_ReplaceHeaderNameValuePair(IGNORED_PTR_ARG, "iothub-messageid", TEST_MESSAGE_ID));
     STRICT_EXPECTED_CALL(HTTPHeaders_ReplaceHeaderNameValuePair(IGNORED_PTR_ARG, "iothub-interface-id", "urn:azureiot:Security:SecurityAgent:1"));
 
     STRICT_EXPECTED_CALL(BUFFER_create(IGNORED_PTR_ARG, IGNORED_NUM_ARG));
@@ -14043,27 +14103,21 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_GetMessageId_succeeds)
         .IgnoreArgument(2)
         .IgnoreArgument(3);
 
-    STRICT_EXPECTED_CALL(HTTPHeaders_Clone(IGNORED_PTR_ARG));
-
-    STRICT_EXPECTED_CALL(HTTPHeaders_ReplaceHeaderNameValuePair(IGNORED_PTR_ARG, "Content-Type", "application/octet-stream"))
-        .IgnoreArgument(1);
-
-    /*no properties, so no more headers*/
+    /*the message is inspected before any header is touched*/
     STRICT_EXPECTED_CALL(IoTHubMessage_Properties(TEST_IOTHUB_MESSAGE_HANDLE_6));
     STRICT_EXPECTED_CALL(Map_GetInternals(TEST_MAP_1_PROPERTY, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
-    /*this is making http headers*/
-    STRICT_EXPECTED_CALL(STRING_c_str(IGNORED_PTR_ARG));
-    STRICT_EXPECTED_CALL(HTTPHeaders_ReplaceHeaderNameValuePair(IGNORED_PTR_ARG, "iothub-app-" TEST_RED_KEY, TEST_RED_VALUE));
-    STRICT_EXPECTED_CALL(STRING_delete(IGNORED_PTR_ARG));
-
     EXPECTED_CALL(IoTHubMessage_GetMessageId(IGNORED_PTR_ARG)).SetReturn(TEST_MESSAGE_ID);
-    STRICT_EXPECTED_CALL(HTTPHeaders_ReplaceHeaderNameValuePair(IGNORED_PTR_ARG, "iothub-messageid", TEST_MESSAGE_ID));
     EXPECTED_CALL(IoTHubMessage_GetCorrelationId(IGNORED_PTR_ARG));
     EXPECTED_CALL(IoTHubMessage_GetContentTypeSystemProperty(IGNORED_PTR_ARG)).SetReturn(NULL);
     EXPECTED_CALL(IoTHubMessage_GetContentEncodingSystemProperty(IGNORED_PTR_ARG)).SetReturn(NULL);
-
     STRICT_EXPECTED_CALL(IoTHubMessage_IsSecurityMessage(IGNORED_PTR_ARG));
 
+    /*the message has per-message headers, so the single event template is cloned*/
+    STRICT_EXPECTED_CALL(HTTPHeaders_Clone(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(gballoc_realloc(NULL, IGNORED_NUM_ARG));
+    STRICT_EXPECTED_CALL(HTTPHeaders_ReplaceHeaderNameValuePair(IGNORED_PTR_ARG, "iothub-app-" TEST_RED_KEY, TEST_RED_VALUE));
+    STRICT_EXPECTED_CALL(HTTPHeaders_ReplaceHeaderNameValuePair(IGNORED_PTR_ARG, "iothub-messageid", TEST_MESSAGE_ID));
+
     STRICT_EXPECTED_CALL(BUFFER_create(IGNORED_PTR_ARG, IGNORED_NUM_ARG));
 
     /*executing HTTP goodies*/
@@ -14114,27 +14168,21 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_GetCorrelationId_succeeds)
     STRICT_EXPECTED_CALL(IoTHubMessage_GetContentType(TEST_IOTHUB_MESSAGE_HANDLE_6));
     STRICT_EXPECTED_CALL(IoTHubMessage_GetByteArray(TEST_IOTHUB_MESSAGE_HANDLE_6, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
 
-    STRICT_EXPECTED_CALL(HTTPHeaders_Clone(IGNORED_PTR_ARG));
-    STRICT_EXPECTED_CALL(HTTPHeaders_ReplaceHeaderNameValuePair(IGNORED_PTR_ARG, "Content-Type", "application/octet-stream"));
-
-    /*no properties, so no more headers*/
+    /*the message is inspected before any header is touched*/
     STRICT_EXPECTED_CALL(IoTHubMessage_Properties(TEST_IOTHUB_MESSAGE_HANDLE_6));
     STRICT_EXPECTED_CALL(Map_GetInternals(TEST_MAP_1_PROPERTY, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
-
-    /*this is making http headers*/
-    STRICT_EXPECTED_CALL(STRING_c_str(IGNORED_PTR_ARG));
-    STRICT_EXPECTED_CALL(HTTPHeaders_ReplaceHeaderNameValuePair(IGNORED_PTR_ARG, "iothub-app-" TEST_RED_KEY, TEST_RED_VALUE));
-
-    STRICT_EXPECTED_CALL(STRING_delete(IGNORED_PTR_ARG));
-
     EXPECTED_CALL(IoTHubMessage_GetMessageId(IGNORED_PTR_ARG));
     EXPECTED_CALL(IoTHubMessage_GetCorrelationId(IGNORED_PTR_ARG)).SetReturn(TEST_MESSAGE_ID);
-    STRICT_EXPECTED_CALL(HTTPHeaders_ReplaceHeaderNameValuePair(IGNORED_PTR_ARG, "iothub-correlationid", TEST_MESSAGE_ID));
     EXPECTED_CALL(IoTHubMessage_GetContentTypeSystemProperty(IGNORED_PTR_ARG)).SetReturn(NULL);
     EXPECTED_CALL(IoTHubMessage_GetContentEncodingSystemProperty(IGNORED_PTR_ARG)).SetReturn(NULL);
-
     STRICT_EXPECTED_CALL(IoTHubMessage_IsSecurityMessage(IGNORED_PTR_ARG));
 
+    /*the message has per-message headers, so the single event template is cloned*/
+    STRICT_EXPECTED_CALL(HTTPHeaders_Clone(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(gballoc_realloc(NULL, IGNORED_NUM_ARG));
+    STRICT_EXPECTED_CALL(HTTPHeaders_ReplaceHeaderNameValuePair(IGNORED_PTR_ARG, "iothub-app-" TEST_RED_KEY, TEST_RED_VALUE));
+    STRICT_EXPECTED_CALL(HTTPHeaders_ReplaceHeaderNameValuePair(IGNORED_PTR_ARG, "iothub-correlationid", TEST_MESSAGE_ID));
+
     STRICT_EXPECTED_CALL(BUFFER_create(IGNORED_PTR_ARG, IGNORED_NUM_ARG));
 
     /*executing HTTP goodies*/
@@ -14190,27 +14238,21 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_GetCustomContentType_succeeds)
     STRICT_EXPECTED_CALL(IoTHubMessage_GetContentType(TEST_IOTHUB_MESSAGE_HANDLE_6));
     STRICT_EXPECTED_CALL(IoTHubMessage_GetByteArray(TEST_IOTHUB_MESSAGE_HANDLE_6, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
 
-    STRICT_EXPECTED_CALL(HTTPHeaders_Clone(IGNORED_PTR_ARG));
-    STRICT_EXPECTED_CALL(HTTPHeaders_ReplaceHeaderNameValuePair(IGNORED_PTR_ARG, "Content-Type", "application/octet-stream"));
-
-    /*no properties, so no more headers*/
+    /*the message is inspected before any header is touched*/
     STRICT_EXPECTED_CALL(IoTHubMessage_Properties(TEST_IOTHUB_MESSAGE_HANDLE_6));
     STRICT_EXPECTED_CALL(Map_GetInternals(TEST_MAP_1_PROPERTY, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
-
-    /*this is making http headers*/
-    STRICT_EXPECTED_CALL(STRING_c_str(IGNORED_PTR_ARG));
-    STRICT_EXPECTED_CALL(HTTPHeaders_ReplaceHeaderNameValuePair(IGNORED_PTR_ARG, "iothub-app-" TEST_RED_KEY, TEST_RED_VALUE));
-
-    STRICT_EXPECTED_CALL(STRING_delete(IGNORED_PTR_ARG));
-
     EXPECTED_CALL(IoTHubMessage_GetMessageId(IGNORED_PTR_ARG));
     EXPECTED_CALL(IoTHubMessage_GetCorrelationId(IGNORED_PTR_ARG)).SetReturn(NULL);
     EXPECTED_CALL(IoTHubMessage_GetContentTypeSystemProperty(IGNORED_PTR_ARG)).SetReturn(TEST_CONTENT_TYPE);
-    STRICT_EXPECTED_CALL(HTTPHeaders_ReplaceHeaderNameValuePair(IGNORED_PTR_ARG, "iothub-contenttype", TEST_CONTENT_TYPE));
     EXPECTED_CALL(IoTHubMessage_GetContentEncodingSystemProperty(IGNORED_PTR_ARG)).SetReturn(NULL);
-
     STRICT_EXPECTED_CALL(IoTHubMessage_IsSecurityMessage(IGNORED_PTR_ARG));
 
+    /*the message has per-message headers, so the single event template is cloned*/
+    STRICT_EXPECTED_CALL(HTTPHeaders_Clone(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(gballoc_realloc(NULL, IGNORED_NUM_ARG));
+    STRICT_EXPECTED_CALL(HTTPHeaders_ReplaceHeaderNameValuePair(IGNORED_PTR_ARG, "iothub-app-" TEST_RED_KEY, TEST_RED_VALUE));
+    STRICT_EXPECTED_CALL(HTTPHeaders_ReplaceHeaderNameValuePair(IGNORED_PTR_ARG, "iothub-contenttype", TEST_CONTENT_TYPE));
+
     STRICT_EXPECTED_CALL(BUFFER_create(IGNORED_PTR_ARG, IGNORED_NUM_ARG));
 
     /*executing HTTP goodies*/
@@ -14266,27 +14308,21 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_GetContentEncoding_succeeds)
     STRICT_EXPECTED_CALL(IoTHubMessage_GetContentType(TEST_IOTHUB_MESSAGE_HANDLE_6));
     STRICT_EXPECTED_CALL(IoTHubMessage_GetByteArray(TEST_IOTHUB_MESSAGE_HANDLE_6, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
 
-    STRICT_EXPECTED_CALL(HTTPHeaders_Clone(IGNORED_PTR_ARG));
-    STRICT_EXPECTED_CALL(HTTPHeaders_ReplaceHeaderNameValuePair(IGNORED_PTR_ARG, "Content-Type", "application/octet-stream"));
-
-    /*no properties, so no more headers*/
+    /*the message is inspected before any header is touched*/
     STRICT_EXPECTED_CALL(IoTHubMessage_Properties(TEST_IOTHUB_MESSAGE_HANDLE_6));
     STRICT_EXPECTED_CALL(Map_GetInternals(TEST_MAP_1_PROPERTY, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
-
-    /*this is making http headers*/
-    STRICT_EXPECTED_CALL(STRING_c_str(IGNORED_PTR_ARG));
-    STRICT_EXPECTED_CALL(HTTPHeaders_ReplaceHeaderNameValuePair(IGNORED_PTR_ARG, "iothub-app-" TEST_RED_KEY, TEST_RED_VALUE));
-
-    STRICT_EXPECTED_CALL(STRING_delete(IGNORED_PTR_ARG));
-
     EXPECTED_CALL(IoTHubMessage_GetMessageId(IGNORED_PTR_ARG));
     EXPECTED_CALL(IoTHubMessage_GetCorrelationId(IGNORED_PTR_ARG)).SetReturn(NULL);
     EXPECTED_CALL(IoTHubMessage_GetContentTypeSystemProperty(IGNORED_PTR_ARG)).SetReturn(NULL);
     EXPECTED_CALL(IoTHubMessage_GetContentEncodingSystemProperty(IGNORED_PTR_ARG)).SetReturn(TEST_CONTENT_ENCODING);
-    STRICT_EXPECTED_CALL(HTTPHeaders_ReplaceHeaderNameValuePair(IGNORED_PTR_ARG, "iothub-contentencoding", TEST_CONTENT_ENCODING));
-
     STRICT_EXPECTED_CALL(IoTHubMessage_IsSecurityMessage(IGNORED_PTR_ARG));
 
+    /*the message has per-message headers, so the single event template is cloned*/
+    STRICT_EXPECTED_CALL(HTTPHeaders_Clone(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(gballoc_realloc(NULL, IGNORED_NUM_ARG));
+    STRICT_EXPECTED_CALL(HTTPHeaders_ReplaceHeaderNameValuePair(IGNORED_PTR_ARG, "iothub-app-" TEST_RED_KEY, TEST_RED_VALUE));
+    STRICT_EXPECTED_CALL(HTTPHeaders_ReplaceHeaderNameValuePair(IGNORED_PTR_ARG, "iothub-contentencoding", TEST_CONTENT_ENCODING));
+
     STRICT_EXPECTED_CALL(BUFFER_create(IGNORED_PTR_ARG, IGNORED_NUM_ARG));
 
     /*executing HTTP goodies*/
@@ -14326,6 +14362,52 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_GetContentEncoding_succeeds)
     IoTHubTransportHttp_Destroy(handle);
 }
 
+//Tests_SRS_TRANSPORTMULTITHTTP_44_020: [ If the message has neither properties nor system properties, the single event HTTP request headers shall be used as they are, without being cloned. ]
+TEST_FUNCTION(IoTHubTransportHttp_DoWork_message_without_properties_uses_single_event_headers_without_clone_succeeds)
+{
+    //arrange
+    DList_InsertTailList(&(waitingToSend), &(message1.entry));
+    TRANSPORT_LL_HANDLE handle = IoTHubTransportHttp_Create(&TEST_CONFIG, &transport_cb_info, transport_cb_ctx);
+    (void)IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_CONFIG.waitingToSend);
+    umock_c_reset_all_calls();
+
+    setupDoWorkLoopOnceForOneDevice();
+
+    STRICT_EXPECTED_CALL(DList_IsListEmpty(&waitingToSend));
+    STRICT_EXPECTED_CALL(IoTHubMessage_GetContentType(TEST_IOTHUB_MESSAGE_HANDLE_1));
+    STRICT_EXPECTED_CALL(IoTHubMessage_GetByteArray(TEST_IOTHUB_MESSAGE_HANDLE_1, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+
+    STRICT_EXPECTED_CALL(IoTHubMessage_Properties(TEST_IOTHUB_MESSAGE_HANDLE_1));
+    STRICT_EXPECTED_CALL(Map_GetInternals(TEST_MAP_EMPTY, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+    EXPECTED_CALL(IoTHubMessage_GetMessageId(IGNORED_PTR_ARG)).SetReturn(NULL);
+    EXPECTED_CALL(IoTHubMessage_GetCorrelationId(IGNORED_PTR_ARG)).SetReturn(NULL);
+    EXPECTED_CALL(IoTHubMessage_GetContentTypeSystemProperty(IGNORED_PTR_ARG)).SetReturn(NULL);
+    EXPECTED_CALL(IoTHubMessage_GetContentEncodingSystemProperty(IGNORED_PTR_ARG)).SetReturn(NULL);
+    STRICT_EXPECTED_CALL(IoTHubMessage_IsSecurityMessage(IGNORED_PTR_ARG));
+
+    /*no HTTPHeaders_Clone, the pre-rendered headers go out as they are*/
+    STRICT_EXPECTED_CALL(BUFFER_create(IGNORED_PTR_ARG, IGNORED_NUM_ARG));
+
+    STRICT_EXPECTED_CALL(STRING_c_str(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(HTTPAPIEX_SAS_ExecuteRequest(IGNORED_PTR_ARG, IGNORED_PTR_ARG, HTTPAPI_REQUEST_POST, "/devices/" TEST_DEVICE_ID EVENT_ENDPOINT API_VERSION, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG, NULL, NULL))
+        .CopyOutArgumentBuffer(7, &httpStatus204, sizeof(httpStatus204));
+
+    STRICT_EXPECTED_CALL(DList_RemoveHeadList(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(DList_InsertTailList(IGNORED_PTR_ARG, &(message1.entry)));
+    STRICT_EXPECTED_CALL(Transport_SendComplete_Callback(IGNORED_PTR_ARG, IOTHUB_CLIENT_CONFIRMATION_OK, IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(BUFFER_delete(IGNORED_PTR_ARG));
+
+    //act
+    IoTHubTransportHttp_DoWork(handle);
+
+    //assert
+    ASSERT_ARE_EQUAL(int, 0, memcmp(real_BUFFER_u_char(last_BUFFER_HANDLE_to_HTTPAPIEX_ExecuteRequest), buffer1, buffer1_size));
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    //cleanup
+    IoTHubTransportHttp_Destroy(handle);
+}
+
 /*Tests_SRS_TRANSPORTMULTITHTTP_02_001: [ If handle is NULL then IoTHubTransportHttp_GetHostname shall fail and return NULL. ]*/
 TEST_FUNCTION(IoTHubTransportHttp_GetHostname_with_NULL_handle_fails)
 {
@@ -14417,6 +14499,26 @@ TEST_FUNCTION(IoTHubTransportHttp_GetTwinAsync_returns)
     IoTHubTransportHttp_Destroy(handle);
 }
 
+// Tests_SRS_TRANSPORTMULTITHTTP_44_023: [ `IoTHubTransportHttp_GetRttStatistics` shall return IOTHUB_CLIENT_ERROR]
+TEST_FUNCTION(IoTHubTransportHttp_GetRttStatistics_returns)
+{
+    //arrange
+    TRANSPORT_LL_HANDLE handle = IoTHubTransportHttp_Create(&TEST_CONFIG, &transport_cb_info, transport_cb_ctx);
+    IOTHUB_CLIENT_RTT_STATISTICS rtt_statistics;
+
+    umock_c_reset_all_calls();
+
+    //act
+    IOTHUB_CLIENT_RESULT res = IoTHubTransportHttp_GetRttStatistics(handle, &rtt_statistics);
+
+    //assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_ARE_EQUAL(int, IOTHUB_CLIENT_ERROR, res);
+
+    //cleanup
+    IoTHubTransportHttp_Destroy(handle);
+}
+
 TEST_FUNCTION(IoTHubTransportHttp_SetCallbackContext_success)
 {
     // arrange
@@ -14467,5 +14569,358 @@ TEST_FUNCTION(IoTHubTransportHttp_GetSupportedPlatformInfo_returns)
     IoTHubTransportHttp_Destroy(handle);
 }
 
+//Tests_SRS_TRANSPORTMULTITHTTP_17_053: [ If option SetBatching is true then _DoWork shall send batched event message as specced below. ]
+//Tests_SRS_TRANSPORTMULTITHTTP_17_056: [ IoTHubTransportHttp_DoWork shall build the following string:[{"body":"base64 encoding of the message1 content"},{"body":"base64 encoding of the message2 content"}...] ]
+//Tests_SRS_TRANSPORTMULTITHTTP_17_064: [ If IoTHubMessage does not have properties, then "properties":{...} shall be missing from the payload. ]
+TEST_FUNCTION(IoTHubTransportHttp_DoWork_batched_with_2_event_items_builds_1_payload_succeeds)
+{
+    //arrange
+    bool batching = true;
+    DList_InsertTailList(&(waitingToSend), &(message1.entry));
+    DList_InsertTailList(&(waitingToSend), &(message2.entry));
+    TRANSPORT_LL_HANDLE handle = IoTHubTransportHttp_Create(&TEST_CONFIG, &transport_cb_info, transport_cb_ctx);
+    (void)IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_CONFIG.waitingToSend);
+    (void)IoTHubTransportHttp_SetOption(handle, OPTION_BATCHING, &batching);
+
+    umock_c_reset_all_calls();
+
+    setupDoWorkLoopOnceForOneDevice();
+
+    STRICT_EXPECTED_CALL(DList_IsListEmpty(&waitingToSend));
+
+    /*the payload buffer is allocated once, both items fit in it*/
+    STRICT_EXPECTED_CALL(gballoc_realloc(NULL, IGNORED_NUM_ARG));
+
+    STRICT_EXPECTED_CALL(IoTHubMessage_GetContentType(TEST_IOTHUB_MESSAGE_HANDLE_1));
+    STRICT_EXPECTED_CALL(IoTHubMessage_GetByteArray(TEST_IOTHUB_MESSAGE_HANDLE_1, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(IoTHubMessage_Properties(TEST_IOTHUB_MESSAGE_HANDLE_1));
+    STRICT_EXPECTED_CALL(Map_GetInternals(TEST_MAP_EMPTY, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(DList_RemoveHeadList(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(DList_InsertTailList(IGNORED_PTR_ARG, &(message1.entry)));
+
+    STRICT_EXPECTED_CALL(IoTHubMessage_GetContentType(TEST_IOTHUB_MESSAGE_HANDLE_2));
+    STRICT_EXPECTED_CALL(IoTHubMessage_GetByteArray(TEST_IOTHUB_MESSAGE_HANDLE_2, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(IoTHubMessage_Properties(TEST_IOTHUB_MESSAGE_HANDLE_2));
+    STRICT_EXPECTED_CALL(Map_GetInternals(TEST_MAP_EMPTY, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(DList_RemoveHeadList(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(DList_InsertTailList(IGNORED_PTR_ARG, &(message2.entry)));
+
+    STRICT_EXPECTED_CALL(BUFFER_new());
+    STRICT_EXPECTED_CALL(BUFFER_build(IGNORED_PTR_ARG, IGNORED_PTR_ARG, sizeof("[{\"body\":\"MQ==\"},{\"body\":\"MjI=\"}]") - 1));
+
+    /*executing HTTP goodies*/
+    STRICT_EXPECTED_CALL(STRING_c_str(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(HTTPAPIEX_SAS_ExecuteRequest(IGNORED_PTR_ARG, IGNORED_PTR_ARG, HTTPAPI_REQUEST_POST, "/devices/" TEST_DEVICE_ID EVENT_ENDPOINT API_VERSION, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG, NULL, NULL))
+        .CopyOutArgumentBuffer(7, &httpStatus200, sizeof(httpStatus200));
+    STRICT_EXPECTED_CALL(Transport_SendComplete_Callback(IGNORED_PTR_ARG, IOTHUB_CLIENT_CONFIRMATION_OK, IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(BUFFER_delete(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG));
+
+    //act
+    IoTHubTransportHttp_DoWork(handle);
+
+    //assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_ARE_EQUAL(int, 0, memcmp(real_BUFFER_u_char(last_BUFFER_HANDLE_to_HTTPAPIEX_ExecuteRequest), "[{\"body\":\"MQ==\"},{\"body\":\"MjI=\"}]", sizeof("[{\"body\":\"MQ==\"},{\"body\":\"MjI=\"}]") - 1));
+
+    //cleanup
+    IoTHubTransportHttp_Destroy(handle);
+}
+
+//Tests_SRS_TRANSPORTMULTITHTTP_17_061: [ The message size shall be limited to 255KB - 1 byte. ]
+//Tests_SRS_TRANSPORTMULTITHTTP_17_065: [ If the oldest message in waitingToSend causes the message size to exceed the message size limit then it shall be removed from waitingToSend, and IoTHubClientCore_LL_SendComplete shall be called. Parameter PDLIST_ENTRY completed shall point to a list containing only the oldest item, and parameter IOTHUB_CLIENT_CONFIRMATION_RESULT result shall be set to IOTHUB_CLIENT_CONFIRMATION_BATCHSTATE_FAILED. ]
+TEST_FUNCTION(IoTHubTransportHttp_DoWork_batched_with_1_event_item_bigger_than_256K_is_not_encoded)
+{
+    //arrange
+    bool batching = true;
+    DList_InsertTailList(&(waitingToSend), &(message4.entry));
+    TRANSPORT_LL_HANDLE handle = IoTHubTransportHttp_Create(&TEST_CONFIG, &transport_cb_info, transport_cb_ctx);
+    (void)IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_CONFIG.waitingToSend);
+    (void)IoTHubTransportHttp_SetOption(handle, OPTION_BATCHING, &batching);
+
+    umock_c_reset_all_calls();
+
+    setupDoWorkLoopOnceForOneDevice();
+
+    STRICT_EXPECTED_CALL(DList_IsListEmpty(&waitingToSend));
+    STRICT_EXPECTED_CALL(gballoc_realloc(NULL, IGNORED_NUM_ARG));
+
+    /*the size of the item is known before encoding it, so the payload never grows to hold it*/
+    STRICT_EXPECTED_CALL(IoTHubMessage_GetContentType(TEST_IOTHUB_MESSAGE_HANDLE_4));
+    STRICT_EXPECTED_CALL(IoTHubMessage_GetByteArray(TEST_IOTHUB_MESSAGE_HANDLE_4, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(IoTHubMessage_Properties(TEST_IOTHUB_MESSAGE_HANDLE_4));
+    STRICT_EXPECTED_CALL(Map_GetInternals(TEST_MAP_EMPTY, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(DList_RemoveHeadList(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(DList_InsertTailList(IGNORED_PTR_ARG, &(message4.entry)));
+    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(Transport_SendComplete_Callback(IGNORED_PTR_ARG, IOTHUB_CLIENT_CONFIRMATION_ERROR, IGNORED_PTR_ARG));
+
+    //act
+    IoTHubTransportHttp_DoWork(handle);
+
+    //assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    //cleanup
+    IoTHubTransportHttp_Destroy(handle);
+}
+
+//Tests_SRS_TRANSPORTMULTITHTTP_44_004: [ If "AdaptivePolling" is on and a GET that did not follow a received message returns any other status code, the polling time shall double, starting from 1 second. ]
+//Tests_SRS_TRANSPORTMULTITHTTP_44_005: [ The adaptive polling time shall never be longer than MaximumPollingTime nor shorter than MinimumPollingTime; if the bounds cross, MinimumPollingTime wins. ]
+TEST_FUNCTION(IoTHubTransportHttp_DoWork_adaptive_polling_after_empty_queue_backs_off_succeeds)
+{
+    //arrange
+    bool adaptivePolling = true;
+    unsigned int thisIs1Second = 1;
+    TRANSPORT_LL_HANDLE handle = IoTHubTransportHttp_Create(&TEST_CONFIG, &transport_cb_info, transport_cb_ctx);
+    IOTHUB_DEVICE_HANDLE devHandle = IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_CONFIG.waitingToSend);
+    (void)IoTHubTransportHttp_Subscribe(devHandle);
+    (void)IoTHubTransportHttp_SetOption(handle, OPTION_ADAPTIVE_POLLING, &adaptivePolling);
+    (void)IoTHubTransportHttp_SetOption(handle, OPTION_MIN_POLLING_TIME, &thisIs1Second);
+
+    /*first GET finds the queue empty (204), so the polling time goes from 1 to 2 seconds*/
+    STRICT_EXPECTED_CALL(get_time(NULL))
+        .SetReturn(TEST_GET_TIME_VALUE);
+    IoTHubTransportHttp_DoWork(handle);
+    umock_c_reset_all_calls();
+
+    setupDoWorkLoopOnceForOneDevice();
+    STRICT_EXPECTED_CALL(DList_IsListEmpty(&waitingToSend)); /*because DoWork for event*/
+    STRICT_EXPECTED_CALL(get_time(NULL))
+        .SetReturn(TEST_GET_TIME_VALUE + 2);
+    STRICT_EXPECTED_CALL(get_difftime(TEST_GET_TIME_VALUE + 2, TEST_GET_TIME_VALUE))
+        .SetReturn(2.0);
+
+    //act
+    IoTHubTransportHttp_DoWork(handle);
+
+    //assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    //cleanup
+    IoTHubTransportHttp_Destroy(handle);
+}
+
+//Tests_SRS_TRANSPORTMULTITHTTP_44_003: [ If "AdaptivePolling" is on and a GET returns status code 200, the next GET shall be allowed on the next _DoWork and the polling time shall go back to MinimumPollingTime. ]
+TEST_FUNCTION(IoTHubTransportHttp_DoWork_adaptive_polling_after_received_message_polls_again_succeeds)
+{
+    //arrange
+    bool adaptivePolling = true;
+    unsigned int statusCode200 = 200;
+    TRANSPORT_LL_HANDLE handle = IoTHubTransportHttp_Create(&TEST_CONFIG, &transport_cb_info, transport_cb_ctx);
+    IOTHUB_DEVICE_HANDLE devHandle = IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_CONFIG.waitingToSend);
+    (void)IoTHubTransportHttp_Subscribe(devHandle);
+    (void)IoTHubTransportHttp_SetOption(handle, OPTION_ADAPTIVE_POLLING, &adaptivePolling);
+
+    /*first GET returns a message (200), its processing is cut short by a missing ETag*/
+    STRICT_EXPECTED_CALL(get_time(NULL))
+        .SetReturn(TEST_GET_TIME_VALUE);
+    STRICT_EXPECTED_CALL(HTTPAPIEX_SAS_ExecuteRequest(IGNORED_PTR_ARG, IGNORED_PTR_ARG, HTTPAPI_REQUEST_GET, "/devices/" TEST_DEVICE_ID MESSAGE_ENDPOINT_HTTP API_VERSION, IGNORED_PTR_ARG, NULL, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreArgument_requestType()
+        .CopyOutArgumentBuffer(7, &statusCode200, sizeof(statusCode200));
+    STRICT_EXPECTED_CALL(HTTPHeaders_FindHeaderValue(IGNORED_PTR_ARG, "ETag"))
+        .SetReturn(NULL);
+    IoTHubTransportHttp_DoWork(handle);
+    umock_c_reset_all_calls();
+
+    /*the second GET happens in the same second, well before MinimumPollingTime*/
+    setupDoWorkLoopOnceForOneDevice();
+    STRICT_EXPECTED_CALL(DList_IsListEmpty(&waitingToSend)); /*because DoWork for event*/
+    STRICT_EXPECTED_CALL(get_time(NULL))
+        .SetReturn(TEST_GET_TIME_VALUE);
+    STRICT_EXPECTED_CALL(HTTPHeaders_Alloc());
+    STRICT_EXPECTED_CALL(BUFFER_new());
+    STRICT_EXPECTED_CALL(STRING_c_str(IGNORED_PTR_ARG)); /*because relativePath is a STRING_HANDLE*/
+    STRICT_EXPECTED_CALL(HTTPAPIEX_SAS_ExecuteRequest(IGNORED_PTR_ARG, IGNORED_PTR_ARG, HTTPAPI_REQUEST_GET, "/devices/" TEST_DEVICE_ID MESSAGE_ENDPOINT_HTTP API_VERSION, IGNORED_PTR_ARG, NULL, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreArgument_requestType();
+    STRICT_EXPECTED_CALL(BUFFER_delete(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(HTTPHeaders_Free(IGNORED_PTR_ARG));
+
+    //act
+    IoTHubTransportHttp_DoWork(handle);
+
+    //assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    //cleanup
+    IoTHubTransportHttp_Destroy(handle);
+}
+
+//Tests_SRS_TRANSPORTMULTITHTTP_44_012: [ If the pool size is 0 or bigger than 64 then IoTHubTransportHttp_SetOption shall return IOTHUB_CLIENT_INVALID_ARG. ]
+TEST_FUNCTION(IoTHubTransportHttp_SetOption_HttpConnectionPoolSize_0_fails)
+{
+    //arrange
+    unsigned int poolSize = 0;
+    TRANSPORT_LL_HANDLE handle = IoTHubTransportHttp_Create(&TEST_CONFIG, &transport_cb_info, transport_cb_ctx);
+    umock_c_reset_all_calls();
+
+    //act
+    IOTHUB_CLIENT_RESULT result = IoTHubTransportHttp_SetOption(handle, OPTION_HTTP_CONNECTION_POOL_SIZE, &poolSize);
+
+    //assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    //cleanup
+    IoTHubTransportHttp_Destroy(handle);
+}
+
+//Tests_SRS_TRANSPORTMULTITHTTP_44_008: [ "HttpConnectionPoolSize" ]
+//Tests_SRS_TRANSPORTMULTITHTTP_44_013: [ Every other connection shall be created with HTTPAPIEX_Create and shall receive, through HTTPAPIEX_SetOption, every option previously passed down to HTTPAPIEX. ]
+TEST_FUNCTION(IoTHubTransportHttp_SetOption_HttpConnectionPoolSize_2_creates_1_more_connection_succeeds)
+{
+    //arrange
+    unsigned int poolSize = 2;
+    TRANSPORT_LL_HANDLE handle = IoTHubTransportHttp_Create(&TEST_CONFIG, &transport_cb_info, transport_cb_ctx);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
+    STRICT_EXPECTED_CALL(STRING_c_str(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(HTTPAPIEX_Create(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(VECTOR_size(IGNORED_PTR_ARG));
+
+    //act
+    IOTHUB_CLIENT_RESULT result = IoTHubTransportHttp_SetOption(handle, OPTION_HTTP_CONNECTION_POOL_SIZE, &poolSize);
+
+    //assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    //cleanup
+    IoTHubTransportHttp_Destroy(handle);
+}
+
+//Tests_SRS_TRANSPORTMULTITHTTP_44_009: [ Connection k of the pool shall serve the devices at positions k, k + pool size, k + 2 * pool size... of the transport device list, one after the other. ]
+//Tests_SRS_TRANSPORTMULTITHTTP_44_010: [ If the pool has more than one connection, IoTHubTransportHttp_DoWork shall hand every connection but the first one to its own thread, started with ThreadAPI_Create by the first call and kept until the pool is destroyed, serve the first one on the calling thread, and wait for the threads to finish the pass before returning. ]
+//Tests_SRS_TRANSPORTMULTITHTTP_44_021: [ The confirmations and messages of the devices served by the threads of the pool shall be handed to IoTHubClientCore_LL on the calling thread, once every connection is done with the pass. ]
+TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_HttpConnectionPoolSize_2_serves_the_second_connection_on_a_thread)
+{
+    //arrange
+    unsigned int poolSize = 2;
+    TRANSPORT_LL_HANDLE handle = IoTHubTransportHttp_Create(&TEST_CONFIG, &transport_cb_info, transport_cb_ctx);
+    (void)IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_CONFIG.waitingToSend);
+    (void)IoTHubTransportHttp_SetOption(handle, OPTION_HTTP_CONNECTION_POOL_SIZE, &poolSize);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(Lock_Init());
+    STRICT_EXPECTED_CALL(Condition_Init());
+    STRICT_EXPECTED_CALL(ThreadAPI_Create(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(Lock(TEST_LOCK_HANDLE));
+    STRICT_EXPECTED_CALL(Condition_Post(TEST_COND_HANDLE));
+    STRICT_EXPECTED_CALL(Unlock(TEST_LOCK_HANDLE));
+    setupDoWorkLoopOnceForOneDevice();
+    STRICT_EXPECTED_CALL(DList_IsListEmpty(&waitingToSend)); /*because DoWork for event*/
+    STRICT_EXPECTED_CALL(Lock(TEST_LOCK_HANDLE));
+    STRICT_EXPECTED_CALL(Condition_Wait(TEST_COND_HANDLE, TEST_LOCK_HANDLE, 0));
+    STRICT_EXPECTED_CALL(Unlock(TEST_LOCK_HANDLE));
+    STRICT_EXPECTED_CALL(VECTOR_size(IGNORED_PTR_ARG)); /*deferred callbacks*/
+    STRICT_EXPECTED_CALL(VECTOR_element(IGNORED_PTR_ARG, 0));
+
+    //act
+    IoTHubTransportHttp_DoWork(handle);
+
+    //assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    //cleanup
+    IoTHubTransportHttp_Destroy(handle);
+}
+
+//Tests_SRS_TRANSPORTMULTITHTTP_44_011: [ If ThreadAPI_Create fails, the devices of that connection shall be served on the calling thread. ]
+TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_HttpConnectionPoolSize_2_when_ThreadAPI_Create_fails_serves_the_second_connection_inline)
+{
+    //arrange
+    unsigned int poolSize = 2;
+    TRANSPORT_LL_HANDLE handle = IoTHubTransportHttp_Create(&TEST_CONFIG, &transport_cb_info, transport_cb_ctx);
+    (void)IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_CONFIG.waitingToSend);
+    (void)IoTHubTransportHttp_SetOption(handle, OPTION_HTTP_CONNECTION_POOL_SIZE, &poolSize);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(Lock_Init());
+    STRICT_EXPECTED_CALL(Condition_Init());
+    STRICT_EXPECTED_CALL(ThreadAPI_Create(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .SetReturn(THREADAPI_ERROR);
+    STRICT_EXPECTED_CALL(Condition_Deinit(TEST_COND_HANDLE));
+    STRICT_EXPECTED_CALL(Lock_Deinit(TEST_LOCK_HANDLE));
+    setupDoWorkLoopOnceForOneDevice();
+    STRICT_EXPECTED_CALL(DList_IsListEmpty(&waitingToSend)); /*because DoWork for event*/
+    STRICT_EXPECTED_CALL(VECTOR_size(IGNORED_PTR_ARG)); /*the second connection has no device to serve*/
+
+    //act
+    IoTHubTransportHttp_DoWork(handle);
+
+    //assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    //cleanup
+    IoTHubTransportHttp_Destroy(handle);
+}
+
+//Tests_SRS_TRANSPORTMULTITHTTP_44_010: [ If the pool has more than one connection, IoTHubTransportHttp_DoWork shall hand every connection but the first one to its own thread, started with ThreadAPI_Create by the first call and kept until the pool is destroyed, serve the first one on the calling thread, and wait for the threads to finish the pass before returning. ]
+TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_HttpConnectionPoolSize_2_twice_starts_the_thread_once)
+{
+    //arrange
+    unsigned int poolSize = 2;
+    TRANSPORT_LL_HANDLE handle = IoTHubTransportHttp_Create(&TEST_CONFIG, &transport_cb_info, transport_cb_ctx);
+    (void)IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_CONFIG.waitingToSend);
+    (void)IoTHubTransportHttp_SetOption(handle, OPTION_HTTP_CONNECTION_POOL_SIZE, &poolSize);
+    IoTHubTransportHttp_DoWork(handle);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(Lock(TEST_LOCK_HANDLE));
+    STRICT_EXPECTED_CALL(Condition_Post(TEST_COND_HANDLE));
+    STRICT_EXPECTED_CALL(Unlock(TEST_LOCK_HANDLE));
+    setupDoWorkLoopOnceForOneDevice();
+    STRICT_EXPECTED_CALL(DList_IsListEmpty(&waitingToSend)); /*because DoWork for event*/
+    STRICT_EXPECTED_CALL(Lock(TEST_LOCK_HANDLE));
+    STRICT_EXPECTED_CALL(Condition_Wait(TEST_COND_HANDLE, TEST_LOCK_HANDLE, 0));
+    STRICT_EXPECTED_CALL(Unlock(TEST_LOCK_HANDLE));
+    STRICT_EXPECTED_CALL(VECTOR_size(IGNORED_PTR_ARG)); /*deferred callbacks*/
+    STRICT_EXPECTED_CALL(VECTOR_element(IGNORED_PTR_ARG, 0));
+
+    //act
+    IoTHubTransportHttp_DoWork(handle);
+
+    //assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    //cleanup
+    IoTHubTransportHttp_Destroy(handle);
+}
+
+//Tests_SRS_TRANSPORTMULTITHTTP_44_022: [ The threads of the pool shall be stopped and joined when the pool is replaced or the transport is destroyed. ]
+TEST_FUNCTION(IoTHubTransportHttp_SetOption_HttpConnectionPoolSize_1_after_DoWork_joins_the_pool_thread)
+{
+    //arrange
+    unsigned int poolSize = 2;
+    unsigned int newPoolSize = 1;
+    TRANSPORT_LL_HANDLE handle = IoTHubTransportHttp_Create(&TEST_CONFIG, &transport_cb_info, transport_cb_ctx);
+    (void)IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_CONFIG.waitingToSend);
+    (void)IoTHubTransportHttp_SetOption(handle, OPTION_HTTP_CONNECTION_POOL_SIZE, &poolSize);
+    IoTHubTransportHttp_DoWork(handle);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(VECTOR_size(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(VECTOR_element(IGNORED_PTR_ARG, 0));
+    STRICT_EXPECTED_CALL(Lock(TEST_LOCK_HANDLE));
+    STRICT_EXPECTED_CALL(Condition_Post(TEST_COND_HANDLE));
+    STRICT_EXPECTED_CALL(Unlock(TEST_LOCK_HANDLE));
+    STRICT_EXPECTED_CALL(ThreadAPI_Join(IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(Condition_Deinit(TEST_COND_HANDLE));
+    STRICT_EXPECTED_CALL(Lock_Deinit(TEST_LOCK_HANDLE));
+    STRICT_EXPECTED_CALL(HTTPAPIEX_Destroy(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG));
+
+    //act
+    IOTHUB_CLIENT_RESULT result = IoTHubTransportHttp_SetOption(handle, OPTION_HTTP_CONNECTION_POOL_SIZE, &newPoolSize);
+
+    //assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    //cleanup
+    IoTHubTransportHttp_Destroy(handle);
+}
+
 END_TEST_SUITE(iothubtransporthttp_ut)
 
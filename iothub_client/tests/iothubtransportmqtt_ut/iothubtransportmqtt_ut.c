@@ -113,6 +113,7 @@ static pfIoTHubTransport_Subscribe_InputQueue       IoTHubTransportMqtt_Subscrib
 static pfIoTHubTransport_Unsubscribe_InputQueue     IoTHubTransportMqtt_Unsubscribe_InputQueue;
 static pfIoTHubTransport_SetCallbackContext         IoTHubTransportMqtt_SetCallbackContext;
 static pfIoTHubTransport_GetSupportedPlatformInfo   IotHubTransportMqtt_GetSupportedPlatformInfo;
+static pfIoTHubTransport_GetRttStatistics         IotHubTransportMqtt_GetRttStatistics;
 
 static TRANSPORT_LL_HANDLE my_IoTHubTransport_MQTT_Common_Create(const IOTHUBTRANSPORT_CONFIG* config, MQTT_GET_IO_TRANSPORT get_io_transport, TRANSPORT_CALLBACKS_INFO* cb_info, void* ctx)
 {
@@ -358,6 +359,7 @@ TEST_SUITE_INITIALIZE(suite_init)
     IoTHubTransportMqtt_Unsubscribe_InputQueue = ((TRANSPORT_PROVIDER*)MQTT_Protocol())->IoTHubTransport_Unsubscribe_InputQueue;
     IoTHubTransportMqtt_SetCallbackContext = ((TRANSPORT_PROVIDER*)MQTT_Protocol())->IoTHubTransport_SetCallbackContext;
     IotHubTransportMqtt_GetSupportedPlatformInfo = ((TRANSPORT_PROVIDER*)MQTT_Protocol())->IoTHubTransport_GetSupportedPlatformInfo;
+    IotHubTransportMqtt_GetRttStatistics = ((TRANSPORT_PROVIDER*)MQTT_Protocol())->IoTHubTransport_GetRttStatistics;
 }
 
 TEST_SUITE_CLEANUP(suite_cleanup)
@@ -987,4 +989,28 @@ TEST_FUNCTION(IoTHubTransportMqtt_GetSupportedPlatformInfo_NULL_info)
     // cleanup
 }
 
+/* Tests_SRS_IOTHUB_MQTT_TRANSPORT_44_001: [ IotHubTransportMqtt_GetRttStatistics shall call into the IoTHubTransport_MQTT_Common_GetRttStatistics function and return its result. ] */
+TEST_FUNCTION(IoTHubTransportMqtt_GetRttStatistics_success)
+{
+    // arrange
+    IOTHUBTRANSPORT_CONFIG config = { 0 };
+    SetupIothubTransportConfig(&config, TEST_DEVICE_ID, TEST_DEVICE_KEY, TEST_IOTHUB_NAME, TEST_IOTHUB_SUFFIX, TEST_PROTOCOL_GATEWAY_HOSTNAME);
+    TRANSPORT_LL_HANDLE handle = IoTHubTransportMqtt_Create(&config, g_transport_cb_info, NULL);
+
+    IOTHUB_CLIENT_RTT_STATISTICS rtt_statistics;
+
+    umock_c_reset_all_calls();
+    STRICT_EXPECTED_CALL(IoTHubTransport_MQTT_Common_GetRttStatistics(handle, &rtt_statistics))
+        .SetReturn(IOTHUB_CLIENT_OK);
+
+    // act
+    IOTHUB_CLIENT_RESULT result = IotHubTransportMqtt_GetRttStatistics(handle, &rtt_statistics);
+
+    // assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
+
+    // cleanup
+}
+
 END_TEST_SUITE(iothubtransportmqtt_ut)
@@ -572,6 +572,7 @@ static pfIoTHubTransport_Unsubscribe_DeviceMethod   IoTHubTransportMqtt_WS_Unsub
 static pfIoTHubTransport_ProcessItem                IoTHubTransportMqtt_WS_ProcessItem;
 static pfIoTHubTransport_SetCallbackContext         IotHubTransportMqtt_WS_SetCallbackContext;
 static pfIoTHubTransport_GetSupportedPlatformInfo   IotHubTransportMqtt_WS_GetSupportedPlatformInfo;
+static pfIoTHubTransport_GetRttStatistics         IotHubTransportMqtt_WS_GetRttStatistics;
 
 static TRANSPORT_LL_HANDLE my_IoTHubTransport_MQTT_Common_Create(const IOTHUBTRANSPORT_CONFIG* config, MQTT_GET_IO_TRANSPORT get_io_transport, TRANSPORT_CALLBACKS_INFO* cb_info, void* ctx)
 {
@@ -666,6 +667,7 @@ TEST_SUITE_INITIALIZE(suite_init)
     IoTHubTransportMqtt_WS_ProcessItem = ((TRANSPORT_PROVIDER*)MQTT_WebSocket_Protocol())->IoTHubTransport_ProcessItem;
     IotHubTransportMqtt_WS_SetCallbackContext = ((TRANSPORT_PROVIDER*)MQTT_WebSocket_Protocol())->IoTHubTransport_SetCallbackContext;
     IotHubTransportMqtt_WS_GetSupportedPlatformInfo = ((TRANSPORT_PROVIDER*)MQTT_WebSocket_Protocol())->IoTHubTransport_GetSupportedPlatformInfo;
+    IotHubTransportMqtt_WS_GetRttStatistics = ((TRANSPORT_PROVIDER*)MQTT_WebSocket_Protocol())->IoTHubTransport_GetRttStatistics;
 }
 
 TEST_SUITE_CLEANUP(suite_cleanup)
@@ -1355,4 +1357,28 @@ TEST_FUNCTION(IoTHubTransportMqtt_WS_GetSupportedPlatformInfo_NULL_info)
     // cleanup
 }
 
+/* Tests_SRS_IOTHUB_MQTT_WEBSOCKET_TRANSPORT_44_001: [ IotHubTransportMqtt_WS_GetRttStatistics shall call into the IoTHubTransport_MQTT_Common_GetRttStatistics function and return its result. ] */
+TEST_FUNCTION(IoTHubTransportMqtt_WS_GetRttStatistics_success)
+{
+    // arrange
+    IOTHUBTRANSPORT_CONFIG config = { 0 };
+    SetupIothubTransportConfig(&config, TEST_DEVICE_ID, TEST_DEVICE_KEY, TEST_IOTHUB_NAME, TEST_IOTHUB_SUFFIX, TEST_PROTOCOL_GATEWAY_HOSTNAME);
+    TRANSPORT_LL_HANDLE handle = IoTHubTransportMqtt_WS_Create(&config, transport_cb_info, NULL);
+
+    IOTHUB_CLIENT_RTT_STATISTICS rtt_statistics;
+
+    umock_c_reset_all_calls();
+    STRICT_EXPECTED_CALL(IoTHubTransport_MQTT_Common_GetRttStatistics(handle, &rtt_statistics))
+        .SetReturn(IOTHUB_CLIENT_OK);
+
+    // act
+    IOTHUB_CLIENT_RESULT result = IotHubTransportMqtt_WS_GetRttStatistics(handle, &rtt_statistics);
+
+    // assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
+
+    // cleanup
+}
+
 END_TEST_SUITE(iothubtransportmqtt_ws_ut)
@@ -0,0 +1,496 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#ifdef __cplusplus
+#include <cstdlib>
+#include <cstddef>
+#include <cstring>
+#include <cstdio>
+#else
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdbool.h>
+#endif
+
+#include <dirent.h>
+#include <unistd.h>
+
+#include "testrunnerswitcher.h"
+
+#include "iothub_message.h"
+#include "internal/message_store.h"
+
+#define MAX_STORED_MESSAGES 4096
+#define LARGE_PAYLOAD_SIZE (200 * 1024)
+
+typedef struct STORED_MESSAGE_TAG
+{
+    IOTHUB_MESSAGE_HANDLE message;
+    size_t position;
+} STORED_MESSAGE;
+
+static TEST_MUTEX_HANDLE g_testByTest;
+static char g_directory[64];
+static STORED_MESSAGE g_stored_messages[MAX_STORED_MESSAGES];
+static size_t g_stored_message_count;
+
+static void on_stored_message(IOTHUB_MESSAGE_HANDLE message, size_t position, void* context)
+{
+    (void)context;
+    ASSERT_IS_TRUE(g_stored_message_count < MAX_STORED_MESSAGES);
+    g_stored_messages[g_stored_message_count].message = message;
+    g_stored_messages[g_stored_message_count].position = position;
+    g_stored_message_count++;
+}
+
+static void destroy_stored_messages(void)
+{
+    size_t index;
+    for (index = 0; index < g_stored_message_count; index++)
+    {
+        IoTHubMessage_Destroy(g_stored_messages[index].message);
+    }
+    g_stored_message_count = 0;
+}
+
+static void remove_test_directory(void)
+{
+    DIR* directory = opendir(g_directory);
+    if (directory != NULL)
+    {
+        struct dirent* file;
+        while ((file = readdir(directory)) != NULL)
+        {
+            if (file->d_name[0] != '.')
+            {
+                char path[128];
+                (void)snprintf(path, sizeof(path), "%s/%s", g_directory, file->d_name);
+                (void)unlink(path);
+            }
+        }
+        (void)closedir(directory);
+    }
+    (void)rmdir(g_directory);
+}
+
+static IOTHUB_MESSAGE_HANDLE create_test_message(const char* payload)
+{
+    IOTHUB_MESSAGE_HANDLE message = IoTHubMessage_CreateFromByteArray((const unsigned char*)payload, strlen(payload));
+    ASSERT_IS_NOT_NULL(message);
+    return message;
+}
+
+static size_t append_test_message(MESSAGE_STORE_HANDLE store, const char* payload)
+{
+    size_t position = 0;
+    IOTHUB_MESSAGE_HANDLE message = create_test_message(payload);
+    ASSERT_ARE_EQUAL(int, 0, message_store_append(store, message, &position));
+    IoTHubMessage_Destroy(message);
+    return position;
+}
+
+static void assert_payload(IOTHUB_MESSAGE_HANDLE message, const char* expected_payload)
+{
+    const unsigned char* payload;
+    size_t size;
+    ASSERT_ARE_EQUAL(int, IOTHUB_MESSAGE_OK, IoTHubMessage_GetByteArray(message, &payload, &size));
+    ASSERT_ARE_EQUAL(size_t, strlen(expected_payload), size);
+    ASSERT_ARE_EQUAL(int, 0, memcmp(expected_payload, payload, size));
+}
+
+static MESSAGE_STORE_HANDLE reopen_store(MESSAGE_STORE_HANDLE store)
+{
+    message_store_close(store);
+    destroy_stored_messages();
+    store = message_store_open(g_directory, on_stored_message, NULL);
+    ASSERT_IS_NOT_NULL(store);
+    return store;
+}
+
+static size_t fill_store(MESSAGE_STORE_HANDLE store, IOTHUB_MESSAGE_HANDLE message, size_t* positions)
+{
+    size_t count = 0;
+    while (count < MAX_STORED_MESSAGES && message_store_append(store, message, &positions[count]) == 0)
+    {
+        count++;
+    }
+    ASSERT_IS_TRUE(count < MAX_STORED_MESSAGES);
+    return count;
+}
+
+BEGIN_TEST_SUITE(message_store_ut)
+
+TEST_SUITE_INITIALIZE(TestClassInitialize)
+{
+    g_testByTest = TEST_MUTEX_CREATE();
+    ASSERT_IS_NOT_NULL(g_testByTest);
+}
+
+TEST_SUITE_CLEANUP(TestClassCleanup)
+{
+    TEST_MUTEX_DESTROY(g_testByTest);
+}
+
+TEST_FUNCTION_INITIALIZE(TestMethodInitialize)
+{
+    if (TEST_MUTEX_ACQUIRE(g_testByTest))
+    {
+        ASSERT_FAIL("our mutex is ABANDONED. Failure in test framework");
+    }
+
+    (void)strcpy(g_directory, "/tmp/message_store_ut_XXXXXX");
+    ASSERT_IS_NOT_NULL(mkdtemp(g_directory));
+    g_stored_message_count = 0;
+}
+
+TEST_FUNCTION_CLEANUP(TestMethodCleanup)
+{
+    destroy_stored_messages();
+    remove_test_directory();
+    TEST_MUTEX_RELEASE(g_testByTest);
+}
+
+// Tests_SRS_MESSAGE_STORE_44_001: [ If `directory` or `on_stored_message` are NULL, `message_store_open` shall fail and return NULL. ]
+TEST_FUNCTION(message_store_open_NULL_arguments_fail)
+{
+    // act
+    MESSAGE_STORE_HANDLE store_without_directory = message_store_open(NULL, on_stored_message, NULL);
+    MESSAGE_STORE_HANDLE store_without_callback = message_store_open(g_directory, NULL, NULL);
+
+    // assert
+    ASSERT_IS_NULL(store_without_directory);
+    ASSERT_IS_NULL(store_without_callback);
+}
+
+// Tests_SRS_MESSAGE_STORE_44_003: [ If any of the segment files cannot be opened, created or mapped, `message_store_open` shall fail and return NULL. ]
+TEST_FUNCTION(message_store_open_missing_directory_fails)
+{
+    // arrange
+    char missing_directory[128];
+    (void)snprintf(missing_directory, sizeof(missing_directory), "%s/missing", g_directory);
+
+    // act
+    MESSAGE_STORE_HANDLE store = message_store_open(missing_directory, on_stored_message, NULL);
+
+    // assert
+    ASSERT_IS_NULL(store);
+}
+
+// Tests_SRS_MESSAGE_STORE_44_002: [ `message_store_open` shall create the segment files of the log in `directory` if they do not exist, and map them in memory. ]
+TEST_FUNCTION(message_store_open_empty_directory_succeeds_without_replaying)
+{
+    // act
+    MESSAGE_STORE_HANDLE store = message_store_open(g_directory, on_stored_message, NULL);
+
+    // assert
+    ASSERT_IS_NOT_NULL(store);
+    ASSERT_ARE_EQUAL(size_t, 0, g_stored_message_count);
+
+    // cleanup
+    message_store_close(store);
+}
+
+// Tests_SRS_MESSAGE_STORE_44_006: [ If `store` is NULL, `message_store_close` shall return. ]
+// Tests_SRS_MESSAGE_STORE_44_013: [ If `store` is NULL or `position` is not in the log, `message_store_release` shall return. ]
+// Tests_SRS_MESSAGE_STORE_44_015: [ If `store` is NULL, `message_store_commit` shall fail and return a non-zero value. ]
+TEST_FUNCTION(message_store_NULL_store_is_rejected)
+{
+    // act
+    message_store_close(NULL);
+    message_store_release(NULL, 64);
+
+    // assert
+    ASSERT_ARE_NOT_EQUAL(int, 0, message_store_commit(NULL));
+}
+
+// Tests_SRS_MESSAGE_STORE_44_008: [ If `store`, `message` or `position` are NULL, `message_store_append` shall fail and return a non-zero value. ]
+TEST_FUNCTION(message_store_append_NULL_arguments_fail)
+{
+    // arrange
+    size_t position;
+    MESSAGE_STORE_HANDLE store = message_store_open(g_directory, on_stored_message, NULL);
+    IOTHUB_MESSAGE_HANDLE message = create_test_message("payload");
+
+    // act
+    // assert
+    ASSERT_ARE_NOT_EQUAL(int, 0, message_store_append(NULL, message, &position));
+    ASSERT_ARE_NOT_EQUAL(int, 0, message_store_append(store, NULL, &position));
+    ASSERT_ARE_NOT_EQUAL(int, 0, message_store_append(store, message, NULL));
+
+    // cleanup
+    IoTHubMessage_Destroy(message);
+    message_store_close(store);
+}
+
+// Tests_SRS_MESSAGE_STORE_44_012: [ On success `message_store_append` shall set `position` to the non-zero position of the message in the log and return 0. ]
+// Tests_SRS_MESSAGE_STORE_44_016: [ `message_store_commit` shall synchronously flush to disk the parts of the segments changed since the previous commit, with one flush per changed segment. ]
+TEST_FUNCTION(message_store_append_returns_distinct_non_zero_positions)
+{
+    // arrange
+    MESSAGE_STORE_HANDLE store = message_store_open(g_directory, on_stored_message, NULL);
+
+    // act
+    size_t first_position = append_test_message(store, "first");
+    size_t second_position = append_test_message(store, "second");
+
+    // assert
+    ASSERT_ARE_NOT_EQUAL(size_t, 0, first_position);
+    ASSERT_ARE_NOT_EQUAL(size_t, 0, second_position);
+    ASSERT_ARE_NOT_EQUAL(size_t, first_position, second_position);
+    ASSERT_ARE_EQUAL(int, 0, message_store_commit(store));
+
+    // cleanup
+    message_store_close(store);
+}
+
+// Tests_SRS_MESSAGE_STORE_44_004: [ `message_store_open` shall call `on_stored_message` for every message of the log that was never released, oldest first. ]
+// Tests_SRS_MESSAGE_STORE_44_007: [ `message_store_close` shall commit the log, unmap and close its segment files and free the store, keeping the messages that were not released. ]
+// Tests_SRS_MESSAGE_STORE_44_011: [ `message_store_append` shall serialize the payload, properties, system properties and priority of `message` directly into the mapped log, without flushing it to disk. ]
+TEST_FUNCTION(message_store_open_replays_the_stored_messages)
+{
+    // arrange
+    size_t position;
+    MESSAGE_STORE_HANDLE store = message_store_open(g_directory, on_stored_message, NULL);
+    IOTHUB_MESSAGE_HANDLE message = create_test_message("telemetry");
+    IOTHUB_MESSAGE_HANDLE string_message = IoTHubMessage_CreateFromString("string telemetry");
+    ASSERT_ARE_EQUAL(int, IOTHUB_MESSAGE_OK, IoTHubMessage_SetMessageId(message, "message id"));
+    ASSERT_ARE_EQUAL(int, IOTHUB_MESSAGE_OK, IoTHubMessage_SetCorrelationId(message, "correlation id"));
+    ASSERT_ARE_EQUAL(int, IOTHUB_MESSAGE_OK, IoTHubMessage_SetContentTypeSystemProperty(message, "application/json"));
+    ASSERT_ARE_EQUAL(int, IOTHUB_MESSAGE_OK, IoTHubMessage_SetContentEncodingSystemProperty(message, "utf-8"));
+    ASSERT_ARE_EQUAL(int, IOTHUB_MESSAGE_OK, IoTHubMessage_SetProperty(message, "alert", "true"));
+    ASSERT_ARE_EQUAL(int, IOTHUB_MESSAGE_OK, IoTHubMessage_SetProperty(message, "zone", "7"));
+    ASSERT_ARE_EQUAL(int, IOTHUB_MESSAGE_OK, IoTHubMessage_SetPriority(message, IOTHUB_MESSAGE_PRIORITY_HIGH));
+    ASSERT_ARE_EQUAL(int, 0, message_store_append(store, message, &position));
+    ASSERT_ARE_EQUAL(int, 0, message_store_append(store, string_message, &position));
+
+    // act
+    store = reopen_store(store);
+
+    // assert
+    ASSERT_ARE_EQUAL(size_t, 2, g_stored_message_count);
+    assert_payload(g_stored_messages[0].message, "telemetry");
+    ASSERT_ARE_EQUAL(char_ptr, "message id", IoTHubMessage_GetMessageId(g_stored_messages[0].message));
+    ASSERT_ARE_EQUAL(char_ptr, "correlation id", IoTHubMessage_GetCorrelationId(g_stored_messages[0].message));
+    ASSERT_ARE_EQUAL(char_ptr, "application/json", IoTHubMessage_GetContentTypeSystemProperty(g_stored_messages[0].message));
+    ASSERT_ARE_EQUAL(char_ptr, "utf-8", IoTHubMessage_GetContentEncodingSystemProperty(g_stored_messages[0].message));
+    ASSERT_ARE_EQUAL(char_ptr, "true", IoTHubMessage_GetProperty(g_stored_messages[0].message, "alert"));
+    ASSERT_ARE_EQUAL(char_ptr, "7", IoTHubMessage_GetProperty(g_stored_messages[0].message, "zone"));
+    ASSERT_ARE_EQUAL(int, IOTHUB_MESSAGE_PRIORITY_HIGH, IoTHubMessage_GetPriority(g_stored_messages[0].message));
+    ASSERT_ARE_EQUAL(int, IOTHUBMESSAGE_STRING, IoTHubMessage_GetContentType(g_stored_messages[1].message));
+    ASSERT_ARE_EQUAL(char_ptr, "string telemetry", IoTHubMessage_GetString(g_stored_messages[1].message));
+    ASSERT_IS_NULL(IoTHubMessage_GetMessageId(g_stored_messages[1].message));
+
+    // cleanup
+    IoTHubMessage_Destroy(message);
+    IoTHubMessage_Destroy(string_message);
+    message_store_close(store);
+}
+
+// Tests_SRS_MESSAGE_STORE_44_014: [ `message_store_release` shall mark the message as released, so it is not replayed by `message_store_open` and its segment can be reused once all its messages are released. ]
+TEST_FUNCTION(message_store_open_does_not_replay_released_messages)
+{
+    // arrange
+    MESSAGE_STORE_HANDLE store = message_store_open(g_directory, on_stored_message, NULL);
+    size_t first_position = append_test_message(store, "first");
+    (void)append_test_message(store, "second");
+    size_t third_position = append_test_message(store, "third");
+    (void)append_test_message(store, "fourth");
+
+    // act
+    message_store_release(store, first_position);
+    message_store_release(store, third_position);
+    store = reopen_store(store);
+
+    // assert
+    ASSERT_ARE_EQUAL(size_t, 2, g_stored_message_count);
+    assert_payload(g_stored_messages[0].message, "second");
+    assert_payload(g_stored_messages[1].message, "fourth");
+
+    // cleanup
+    message_store_close(store);
+}
+
+// Tests_SRS_MESSAGE_STORE_44_004: [ `message_store_open` shall call `on_stored_message` for every message of the log that was never released, oldest first. ]
+TEST_FUNCTION(message_store_replayed_messages_can_be_released)
+{
+    // arrange
+    MESSAGE_STORE_HANDLE store = message_store_open(g_directory, on_stored_message, NULL);
+    (void)append_test_message(store, "first");
+    (void)append_test_message(store, "second");
+    store = reopen_store(store);
+    ASSERT_ARE_EQUAL(size_t, 2, g_stored_message_count);
+
+    // act
+    message_store_release(store, g_stored_messages[0].position);
+    (void)append_test_message(store, "third");
+    store = reopen_store(store);
+
+    // assert
+    ASSERT_ARE_EQUAL(size_t, 2, g_stored_message_count);
+    assert_payload(g_stored_messages[0].message, "second");
+    assert_payload(g_stored_messages[1].message, "third");
+
+    // cleanup
+    message_store_close(store);
+}
+
+// Tests_SRS_MESSAGE_STORE_44_013: [ If `store` is NULL or `position` is not in the log, `message_store_release` shall return. ]
+TEST_FUNCTION(message_store_release_twice_keeps_the_other_messages)
+{
+    // arrange
+    MESSAGE_STORE_HANDLE store = message_store_open(g_directory, on_stored_message, NULL);
+    size_t position = append_test_message(store, "first");
+    (void)append_test_message(store, "second");
+
+    // act
+    message_store_release(store, position);
+    message_store_release(store, position);
+    message_store_release(store, 0);
+    store = reopen_store(store);
+
+    // assert
+    ASSERT_ARE_EQUAL(size_t, 1, g_stored_message_count);
+    assert_payload(g_stored_messages[0].message, "second");
+
+    // cleanup
+    message_store_close(store);
+}
+
+// Tests_SRS_MESSAGE_STORE_44_009: [ If the message does not fit in a segment, `message_store_append` shall fail and return a non-zero value. ]
+TEST_FUNCTION(message_store_append_message_larger_than_a_segment_fails)
+{
+    // arrange
+    size_t position;
+    size_t payload_size = 64 * 1024 * 1024;
+    unsigned char* payload = (unsigned char*)calloc(1, payload_size);
+    MESSAGE_STORE_HANDLE store = message_store_open(g_directory, on_stored_message, NULL);
+    IOTHUB_MESSAGE_HANDLE message;
+    ASSERT_IS_NOT_NULL(payload);
+    message = IoTHubMessage_CreateFromByteArray(payload, payload_size);
+    ASSERT_IS_NOT_NULL(message);
+
+    // act
+    int result = message_store_append(store, message, &position);
+
+    // assert
+    ASSERT_ARE_NOT_EQUAL(int, 0, result);
+
+    // cleanup
+    IoTHubMessage_Destroy(message);
+    free(payload);
+    message_store_close(store);
+}
+
+// Tests_SRS_MESSAGE_STORE_44_010: [ If the message does not fit in the current segment and the next one still has messages that were not released, `message_store_append` shall fail and return a non-zero value. ]
+// Tests_SRS_MESSAGE_STORE_44_014: [ `message_store_release` shall mark the message as released, so it is not replayed by `message_store_open` and its segment can be reused once all its messages are released. ]
+TEST_FUNCTION(message_store_append_to_a_full_log_fails_until_messages_are_released)
+{
+    // arrange
+    static size_t positions[MAX_STORED_MESSAGES];
+    size_t position;
+    size_t count;
+    size_t index;
+    unsigned char* payload = (unsigned char*)calloc(1, LARGE_PAYLOAD_SIZE);
+    MESSAGE_STORE_HANDLE store = message_store_open(g_directory, on_stored_message, NULL);
+    IOTHUB_MESSAGE_HANDLE message;
+    ASSERT_IS_NOT_NULL(payload);
+    message = IoTHubMessage_CreateFromByteArray(payload, LARGE_PAYLOAD_SIZE);
+    ASSERT_IS_NOT_NULL(message);
+    count = fill_store(store, message, positions);
+    ASSERT_ARE_NOT_EQUAL(size_t, 0, count);
+
+    // act
+    for (index = 0; index < count; index++)
+    {
+        message_store_release(store, positions[index]);
+    }
+
+    // assert
+    ASSERT_ARE_EQUAL(int, 0, message_store_append(store, message, &position));
+    store = reopen_store(store);
+    ASSERT_ARE_EQUAL(size_t, 1, g_stored_message_count);
+    ASSERT_ARE_EQUAL(size_t, position, g_stored_messages[0].position);
+
+    // cleanup
+    IoTHubMessage_Destroy(message);
+    free(payload);
+    message_store_close(store);
+}
+
+// Tests_SRS_MESSAGE_STORE_44_004: [ `message_store_open` shall call `on_stored_message` for every message of the log that was never released, oldest first. ]
+TEST_FUNCTION(message_store_open_replays_a_wrapped_log_oldest_first)
+{
+    // arrange
+    static size_t positions[MAX_STORED_MESSAGES];
+    size_t count;
+    size_t index;
+    unsigned char* payload = (unsigned char*)malloc(LARGE_PAYLOAD_SIZE);
+    MESSAGE_STORE_HANDLE store = message_store_open(g_directory, on_stored_message, NULL);
+    IOTHUB_MESSAGE_HANDLE message;
+    ASSERT_IS_NOT_NULL(payload);
+    (void)memset(payload, 'a', LARGE_PAYLOAD_SIZE);
+    message = IoTHubMessage_CreateFromByteArray(payload, LARGE_PAYLOAD_SIZE);
+    ASSERT_IS_NOT_NULL(message);
+    count = fill_store(store, message, positions);
+    for (index = 0; index < count / 2; index++)
+    {
+        message_store_release(store, positions[index]);
+    }
+    IoTHubMessage_Destroy(message);
+    (void)memset(payload, 'b', LARGE_PAYLOAD_SIZE);
+    message = IoTHubMessage_CreateFromByteArray(payload, LARGE_PAYLOAD_SIZE);
+    ASSERT_IS_NOT_NULL(message);
+    ASSERT_ARE_EQUAL(int, 0, message_store_append(store, message, &positions[count]));
+
+    // act
+    store = reopen_store(store);
+
+    // assert
+    ASSERT_ARE_EQUAL(size_t, count - (count / 2) + 1, g_stored_message_count);
+    for (index = 0; index < g_stored_message_count; index++)
+    {
+        const unsigned char* stored_payload;
+        size_t stored_size;
+        ASSERT_ARE_EQUAL(int, IOTHUB_MESSAGE_OK, IoTHubMessage_GetByteArray(g_stored_messages[index].message, &stored_payload, &stored_size));
+        ASSERT_ARE_EQUAL(int, (index == g_stored_message_count - 1) ? 'b' : 'a', stored_payload[0]);
+    }
+
+    // cleanup
+    IoTHubMessage_Destroy(message);
+    free(payload);
+    message_store_close(store);
+}
+
+// Tests_SRS_MESSAGE_STORE_44_005: [ Records that are torn or were written before their segment was reused shall be ignored. ]
+TEST_FUNCTION(message_store_open_ignores_a_torn_record)
+{
+    // arrange
+    char path[128];
+    FILE* segment_file;
+    MESSAGE_STORE_HANDLE store = message_store_open(g_directory, on_stored_message, NULL);
+    (void)append_test_message(store, "this message is written completely");
+    size_t torn_position = append_test_message(store, "this message is only written in part");
+    message_store_close(store);
+
+    (void)snprintf(path, sizeof(path), "%s/segment_00.log", g_directory);
+    segment_file = fopen(path, "r+b");
+    ASSERT_IS_NOT_NULL(segment_file);
+    ASSERT_ARE_EQUAL(int, 0, fseek(segment_file, (long)torn_position + 48, SEEK_SET));
+    ASSERT_ARE_NOT_EQUAL(int, EOF, fputc('!', segment_file));
+    (void)fclose(segment_file);
+
+    // act
+    store = message_store_open(g_directory, on_stored_message, NULL);
+
+    // assert
+    ASSERT_IS_NOT_NULL(store);
+    ASSERT_ARE_EQUAL(size_t, 1, g_stored_message_count);
+    assert_payload(g_stored_messages[0].message, "this message is written completely");
+
+    // cleanup
+    message_store_close(store);
+}
+
+END_TEST_SUITE(message_store_ut)
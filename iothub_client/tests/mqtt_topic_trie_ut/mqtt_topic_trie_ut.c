@@ -0,0 +1,268 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#ifdef __cplusplus
+#include <cstdio>
+#include <cstdlib>
+#include <cstddef>
+#include <cstring>
+#else
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+#include <stdbool.h>
+#endif
+
+#include "testrunnerswitcher.h"
+#include "umock_c/umock_c.h"
+
+#include "internal/mqtt_topic_trie.h"
+
+#define TEST_TWIN_VALUE         1
+#define TEST_METHODS_VALUE      2
+#define TEST_INPUT_QUEUE_VALUE  3
+#define TEST_DEFAULT_VALUE      4
+
+static const char TEST_TWIN_PREFIX[] = "$iothub/twin";
+static const char TEST_METHODS_PREFIX[] = "$iothub/methods";
+// Added without its trailing '#', as the transport does with the subscribed input queue topic.
+static const char TEST_INPUT_QUEUE_TOPIC[] = "devices/thisIsDeviceID/modules/thisIsModuleID/#";
+
+static TEST_MUTEX_HANDLE g_testByTest;
+
+MU_DEFINE_ENUM_STRINGS(UMOCK_C_ERROR_CODE, UMOCK_C_ERROR_CODE_VALUES)
+
+static void on_umock_c_error(UMOCK_C_ERROR_CODE error_code)
+{
+    char temp_str[256];
+    (void)snprintf(temp_str, sizeof(temp_str), "umock_c reported error :%s", MU_ENUM_TO_STRING(UMOCK_C_ERROR_CODE, error_code));
+    ASSERT_FAIL(temp_str);
+}
+
+static void add_iothub_prefixes(MQTT_TOPIC_TRIE* trie)
+{
+    mqtt_topic_trie_initialize(trie);
+    ASSERT_ARE_EQUAL(int, 0, mqtt_topic_trie_add(trie, TEST_TWIN_PREFIX, sizeof(TEST_TWIN_PREFIX) - 1, TEST_TWIN_VALUE));
+    ASSERT_ARE_EQUAL(int, 0, mqtt_topic_trie_add(trie, TEST_METHODS_PREFIX, sizeof(TEST_METHODS_PREFIX) - 1, TEST_METHODS_VALUE));
+    ASSERT_ARE_EQUAL(int, 0, mqtt_topic_trie_add(trie, TEST_INPUT_QUEUE_TOPIC, sizeof(TEST_INPUT_QUEUE_TOPIC) - 2, TEST_INPUT_QUEUE_VALUE));
+}
+
+BEGIN_TEST_SUITE(mqtt_topic_trie_ut)
+
+TEST_SUITE_INITIALIZE(TestClassInitialize)
+{
+    g_testByTest = TEST_MUTEX_CREATE();
+    ASSERT_IS_NOT_NULL(g_testByTest);
+
+    umock_c_init(on_umock_c_error);
+}
+
+TEST_SUITE_CLEANUP(TestClassCleanup)
+{
+    umock_c_deinit();
+
+    TEST_MUTEX_DESTROY(g_testByTest);
+}
+
+TEST_FUNCTION_INITIALIZE(TestMethodInitialize)
+{
+    if (TEST_MUTEX_ACQUIRE(g_testByTest))
+    {
+        ASSERT_FAIL("our mutex is ABANDONED. Failure in test framework");
+    }
+
+    umock_c_reset_all_calls();
+}
+
+TEST_FUNCTION_CLEANUP(TestMethodCleanup)
+{
+    TEST_MUTEX_RELEASE(g_testByTest);
+}
+
+// Tests_SRS_MQTT_TOPIC_TRIE_44_001: [ If `trie` is NULL, `mqtt_topic_trie_initialize` shall return. ]
+TEST_FUNCTION(mqtt_topic_trie_initialize_NULL_trie_returns)
+{
+    // act
+    mqtt_topic_trie_initialize(NULL);
+
+    // assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+// Tests_SRS_MQTT_TOPIC_TRIE_44_002: [ `mqtt_topic_trie_initialize` shall set the trie as holding no prefix. ]
+// Tests_SRS_MQTT_TOPIC_TRIE_44_007: [ `mqtt_topic_trie_match` shall return the value of the longest prefix added to `trie` that `topic` starts with, ignoring ASCII case, or MQTT_TOPIC_TRIE_NO_MATCH if there is none. ]
+// Tests_SRS_MQTT_TOPIC_TRIE_44_008: [ If `matched_length` is not NULL, `mqtt_topic_trie_match` shall store in it the length of the matched prefix, or 0 if there is none. ]
+TEST_FUNCTION(mqtt_topic_trie_initialize_matches_nothing)
+{
+    // arrange
+    MQTT_TOPIC_TRIE trie;
+    size_t matched_length = 42;
+    (void)memset(&trie, 0xAA, sizeof(trie));
+
+    // act
+    mqtt_topic_trie_initialize(&trie);
+
+    // assert
+    ASSERT_ARE_EQUAL(int, MQTT_TOPIC_TRIE_NO_MATCH, mqtt_topic_trie_match(&trie, "$iothub/twin/res/200/?$rid=1", &matched_length));
+    ASSERT_ARE_EQUAL(size_t, 0, matched_length);
+    ASSERT_ARE_EQUAL(int, MQTT_TOPIC_TRIE_NO_MATCH, mqtt_topic_trie_match(&trie, "", NULL));
+}
+
+// Tests_SRS_MQTT_TOPIC_TRIE_44_003: [ If `trie` is NULL, `prefix` is NULL with a non-zero `prefix_length` or `value` is negative, `mqtt_topic_trie_add` shall fail and return a non-zero value. ]
+TEST_FUNCTION(mqtt_topic_trie_add_invalid_arguments_fail)
+{
+    // arrange
+    MQTT_TOPIC_TRIE trie;
+    mqtt_topic_trie_initialize(&trie);
+
+    // act
+    int result_trie = mqtt_topic_trie_add(NULL, TEST_TWIN_PREFIX, sizeof(TEST_TWIN_PREFIX) - 1, TEST_TWIN_VALUE);
+    int result_prefix = mqtt_topic_trie_add(&trie, NULL, 1, TEST_TWIN_VALUE);
+    int result_value = mqtt_topic_trie_add(&trie, TEST_TWIN_PREFIX, sizeof(TEST_TWIN_PREFIX) - 1, -1);
+
+    // assert
+    ASSERT_ARE_NOT_EQUAL(int, 0, result_trie);
+    ASSERT_ARE_NOT_EQUAL(int, 0, result_prefix);
+    ASSERT_ARE_NOT_EQUAL(int, 0, result_value);
+    ASSERT_ARE_EQUAL(size_t, 1, trie.node_count);
+}
+
+// Tests_SRS_MQTT_TOPIC_TRIE_44_005: [ Otherwise `mqtt_topic_trie_add` shall add `prefix` to `trie` so that matching topics starting with it returns `value`, replacing the value of a prefix added before with the same characters, and return 0. ]
+// Tests_SRS_MQTT_TOPIC_TRIE_44_007: [ `mqtt_topic_trie_match` shall return the value of the longest prefix added to `trie` that `topic` starts with, ignoring ASCII case, or MQTT_TOPIC_TRIE_NO_MATCH if there is none. ]
+// Tests_SRS_MQTT_TOPIC_TRIE_44_008: [ If `matched_length` is not NULL, `mqtt_topic_trie_match` shall store in it the length of the matched prefix, or 0 if there is none. ]
+TEST_FUNCTION(mqtt_topic_trie_match_classifies_iothub_topics)
+{
+    // arrange
+    MQTT_TOPIC_TRIE trie;
+    size_t matched_length;
+    add_iothub_prefixes(&trie);
+
+    // act
+    int twin = mqtt_topic_trie_match(&trie, "$iothub/twin/res/200/?$rid=2", &matched_length);
+
+    // assert
+    ASSERT_ARE_EQUAL(int, TEST_TWIN_VALUE, twin);
+    ASSERT_ARE_EQUAL(size_t, sizeof(TEST_TWIN_PREFIX) - 1, matched_length);
+    ASSERT_ARE_EQUAL(int, TEST_METHODS_VALUE, mqtt_topic_trie_match(&trie, "$iothub/methods/POST/method_name/?$rid=b", &matched_length));
+    ASSERT_ARE_EQUAL(size_t, sizeof(TEST_METHODS_PREFIX) - 1, matched_length);
+    ASSERT_ARE_EQUAL(int, TEST_INPUT_QUEUE_VALUE, mqtt_topic_trie_match(&trie, "devices/thisIsDeviceID/modules/thisIsModuleID/inputs/input1", &matched_length));
+    ASSERT_ARE_EQUAL(size_t, sizeof(TEST_INPUT_QUEUE_TOPIC) - 2, matched_length);
+    ASSERT_ARE_EQUAL(int, MQTT_TOPIC_TRIE_NO_MATCH, mqtt_topic_trie_match(&trie, "devices/thisIsDeviceID/messages/devicebound/", &matched_length));
+    ASSERT_ARE_EQUAL(size_t, 0, matched_length);
+    ASSERT_ARE_EQUAL(int, MQTT_TOPIC_TRIE_NO_MATCH, mqtt_topic_trie_match(&trie, "$iothub/meth", &matched_length));
+    ASSERT_ARE_EQUAL(int, MQTT_TOPIC_TRIE_NO_MATCH, mqtt_topic_trie_match(&trie, "", &matched_length));
+}
+
+// Tests_SRS_MQTT_TOPIC_TRIE_44_007: [ `mqtt_topic_trie_match` shall return the value of the longest prefix added to `trie` that `topic` starts with, ignoring ASCII case, or MQTT_TOPIC_TRIE_NO_MATCH if there is none. ]
+TEST_FUNCTION(mqtt_topic_trie_match_ignores_case)
+{
+    // arrange
+    MQTT_TOPIC_TRIE trie;
+    size_t matched_length;
+    add_iothub_prefixes(&trie);
+
+    // act
+    int result = mqtt_topic_trie_match(&trie, "$IOTHUB/Twin/PATCH/properties/desired/?$version=2", &matched_length);
+
+    // assert
+    ASSERT_ARE_EQUAL(int, TEST_TWIN_VALUE, result);
+    ASSERT_ARE_EQUAL(size_t, sizeof(TEST_TWIN_PREFIX) - 1, matched_length);
+    ASSERT_ARE_EQUAL(int, TEST_INPUT_QUEUE_VALUE, mqtt_topic_trie_match(&trie, "DEVICES/thisisdeviceid/Modules/THISISMODULEID/inputs/input1", NULL));
+}
+
+// Tests_SRS_MQTT_TOPIC_TRIE_44_005: [ Otherwise `mqtt_topic_trie_add` shall add `prefix` to `trie` so that matching topics starting with it returns `value`, replacing the value of a prefix added before with the same characters, and return 0. ]
+// Tests_SRS_MQTT_TOPIC_TRIE_44_007: [ `mqtt_topic_trie_match` shall return the value of the longest prefix added to `trie` that `topic` starts with, ignoring ASCII case, or MQTT_TOPIC_TRIE_NO_MATCH if there is none. ]
+TEST_FUNCTION(mqtt_topic_trie_match_returns_the_longest_prefix)
+{
+    // arrange
+    MQTT_TOPIC_TRIE trie;
+    size_t matched_length;
+    add_iothub_prefixes(&trie);
+
+    // act
+    // An empty prefix matches whatever no other prefix does, and prefixes may end inside labels of other prefixes.
+    ASSERT_ARE_EQUAL(int, 0, mqtt_topic_trie_add(&trie, "", 0, TEST_DEFAULT_VALUE));
+    ASSERT_ARE_EQUAL(int, 0, mqtt_topic_trie_add(&trie, "$iothub/tw", 10, 10));
+    ASSERT_ARE_EQUAL(int, 0, mqtt_topic_trie_add(&trie, "devices/thisIsDeviceID/mod", 26, 11));
+
+    // assert
+    ASSERT_ARE_EQUAL(int, TEST_DEFAULT_VALUE, mqtt_topic_trie_match(&trie, "devices/thisIsDeviceID/messages/devicebound/", &matched_length));
+    ASSERT_ARE_EQUAL(size_t, 0, matched_length);
+    ASSERT_ARE_EQUAL(int, 10, mqtt_topic_trie_match(&trie, "$iothub/twi", &matched_length));
+    ASSERT_ARE_EQUAL(size_t, 10, matched_length);
+    ASSERT_ARE_EQUAL(int, TEST_TWIN_VALUE, mqtt_topic_trie_match(&trie, "$iothub/twin/res/200/?$rid=2", &matched_length));
+    ASSERT_ARE_EQUAL(size_t, sizeof(TEST_TWIN_PREFIX) - 1, matched_length);
+    ASSERT_ARE_EQUAL(int, 11, mqtt_topic_trie_match(&trie, "devices/thisIsDeviceID/modules/otherModuleID/inputs/input1", &matched_length));
+    ASSERT_ARE_EQUAL(size_t, 26, matched_length);
+    ASSERT_ARE_EQUAL(int, TEST_INPUT_QUEUE_VALUE, mqtt_topic_trie_match(&trie, "devices/thisIsDeviceID/modules/thisIsModuleID/inputs/input1", NULL));
+    ASSERT_ARE_EQUAL(int, TEST_METHODS_VALUE, mqtt_topic_trie_match(&trie, "$iothub/methods/POST/method_name/?$rid=b", NULL));
+}
+
+// Tests_SRS_MQTT_TOPIC_TRIE_44_005: [ Otherwise `mqtt_topic_trie_add` shall add `prefix` to `trie` so that matching topics starting with it returns `value`, replacing the value of a prefix added before with the same characters, and return 0. ]
+TEST_FUNCTION(mqtt_topic_trie_add_existing_prefix_replaces_its_value)
+{
+    // arrange
+    MQTT_TOPIC_TRIE trie;
+    add_iothub_prefixes(&trie);
+    size_t node_count = trie.node_count;
+
+    // act
+    int result = mqtt_topic_trie_add(&trie, "$IOTHUB/TWIN", 12, TEST_DEFAULT_VALUE);
+
+    // assert
+    ASSERT_ARE_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(size_t, node_count, trie.node_count);
+    ASSERT_ARE_EQUAL(int, TEST_DEFAULT_VALUE, mqtt_topic_trie_match(&trie, "$iothub/twin/res/200/?$rid=2", NULL));
+    ASSERT_ARE_EQUAL(int, TEST_METHODS_VALUE, mqtt_topic_trie_match(&trie, "$iothub/methods/POST/method_name/?$rid=b", NULL));
+}
+
+// Tests_SRS_MQTT_TOPIC_TRIE_44_004: [ If `trie` has no room for the nodes `prefix` needs, `mqtt_topic_trie_add` shall fail and return a non-zero value, leaving `trie` unchanged. ]
+TEST_FUNCTION(mqtt_topic_trie_add_fails_when_the_trie_is_full)
+{
+    // arrange
+    static const char* prefixes[] = { "a0", "b0", "c0", "d0", "e0", "f0", "g0", "h0", "i0", "j0", "k0", "l0", "m0", "n0", "o0" };
+    MQTT_TOPIC_TRIE trie;
+    size_t index;
+    mqtt_topic_trie_initialize(&trie);
+    for (index = 0; index < MQTT_TOPIC_TRIE_MAX_NODES - 1; index++)
+    {
+        ASSERT_ARE_EQUAL(int, 0, mqtt_topic_trie_add(&trie, prefixes[index], 2, (int)index));
+    }
+
+    // act
+    int result_new_child = mqtt_topic_trie_add(&trie, "z0", 2, 100);
+    int result_split = mqtt_topic_trie_add(&trie, "a1", 2, 100);
+    int result_existing = mqtt_topic_trie_add(&trie, "a0", 2, 100);
+
+    // assert
+    ASSERT_ARE_NOT_EQUAL(int, 0, result_new_child);
+    ASSERT_ARE_NOT_EQUAL(int, 0, result_split);
+    ASSERT_ARE_EQUAL(int, 0, result_existing);
+    ASSERT_ARE_EQUAL(size_t, MQTT_TOPIC_TRIE_MAX_NODES, trie.node_count);
+    ASSERT_ARE_EQUAL(int, MQTT_TOPIC_TRIE_NO_MATCH, mqtt_topic_trie_match(&trie, "z0/topic", NULL));
+    ASSERT_ARE_EQUAL(int, MQTT_TOPIC_TRIE_NO_MATCH, mqtt_topic_trie_match(&trie, "a1/topic", NULL));
+    ASSERT_ARE_EQUAL(int, 100, mqtt_topic_trie_match(&trie, "a0/topic", NULL));
+    ASSERT_ARE_EQUAL(int, 14, mqtt_topic_trie_match(&trie, "o0/topic", NULL));
+}
+
+// Tests_SRS_MQTT_TOPIC_TRIE_44_006: [ If `trie` or `topic` are NULL, `mqtt_topic_trie_match` shall return MQTT_TOPIC_TRIE_NO_MATCH. ]
+// Tests_SRS_MQTT_TOPIC_TRIE_44_008: [ If `matched_length` is not NULL, `mqtt_topic_trie_match` shall store in it the length of the matched prefix, or 0 if there is none. ]
+TEST_FUNCTION(mqtt_topic_trie_match_NULL_arguments_match_nothing)
+{
+    // arrange
+    MQTT_TOPIC_TRIE trie;
+    size_t matched_length = 42;
+    add_iothub_prefixes(&trie);
+
+    // act
+    int result_trie = mqtt_topic_trie_match(NULL, "$iothub/twin/res/200/?$rid=2", &matched_length);
+    int result_topic = mqtt_topic_trie_match(&trie, NULL, NULL);
+
+    // assert
+    ASSERT_ARE_EQUAL(int, MQTT_TOPIC_TRIE_NO_MATCH, result_trie);
+    ASSERT_ARE_EQUAL(int, MQTT_TOPIC_TRIE_NO_MATCH, result_topic);
+    ASSERT_ARE_EQUAL(size_t, 0, matched_length);
+}
+
+END_TEST_SUITE(mqtt_topic_trie_ut)
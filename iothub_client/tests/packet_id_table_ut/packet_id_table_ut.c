@@ -0,0 +1,324 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#ifdef __cplusplus
+#include <cstdio>
+#include <cstdlib>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#else
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdbool.h>
+#endif
+
+static void* my_gballoc_malloc(size_t size)
+{
+    return malloc(size);
+}
+
+static void my_gballoc_free(void* ptr)
+{
+    free(ptr);
+}
+
+#include "testrunnerswitcher.h"
+#include "umock_c/umock_c.h"
+#include "umock_c/umocktypes_stdint.h"
+
+#define ENABLE_MOCKS
+#include "azure_c_shared_utility/gballoc.h"
+#undef ENABLE_MOCKS
+
+#include "internal/packet_id_table.h"
+
+#define TEST_ITEM_COUNT 65535
+
+static TEST_MUTEX_HANDLE g_testByTest;
+static int g_items[TEST_ITEM_COUNT + 1];
+
+MU_DEFINE_ENUM_STRINGS(UMOCK_C_ERROR_CODE, UMOCK_C_ERROR_CODE_VALUES)
+
+static void on_umock_c_error(UMOCK_C_ERROR_CODE error_code)
+{
+    char temp_str[256];
+    (void)snprintf(temp_str, sizeof(temp_str), "umock_c reported error :%s", MU_ENUM_TO_STRING(UMOCK_C_ERROR_CODE, error_code));
+    ASSERT_FAIL(temp_str);
+}
+
+static void fill_inline_slots(PACKET_ID_TABLE* table)
+{
+    uint16_t packet_id;
+
+    // 3/4 of the inline slots can be used before the table grows.
+    for (packet_id = 1; packet_id <= (PACKET_ID_TABLE_INLINE_SLOT_COUNT * 3) / 4; packet_id++)
+    {
+        ASSERT_ARE_EQUAL(int, 0, packet_id_table_insert(table, packet_id, &g_items[packet_id]));
+    }
+}
+
+BEGIN_TEST_SUITE(packet_id_table_ut)
+
+TEST_SUITE_INITIALIZE(TestClassInitialize)
+{
+    int result;
+
+    g_testByTest = TEST_MUTEX_CREATE();
+    ASSERT_IS_NOT_NULL(g_testByTest);
+
+    umock_c_init(on_umock_c_error);
+
+    result = umocktypes_stdint_register_types();
+    ASSERT_ARE_EQUAL(int, 0, result);
+
+    REGISTER_GLOBAL_MOCK_HOOK(gballoc_malloc, my_gballoc_malloc);
+    REGISTER_GLOBAL_MOCK_FAIL_RETURN(gballoc_malloc, NULL);
+    REGISTER_GLOBAL_MOCK_HOOK(gballoc_free, my_gballoc_free);
+}
+
+TEST_SUITE_CLEANUP(TestClassCleanup)
+{
+    umock_c_deinit();
+
+    TEST_MUTEX_DESTROY(g_testByTest);
+}
+
+TEST_FUNCTION_INITIALIZE(TestMethodInitialize)
+{
+    if (TEST_MUTEX_ACQUIRE(g_testByTest))
+    {
+        ASSERT_FAIL("our mutex is ABANDONED. Failure in test framework");
+    }
+
+    umock_c_reset_all_calls();
+}
+
+TEST_FUNCTION_CLEANUP(TestMethodCleanup)
+{
+    TEST_MUTEX_RELEASE(g_testByTest);
+}
+
+// Tests_SRS_PACKET_ID_TABLE_44_001: [ If `table` is NULL, `packet_id_table_initialize` shall return. ]
+// Tests_SRS_PACKET_ID_TABLE_44_003: [ If `table` is NULL, `packet_id_table_deinitialize` shall return. ]
+TEST_FUNCTION(packet_id_table_initialize_and_deinitialize_NULL_table_return)
+{
+    // act
+    packet_id_table_initialize(NULL);
+    packet_id_table_deinitialize(NULL);
+
+    // assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+// Tests_SRS_PACKET_ID_TABLE_44_002: [ `packet_id_table_initialize` shall set the table as empty, using the slots stored in the table itself. ]
+// Tests_SRS_PACKET_ID_TABLE_44_011: [ `packet_id_table_find` shall return the value added under `packet_id`, or NULL if `packet_id` is not in `table`. ]
+TEST_FUNCTION(packet_id_table_initialize_sets_the_table_as_empty)
+{
+    // arrange
+    PACKET_ID_TABLE table;
+    (void)memset(&table, 0xAA, sizeof(table));
+
+    // act
+    packet_id_table_initialize(&table);
+
+    // assert
+    ASSERT_ARE_EQUAL(size_t, 0, table.count);
+    ASSERT_IS_TRUE(table.slots == table.inline_slots);
+    ASSERT_IS_NULL(packet_id_table_find(&table, 0));
+    ASSERT_IS_NULL(packet_id_table_find(&table, 1));
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+// Tests_SRS_PACKET_ID_TABLE_44_005: [ If `table` or `value` are NULL, `packet_id_table_insert` shall fail and return a non-zero value. ]
+TEST_FUNCTION(packet_id_table_insert_NULL_arguments_fail)
+{
+    // arrange
+    PACKET_ID_TABLE table;
+    packet_id_table_initialize(&table);
+
+    // act
+    int result_table = packet_id_table_insert(NULL, 1, &g_items[1]);
+    int result_value = packet_id_table_insert(&table, 1, NULL);
+
+    // assert
+    ASSERT_ARE_NOT_EQUAL(int, 0, result_table);
+    ASSERT_ARE_NOT_EQUAL(int, 0, result_value);
+    ASSERT_ARE_EQUAL(size_t, 0, table.count);
+}
+
+// Tests_SRS_PACKET_ID_TABLE_44_006: [ If `packet_id` is already in `table`, `packet_id_table_insert` shall fail and return a non-zero value. ]
+TEST_FUNCTION(packet_id_table_insert_existing_packet_id_fails)
+{
+    // arrange
+    PACKET_ID_TABLE table;
+    packet_id_table_initialize(&table);
+    ASSERT_ARE_EQUAL(int, 0, packet_id_table_insert(&table, 7, &g_items[7]));
+
+    // act
+    int result = packet_id_table_insert(&table, 7, &g_items[8]);
+
+    // assert
+    ASSERT_ARE_NOT_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(size_t, 1, table.count);
+    ASSERT_ARE_EQUAL(void_ptr, &g_items[7], packet_id_table_find(&table, 7));
+}
+
+// Tests_SRS_PACKET_ID_TABLE_44_009: [ Otherwise `packet_id_table_insert` shall add `value` to `table` under `packet_id` and return 0. ]
+// Tests_SRS_PACKET_ID_TABLE_44_011: [ `packet_id_table_find` shall return the value added under `packet_id`, or NULL if `packet_id` is not in `table`. ]
+TEST_FUNCTION(packet_id_table_insert_within_the_inline_slots_does_not_allocate)
+{
+    // arrange
+    PACKET_ID_TABLE table;
+    uint16_t packet_id;
+    packet_id_table_initialize(&table);
+    umock_c_reset_all_calls();
+
+    // act
+    fill_inline_slots(&table);
+
+    // assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_IS_TRUE(table.slots == table.inline_slots);
+    ASSERT_ARE_EQUAL(size_t, (PACKET_ID_TABLE_INLINE_SLOT_COUNT * 3) / 4, table.count);
+    for (packet_id = 1; packet_id <= (PACKET_ID_TABLE_INLINE_SLOT_COUNT * 3) / 4; packet_id++)
+    {
+        ASSERT_ARE_EQUAL(void_ptr, &g_items[packet_id], packet_id_table_find(&table, packet_id));
+    }
+    ASSERT_IS_NULL(packet_id_table_find(&table, 0));
+    ASSERT_IS_NULL(packet_id_table_find(&table, 100));
+}
+
+// Tests_SRS_PACKET_ID_TABLE_44_007: [ If adding `value` would make `table` more than 3/4 full, `packet_id_table_insert` shall move the entries to twice as many slots, allocated on the heap. ]
+// Tests_SRS_PACKET_ID_TABLE_44_004: [ `packet_id_table_deinitialize` shall free the slots allocated by the table and set it as empty. ]
+TEST_FUNCTION(packet_id_table_insert_grows_the_table)
+{
+    // arrange
+    PACKET_ID_TABLE table;
+    uint16_t packet_id;
+    packet_id_table_initialize(&table);
+    fill_inline_slots(&table);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(gballoc_malloc(PACKET_ID_TABLE_INLINE_SLOT_COUNT * 2 * sizeof(PACKET_ID_TABLE_SLOT)));
+
+    // act
+    packet_id = (PACKET_ID_TABLE_INLINE_SLOT_COUNT * 3) / 4 + 1;
+    int result = packet_id_table_insert(&table, packet_id, &g_items[packet_id]);
+
+    // assert
+    ASSERT_ARE_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_IS_FALSE(table.slots == table.inline_slots);
+    for (packet_id = 1; packet_id <= (PACKET_ID_TABLE_INLINE_SLOT_COUNT * 3) / 4 + 1; packet_id++)
+    {
+        ASSERT_ARE_EQUAL(void_ptr, &g_items[packet_id], packet_id_table_find(&table, packet_id));
+    }
+
+    // cleanup
+    umock_c_reset_all_calls();
+    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG));
+    packet_id_table_deinitialize(&table);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_ARE_EQUAL(size_t, 0, table.count);
+    ASSERT_IS_TRUE(table.slots == table.inline_slots);
+}
+
+// Tests_SRS_PACKET_ID_TABLE_44_008: [ If allocating the slots fails, `packet_id_table_insert` shall fail and return a non-zero value, leaving `table` unchanged. ]
+TEST_FUNCTION(packet_id_table_insert_fails_when_growing_fails)
+{
+    // arrange
+    PACKET_ID_TABLE table;
+    uint16_t packet_id;
+    packet_id_table_initialize(&table);
+    fill_inline_slots(&table);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG)).SetReturn(NULL);
+
+    // act
+    packet_id = (PACKET_ID_TABLE_INLINE_SLOT_COUNT * 3) / 4 + 1;
+    int result = packet_id_table_insert(&table, packet_id, &g_items[packet_id]);
+
+    // assert
+    ASSERT_ARE_NOT_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_IS_TRUE(table.slots == table.inline_slots);
+    ASSERT_ARE_EQUAL(size_t, (PACKET_ID_TABLE_INLINE_SLOT_COUNT * 3) / 4, table.count);
+    ASSERT_IS_NULL(packet_id_table_find(&table, packet_id));
+    ASSERT_ARE_EQUAL(void_ptr, &g_items[1], packet_id_table_find(&table, 1));
+}
+
+// Tests_SRS_PACKET_ID_TABLE_44_010: [ If `table` is NULL, `packet_id_table_find` shall return NULL. ]
+// Tests_SRS_PACKET_ID_TABLE_44_012: [ If `table` is NULL, `packet_id_table_remove` shall return NULL. ]
+TEST_FUNCTION(packet_id_table_find_and_remove_NULL_table_return_NULL)
+{
+    // act
+    void* found = packet_id_table_find(NULL, 1);
+    void* removed = packet_id_table_remove(NULL, 1);
+
+    // assert
+    ASSERT_IS_NULL(found);
+    ASSERT_IS_NULL(removed);
+}
+
+// Tests_SRS_PACKET_ID_TABLE_44_013: [ `packet_id_table_remove` shall remove the value added under `packet_id` from `table` and return it, or return NULL if `packet_id` is not in `table`. ]
+TEST_FUNCTION(packet_id_table_remove_returns_the_value)
+{
+    // arrange
+    PACKET_ID_TABLE table;
+    packet_id_table_initialize(&table);
+    fill_inline_slots(&table);
+
+    // act
+    void* removed = packet_id_table_remove(&table, 5);
+    void* removed_again = packet_id_table_remove(&table, 5);
+    void* not_found = packet_id_table_remove(&table, 100);
+
+    // assert
+    ASSERT_ARE_EQUAL(void_ptr, &g_items[5], removed);
+    ASSERT_IS_NULL(removed_again);
+    ASSERT_IS_NULL(not_found);
+    ASSERT_ARE_EQUAL(size_t, (PACKET_ID_TABLE_INLINE_SLOT_COUNT * 3) / 4 - 1, table.count);
+    ASSERT_IS_NULL(packet_id_table_find(&table, 5));
+    ASSERT_ARE_EQUAL(void_ptr, &g_items[4], packet_id_table_find(&table, 4));
+    ASSERT_ARE_EQUAL(void_ptr, &g_items[6], packet_id_table_find(&table, 6));
+}
+
+// Tests_SRS_PACKET_ID_TABLE_44_007: [ If adding `value` would make `table` more than 3/4 full, `packet_id_table_insert` shall move the entries to twice as many slots, allocated on the heap. ]
+// Tests_SRS_PACKET_ID_TABLE_44_013: [ `packet_id_table_remove` shall remove the value added under `packet_id` from `table` and return it, or return NULL if `packet_id` is not in `table`. ]
+TEST_FUNCTION(packet_id_table_holds_every_packet_id_removed_out_of_order)
+{
+    // arrange
+    PACKET_ID_TABLE table;
+    uint32_t packet_id;
+    uint32_t step;
+    packet_id_table_initialize(&table);
+
+    for (packet_id = 1; packet_id <= TEST_ITEM_COUNT; packet_id++)
+    {
+        ASSERT_ARE_EQUAL(int, 0, packet_id_table_insert(&table, (uint16_t)packet_id, &g_items[packet_id]));
+    }
+
+    // act
+    // 4099 is prime, so stepping by it visits every packet id once, far from the insertion order.
+    for (packet_id = 1, step = 0; step < TEST_ITEM_COUNT; step++, packet_id = (packet_id + 4099 - 1) % TEST_ITEM_COUNT + 1)
+    {
+        ASSERT_ARE_EQUAL(void_ptr, &g_items[packet_id], packet_id_table_remove(&table, (uint16_t)packet_id));
+        if ((step % 1024) == 0)
+        {
+            ASSERT_IS_NULL(packet_id_table_find(&table, (uint16_t)packet_id));
+        }
+    }
+
+    // assert
+    ASSERT_ARE_EQUAL(size_t, 0, table.count);
+
+    // cleanup
+    packet_id_table_deinitialize(&table);
+}
+
+END_TEST_SUITE(packet_id_table_ut)
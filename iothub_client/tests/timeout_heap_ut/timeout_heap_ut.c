@@ -0,0 +1,336 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#ifdef __cplusplus
+#include <cstdlib>
+#include <cstddef>
+#include <cstring>
+#else
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+#include <stdbool.h>
+#endif
+
+#include "testrunnerswitcher.h"
+
+#include "internal/timeout_heap.h"
+
+#define TEST_ENTRY_COUNT 1000
+
+typedef struct TEST_ITEM_TAG
+{
+    size_t id;
+    bool is_queued;
+    TIMEOUT_HEAP_ENTRY timeout_entry;
+} TEST_ITEM;
+
+static TEST_MUTEX_HANDLE g_testByTest;
+static TEST_ITEM g_items[TEST_ENTRY_COUNT];
+
+static TEST_ITEM* get_item(TIMEOUT_HEAP_ENTRY* entry)
+{
+    return (entry == NULL) ? NULL : (TEST_ITEM*)((unsigned char*)entry - offsetof(TEST_ITEM, timeout_entry));
+}
+
+static void reset_test_items(void)
+{
+    size_t index;
+    (void)memset(g_items, 0, sizeof(g_items));
+    for (index = 0; index < TEST_ENTRY_COUNT; index++)
+    {
+        g_items[index].id = index;
+    }
+}
+
+BEGIN_TEST_SUITE(timeout_heap_ut)
+
+TEST_SUITE_INITIALIZE(TestClassInitialize)
+{
+    g_testByTest = TEST_MUTEX_CREATE();
+    ASSERT_IS_NOT_NULL(g_testByTest);
+}
+
+TEST_SUITE_CLEANUP(TestClassCleanup)
+{
+    TEST_MUTEX_DESTROY(g_testByTest);
+}
+
+TEST_FUNCTION_INITIALIZE(TestMethodInitialize)
+{
+    if (TEST_MUTEX_ACQUIRE(g_testByTest))
+    {
+        ASSERT_FAIL("our mutex is ABANDONED. Failure in test framework");
+    }
+
+    reset_test_items();
+}
+
+TEST_FUNCTION_CLEANUP(TestMethodCleanup)
+{
+    TEST_MUTEX_RELEASE(g_testByTest);
+}
+
+// Tests_SRS_TIMEOUT_HEAP_44_001: [ If `heap` is NULL, `timeout_heap_initialize` shall return. ]
+TEST_FUNCTION(timeout_heap_initialize_NULL_heap_returns)
+{
+    // act
+    timeout_heap_initialize(NULL);
+
+    // assert
+    // (nothing to assert, the call shall not crash)
+}
+
+// Tests_SRS_TIMEOUT_HEAP_44_002: [ `timeout_heap_initialize` shall set the heap as empty. ]
+// Tests_SRS_TIMEOUT_HEAP_44_010: [ `timeout_heap_peek` shall return the entry with the earliest deadline, or NULL if `heap` is empty. ]
+TEST_FUNCTION(timeout_heap_initialize_sets_the_heap_as_empty)
+{
+    // arrange
+    TIMEOUT_HEAP heap;
+    (void)memset(&heap, 0xAA, sizeof(heap));
+
+    // act
+    timeout_heap_initialize(&heap);
+
+    // assert
+    ASSERT_IS_NULL(timeout_heap_peek(&heap));
+    ASSERT_ARE_EQUAL(size_t, 0, heap.count);
+}
+
+// Tests_SRS_TIMEOUT_HEAP_44_003: [ If `heap` or `entry` are NULL, `timeout_heap_insert` shall return. ]
+TEST_FUNCTION(timeout_heap_insert_NULL_arguments_return)
+{
+    // arrange
+    TIMEOUT_HEAP heap;
+    timeout_heap_initialize(&heap);
+
+    // act
+    timeout_heap_insert(NULL, &g_items[0].timeout_entry, 10);
+    timeout_heap_insert(&heap, NULL, 10);
+
+    // assert
+    ASSERT_IS_NULL(timeout_heap_peek(&heap));
+    ASSERT_ARE_EQUAL(size_t, 0, heap.count);
+}
+
+// Tests_SRS_TIMEOUT_HEAP_44_004: [ `timeout_heap_insert` shall add `entry` to `heap` with the given `deadline`, without allocating memory. ]
+// Tests_SRS_TIMEOUT_HEAP_44_010: [ `timeout_heap_peek` shall return the entry with the earliest deadline, or NULL if `heap` is empty. ]
+TEST_FUNCTION(timeout_heap_peek_returns_the_earliest_deadline)
+{
+    // arrange
+    TIMEOUT_HEAP heap;
+    timeout_heap_initialize(&heap);
+
+    // act
+    timeout_heap_insert(&heap, &g_items[0].timeout_entry, 30);
+    timeout_heap_insert(&heap, &g_items[1].timeout_entry, 10);
+    timeout_heap_insert(&heap, &g_items[2].timeout_entry, 20);
+
+    // assert
+    ASSERT_ARE_EQUAL(size_t, 3, heap.count);
+    ASSERT_ARE_EQUAL(size_t, 1, get_item(timeout_heap_peek(&heap))->id);
+}
+
+// Tests_SRS_TIMEOUT_HEAP_44_005: [ Entries with the same `deadline` shall expire in the order they were inserted. ]
+TEST_FUNCTION(timeout_heap_pop_expired_returns_entries_with_the_same_deadline_in_insertion_order)
+{
+    // arrange
+    TIMEOUT_HEAP heap;
+    size_t index;
+    timeout_heap_initialize(&heap);
+
+    for (index = 0; index < 10; index++)
+    {
+        timeout_heap_insert(&heap, &g_items[index].timeout_entry, 100);
+    }
+
+    // act & assert
+    for (index = 0; index < 10; index++)
+    {
+        ASSERT_ARE_EQUAL(size_t, index, get_item(timeout_heap_pop_expired(&heap, 100))->id);
+    }
+    ASSERT_IS_NULL(timeout_heap_pop_expired(&heap, 100));
+}
+
+// Tests_SRS_TIMEOUT_HEAP_44_006: [ If `heap` or `entry` are NULL, `timeout_heap_remove` shall return. ]
+TEST_FUNCTION(timeout_heap_remove_NULL_arguments_return)
+{
+    // arrange
+    TIMEOUT_HEAP heap;
+    timeout_heap_initialize(&heap);
+    timeout_heap_insert(&heap, &g_items[0].timeout_entry, 10);
+
+    // act
+    timeout_heap_remove(NULL, &g_items[0].timeout_entry);
+    timeout_heap_remove(&heap, NULL);
+
+    // assert
+    ASSERT_ARE_EQUAL(size_t, 1, heap.count);
+    ASSERT_ARE_EQUAL(size_t, 0, get_item(timeout_heap_peek(&heap))->id);
+}
+
+// Tests_SRS_TIMEOUT_HEAP_44_007: [ `timeout_heap_remove` shall remove `entry` from `heap`, keeping the order of the remaining entries. ]
+TEST_FUNCTION(timeout_heap_remove_the_earliest_entry_succeeds)
+{
+    // arrange
+    TIMEOUT_HEAP heap;
+    timeout_heap_initialize(&heap);
+    timeout_heap_insert(&heap, &g_items[0].timeout_entry, 10);
+    timeout_heap_insert(&heap, &g_items[1].timeout_entry, 20);
+    timeout_heap_insert(&heap, &g_items[2].timeout_entry, 30);
+
+    // act
+    timeout_heap_remove(&heap, &g_items[0].timeout_entry);
+
+    // assert
+    ASSERT_ARE_EQUAL(size_t, 2, heap.count);
+    ASSERT_ARE_EQUAL(size_t, 1, get_item(timeout_heap_pop_expired(&heap, 100))->id);
+    ASSERT_ARE_EQUAL(size_t, 2, get_item(timeout_heap_pop_expired(&heap, 100))->id);
+    ASSERT_IS_NULL(timeout_heap_pop_expired(&heap, 100));
+}
+
+// Tests_SRS_TIMEOUT_HEAP_44_007: [ `timeout_heap_remove` shall remove `entry` from `heap`, keeping the order of the remaining entries. ]
+TEST_FUNCTION(timeout_heap_remove_an_inner_entry_succeeds)
+{
+    // arrange
+    TIMEOUT_HEAP heap;
+    timeout_heap_initialize(&heap);
+    timeout_heap_insert(&heap, &g_items[0].timeout_entry, 10);
+    timeout_heap_insert(&heap, &g_items[1].timeout_entry, 40);
+    timeout_heap_insert(&heap, &g_items[2].timeout_entry, 20);
+    timeout_heap_insert(&heap, &g_items[3].timeout_entry, 30);
+
+    // act
+    timeout_heap_remove(&heap, &g_items[2].timeout_entry);
+
+    // assert
+    ASSERT_ARE_EQUAL(size_t, 3, heap.count);
+    ASSERT_ARE_EQUAL(size_t, 0, get_item(timeout_heap_pop_expired(&heap, 100))->id);
+    ASSERT_ARE_EQUAL(size_t, 3, get_item(timeout_heap_pop_expired(&heap, 100))->id);
+    ASSERT_ARE_EQUAL(size_t, 1, get_item(timeout_heap_pop_expired(&heap, 100))->id);
+    ASSERT_IS_NULL(timeout_heap_pop_expired(&heap, 100));
+}
+
+// Tests_SRS_TIMEOUT_HEAP_44_008: [ If `entry` is not in `heap`, `timeout_heap_remove` shall return without changing `heap`. ]
+TEST_FUNCTION(timeout_heap_remove_an_entry_not_in_the_heap_does_nothing)
+{
+    // arrange
+    TIMEOUT_HEAP heap;
+    timeout_heap_initialize(&heap);
+    timeout_heap_insert(&heap, &g_items[0].timeout_entry, 10);
+    timeout_heap_insert(&heap, &g_items[1].timeout_entry, 20);
+    (void)timeout_heap_pop_expired(&heap, 10);
+
+    // act
+    timeout_heap_remove(&heap, &g_items[0].timeout_entry);
+    timeout_heap_remove(&heap, &g_items[2].timeout_entry);
+
+    // assert
+    ASSERT_ARE_EQUAL(size_t, 1, heap.count);
+    ASSERT_ARE_EQUAL(size_t, 1, get_item(timeout_heap_peek(&heap))->id);
+}
+
+// Tests_SRS_TIMEOUT_HEAP_44_009: [ If `heap` is NULL, `timeout_heap_peek` shall return NULL. ]
+TEST_FUNCTION(timeout_heap_peek_NULL_heap_returns_NULL)
+{
+    // act
+    TIMEOUT_HEAP_ENTRY* result = timeout_heap_peek(NULL);
+
+    // assert
+    ASSERT_IS_NULL(result);
+}
+
+// Tests_SRS_TIMEOUT_HEAP_44_011: [ If `heap` is NULL, `timeout_heap_pop_expired` shall return NULL. ]
+TEST_FUNCTION(timeout_heap_pop_expired_NULL_heap_returns_NULL)
+{
+    // act
+    TIMEOUT_HEAP_ENTRY* result = timeout_heap_pop_expired(NULL, 10);
+
+    // assert
+    ASSERT_IS_NULL(result);
+}
+
+// Tests_SRS_TIMEOUT_HEAP_44_012: [ If `heap` is empty or the earliest deadline is after `current_ms`, `timeout_heap_pop_expired` shall return NULL. ]
+TEST_FUNCTION(timeout_heap_pop_expired_before_the_earliest_deadline_returns_NULL)
+{
+    // arrange
+    TIMEOUT_HEAP heap;
+    TIMEOUT_HEAP_ENTRY* result;
+    timeout_heap_initialize(&heap);
+    timeout_heap_insert(&heap, &g_items[0].timeout_entry, 10);
+
+    // act
+    result = timeout_heap_pop_expired(&heap, 9);
+
+    // assert
+    ASSERT_IS_NULL(result);
+    ASSERT_ARE_EQUAL(size_t, 1, heap.count);
+}
+
+// Tests_SRS_TIMEOUT_HEAP_44_013: [ Otherwise `timeout_heap_pop_expired` shall remove the entry with the earliest deadline from `heap` and return it. ]
+TEST_FUNCTION(timeout_heap_pop_expired_returns_only_the_expired_entries)
+{
+    // arrange
+    TIMEOUT_HEAP heap;
+    timeout_heap_initialize(&heap);
+    timeout_heap_insert(&heap, &g_items[0].timeout_entry, 30);
+    timeout_heap_insert(&heap, &g_items[1].timeout_entry, 10);
+    timeout_heap_insert(&heap, &g_items[2].timeout_entry, 20);
+
+    // act & assert
+    ASSERT_ARE_EQUAL(size_t, 1, get_item(timeout_heap_pop_expired(&heap, 25))->id);
+    ASSERT_ARE_EQUAL(size_t, 2, get_item(timeout_heap_pop_expired(&heap, 25))->id);
+    ASSERT_IS_NULL(timeout_heap_pop_expired(&heap, 25));
+    ASSERT_ARE_EQUAL(size_t, 1, heap.count);
+    ASSERT_ARE_EQUAL(size_t, 0, get_item(timeout_heap_peek(&heap))->id);
+}
+
+// Tests_SRS_TIMEOUT_HEAP_44_007: [ `timeout_heap_remove` shall remove `entry` from `heap`, keeping the order of the remaining entries. ]
+// Tests_SRS_TIMEOUT_HEAP_44_013: [ Otherwise `timeout_heap_pop_expired` shall remove the entry with the earliest deadline from `heap` and return it. ]
+TEST_FUNCTION(timeout_heap_pop_expired_after_many_inserts_and_removes_returns_entries_in_deadline_order)
+{
+    // arrange
+    TIMEOUT_HEAP heap;
+    TIMEOUT_HEAP_ENTRY* entry;
+    tickcounter_ms_t last_deadline = 0;
+    size_t expected_count = 0;
+    size_t popped_count = 0;
+    size_t index;
+    timeout_heap_initialize(&heap);
+
+    for (index = 0; index < TEST_ENTRY_COUNT; index++)
+    {
+        timeout_heap_insert(&heap, &g_items[index].timeout_entry, (tickcounter_ms_t)((index * 7919) % 997));
+        g_items[index].is_queued = true;
+    }
+
+    for (index = 0; index < TEST_ENTRY_COUNT; index += 3)
+    {
+        timeout_heap_remove(&heap, &g_items[index].timeout_entry);
+        g_items[index].is_queued = false;
+    }
+
+    for (index = 0; index < TEST_ENTRY_COUNT; index++)
+    {
+        expected_count += g_items[index].is_queued ? 1 : 0;
+    }
+
+    // act
+    while ((entry = timeout_heap_pop_expired(&heap, 1000)) != NULL)
+    {
+        TEST_ITEM* item = get_item(entry);
+
+        // assert
+        ASSERT_IS_TRUE(item->is_queued);
+        ASSERT_IS_TRUE(entry->deadline >= last_deadline);
+        last_deadline = entry->deadline;
+        item->is_queued = false;
+        popped_count++;
+    }
+
+    // assert
+    ASSERT_ARE_EQUAL(size_t, expected_count, popped_count);
+    ASSERT_ARE_EQUAL(size_t, 0, heap.count);
+}
+
+END_TEST_SUITE(timeout_heap_ut)
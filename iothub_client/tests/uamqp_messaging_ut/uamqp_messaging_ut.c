@@ -318,30 +318,34 @@ static void set_exp_calls_for_create_encoded_data(IOTHUBMESSAGE_CONTENT_TYPE msg
         .CopyOutArgumentBuffer(2, &encoding_size, sizeof(encoding_size));
 }
 
-static void set_exp_calls_for_message_create_uamqp_encoding_from_iothub_message(size_t number_of_app_properties, IOTHUBMESSAGE_CONTENT_TYPE msg_content_type, bool has_message_id, bool has_correlation_id, bool has_diag_properties, bool has_security_props, const char* content_type, const char* content_encoding)
+static void set_exp_calls_for_create_encoded_sections(size_t number_of_app_properties, IOTHUBMESSAGE_CONTENT_TYPE msg_content_type, bool has_message_id, bool has_correlation_id, bool has_diag_properties, bool has_security_props, const char* content_type, const char* content_encoding)
 {
     set_exp_calls_for_create_encoded_message_properties(has_message_id, has_correlation_id, content_type, content_encoding);
     set_exp_calls_for_create_encoded_application_properties(number_of_app_properties);
     set_exp_calls_for_create_encoded_annotations_properties(has_diag_properties, has_security_props);
 
     set_exp_calls_for_create_encoded_data(msg_content_type);
+}
 
-    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG))
-        .SetReturn(g_encoding_buffer);
-    STRICT_EXPECTED_CALL(amqpvalue_encode(TEST_AMQP_VALUE, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
-
-    if (number_of_app_properties > 0)
+static void set_exp_calls_for_encode_and_destroy_sections(size_t number_of_app_properties, bool has_diag_properties, bool expect_encoding)
+{
+    if (expect_encoding)
     {
         STRICT_EXPECTED_CALL(amqpvalue_encode(TEST_AMQP_VALUE, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
-    }
 
-    if (has_diag_properties)
-    {
+        if (number_of_app_properties > 0)
+        {
+            STRICT_EXPECTED_CALL(amqpvalue_encode(TEST_AMQP_VALUE, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+        }
+
+        if (has_diag_properties)
+        {
+            STRICT_EXPECTED_CALL(amqpvalue_encode(TEST_AMQP_VALUE, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+        }
+
         STRICT_EXPECTED_CALL(amqpvalue_encode(TEST_AMQP_VALUE, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
     }
 
-    STRICT_EXPECTED_CALL(amqpvalue_encode(TEST_AMQP_VALUE, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
-
     STRICT_EXPECTED_CALL(amqpvalue_destroy(TEST_AMQP_VALUE));
     if (number_of_app_properties > 0)
     {
@@ -354,6 +358,16 @@ static void set_exp_calls_for_message_create_uamqp_encoding_from_iothub_message(
     STRICT_EXPECTED_CALL(amqpvalue_destroy(TEST_AMQP_VALUE));
 }
 
+static void set_exp_calls_for_message_create_uamqp_encoding_from_iothub_message(size_t number_of_app_properties, IOTHUBMESSAGE_CONTENT_TYPE msg_content_type, bool has_message_id, bool has_correlation_id, bool has_diag_properties, bool has_security_props, const char* content_type, const char* content_encoding)
+{
+    set_exp_calls_for_create_encoded_sections(number_of_app_properties, msg_content_type, has_message_id, has_correlation_id, has_diag_properties, has_security_props, content_type, content_encoding);
+
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG))
+        .SetReturn(g_encoding_buffer);
+
+    set_exp_calls_for_encode_and_destroy_sections(number_of_app_properties, has_diag_properties, true);
+}
+
 static void set_exp_calls_for_message_create_IoTHubMessage_from_uamqp_message(
     size_t number_of_properties,
     bool has_message_id,
@@ -1061,6 +1075,116 @@ TEST_FUNCTION(message_create_from_iothub_message_STRING_return_errors_fails)
     umock_c_negative_tests_deinit();
 }
 
+// Tests_SRS_UAMQP_MESSAGING_44_001: [`message_create_uamqp_encoding_from_iothub_message_into_buffer` shall encode the message the same way as `message_create_uamqp_encoding_from_iothub_message`, but into `encoding_buffer->bytes`; `body_binary_data->bytes` shall point into `encoding_buffer` and is only valid until the next call with the same buffer.]
+// Tests_SRS_UAMQP_MESSAGING_44_002: [If `encoding_buffer->capacity` is smaller than the encoded length, `encoding_buffer->bytes` shall be grown with realloc(), doubling from ENCODING_BUFFER_INITIAL_CAPACITY and never past `encoding_buffer->max_capacity`.]
+TEST_FUNCTION(message_create_uamqp_encoding_from_iothub_message_into_buffer_grows_buffer_success)
+{
+    // arrange
+    umock_c_reset_all_calls();
+    set_exp_calls_for_create_encoded_sections(1, IOTHUBMESSAGE_BYTEARRAY, true, true, true, false, TEST_CONTENT_TYPE, TEST_CONTENT_ENCODING);
+    STRICT_EXPECTED_CALL(gballoc_realloc(NULL, 1024))
+        .SetReturn(g_encoding_buffer);
+    set_exp_calls_for_encode_and_destroy_sections(1, true, true);
+
+    UAMQP_ENCODING_BUFFER encoding_buffer;
+    encoding_buffer.bytes = NULL;
+    encoding_buffer.capacity = 0;
+    encoding_buffer.max_capacity = 256 * 1024;
+
+    BINARY_DATA binary_data;
+    memset(&binary_data, 0, sizeof(binary_data));
+
+    // act
+    int result = message_create_uamqp_encoding_from_iothub_message_into_buffer(NULL, TEST_IOTHUB_MESSAGE_HANDLE, &encoding_buffer, &binary_data);
+
+    // assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_ARE_EQUAL(int, result, 0);
+    ASSERT_ARE_EQUAL(void_ptr, (void*)g_encoding_buffer, (void*)encoding_buffer.bytes);
+    ASSERT_ARE_EQUAL(size_t, 1024, encoding_buffer.capacity);
+    ASSERT_ARE_EQUAL(void_ptr, (void*)encoding_buffer.bytes, (void*)binary_data.bytes);
+    ASSERT_ARE_EQUAL(size_t, TEST_AMQP_ENCODING_SIZE * 4, binary_data.length);
+
+    // cleanup
+}
+
+// Tests_SRS_UAMQP_MESSAGING_44_001: [`message_create_uamqp_encoding_from_iothub_message_into_buffer` shall encode the message the same way as `message_create_uamqp_encoding_from_iothub_message`, but into `encoding_buffer->bytes`; `body_binary_data->bytes` shall point into `encoding_buffer` and is only valid until the next call with the same buffer.]
+TEST_FUNCTION(message_create_uamqp_encoding_from_iothub_message_into_buffer_reuses_buffer_success)
+{
+    // arrange
+    umock_c_reset_all_calls();
+    set_exp_calls_for_create_encoded_sections(1, IOTHUBMESSAGE_STRING, true, true, true, false, TEST_CONTENT_TYPE, TEST_CONTENT_ENCODING);
+    set_exp_calls_for_encode_and_destroy_sections(1, true, true);
+
+    UAMQP_ENCODING_BUFFER encoding_buffer;
+    encoding_buffer.bytes = (unsigned char*)g_encoding_buffer;
+    encoding_buffer.capacity = TEST_AMQP_ENCODING_SIZE * 4;
+    encoding_buffer.max_capacity = 256 * 1024;
+
+    BINARY_DATA binary_data;
+    memset(&binary_data, 0, sizeof(binary_data));
+
+    // act
+    int result = message_create_uamqp_encoding_from_iothub_message_into_buffer(NULL, TEST_IOTHUB_MESSAGE_HANDLE, &encoding_buffer, &binary_data);
+
+    // assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_ARE_EQUAL(int, result, 0);
+    ASSERT_ARE_EQUAL(size_t, TEST_AMQP_ENCODING_SIZE * 4, encoding_buffer.capacity);
+    ASSERT_ARE_EQUAL(void_ptr, (void*)g_encoding_buffer, (void*)binary_data.bytes);
+    ASSERT_ARE_EQUAL(size_t, TEST_AMQP_ENCODING_SIZE * 4, binary_data.length);
+
+    // cleanup
+}
+
+// Tests_SRS_UAMQP_MESSAGING_44_003: [If the encoded length is greater than `encoding_buffer->max_capacity`, nothing shall be encoded; `body_binary_data->bytes` shall be NULL, `body_binary_data->length` shall be the encoded length and RESULT_OK shall be returned.]
+TEST_FUNCTION(message_create_uamqp_encoding_from_iothub_message_into_buffer_larger_than_max_capacity_is_not_encoded)
+{
+    // arrange
+    umock_c_reset_all_calls();
+    set_exp_calls_for_create_encoded_sections(1, IOTHUBMESSAGE_STRING, true, true, true, false, TEST_CONTENT_TYPE, TEST_CONTENT_ENCODING);
+    set_exp_calls_for_encode_and_destroy_sections(1, true, false);
+
+    UAMQP_ENCODING_BUFFER encoding_buffer;
+    encoding_buffer.bytes = NULL;
+    encoding_buffer.capacity = 0;
+    encoding_buffer.max_capacity = TEST_AMQP_ENCODING_SIZE;
+
+    BINARY_DATA binary_data;
+    memset(&binary_data, 0, sizeof(binary_data));
+
+    // act
+    int result = message_create_uamqp_encoding_from_iothub_message_into_buffer(NULL, TEST_IOTHUB_MESSAGE_HANDLE, &encoding_buffer, &binary_data);
+
+    // assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_ARE_EQUAL(int, result, 0);
+    ASSERT_IS_NULL(encoding_buffer.bytes);
+    ASSERT_IS_NULL(binary_data.bytes);
+    ASSERT_ARE_EQUAL(size_t, TEST_AMQP_ENCODING_SIZE * 4, binary_data.length);
+
+    // cleanup
+}
+
+// Tests_SRS_UAMQP_MESSAGING_44_004: [If `encoding_buffer` is NULL, `message_create_uamqp_encoding_from_iothub_message_into_buffer` shall fail and return a non-zero value.]
+TEST_FUNCTION(message_create_uamqp_encoding_from_iothub_message_into_buffer_NULL_encoding_buffer_fails)
+{
+    // arrange
+    umock_c_reset_all_calls();
+
+    BINARY_DATA binary_data;
+    memset(&binary_data, 0, sizeof(binary_data));
+
+    // act
+    int result = message_create_uamqp_encoding_from_iothub_message_into_buffer(NULL, TEST_IOTHUB_MESSAGE_HANDLE, NULL, &binary_data);
+
+    // assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_ARE_NOT_EQUAL(int, result, 0);
+
+    // cleanup
+}
+
 // Tests_SRS_UAMQP_MESSAGING_09_001: [The body type of the uAMQP message shall be retrieved using message_get_body_type().]
 // Tests_SRS_UAMQP_MESSAGING_09_003: [If the uAMQP message body type is MESSAGE_BODY_TYPE_DATA, the body data shall be treated as binary data.]
 // Tests_SRS_UAMQP_MESSAGING_09_004: [The uAMQP message body data shall be retrieved using message_get_body_amqp_data_in_place().]